@@ -0,0 +1,140 @@
+// Batch Evaluation Benchmark - vector implementations against the scalar loop
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_batch bench/bench_batch.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// Every implementation the CPU supports must match perform_operation bit for
+// bit, including zero, negative zero, infinite and NaN divisors, and '^'.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "../calc_batch.h"
+#include "../calc_engine.h"
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Mostly ordinary operands, with the special values sprinkled in
+static double random_operand(void) {
+	static const double special[] = {0.0, -0.0, INFINITY, -INFINITY, NAN, 1e308, 5e-324};
+	if (rand() % 16 == 0) {
+		return special[rand() % (sizeof(special) / sizeof(special[0]))];
+	}
+	return (rand() - RAND_MAX / 2) / 1000.0;
+}
+
+// Bitwise comparison, so -0.0 vs 0.0 counts as a difference
+static int same_results(const double* a, const double* b, size_t count) {
+	return memcmp(a, b, count * sizeof(double)) == 0;
+}
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : 1 << 20;
+	long rounds = argc > 2 ? atol(argv[2]) : 20;
+
+	double* lhs = malloc(count * sizeof(double));
+	double* rhs = malloc(count * sizeof(double));
+	char* ops = malloc(count);
+	char* pow_ops = malloc(count);
+	double* expected = malloc(count * sizeof(double));
+	double* out = malloc(count * sizeof(double));
+	srand(1);
+	for (size_t i = 0; i < count; i++) {
+		lhs[i] = random_operand();
+		rhs[i] = random_operand();
+		ops[i] = "+-*/+-*/="[rand() % 9];  // '=' is an unknown operator: result is rhs
+		pow_ops[i] = i % 5 == 0 ? '^' : ops[i];
+	}
+
+	const calc_batch_isa isas[] = {CALC_BATCH_SCALAR, CALC_BATCH_SSE2, CALC_BATCH_AVX2, CALC_BATCH_NEON};
+	const char column_ops[] = {'+', '-', '*', '/'};
+	double scalar_mixed = 0, scalar_column[4] = {0};
+	calc_batch_isa best = calc_batch_active();
+
+	printf("%-8s %14s %14s %14s %14s %14s\n", "isa", "mixed Mop/s", "+ Mop/s", "- Mop/s", "* Mop/s", "/ Mop/s");
+	for (size_t s = 0; s < sizeof(isas) / sizeof(isas[0]); s++) {
+		if (!calc_batch_select(isas[s])) {
+			continue;
+		}
+
+		// Exactness against perform_operation, including odd lengths for the tails
+		for (size_t length = count - 3; length <= count; length++) {
+			for (size_t i = 0; i < length; i++) {
+				expected[i] = perform_operation(lhs[i], ops[i], rhs[i]);
+			}
+			calc_batch_apply(out, lhs, ops, rhs, length);
+			if (!same_results(out, expected, length)) {
+				printf("%s: mixed results differ from perform_operation\n", calc_batch_isa_name(isas[s]));
+				return 1;
+			}
+
+			// '^' lanes are patched in place, so check with out aliasing lhs
+			for (size_t i = 0; i < length; i++) {
+				expected[i] = perform_operation(lhs[i], pow_ops[i], rhs[i]);
+			}
+			memcpy(out, lhs, length * sizeof(double));
+			calc_batch_apply(out, out, pow_ops, rhs, length);
+			if (!same_results(out, expected, length)) {
+				printf("%s: results with '^' differ from perform_operation\n", calc_batch_isa_name(isas[s]));
+				return 1;
+			}
+			for (size_t i = 0; i < length; i++) {
+				expected[i] = perform_operation(lhs[i], '^', rhs[i]);
+			}
+			calc_batch_apply_column(out, lhs, '^', rhs, length);
+			if (!same_results(out, expected, length)) {
+				printf("%s: '^' column differs from perform_operation\n", calc_batch_isa_name(isas[s]));
+				return 1;
+			}
+
+			for (size_t c = 0; c < 4; c++) {
+				for (size_t i = 0; i < length; i++) {
+					expected[i] = perform_operation(lhs[i], column_ops[c], rhs[i]);
+				}
+				calc_batch_apply_column(out, lhs, column_ops[c], rhs, length);
+				if (!same_results(out, expected, length)) {
+					printf("%s: '%c' column differs from perform_operation\n", calc_batch_isa_name(isas[s]), column_ops[c]);
+					return 1;
+				}
+			}
+		}
+
+		double start = now_seconds();
+		for (long r = 0; r < rounds; r++) {
+			calc_batch_apply(out, lhs, ops, rhs, count);
+		}
+		double mixed = (double)count * rounds / (now_seconds() - start) / 1e6;
+		if (isas[s] == CALC_BATCH_SCALAR) {
+			scalar_mixed = mixed;
+		}
+		printf("%-8s %8.0f x%-4.1f", calc_batch_isa_name(isas[s]), mixed, mixed / scalar_mixed);
+
+		for (size_t c = 0; c < 4; c++) {
+			start = now_seconds();
+			for (long r = 0; r < rounds; r++) {
+				calc_batch_apply_column(out, lhs, column_ops[c], rhs, count);
+			}
+			double column = (double)count * rounds / (now_seconds() - start) / 1e6;
+			if (isas[s] == CALC_BATCH_SCALAR) {
+				scalar_column[c] = column;
+			}
+			printf(" %8.0f x%-4.1f", column, column / scalar_column[c]);
+		}
+		printf("\n");
+	}
+	printf("default: %s\n", calc_batch_isa_name(best));
+
+	free(lhs);
+	free(rhs);
+	free(ops);
+	free(pow_ops);
+	free(expected);
+	free(out);
+	return 0;
+}
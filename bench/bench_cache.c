@@ -0,0 +1,581 @@
+// Result Cache Benchmark - hit rates and speedups on a skewed workload
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_cache bench/bench_cache.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// Checks that values come back intact (including when the buffer is too
+// small), that the cache stays within its budget, that CLOCK keeps a hot set
+// through a stream of one-off keys, that threads looking up and inserting at
+// once never see a torn record, and that cached decimal and rational results
+// are the ones computed without the cache. Then replays a Zipf-distributed
+// stream of decimal quotients and rational powers at several budgets, and
+// the decimal stream on several threads sharing one cache.
+//
+// Usage: bench_cache [operations]
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../calc_cache.h"
+#include "../calc_decimal.h"
+#include "../calc_rational.h"
+
+#define OPERATIONS 200000
+#define DISTINCT 4096
+#define ZIPF_EXPONENT 1.0
+#define PRECISION 100
+#define CHECK_SECONDS 0.3
+
+// ============================================================================
+// Data
+// ============================================================================
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Key and value of record i: the value's length varies with i, and every
+// byte of it depends on i, so a torn or misplaced record shows
+static size_t make_key(char* key, unsigned i) {
+	return (size_t)snprintf(key, 32, "record %u", i);
+}
+
+static size_t make_value(unsigned char* value, unsigned i) {
+	size_t length = 8 + (i * 37) % 600;
+	for (size_t j = 0; j < length; j++) {
+		value[j] = (unsigned char)(i * 131 + j * 7 + (i >> 8));
+	}
+	return length;
+}
+
+static int value_ok(const unsigned char* value, size_t length, unsigned i) {
+	unsigned char want[1024];
+	return length == make_value(want, i) && memcmp(value, want, length) == 0;
+}
+
+static void insert_record(unsigned i) {
+	char key[32];
+	unsigned char value[1024];
+	size_t key_length = make_key(key, i);
+	calc_cache_insert(key, key_length, value, make_value(value, i));
+}
+
+// 0 if record i is not cached, -1 if it came back wrong, else 1
+static int find_record(unsigned i) {
+	char key[32];
+	unsigned char value[1024];
+	size_t key_length = make_key(key, i);
+	size_t length = calc_cache_lookup(key, key_length, value, sizeof(value));
+	if (length == 0) {
+		return 0;
+	}
+	return value_ok(value, length, i) ? 1 : -1;
+}
+
+// Ranks 0 .. n-1 with probability proportional to 1 / (rank + 1)^s
+static unsigned* zipf_stream(size_t count, unsigned n, double s) {
+	double* cdf = malloc(n * sizeof(double));
+	unsigned* stream = malloc(count * sizeof(unsigned));
+	double total = 0;
+	for (unsigned r = 0; r < n; r++) {
+		total += 1.0 / pow(r + 1, s);
+		cdf[r] = total;
+	}
+	for (size_t i = 0; i < count; i++) {
+		double u = (double)(next_random() >> 11) * 0x1p-53 * total;
+		unsigned lo = 0;
+		unsigned hi = n - 1;
+		while (lo < hi) {
+			unsigned mid = (lo + hi) / 2;
+			if (cdf[mid] < u) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		stream[i] = lo;
+	}
+	free(cdf);
+	return stream;
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static size_t failures = 0;
+
+static void fail(const char* what, const char* got, const char* want) {
+	fprintf(stderr, "FAIL %s: got %s, want %s\n", what, got, want);
+	failures++;
+}
+
+static void fail_count(const char* what, uint64_t got, uint64_t want) {
+	char got_text[32];
+	char want_text[32];
+	snprintf(got_text, sizeof(got_text), "%llu", (unsigned long long)got);
+	snprintf(want_text, sizeof(want_text), "%llu", (unsigned long long)want);
+	fail(what, got_text, want_text);
+}
+
+static void check_round_trip(void) {
+	calc_cache_set_budget(1 << 20);
+	for (unsigned i = 0; i < 1000; i++) {
+		insert_record(i);
+		insert_record(i);   // Already there: not stored twice
+	}
+	size_t found = 0;
+	for (unsigned i = 0; i < 1000; i++) {
+		int result = find_record(i);
+		if (result < 0) {
+			fail("round trip", "a different value", "the one inserted");
+			break;
+		}
+		found += (size_t)result;
+	}
+	calc_cache_stats stats;
+	calc_cache_get_stats(&stats);
+	if (found != stats.entries || stats.insertions != stats.entries + stats.evictions) {
+		fail_count("found records", found, stats.entries);
+	}
+	if (found < 900) {
+		fail_count("records kept in 1 MiB", found, 1000);
+	}
+	
+	// Too small a buffer reports the length and copies nothing
+	char key[32];
+	unsigned char value[1024];
+	unsigned char small[4] = {0, 0, 0, 0};
+	size_t key_length = make_key(key, 999);
+	size_t want = make_value(value, 999);
+	size_t length = calc_cache_lookup(key, key_length, small, sizeof(small));
+	if (length != want || small[0] != 0) {
+		fail_count("length with a small buffer", length, want);
+	}
+	if (calc_cache_lookup("absent", 6, value, sizeof(value)) != 0) {
+		fail("absent key", "a hit", "a miss");
+	}
+	
+	calc_cache_set_budget(0);
+	insert_record(1);
+	if (find_record(1) != 0) {
+		fail("budget 0", "a hit", "a miss");
+	}
+}
+
+// Far more data than fits: the ring stays in budget and what is found is right
+static void check_budget(void) {
+	size_t budget = 64 << 10;
+	calc_cache_set_budget(budget);
+	for (unsigned i = 0; i < 20000; i++) {
+		insert_record(i);
+		if (i % 7 == 0 && find_record(i / 2) < 0) {
+			fail("record after wrapping", "a different value", "the one inserted");
+			break;
+		}
+	}
+	calc_cache_stats stats;
+	calc_cache_get_stats(&stats);
+	if (stats.bytes > budget) {
+		fail_count("bytes in a 64 KiB cache", stats.bytes, budget);
+	}
+	if (stats.evictions == 0 || stats.entries == 0) {
+		fail_count("evictions", stats.evictions, 20000 - stats.entries);
+	}
+	for (unsigned i = 0; i < 20000; i++) {
+		if (find_record(i) < 0) {
+			fail("record after wrapping", "a different value", "the one inserted");
+			break;
+		}
+	}
+}
+
+// A hot set that keeps being hit survives a long stream of one-off keys,
+// which FIFO would push out after one pass round the ring
+static void check_clock(void) {
+	calc_cache_set_budget(256 << 10);
+	const unsigned hot = 64;
+	for (unsigned i = 0; i < hot; i++) {
+		insert_record(i);
+	}
+	for (unsigned i = 0; i < 50000; i++) {
+		insert_record(1000000 + i);
+		if (i % 64 == 0) {
+			for (unsigned h = 0; h < hot; h++) {
+				if (find_record(h) == 0) {
+					insert_record(h);
+				}
+			}
+		}
+	}
+	unsigned kept = 0;
+	for (unsigned h = 0; h < hot; h++) {
+		kept += find_record(h) == 1;
+	}
+	if (kept < hot * 9 / 10) {
+		fail_count("hot records kept", kept, hot);
+	}
+}
+
+typedef struct {
+	unsigned seed;
+	uint64_t lookups;
+	uint64_t torn;
+	double until;
+} racer;
+
+// Look up random records and insert the ones missing, as evaluators do
+static void* race(void* arg) {
+	racer* r = arg;
+	uint64_t state = r->seed * 0x9E3779B97F4A7C15ULL + 1;
+	while (now_seconds() < r->until) {
+		for (int n = 0; n < 256; n++) {
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			unsigned i = (unsigned)((state * 0x2545F4914F6CDD1DULL) >> 40) % 8192;
+			int result = find_record(i);
+			if (result < 0) {
+				r->torn++;
+			} else if (result == 0) {
+				insert_record(i);
+			}
+			r->lookups++;
+		}
+	}
+	return NULL;
+}
+
+// A small cache wraps constantly under four threads: no reader may see a
+// record being overwritten
+static void check_threads(void) {
+	enum { THREADS = 4 };
+	calc_cache_set_budget(128 << 10);
+	pthread_t threads[THREADS];
+	racer racers[THREADS];
+	double until = now_seconds() + CHECK_SECONDS;
+	for (int t = 0; t < THREADS; t++) {
+		racers[t] = (racer){(unsigned)t + 1, 0, 0, until};
+		pthread_create(&threads[t], NULL, race, &racers[t]);
+	}
+	uint64_t lookups = 0;
+	uint64_t torn = 0;
+	for (int t = 0; t < THREADS; t++) {
+		pthread_join(threads[t], NULL);
+		lookups += racers[t].lookups;
+		torn += racers[t].torn;
+	}
+	calc_cache_stats stats;
+	calc_cache_get_stats(&stats);
+	if (torn) {
+		fail_count("torn records", torn, 0);
+	}
+	if (stats.hits + stats.misses != lookups) {
+		fail_count("hits and misses", stats.hits + stats.misses, lookups);
+	}
+	if (stats.hits == 0 || stats.evictions == 0) {
+		fail_count("hits under contention", stats.hits, lookups);
+	}
+}
+
+static void random_decimal(calc_decimal* d, int digits) {
+	char text[128];
+	int n = 0;
+	text[n++] = (char)('1' + next_random() % 9);
+	for (int i = 1; i < digits; i++) {
+		text[n++] = (char)('0' + next_random() % 10);
+	}
+	snprintf(text + n, sizeof(text) - (size_t)n, "e%d", (int)(next_random() % 21) - 10 - digits);
+	calc_decimal_set_string(d, text);
+	d->negative = next_random() % 2;
+}
+
+// Uncached, then twice cached (a miss and a hit): the same digits every time
+static void check_decimal(void) {
+	static const char operators[] = "*/";
+	enum { COUNT = 200 };
+	calc_decimal a[COUNT];
+	calc_decimal b[COUNT];
+	calc_decimal result;
+	calc_decimal_init(&result);
+	char* want[COUNT];
+	char got[512];
+	calc_cache_set_budget(0);
+	for (int i = 0; i < COUNT; i++) {
+		calc_decimal_init(&a[i]);
+		calc_decimal_init(&b[i]);
+		random_decimal(&a[i], 90);
+		random_decimal(&b[i], 60 + (int)(next_random() % 31));   // Long enough to cache a product
+		calc_decimal_operation(&result, &a[i], operators[i % 2], &b[i], PRECISION);
+		want[i] = malloc(512);
+		calc_decimal_to_string(&result, want[i], 512, 0);
+	}
+	calc_cache_set_budget(CALC_CACHE_DEFAULT_BUDGET);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < COUNT; i++) {
+			calc_decimal_operation(&result, &a[i], operators[i % 2], &b[i], PRECISION);
+			calc_decimal_to_string(&result, got, sizeof(got), 0);
+			if (strcmp(got, want[i]) != 0) {
+				fail(pass ? "cached decimal" : "decimal on a miss", got, want[i]);
+				pass = 2;
+				break;
+			}
+		}
+	}
+	// In place, as the expression evaluator does it
+	calc_decimal_copy(&result, &a[1]);
+	calc_decimal_operation(&result, &result, '/', &b[1], PRECISION);
+	calc_decimal_to_string(&result, got, sizeof(got), 0);
+	if (strcmp(got, want[1]) != 0) {
+		fail("cached decimal in place", got, want[1]);
+	}
+	calc_cache_stats stats;
+	calc_cache_get_stats(&stats);
+	if (stats.hits < COUNT) {
+		fail_count("decimal hits", stats.hits, COUNT + 1);
+	}
+	for (int i = 0; i < COUNT; i++) {
+		calc_decimal_free(&a[i]);
+		calc_decimal_free(&b[i]);
+		free(want[i]);
+	}
+	calc_decimal_free(&result);
+}
+
+// A fraction of machine words, or a power of one that needs bignums
+static void random_rational(calc_rational* r, int big) {
+	calc_rational_set_scaled(r, 1000 + next_random() % 1000000, (int)(next_random() % 6), next_random() % 2);
+	if (big) {
+		calc_rational exponent;
+		calc_rational_init(&exponent);
+		calc_rational_set_scaled(&exponent, 8 + next_random() % 8, 0, 0);
+		calc_rational_operation(r, r, '^', &exponent);
+		calc_rational_free(&exponent);
+	}
+}
+
+static void check_rational(void) {
+	static const char operators[] = "+-*/^";
+	enum { COUNT = 200 };
+	calc_rational a[COUNT];
+	calc_rational b[COUNT];
+	calc_rational result;
+	calc_rational_init(&result);
+	char* want[COUNT];
+	char got[4096];
+	calc_cache_set_budget(0);
+	for (int i = 0; i < COUNT; i++) {
+		char op = operators[i % 5];
+		calc_rational_init(&a[i]);
+		calc_rational_init(&b[i]);
+		random_rational(&a[i], op != '^');
+		if (op == '^') {
+			calc_rational_set_scaled(&b[i], 32 + next_random() % 100, 0, next_random() % 2);
+		} else {
+			random_rational(&b[i], 1);
+		}
+		calc_rational_operation(&result, &a[i], op, &b[i]);
+		want[i] = malloc(sizeof(got));
+		calc_rational_to_string(&result, want[i], sizeof(got), 0);
+	}
+	calc_cache_set_budget(CALC_CACHE_DEFAULT_BUDGET);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < COUNT; i++) {
+			calc_rational_operation(&result, &a[i], operators[i % 5], &b[i]);
+			calc_rational_to_string(&result, got, sizeof(got), 0);
+			if (strcmp(got, want[i]) != 0) {
+				fail(pass ? "cached rational" : "rational on a miss", got, want[i]);
+				pass = 2;
+				break;
+			}
+		}
+	}
+	calc_cache_stats stats;
+	calc_cache_get_stats(&stats);
+	if (stats.hits < COUNT) {
+		fail_count("rational hits", stats.hits, COUNT);
+	}
+	for (int i = 0; i < COUNT; i++) {
+		calc_rational_free(&a[i]);
+		calc_rational_free(&b[i]);
+		free(want[i]);
+	}
+	calc_rational_free(&result);
+}
+
+// ============================================================================
+// Timings
+// ============================================================================
+
+// DISTINCT operations of each kind, picked by a shared Zipf stream
+static calc_decimal dividends[DISTINCT];
+static calc_decimal divisors[DISTINCT];
+static calc_rational bases[DISTINCT];
+static calc_rational exponents[DISTINCT];
+
+static void make_operands(void) {
+	for (unsigned i = 0; i < DISTINCT; i++) {
+		calc_decimal_init(&dividends[i]);
+		calc_decimal_init(&divisors[i]);
+		random_decimal(&dividends[i], 30);
+		random_decimal(&divisors[i], 30);
+		calc_rational_init(&bases[i]);
+		calc_rational_init(&exponents[i]);
+		random_rational(&bases[i], 0);
+		calc_rational_set_scaled(&exponents[i], 32 + next_random() % 64, 0, 0);
+	}
+}
+
+typedef struct {
+	const unsigned* stream;
+	size_t count;
+	int rational;
+	double sink;
+} worker;
+
+static void* run_stream(void* arg) {
+	worker* w = arg;
+	calc_decimal quotient;
+	calc_rational power;
+	calc_decimal_init(&quotient);
+	calc_rational_init(&power);
+	for (size_t i = 0; i < w->count; i++) {
+		unsigned k = w->stream[i];
+		if (w->rational) {
+			calc_rational_operation(&power, &bases[k], '^', &exponents[k]);
+			w->sink += power.big;
+		} else {
+			calc_decimal_operation(&quotient, &dividends[k], '/', &divisors[k], PRECISION);
+			w->sink += quotient.length;
+		}
+	}
+	calc_decimal_free(&quotient);
+	calc_rational_free(&power);
+	return NULL;
+}
+
+// Split the stream across threads sharing the cache; returns seconds
+static double time_stream(const unsigned* stream, size_t count, int rational, int thread_count) {
+	pthread_t threads[64];
+	worker workers[64];
+	double start = now_seconds();
+	for (int t = 0; t < thread_count; t++) {
+		size_t first = count * (size_t)t / (size_t)thread_count;
+		size_t last = count * (size_t)(t + 1) / (size_t)thread_count;
+		workers[t] = (worker){stream + first, last - first, rational, 0};
+		pthread_create(&threads[t], NULL, run_stream, &workers[t]);
+	}
+	for (int t = 0; t < thread_count; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	return now_seconds() - start;
+}
+
+static void time_budgets(const unsigned* stream, size_t count) {
+	static const size_t budgets[] = {0, 64 << 10, 256 << 10, 1 << 20, CALC_CACHE_DEFAULT_BUDGET};
+	static const char* workloads[] = {"decimal quotients", "rational powers"};
+	printf("\nZipf s=%.1f over %d operations, %zu lookups\n", ZIPF_EXPONENT, DISTINCT, count);
+	printf("%-18s %10s %9s %10s %10s %8s\n", "workload", "budget KiB", "hit rate", "evictions", "ns/op", "speedup");
+	for (int rational = 0; rational < 2; rational++) {
+		double uncached = 0;
+		for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+			calc_cache_set_budget(budgets[b]);
+			double elapsed = time_stream(stream, count, rational, 1);
+			calc_cache_stats stats;
+			calc_cache_get_stats(&stats);
+			if (b == 0) {
+				uncached = elapsed;
+				printf("%-18s %10s %9s %10s %10.0f %8s\n", workloads[rational], "off", "-", "-",
+					elapsed * 1e9 / count, "1.00");
+				continue;
+			}
+			printf("%-18s %10zu %8.1f%% %10llu %10.0f %8.2f\n", workloads[rational], budgets[b] >> 10,
+				100.0 * stats.hits / (stats.hits + stats.misses), (unsigned long long)stats.evictions,
+				elapsed * 1e9 / count, uncached / elapsed);
+		}
+	}
+}
+
+static void time_threads(const unsigned* stream, size_t count) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int most = cpus > 1 ? (cpus < 64 ? (int)cpus : 64) : 4;
+	printf("\ndecimal quotients on threads sharing a %zu KiB cache\n", CALC_CACHE_DEFAULT_BUDGET >> 10);
+	printf("%8s %12s %12s %9s\n", "threads", "uncached/s", "cached/s", "hit rate");
+	for (int threads = 1; threads <= most; threads *= 2) {
+		calc_cache_set_budget(0);
+		double uncached = time_stream(stream, count, 0, threads);
+		calc_cache_set_budget(CALC_CACHE_DEFAULT_BUDGET);
+		double cached = time_stream(stream, count, 0, threads);
+		calc_cache_stats stats;
+		calc_cache_get_stats(&stats);
+		printf("%8d %12.0f %12.0f %8.1f%%\n", threads, count / uncached, count / cached,
+			100.0 * stats.hits / (stats.hits + stats.misses));
+	}
+}
+
+// Cost of a hit and of a miss on their own, with 1 KiB records
+static void time_lookups(void) {
+	enum { KEYS = 1024, ROUNDS = 200 };
+	calc_cache_set_budget(CALC_CACHE_DEFAULT_BUDGET);
+	char key[32];
+	unsigned char value[1024];
+	for (unsigned i = 0; i < KEYS; i++) {
+		insert_record(i);
+	}
+	size_t sink = 0;
+	double start = now_seconds();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (unsigned i = 0; i < KEYS; i++) {
+			size_t key_length = make_key(key, i);
+			sink += calc_cache_lookup(key, key_length, value, sizeof(value));
+		}
+	}
+	double hit = (now_seconds() - start) / (ROUNDS * KEYS);
+	start = now_seconds();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (unsigned i = 0; i < KEYS; i++) {
+			size_t key_length = make_key(key, KEYS + i);
+			sink += calc_cache_lookup(key, key_length, value, sizeof(value));
+		}
+	}
+	double miss = (now_seconds() - start) / (ROUNDS * KEYS);
+	printf("\nlookup, formatting the key included: hit %.0f ns (%zu bytes copied on average), miss %.0f ns\n",
+		hit * 1e9, sink / (ROUNDS * KEYS), miss * 1e9);
+}
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : OPERATIONS;
+	
+	check_round_trip();
+	check_budget();
+	check_clock();
+	check_threads();
+	check_decimal();
+	check_rational();
+	printf("checks: %s\n", failures ? "FAILED" : "ok");
+	
+	make_operands();
+	unsigned* stream = zipf_stream(count, DISTINCT, ZIPF_EXPONENT);
+	time_lookups();
+	time_budgets(stream, count);
+	time_threads(stream, count);
+	free(stream);
+	return failures != 0;
+}
@@ -0,0 +1,125 @@
+// Decimal Arithmetic Benchmark - multiplication and division by operand size
+// Compile with: gcc -O2 -o bench/bin/bench_decimal bench/bench_decimal.c $DECIMAL_SOURCES -lm
+//               with DECIMAL_SOURCES from build.sh
+//
+// Times multiplies from 100 to 10^6 digits with the automatic algorithm choice
+// and with each algorithm forced, then Newton division at growing precision.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_decimal.h"
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void random_decimal(calc_decimal* d, long digits, unsigned seed) {
+	char* text = malloc((size_t)digits + 1);
+	srand(seed);
+	for (long i = 0; i < digits; i++) {
+		text[i] = (char)('1' + rand() % 9);
+	}
+	text[digits] = '\0';
+	calc_decimal_set_string(d, text);
+	free(text);
+}
+
+// Seconds per multiply, repeating small sizes until at least 0.2 s has passed
+static double time_multiply(const calc_decimal* a, const calc_decimal* b, calc_decimal* product) {
+	long rounds = 0;
+	double start = now_seconds(), elapsed;
+	do {
+		calc_decimal_mul(product, a, b);
+		rounds++;
+		elapsed = now_seconds() - start;
+	} while (elapsed < 0.2);
+	return elapsed / rounds;
+}
+
+int main(int argc, char* argv[]) {
+	long max_digits = argc > 1 ? atol(argv[1]) : 1000000;
+	size_t karatsuba = calc_decimal_karatsuba_threshold;
+	size_t ntt = calc_decimal_ntt_threshold;
+	
+	calc_decimal a, b, product, check;
+	calc_decimal_init(&a);
+	calc_decimal_init(&b);
+	calc_decimal_init(&product);
+	calc_decimal_init(&check);
+	
+	// Decimal mode's reason to exist
+	calc_decimal tenth, fifth;
+	char text[32];
+	calc_decimal_init(&tenth);
+	calc_decimal_init(&fifth);
+	calc_decimal_set_string(&tenth, "0.1");
+	calc_decimal_set_string(&fifth, "0.2");
+	calc_decimal_operation(&product, &tenth, '+', &fifth, 34);
+	calc_decimal_to_string(&product, text, sizeof(text), 0);
+	if (strcmp(text, "0.3") != 0) {
+		printf("0.1 + 0.2 = %s\n", text);
+		return 1;
+	}
+	calc_decimal_free(&tenth);
+	calc_decimal_free(&fifth);
+	
+	printf("%10s %14s %14s %14s %14s\n", "digits", "auto ms", "schoolbook ms", "karatsuba ms", "ntt ms");
+	for (long digits = 100; digits <= max_digits; digits *= 10) {
+		random_decimal(&a, digits, 1);
+		random_decimal(&b, digits, 2);
+		
+		calc_decimal_karatsuba_threshold = karatsuba;
+		calc_decimal_ntt_threshold = ntt;
+		double automatic = time_multiply(&a, &b, &product);
+		
+		// Forced algorithms, skipped where they would take too long
+		double times[3] = {-1, -1, -1};
+		const size_t forced[3][2] = {{(size_t)-1, (size_t)-1}, {0, (size_t)-1}, {0, 0}};
+		for (int i = 0; i < 3; i++) {
+			if ((i == 0 && digits > 100000) || (i == 1 && digits > 1000000)) {
+				continue;
+			}
+			calc_decimal_karatsuba_threshold = forced[i][0];
+			calc_decimal_ntt_threshold = forced[i][1];
+			times[i] = time_multiply(&a, &b, &check);
+			if (calc_decimal_compare(&check, &product) != 0) {
+				printf("mismatch at %ld digits\n", digits);
+				return 1;
+			}
+		}
+		printf("%10ld %14.3f", digits, automatic * 1e3);
+		for (int i = 0; i < 3; i++) {
+			if (times[i] < 0) {
+				printf(" %14s", "-");
+			} else {
+				printf(" %14.3f", times[i] * 1e3);
+			}
+		}
+		printf("\n");
+	}
+	calc_decimal_karatsuba_threshold = karatsuba;
+	calc_decimal_ntt_threshold = ntt;
+	
+	printf("\n%10s %14s\n", "precision", "divide ms");
+	calc_decimal quotient;
+	calc_decimal_init(&quotient);
+	for (long digits = 100; digits <= max_digits / 10; digits *= 10) {
+		random_decimal(&a, digits, 3);
+		random_decimal(&b, digits, 4);
+		double start = now_seconds();
+		calc_decimal_div(&quotient, &a, &b, digits);
+		printf("%10ld %14.3f\n", digits, (now_seconds() - start) * 1e3);
+	}
+	
+	calc_decimal_free(&a);
+	calc_decimal_free(&b);
+	calc_decimal_free(&product);
+	calc_decimal_free(&check);
+	calc_decimal_free(&quotient);
+	return 0;
+}
@@ -0,0 +1,157 @@
+// Dispatch Benchmark - cost per event of button tags and keyDown: against titles
+// Compile with: gcc -O2 -DOBJC_STUB -pthread -o bench/bin/bench_dispatch bench/bench_dispatch.c
+//               objc_shim.c objc_stub.c $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Launches calculator.c against the counting stub runtime and feeds the same
+// keys through each input path. The display callback is detached so the
+// figures are dispatch plus engine work; the engine alone is timed too and
+// subtracted. Every path but the engine one does the same per-event work
+// around the key (pool, latency hooks, tape), so the difference between the
+// title and tag paths is the lookup alone. Fails if a path ends on a
+// different display or the tag path sends as many messages as the title path.
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define main calculator_main
+#include "../calculator.c"
+#undef main
+
+// ============================================================================
+// Title Path
+// ============================================================================
+
+// button_clicked as it was before tags: read the title, convert it, compare.
+// The pool, latency hooks and tape update are the same as button_clicked's,
+// so the two paths differ only in how the key is found.
+void title_button_clicked(void* self, SEL sel, id sender) {
+	(void)self;
+	(void)sel;
+	calc_latency_begin();
+	void* pool = objc_autoreleasePoolPush();
+	
+	id title_obj = objc_msgSend_id(sender, objc_sel.title);
+	const char* title = nsstring_to_cstring(title_obj);
+	
+	char key = title[0];
+	if ((key >= '0' && key <= '9') || key == '.' || key == '=' ||
+		key == '+' || key == '-' || key == '*' || key == '/' || key == '(' || key == ')') {
+		calc_handle_key(&g_engine, key);
+		show_tape();
+	} else {
+		printf("Unknown button: %s\n", title);
+	}
+	
+	objc_autoreleasePoolPop(pool);
+	calc_latency_end();
+}
+
+// ============================================================================
+// Benchmark
+// ============================================================================
+
+typedef enum {
+	PATH_ENGINE,   // calc_handle_key directly
+	PATH_TITLE,
+	PATH_TAG,
+	PATH_KEY_DOWN,
+	PATH_COUNT
+} input_path;
+
+static const char* const path_names[PATH_COUNT] = {"engine only", "button title", "button tag", "keyDown:"};
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[]) {
+	long rounds = argc > 1 ? atol(argv[1]) : 100000;
+	char* launch_argv[] = {"calculator", NULL};
+	calculator_main(1, launch_argv);
+	
+	// Button and key event for every key, found the way a user would reach them
+	id buttons[128] = {0};
+	id events[128] = {0};
+	id subviews[64];
+	size_t count = objc_stub_subviews(objc_msgSend_id(g_window, objc_sel.contentView), subviews, 64);
+	for (size_t i = 0; i < count; i++) {
+		const char* title = objc_stub_text(objc_msgSend_id(subviews[i], objc_sel.title));
+		if (title && title[0] && title[1] == '\0') {
+			buttons[(unsigned char)title[0]] = subviews[i];
+		}
+	}
+	// Prefer unshifted keys, then main-keyboard codes (lower) over the keypad
+	for (int shift = 1; shift >= 0; shift--) {
+		for (int code = 127; code >= 0; code--) {
+			int tag = g_key_tags[shift][code];
+			if (tag >= 0) {
+				events[(unsigned char)calc_buttons[tag].key] = objc_stub_key_event(
+					(unsigned short)code, shift ? NSEventModifierFlagShift : 0);
+			}
+		}
+	}
+	
+	const char* keys = "12.5+3.25*4-1/2=0.1+0.2=987654321*123456789=(7)";
+	size_t key_count = strlen(keys);
+	for (size_t i = 0; i < key_count; i++) {
+		unsigned char key = (unsigned char)keys[i];
+		if (!buttons[key] || !events[key]) {
+			printf("FAIL: no button or key binding for '%c'\n", key);
+			return 1;
+		}
+	}
+	
+	int ok = 1;
+	double ns[PATH_COUNT];
+	double messages[PATH_COUNT];
+	double results[PATH_COUNT];
+	printf("%-14s %10s %14s %16s\n", "path", "ns/event", "dispatch ns", "messages/event");
+	for (int path = 0; path < PATH_COUNT; path++) {
+		objc_stub_reset_counters();
+		double start = now_seconds();
+		for (long r = 0; r < rounds; r++) {
+			calc_engine_init(&g_engine, NULL, NULL);
+			for (size_t i = 0; i < key_count; i++) {
+				unsigned char key = (unsigned char)keys[i];
+				switch (path) {
+					case PATH_ENGINE:
+						calc_handle_key(&g_engine, keys[i]);
+						break;
+					case PATH_TITLE:
+						title_button_clicked(NULL, objc_sel.buttonClicked, buttons[key]);
+						break;
+					case PATH_TAG:
+						button_clicked(NULL, objc_sel.buttonClicked, buttons[key]);
+						break;
+					case PATH_KEY_DOWN:
+						window_key_down(g_window, objc_sel.keyDown, events[key]);
+						break;
+				}
+			}
+			calc_engine_free(&g_engine);
+		}
+		double elapsed = now_seconds() - start;
+		double total = (double)key_count * rounds;
+		ns[path] = elapsed * 1e9 / total;
+		messages[path] = objc_stub_stats.messages / total;
+		results[path] = g_engine.input.display_value;
+		printf("%-14s %10.1f %14.1f %16.2f\n", path_names[path], ns[path], ns[path] - ns[PATH_ENGINE], messages[path]);
+		
+		if (results[path] != results[PATH_ENGINE]) {
+			printf("FAIL: %s ends on %.17g, engine on %.17g\n", path_names[path], results[path], results[PATH_ENGINE]);
+			ok = 0;
+		}
+	}
+	
+	if (messages[PATH_TAG] >= messages[PATH_TITLE]) {
+		printf("FAIL: tag dispatch sends as many messages as title dispatch\n");
+		ok = 0;
+	}
+	double saved = ns[PATH_TITLE] - ns[PATH_TAG];
+	printf("tag instead of title: %.2f fewer messages, %.1f ns %s per click\n",
+		messages[PATH_TITLE] - messages[PATH_TAG], fabs(saved), saved >= 0 ? "less" : "more");
+	return ok ? 0 : 1;
+}
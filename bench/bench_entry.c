@@ -0,0 +1,131 @@
+// Digit Entry Micro-Benchmark - per-keystroke cost of the entry buffer
+// against the original snprintf/atof implementation of handle_number
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_entry bench/bench_entry.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_engine.h"
+
+// ============================================================================
+// Original Implementation
+// ============================================================================
+
+// handle_number as it was before the entry buffer, display step included
+typedef struct {
+	double display_value;
+	int new_number;
+	int has_decimal;
+	char display[32];
+} legacy_state;
+
+static void legacy_handle_number(legacy_state* state, const char* digit_str) {
+	if (digit_str[0] == '.') {
+		if (state->has_decimal) {
+			return;
+		}
+		state->has_decimal = 1;
+		state->new_number = 0;
+		snprintf(state->display, sizeof(state->display), "%.10g", state->display_value);
+		return;
+	}
+	
+	double digit = atof(digit_str);
+	
+	if (state->new_number) {
+		state->display_value = digit;
+		state->new_number = 0;
+		state->has_decimal = 0;
+	} else if (state->has_decimal) {
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.10g", state->display_value);
+		const char* decimal_pos = strchr(buffer, '.');
+		int decimal_places = decimal_pos ? strlen(decimal_pos + 1) : 0;
+		
+		double multiplier = 1.0;
+		for (int i = 0; i < decimal_places + 1; i++) {
+			multiplier *= 10.0;
+		}
+		state->display_value += digit / multiplier;
+	} else {
+		state->display_value = state->display_value * 10 + digit;
+	}
+	
+	snprintf(state->display, sizeof(state->display), "%.10g", state->display_value);
+}
+
+// ============================================================================
+// Benchmark
+// ============================================================================
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The engine display sink copies the text, like the original did into its buffer
+static void copy_display(void* ctx, const char* text) {
+	strcpy((char*)ctx, text);
+}
+
+static double bench_legacy(const char* keys, long rounds, double* value) {
+	size_t count = strlen(keys);
+	legacy_state state;
+	double start = now_seconds();
+	for (long r = 0; r < rounds; r++) {
+		state.display_value = 0;
+		state.new_number = 1;
+		state.has_decimal = 0;
+		for (size_t i = 0; i < count; i++) {
+			char digit_str[2] = {keys[i], '\0'};
+			legacy_handle_number(&state, digit_str);
+		}
+	}
+	double elapsed = now_seconds() - start;
+	*value = state.display_value;
+	return elapsed * 1e9 / ((double)count * rounds);
+}
+
+static double bench_entry(const char* keys, long rounds, double* value) {
+	size_t count = strlen(keys);
+	char display[64];
+	calc_engine engine;
+	double start = now_seconds();
+	for (long r = 0; r < rounds; r++) {
+		calc_engine_init(&engine, copy_display, display);
+		for (size_t i = 0; i < count; i++) {
+			calc_handle_key(&engine, keys[i]);
+		}
+	}
+	double elapsed = now_seconds() - start;
+	*value = calc_entry_value(&engine.input.entry);
+	return elapsed * 1e9 / ((double)count * rounds);
+}
+
+int main(int argc, char* argv[]) {
+	long rounds = argc > 1 ? atol(argv[1]) : 200000;
+	const char* inputs[] = {
+		"7",
+		"1234567890",
+		"1234567890123456789",
+		"0.10",
+		"3.14159265",
+		"0.123456789012345678",
+		"98765.4321098765432",
+	};
+	
+	printf("%-22s %12s %12s %8s  %-24s %-24s\n",
+		"input", "legacy ns/key", "entry ns/key", "speedup", "legacy value", "entry value");
+	for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+		double legacy_value, entry_value;
+		double legacy_ns = bench_legacy(inputs[i], rounds, &legacy_value);
+		double entry_ns = bench_entry(inputs[i], rounds, &entry_value);
+		printf("%-22s %12.1f %12.1f %7.1fx  %-24.17g %-24.17g\n",
+			inputs[i], legacy_ns, entry_ns, legacy_ns / entry_ns, legacy_value, entry_value);
+	}
+	return 0;
+}
@@ -0,0 +1,195 @@
+// Expression Benchmark - compiled bytecode against re-parsing the text
+// Compile with: gcc -O2 -o bench/bin/bench_expr bench/bench_expr.c $EXPR_SOURCES -lm
+//               with EXPR_SOURCES from build.sh
+//
+// Generates random expressions, checks the bytecode against a direct
+// recursive-descent evaluator, then times evaluation of the pre-compiled set.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_expr.h"
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ============================================================================
+// Reference Evaluator
+// ============================================================================
+
+// Evaluates while parsing, the way a calculator without a compiler would
+static double direct_binary(const char** p, int min_precedence);
+
+static double direct_unary(const char** p) {
+	if (**p == '-') {
+		(*p)++;
+		return -direct_unary(p);
+	}
+	if (**p == '(') {
+		(*p)++;
+		double value = direct_binary(p, 1);
+		(*p)++;  // ')'
+		return value;
+	}
+	return strtod(*p, (char**)p);
+}
+
+static double direct_binary(const char** p, int min_precedence) {
+	double lhs = direct_unary(p);
+	for (;;) {
+		char op = **p;
+		int prec = op == '+' || op == '-' ? 1 : op == '*' || op == '/' ? 2 : 0;
+		if (prec == 0 || prec < min_precedence) {
+			return lhs;
+		}
+		(*p)++;
+		double rhs = direct_binary(p, prec + 1);
+		switch (op) {
+			case '+': lhs += rhs; break;
+			case '-': lhs -= rhs; break;
+			case '*': lhs *= rhs; break;
+			default: lhs = rhs != 0 ? lhs / rhs : 0; break;
+		}
+	}
+}
+
+// ============================================================================
+// Workload
+// ============================================================================
+
+static size_t random_operand(char* out, int depth) {
+	size_t n = 0;
+	if (rand() % 6 == 0) {
+		out[n++] = '-';
+	}
+	if (depth > 0 && rand() % 4 == 0) {
+		out[n++] = '(';
+		int terms = 2 + rand() % 3;
+		for (int t = 0; t < terms; t++) {
+			if (t) {
+				out[n++] = "+-*/"[rand() % 4];
+			}
+			n += random_operand(out + n, depth - 1);
+		}
+		out[n++] = ')';
+	} else {
+		n += (size_t)sprintf(out + n, rand() % 2 ? "%d" : "%d.%d", rand() % 1000, rand() % 100);
+	}
+	return n;
+}
+
+// Roughly calculator-sized: 3 to 8 terms, some nested
+static void random_expression(char* out) {
+	size_t n = 0;
+	int terms = 3 + rand() % 6;
+	for (int t = 0; t < terms; t++) {
+		if (t) {
+			out[n++] = "+-*/"[rand() % 4];
+		}
+		n += random_operand(out + n, 2);
+	}
+	out[n] = '\0';
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+#define EXPRESSION_COUNT 1000
+#define EXPRESSION_SIZE 512
+
+int main(int argc, char* argv[]) {
+	long rounds = argc > 1 ? atol(argv[1]) : 5000;
+	
+	// Precedence, parentheses, unary minus, powers and the divide-by-zero rule
+	static const struct { const char* text; double value; } cases[] = {
+		{"2+3*4", 14}, {"(2+3)*4", 20}, {"-(2+3)*4", -20}, {"2*-3", -6}, {"--3", 3},
+		{"8/4/2", 1}, {"8-4-2", 2}, {"1/0", 0}, {"1/(2-2)+5", 5}, {" 1.5e2 + .5 ", 150.5},
+		{"2^10", 1024}, {"-2^2", -4}, {"2^3^2", 512}, {"2^-1", 0.5}, {"3*(1+1)^3", 24},
+		{"sqrt(9)*2", 6}, {"-sqrt(4)^2", -4}, {"x + 1", 1}, {"exp(0) + ln(1)", 1},
+	};
+	calc_expr expr;
+	calc_expr_init(&expr);
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		if (!calc_expr_compile(&expr, cases[i].text) || calc_expr_eval(&expr) != cases[i].value) {
+			printf("FAIL: %s\n", cases[i].text);
+			return 1;
+		}
+	}
+	static const char* errors[] = {"", "2+", "(1+2", "1+2)", "2**3", "1 2", "2^", "^2", "sin 1", "foo(1)", "sqrt()"};
+	for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+		if (calc_expr_compile(&expr, errors[i])) {
+			printf("FAIL: accepted \"%s\"\n", errors[i]);
+			return 1;
+		}
+	}
+	calc_expr_free(&expr);
+	
+	// Random workload, compiled once
+	static char texts[EXPRESSION_COUNT][EXPRESSION_SIZE];
+	static calc_expr compiled[EXPRESSION_COUNT];
+	size_t code_bytes = 0;
+	srand(1);
+	for (int i = 0; i < EXPRESSION_COUNT; i++) {
+		random_expression(texts[i]);
+	}
+	double start = now_seconds();
+	for (int i = 0; i < EXPRESSION_COUNT; i++) {
+		calc_expr_init(&compiled[i]);
+		if (!calc_expr_compile(&compiled[i], texts[i])) {
+			printf("FAIL: %s: %s at %zu\n", texts[i], compiled[i].error, compiled[i].error_position);
+			return 1;
+		}
+		code_bytes += compiled[i].code_length;
+	}
+	double compile_time = now_seconds() - start;
+	
+	for (int i = 0; i < EXPRESSION_COUNT; i++) {
+		const char* p = texts[i];
+		double expected = direct_binary(&p, 1);
+		double actual = calc_expr_eval(&compiled[i]);
+		if (actual != expected && !(actual != actual && expected != expected)) {
+			printf("FAIL: %s = %.17g, bytecode gave %.17g\n", texts[i], expected, actual);
+			return 1;
+		}
+	}
+	
+	double sink = 0;
+	start = now_seconds();
+	for (long r = 0; r < rounds; r++) {
+		for (int i = 0; i < EXPRESSION_COUNT; i++) {
+			sink += calc_expr_eval(&compiled[i]);
+		}
+	}
+	double bytecode_time = now_seconds() - start;
+	
+	long direct_rounds = rounds / 10 > 0 ? rounds / 10 : 1;
+	start = now_seconds();
+	for (long r = 0; r < direct_rounds; r++) {
+		for (int i = 0; i < EXPRESSION_COUNT; i++) {
+			const char* p = texts[i];
+			sink += direct_binary(&p, 1);
+		}
+	}
+	double direct_time = now_seconds() - start;
+	
+	double evaluations = (double)rounds * EXPRESSION_COUNT;
+	double direct_evaluations = (double)direct_rounds * EXPRESSION_COUNT;
+	printf("expressions:  %d (%.1f bytecode bytes each)\n", EXPRESSION_COUNT, (double)code_bytes / EXPRESSION_COUNT);
+	printf("compile:      %.1f ns/expression\n", compile_time * 1e9 / EXPRESSION_COUNT);
+	printf("bytecode:     %.2f M evaluations/sec, %.1f ns/evaluation\n",
+		evaluations / bytecode_time / 1e6, bytecode_time * 1e9 / evaluations);
+	printf("re-parse:     %.2f M evaluations/sec, %.1f ns/evaluation\n",
+		direct_evaluations / direct_time / 1e6, direct_time * 1e9 / direct_evaluations);
+	printf("(checksum %g)\n", sink);
+	
+	for (int i = 0; i < EXPRESSION_COUNT; i++) {
+		calc_expr_free(&compiled[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,306 @@
+// Display Formatting Benchmark - calc_format_double against snprintf
+// Compile with: gcc -O2 -o bench/bin/bench_format bench/bench_format.c calc_format.c -lm
+//
+// Checks every value in the corpus reads back exactly, and checks the digits of
+// every eighth against the %.17g-and-reduce oracle: the shortest correctly
+// rounded %.Ne that reads back. calc_shortest_digits must never be longer, and
+// must give the same digits when as long. It may be shorter only at powers of
+// two, where the gap below is half the gap above, so the oracle's nearest
+// string can fall outside the narrower side while a string above does not.
+// Also checks significant_digits 1 to 17 in every notation, on carry cases
+// such as 9.99...e+N and on part of the corpus, against %.*e and %.*g: the
+// digits must be the correctly rounded ones, the point and exponent must
+// match and engineering exponents must be multiples of 3. The display rounds
+// the shortest digits, so when those are no longer than asked for they are
+// expected as they are, and a shortest string of exactly one digit more that
+// ends in 5 (a tie only after the first rounding) is skipped.
+// Fails on any other difference.
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_format.h"
+
+// ============================================================================
+// Corpus
+// ============================================================================
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double bits_to_double(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static const double edge_cases[] = {
+	0.0, -0.0, 1.0, -1.0, 0.1, 0.2, 0.3, 1.0 / 3.0, 2.0 / 3.0,
+	DBL_MIN, DBL_MAX, -DBL_MAX, DBL_EPSILON, 4.9406564584124654e-324,
+	2.2250738585072009e-308, 1e-300, 1e300, 1e15, 1e16, 1e17, 1e21, 1e22, 1e23,
+	9007199254740992.0, 9007199254740993.0, 123456789012345678.0,
+	5e-324, 1.7976931348623157e308, 0.30000000000000004, 100.0, 1234.5,
+	-2.5e-7, 299792458.0, 6.02214076e23, 1.602176634e-19
+};
+
+// Fill with edge cases, special values, random bit patterns, subnormals and
+// calculator-like values (short decimals from keystrokes)
+static size_t build_corpus(double* corpus, size_t count) {
+	size_t n = 0;
+	for (size_t i = 0; i < sizeof(edge_cases) / sizeof(edge_cases[0]) && n < count; i++) {
+		corpus[n++] = edge_cases[i];
+	}
+	corpus[n++] = NAN;
+	corpus[n++] = INFINITY;
+	corpus[n++] = -INFINITY;
+	while (n < count) {
+		uint64_t r = next_random();
+		switch (n % 4) {
+			case 0: corpus[n] = bits_to_double(r); break;
+			case 1: corpus[n] = bits_to_double(r & 0x800FFFFFFFFFFFFFULL); break;  // Subnormal
+			case 2: corpus[n] = (double)(r % 100000000) / 1000.0; break;
+			default: corpus[n] = (double)(r >> 11) * 0x1.0p-53 * 1e6; break;
+		}
+		n++;
+	}
+	return n;
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static int same_double(double a, double b) {
+	return (a != a && b != b) || memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Shortest correctly rounded %.*e text that reads back as value (the oracle);
+// returns its digit count
+static int shortest_printf_digits(double value, char* digits) {
+	char buffer[64];
+	int precision = 1;
+	for (; precision < 17; precision++) {
+		snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, value);
+		if (strtod(buffer, NULL) == value) {
+			break;
+		}
+	}
+	snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, value);
+	int n = 0;
+	for (const char* p = buffer; *p && *p != 'e'; p++) {
+		if (*p >= '0' && *p <= '9') {
+			digits[n++] = *p;
+		}
+	}
+	return n;
+}
+
+// Values that carry into a new leading digit when rounded
+static const double carry_cases[] = {
+	1.996, 179700.0, 12.99999999999, 0.0999999, 9.99e-5, 9.5, 99.96, 999.96,
+	999999999999999.9, 0.9999999999999999, 9.999999999999999e22, 9.99e-300,
+	9.9999999999999995e-300, 99999.5, 995000.0, DBL_MAX, -DBL_MAX, -1.996
+};
+
+// Digits of a formatted number without leading or trailing zeros, and the
+// decimal exponent of the first; returns the digit count
+static int parse_digits(const char* text, char* digits, int* leading) {
+	int n = 0, before_point = -1, skipped = 0;
+	const char* p = text;
+	if (*p == '-') {
+		p++;
+	}
+	for (; *p && *p != 'e'; p++) {
+		if (*p == '.') {
+			before_point = n + skipped;
+		} else if (n == 0 && *p == '0') {
+			skipped++;
+		} else {
+			digits[n++] = *p;
+		}
+	}
+	if (before_point < 0) {
+		before_point = n + skipped;
+	}
+	*leading = before_point - skipped - 1 + (*p == 'e' ? atoi(p + 1) : 0);
+	while (n > 1 && digits[n - 1] == '0') {
+		n--;
+	}
+	return n;
+}
+
+// Check value at 1 to 17 significant digits in every notation; returns the
+// number of failures
+static size_t check_rounding(double value, size_t* checked) {
+	static const calc_notation notations[] = {
+		CALC_NOTATION_AUTO, CALC_NOTATION_SCIENTIFIC, CALC_NOTATION_ENGINEERING
+	};
+	static const char* const names[] = {"auto", "scientific", "engineering"};
+	char shortest[CALC_FORMAT_MAX_DIGITS];
+	int shortest_exponent;
+	int shortest_length = calc_shortest_digits(fabs(value), shortest, &shortest_exponent);
+	static size_t reported = 0;
+	size_t failures = 0;
+	for (int count = 1; count <= 17; count++) {
+		if (shortest_length == count + 1 && shortest[count] == '5') {
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			calc_format_options options = {count, notations[k]};
+			char text[CALC_FORMAT_BUFFER_SIZE], expected_text[64];
+			calc_format_double(text, value, &options);
+			if (count >= shortest_length) {
+				snprintf(expected_text, sizeof(expected_text), "%.*se%d",
+					shortest_length, shortest, shortest_exponent);
+			} else if (notations[k] == CALC_NOTATION_AUTO) {
+				snprintf(expected_text, sizeof(expected_text), "%.*g", count, value);
+			} else {
+				snprintf(expected_text, sizeof(expected_text), "%.*e", count - 1, value);
+			}
+			char digits[64], expected[64];
+			int leading, expected_leading;
+			int length = parse_digits(text, digits, &leading);
+			int expected_length = parse_digits(expected_text, expected, &expected_leading);
+			int ok = length == expected_length && leading == expected_leading &&
+				memcmp(digits, expected, length) == 0 && (text[0] == '-') == (value < 0);
+			if (notations[k] != CALC_NOTATION_AUTO) {
+				// Digits before the point: 1, or 1 to 3 with a multiple-of-3 exponent
+				const char* e = strchr(text, 'e');
+				int int_digits = (int)(strcspn(text, ".e") - (text[0] == '-'));
+				int exponent = e ? atoi(e + 1) : 0;
+				if (notations[k] == CALC_NOTATION_SCIENTIFIC) {
+					ok = ok && e && int_digits == 1;
+				} else {
+					ok = ok && e && exponent % 3 == 0 && int_digits == leading - exponent + 1;
+				}
+			}
+			if (!ok && failures++ == 0 && reported++ < 10) {
+				printf("rounding failure: %.17g at %d digits, %s: %s, expected %s\n",
+					value, count, names[k], text, expected_text);
+			}
+			(*checked)++;
+		}
+	}
+	return failures;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+	if (count < 64) {
+		count = 64;
+	}
+	double* corpus = malloc(count * sizeof(double));
+	count = build_corpus(corpus, count);
+	
+	// Correctness: round trip for all values, shortest length for finite ones
+	size_t failures = 0, longer = 0, not_closest = 0, shorter = 0, checked = 0;
+	char buffer[CALC_FORMAT_BUFFER_SIZE];
+	for (size_t i = 0; i < count; i++) {
+		calc_format_double(buffer, corpus[i], NULL);
+		if (!same_double(strtod(buffer, NULL), corpus[i])) {
+			if (failures++ < 10) {
+				printf("round-trip failure: %.17g -> %s\n", corpus[i], buffer);
+			}
+		}
+		if (i % 8 == 0 && isfinite(corpus[i]) && corpus[i] != 0) {
+			char digits[CALC_FORMAT_MAX_DIGITS], expected[32];
+			int exponent;
+			int length = calc_shortest_digits(fabs(corpus[i]), digits, &exponent);
+			int shortest = shortest_printf_digits(fabs(corpus[i]), expected);
+			while (length > 1 && digits[length - 1] == '0') {
+				length--;
+			}
+			while (shortest > 1 && expected[shortest - 1] == '0') {
+				shortest--;
+			}
+			uint64_t bits;
+			memcpy(&bits, &corpus[i], sizeof(bits));
+			int power_of_two = (bits & 0x000FFFFFFFFFFFFFULL) == 0;
+			if (length > shortest || (length < shortest && !power_of_two)) {
+				if (longer++ < 10) {
+					printf("length failure: %.17g -> %.*s, oracle %.*s\n", corpus[i], length, digits, shortest, expected);
+				}
+			} else if (length < shortest) {
+				shorter++;
+			} else if (memcmp(digits, expected, length) != 0) {
+				if (not_closest++ < 10) {
+					printf("digit failure: %.17g -> %.*s, oracle %.*s\n", corpus[i], length, digits, shortest, expected);
+				}
+			}
+			checked++;
+		}
+	}
+	printf("corpus: %zu values, round-trip failures: %zu\n", count, failures);
+	printf("shortest check: %zu values, %zu of the wrong length, %zu with other digits, %zu shorter at a power of two\n",
+		checked, longer, not_closest, shorter);
+	
+	// Rounded digits: the carry cases, 1 - 10^-k across the exponent range,
+	// and every 64th corpus value
+	size_t rounding_failures = 0, rounding_checked = 0;
+	for (size_t i = 0; i < sizeof(carry_cases) / sizeof(carry_cases[0]); i++) {
+		rounding_failures += check_rounding(carry_cases[i], &rounding_checked);
+	}
+	for (int e = -300; e <= 300; e += 23) {
+		for (int k = 1; k <= 16; k++) {
+			rounding_failures += check_rounding((1 - pow(10, -k)) * pow(10, e), &rounding_checked);
+		}
+	}
+	for (size_t i = 0; i < count; i += 64) {
+		if (isfinite(corpus[i]) && corpus[i] != 0) {
+			rounding_failures += check_rounding(corpus[i], &rounding_checked);
+		}
+	}
+	printf("rounding check: %zu formats, %zu failures\n", rounding_checked, rounding_failures);
+	
+	// Throughput
+	const struct {
+		const char* name;
+		int precision;
+		calc_format_options options;
+	} cases[] = {
+		{"calc_format_double shortest", 0, {0, CALC_NOTATION_AUTO}},
+		{"calc_format_double 10 digits", 0, {10, CALC_NOTATION_AUTO}},
+		{"calc_format_double engineering", 0, {0, CALC_NOTATION_ENGINEERING}},
+		{"snprintf %.17g", 17, {0}},
+		{"snprintf %.10g", 10, {0}},
+	};
+	size_t sink = 0;
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		double start = now_seconds();
+		for (size_t i = 0; i < count; i++) {
+			if (cases[c].precision) {
+				sink += snprintf(buffer, sizeof(buffer), "%.*g", cases[c].precision, corpus[i]);
+			} else {
+				sink += calc_format_double(buffer, corpus[i], &cases[c].options);
+			}
+		}
+		double elapsed = now_seconds() - start;
+		printf("%-32s %8.1f ns/value  %6.1f Mvalues/s\n",
+			cases[c].name, elapsed * 1e9 / count, count / elapsed / 1e6);
+	}
+	
+	free(corpus);
+	return failures != 0 || longer != 0 || not_closest != 0 || rounding_failures != 0 || sink == 0;
+}
@@ -0,0 +1,336 @@
+// Graph Benchmark - batch evaluation, refinement and cached panning and zooming
+// Compile with: gcc -O2 -o bench/bin/bench_graph bench/bench_graph.c $GRAPH_SOURCES -lm
+//               with GRAPH_SOURCES from build.sh
+//
+// Checks that batch evaluation matches calc_expr_eval_at bit for bit, that
+// poles are left open while steep continuous curves stay connected, that a
+// render from cached samples is pixel-identical to one from scratch, and that
+// the PNG is well formed. Then times points evaluated per second, and frames
+// per second while panning and zooming with and without the sample cache.
+// Exits 1 if a cached pan or zoom is not faster in frames per second.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "../calc_graph.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define POINT_COUNT (1 << 20)
+#define FRAME_COUNT 300
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int same_double(double a, double b) {
+	return memcmp(&a, &b, sizeof(double)) == 0 || (a != a && b != b);
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static int check_batch(void) {
+	static const char* functions[] = {
+		"x", "-x^2 + 3*x - 1", "1/x", "sin(x)/x", "sqrt(4 - x^2)", "ln(x) + log10(x)",
+		"exp(-x^2/10)*cos(3*x)", "tan(x)", "atan(x) - asin(x/100) + acos(x/100)",
+		"sinh(x/10)*cosh(x/10)/tanh(x)", "gamma(x) + factorial(x/2)", "2^x - x^pi", "((x))",
+	};
+	size_t count = 3000;
+	double* xs = malloc(count * sizeof(double));
+	double* batch = malloc(count * sizeof(double));
+	for (size_t i = 0; i < count; i++) {
+		xs[i] = (double)i / 64 - 20;
+	}
+	xs[7] = 0;
+	xs[8] = -0.0;
+	xs[9] = NAN;
+	xs[10] = INFINITY;
+	
+	calc_expr expr;
+	calc_expr_init(&expr);
+	int ok = 1;
+	for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]) && ok; f++) {
+		if (!calc_expr_compile(&expr, functions[f])) {
+			printf("FAIL: %s: %s at %zu\n", functions[f], expr.error, expr.error_position);
+			ok = 0;
+			break;
+		}
+		calc_expr_eval_batch(&expr, batch, xs, count);
+		for (size_t i = 0; i < count; i++) {
+			double scalar = calc_expr_eval_at(&expr, xs[i]);
+			if (!same_double(scalar, batch[i])) {
+				printf("FAIL: %s at x = %.17g: scalar %.17g, batch %.17g\n", functions[f], xs[i], scalar, batch[i]);
+				ok = 0;
+				break;
+			}
+		}
+	}
+	
+	static const struct { const char* text; double x; double value; } cases[] = {
+		{"x^2", 3, 9}, {"-x", 2, -2}, {"sqrt(x)*2", 16, 8}, {"2*pi - pi*2", 0, 0},
+		{"exp(0) + ln(1)", 0, 1}, {"factorial(x)", 5, 120}, {"-pi", 0, -3.141592653589793},
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]) && ok; i++) {
+		if (!calc_expr_compile(&expr, cases[i].text) || calc_expr_eval_at(&expr, cases[i].x) != cases[i].value) {
+			printf("FAIL: %s at x = %g\n", cases[i].text, cases[i].x);
+			ok = 0;
+		}
+	}
+	static const char* errors[] = {"y", "sin x", "sin()", "foo(x)", "2x", "sqrt(x", "pix"};
+	for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]) && ok; i++) {
+		if (calc_expr_compile(&expr, errors[i])) {
+			printf("FAIL: accepted \"%s\"\n", errors[i]);
+			ok = 0;
+		}
+	}
+	
+	calc_expr_free(&expr);
+	free(xs);
+	free(batch);
+	return ok;
+}
+
+// First and last inked row of a column, or 0 if it has none
+static int ink_span(const calc_graph* graph, int column, int* top, int* bottom) {
+	*top = -1;
+	*bottom = -1;
+	for (int row = 0; row < graph->height; row++) {
+		if (graph->ink[(size_t)row * graph->width + column] > 64) {
+			if (*top < 0) {
+				*top = row;
+			}
+			*bottom = row;
+		}
+	}
+	return *top >= 0;
+}
+
+// Render text over view; expect this many discontinuities, and if connected
+// is set, inked runs of neighbouring columns that touch
+static int check_plot(calc_graph* graph, const char* text, calc_graph_view view, size_t breaks, int connected) {
+	if (!calc_graph_set_function(graph, text)) {
+		printf("FAIL: %s: %s\n", text, graph->error);
+		return 0;
+	}
+	calc_graph_render(graph, &view);
+	if (graph->breaks != breaks) {
+		printf("FAIL: %s: %zu discontinuities, expected %zu\n", text, graph->breaks, breaks);
+		return 0;
+	}
+	
+	int previous_top = 0;
+	int previous_bottom = 0;
+	int previous = 0;
+	for (int column = 0; column < graph->width && connected; column++) {
+		int top;
+		int bottom;
+		int inked = ink_span(graph, column, &top, &bottom);
+		if (inked && previous && (top > previous_bottom + 1 || bottom < previous_top - 1)) {
+			printf("FAIL: %s: gap between columns %d and %d\n", text, column - 1, column);
+			return 0;
+		}
+		previous = inked;
+		previous_top = top;
+		previous_bottom = bottom;
+	}
+	return 1;
+}
+
+static int check_plots(void) {
+	calc_graph graph;
+	if (!calc_graph_init(&graph, WIDTH, HEIGHT)) {
+		printf("FAIL: out of memory\n");
+		return 0;
+	}
+	calc_graph_view square = {-5, 5, -5, 5};
+	int ok = check_plot(&graph, "tan(x)", square, 4, 0) &&
+	         check_plot(&graph, "1/x", square, 2, 0) &&
+	         check_plot(&graph, "x^3", square, 0, 1) &&
+	         check_plot(&graph, "tanh(200*x)*4", square, 0, 1) &&
+	         check_plot(&graph, "sqrt(9 - x^2)", square, 0, 1) &&
+	         check_plot(&graph, "sin(x)*exp(-x^2/10)", square, 0, 1);
+	
+	// A pole must not be drawn as a vertical line: the column at pi/2 is
+	// nearly empty
+	if (ok) {
+		check_plot(&graph, "tan(x)", square, 4, 0);
+		int column = (int)((M_PI / 2 - square.x_min) * WIDTH / (square.x_max - square.x_min));
+		int inked = 0;
+		for (int row = 0; row < HEIGHT; row++) {
+			inked += graph.ink[(size_t)row * WIDTH + column] > 64;
+		}
+		if (inked > HEIGHT / 4) {
+			printf("FAIL: tan(x): %d inked pixels in the column at pi/2\n", inked);
+			ok = 0;
+		}
+	}
+	
+	// Cached renders after pans and zooms match renders from scratch
+	calc_graph fresh;
+	calc_graph_init(&fresh, WIDTH, HEIGHT);
+	calc_graph_set_function(&graph, "sin(x)*exp(-x^2/10) + 1/(x - 1)");
+	calc_graph_set_function(&fresh, "sin(x)*exp(-x^2/10) + 1/(x - 1)");
+	calc_graph_view view = {-8, 8, -3, 3};
+	for (int step = 0; step < 40 && ok; step++) {
+		double width = view.x_max - view.x_min;
+		if (step % 4 == 3) {
+			view.x_min += width / 4;    // Zoom in by two about the centre
+			view.x_max -= width / 4;
+		} else if (step % 8 == 5) {
+			view.x_min -= width / 2;
+			view.x_max += width / 2;
+		} else if (step % 8 == 6) {
+			view.y_min += 0.37;         // A vertical pan repaints everything
+			view.y_max += 0.37;
+		} else {
+			view.x_min += width * 0.0371;
+			view.x_max += width * 0.0371;
+		}
+		calc_graph_render(&graph, &view);
+		calc_graph_clear_cache(&fresh);
+		calc_graph_render(&fresh, &view);
+		if (memcmp(graph.pixels, fresh.pixels, (size_t)WIDTH * HEIGHT * 4) != 0) {
+			printf("FAIL: cached render differs at step %d\n", step);
+			ok = 0;
+		}
+	}
+	calc_graph_free(&fresh);
+	
+	// PNG: signature, and stored blocks of exactly the expected size
+	char path[] = "/tmp/bench_graph_XXXXXX";
+	int fd = mkstemp(path);
+	if (ok && fd >= 0) {
+		close(fd);
+		if (!calc_graph_write_png(&graph, path)) {
+			printf("FAIL: could not write %s\n", path);
+			ok = 0;
+		}
+		FILE* file = fopen(path, "rb");
+		unsigned char signature[8] = {0};
+		long size = -1;
+		if (file) {
+			size_t got = fread(signature, 1, 8, file);
+			fseek(file, 0, SEEK_END);
+			size = got == 8 ? ftell(file) : -1;
+			fclose(file);
+		}
+		size_t raw = (size_t)HEIGHT * (1 + WIDTH * 4);
+		long expected = (long)(8 + 25 + 12 + 2 + (raw + 65534) / 65535 * 5 + raw + 4 + 12);
+		if (ok && (memcmp(signature, "\x89PNG\r\n\x1a\n", 8) != 0 || size != expected)) {
+			printf("FAIL: PNG is %ld bytes, expected %ld\n", size, expected);
+			ok = 0;
+		}
+		unlink(path);
+	}
+	
+	calc_graph_free(&graph);
+	return ok;
+}
+
+// ============================================================================
+// Timing
+// ============================================================================
+
+static void time_points(const char* text) {
+	calc_expr expr;
+	calc_expr_init(&expr);
+	calc_expr_compile(&expr, text);
+	double* xs = malloc(POINT_COUNT * sizeof(double));
+	double* ys = malloc(POINT_COUNT * sizeof(double));
+	for (size_t i = 0; i < POINT_COUNT; i++) {
+		xs[i] = (double)i / POINT_COUNT * 20 - 10;
+	}
+	
+	double start = now_seconds();
+	calc_expr_eval_batch(&expr, ys, xs, POINT_COUNT);
+	double batch_time = now_seconds() - start;
+	double sink = ys[POINT_COUNT / 3];
+	
+	start = now_seconds();
+	for (size_t i = 0; i < POINT_COUNT; i++) {
+		ys[i] = calc_expr_eval_at(&expr, xs[i]);
+	}
+	double scalar_time = now_seconds() - start;
+	sink += ys[POINT_COUNT / 3];
+	
+	printf("%-32s batch %6.1f M points/sec, scalar %6.1f M points/sec (%.1fx) (%g)\n", text,
+		POINT_COUNT / batch_time / 1e6, POINT_COUNT / scalar_time / 1e6, scalar_time / batch_time, sink);
+	free(xs);
+	free(ys);
+	calc_expr_free(&expr);
+}
+
+// Frames per second over a pan (pan set) or a zoom in and back out, and the
+// f values computed for them
+static double run_frames(calc_graph* graph, int pan, int cached, uint64_t* evaluations) {
+	calc_graph_view view = {-10, 10, -3, 3};
+	calc_graph_clear_cache(graph);
+	uint64_t first_evaluation = graph->evaluations;
+	
+	double start = now_seconds();
+	for (int frame = 0; frame < FRAME_COUNT; frame++) {
+		double width = view.x_max - view.x_min;
+		if (pan) {
+			view.x_min += width / 100;
+			view.x_max += width / 100;
+		} else {
+			double factor = frame < FRAME_COUNT / 2 ? 0.98 : 1 / 0.98;
+			double centre = 0.5 * (view.x_min + view.x_max) + width / 50;
+			view.x_min = centre - width * factor / 2;
+			view.x_max = centre + width * factor / 2;
+		}
+		if (!cached) {
+			calc_graph_clear_cache(graph);
+		}
+		calc_graph_render(graph, &view);
+	}
+	*evaluations = graph->evaluations - first_evaluation;
+	return FRAME_COUNT / (now_seconds() - start);
+}
+
+// run_frames at its best of three runs, printed
+static double time_frames(calc_graph* graph, int pan, int cached) {
+	double best = 0;
+	uint64_t evaluations = 0;
+	for (int run = 0; run < 3; run++) {
+		double frames_per_second = run_frames(graph, pan, cached, &evaluations);
+		best = frames_per_second > best ? frames_per_second : best;
+	}
+	printf("%-5s %-9s %8.0f frames/sec, %7.1f evaluations/frame\n", pan ? "pan" : "zoom",
+		cached ? "cached" : "uncached", best, (double)evaluations / FRAME_COUNT);
+	return best;
+}
+
+int main(void) {
+	if (!check_batch() || !check_plots()) {
+		return 1;
+	}
+	
+	time_points("x^3 - 2*x + 1");
+	time_points("sin(x)*exp(-x^2/10) + x/3");
+	time_points("1/(x^2 + 1) - ln(x^2 + 1)");
+	
+	calc_graph graph;
+	calc_graph_init(&graph, WIDTH, HEIGHT);
+	calc_graph_set_function(&graph, "sin(3*x)*exp(-x^2/50) + tan(x/4)/10");
+	printf("\n%dx%d, sin(3*x)*exp(-x^2/50) + tan(x/4)/10, %d frames\n", WIDTH, HEIGHT, FRAME_COUNT);
+	int ok = 1;
+	for (int pan = 1; pan >= 0; pan--) {
+		double uncached = time_frames(&graph, pan, 0);
+		double cached = time_frames(&graph, pan, 1);
+		if (cached <= uncached) {
+			printf("FAIL: %s with the cache is no faster than without\n", pan ? "pan" : "zoom");
+			ok = 0;
+		}
+	}
+	calc_graph_free(&graph);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,291 @@
+// Paper Tape Benchmark - recording and incremental recomputation after edits
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_history bench/bench_history.c
+//               $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Types random calculations into an engine with a tape attached and checks
+// that recomputing the tape from scratch gives every recorded result bit for
+// bit, and the last total. Then makes random edits to a million-entry tape,
+// checking the incremental recomputation against a full one, and times
+// recording, typical edits and the worst case: an edit at the start of one
+// chain a million entries long.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_engine.h"
+#include "../calc_history.h"
+
+#define TAPE_ENTRIES (1 << 20)
+#define EDITS 20000
+#define CHECK_EVERY 1000
+#define CALCULATIONS 250000
+
+// ============================================================================
+// Data
+// ============================================================================
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static void type_keys(calc_engine* engine, const char* keys) {
+	for (; *keys; keys++) {
+		calc_handle_key(engine, *keys);
+	}
+}
+
+// One random calculation: a chain of up to 8 operations, sometimes carried
+// on from the last total, sometimes with a square root or percent
+static void type_calculation(calc_engine* engine) {
+	static const char operators[] = "+-*/+-+-^";
+	char keys[128];
+	size_t length = 0;
+	int terms = 1 + (int)(next_random() % 8);
+	int carry_on = next_random() % 2;
+	
+	for (int t = 0; t < terms; t++) {
+		if (t > 0 || carry_on) {
+			keys[length++] = operators[next_random() % (sizeof(operators) - 1)];
+		}
+		length += (size_t)snprintf(keys + length, sizeof(keys) - length, "%u",
+			(unsigned)(next_random() % 1000));
+		if (next_random() % 16 == 0) {
+			keys[length++] = next_random() % 2 ? 'r' : '%';
+		}
+	}
+	keys[length++] = '=';
+	keys[length] = '\0';
+	type_keys(engine, keys);
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static size_t failures = 0;
+
+static void fail(const char* what, size_t index, double got, double want) {
+	if (failures++ < 10) {
+		printf("FAIL %s: entry %zu gave %.17g, expected %.17g\n", what, index, got, want);
+	}
+}
+
+static int same_bits(double a, double b) {
+	return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// Recompute history from scratch and compare with the results it holds
+static void check_against_full(const char* what, calc_history* history, calc_history* scratch) {
+	calc_history_clear(scratch);
+	scratch->base = history->base;
+	for (size_t i = 0; i < history->count; i++) {
+		const calc_history_entry* entry = calc_history_at(history, i);
+		calc_history_append(scratch, entry->op, entry->operand, 0, entry->flags);
+	}
+	calc_history_recompute_all(scratch);
+	for (size_t i = 0; i < history->count; i++) {
+		double got = calc_history_at(history, i)->result;
+		double want = calc_history_at(scratch, i)->result;
+		if (!same_bits(got, want)) {
+			fail(what, i, got, want);
+			return;
+		}
+	}
+}
+
+// A random edit: a new operand, or a new operator ('\0' now and then)
+static size_t random_edit(calc_history* history) {
+	static const char operators[] = "+-*/+-";
+	size_t index = (size_t)(next_random() % history->count);
+	if (next_random() % 3 == 0) {
+		int start = next_random() % 16 == 0;
+		return calc_history_set_operator(history, index, start ? '\0' : operators[next_random() % 6]);
+	}
+	return calc_history_set_operand(history, index, (double)(next_random() % 1000));
+}
+
+// Recorded results are what the engine computed, and the tape recomputes to them
+static void check_recording(calc_history* scratch) {
+	calc_history history;
+	calc_history_init(&history, 1 << 16);
+	calc_engine engine;
+	calc_engine_init(&engine, NULL, NULL);
+	engine.history = &history;
+	
+	for (int c = 0; c < 5000; c++) {
+		uint64_t appended = history.appended;
+		type_calculation(&engine);
+		if (history.appended == appended) {
+			continue;   // A lone number, maybe with a function applied
+		}
+		const calc_history_entry* last = calc_history_at(&history, history.count - 1);
+		if (!(last->flags & CALC_HISTORY_TOTAL) || !same_bits(last->result, engine.input.display_value)) {
+			fail("recorded total", history.count - 1, last->result, engine.input.display_value);
+			break;
+		}
+	}
+	check_against_full("recording", &history, scratch);
+	
+	// "2 + 3 * 4 =" then "+ 1 =" carries on from 20; "5 - 1 =" starts afresh
+	calc_history_clear(&history);
+	type_keys(&engine, "2+3*4=+1=5-1=");
+	static const char ops[] = {'\0', '+', '*', '\0', '+', '\0', '-'};
+	static const double results[] = {2, 5, 20, 20, 21, 5, 4};
+	for (size_t i = 0; i < 7; i++) {
+		const calc_history_entry* entry = calc_history_at(&history, i);
+		if (history.count != 7 || entry->op != ops[i] || entry->result != results[i]) {
+			fail("chain", i, entry->result, results[i]);
+			break;
+		}
+	}
+	if (!(calc_history_at(&history, 3)->flags & CALC_HISTORY_LINKED)
+		|| (calc_history_at(&history, 5)->flags & CALC_HISTORY_LINKED)) {
+		fail("linked starts", 3, calc_history_at(&history, 3)->flags, CALC_HISTORY_LINKED);
+	}
+	
+	// Editing 3 to 4 changes 20 to 24 and the carried-on total to 25, not 4
+	size_t recomputed = calc_history_set_operand(&history, 1, 4);
+	if (recomputed != 4 || calc_history_at(&history, 4)->result != 25 || calc_history_at(&history, 6)->result != 4) {
+		fail("edit", 4, calc_history_at(&history, 4)->result, 25);
+	}
+	
+	calc_engine_free(&engine);
+	calc_history_free(&history);
+}
+
+// A full ring drops its oldest entries and keeps recomputing from base
+static void check_wrap(calc_history* scratch) {
+	calc_history history;
+	calc_history_init(&history, 6);   // Rounded up to 8
+	calc_engine engine;
+	calc_engine_init(&engine, NULL, NULL);
+	engine.history = &history;
+	
+	type_keys(&engine, "1+2+3+4+5+6+7+8+9+10=");
+	if (history.capacity != 8 || history.count != 8 || history.appended != 10 || history.base != 3) {
+		fail("ring", history.count, history.base, 3);
+	}
+	if (calc_history_at(&history, 7)->result != 55) {
+		fail("ring total", 7, calc_history_at(&history, 7)->result, 55);
+	}
+	calc_history_set_operand(&history, 0, 13);
+	if (calc_history_at(&history, 7)->result != 65) {
+		fail("ring edit", 7, calc_history_at(&history, 7)->result, 65);
+	}
+	check_against_full("ring", &history, scratch);
+	
+	calc_engine_free(&engine);
+	calc_history_free(&history);
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(void) {
+	calc_history scratch;
+	calc_history tape;
+	double* edit_times = malloc(EDITS * sizeof(double));
+	if (!edit_times || !calc_history_init(&scratch, TAPE_ENTRIES)
+		|| !calc_history_init(&tape, TAPE_ENTRIES)) {
+		printf("out of memory\n");
+		return 1;
+	}
+	
+	check_recording(&scratch);
+	check_wrap(&scratch);
+	
+	// Record a million entries through the engine, timing the same keys
+	// without the tape and with it (best of three)
+	calc_engine engine;
+	calc_engine_init(&engine, NULL, NULL);
+	double best[2] = {1e9, 1e9};
+	for (int run = 0; run < 6; run++) {
+		uint64_t seed = rng_state;
+		engine.history = run % 2 ? &tape : NULL;
+		double start = now_seconds();
+		for (int c = 0; c < CALCULATIONS; c++) {
+			type_calculation(&engine);
+		}
+		double elapsed = now_seconds() - start;
+		best[run % 2] = elapsed < best[run % 2] ? elapsed : best[run % 2];
+		if (run % 2 == 0) {
+			rng_state = seed;
+		}
+	}
+	while (tape.appended < TAPE_ENTRIES) {
+		type_calculation(&engine);
+	}
+	printf("recording: %.1f ns per calculation without the tape, %.1f ns with it\n",
+		best[0] * 1e9 / CALCULATIONS, best[1] * 1e9 / CALCULATIONS);
+	
+	double start = now_seconds();
+	for (size_t i = 0; i < TAPE_ENTRIES; i++) {
+		calc_history_append(&scratch, '+', (double)i, (double)i, 0);
+	}
+	double appending = now_seconds() - start;
+	printf("calc_history_append: %.2f ns/entry\n", appending * 1e9 / TAPE_ENTRIES);
+	
+	// Random edits to the full tape, checked against full recomputes
+	size_t recomputed = 0;
+	size_t most = 0;
+	for (int e = 0; e < EDITS; e++) {
+		start = now_seconds();
+		size_t n = random_edit(&tape);
+		edit_times[e] = now_seconds() - start;
+		recomputed += n;
+		most = n > most ? n : most;
+		if ((e + 1) % CHECK_EVERY == 0) {
+			check_against_full("edits", &tape, &scratch);
+		}
+	}
+	qsort(edit_times, EDITS, sizeof(double), compare_doubles);
+	printf("edits on %zu entries: %d, %.1f recomputed on average, %zu at most\n",
+		tape.count, EDITS, (double)recomputed / EDITS, most);
+	printf("edit latency: p50 %.2f us  p99 %.2f us  max %.2f us\n", edit_times[EDITS / 2] * 1e6,
+		edit_times[EDITS * 99 / 100] * 1e6, edit_times[EDITS - 1] * 1e6);
+	
+	// Worst case: the first operand of one chain through the whole tape
+	calc_history_clear(&tape);
+	calc_history_append(&tape, '\0', 1, 1, 0);
+	for (size_t i = 1; i < TAPE_ENTRIES; i++) {
+		calc_history_append(&tape, '+', 1, (double)(i + 1), 0);
+	}
+	start = now_seconds();
+	size_t chain = calc_history_set_operand(&tape, 0, 2);
+	double worst = now_seconds() - start;
+	if (chain != TAPE_ENTRIES || calc_history_at(&tape, TAPE_ENTRIES - 1)->result != TAPE_ENTRIES + 1) {
+		fail("chain", TAPE_ENTRIES - 1, calc_history_at(&tape, TAPE_ENTRIES - 1)->result, TAPE_ENTRIES + 1);
+	}
+	printf("worst case: %zu entries recomputed in %.2f ms (%.2f ns/entry)\n", chain, worst * 1e3,
+		worst * 1e9 / chain);
+	
+	printf("failures: %zu\n", failures);
+	calc_engine_free(&engine);
+	calc_history_free(&tape);
+	calc_history_free(&scratch);
+	free(edit_times);
+	return failures != 0;
+}
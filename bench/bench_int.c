@@ -0,0 +1,306 @@
+// Integer Mode Benchmark - radix conversion against snprintf and strtoull
+// Compile with: gcc -O2 -o bench/bin/bench_int bench/bench_int.c calc_int.c
+//
+// Checks formatting against snprintf for 64-bit words, round trips every word
+// size, signedness and radix through calc_int_parse, and checks the operators
+// and bit counts against bit-by-bit references, then times converting large
+// volumes of values between bases.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_int.h"
+
+// ============================================================================
+// Corpus
+// ============================================================================
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static const uint64_t edge_cases[] = {
+	0, 1, 7, 8, 9, 10, 15, 16, 99, 100, 255, 256, 32767, 32768, 65535,
+	0x7FFFFFFFULL, 0x80000000ULL, 0xFFFFFFFFULL, 9999999999999999999ULL,
+	10000000000000000000ULL, 0x7FFFFFFFFFFFFFFFULL, 0x8000000000000000ULL, UINT64_MAX
+};
+
+// Edge cases, then full-width, short (typed-looking) and random-length values
+static void build_corpus(uint64_t* corpus, size_t count) {
+	size_t n = 0;
+	for (; n < sizeof(edge_cases) / sizeof(edge_cases[0]) && n < count; n++) {
+		corpus[n] = edge_cases[n];
+	}
+	for (; n < count; n++) {
+		uint64_t r = next_random();
+		switch (n % 3) {
+			case 0: corpus[n] = r; break;
+			case 1: corpus[n] = r % 100000; break;
+			default: corpus[n] = r >> (next_random() % 64); break;
+		}
+	}
+}
+
+static calc_int wide_value(const uint64_t* corpus, size_t count, size_t i) {
+	return (calc_int)corpus[i] << 64 | corpus[(i * 7 + 3) % count];
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ============================================================================
+// References
+// ============================================================================
+
+static size_t failures = 0;
+
+static void fail(const char* what, uint64_t value, const char* got, const char* want) {
+	if (failures++ < 10) {
+		printf("FAIL %s: %016" PRIX64 " gave %s, expected %s\n", what, value, got, want);
+	}
+}
+
+static void binary_reference(char* buffer, calc_int value) {
+	char digits[129];
+	int n = 0;
+	do {
+		digits[n++] = (char)('0' + (int)(value & 1));
+		value >>= 1;
+	} while (value != 0);
+	for (int i = 0; i < n; i++) {
+		buffer[i] = digits[n - 1 - i];
+	}
+	buffer[n] = '\0';
+}
+
+static int bit_at(calc_int value, int bit) {
+	return (int)(value >> bit) & 1;
+}
+
+// popcount, clz, ctz and both rotates one bit at a time
+static void check_bit_operations(calc_int value, int bits) {
+	int count = 0, leading = 0, trailing = 0;
+	for (int b = 0; b < bits; b++) {
+		count += bit_at(value, b);
+	}
+	while (leading < bits && !bit_at(value, bits - 1 - leading)) {
+		leading++;
+	}
+	while (trailing < bits && !bit_at(value, trailing)) {
+		trailing++;
+	}
+	char got[40], want[40];
+	if (calc_int_popcount(value, bits) != count || calc_int_clz(value, bits) != leading
+		|| calc_int_ctz(value, bits) != trailing) {
+		snprintf(got, sizeof(got), "%d/%d/%d", calc_int_popcount(value, bits), calc_int_clz(value, bits),
+			calc_int_ctz(value, bits));
+		snprintf(want, sizeof(want), "%d/%d/%d", count, leading, trailing);
+		fail("popcount/clz/ctz", (uint64_t)value, got, want);
+	}
+	
+	int shift = (int)(value % (calc_int)(bits + 3)) - 1;  // -1 and counts past the width too
+	calc_int left = calc_int_operation(value, '[', (calc_int)shift, bits, 0);
+	calc_int right = calc_int_operation(value, ']', (calc_int)shift, bits, 0);
+	int steps = ((shift % bits) + bits) % bits;
+	for (int b = 0; b < bits; b++) {
+		if (bit_at(left, (b + steps) % bits) != bit_at(value, b)
+			|| bit_at(right, b) != bit_at(value, (b + steps) % bits)) {
+			fail("rotate", (uint64_t)value, "wrong bits", "rotated bits");
+			break;
+		}
+	}
+}
+
+// Results that only hold with wrapping two's-complement words
+static void check_known_results(void) {
+	static const struct {
+		calc_int lhs;
+		char op;
+		calc_int rhs;
+		int bits;
+		int is_signed;
+		const char* decimal;
+	} cases[] = {
+		{127, '+', 1, 8, 1, "-128"},
+		{200, '+', 100, 8, 0, "44"},
+		{(calc_int)-128, '/', (calc_int)-1, 8, 1, "-128"},
+		{(calc_int)-7, '/', 2, 32, 1, "-3"},
+		{(calc_int)-7, '%', 2, 32, 1, "-1"},
+		{7, '/', 0, 16, 0, "0"},
+		{(calc_int)-128, '>', 1, 8, 1, "-64"},
+		{0x80, '>', 1, 8, 0, "64"},
+		{(calc_int)-1, '>', 200, 64, 1, "-1"},
+		{1, '<', 63, 64, 1, "-9223372036854775808"},
+		{1, '<', 64, 64, 0, "0"},
+		{(calc_int)1 << 127, '/', (calc_int)-1, 128, 1, "-170141183460469231731687303715884105728"},
+		{(calc_int)-1, '*', (calc_int)-1, 128, 0, "1"},
+		{0xF0, '^', 0xFF, 8, 0, "15"},
+		{0x81, '[', 1, 8, 0, "3"},
+		{0x81, ']', 1, 8, 0, "192"},
+	};
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		char buffer[CALC_INT_BUFFER_SIZE];
+		calc_int lhs = calc_int_wrap(cases[c].lhs, cases[c].bits, cases[c].is_signed);
+		calc_int rhs = calc_int_wrap(cases[c].rhs, cases[c].bits, cases[c].is_signed);
+		calc_int result = calc_int_operation(lhs, cases[c].op, rhs, cases[c].bits, cases[c].is_signed);
+		calc_int_format(buffer, result, cases[c].bits, cases[c].is_signed, 10);
+		if (strcmp(buffer, cases[c].decimal) != 0) {
+			fail("operator", (uint64_t)cases[c].lhs, buffer, cases[c].decimal);
+		}
+	}
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+	if (count < 64) {
+		count = 64;
+	}
+	uint64_t* corpus = malloc(count * sizeof(uint64_t));
+	build_corpus(corpus, count);
+	
+	// 64-bit words against snprintf, and binary against a bit loop
+	char buffer[CALC_INT_BUFFER_SIZE], expected[CALC_INT_BUFFER_SIZE];
+	for (size_t i = 0; i < count; i++) {
+		uint64_t value = corpus[i];
+		static const struct {
+			int radix;
+			const char* format;
+		} radices[] = {{10, "%" PRIu64}, {16, "%" PRIX64}, {8, "%" PRIo64}};
+		for (size_t r = 0; r < 3; r++) {
+			calc_int_format(buffer, value, 64, 0, radices[r].radix);
+			snprintf(expected, sizeof(expected), radices[r].format, value);
+			if (strcmp(buffer, expected) != 0) {
+				fail("format", value, buffer, expected);
+			}
+		}
+		calc_int_format(buffer, calc_int_wrap(value, 64, 1), 64, 1, 10);
+		snprintf(expected, sizeof(expected), "%" PRId64, (int64_t)value);
+		if (strcmp(buffer, expected) != 0) {
+			fail("signed format", value, buffer, expected);
+		}
+		calc_int_format(buffer, value, 64, 0, 2);
+		binary_reference(expected, value);
+		if (strcmp(buffer, expected) != 0) {
+			fail("binary format", value, buffer, expected);
+		}
+	}
+	
+	// Round trips for every word, including the sign for signed decimal
+	static const int widths[] = {8, 16, 32, 64, 128};
+	static const int radices[] = {2, 8, 10, 16};
+	size_t round_trips = 0;
+	for (size_t i = 0; i < count; i += 7) {
+		for (size_t w = 0; w < 5; w++) {
+			for (int is_signed = 0; is_signed < 2; is_signed++) {
+				calc_int value = calc_int_wrap(wide_value(corpus, count, i), widths[w], is_signed);
+				for (size_t r = 0; r < 4; r++) {
+					calc_int parsed = 0;
+					int length = calc_int_format(buffer, value, widths[w], is_signed, radices[r]);
+					if (!calc_int_parse(&parsed, buffer, (size_t)length, radices[r], widths[w], is_signed)
+						|| parsed != value) {
+						fail("round trip", (uint64_t)value, buffer, "the same value");
+					}
+					round_trips++;
+				}
+				check_bit_operations(value, widths[w]);
+			}
+		}
+	}
+	
+	// Parsing must refuse what does not fit
+	calc_int parsed;
+	if (calc_int_parse(&parsed, "256", 3, 10, 8, 0) || calc_int_parse(&parsed, "-129", 4, 10, 8, 1)
+		|| calc_int_parse(&parsed, "-1", 2, 10, 8, 0) || calc_int_parse(&parsed, "12", 2, 2, 8, 0)
+		|| calc_int_parse(&parsed, "340282366920938463463374607431768211456", 39, 10, 128, 0)
+		|| !calc_int_parse(&parsed, "-128", 4, 10, 8, 1) || parsed != (calc_int)-128
+		|| !calc_int_parse(&parsed, "ff", 2, 16, 8, 1) || parsed != (calc_int)-1) {
+		fail("parse limits", 0, "accepted or refused", "the opposite");
+	}
+	check_known_results();
+	printf("corpus: %zu values, %zu round trips, failures: %zu\n", count, round_trips, failures);
+	
+	// Throughput
+	char* text = malloc(count * 24);
+	size_t sink = 0;
+	const struct {
+		const char* name;
+		int radix;
+		int libc;
+	} cases[] = {
+		{"calc_int_format dec", 10, 0}, {"snprintf %llu", 10, 1},
+		{"calc_int_format hex", 16, 0}, {"snprintf %llX", 16, 1},
+		{"calc_int_format oct", 8, 0}, {"snprintf %llo", 8, 1},
+		{"calc_int_format bin", 2, 0},
+	};
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		double start = now_seconds();
+		for (size_t i = 0; i < count; i++) {
+			if (cases[c].libc) {
+				const char* format = cases[c].radix == 10 ? "%llu" : cases[c].radix == 16 ? "%llX" : "%llo";
+				sink += snprintf(buffer, sizeof(buffer), format, (unsigned long long)corpus[i]);
+			} else {
+				sink += calc_int_format(buffer, corpus[i], 64, 0, cases[c].radix);
+			}
+		}
+		double elapsed = now_seconds() - start;
+		printf("%-32s %8.1f ns/value  %6.1f Mvalues/s\n", cases[c].name, elapsed * 1e9 / count, count / elapsed / 1e6);
+	}
+	
+	// Hex text to decimal text, as when switching the display radix over a column
+	for (int libc = 0; libc < 2; libc++) {
+		size_t* lengths = malloc(count * sizeof(size_t));
+		for (size_t i = 0; i < count; i++) {
+			lengths[i] = (size_t)snprintf(text + i * 24, 24, "%" PRIX64, corpus[i]);
+		}
+		double start = now_seconds();
+		for (size_t i = 0; i < count; i++) {
+			if (libc) {
+				sink += snprintf(buffer, sizeof(buffer), "%llu", strtoull(text + i * 24, NULL, 16));
+			} else {
+				calc_int value = 0;
+				calc_int_parse(&value, text + i * 24, lengths[i], 16, 64, 0);
+				sink += calc_int_format(buffer, value, 64, 0, 10);
+			}
+		}
+		double elapsed = now_seconds() - start;
+		printf("%-32s %8.1f ns/value  %6.1f Mvalues/s\n", libc ? "hex -> dec strtoull+snprintf" : "hex -> dec calc_int",
+			elapsed * 1e9 / count, count / elapsed / 1e6);
+		free(lengths);
+	}
+	
+	// 128-bit words have no libc counterpart
+	for (size_t r = 0; r < 4; r++) {
+		double start = now_seconds();
+		for (size_t i = 0; i < count; i++) {
+			calc_int value = 0;
+			int length = calc_int_format(buffer, wide_value(corpus, count, i), 128, 0, radices[r]);
+			calc_int_parse(&value, buffer, (size_t)length, radices[r], 128, 0);
+			sink += (size_t)value;
+		}
+		double elapsed = now_seconds() - start;
+		char name[40];
+		snprintf(name, sizeof(name), "128-bit radix %d round trip", radices[r]);
+		printf("%-32s %8.1f ns/value  %6.1f Mvalues/s\n", name, elapsed * 1e9 / count, count / elapsed / 1e6);
+	}
+	
+	free(text);
+	free(corpus);
+	return failures != 0 || sink == 0;
+}
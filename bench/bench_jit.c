@@ -0,0 +1,371 @@
+// JIT Benchmark - native expression loops against the bytecode interpreter
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_jit bench/bench_jit.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// Checks every code generator the CPU can run against calc_expr_eval_batch
+// bit for bit: hand-picked and random expressions in x over zeros of both
+// signs, infinities, NaNs, subnormals and random values, at lengths around
+// each vector width, in place and not; and that '^', functions and
+// expressions too deep for the registers fall back to the interpreter. Then
+// times a few expressions per generator against the interpreter and a
+// hand-written C loop, and reports the cost of compiling.
+//
+// Usage: bench_jit [values]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_jit.h"
+
+#define VALUES 4096
+#define MIN_SECONDS 0.2   // Repeat each timing at least this long
+#define RANDOM_EXPRESSIONS 300
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const calc_batch_isa isas[] = {CALC_BATCH_SCALAR, CALC_BATCH_SSE2, CALC_BATCH_AVX2, CALC_BATCH_NEON};
+#define ISA_COUNT (sizeof(isas) / sizeof(isas[0]))
+
+// Values of x: the awkward ones first, then random magnitudes of either sign
+static void fill_xs(double* xs, size_t count) {
+	static const double special[] = {
+		0.0, -0.0, 1.0, -1.0, 2.0, 0.5, 1.0 / 3, 7.0, INFINITY, -INFINITY, NAN, -NAN,
+		4.9e-324, -2.2e-310, 1e308, -1.7e308, 1.0 + 0x1p-52,
+	};
+	size_t special_count = sizeof(special) / sizeof(special[0]);
+	for (size_t i = 0; i < count; i++) {
+		if (i < special_count) {
+			xs[i] = special[i];
+		} else if (i % 5 == 0) {
+			xs[i] = (double)(int)(next_random() % 9) - 4;   // Small integers hit the zero divisors
+		} else {
+			xs[i] = ldexp((double)(next_random() >> 11) * 0x1p-53, (int)(next_random() % 41) - 20);
+			xs[i] = next_random() & 1 ? -xs[i] : xs[i];
+		}
+	}
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static size_t failures = 0;
+
+static void fail(const char* what, const char* got, const char* want) {
+	if (failures++ < 10) {
+		printf("FAIL %s: got %s, expected %s\n", what, got, want);
+	}
+}
+
+// Random terms over x and small constants, nested up to depth levels
+static size_t random_operand(char* out, int depth) {
+	size_t n = 0;
+	if (next_random() % 6 == 0) {
+		out[n++] = '-';
+	}
+	if (depth > 0 && next_random() % 3 == 0) {
+		out[n++] = '(';
+		int terms = 2 + (int)(next_random() % 3);
+		for (int t = 0; t < terms; t++) {
+			if (t) {
+				out[n++] = "+-*/"[next_random() % 4];
+			}
+			n += random_operand(out + n, depth - 1);
+		}
+		out[n++] = ')';
+	} else if (next_random() % 2) {
+		out[n++] = 'x';
+	} else {
+		n += (size_t)sprintf(out + n, "%d.%d", (int)(next_random() % 5), (int)(next_random() % 100));
+	}
+	return n;
+}
+
+// Every length from 0 to 40, and some longer, in place and into a new array
+static void check_expression(const char* text, int native) {
+	static const size_t long_counts[] = {255, 256, 257, 1000, 1001, 1003};
+	calc_expr expr;
+	calc_expr_init(&expr);
+	if (!calc_expr_compile(&expr, text)) {
+		fail(text, expr.error, "a compiled expression");
+		calc_expr_free(&expr);
+		return;
+	}
+	
+	size_t most = 1003;
+	double* xs = malloc(most * sizeof(double));
+	double* want = malloc(most * sizeof(double));
+	double* got = malloc((most + 2) * sizeof(double));
+	fill_xs(xs, most);
+	calc_expr_eval_batch(&expr, want, xs, most);
+	
+	calc_jit jit;
+	calc_jit_init(&jit);
+	int compiled = calc_jit_compile(&jit, &expr);
+	char what[160];
+	snprintf(what, sizeof(what), "%s (%s)", text, calc_batch_isa_name(calc_jit_active()));
+	if (compiled != native) {
+		fail(what, compiled ? "native code" : "the interpreter", native ? "native code" : "the interpreter");
+	}
+	
+	for (size_t c = 0; c < 41 + sizeof(long_counts) / sizeof(long_counts[0]); c++) {
+		size_t count = c < 41 ? c : long_counts[c - 41];
+		for (int in_place = 0; in_place < 2; in_place++) {
+			double* out = in_place ? got : got + 1;
+			if (in_place) {
+				memcpy(out, xs, count * sizeof(double));
+			}
+			out[count] = 12345.0;   // Canary past the end
+			calc_jit_eval(&jit, &expr, out, in_place ? out : xs, count);
+			
+			// Prefix results are independent of count, so want serves every length
+			if (memcmp(out, want, count * sizeof(double)) != 0 || out[count] != 12345.0) {
+				size_t i = 0;
+				while (i < count && memcmp(&out[i], &want[i], sizeof(double)) == 0) {
+					i++;
+				}
+				char got_text[64], want_text[64];
+				snprintf(got_text, sizeof(got_text), i < count ? "%.17g at x = %g" : "a write past the end",
+					i < count ? out[i] : 0.0, i < count ? xs[i] : 0.0);
+				snprintf(want_text, sizeof(want_text), "%.17g (%zu values%s)", i < count ? want[i] : 0.0,
+					count, in_place ? ", in place" : "");
+				fail(what, got_text, want_text);
+				c = 1000;
+				break;
+			}
+		}
+	}
+	calc_jit_free(&jit);
+	calc_expr_free(&expr);
+	free(xs);
+	free(want);
+	free(got);
+}
+
+static void check_generators(void) {
+	static const char* const supported[] = {
+		"x", "7", "-x", "--x", "x + 1", "x - 2.5", "3 * x", "x / 3", "x / 0", "1 / x", "0 / x", "x / x",
+		"-x / -0", "(x + 1) / (x - 1)", "x / (x - x)", "-(x*3 + 1) / (x - 2) / 0 - 7",
+		"((x*0.5 + 1.25)*x - 3)*x + 2", "1e308*x*10", "x*x*x*x*x*x*x*x*x*x",
+		"(x - 1e-300) / 1e300 / 1e300", "1 - (x - (1 - (x - (1 - (x - (1 - (x - 1)))))))",
+	};
+	static const char* const interpreted[] = {"x ^ 2", "sin(x)", "sqrt(x) + x", "2 ^ x / 0"};
+	char deep[256] = "";
+	char text[1024];
+	for (int i = 0; i < 25; i++) {
+		strcat(deep, "x + (");
+	}
+	strcat(deep, "x");
+	for (int i = 0; i < 25; i++) {
+		strcat(deep, ")");
+	}
+	
+	calc_batch_isa best = calc_jit_active();
+	for (size_t s = 0; s < ISA_COUNT; s++) {
+		if (!calc_jit_select(isas[s])) {
+			continue;
+		}
+		int native = isas[s] != CALC_BATCH_SCALAR;
+		for (size_t i = 0; i < sizeof(supported) / sizeof(supported[0]); i++) {
+			check_expression(supported[i], native);
+		}
+		for (size_t i = 0; i < sizeof(interpreted) / sizeof(interpreted[0]); i++) {
+			check_expression(interpreted[i], 0);
+		}
+		check_expression(deep, 0);
+		
+		rng_state = 0x9E3779B97F4A7C15ULL;
+		for (int i = 0; i < RANDOM_EXPRESSIONS; i++) {
+			size_t n = 0;
+			int terms = 2 + (int)(next_random() % 6);
+			for (int t = 0; t < terms; t++) {
+				if (t) {
+					text[n++] = "+-*/"[next_random() % 4];
+				}
+				n += random_operand(text + n, 3);
+			}
+			text[n] = '\0';
+			
+			// Shallow enough for every generator's registers
+			calc_expr expr;
+			calc_expr_init(&expr);
+			calc_expr_compile(&expr, text);
+			int fits = expr.max_depth <= 15;
+			calc_expr_free(&expr);
+			if (fits) {
+				check_expression(text, native);
+			}
+		}
+	}
+	calc_jit_select(best);
+}
+
+// ============================================================================
+// Timing
+// ============================================================================
+
+static void loop_cubic(double* out, const double* xs, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		double x = xs[i];
+		out[i] = ((x * 0.5 + 1.25) * x - 3) * x + 2;
+	}
+}
+
+static void loop_ratio(double* out, const double* xs, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		double x = xs[i];
+		double d = x - 1;
+		out[i] = d != 0 ? (x + 1) / d : 0;
+	}
+}
+
+static void loop_rational(double* out, const double* xs, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		double x = xs[i];
+		double d = x * x + 1;
+		out[i] = (d != 0 ? (x * x - 2 * x + 1) / d : 0) - x / 7;
+	}
+}
+
+static void loop_chain(double* out, const double* xs, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		double x = xs[i];
+		out[i] = ((((x + 1) * x + 2) * x + 3) * x + 4) * 0.25 - x;
+	}
+}
+
+typedef struct {
+	const char* text;
+	void (*loop)(double* out, const double* xs, size_t count);
+} timed_expression;
+
+typedef enum { RUN_INTERPRETER, RUN_LOOP, RUN_JIT } runner;
+
+// Nanoseconds per value
+static double time_runner(runner how, const timed_expression* e, calc_expr* expr, const calc_jit* jit,
+                          double* out, const double* xs, size_t count) {
+	size_t rounds = 0;
+	double start = now_seconds();
+	double elapsed;
+	do {
+		for (int r = 0; r < 8; r++) {
+			if (how == RUN_INTERPRETER) {
+				calc_expr_eval_batch(expr, out, xs, count);
+			} else if (how == RUN_LOOP) {
+				e->loop(out, xs, count);
+			} else {
+				calc_jit_eval(jit, expr, out, xs, count);
+			}
+		}
+		rounds += 8;
+		elapsed = now_seconds() - start;
+	} while (elapsed < MIN_SECONDS);
+	return elapsed * 1e9 / ((double)rounds * count);
+}
+
+static void time_expressions(size_t count) {
+	static const timed_expression expressions[] = {
+		{"((x*0.5 + 1.25)*x - 3)*x + 2", loop_cubic},
+		{"(x + 1) / (x - 1)", loop_ratio},
+		{"(x*x - 2*x + 1) / (x*x + 1) - x/7", loop_rational},
+		{"((((x + 1)*x + 2)*x + 3)*x + 4)*0.25 - x", loop_chain},
+	};
+	double* xs = malloc(count * sizeof(double));
+	double* out = malloc(count * sizeof(double));
+	fill_xs(xs, count);
+	
+	calc_batch_isa best = calc_jit_active();
+	printf("\nns per value over %zu values\n%-42s %8s %8s", count, "expression", "interp", "C loop");
+	for (size_t s = 1; s < ISA_COUNT; s++) {
+		if (calc_jit_select(isas[s])) {
+			printf(" %8s", calc_batch_isa_name(isas[s]));
+		}
+	}
+	printf(" %8s\n", "speedup");
+	
+	for (size_t e = 0; e < sizeof(expressions) / sizeof(expressions[0]); e++) {
+		calc_expr expr;
+		calc_expr_init(&expr);
+		calc_expr_compile(&expr, expressions[e].text);
+		double interpreted = time_runner(RUN_INTERPRETER, &expressions[e], &expr, NULL, out, xs, count);
+		double looped = time_runner(RUN_LOOP, &expressions[e], &expr, NULL, out, xs, count);
+		printf("%-42s %8.3f %8.3f", expressions[e].text, interpreted, looped);
+		double fastest = interpreted;
+		for (size_t s = 1; s < ISA_COUNT; s++) {
+			if (!calc_jit_select(isas[s])) {
+				continue;
+			}
+			calc_jit jit;
+			calc_jit_init(&jit);
+			calc_jit_compile(&jit, &expr);
+			double native = time_runner(RUN_JIT, &expressions[e], &expr, &jit, out, xs, count);
+			fastest = native < fastest ? native : fastest;
+			printf(" %8.3f", native);
+			calc_jit_free(&jit);
+		}
+		printf(" %7.1fx\n", interpreted / fastest);
+		calc_expr_free(&expr);
+	}
+	calc_jit_select(best);
+	free(xs);
+	free(out);
+}
+
+// Compile plus the mapping, for a short and a long expression
+static void time_compile(void) {
+	static const char* const texts[] = {
+		"(x + 1) / (x - 1)",
+		"1 - (x - (1 - (x - (1 - (x - (1 - (x - 1))))))) * x / 3 + x*x*x*x*x*x*x*x / (x + 7) - 2*x*x",
+	};
+	printf("\n%-10s %-8s %10s %12s\n", "compile", "isa", "bytes", "us each");
+	for (size_t t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+		calc_expr expr;
+		calc_expr_init(&expr);
+		calc_expr_compile(&expr, texts[t]);
+		calc_jit jit;
+		calc_jit_init(&jit);
+		int rounds = 2000;
+		double start = now_seconds();
+		for (int r = 0; r < rounds; r++) {
+			calc_jit_compile(&jit, &expr);
+		}
+		double elapsed = now_seconds() - start;
+		printf("%-10s %-8s %10zu %12.2f\n", t ? "long" : "short", calc_batch_isa_name(jit.isa), jit.code_size,
+			elapsed * 1e6 / rounds);
+		calc_jit_free(&jit);
+		calc_expr_free(&expr);
+	}
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : VALUES;
+	
+	check_generators();
+	printf("checks: %s (%s code generator)\n", failures ? "FAILED" : "ok", calc_batch_isa_name(calc_jit_active()));
+	
+	time_expressions(count ? count : 1);
+	time_compile();
+	return failures != 0;
+}
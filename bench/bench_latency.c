@@ -0,0 +1,166 @@
+// Latency Instrumentation Benchmark - hook overhead and histogram checks
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_latency bench/bench_latency.c
+//               $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Drives engines from two threads with known dispatch and render delays, then
+// checks the histograms and JSON output against them. Exits 1 on a failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include "../calc_engine.h"
+#include "../calc_latency.h"
+
+#define DISPATCH_DELAY_NS 2000
+#define RENDER_DELAY_NS 5000
+
+static const char keys[] = "12.5*3-4/2+7=0.125+0.25=";
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void spin(uint64_t ns) {
+	uint64_t until = now_ns() + ns;
+	while (now_ns() < until) {
+	}
+}
+
+static void discard_display(void* ctx, const char* text) {
+	(void)ctx;
+	(void)text;
+}
+
+static void slow_display(void* ctx, const char* text) {
+	(void)ctx;
+	(void)text;
+	spin(RENDER_DELAY_NS);
+}
+
+// Nanoseconds per key for the hooked key loop, without artificial delays
+static double bench_keys(long rounds) {
+	calc_engine engine;
+	calc_engine_init(&engine, discard_display, NULL);
+	uint64_t start = now_ns();
+	for (long r = 0; r < rounds; r++) {
+		for (size_t i = 0; keys[i]; i++) {
+			calc_latency_begin();
+			calc_handle_key(&engine, keys[i]);
+			calc_latency_end();
+		}
+	}
+	double elapsed = (double)(now_ns() - start);
+	calc_engine_free(&engine);
+	return elapsed / ((double)rounds * (sizeof(keys) - 1));
+}
+
+// Each event: DISPATCH_DELAY_NS before the engine, RENDER_DELAY_NS per display update
+static void* drive_events(void* arg) {
+	long rounds = *(const long*)arg;
+	calc_engine engine;
+	calc_engine_init(&engine, slow_display, NULL);
+	for (long r = 0; r < rounds; r++) {
+		for (size_t i = 0; keys[i]; i++) {
+			calc_latency_begin();
+			spin(DISPATCH_DELAY_NS);
+			calc_handle_key(&engine, keys[i]);
+			calc_latency_end();
+		}
+	}
+	calc_engine_free(&engine);
+	return NULL;
+}
+
+static int check(int ok, const char* what) {
+	if (!ok) {
+		printf("FAIL: %s\n", what);
+	}
+	return ok;
+}
+
+int main(int argc, char* argv[]) {
+	long rounds = argc > 1 ? atol(argv[1]) : 200000;
+	long events_per_thread = argc > 2 ? atol(argv[2]) : 120;  // rounds of keys; > one ring
+	
+	// Overhead: hooks compiled in but disabled, then enabled
+	double disabled_ns = bench_keys(rounds);
+	calc_latency_enable(NULL);
+	double enabled_ns = bench_keys(rounds);
+	calc_latency_collect();
+	printf("hooks disabled: %.1f ns/key\nhooks enabled:  %.1f ns/key (+%.1f ns)\n",
+		disabled_ns, enabled_ns, enabled_ns - disabled_ns);
+	calc_latency_reset();
+	
+	// Known delays from two threads at once, each overflowing its ring's drain point
+	pthread_t thread;
+	pthread_create(&thread, NULL, drive_events, &events_per_thread);
+	drive_events(&events_per_thread);
+	pthread_join(thread, NULL);
+	calc_latency_collect();
+	
+	int ok = 1;
+	uint64_t expected = 2 * (uint64_t)events_per_thread * (sizeof(keys) - 1);
+	const calc_latency_histogram* dispatch = calc_latency_phase_histogram(CALC_LATENCY_DISPATCH);
+	const calc_latency_histogram* compute = calc_latency_phase_histogram(CALC_LATENCY_COMPUTING);
+	const calc_latency_histogram* render = calc_latency_phase_histogram(CALC_LATENCY_RENDERING);
+	const calc_latency_histogram* total = calc_latency_phase_histogram(CALC_LATENCY_TOTAL);
+	
+	ok &= check(calc_latency_dropped() == 0, "no events dropped");
+	ok &= check(total->count == expected && dispatch->count == expected
+		&& compute->count == expected && render->count == expected, "one sample per event in every phase");
+	ok &= check(dispatch->total_ns + compute->total_ns + render->total_ns == total->total_ns,
+		"phases add up to the total");
+	ok &= check(dispatch->min_ns >= DISPATCH_DELAY_NS, "dispatch includes the dispatch delay");
+	// Some keys (the first operator) leave the display alone, so not every event renders
+	ok &= check(calc_latency_percentile(render, 50) >= RENDER_DELAY_NS, "render includes the display delay");
+	ok &= check(total->min_ns >= DISPATCH_DELAY_NS, "total includes the dispatch delay");
+	
+	static const calc_latency_phase phases[] = {CALC_LATENCY_DISPATCH, CALC_LATENCY_COMPUTING, CALC_LATENCY_RENDERING, CALC_LATENCY_TOTAL};
+	static const char* const names[] = {"dispatch", "compute", "render", "total"};
+	printf("\n%-10s %8s %10s %10s %10s %10s %10s %10s\n", "phase", "count", "min ns", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns");
+	for (int p = 0; p < 4; p++) {
+		const calc_latency_histogram* h = calc_latency_phase_histogram(phases[p]);
+		uint64_t p50 = calc_latency_percentile(h, 50);
+		uint64_t p90 = calc_latency_percentile(h, 90);
+		uint64_t p99 = calc_latency_percentile(h, 99);
+		uint64_t p999 = calc_latency_percentile(h, 99.9);
+		printf("%-10s %8" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+			names[p], h->count, h->min_ns, p50, p90, p99, p999, h->max_ns);
+		// A percentile is a bucket bound, at most 1/64 above the true value
+		ok &= check(h->min_ns <= p50 + p50 / 64 && p50 <= p90 && p90 <= p99 && p99 <= p999 && p999 <= h->max_ns,
+			"percentiles are ordered and within min/max");
+	}
+	
+	// JSON: totals and every phase present, brackets balanced
+	FILE* json = tmpfile();
+	calc_latency_write_json(json);
+	long size = ftell(json);
+	char* text = calloc((size_t)size + 1, 1);
+	rewind(json);
+	ok &= check(fread(text, 1, (size_t)size, json) == (size_t)size, "JSON readable");
+	fclose(json);
+	char events[64];
+	snprintf(events, sizeof(events), "\"events\": %" PRIu64 ",", expected);
+	ok &= check(strstr(text, events) != NULL, "JSON event count");
+	for (int p = 0; p < 4; p++) {
+		char key[32];
+		snprintf(key, sizeof(key), "\"%s\": {\"count\": %" PRIu64, names[p], expected);
+		ok &= check(strstr(text, key) != NULL, "JSON phase entry");
+	}
+	int depth = 0, balanced = 1;
+	for (const char* c = text; *c; c++) {
+		depth += (*c == '{' || *c == '[') - (*c == '}' || *c == ']');
+		balanced &= depth >= 0;
+	}
+	ok &= check(balanced && depth == 0, "JSON brackets balanced");
+	free(text);
+	
+	printf("\n%s\n", ok ? "all checks passed" : "checks FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,309 @@
+// Scientific Function Benchmark - accuracy and throughput against libm
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_math bench/bench_math.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// Errors are in ULPs of the correctly rounded result, measured against the
+// long double functions; they are only measured where long double is wider
+// than double (x86). Fails if any implementation exceeds the bound that
+// calc_math.h documents, if a batch result differs from the scalar one in any
+// bit, or if a special case comes out wrong.
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "../calc_math.h"
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double random_unit(void) {
+	return ((double)rand() * ((double)RAND_MAX + 1) + rand()) / (((double)RAND_MAX + 1) * ((double)RAND_MAX + 1));
+}
+
+static long double factoriall(long double x) {
+	return tgammal(x + 1);
+}
+
+static double factorial(double x) {
+	return tgamma(x + 1);
+}
+
+static long double percentl(long double x) {
+	return x / 100;
+}
+
+static double percent(double x) {
+	return x / 100;
+}
+
+typedef struct math_case {
+	calc_function function;
+	const char* domain;
+	double (*libm)(double);
+	long double (*reference)(long double);
+	double low, high;
+	int logarithmic;               // |x| log-uniform in [low, high], either sign if signed
+	int is_signed;
+	int integers;                  // Every other sample rounded to an integer
+	double bound;                  // calc_math.h's documented ULP bound
+} math_case;
+
+static const math_case cases[] = {
+	{CALC_SQRT, "[1e-310, 1e308]", sqrt, sqrtl, 1e-310, 1e308, 1, 0, 0, 0.5},
+	{CALC_EXP, "[-745, 709.7]", exp, expl, -745, 709.7, 0, 0, 0, 0.53},
+	{CALC_LN, "[1e-320, 1e308]", log, logl, 1e-320, 1e308, 1, 0, 0, 0.51},
+	{CALC_LOG10, "[1e-320, 1e308]", log10, log10l, 1e-320, 1e308, 1, 0, 0, 0.51},
+	{CALC_SIN, "[-10, 10]", sin, sinl, -10, 10, 0, 0, 0, 0.85},
+	{CALC_SIN, "|x| < 1e300", sin, sinl, 1, 1e300, 1, 1, 0, 0.85},
+	{CALC_COS, "[-10, 10]", cos, cosl, -10, 10, 0, 0, 0, 0.85},
+	{CALC_COS, "|x| < 1e300", cos, cosl, 1, 1e300, 1, 1, 0, 0.85},
+	{CALC_TAN, "[-10, 10]", tan, tanl, -10, 10, 0, 0, 0, 0.8},
+	{CALC_TAN, "|x| < 1e300", tan, tanl, 1, 1e300, 1, 1, 0, 0.8},
+	{CALC_ASIN, "[-1, 1]", asin, asinl, -1, 1, 0, 0, 0, 0.9},
+	{CALC_ACOS, "[-1, 1]", acos, acosl, -1, 1, 0, 0, 0, 0.9},
+	{CALC_ATAN, "|x| < 1e10", atan, atanl, 1e-10, 1e10, 1, 1, 0, 0.9},
+	{CALC_SINH, "[-710, 710]", sinh, sinhl, -710, 710, 0, 0, 0, 0.6},
+	{CALC_SINH, "[-2, 2]", sinh, sinhl, -2, 2, 0, 0, 0, 0.6},
+	{CALC_COSH, "[-710, 710]", cosh, coshl, -710, 710, 0, 0, 0, 0.6},
+	{CALC_COSH, "[-2, 2]", cosh, coshl, -2, 2, 0, 0, 0, 0.6},
+	{CALC_TANH, "[-20, 20]", tanh, tanhl, -20, 20, 0, 0, 0, 0.6},
+	{CALC_FACTORIAL, "[-170, 170]", factorial, factoriall, -170, 170, 0, 0, 1, 1.0},
+	{CALC_GAMMA, "[-170, 171.6]", tgamma, tgammal, -170, 171.6, 0, 0, 0, 1.0},
+	{CALC_GAMMA, "[-5, 12]", tgamma, tgammal, -5, 12, 0, 0, 0, 1.0},
+	{CALC_PERCENT, "[-1e6, 1e6]", percent, percentl, -1e6, 1e6, 0, 0, 0, 0.5},
+};
+
+#define POW_BOUND 0.6
+
+static double sample(const math_case* c) {
+	double x;
+	if (c->logarithmic) {
+		x = exp(log(c->low) + random_unit() * (log(c->high) - log(c->low)));
+		if (c->is_signed && rand() % 2) {
+			x = -x;
+		}
+	} else {
+		x = c->low + random_unit() * (c->high - c->low);
+	}
+	if (c->integers && rand() % 2) {
+		x = nearbyint(x);
+	}
+	return x;
+}
+
+// |got - want| in ULPs of the double nearest want; 0 when both are the same
+// infinity or NaN, and huge when only one is
+static double ulp_error(double got, long double want) {
+	if (isnan(got) || isnan(want)) {
+		return isnan(got) && isnan(want) ? 0 : INFINITY;
+	}
+	double rounded = (double)want;
+	if (isinf(rounded)) {
+		return got == rounded ? 0 : INFINITY;
+	}
+	int exponent;
+	frexp(rounded, &exponent);
+	if (exponent < DBL_MIN_EXP) {
+		exponent = DBL_MIN_EXP;
+	}
+	long double ulp = ldexpl(1, exponent - DBL_MANT_DIG);
+	return (double)(fabsl((long double)got - want) / ulp);
+}
+
+// Bitwise, so -0.0 vs 0.0 counts as a difference
+static int same_results(const double* a, const double* b, size_t count) {
+	return memcmp(a, b, count * sizeof(double)) == 0;
+}
+
+// Results that must come out exactly
+typedef struct exact_case {
+	calc_function function;
+	double x;
+	double expected;
+} exact_case;
+
+static int check_exact(void) {
+	static const exact_case exact[] = {
+		{CALC_SIN, -0.0, -0.0}, {CALC_TAN, -0.0, -0.0}, {CALC_ATAN, -0.0, -0.0},
+		{CALC_COS, 0.0, 1.0}, {CALC_EXP, 0.0, 1.0}, {CALC_EXP, -INFINITY, 0.0},
+		{CALC_EXP, 710, INFINITY}, {CALC_LN, 1.0, 0.0}, {CALC_LN, 0.0, -INFINITY},
+		{CALC_LN, -1.0, NAN}, {CALC_LOG10, 1000, 3}, {CALC_LOG10, 1e-300, -300},
+		{CALC_SQRT, -1.0, NAN}, {CALC_SQRT, 144, 12}, {CALC_ASIN, 2.0, NAN},
+		{CALC_ACOS, 1.0, 0.0}, {CALC_TANH, INFINITY, 1.0}, {CALC_SINH, -0.0, -0.0},
+		{CALC_COSH, -INFINITY, INFINITY}, {CALC_SIN, INFINITY, NAN},
+		{CALC_FACTORIAL, 0, 1}, {CALC_FACTORIAL, 5, 120}, {CALC_FACTORIAL, 20, 2432902008176640000.0},
+		{CALC_FACTORIAL, 171, INFINITY}, {CALC_FACTORIAL, -1, INFINITY}, {CALC_GAMMA, 1, 1},
+		{CALC_GAMMA, 0.0, INFINITY}, {CALC_GAMMA, -0.0, -INFINITY}, {CALC_GAMMA, -3, NAN},
+		{CALC_GAMMA, 172, INFINITY}, {CALC_PERCENT, 50, 0.5},
+	};
+	static const double pow_exact[][3] = {
+		{2, 10, 1024}, {-2, 3, -8}, {-8, 1.0 / 3, NAN}, {0.0, -1, INFINITY}, {-0.0, -1, -INFINITY},
+		{-0.0, 2, 0.0}, {1, NAN, 1}, {NAN, 0, 1}, {-1, INFINITY, 1}, {0.5, INFINITY, 0.0},
+		{10, 308, 1e308}, {10, -5, 1e-5}, {2, -1074, 5e-324}, {2, 1024, INFINITY}, {-INFINITY, 3, -INFINITY},
+	};
+	int ok = 1;
+	for (size_t i = 0; i < sizeof(exact) / sizeof(exact[0]); i++) {
+		double got = calc_math_apply(exact[i].function, exact[i].x);
+		if (isnan(exact[i].expected) ? !isnan(got) : memcmp(&got, &exact[i].expected, sizeof(got)) != 0) {
+			printf("%s(%g) = %.17g, expected %.17g\n", calc_function_name(exact[i].function), exact[i].x, got, exact[i].expected);
+			ok = 0;
+		}
+	}
+	for (size_t i = 0; i < sizeof(pow_exact) / sizeof(pow_exact[0]); i++) {
+		double got = calc_pow(pow_exact[i][0], pow_exact[i][1]);
+		double expected = pow_exact[i][2];
+		if (isnan(expected) ? !isnan(got) : memcmp(&got, &expected, sizeof(got)) != 0) {
+			printf("pow(%g, %g) = %.17g, expected %.17g\n", pow_exact[i][0], pow_exact[i][1], got, expected);
+			ok = 0;
+		}
+	}
+	return ok;
+}
+
+static const calc_batch_isa isas[] = {CALC_BATCH_SCALAR, CALC_BATCH_SSE2, CALC_BATCH_AVX2, CALC_BATCH_NEON};
+#define ISA_COUNT (sizeof(isas) / sizeof(isas[0]))
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+	long rounds = argc > 2 ? atol(argv[2]) : 10;
+	int measure_error = LDBL_MANT_DIG > DBL_MANT_DIG;
+	int ok = check_exact();
+	
+	double* in = malloc(count * sizeof(double));
+	double* y = malloc(count * sizeof(double));
+	double* expected = malloc(count * sizeof(double));
+	double* out = malloc(count * sizeof(double));
+	calc_batch_isa best = calc_math_active();
+	srand(1);
+	
+	printf("%-10s %-16s %8s %8s %8s %8s", "function", "domain", "ulp", "libm ulp", "libm ns", "calc ns");
+	for (size_t s = 0; s < ISA_COUNT; s++) {
+		if (calc_math_select(isas[s])) {
+			printf(" %6s ns", calc_batch_isa_name(isas[s]));
+		}
+	}
+	printf("\n");
+	
+	size_t case_count = sizeof(cases) / sizeof(cases[0]);
+	for (size_t c = 0; c <= case_count; c++) {
+		// The last row is pow, with two arguments
+		int is_pow = c == case_count;
+		const math_case* mc = is_pow ? NULL : &cases[c];
+		double bound = is_pow ? POW_BOUND : mc->bound;
+		for (size_t i = 0; i < count; i++) {
+			if (is_pow) {
+				// Magnitudes 1e-3 to 1e3; integer exponents for negative bases
+				in[i] = exp((random_unit() * 2 - 1) * 6.9);
+				y[i] = (random_unit() * 2 - 1) * 100;
+				if (rand() % 2) {
+					in[i] = -in[i];
+					y[i] = nearbyint(y[i]);
+				}
+			} else {
+				in[i] = sample(mc);
+			}
+		}
+		
+		// Accuracy, scalar
+		double worst = 0, libm_worst = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (is_pow) {
+				expected[i] = calc_pow(in[i], y[i]);
+			} else {
+				expected[i] = calc_math_apply(mc->function, in[i]);
+			}
+			if (measure_error) {
+				long double want = is_pow ? powl(in[i], y[i]) : mc->reference(in[i]);
+				double libm = is_pow ? pow(in[i], y[i]) : mc->libm(in[i]);
+				double error = ulp_error(expected[i], want);
+				if (error > worst) {
+					worst = error;
+				}
+				error = ulp_error(libm, want);
+				if (error > libm_worst) {
+					libm_worst = error;
+				}
+			}
+		}
+		const char* name = is_pow ? "pow" : calc_function_name(mc->function);
+		const char* domain = is_pow ? "|x| < 1e3, |y| < 100" : mc->domain;
+		if (measure_error) {
+			printf("%-10s %-16s %8.3f %8.3f", name, domain, worst, libm_worst);
+			if (worst > bound) {
+				printf("\n%s: %.3f ULP exceeds the documented %.2f\n", name, worst, bound);
+				ok = 0;
+			}
+		} else {
+			printf("%-10s %-16s %8s %8s", name, domain, "-", "-");
+		}
+		
+		// Throughput: libm, scalar calls, then each batch implementation
+		double start = now_seconds();
+		volatile double sink = 0;
+		for (long r = 0; r < rounds; r++) {
+			double sum = 0;
+			for (size_t i = 0; i < count; i++) {
+				sum += is_pow ? pow(in[i], y[i]) : mc->libm(in[i]);
+			}
+			sink += sum;
+		}
+		printf(" %8.1f", (now_seconds() - start) * 1e9 / (count * rounds));
+		start = now_seconds();
+		for (long r = 0; r < rounds; r++) {
+			double sum = 0;
+			for (size_t i = 0; i < count; i++) {
+				sum += is_pow ? calc_pow(in[i], y[i]) : calc_math_apply(mc->function, in[i]);
+			}
+			sink += sum;
+		}
+		printf(" %8.1f", (now_seconds() - start) * 1e9 / (count * rounds));
+		
+		for (size_t s = 0; s < ISA_COUNT; s++) {
+			if (!calc_math_select(isas[s])) {
+				continue;
+			}
+			// Bit-identical to scalar, including odd lengths for the tails
+			for (size_t length = count - 3; length <= count; length++) {
+				if (is_pow) {
+					calc_math_batch_pow(out, in, y, length);
+				} else {
+					calc_math_batch(mc->function, out, in, length);
+				}
+				if (!same_results(out, expected, length)) {
+					printf("\n%s: %s batch differs from scalar\n", calc_batch_isa_name(isas[s]), name);
+					ok = 0;
+					break;
+				}
+			}
+			start = now_seconds();
+			for (long r = 0; r < rounds; r++) {
+				if (is_pow) {
+					calc_math_batch_pow(out, in, y, count);
+				} else {
+					calc_math_batch(mc->function, out, in, count);
+				}
+			}
+			printf(" %9.1f", (now_seconds() - start) * 1e9 / (count * rounds));
+		}
+		printf("\n");
+		calc_math_select(CALC_BATCH_SCALAR);
+	}
+	calc_math_select(best);
+	printf("default: %s\n", calc_batch_isa_name(best));
+	
+	free(in);
+	free(y);
+	free(expected);
+	free(out);
+	if (!ok) {
+		printf("FAILED\n");
+	}
+	return ok ? 0 : 1;
+}
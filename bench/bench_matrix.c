@@ -0,0 +1,529 @@
+// Matrix Benchmark - blocked products, LU and the engine's matrix keys
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_matrix bench/bench_matrix.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// Checks products against a plain triple loop on awkward shapes with every
+// kernel, on one thread and split across several (small integers, so both
+// sums are exact); element-wise operators against perform_operation bit for
+// bit; solve and inverse residuals; known determinants; parsing and
+// formatting; and the engine's matrix keys. Then reports GFLOP/s of square
+// products from 4 x 4 to 4096 x 4096 per kernel, thread scaling of the
+// largest, and the LU-based operations.
+//
+// Usage: bench_matrix [largest size]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_engine.h"
+#include "../calc_matrix.h"
+
+#define LARGEST_SIZE 4096
+#define OTHER_KERNELS_LARGEST 1024   // Slower kernels stop here
+#define NAIVE_LARGEST 512
+#define MIN_SECONDS 0.2              // Repeat each timing at least this long
+
+// ============================================================================
+// Data
+// ============================================================================
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Small integers: every product and partial sum is exact in any order
+static void fill_integers(double* data, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		data[i] = (double)(int)(next_random() % 9) - 4;
+	}
+}
+
+static void fill_uniform(double* data, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		data[i] = (double)(next_random() >> 11) * 0x1p-53 - 0.5;
+	}
+}
+
+// Random, with a heavy diagonal so it is far from singular
+static void well_conditioned(calc_matrix* m, size_t n) {
+	calc_matrix_resize(m, n, n);
+	fill_uniform(m->data, n * n);
+	for (size_t i = 0; i < n; i++) {
+		m->data[i * n + i] += (double)n;
+	}
+}
+
+static void naive_gemm(size_t m, size_t n, size_t k, double alpha, const double* a, size_t lda,
+                       const double* b, size_t ldb, double* c, size_t ldc) {
+	for (size_t i = 0; i < m; i++) {
+		for (size_t j = 0; j < n; j++) {
+			double sum = 0;
+			for (size_t p = 0; p < k; p++) {
+				sum += a[i * lda + p] * b[p * ldb + j];
+			}
+			c[i * ldc + j] += alpha * sum;
+		}
+	}
+}
+
+static const calc_batch_isa isas[] = {CALC_BATCH_SCALAR, CALC_BATCH_SSE2, CALC_BATCH_AVX2, CALC_BATCH_NEON};
+#define ISA_COUNT (sizeof(isas) / sizeof(isas[0]))
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static size_t failures = 0;
+
+static void fail(const char* what, const char* got, const char* want) {
+	if (failures++ < 10) {
+		printf("FAIL %s: got %s, expected %s\n", what, got, want);
+	}
+}
+
+// C += alpha A B on blocks inside larger arrays, against the triple loop
+static void check_gemm_shape(size_t m, size_t n, size_t k, double alpha) {
+	size_t lda = k + 3;
+	size_t ldb = n + 5;
+	size_t ldc = n + 1;
+	double* a = malloc(m * lda * sizeof(double));
+	double* b = malloc(k * ldb * sizeof(double));
+	double* c = malloc(m * ldc * sizeof(double));
+	double* want = malloc(m * ldc * sizeof(double));
+	fill_integers(a, m * lda);
+	fill_integers(b, k * ldb);
+	fill_integers(c, m * ldc);
+	memcpy(want, c, m * ldc * sizeof(double));
+	
+	calc_matrix_gemm(m, n, k, alpha, a, lda, b, ldb, c, ldc);
+	naive_gemm(m, n, k, alpha, a, lda, b, ldb, want, ldc);
+	if (memcmp(c, want, m * ldc * sizeof(double)) != 0) {
+		char got[96];
+		snprintf(got, sizeof(got), "%s kernel, %d threads, %zux%zu by %zux%zu differ",
+			calc_batch_isa_name(calc_matrix_active()), calc_matrix_threads(), m, k, k, n);
+		fail("product", got, "the triple loop's sums");
+	}
+	free(a);
+	free(b);
+	free(c);
+	free(want);
+}
+
+static void check_products(void) {
+	static const size_t shapes[][3] = {
+		{1, 1, 1}, {1, 7, 3}, {5, 1, 9}, {3, 3, 3}, {7, 9, 11}, {6, 8, 256}, {13, 17, 257},
+		{97, 95, 300}, {100, 1030, 5}, {191, 200, 173}, {300, 7, 300}, {9, 300, 1000},
+	};
+	calc_batch_isa best = calc_matrix_active();
+	int threads = calc_matrix_threads();
+	for (size_t s = 0; s < ISA_COUNT; s++) {
+		if (!calc_matrix_select(isas[s])) {
+			continue;
+		}
+		// Several threads even on one CPU, so the split is checked everywhere
+		static const int thread_counts[] = {1, 3};
+		for (int t = 0; t < 2; t++) {
+			calc_matrix_set_threads(thread_counts[t]);
+			for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+				check_gemm_shape(shapes[i][0], shapes[i][1], shapes[i][2], i % 2 ? -1.0 : 1.0);
+			}
+		}
+	}
+	calc_matrix_select(best);
+	calc_matrix_set_threads(threads);
+}
+
+// Element by element, with numbers on either side, as perform_operation does it
+static void check_elementwise(void) {
+	static const char ops[] = "+-*/^";
+	size_t rows = 7;
+	size_t cols = 13;
+	calc_matrix a, b, result;
+	calc_matrix_init(&a);
+	calc_matrix_init(&b);
+	calc_matrix_init(&result);
+	calc_matrix_resize(&a, rows, cols);
+	calc_matrix_resize(&b, rows, cols);
+	fill_uniform(a.data, rows * cols);
+	fill_integers(b.data, rows * cols);   // Zeros for the division rule
+	b.data[0] = 0;
+	
+	for (const char* op = ops; *op; op++) {
+		calc_matrix_elementwise(&result, &a, *op, &b);
+		for (size_t i = 0; i < rows * cols; i++) {
+			double want = perform_operation(a.data[i], *op, b.data[i]);
+			if (memcmp(&result.data[i], &want, sizeof(double)) != 0) {
+				fail("element-wise", "a different double", "perform_operation's");
+				break;
+			}
+		}
+		calc_matrix_scalar(&result, &a, *op, 0.0, 0);
+		calc_matrix_scalar(&b, &b, *op, 3.0, 1);   // In place
+		for (size_t i = 0; i < rows * cols; i++) {
+			double want = perform_operation(a.data[i], *op, 0.0);
+			if (memcmp(&result.data[i], &want, sizeof(double)) != 0) {
+				fail("matrix op number", "a different double", "perform_operation's");
+				break;
+			}
+		}
+	}
+	calc_matrix_resize(&b, rows + 1, cols);
+	if (calc_matrix_elementwise(&result, &a, '+', &b)) {
+		fail("element-wise shapes", "7x13 + 8x13 accepted", "rejected");
+	}
+	calc_matrix_free(&a);
+	calc_matrix_free(&b);
+	calc_matrix_free(&result);
+}
+
+// Largest |A X - B| over the elements
+static double residual(const calc_matrix* a, const calc_matrix* x, const calc_matrix* b) {
+	calc_matrix product;
+	calc_matrix_init(&product);
+	calc_matrix_multiply(&product, a, x);
+	double worst = 0;
+	for (size_t i = 0; i < b->rows * b->cols; i++) {
+		worst = fmax(worst, fabs(product.data[i] - b->data[i]));
+	}
+	calc_matrix_free(&product);
+	return worst;
+}
+
+static void check_lu(void) {
+	static const size_t sizes[] = {1, 2, 5, 63, 64, 65, 130, 300};
+	calc_matrix a, b, x, identity;
+	calc_matrix_init(&a);
+	calc_matrix_init(&b);
+	calc_matrix_init(&x);
+	calc_matrix_init(&identity);
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t n = sizes[s];
+		well_conditioned(&a, n);
+		calc_matrix_resize(&b, n, 3);
+		fill_uniform(b.data, n * 3);
+		char got[64];
+		if (!calc_matrix_solve(&x, &a, &b) || residual(&a, &x, &b) > 1e-12 * n) {
+			snprintf(got, sizeof(got), "n = %zu, residual %g", n, x.rows ? residual(&a, &x, &b) : -1.0);
+			fail("solve", got, "a solution");
+		}
+		calc_matrix_identity(&identity, n);
+		if (!calc_matrix_inverse(&x, &a) || residual(&a, &x, &identity) > 1e-12 * n) {
+			snprintf(got, sizeof(got), "n = %zu, residual %g", n, x.rows ? residual(&a, &x, &identity) : -1.0);
+			fail("inverse", got, "the inverse");
+		}
+	}
+	
+	// Rank one: singular, with determinant 0
+	calc_matrix_resize(&a, 70, 70);
+	for (size_t i = 0; i < 70; i++) {
+		for (size_t j = 0; j < 70; j++) {
+			a.data[i * 70 + j] = (double)((i + 1) * (j + 1));
+		}
+	}
+	double determinant = 1;
+	if (calc_matrix_inverse(&x, &a) || !calc_matrix_determinant(&a, &determinant) || determinant != 0) {
+		fail("singular", "an inverse or a determinant", "none, and 0");
+	}
+	calc_matrix_free(&a);
+	calc_matrix_free(&b);
+	calc_matrix_free(&x);
+	calc_matrix_free(&identity);
+}
+
+static void check_determinant(const char* text, double want) {
+	calc_matrix m;
+	calc_matrix_init(&m);
+	double got = NAN;
+	if (!calc_matrix_parse(&m, text, strlen(text)) || !calc_matrix_determinant(&m, &got)
+		|| fabs(got - want) > 1e-9 * fmax(1, fabs(want))) {
+		char shown[32];
+		char expected[32];
+		snprintf(shown, sizeof(shown), "%.17g", got);
+		snprintf(expected, sizeof(expected), "%.17g", want);
+		fail(text, shown, expected);
+	}
+	calc_matrix_free(&m);
+}
+
+static void check_determinants(void) {
+	check_determinant("[2 1; 1 3]", 5);
+	check_determinant("[0 1; 1 0]", -1);
+	check_determinant("[0 0 1; 0 1 0; 1 0 0]", -1);
+	check_determinant("[1 2 3; 4 5 6; 7 8 10]", -3);
+	check_determinant("[2 0 0 0; 1 3 0 0; 4 5 6 0; 7 8 9 10]", 360);
+	check_determinant("[1 2; 2 4]", 0);
+	check_determinant("[7]", 7);
+	
+	// A permutation of a large triangular matrix: the product of its diagonal,
+	// with the sign of the row swaps
+	size_t n = 200;
+	calc_matrix m;
+	calc_matrix_init(&m);
+	calc_matrix_resize(&m, n, n);
+	memset(m.data, 0, n * n * sizeof(double));
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j <= i; j++) {
+			m.data[(n - 1 - i) * n + j] = i == j ? (i % 2 ? 2.0 : 0.5) : 1.0 / (double)(i + j + 1);
+		}
+	}
+	double got = 0;
+	double want = n / 2 % 2 ? -1 : 1;   // n/2 swaps reverse the rows
+	calc_matrix_determinant(&m, &got);
+	if (fabs(got - want) > 1e-9) {
+		char shown[32];
+		snprintf(shown, sizeof(shown), "%.17g", got);
+		fail("reversed triangular determinant", shown, want > 0 ? "1" : "-1");
+	}
+	calc_matrix_free(&m);
+}
+
+static void check_parse(const char* text, const char* want) {
+	calc_matrix m;
+	calc_matrix_init(&m);
+	char got[256];
+	if (!calc_matrix_parse(&m, text, strlen(text))) {
+		snprintf(got, sizeof(got), "a parse error");
+	} else {
+		calc_matrix_format(&m, got, sizeof(got), NULL);
+	}
+	if (strcmp(got, want) != 0) {
+		fail(text, got, want);
+	}
+	calc_matrix_free(&m);
+}
+
+static void check_text(void) {
+	check_parse("[1 2; 3 4]", "[1, 2; 3, 4]");
+	check_parse("1,2,3\r\n4,5,6\r\n", "[1, 2, 3; 4, 5, 6]");
+	check_parse("  0.1 -2e3\n\n 1e-5 7 \n", "[0.1, -2000; 0.00001, 7]");
+	check_parse("[1 2; 3]", "a parse error");
+	check_parse("1 x", "a parse error");
+	check_parse("[]", "[]");
+	check_parse("0 1 2 3 4; 5 6 7 8 9; 10 11 12 13 14; 15 16 17 18 19; 20 21 22 23 24",
+		"5x5 [0, 1, 2, 3, ...; 5, 6, 7, 8, ...; 10, 11, 12, 13, ...; 15, 16, 17, 18, ...; ...]");
+	
+	// Truncated, terminated, and the length the whole needs
+	calc_matrix m;
+	calc_matrix_init(&m);
+	calc_matrix_parse(&m, "1 2; 3 4", 8);
+	char small[6];
+	size_t length = calc_matrix_format(&m, small, sizeof(small), NULL);
+	if (length != 12 || strcmp(small, "[1, 2") != 0) {
+		fail("truncated format", small, "[1, 2 of 12");
+	}
+	calc_matrix_free(&m);
+}
+
+static char shown[4096];
+
+static void capture_display(void* ctx, const char* text) {
+	(void)ctx;
+	snprintf(shown, sizeof(shown), "%s", text);
+}
+
+// Keys into a fresh engine, where 'A' and 'B' load the given matrices
+static void check_keys(const char* a, const char* b, const char* keys, const char* want) {
+	calc_engine engine;
+	calc_engine_init(&engine, capture_display, NULL);
+	calc_matrix m;
+	calc_matrix_init(&m);
+	for (const char* k = keys; *k; k++) {
+		if (*k == 'A' || *k == 'B') {
+			const char* text = *k == 'A' ? a : b;
+			calc_matrix_parse(&m, text, strlen(text));
+			calc_engine_set_matrix(&engine, &m);
+		} else {
+			calc_handle_key(&engine, *k);
+		}
+	}
+	if (strcmp(shown, want) != 0) {
+		char what[128];
+		snprintf(what, sizeof(what), "%s with A = %s, B = %s", keys, a, b);
+		fail(what, shown, want);
+	}
+	calc_matrix_free(&m);
+	calc_engine_free(&engine);
+}
+
+static void check_engine(void) {
+	const char* a = "[2 1; 1 3]";
+	const char* b = "[1 0; 0 2]";
+	check_keys(a, b, "A", "[2, 1; 1, 3]");
+	check_keys(a, b, "A@B=", "[2, 2; 1, 6]");
+	check_keys(a, b, "A*B=", "[2, 0; 0, 6]");
+	check_keys(a, b, "A+B-A=", "[1, 0; 0, 2]");
+	check_keys(a, b, "A\\A=", "[1, 0; 0, 1]");
+	check_keys(a, b, "2*A=", "[4, 2; 2, 6]");
+	check_keys(a, b, "A/0=", "[0, 0; 0, 0]");
+	check_keys(a, b, "2\\A=", "[1, 0.5; 0.5, 1.5]");
+	check_keys(a, b, "A\\2=", "Error");
+	check_keys(a, "[1 2 3]", "A@B=", "Error");
+	check_keys(a, b, "Ad", "5");
+	check_keys(a, b, "Ai", "[0.6, -0.2; -0.2, 0.4]");
+	check_keys(a, "[1 2 3]", "B'", "[1; 2; 3]");
+	check_keys(a, "[1 2 3]", "Bd", "Error");
+	check_keys(a, b, "Br", "[1, 0; 0, 1.4142135623730951]");
+	check_keys(a, b, "A+Bd", "2");                   // The determinant of B
+	check_keys(a, b, "A+=", "[4, 2; 2, 6]");          // Repeats the operand, like 2 + =
+	check_keys(a, b, "A+Ad+1=", "[8, 7; 7, 9]");      // (A + det A) + 1
+	check_keys(a, b, "A@B=5+1=", "6");                // A typed number ends the matrix
+	check_keys(a, b, "3@4=", "12");
+	check_keys(a, b, "4\\2=", "0.5");
+	check_keys(a, b, "4i", "0.25");
+	check_keys(a, b, "0i", "0");
+	
+	// Decimal mode has no matrices, and its keys ignore the matrix ones
+	calc_engine engine;
+	calc_engine_init(&engine, capture_display, NULL);
+	calc_engine_set_precision(&engine, 34);
+	calc_matrix m;
+	calc_matrix_init(&m);
+	calc_matrix_parse(&m, a, strlen(a));
+	if (calc_engine_set_matrix(&engine, &m)) {
+		fail("decimal mode", "a matrix", "no matrices");
+	}
+	calc_handle_key(&engine, '4');
+	calc_handle_key(&engine, 'i');
+	if (strcmp(shown, "4") != 0) {
+		fail("decimal mode 4i", shown, "4");
+	}
+	calc_matrix_free(&m);
+	calc_engine_free(&engine);
+}
+
+// ============================================================================
+// Timing
+// ============================================================================
+
+// GFLOP/s of n x n products, repeated for at least MIN_SECONDS
+static double product_rate(size_t n, const double* a, const double* b, double* c, int naive) {
+	double flops = 2.0 * n * n * n;
+	long rounds = 0;
+	double start = now_seconds();
+	double elapsed;
+	do {
+		if (naive) {
+			naive_gemm(n, n, n, 1.0, a, n, b, n, c, n);
+		} else {
+			calc_matrix_gemm(n, n, n, 1.0, a, n, b, n, c, n);
+		}
+		rounds++;
+		elapsed = now_seconds() - start;
+	} while (elapsed < MIN_SECONDS);
+	return flops * rounds / elapsed / 1e9;
+}
+
+static void time_products(size_t largest) {
+	double* a = malloc(largest * largest * sizeof(double));
+	double* b = malloc(largest * largest * sizeof(double));
+	double* c = calloc(largest * largest, sizeof(double));
+	fill_uniform(a, largest * largest);
+	fill_uniform(b, largest * largest);
+	calc_batch_isa best = calc_matrix_active();
+	int threads = calc_matrix_threads();
+	
+	printf("\nsquare products, GFLOP/s on one thread (naive = triple loop)\n%6s %8s", "n", "naive");
+	for (size_t s = 0; s < ISA_COUNT; s++) {
+		if (calc_matrix_select(isas[s])) {
+			printf(" %8s", calc_batch_isa_name(isas[s]));
+		}
+	}
+	printf("\n");
+	calc_matrix_set_threads(1);
+	for (size_t n = 4; n <= largest; n *= 2) {
+		printf("%6zu", n);
+		if (n <= NAIVE_LARGEST) {
+			printf(" %8.2f", product_rate(n, a, b, c, 1));
+		} else {
+			printf(" %8s", "-");
+		}
+		for (size_t s = 0; s < ISA_COUNT; s++) {
+			if (!calc_matrix_select(isas[s])) {
+				continue;
+			}
+			if (isas[s] == best || n <= OTHER_KERNELS_LARGEST) {
+				printf(" %8.2f", product_rate(n, a, b, c, 0));
+			} else {
+				printf(" %8s", "-");
+			}
+		}
+		printf("\n");
+		fflush(stdout);
+	}
+	calc_matrix_select(best);
+	
+	// The largest product the benchmark ran, on 1..CPUs threads
+	size_t n = 1;
+	while (n * 2 <= largest) {
+		n *= 2;
+	}
+	printf("\n%zu x %zu with the %s kernel\n%8s %10s %8s\n", n, n, calc_batch_isa_name(best),
+		"threads", "GFLOP/s", "speedup");
+	double single = 0;
+	for (int t = 1; t <= threads; t++) {
+		calc_matrix_set_threads(t);
+		double rate = product_rate(n, a, b, c, 0);
+		single = t == 1 ? rate : single;
+		printf("%8d %10.2f %8.2f\n", t, rate, rate / single);
+	}
+	calc_matrix_set_threads(threads);
+	free(a);
+	free(b);
+	free(c);
+}
+
+static void time_lu(void) {
+	static const size_t sizes[] = {64, 256, 1024};
+	calc_matrix a, x;
+	calc_matrix_init(&a);
+	calc_matrix_init(&x);
+	printf("\n%6s %14s %14s %10s\n", "n", "det ms", "inverse ms", "det GFLOP/s");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t n = sizes[s];
+		well_conditioned(&a, n);
+		double determinant;
+		double start = now_seconds();
+		calc_matrix_determinant(&a, &determinant);
+		double det_time = now_seconds() - start;
+		start = now_seconds();
+		calc_matrix_inverse(&x, &a);
+		double inverse_time = now_seconds() - start;
+		printf("%6zu %14.3f %14.3f %10.2f\n", n, det_time * 1e3, inverse_time * 1e3,
+			2.0 / 3.0 * n * n * n / det_time / 1e9);
+	}
+	calc_matrix_free(&a);
+	calc_matrix_free(&x);
+}
+
+int main(int argc, char* argv[]) {
+	size_t largest = argc > 1 ? (size_t)atol(argv[1]) : LARGEST_SIZE;
+	
+	check_products();
+	check_elementwise();
+	check_lu();
+	check_determinants();
+	check_text();
+	check_engine();
+	printf("checks: %s (%s kernel, %d threads)\n", failures ? "FAILED" : "ok",
+		calc_batch_isa_name(calc_matrix_active()), calc_matrix_threads());
+	
+	time_products(largest);
+	time_lu();
+	return failures != 0;
+}
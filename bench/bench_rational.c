@@ -0,0 +1,391 @@
+// Rational Mode Benchmark - exact fractions against Euclid and the double path
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_rational bench/bench_rational.c
+//               $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Checks the engine's rational mode on calculations doubles get wrong and on
+// results past the double range, the binary GCD against Euclid's, that long random chains undone in reverse come
+// back to exactly where they started (growing past 64 bits and shrinking back
+// on the way), and double round trips. Then times the GCDs, mixed chains of
+// rationals against perform_operation, and keys per second in both modes.
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_engine.h"
+#include "../calc_rational.h"
+
+#define GCD_PAIRS 1000000
+#define CHAIN_LENGTH 2000
+#define SHORT_CHAINS 200000
+#define SHORT_CHAIN_LENGTH 8
+#define OPERAND_POOL (1 << 16)
+#define KEY_ROUNDS 200000
+
+// ============================================================================
+// Data
+// ============================================================================
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t euclid_gcd(uint64_t a, uint64_t b) {
+	while (b != 0) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// A non-zero operand like one typed in: up to three digits, maybe with one
+// or two decimal places
+static void random_operand(calc_rational* r) {
+	uint64_t mantissa = 1 + next_random() % 999;
+	calc_rational_set_scaled(r, mantissa, (int)(next_random() % 3), next_random() % 4 == 0);
+}
+
+static const char chain_operators[] = "+-*/";
+
+static char inverse_operator(char op) {
+	return op == '+' ? '-' : op == '-' ? '+' : op == '*' ? '/' : '*';
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static size_t failures = 0;
+
+static void fail(const char* what, const char* got, const char* want) {
+	if (failures++ < 10) {
+		printf("FAIL %s: got %s, expected %s\n", what, got, want);
+	}
+}
+
+static int same_value(const calc_rational* a, const calc_rational* b) {
+	calc_rational difference;
+	calc_rational_init(&difference);
+	calc_rational_sub(&difference, a, b);
+	int same = calc_rational_is_zero(&difference);
+	calc_rational_free(&difference);
+	return same;
+}
+
+static char shown[4096];
+
+static void capture_display(void* ctx, const char* text) {
+	(void)ctx;
+	snprintf(shown, sizeof(shown), "%s", text);
+}
+
+// Keys typed into a fresh engine in the given rational mode, and what it shows
+static void check_keys(int mode, const char* keys, const char* want) {
+	calc_engine engine;
+	calc_engine_init(&engine, capture_display, NULL);
+	calc_engine_set_rational_mode(&engine, mode);
+	for (const char* k = keys; *k; k++) {
+		calc_handle_key(&engine, *k);
+	}
+	if (strcmp(shown, want) != 0) {
+		fail(keys, shown, want);
+	}
+	calc_engine_free(&engine);
+}
+
+// Keys whose result comes from a double function: the value must be within
+// a few ulps of want
+static void check_value(const char* keys, double want) {
+	calc_engine engine;
+	calc_engine_init(&engine, capture_display, NULL);
+	calc_engine_set_rational_mode(&engine, CALC_RATIONAL_FRACTIONS);
+	for (const char* k = keys; *k; k++) {
+		calc_handle_key(&engine, *k);
+	}
+	if (!(fabs(engine.input.display_value - want) <= 1e-15 * fabs(want))) {
+		char got[32];
+		char expected[32];
+		snprintf(got, sizeof(got), "%.17g", engine.input.display_value);
+		snprintf(expected, sizeof(expected), "%.17g", want);
+		fail(keys, got, expected);
+	}
+	calc_engine_free(&engine);
+}
+
+static void check_engine(void) {
+	check_keys(CALC_RATIONAL_FRACTIONS, "1/3*3=", "1");
+	check_keys(CALC_RATIONAL_FRACTIONS, "0.1+0.2=", "3/10");
+	check_keys(CALC_RATIONAL_FRACTIONS, "1/3=", "1/3");
+	check_keys(CALC_RATIONAL_FRACTIONS, "1-0.9-0.1=", "0");
+	check_keys(CALC_RATIONAL_FRACTIONS, "2-7/4=", "-5/4");
+	check_keys(CALC_RATIONAL_FRACTIONS, "50+10%", "5");
+	check_keys(CALC_RATIONAL_FRACTIONS, "2^64=", "18446744073709551616");
+	check_keys(CALC_RATIONAL_FRACTIONS, "1/0=", "0");
+	
+	// Past the double range ((10^301)^300 in the chain too): the double
+	// display's Infinity and NaN, kept through further arithmetic
+	check_keys(CALC_RATIONAL_FRACTIONS, "2^99999999=", "Infinity");
+	check_keys(CALC_RATIONAL_FRACTIONS, "0-2^99999999=", "-Infinity");
+	check_keys(CALC_RATIONAL_FRACTIONS, "0-4=r", "NaN");
+	check_keys(CALC_RATIONAL_DECIMALS, "0-4=r", "NaN");
+	check_keys(CALC_RATIONAL_FRACTIONS, "2^99999999=-1=", "Infinity");
+	check_keys(CALC_RATIONAL_FRACTIONS, "2^99999999=*0=", "NaN");
+	check_keys(CALC_RATIONAL_FRACTIONS, "10^300*10^300=r", "Infinity");
+	
+	// Bignums beyond the double range, scaled before the double function
+	check_value("10^600=r", 1e300);
+	check_value("0.1^600=r", 1e-300);
+	check_value("10^400=n", 400 * 2.302585092994045684);
+	check_value("10^400=g", 400);
+	check_value("10^400^0.5=", 1e200);
+	check_value("0.1^400^0.5=", 1e-200);
+	check_value("10^800^0.25=", 1e200);
+	check_keys(CALC_RATIONAL_DECIMALS, "1/6=", "0.1(6)");
+	check_keys(CALC_RATIONAL_DECIMALS, "22/7=", "3.(142857)");
+	check_keys(CALC_RATIONAL_DECIMALS, "1/8=", "0.125");
+	
+	// The same keys in double mode drift
+	calc_engine engine;
+	calc_engine_init(&engine, NULL, NULL);
+	const char* keys = "0.1+0.2-0.3=";
+	for (const char* k = keys; *k; k++) {
+		calc_handle_key(&engine, *k);
+	}
+	printf("0.1 + 0.2 - 0.3: %.17g in double mode, 0 in rational mode\n", engine.input.display_value);
+	calc_engine_free(&engine);
+}
+
+static void check_gcd(void) {
+	for (int i = 0; i < 100000; i++) {
+		uint64_t a = next_random() >> (next_random() % 64);
+		uint64_t b = next_random() >> (next_random() % 64);
+		if (i % 8 == 0) {
+			uint64_t common = 1 + next_random() % 1000;
+			a = (a >> 10) * common;
+			b = (b >> 10) * common;
+		}
+		if (calc_rational_gcd(a, b) != euclid_gcd(a, b)) {
+			char got[32];
+			char want[32];
+			snprintf(got, sizeof(got), "%" PRIu64, calc_rational_gcd(a, b));
+			snprintf(want, sizeof(want), "%" PRIu64, euclid_gcd(a, b));
+			fail("gcd", got, want);
+			return;
+		}
+	}
+}
+
+// Apply a random chain, then its inverses in reverse: the value must come
+// back exactly, and back to machine words
+static void check_chains(void) {
+	static calc_rational operands[CHAIN_LENGTH];
+	static char operators[CHAIN_LENGTH];
+	calc_rational start;
+	calc_rational value;
+	calc_rational_init(&start);
+	calc_rational_init(&value);
+	int promoted = 0;
+	
+	for (int c = 0; c < 20; c++) {
+		random_operand(&start);
+		calc_rational_copy(&value, &start);
+		for (int i = 0; i < CHAIN_LENGTH; i++) {
+			calc_rational_init(&operands[i]);
+			random_operand(&operands[i]);
+			operators[i] = chain_operators[next_random() % 4];
+			calc_rational_operation(&value, &value, operators[i], &operands[i]);
+			promoted |= value.big;
+		}
+		for (int i = CHAIN_LENGTH - 1; i >= 0; i--) {
+			calc_rational_operation(&value, &value, inverse_operator(operators[i]), &operands[i]);
+			calc_rational_free(&operands[i]);
+		}
+		if (!same_value(&value, &start) || value.big) {
+			char got[256];
+			char want[256];
+			calc_rational_to_string(&value, got, sizeof(got), 0);
+			calc_rational_to_string(&start, want, sizeof(want), 0);
+			fail("undone chain", got, want);
+			break;
+		}
+	}
+	if (!promoted) {
+		fail("promotion", "machine words", "bignums");
+	}
+	calc_rational_free(&start);
+	calc_rational_free(&value);
+}
+
+// Doubles convert exactly, so converting back gives the same bits
+static void check_doubles(void) {
+	calc_rational r;
+	calc_rational_init(&r);
+	for (int i = 0; i < 100000; i++) {
+		uint64_t bits = next_random();
+		double value;
+		memcpy(&value, &bits, sizeof(double));
+		if (!calc_rational_set_double(&r, value)) {
+			continue;   // Infinity or NaN
+		}
+		double back = calc_rational_to_double(&r);
+		if (back != value) {
+			char got[32];
+			char want[32];
+			snprintf(got, sizeof(got), "%.17g", back);
+			snprintf(want, sizeof(want), "%.17g", value);
+			fail("double round trip", got, want);
+			break;
+		}
+	}
+	calc_rational_free(&r);
+}
+
+// ============================================================================
+// Timings
+// ============================================================================
+
+static void time_gcd(void) {
+	uint64_t* pairs = malloc(2 * GCD_PAIRS * sizeof(uint64_t));
+	if (!pairs) {
+		return;
+	}
+	for (size_t i = 0; i < 2 * GCD_PAIRS; i++) {
+		pairs[i] = next_random();
+	}
+	uint64_t sums[2] = {0, 0};
+	double start = now_seconds();
+	for (size_t i = 0; i < GCD_PAIRS; i++) {
+		sums[0] += calc_rational_gcd(pairs[2 * i], pairs[2 * i + 1]);
+	}
+	double binary = now_seconds() - start;
+	start = now_seconds();
+	for (size_t i = 0; i < GCD_PAIRS; i++) {
+		sums[1] += euclid_gcd(pairs[2 * i], pairs[2 * i + 1]);
+	}
+	double euclid = now_seconds() - start;
+	if (sums[0] != sums[1]) {
+		fail("gcd sums", "binary", "euclid");
+	}
+	printf("64-bit gcd: binary %.1f ns, Euclid %.1f ns\n", binary * 1e9 / GCD_PAIRS, euclid * 1e9 / GCD_PAIRS);
+	free(pairs);
+}
+
+// Many short chains like typed calculations, then one long one that grows
+// into bignums; the same operations in double alongside
+static void time_chains(void) {
+	static calc_rational operands[OPERAND_POOL];
+	static double operand_values[OPERAND_POOL];
+	static char operators[OPERAND_POOL];
+	calc_rational value;
+	calc_rational_init(&value);
+	double sink = 0;
+	
+	for (int i = 0; i < OPERAND_POOL; i++) {
+		calc_rational_init(&operands[i]);
+		random_operand(&operands[i]);
+		operand_values[i] = calc_rational_to_double(&operands[i]);
+		operators[i] = chain_operators[next_random() % 4];
+	}
+	double start = now_seconds();
+	for (int c = 0; c < SHORT_CHAINS; c++) {
+		int first = (c * SHORT_CHAIN_LENGTH) % OPERAND_POOL;
+		calc_rational_copy(&value, &operands[first]);
+		for (int i = first + 1; i < first + SHORT_CHAIN_LENGTH; i++) {
+			calc_rational_operation(&value, &value, operators[i], &operands[i]);
+		}
+		sink += value.big ? 0 : (double)value.num;
+	}
+	double rational_time = now_seconds() - start;
+	start = now_seconds();
+	for (int c = 0; c < SHORT_CHAINS; c++) {
+		int first = (c * SHORT_CHAIN_LENGTH) % OPERAND_POOL;
+		double result = operand_values[first];
+		for (int i = first + 1; i < first + SHORT_CHAIN_LENGTH; i++) {
+			result = perform_operation(result, operators[i], operand_values[i]);
+		}
+		sink += result;
+	}
+	double double_time = now_seconds() - start;
+	int operations = SHORT_CHAINS * (SHORT_CHAIN_LENGTH - 1);
+	printf("%d-term chains: rational %.1f ns/op, double %.1f ns/op\n", SHORT_CHAIN_LENGTH,
+		rational_time * 1e9 / operations, double_time * 1e9 / operations);
+	for (int i = 0; i < OPERAND_POOL; i++) {
+		calc_rational_free(&operands[i]);
+	}
+	
+	// One long chain: the fraction keeps every digit, the double keeps 17
+	calc_rational operand;
+	calc_rational_init(&operand);
+	random_operand(&value);
+	start = now_seconds();
+	for (int i = 0; i < CHAIN_LENGTH; i++) {
+		random_operand(&operand);
+		calc_rational_operation(&value, &value, chain_operators[next_random() % 4], &operand);
+	}
+	double long_time = now_seconds() - start;
+	size_t length = calc_rational_to_string(&value, NULL, 0, 0);
+	printf("%d-term chain: %.2f ms (%.1f us/op), result %zu characters as a fraction\n", CHAIN_LENGTH,
+		long_time * 1e3, long_time * 1e6 / CHAIN_LENGTH, length);
+	calc_rational_free(&operand);
+	calc_rational_free(&value);
+	if (sink == 1.5) {
+		printf("\n");   // Keeps the double chains from being optimized out
+	}
+}
+
+// The same keys in rational and double mode
+static void time_keys(void) {
+	static const char keys[] = "12.5+3/7*4-0.25=";
+	double elapsed[2];
+	for (int mode = 0; mode < 2; mode++) {
+		calc_engine engine;
+		calc_engine_init(&engine, NULL, NULL);
+		calc_engine_set_rational_mode(&engine, mode ? CALC_RATIONAL_FRACTIONS : 0);
+		double start = now_seconds();
+		for (int r = 0; r < KEY_ROUNDS; r++) {
+			for (const char* k = keys; *k; k++) {
+				calc_handle_key(&engine, *k);
+			}
+		}
+		elapsed[mode] = now_seconds() - start;
+		calc_engine_free(&engine);
+	}
+	double count = (double)KEY_ROUNDS * (sizeof(keys) - 1);
+	printf("keys: %.1f ns/key in double mode, %.1f ns/key in rational mode\n",
+		elapsed[0] * 1e9 / count, elapsed[1] * 1e9 / count);
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(void) {
+	check_engine();
+	check_gcd();
+	check_chains();
+	check_doubles();
+	
+	time_gcd();
+	time_chains();
+	time_keys();
+	
+	printf("failures: %zu\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,135 @@
+// Display Rendering Benchmark - renders and allocations for bursts of keys
+// Compile with: gcc -O2 -DOBJC_STUB -pthread -o bench/bin/bench_render bench/bench_render.c
+//               objc_shim.c objc_stub.c $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Launches calculator.c against the counting stub runtime and types a
+// 10,000-key burst (as a paste would deliver it) within one run-loop cycle,
+// then the same keys one cycle each. Fails unless the burst costs exactly one
+// render and one NSString, and both end on the headless engine's display.
+
+#include <stdlib.h>
+
+#define main calculator_main
+#include "../calculator.c"
+#undef main
+
+#define BURST_KEYS 10000
+
+static const char pattern[] = "12.5+3.25*4-1/2=0.1+0.2=987654321*123456789=7*(6)=";
+
+static char* expected_text = NULL;
+static size_t expected_size = 0;
+
+static void expected_display(void* ctx, const char* text) {
+	(void)ctx;
+	copy_text(&expected_text, &expected_size, text);
+}
+
+// Sits between the engine and the app's callback to count update requests
+static unsigned long display_updates = 0;
+
+static void counting_display(void* ctx, const char* text) {
+	display_updates++;
+	update_display(ctx, text);
+}
+
+typedef struct {
+	unsigned long display_updates;   // Engine calls to update_display
+	unsigned long renders;           // setStringValue: sent to the field
+	unsigned long allocations;
+	unsigned long pools;
+	unsigned long messages;
+} burst_stats;
+
+// Type count keys, running the run loop after every cycle_keys keys
+static burst_stats type_keys(id* events, size_t count, size_t cycle_keys) {
+	burst_stats stats = {0};
+	objc_stub_reset_counters();
+	display_updates = 0;
+	for (size_t i = 0; i < count; i++) {
+		window_key_down(g_window, objc_sel.keyDown, events[(unsigned char)pattern[i % (sizeof(pattern) - 1)]]);
+		if ((i + 1) % cycle_keys == 0 || i + 1 == count) {
+			objc_stub_run_loop();
+		}
+	}
+	stats.display_updates = display_updates;
+	stats.renders = objc_stub_sent("setStringValue:");
+	stats.allocations = objc_stub_stats.allocations;
+	stats.pools = objc_stub_stats.autorelease_pools;
+	stats.messages = objc_stub_stats.messages;
+	return stats;
+}
+
+static void print_stats(const char* name, const burst_stats* stats) {
+	printf("%-22s %10lu %10lu %12lu %8lu %10lu\n", name, stats->display_updates, stats->renders,
+		stats->allocations, stats->pools, stats->messages);
+}
+
+int main(void) {
+	char* launch_argv[] = {"calculator", NULL};
+	calculator_main(1, launch_argv);
+	g_engine.display = counting_display;
+	
+	// One key event per calculator key, unshifted where possible
+	id events[128] = {0};
+	for (int shift = 1; shift >= 0; shift--) {
+		for (int code = 127; code >= 0; code--) {
+			int tag = g_key_tags[shift][code];
+			if (tag >= 0) {
+				events[(unsigned char)calc_buttons[tag].key] = objc_stub_key_event(
+					(unsigned short)code, shift ? NSEventModifierFlagShift : 0);
+			}
+		}
+	}
+	
+	// What the display should end on, from the engine alone
+	calc_engine engine;
+	calc_engine_init(&engine, expected_display, NULL);
+	for (size_t i = 0; i < BURST_KEYS; i++) {
+		calc_handle_key(&engine, pattern[i % (sizeof(pattern) - 1)]);
+	}
+	calc_engine_free(&engine);
+	
+	int ok = 1;
+	printf("%-22s %10s %10s %12s %8s %10s\n", "input", "updates", "renders", "allocations", "pools", "messages");
+	
+	burst_stats burst = type_keys(events, BURST_KEYS, BURST_KEYS);
+	print_stats("10000 keys, 1 cycle", &burst);
+	if (burst.renders != 1 || burst.allocations != 1 || strcmp(objc_stub_text(g_display), expected_text) != 0) {
+		printf("FAIL: burst should render once, with one NSString, ending on %s (shows %s)\n",
+			expected_text, objc_stub_text(g_display));
+		ok = 0;
+	}
+	if (burst.pools != BURST_KEYS + 1) {
+		printf("FAIL: expected one autorelease pool per key plus one per flush\n");
+		ok = 0;
+	}
+	
+	// Unchanged text is never rendered: leading zeros on a cleared display keep showing "0"
+	calc_engine_set_precision(&g_engine, 0);
+	objc_stub_run_loop();
+	objc_stub_reset_counters();
+	display_updates = 0;
+	for (int i = 0; i < 100; i++) {
+		window_key_down(g_window, objc_sel.keyDown, events['0']);
+		objc_stub_run_loop();
+	}
+	printf("%-22s %10lu %10lu %12lu\n", "100 zeros, 1 per cycle", display_updates,
+		objc_stub_sent("setStringValue:"), objc_stub_stats.allocations);
+	if (display_updates != 100 || objc_stub_sent("setStringValue:") != 0 || objc_stub_stats.allocations != 0) {
+		printf("FAIL: typing zeros on \"0\" should not render\n");
+		ok = 0;
+	}
+	
+	// Same keys from a cleared calculator, one per cycle: renders only where the text changed
+	calc_engine_set_precision(&g_engine, 0);
+	objc_stub_run_loop();
+	burst_stats single = type_keys(events, BURST_KEYS, 1);
+	print_stats("10000 keys, 1 per cycle", &single);
+	if (single.renders > single.display_updates || strcmp(objc_stub_text(g_display), expected_text) != 0) {
+		printf("FAIL: per-cycle typing rendered unchanged text or ended on the wrong display\n");
+		ok = 0;
+	}
+	
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+// Runtime Traffic Benchmark - Objective-C runtime calls per keystroke
+// Compile with: gcc -O2 -DOBJC_STUB -pthread -o bench/bin/bench_runtime bench/bench_runtime.c
+//               objc_shim.c objc_stub.c $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Launches calculator.c against the counting stub runtime, then clicks its
+// buttons the way AppKit does (target/action) and reports the runtime traffic.
+// Fails if any keystroke still resolves a selector or class at runtime.
+
+#include <stdlib.h>
+#include <time.h>
+
+#define main calculator_main
+#include "../calculator.c"
+#undef main
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[]) {
+	long rounds = argc > 1 ? atol(argv[1]) : 100000;
+	char* launch_argv[] = {"calculator", NULL};
+	calculator_main(1, launch_argv);
+	
+	// Map each key to the button carrying that title
+	id buttons[128] = {0};
+	id subviews[64];
+	size_t count = objc_stub_subviews(objc_msgSend_id(g_window, objc_sel.contentView), subviews, 64);
+	for (size_t i = 0; i < count; i++) {
+		const char* title = objc_stub_text(objc_msgSend_id(subviews[i], objc_sel.title));
+		if (title && title[0] && title[1] == '\0') {
+			buttons[(unsigned char)title[0]] = subviews[i];
+		}
+	}
+	
+	const char* keys = "12.5+3.25*4-1/2=0.1+0.2=987654321*123456789=";
+	size_t key_count = strlen(keys);
+	
+	objc_stub_reset_counters();
+	double start = now_seconds();
+	for (long r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < key_count; i++) {
+			// AppKit sends the button's action to its target with the button as
+			// sender, and each click is its own run-loop cycle
+			objc_msgSend_void_id(g_button_delegate, objc_sel.buttonClicked, buttons[(unsigned char)keys[i]]);
+			objc_stub_run_loop();
+		}
+	}
+	double elapsed = now_seconds() - start;
+	double total = (double)key_count * rounds;
+	
+	printf("display: %s\n", objc_stub_text(g_display));
+	printf("keystrokes:          %.0f\n", total);
+	printf("messages/keystroke:  %.2f (setStringValue: %.2f)\n",
+		objc_stub_stats.messages / total, objc_stub_sent("setStringValue:") / total);
+	printf("selector lookups/keystroke: %.2f\n", objc_stub_stats.selector_lookups / total);
+	printf("class lookups/keystroke:    %.2f\n", objc_stub_stats.class_lookups / total);
+	printf("stub time:           %.1f ns/keystroke\n", elapsed * 1e9 / total);
+	
+	return objc_stub_stats.selector_lookups + objc_stub_stats.class_lookups != 0;
+}
@@ -0,0 +1,178 @@
+// Session Benchmark - pooled sessions: churn, memory and interleaved input
+// Compile with: gcc -O2 -pthread -o bench/bin/bench_session bench/bench_session.c
+//               calc_session.c $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Checks that a session shows the same text as a calc_engine after every key
+// of random input, then times create/destroy churn against malloc'd engines
+// and feeds keys to a million live sessions in random order. Exits 1 on a
+// mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_session.h"
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Small LCG so runs are repeatable and cheap next to the work being timed
+static unsigned long long rng_state = 1;
+
+static unsigned next_random(void) {
+	rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned)(rng_state >> 33);
+}
+
+// Mostly digits, as people type, with the odd function or matrix key
+static char random_key(void) {
+	static const char keys[] = "0123456789012345678901234567890123456789..+-*/+-*/==()^rs%@\\'di";
+	return keys[next_random() % (sizeof(keys) - 1)];
+}
+
+// The same with statistics keys, which give a session its own data set, so
+// only the equivalence check uses them
+static char random_checked_key(void) {
+	return next_random() % 16 == 0 ? "DDMVK"[next_random() % 5] : random_key();
+}
+
+static void copy_display(void* ctx, const char* text) {
+	strcpy((char*)ctx, text);
+}
+
+// ============================================================================
+// Equivalence
+// ============================================================================
+
+static int check_against_engine(int streams, int keys_per_stream) {
+	calc_session session;
+	calc_session_init(&session);
+	calc_engine engine;
+	char expected[CALC_FORMAT_BUFFER_SIZE];
+	char actual[CALC_FORMAT_BUFFER_SIZE];
+	for (int s = 0; s < streams; s++) {
+		calc_session_reset(&session);
+		calc_engine_init(&engine, copy_display, expected);
+		strcpy(expected, "0");
+		for (int k = 0; k < keys_per_stream; k++) {
+			char key = random_checked_key();
+			calc_handle_key(&engine, key);
+			calc_session_key(&session, key);
+			calc_session_format(&session, actual, NULL);
+			if (strcmp(actual, expected) != 0 || memcmp(&session.input.display_value, &engine.input.display_value, sizeof(double)) != 0) {
+				printf("FAIL: stream %d key %d ('%c'): session shows %s, engine %s\n", s, k, key, actual, expected);
+				return 0;
+			}
+		}
+		calc_engine_free(&engine);
+	}
+	calc_session_free(&session);
+	return 1;
+}
+
+// ============================================================================
+// Benchmark
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+	size_t sessions = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+	size_t operations = argc > 2 ? (size_t)atol(argv[2]) : 10000000;
+	
+	if (!check_against_engine(2000, 500)) {
+		return 1;
+	}
+	printf("session matches calc_engine on 2000 random streams\n\n");
+	printf("sizeof(calc_session) = %zu bytes, sizeof(calc_engine) = %zu bytes\n\n",
+		sizeof(calc_session), sizeof(calc_engine));
+	
+	// Churn: a working set of live sessions, destroying and creating at random
+	size_t working_set = sessions / 10 ? sessions / 10 : 1;
+	calc_session** live = malloc(working_set * sizeof(calc_session*));
+	calc_engine** engines = malloc(working_set * sizeof(calc_engine*));
+	
+	calc_session_pool pool;
+	calc_session_pool_init(&pool, 0);
+	for (size_t i = 0; i < working_set; i++) {
+		live[i] = calc_session_create(&pool);
+	}
+	double start = now_seconds();
+	for (size_t i = 0; i < operations; i++) {
+		size_t victim = next_random() % working_set;
+		calc_session_destroy(&pool, live[victim]);
+		live[victim] = calc_session_create(&pool);
+	}
+	double pool_ns = (now_seconds() - start) * 1e9 / operations;
+	calc_session_pool_free(&pool);
+	
+	for (size_t i = 0; i < working_set; i++) {
+		engines[i] = malloc(sizeof(calc_engine));
+		calc_engine_init(engines[i], NULL, NULL);
+	}
+	start = now_seconds();
+	for (size_t i = 0; i < operations; i++) {
+		size_t victim = next_random() % working_set;
+		calc_engine_free(engines[victim]);
+		free(engines[victim]);
+		engines[victim] = malloc(sizeof(calc_engine));
+		calc_engine_init(engines[victim], NULL, NULL);
+	}
+	double engine_ns = (now_seconds() - start) * 1e9 / operations;
+	for (size_t i = 0; i < working_set; i++) {
+		calc_engine_free(engines[i]);
+		free(engines[i]);
+	}
+	free(engines);
+	free(live);
+	
+	printf("%-34s %10s\n", "churn (destroy + create)", "ns/op");
+	printf("%-34s %10.1f\n", "session pool", pool_ns);
+	printf("%-34s %10.1f  (%.1fx)\n\n", "malloc'd calc_engine", engine_ns, engine_ns / pool_ns);
+	
+	// A million live sessions, then keys to sessions in order and at random
+	calc_session** all = malloc(sessions * sizeof(calc_session*));
+	calc_session_pool_init(&pool, 0);
+	start = now_seconds();
+	for (size_t i = 0; i < sessions; i++) {
+		all[i] = calc_session_create(&pool);
+		if (!all[i]) {
+			printf("FAIL: out of memory at session %zu\n", i);
+			return 1;
+		}
+	}
+	double create_ns = (now_seconds() - start) * 1e9 / sessions;
+	printf("%zu live sessions: %.1f MiB of slabs, %.1f bytes/session, created at %.1f ns each\n\n",
+		sessions, calc_session_pool_bytes(&pool) / 1048576.0,
+		(double)calc_session_pool_bytes(&pool) / sessions, create_ns);
+	
+	char* keys = malloc(operations);
+	size_t* targets = malloc(operations * sizeof(size_t));
+	for (size_t i = 0; i < operations; i++) {
+		keys[i] = random_key();
+		targets[i] = next_random() % sessions;
+	}
+	
+	printf("%-34s %10s %12s\n", "interleaved input", "ns/key", "keys/sec");
+	start = now_seconds();
+	for (size_t i = 0; i < operations; i++) {
+		calc_session_key(all[i % sessions], keys[i]);
+	}
+	double elapsed = now_seconds() - start;
+	printf("%-34s %10.1f %12.0f\n", "round robin", elapsed * 1e9 / operations, operations / elapsed);
+	
+	start = now_seconds();
+	for (size_t i = 0; i < operations; i++) {
+		calc_session_key(all[targets[i]], keys[i]);
+	}
+	elapsed = now_seconds() - start;
+	printf("%-34s %10.1f %12.0f\n", "random session per key", elapsed * 1e9 / operations, operations / elapsed);
+	
+	free(keys);
+	free(targets);
+	free(all);
+	calc_session_pool_free(&pool);
+	return 0;
+}
@@ -0,0 +1,127 @@
+// Startup Benchmark - launch phases and runtime traffic up to the first frame
+// Compile with: gcc -O2 -DOBJC_STUB -pthread -o bench/bin/bench_startup bench/bench_startup.c
+//               objc_shim.c objc_stub.c $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Launches calculator.c against the counting stub runtime and reports each
+// startup phase's time and runtime calls, and the time to the first
+// interactive frame. Fails if a phase after class registration resolves a
+// selector or class, if launch builds any View menu panel, or if a panel is
+// not built exactly once on first use. Then times building each panel.
+
+#include <stdlib.h>
+#include <time.h>
+
+#define main calculator_main
+#include "../calculator.c"
+#undef main
+
+static const char* const phase_labels[CALC_STARTUP_PHASES] = {
+	"classes", "menus", "window", "buttons", "first frame"
+};
+
+// Runtime counters as of each mark
+static objc_stub_counters at_mark[CALC_STARTUP_PHASES];
+static int marked[CALC_STARTUP_PHASES];
+
+static void observe_phase(calc_startup_phase phase) {
+	at_mark[phase] = objc_stub_stats;
+	marked[phase] = 1;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t content_subviews(void) {
+	id subviews[64];
+	return objc_stub_subviews(objc_msgSend_id(g_window, objc_sel.contentView), subviews, 64);
+}
+
+// Choose a View menu item the way AppKit delivers it
+static void select_view(long view) {
+	id item = objc_msgSend_id(NSAlloc(objc_cls.NSMenuItem), objc_sel.init);
+	objc_msgSend_void_int(item, objc_sel.setTag, view);
+	view_mode_selected(NULL, objc_sel.viewModeSelected, item);
+	objc_stub_run_loop();
+}
+
+int main(void) {
+	int ok = 1;
+	char* launch_argv[] = {"calculator", NULL};
+	calc_startup_observer = observe_phase;
+	objc_stub_reset_counters();
+	calculator_main(1, launch_argv);
+	objc_stub_run_loop();
+	
+	printf("%-12s %10s %10s %12s %10s\n", "phase", "us", "messages", "allocations", "lookups");
+	objc_stub_counters before = {0};
+	for (int p = 0; p < CALC_STARTUP_PHASES; p++) {
+		if (!marked[p]) {
+			printf("FAIL: phase %s was never marked\n", phase_labels[p]);
+			ok = 0;
+			continue;
+		}
+		unsigned long lookups = at_mark[p].selector_lookups + at_mark[p].class_lookups
+			- before.selector_lookups - before.class_lookups;
+		printf("%-12s %10.1f %10lu %12lu %10lu\n", phase_labels[p], calc_startup_ns(p) / 1e3,
+			at_mark[p].messages - before.messages, at_mark[p].allocations - before.allocations, lookups);
+		if (p != CALC_STARTUP_CLASSES && lookups != 0) {
+			printf("FAIL: %s resolved selectors or classes after objc_shim_init\n", phase_labels[p]);
+			ok = 0;
+		}
+		before = at_mark[p];
+	}
+	printf("time to first interactive frame: %.1f us, %lu messages, %lu allocations\n",
+		calc_startup_total_ns() / 1e3, before.messages, before.allocations);
+	
+	// Launch builds the display and the grid, and no panel
+	size_t grid_buttons = 0;
+	for (int i = 0; i < GRID_BUTTON_COUNT; i++) {
+		grid_buttons += calc_buttons[i].label != NULL;
+	}
+	size_t launched = content_subviews();
+	int panels = 0;
+	for (int v = 0; v < VIEW_COUNT; v++) {
+		panels += g_panels[v] != NULL;
+	}
+	if (launched != 1 + grid_buttons || panels != 0) {
+		printf("FAIL: launch built %zu views, expected the display and %zu buttons only\n", launched, grid_buttons);
+		ok = 0;
+	}
+	
+	// Panel keys work from the keyboard before their panel exists: 9, sqrt
+	window_key_down(g_window, objc_sel.keyDown, objc_stub_key_event(0x19, 0));
+	window_key_down(g_window, objc_sel.keyDown, objc_stub_key_event(0x0F, 0));
+	objc_stub_run_loop();
+	if (strcmp(objc_stub_text(g_display), "3") != 0) {
+		printf("FAIL: 9 sqrt from the keyboard shows %s\n", objc_stub_text(g_display));
+		ok = 0;
+	}
+	
+	// Each panel is built the first time its view is chosen, and only then
+	static const char* view_names[VIEW_COUNT] = {"basic", "scientific", "programmer", "graph", "tape", "matrix"};
+	double deferred = 0;
+	for (int v = 1; v < VIEW_COUNT; v++) {
+		size_t views = content_subviews();
+		objc_stub_reset_counters();
+		double start = now_seconds();
+		select_view(v);
+		double first = now_seconds() - start;
+		objc_stub_counters first_use = objc_stub_stats;
+		select_view(0);
+		select_view(v);
+		deferred += first;
+		printf("%-10s panel on first use: %8.1f us, %5lu messages, %4lu allocations\n", view_names[v],
+			first * 1e6, first_use.messages, first_use.allocations);
+		if (!g_panels[v] || content_subviews() != views + 1) {
+			printf("FAIL: the %s panel should be built once, on first use\n", view_names[v]);
+			ok = 0;
+		}
+	}
+	select_view(0);
+	printf("deferred from launch: %.1f us\n", deferred * 1e6);
+	
+	return !ok;
+}
@@ -0,0 +1,362 @@
+// Statistics Benchmark - parsing and reduction against strtod and exact references
+// Compile with: gcc -O2 -o bench/bin/bench_stats bench/bench_stats.c calc_stats.c -lm
+//
+// Checks calc_stats_parse_number against strtod bit for bit, the moments
+// against long double two-pass references on data with a large offset (where
+// the textbook sum-of-squares formula fails), merged summaries against a
+// single pass, and quantiles against the sorted data, then times parsing and
+// reduction.
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../calc_stats.h"
+
+// ============================================================================
+// Data
+// ============================================================================
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [0, 1)
+static double uniform(void) {
+	return (double)(next_random() >> 11) * 0x1p-53;
+}
+
+// Box-Muller
+static double gaussian(void) {
+	double u = uniform();
+	double v = uniform();
+	return sqrt(-2 * log(1 - u)) * cos(6.283185307179586 * v);
+}
+
+// Any finite double, from its bits
+static double random_double(void) {
+	for (;;) {
+		uint64_t bits = next_random();
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		if (isfinite(value)) {
+			return value;
+		}
+	}
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static size_t failures = 0;
+
+static void fail(const char* what, const char* text, double got, double want) {
+	if (failures++ < 10) {
+		printf("FAIL %s: %s gave %.17g, expected %.17g\n", what, text, got, want);
+	}
+}
+
+static int same_bits(double a, double b) {
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static void check_parse(const char* text) {
+	double got;
+	if (!calc_stats_parse_number(text, strlen(text), &got)) {
+		fail("parse rejected", text, 0, strtod(text, NULL));
+	} else if (!same_bits(got, strtod(text, NULL))) {
+		fail("parse", text, got, strtod(text, NULL));
+	}
+}
+
+static void check_parser(size_t count) {
+	static const char* accepted[] = {
+		"0", "-0", "+0", "0.", ".5", "5.", "+3", "-3.25", "1E5", "1e-5", "2.5e+3",
+		"9007199254740993", "18446744073709551615", "18446744073709551616",
+		"123456789012345678901234567890", "0.000000000000000000000000000001",
+		"1e22", "1e23", "4.9e-324", "2.4e-324", "1.7976931348623157e308", "1e400", "1e-400",
+		"00000000000000000000001.5", "3.14159265358979323846264338327950288",
+	};
+	static const char* rejected[] = {
+		"", "-", "+", ".", "-.", "e5", "1e", "1e+", "--1", "1.2.3", "abc", "1x", "0x10",
+		"inf", "nan", "1,5", " 1",
+	};
+	for (size_t i = 0; i < sizeof(accepted) / sizeof(accepted[0]); i++) {
+		check_parse(accepted[i]);
+	}
+	for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+		double value;
+		if (calc_stats_parse_number(rejected[i], strlen(rejected[i]), &value)) {
+			fail("parse accepted", rejected[i], value, NAN);
+		}
+	}
+	
+	// Shortest round-trip, fixed, exponent and integer forms of random values
+	static const char* formats[] = {"%.17g", "%.15g", "%.6f", "%.3e", "%.0f", "%g"};
+	char text[512];
+	for (size_t i = 0; i < count; i++) {
+		double value = i % 2 ? random_double() : gaussian() * pow(10, (double)(next_random() % 40) - 20);
+		snprintf(text, sizeof(text), formats[i % 6], value);
+		check_parse(text);
+	}
+	
+	// A stream with every separator, and tokens that are not numbers
+	const char* stream = "1 2\t3\n4\r\n5,6;7 , x 8e1,-9\n\n10 1.5.5 ;; 11";
+	double values[16];
+	size_t n;
+	uint64_t ignored = 0;
+	const char* end = stream + strlen(stream);
+	const char* stop = calc_stats_parse(stream, end, values, 16, &n, &ignored);
+	if (stop != end || n != 11 || ignored != 2 || values[7] != 80 || values[8] != -9 || values[10] != 11) {
+		fail("stream", stream, (double)n, 11);
+	}
+	
+	// Stopping at capacity leaves the rest for the next call
+	ignored = 0;
+	stop = calc_stats_parse(stream, end, values, 4, &n, &ignored);
+	size_t more;
+	calc_stats_parse(stop, end, values + 4, 12, &more, &ignored);
+	if (n != 4 || more != 7 || ignored != 2 || values[4] != 5) {
+		fail("stream in parts", stream, (double)(n + more), 11);
+	}
+}
+
+typedef struct {
+	long double mean;
+	long double variance;   // Sample
+	long double sum;
+} reference;
+
+// Two passes in long double
+static reference exact_moments(const double* values, size_t count) {
+	reference r = {0, 0, 0};
+	for (size_t i = 0; i < count; i++) {
+		r.sum += values[i];
+	}
+	r.mean = r.sum / count;
+	for (size_t i = 0; i < count; i++) {
+		long double d = values[i] - r.mean;
+		r.variance += d * d;
+	}
+	r.variance /= count - 1;
+	return r;
+}
+
+static double relative_error(double got, long double want) {
+	return want == 0 ? fabs(got) : (double)fabsl((got - want) / want);
+}
+
+static void check_moments(const char* what, const calc_stats* stats, const double* values, size_t count,
+                          double mean_tolerance, double variance_tolerance) {
+	reference r = exact_moments(values, count);
+	if (stats->count != count) {
+		fail(what, "count", (double)stats->count, (double)count);
+	}
+	if (relative_error(calc_stats_mean(stats), r.mean) > mean_tolerance) {
+		fail(what, "mean", calc_stats_mean(stats), (double)r.mean);
+	}
+	if (relative_error(calc_stats_variance(stats, 1), r.variance) > variance_tolerance) {
+		fail(what, "variance", calc_stats_variance(stats, 1), (double)r.variance);
+	}
+	if (relative_error(calc_stats_sum(stats), r.sum) > mean_tolerance) {
+		fail(what, "sum", calc_stats_sum(stats), (double)r.sum);
+	}
+}
+
+// Offset data: the textbook formula E[x^2] - E[x]^2 loses every digit
+static void check_accuracy(double* values, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		values[i] = 1e9 + uniform();
+	}
+	calc_stats one, array;
+	calc_stats_init(&one);
+	calc_stats_init(&array);
+	double squares = 0;
+	double sum = 0;
+	for (size_t i = 0; i < count; i++) {
+		calc_stats_add(&one, values[i]);
+		squares += values[i] * values[i];
+		sum += values[i];
+	}
+	calc_stats_add_array(&array, values, count);
+	check_moments("calc_stats_add", &one, values, count, 1e-15, 1e-9);
+	check_moments("calc_stats_add_array", &array, values, count, 1e-15, 1e-9);
+	
+	reference r = exact_moments(values, count);
+	double textbook = (squares - sum * sum / count) / (count - 1);
+	printf("variance of 1e9 + U(0,1): exact %.10Lf, add %.10f, add_array %.10f, textbook %.10f\n",
+		r.variance, calc_stats_variance(&one, 1), calc_stats_variance(&array, 1), textbook);
+	
+	// Cancellation: 1e16 + 1 - 1e16 is 0 in plain double
+	calc_stats_clear(&array);
+	for (size_t i = 0; i < count; i++) {
+		values[i] = i % 3 == 0 ? 1e16 : i % 3 == 1 ? 1 : -1e16;
+	}
+	size_t whole = count - count % 3;
+	calc_stats_add_array(&array, values, whole);
+	if (calc_stats_sum(&array) != (double)(whole / 3)) {
+		fail("compensated sum", "1e16, 1, -1e16, ...", calc_stats_sum(&array), (double)(whole / 3));
+	}
+	calc_stats_free(&one);
+	calc_stats_free(&array);
+}
+
+// Summaries of random-sized parts merge into the summary of the whole
+static void check_merge(double* values, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		values[i] = 50 + 10 * gaussian();
+	}
+	calc_stats whole, merged, part;
+	calc_stats_init(&whole);
+	calc_stats_init(&merged);
+	calc_stats_init(&part);
+	calc_stats_add_array(&whole, values, count);
+	for (size_t i = 0; i < count;) {
+		size_t n = 1 + next_random() % 50000;
+		n = n < count - i ? n : count - i;
+		calc_stats_clear(&part);
+		calc_stats_add_array(&part, values + i, n);
+		calc_stats_merge(&merged, &part);
+		i += n;
+	}
+	check_moments("merge", &merged, values, count, 1e-14, 1e-12);
+	if (merged.min != whole.min || merged.max != whole.max) {
+		fail("merge", "min/max", merged.min, whole.min);
+	}
+	if (memcmp(merged.buckets, whole.buckets, CALC_STATS_BUCKETS * sizeof(uint64_t)) != 0) {
+		fail("merge", "histogram", 0, 0);
+	}
+	calc_stats_free(&whole);
+	calc_stats_free(&merged);
+	calc_stats_free(&part);
+}
+
+// Within 1/128 of the value of the nearest rank
+static void check_quantiles(double* values, size_t count) {
+	static const double quantiles[] = {0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999};
+	double worst = 0;
+	calc_stats stats;
+	calc_stats_init(&stats);
+	for (int shape = 0; shape < 3; shape++) {
+		for (size_t i = 0; i < count; i++) {
+			values[i] = shape == 0 ? exp(2 * gaussian()) : shape == 1 ? 1000 * gaussian() : floor(uniform() * 100);
+		}
+		calc_stats_clear(&stats);
+		calc_stats_add_array(&stats, values, count);
+		qsort(values, count, sizeof(double), compare_doubles);
+		for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+			double want = values[(size_t)(quantiles[q] * (count - 1) + 0.5)];
+			double got = calc_stats_quantile(&stats, quantiles[q]);
+			double error = fabs(got - want) / (fabs(want) > 0 ? fabs(want) : 1);
+			worst = error > worst ? error : worst;
+			if (error > 1.0 / 128) {
+				char name[32];
+				snprintf(name, sizeof(name), "shape %d q%g", shape, quantiles[q]);
+				fail("quantile", name, got, want);
+			}
+		}
+		if (calc_stats_quantile(&stats, 0) != values[0] || calc_stats_quantile(&stats, 1) != values[count - 1]) {
+			fail("quantile", "min/max", calc_stats_quantile(&stats, 0), values[0]);
+		}
+	}
+	printf("quantiles: worst relative error %.2e (bound %.2e)\n", worst, 1.0 / 128);
+	calc_stats_free(&stats);
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : 1 << 21;
+	long rounds = argc > 2 ? atol(argv[2]) : 5;
+	double* values = malloc(count * sizeof(double));
+	
+	check_parser(count / 8);
+	check_accuracy(values, count);
+	check_merge(values, count);
+	check_quantiles(values, count);
+	printf("checks: %zu values, failures: %zu\n", count, failures);
+	
+	// One number per line, as a measuring instrument would log them
+	size_t capacity = count * 24;
+	char* text = malloc(capacity);
+	size_t length = 0;
+	for (size_t i = 0; i < count; i++) {
+		length += (size_t)snprintf(text + length, capacity - length, "%.6f\n", 100 + 15 * gaussian());
+	}
+	
+	double best[4] = {1e9, 1e9, 1e9, 1e9};
+	double sink = 0;
+	calc_stats stats;
+	calc_stats_init(&stats);
+	for (long r = 0; r < rounds; r++) {
+		double start = now_seconds();
+		size_t n;
+		uint64_t ignored = 0;
+		calc_stats_parse(text, text + length, values, count, &n, &ignored);
+		double elapsed = now_seconds() - start;
+		best[0] = elapsed < best[0] ? elapsed : best[0];
+		sink += values[n / 2];
+		
+		start = now_seconds();
+		char* p = text;
+		for (size_t i = 0; i < count; i++) {
+			values[i] = strtod(p, &p);
+		}
+		elapsed = now_seconds() - start;
+		best[1] = elapsed < best[1] ? elapsed : best[1];
+		sink += values[count / 2];
+		
+		calc_stats_clear(&stats);
+		start = now_seconds();
+		calc_stats_add_array(&stats, values, count);
+		elapsed = now_seconds() - start;
+		best[2] = elapsed < best[2] ? elapsed : best[2];
+		sink += calc_stats_variance(&stats, 1);
+		
+		calc_stats_clear(&stats);
+		start = now_seconds();
+		for (size_t i = 0; i < count; i++) {
+			calc_stats_add(&stats, values[i]);
+		}
+		elapsed = now_seconds() - start;
+		best[3] = elapsed < best[3] ? elapsed : best[3];
+		sink += calc_stats_variance(&stats, 1);
+	}
+	static const char* names[] = {"calc_stats_parse", "strtod", "calc_stats_add_array", "calc_stats_add"};
+	for (int c = 0; c < 4; c++) {
+		printf("%-24s %8.1f ns/value  %8.0f MB/s of text\n", names[c], best[c] * 1e9 / count,
+			length / best[c] / 1e6);
+	}
+	printf("%-24s %8.1f ns/value  %8.0f MB/s of text\n", "parse + add_array", (best[0] + best[2]) * 1e9 / count,
+		length / (best[0] + best[2]) / 1e6);
+	
+	calc_stats_free(&stats);
+	free(text);
+	free(values);
+	return failures != 0 || sink == 0;
+}
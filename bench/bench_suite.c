@@ -0,0 +1,670 @@
+// Benchmark Suite - recorded keystroke workloads through each layer of the app
+// Compile with: gcc -O2 -DOBJC_STUB -pthread -o bench/bin/bench_suite bench/bench_suite.c
+//               objc_shim.c objc_stub.c $ENGINE_SOURCES -lm, with ENGINE_SOURCES from build.sh
+//
+// Replays keystroke files (bench/workloads/*.keys, the format calc-replay
+// reads) through five stages, from the innermost hot path out:
+//
+//   entry     digit and point keys through calc_entry, shown after each key
+//   evaluate  every key through calc_handle_key with no display attached
+//   format    calc_format_double on the value shown after each key
+//   display   every key through calc_handle_key with a display callback
+//   dispatch  every key as a keyDown: event to calculator.c on the stub
+//             runtime, with a run loop pass after each, as AppKit would
+//
+// Each stage is warmed up, then timed as a number of samples, each enough
+// rounds of the workload to last a few milliseconds. The report gives the
+// median ns per key, the median absolute deviation and the fastest sample;
+// with -b, the speedup of each median over a baseline saved earlier with -s.
+// The process is pinned to one CPU on Linux. Fails if a workload has a key
+// with no keyboard binding, or if dispatch and display end on different text.
+//
+// Two builds are compared with -a: the other build runs as a child on the
+// same CPU, and their samples alternate (this one first in even pairs, the
+// other first in odd ones), so a change in clock speed or load between runs
+// hits both alike. The report gives the median of the per-pair time ratios
+// and its MAD, which a -s run compared with a later -b run cannot.
+//
+// Usage: bench_suite [-n samples] [-w warm-up samples] [-c cpu|-1] [-s save.tsv]
+//                    [-b baseline.tsv | -a other_build] [keystrokes.keys ...]
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define main calculator_main
+#include "../calculator.c"
+#undef main
+
+#define SAMPLE_SECONDS 0.005   // Each sample runs the workload at least this long
+#define MAX_BASELINE 64
+
+static const char* const default_workloads[] = {
+	"bench/workloads/basic.keys",
+	"bench/workloads/accounting.keys",
+	"bench/workloads/scientific.keys",
+	"bench/workloads/chains.keys",
+};
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ============================================================================
+// Workloads
+// ============================================================================
+
+typedef struct {
+	const char* name;     // File name without directory or extension
+	char* keys;
+	size_t count;
+	double* shown;        // display_value after each key, for the format stage
+	id* events;           // keyDown: event for each key
+} workload;
+
+// Keys from a keystroke file: whitespace dropped, '#' comments to end of line
+static int load_workload(const char* path, workload* w) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return 0;
+	}
+	size_t capacity = 1024;
+	w->keys = malloc(capacity);
+	w->count = 0;
+	int c;
+	int comment = 0;
+	while ((c = fgetc(file)) != EOF) {
+		if (c == '\n') {
+			comment = 0;
+		} else if (c == '#') {
+			comment = 1;
+		}
+		if (comment || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			continue;
+		}
+		if (w->count == capacity) {
+			capacity *= 2;
+			w->keys = realloc(w->keys, capacity);
+		}
+		w->keys[w->count++] = (char)c;
+	}
+	fclose(file);
+	
+	const char* base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+	size_t length = strcspn(base, ".");
+	char* name = malloc(length + 1);
+	memcpy(name, base, length);
+	name[length] = '\0';
+	w->name = name;
+	return w->count > 0;
+}
+
+// Key events the way a user would type each key; unshifted and main-keyboard
+// codes first, as bench_dispatch picks them
+static int bind_events(workload* w) {
+	id events[128] = {0};
+	for (int shift = 1; shift >= 0; shift--) {
+		for (int code = 127; code >= 0; code--) {
+			int tag = g_key_tags[shift][code];
+			if (tag >= 0) {
+				events[(unsigned char)calc_buttons[tag].key] = objc_stub_key_event(
+					(unsigned short)code, shift ? NSEventModifierFlagShift : 0);
+			}
+		}
+	}
+	w->events = malloc(w->count * sizeof(id));
+	for (size_t i = 0; i < w->count; i++) {
+		unsigned char key = (unsigned char)w->keys[i];
+		if (key >= 128 || !events[key]) {
+			printf("FAIL %s: no key binding for '%c'\n", w->name, key);
+			return 0;
+		}
+		w->events[i] = events[key];
+	}
+	return 1;
+}
+
+// ============================================================================
+// Stages
+// ============================================================================
+
+static volatile double g_sink;
+
+typedef struct {
+	char text[CALC_FORMAT_BUFFER_SIZE];
+} shown_text;
+
+static void suite_display(void* ctx, const char* text) {
+	shown_text* shown = ctx;
+	size_t length = strlen(text);
+	length = length < sizeof(shown->text) - 1 ? length : sizeof(shown->text) - 1;
+	memcpy(shown->text, text, length);
+	shown->text[length] = '\0';
+}
+
+static shown_text g_display_text;
+
+static void run_entry(const workload* w) {
+	calc_entry entry;
+	calc_entry_clear(&entry);
+	char buffer[CALC_ENTRY_MAX_DIGITS + 3];
+	double sum = 0;
+	int typing = 0;
+	for (size_t i = 0; i < w->count; i++) {
+		char key = w->keys[i];
+		if ((key >= '0' && key <= '9') || key == '.') {
+			calc_entry_append(&entry, key);
+			sum += calc_entry_format(&entry, buffer);
+			typing = 1;
+		} else if (typing) {
+			sum += calc_entry_value(&entry);
+			calc_entry_clear(&entry);
+			typing = 0;
+		}
+	}
+	g_sink = sum;
+}
+
+static void run_evaluate(const workload* w) {
+	calc_engine engine;
+	calc_engine_init(&engine, NULL, NULL);
+	for (size_t i = 0; i < w->count; i++) {
+		calc_handle_key(&engine, w->keys[i]);
+	}
+	g_sink = engine.input.display_value;
+	calc_engine_free(&engine);
+}
+
+static void run_format(const workload* w) {
+	char buffer[CALC_FORMAT_BUFFER_SIZE];
+	int sum = 0;
+	for (size_t i = 0; i < w->count; i++) {
+		sum += calc_format_double(buffer, w->shown[i], NULL);
+	}
+	g_sink = sum;
+}
+
+static void run_display(const workload* w) {
+	calc_engine engine;
+	calc_engine_init(&engine, suite_display, &g_display_text);
+	for (size_t i = 0; i < w->count; i++) {
+		calc_handle_key(&engine, w->keys[i]);
+	}
+	g_sink = engine.input.display_value;
+	calc_engine_free(&engine);
+}
+
+// The launched app's engine, restarted for each round
+static void run_dispatch(const workload* w) {
+	calc_engine_free(&g_engine);
+	calc_engine_init(&g_engine, update_display, g_display);
+	g_engine.history = &g_history;
+	for (size_t i = 0; i < w->count; i++) {
+		window_key_down(g_window, objc_sel.keyDown, w->events[i]);
+		objc_stub_run_loop();
+	}
+	g_sink = g_engine.input.display_value;
+}
+
+typedef struct {
+	const char* name;
+	void (*run)(const workload* w);
+} stage;
+
+static const stage stages[] = {
+	{"entry", run_entry},
+	{"evaluate", run_evaluate},
+	{"format", run_format},
+	{"display", run_display},
+	{"dispatch", run_dispatch},
+};
+#define STAGE_COUNT (sizeof(stages) / sizeof(stages[0]))
+
+// Display value after each key, from one pass through the engine
+static void record_shown(workload* w) {
+	calc_engine engine;
+	calc_engine_init(&engine, NULL, NULL);
+	w->shown = malloc(w->count * sizeof(double));
+	for (size_t i = 0; i < w->count; i++) {
+		calc_handle_key(&engine, w->keys[i]);
+		w->shown[i] = engine.input.display_value;
+	}
+	calc_engine_free(&engine);
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+typedef struct {
+	double median;        // ns per key
+	double mad;           // Median absolute deviation, ns per key
+	double fastest;
+} summary;
+
+static int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Median of sorted values
+static double median_of(const double* values, size_t count) {
+	return count % 2 ? values[count / 2] : 0.5 * (values[count / 2 - 1] + values[count / 2]);
+}
+
+static summary summarize(double* samples, size_t count) {
+	summary s;
+	qsort(samples, count, sizeof(double), compare_doubles);
+	s.median = median_of(samples, count);
+	s.fastest = samples[0];
+	double* deviations = malloc(count * sizeof(double));
+	for (size_t i = 0; i < count; i++) {
+		deviations[i] = fabs(samples[i] - s.median);
+	}
+	qsort(deviations, count, sizeof(double), compare_doubles);
+	s.mad = median_of(deviations, count);
+	free(deviations);
+	return s;
+}
+
+// Rounds per sample: doubled until one sample lasts SAMPLE_SECONDS
+static long calibrate(const stage* st, const workload* w) {
+	long rounds = 1;
+	for (;;) {
+		double start = now_seconds();
+		for (long r = 0; r < rounds; r++) {
+			st->run(w);
+		}
+		if (now_seconds() - start >= SAMPLE_SECONDS || rounds >= (1L << 24)) {
+			return rounds;
+		}
+		rounds *= 2;
+	}
+}
+
+// Seconds for rounds of a workload through a stage
+static double time_rounds(const stage* st, const workload* w, long rounds) {
+	double start = now_seconds();
+	for (long r = 0; r < rounds; r++) {
+		st->run(w);
+	}
+	return now_seconds() - start;
+}
+
+static summary measure(const stage* st, const workload* w, int samples, int warmup) {
+	long rounds = calibrate(st, w);
+	double* ns = malloc((size_t)samples * sizeof(double));
+	for (int s = -warmup; s < samples; s++) {
+		double elapsed = time_rounds(st, w, rounds);
+		if (s >= 0) {
+			ns[s] = elapsed * 1e9 / ((double)rounds * w->count);
+		}
+	}
+	summary result = summarize(ns, (size_t)samples);
+	free(ns);
+	return result;
+}
+
+// ============================================================================
+// Other Build
+// ============================================================================
+
+// Another build of the suite, started with "-a -": it loads the same
+// workloads and answers each "workload stage rounds" line on its stdin with
+// the seconds those rounds took
+typedef struct {
+	FILE* requests;
+	FILE* replies;
+	pid_t pid;
+} other_build;
+
+static int start_other(other_build* other, const char* path, int cpu, const char* const* paths, size_t count) {
+	int to_child[2];
+	int from_child[2];
+	if (pipe(to_child) != 0 || pipe(from_child) != 0) {
+		perror("pipe");
+		return 0;
+	}
+	fflush(stdout);
+	other->pid = fork();
+	if (other->pid < 0) {
+		perror("fork");
+		return 0;
+	}
+	if (other->pid == 0) {
+		char cpu_text[16];
+		snprintf(cpu_text, sizeof(cpu_text), "%d", cpu);
+		char** argv = malloc((count + 6) * sizeof(char*));
+		argv[0] = (char*)path;
+		argv[1] = "-c";
+		argv[2] = cpu_text;
+		argv[3] = "-a";
+		argv[4] = "-";
+		for (size_t i = 0; i < count; i++) {
+			argv[5 + i] = (char*)paths[i];
+		}
+		argv[5 + count] = NULL;
+		dup2(to_child[0], STDIN_FILENO);
+		dup2(from_child[1], STDOUT_FILENO);
+		close(to_child[0]);
+		close(to_child[1]);
+		close(from_child[0]);
+		close(from_child[1]);
+		execv(path, argv);
+		perror(path);
+		_exit(127);
+	}
+	close(to_child[0]);
+	close(from_child[1]);
+	other->requests = fdopen(to_child[1], "w");
+	other->replies = fdopen(from_child[0], "r");
+	return 1;
+}
+
+// Seconds the other build took for rounds, or -1 if it has stopped
+static double time_other(other_build* other, size_t workload_index, size_t stage_index, long rounds) {
+	double elapsed;
+	fprintf(other->requests, "%zu %zu %ld\n", workload_index, stage_index, rounds);
+	fflush(other->requests);
+	return fscanf(other->replies, "%lf", &elapsed) == 1 ? elapsed : -1;
+}
+
+static int stop_other(other_build* other) {
+	fclose(other->requests);
+	fclose(other->replies);
+	int status;
+	return waitpid(other->pid, &status, 0) == other->pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The child's side of time_other
+static int serve_requests(const workload* workloads, size_t count) {
+	size_t w;
+	size_t s;
+	long rounds;
+	while (scanf("%zu %zu %ld", &w, &s, &rounds) == 3) {
+		if (w >= count || s >= STAGE_COUNT) {
+			return 2;
+		}
+		printf("%.9f\n", time_rounds(&stages[s], &workloads[w], rounds));
+		fflush(stdout);
+	}
+	return 0;
+}
+
+// Alternating samples of this build and the other, the same rounds each;
+// ratio is this build's time over the other's, pair by pair. Returns 0 if
+// the other build stopped answering.
+static int compare(const stage* st, size_t stage_index, const workload* w, size_t workload_index,
+                   other_build* other, int samples, int warmup, summary* mine, summary* theirs, summary* ratio) {
+	long rounds = calibrate(st, w);
+	double* ns = malloc((size_t)samples * 3 * sizeof(double));
+	double* other_ns = ns + samples;
+	double* ratios = ns + 2 * samples;
+	int ok = 1;
+	for (int s = -warmup; s < samples && ok; s++) {
+		double elapsed;
+		double other_elapsed;
+		if (s & 1) {
+			other_elapsed = time_other(other, workload_index, stage_index, rounds);
+			elapsed = time_rounds(st, w, rounds);
+		} else {
+			elapsed = time_rounds(st, w, rounds);
+			other_elapsed = time_other(other, workload_index, stage_index, rounds);
+		}
+		ok = other_elapsed > 0;
+		if (s >= 0 && ok) {
+			ns[s] = elapsed * 1e9 / ((double)rounds * w->count);
+			other_ns[s] = other_elapsed * 1e9 / ((double)rounds * w->count);
+			ratios[s] = elapsed / other_elapsed;
+		}
+	}
+	if (ok) {
+		*mine = summarize(ns, (size_t)samples);
+		*theirs = summarize(other_ns, (size_t)samples);
+		*ratio = summarize(ratios, (size_t)samples);
+	}
+	free(ns);
+	return ok;
+}
+
+// ============================================================================
+// Baseline
+// ============================================================================
+
+typedef struct {
+	char workload[64];
+	char stage[16];
+	double median;
+} baseline_entry;
+
+static baseline_entry g_baseline[MAX_BASELINE];
+static size_t g_baseline_count;
+
+static int load_baseline(const char* path) {
+	FILE* file = fopen(path, "r");
+	if (!file) {
+		perror(path);
+		return 0;
+	}
+	char line[256];
+	while (g_baseline_count < MAX_BASELINE && fgets(line, sizeof(line), file)) {
+		baseline_entry* e = &g_baseline[g_baseline_count];
+		if (sscanf(line, "%63s %15s %lf", e->workload, e->stage, &e->median) == 3) {
+			g_baseline_count++;
+		}
+	}
+	fclose(file);
+	return 1;
+}
+
+static double baseline_median(const char* workload_name, const char* stage_name) {
+	for (size_t i = 0; i < g_baseline_count; i++) {
+		if (strcmp(g_baseline[i].workload, workload_name) == 0 && strcmp(g_baseline[i].stage, stage_name) == 0) {
+			return g_baseline[i].median;
+		}
+	}
+	return 0;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+// Pin to cpu, or to the CPU we start on if cpu < -1; returns the CPU or -1
+static int pin_cpu(int cpu) {
+#ifdef __linux__
+	if (cpu < -1) {
+		cpu = sched_getcpu();
+	}
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+			return cpu;
+		}
+	}
+#else
+	(void)cpu;
+#endif
+	return -1;
+}
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [-n samples] [-w warm-up samples] [-c cpu|-1] [-s save.tsv] "
+		"[-b baseline.tsv | -a other_build] [keystrokes.keys ...]\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+	int samples = 21;
+	int warmup = 5;
+	int cpu = -2;
+	const char* save_path = NULL;
+	const char* baseline_path = NULL;
+	const char* other_path = NULL;
+	int first_file = 1;
+	for (; first_file < argc && argv[first_file][0] == '-'; first_file++) {
+		const char* option = argv[first_file];
+		if (first_file + 1 >= argc || option[2] != '\0') {
+			usage(argv[0]);
+			return 2;
+		}
+		const char* value = argv[++first_file];
+		if (option[1] == 'n') {
+			samples = atoi(value);
+		} else if (option[1] == 'w') {
+			warmup = atoi(value);
+		} else if (option[1] == 'c') {
+			cpu = atoi(value);
+		} else if (option[1] == 's') {
+			save_path = value;
+		} else if (option[1] == 'b') {
+			baseline_path = value;
+		} else if (option[1] == 'a') {
+			other_path = value;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (samples < 1 || warmup < 0 || (baseline_path && other_path)) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (baseline_path && !load_baseline(baseline_path)) {
+		return 2;
+	}
+	
+	const char* const* paths = default_workloads;
+	size_t workload_count = sizeof(default_workloads) / sizeof(default_workloads[0]);
+	if (first_file < argc) {
+		paths = (const char* const*)&argv[first_file];
+		workload_count = (size_t)(argc - first_file);
+	}
+	
+	char* launch_argv[] = {"calculator", NULL};
+	calculator_main(1, launch_argv);
+	
+	workload* workloads = calloc(workload_count, sizeof(workload));
+	int ok = 1;
+	for (size_t i = 0; i < workload_count; i++) {
+		if (!load_workload(paths[i], &workloads[i]) || !bind_events(&workloads[i])) {
+			return 1;
+		}
+		record_shown(&workloads[i]);
+	}
+	
+	int pinned = pin_cpu(cpu);
+	if (other_path && strcmp(other_path, "-") == 0) {
+		return serve_requests(workloads, workload_count);
+	}
+	other_build other = {NULL, NULL, 0};
+	if (other_path && !start_other(&other, other_path, pinned, paths, workload_count)) {
+		return 2;
+	}
+	if (pinned >= 0) {
+		printf("pinned to CPU %d; ", pinned);
+	} else {
+		printf("not pinned; ");
+	}
+	printf("%d samples of at least %.0f ms after %d warm-up samples\n", samples, SAMPLE_SECONDS * 1e3, warmup);
+	if (other_path) {
+		printf("alternating with %s; speedup is this build's time over its, per pair of samples\n\n", other_path);
+		printf("%-12s %-9s %6s %11s %11s %8s %7s\n", "workload", "stage", "keys", "this ns", "other ns", "speedup", "MAD");
+	} else {
+		printf("\n%-12s %-9s %6s %11s %9s %7s %11s", "workload", "stage", "keys", "median ns", "MAD ns", "MAD", "fastest ns");
+		printf(baseline_path ? " %8s\n" : "\n", baseline_path ? "speedup" : "");
+	}
+	
+	FILE* save = save_path ? fopen(save_path, "w") : NULL;
+	if (save_path && !save) {
+		perror(save_path);
+		return 2;
+	}
+	double log_speedup[STAGE_COUNT] = {0};
+	size_t speedup_count[STAGE_COUNT] = {0};
+	
+	for (size_t i = 0; i < workload_count && ok; i++) {
+		const workload* w = &workloads[i];
+		for (size_t s = 0; s < STAGE_COUNT; s++) {
+			summary result;
+			double speedup = 0;
+			if (other_path) {
+				summary theirs;
+				summary ratio;
+				if (!compare(&stages[s], s, w, i, &other, samples, warmup, &result, &theirs, &ratio)) {
+					printf("FAIL %s stopped answering\n", other_path);
+					ok = 0;
+					break;
+				}
+				printf("%-12s %-9s %6zu %11.1f %11.1f %7.3fx %7.3f\n", w->name, stages[s].name, w->count,
+					result.median, theirs.median, ratio.median, ratio.mad);
+				speedup = ratio.median;
+			} else {
+				result = measure(&stages[s], w, samples, warmup);
+				printf("%-12s %-9s %6zu %11.1f %9.2f %6.1f%% %11.1f", w->name, stages[s].name, w->count,
+					result.median, result.mad, 100 * result.mad / result.median, result.fastest);
+				double base = baseline_median(w->name, stages[s].name);
+				if (base > 0) {
+					speedup = base / result.median;
+					printf(" %7.2fx", speedup);
+				}
+				printf("\n");
+			}
+			if (speedup > 0) {
+				log_speedup[s] += log(speedup);
+				speedup_count[s]++;
+			}
+			if (save) {
+				fprintf(save, "%s\t%s\t%.3f\t%.3f\n", w->name, stages[s].name, result.median, result.mad);
+			}
+		}
+		
+		// The app's shown text and the display callback's agree
+		run_display(w);
+		run_dispatch(w);
+		if (strcmp(g_shown_text, g_display_text.text) != 0) {
+			printf("FAIL %s: dispatch shows \"%s\", display \"%s\"\n", w->name, g_shown_text, g_display_text.text);
+			ok = 0;
+		}
+	}
+	if (save) {
+		fclose(save);
+	}
+	if (other_path && !stop_other(&other)) {
+		printf("FAIL %s did not exit cleanly\n", other_path);
+		ok = 0;
+	}
+	
+	if (baseline_path || other_path) {
+		double all = 0;
+		size_t all_count = 0;
+		printf(other_path ? "\ngeometric mean speedup of %s:" : "\ngeometric mean speedup over %s:",
+			other_path ? other_path : baseline_path);
+		for (size_t s = 0; s < STAGE_COUNT; s++) {
+			if (speedup_count[s]) {
+				printf(" %s %.3fx", stages[s].name, exp(log_speedup[s] / speedup_count[s]));
+				all += log_speedup[s];
+				all_count += speedup_count[s];
+			}
+		}
+		if (all_count) {
+			printf(", all %.3fx\n", exp(all / all_count));
+		} else {
+			printf(" no matching entries\n");
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -1,14 +1,144 @@
 #!/bin/bash
 # Build script for macOS Calculator in Pure C
+#
+# On macOS this builds the Cocoa app. On other platforms (e.g. Linux build
+# machines) it builds the headless tools that run the same calculator engine.
 
-# Compile to raw executable (no bundle or plist needed)
-gcc -o calculator calculator.c \
-    -framework Foundation \
-    -framework AppKit \
-    -lm
+CFLAGS="${CFLAGS:--O2}"
+# Source lists for each layer; the "Compile with" comments at the top of the
+# tools and benchmarks refer to these
+DECIMAL_SOURCES="calc_decimal.c calc_cache.c"
+EXPR_SOURCES="calc_expr.c calc_math.c $DECIMAL_SOURCES"
+GRAPH_SOURCES="calc_graph.c calc_jit.c $EXPR_SOURCES"
+ENGINE_SOURCES="calc_engine.c calc_format.c calc_decimal.c calc_expr.c calc_tape.c calc_latency.c calc_math.c calc_int.c calc_stats.c calc_graph.c calc_history.c calc_rational.c calc_batch.c calc_matrix.c calc_cache.c calc_jit.c"
+UI_SOURCES="calculator.c objc_shim.c"
 
-# Ensure executable permissions
-chmod +x calculator
+if [ "$(uname -s)" = "Darwin" ]; then
+	# Compile to raw executable (no bundle or plist needed)
+	gcc $CFLAGS -o calculator $UI_SOURCES $ENGINE_SOURCES \
+	    -framework Foundation \
+	    -framework AppKit \
+	    -lm || exit 1
+	
+	# Ensure executable permissions
+	chmod +x calculator
+	
+	echo "Build complete: calculator"
+	echo "Run with: ./calculator or open calculator"
+fi
 
-echo "Build complete: calculator"
-echo "Run with: ./calculator or open calculator"
+# Headless keystroke replay driver (builds everywhere)
+gcc $CFLAGS -pthread -o calc-replay replay.c $ENGINE_SOURCES -lm || exit 1
+
+echo "Build complete: calc-replay"
+echo "Run with: ./calc-replay [-n iterations] [-v] keystrokes.txt"
+
+# Parallel evaluator for files of one expression per line
+gcc $CFLAGS -pthread -o calc-eval eval.c $ENGINE_SOURCES -lm || exit 1
+
+echo "Build complete: calc-eval"
+echo "Run with: ./calc-eval [-t threads] [-s] expressions.txt"
+
+# One-pass statistics over files of numbers
+gcc $CFLAGS -pthread -o calc-stats stats.c calc_stats.c calc_format.c -lm || exit 1
+
+echo "Build complete: calc-stats"
+echo "Run with: ./calc-stats [-t threads] [-q quantiles] [-s] numbers.txt"
+
+# Function plotter writing PNGs
+gcc $CFLAGS -o calc-graph graph.c $GRAPH_SOURCES -lm || exit 1
+
+echo "Build complete: calc-graph"
+echo "Run with: ./calc-graph [-s WxH] [-x min,max] [-y min,max] [-o graph.png] 'sin(x)/x'"
+
+# Matrix arithmetic on CSV files
+gcc $CFLAGS -pthread -o calc-matrix matrix.c $ENGINE_SOURCES -lm || exit 1
+
+echo "Build complete: calc-matrix"
+echo "Run with: ./calc-matrix [-t threads] [-o out.csv] A.csv [op B.csv|number]"
+
+# Calculation server on a Unix socket, and its load generator
+gcc $CFLAGS -pthread -o calc-server server.c calc_session.c $ENGINE_SOURCES -lm || exit 1
+gcc $CFLAGS -pthread -o calc-load load.c calc_session.c $ENGINE_SOURCES -lm || exit 1
+
+echo "Build complete: calc-server calc-load"
+echo "Run with: ./calc-server [-s socket] & ./calc-load [-s socket] [-c connections,...] [-d depth,...]"
+
+# Micro-benchmarks: ./build.sh bench
+if [ "$1" = "bench" ]; then
+	mkdir -p bench/bin
+	gcc $CFLAGS -pthread -o bench/bin/bench_entry bench/bench_entry.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -o bench/bin/bench_format bench/bench_format.c calc_format.c -lm || exit 1
+	gcc $CFLAGS -o bench/bin/bench_decimal bench/bench_decimal.c $DECIMAL_SOURCES -lm || exit 1
+	gcc $CFLAGS -o bench/bin/bench_expr bench/bench_expr.c $EXPR_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_batch bench/bench_batch.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_math bench/bench_math.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -o bench/bin/bench_int bench/bench_int.c calc_int.c || exit 1
+	gcc $CFLAGS -o bench/bin/bench_stats bench/bench_stats.c calc_stats.c -lm || exit 1
+	gcc $CFLAGS -o bench/bin/bench_graph bench/bench_graph.c $GRAPH_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_history bench/bench_history.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_rational bench/bench_rational.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_matrix bench/bench_matrix.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_cache bench/bench_cache.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_jit bench/bench_jit.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_latency bench/bench_latency.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -pthread -o bench/bin/bench_session bench/bench_session.c calc_session.c $ENGINE_SOURCES -lm || exit 1
+	
+	# Benchmarks that drive calculator.c run it against the stub runtime
+	gcc $CFLAGS -DOBJC_STUB -pthread -o bench/bin/bench_runtime bench/bench_runtime.c objc_shim.c objc_stub.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -DOBJC_STUB -pthread -o bench/bin/bench_dispatch bench/bench_dispatch.c objc_shim.c objc_stub.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -DOBJC_STUB -pthread -o bench/bin/bench_render bench/bench_render.c objc_shim.c objc_stub.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -DOBJC_STUB -pthread -o bench/bin/bench_startup bench/bench_startup.c objc_shim.c objc_stub.c $ENGINE_SOURCES -lm || exit 1
+	gcc $CFLAGS -DOBJC_STUB -pthread -o bench/bin/bench_suite bench/bench_suite.c objc_shim.c objc_stub.c $ENGINE_SOURCES -lm || exit 1
+	
+	echo "Build complete: bench/bin/bench_entry bench/bin/bench_format bench/bin/bench_decimal bench/bin/bench_expr bench/bin/bench_batch bench/bin/bench_math bench/bin/bench_int bench/bin/bench_stats bench/bin/bench_graph bench/bin/bench_history bench/bin/bench_rational bench/bin/bench_matrix bench/bin/bench_cache bench/bin/bench_jit bench/bin/bench_latency bench/bin/bench_session bench/bin/bench_runtime bench/bin/bench_dispatch bench/bin/bench_render bench/bin/bench_startup bench/bin/bench_suite"
+fi
+
+# LTO and profile-guided optimization trained on the benchmark suite's
+# keystroke workloads: ./build.sh pgo. The engine is compiled to objects with
+# -fprofile-generate, trained by an instrumented bench/bin/bench_suite_pgo,
+# then compiled again from the profiles. Those objects make the final
+# bench/bin/bench_suite_pgo and replace the plain calc-replay, calc-eval,
+# calc-matrix, calc-server and calc-load built above. Code the workloads never
+# reach keeps its usual optimization (-fprofile-partial-training). Last, the
+# plain and the PGO suite are timed against each other, sample by sample.
+if [ "$1" = "pgo" ]; then
+	PGO_DIR=bench/bin/pgo
+	mkdir -p $PGO_DIR
+	rm -f $PGO_DIR/*.gcda
+	gcc $CFLAGS -DOBJC_STUB -pthread -o bench/bin/bench_suite bench/bench_suite.c objc_shim.c objc_stub.c $ENGINE_SOURCES -lm || exit 1
+	
+	# Both passes write the same object names, so the second finds the
+	# first's profiles ($PGO_DIR/calc_engine.gcda, ...)
+	for PGO_PASS in generate use; do
+		PGO_FLAGS="-flto=auto -fprofile-$PGO_PASS"
+		if [ $PGO_PASS = use ]; then
+			PGO_FLAGS="$PGO_FLAGS -fprofile-partial-training -Wno-missing-profile"
+		fi
+		PGO_ENGINE=""
+		for source in $ENGINE_SOURCES; do
+			gcc $CFLAGS $PGO_FLAGS -pthread -c -o $PGO_DIR/${source%.c}.o $source || exit 1
+			PGO_ENGINE="$PGO_ENGINE $PGO_DIR/${source%.c}.o"
+		done
+		PGO_SUITE=""
+		for source in bench/bench_suite.c objc_shim.c objc_stub.c; do
+			object=$PGO_DIR/$(basename ${source%.c}).o
+			gcc $CFLAGS $PGO_FLAGS -DOBJC_STUB -pthread -c -o $object $source || exit 1
+			PGO_SUITE="$PGO_SUITE $object"
+		done
+		gcc $CFLAGS $PGO_FLAGS -pthread -o bench/bin/bench_suite_pgo $PGO_SUITE $PGO_ENGINE -lm || exit 1
+		if [ $PGO_PASS = generate ]; then
+			bench/bin/bench_suite_pgo -n 3 -w 1 > /dev/null || exit 1
+		fi
+	done
+	
+	gcc $CFLAGS $PGO_FLAGS -pthread -o calc-replay replay.c $PGO_ENGINE -lm || exit 1
+	gcc $CFLAGS $PGO_FLAGS -pthread -o calc-eval eval.c $PGO_ENGINE -lm || exit 1
+	gcc $CFLAGS $PGO_FLAGS -pthread -o calc-matrix matrix.c $PGO_ENGINE -lm || exit 1
+	gcc $CFLAGS $PGO_FLAGS -pthread -o calc-server server.c calc_session.c $PGO_ENGINE -lm || exit 1
+	gcc $CFLAGS $PGO_FLAGS -pthread -o calc-load load.c calc_session.c $PGO_ENGINE -lm || exit 1
+	
+	echo "Build complete: bench/bin/bench_suite bench/bin/bench_suite_pgo"
+	echo "Build complete (LTO + PGO): calc-replay calc-eval calc-matrix calc-server calc-load"
+	bench/bin/bench_suite -a bench/bin/bench_suite_pgo || exit 1
+fi
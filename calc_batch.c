@@ -0,0 +1,349 @@
+// Batch Evaluation - vectorised perform_operation with runtime CPU dispatch
+//
+// Each implementation computes whole vectors with the same IEEE operations the
+// scalar code uses, then masks division lanes whose divisor compares equal to
+// zero to +0.0. Leftover elements go through perform_operation itself. Powers
+// are calc_math's: whole columns directly, mixed ones gathered per block.
+
+#include "calc_batch.h"
+#include "calc_engine.h"
+#include "calc_math.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#define CALC_BATCH_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define CALC_BATCH_ARM 1
+#include <arm_neon.h>
+#endif
+
+typedef void (*batch_fn)(double* out, const double* lhs, const char* ops, const double* rhs, size_t count);
+typedef void (*column_fn)(double* out, const double* lhs, char op, const double* rhs, size_t count);
+
+// ============================================================================
+// Scalar
+// ============================================================================
+
+static void apply_scalar(double* out, const double* lhs, const char* ops, const double* rhs, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		out[i] = perform_operation(lhs[i], ops[i], rhs[i]);
+	}
+}
+
+static void column_scalar(double* out, const double* lhs, char op, const double* rhs, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		out[i] = perform_operation(lhs[i], op, rhs[i]);
+	}
+}
+
+// ============================================================================
+// SSE2 & AVX2
+// ============================================================================
+
+#ifdef CALC_BATCH_X86
+
+// Lane masks for two operator bytes: all ones where ops[j] == op
+static inline __m128d sse2_op_mask(__m128i codes, char op) {
+	__m128i equal = _mm_cmpeq_epi32(codes, _mm_set1_epi64x((unsigned char)op));
+	// Only the low dword of each lane holds the code; copy its result up
+	return _mm_castsi128_pd(_mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 2, 0, 0)));
+}
+
+static inline __m128d sse2_select(__m128d mask, __m128d value, __m128d otherwise) {
+	return _mm_or_pd(_mm_and_pd(mask, value), _mm_andnot_pd(mask, otherwise));
+}
+
+static inline __m128d sse2_divide(__m128d l, __m128d r) {
+	return _mm_andnot_pd(_mm_cmpeq_pd(r, _mm_setzero_pd()), _mm_div_pd(l, r));
+}
+
+static void apply_sse2(double* out, const double* lhs, const char* ops, const double* rhs, size_t count) {
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		unsigned short pair;
+		memcpy(&pair, ops + i, sizeof(pair));
+		__m128i codes = _mm_cvtsi32_si128(pair);
+		codes = _mm_unpacklo_epi8(codes, _mm_setzero_si128());
+		codes = _mm_unpacklo_epi16(codes, _mm_setzero_si128());
+		codes = _mm_unpacklo_epi32(codes, _mm_setzero_si128());
+		
+		__m128d l = _mm_loadu_pd(lhs + i);
+		__m128d r = _mm_loadu_pd(rhs + i);
+		__m128d result = r;  // Unknown operators return rhs
+		result = sse2_select(sse2_op_mask(codes, '+'), _mm_add_pd(l, r), result);
+		result = sse2_select(sse2_op_mask(codes, '-'), _mm_sub_pd(l, r), result);
+		result = sse2_select(sse2_op_mask(codes, '*'), _mm_mul_pd(l, r), result);
+		result = sse2_select(sse2_op_mask(codes, '/'), sse2_divide(l, r), result);
+		_mm_storeu_pd(out + i, result);
+	}
+	apply_scalar(out + i, lhs + i, ops + i, rhs + i, count - i);
+}
+
+static void column_sse2(double* out, const double* lhs, char op, const double* rhs, size_t count) {
+	size_t i = 0;
+	switch (op) {
+		case '+':
+			for (; i + 2 <= count; i += 2) {
+				_mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+			}
+			break;
+		case '-':
+			for (; i + 2 <= count; i += 2) {
+				_mm_storeu_pd(out + i, _mm_sub_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+			}
+			break;
+		case '*':
+			for (; i + 2 <= count; i += 2) {
+				_mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+			}
+			break;
+		case '/':
+			for (; i + 2 <= count; i += 2) {
+				_mm_storeu_pd(out + i, sse2_divide(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+			}
+			break;
+		default:
+			memmove(out, rhs, count * sizeof(double));
+			return;
+	}
+	column_scalar(out + i, lhs + i, op, rhs + i, count - i);
+}
+
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+
+static inline AVX2_FUNCTION __m256d avx2_divide(__m256d l, __m256d r) {
+	return _mm256_andnot_pd(_mm256_cmp_pd(r, _mm256_setzero_pd(), _CMP_EQ_OQ), _mm256_div_pd(l, r));
+}
+
+static inline AVX2_FUNCTION __m256d avx2_op_mask(__m256i codes, char op) {
+	return _mm256_castsi256_pd(_mm256_cmpeq_epi64(codes, _mm256_set1_epi64x((unsigned char)op)));
+}
+
+static AVX2_FUNCTION void apply_avx2(double* out, const double* lhs, const char* ops, const double* rhs, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		int quad;
+		memcpy(&quad, ops + i, sizeof(quad));
+		__m256i codes = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(quad));
+		
+		__m256d l = _mm256_loadu_pd(lhs + i);
+		__m256d r = _mm256_loadu_pd(rhs + i);
+		__m256d result = r;  // Unknown operators return rhs
+		result = _mm256_blendv_pd(result, _mm256_add_pd(l, r), avx2_op_mask(codes, '+'));
+		result = _mm256_blendv_pd(result, _mm256_sub_pd(l, r), avx2_op_mask(codes, '-'));
+		result = _mm256_blendv_pd(result, _mm256_mul_pd(l, r), avx2_op_mask(codes, '*'));
+		result = _mm256_blendv_pd(result, avx2_divide(l, r), avx2_op_mask(codes, '/'));
+		_mm256_storeu_pd(out + i, result);
+	}
+	apply_scalar(out + i, lhs + i, ops + i, rhs + i, count - i);
+}
+
+static AVX2_FUNCTION void column_avx2(double* out, const double* lhs, char op, const double* rhs, size_t count) {
+	size_t i = 0;
+	switch (op) {
+		case '+':
+			for (; i + 4 <= count; i += 4) {
+				_mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+			}
+			break;
+		case '-':
+			for (; i + 4 <= count; i += 4) {
+				_mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+			}
+			break;
+		case '*':
+			for (; i + 4 <= count; i += 4) {
+				_mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+			}
+			break;
+		case '/':
+			for (; i + 4 <= count; i += 4) {
+				_mm256_storeu_pd(out + i, avx2_divide(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+			}
+			break;
+		default:
+			memmove(out, rhs, count * sizeof(double));
+			return;
+	}
+	column_scalar(out + i, lhs + i, op, rhs + i, count - i);
+}
+
+#endif
+
+// ============================================================================
+// NEON
+// ============================================================================
+
+#ifdef CALC_BATCH_ARM
+
+static inline float64x2_t neon_divide(float64x2_t l, float64x2_t r) {
+	return vbslq_f64(vceqzq_f64(r), vdupq_n_f64(0.0), vdivq_f64(l, r));
+}
+
+static void apply_neon(double* out, const double* lhs, const char* ops, const double* rhs, size_t count) {
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		uint64x2_t codes = vsetq_lane_u64((unsigned char)ops[i + 1],
+			vdupq_n_u64((unsigned char)ops[i]), 1);
+		
+		float64x2_t l = vld1q_f64(lhs + i);
+		float64x2_t r = vld1q_f64(rhs + i);
+		float64x2_t result = r;  // Unknown operators return rhs
+		result = vbslq_f64(vceqq_u64(codes, vdupq_n_u64('+')), vaddq_f64(l, r), result);
+		result = vbslq_f64(vceqq_u64(codes, vdupq_n_u64('-')), vsubq_f64(l, r), result);
+		result = vbslq_f64(vceqq_u64(codes, vdupq_n_u64('*')), vmulq_f64(l, r), result);
+		result = vbslq_f64(vceqq_u64(codes, vdupq_n_u64('/')), neon_divide(l, r), result);
+		vst1q_f64(out + i, result);
+	}
+	apply_scalar(out + i, lhs + i, ops + i, rhs + i, count - i);
+}
+
+static void column_neon(double* out, const double* lhs, char op, const double* rhs, size_t count) {
+	size_t i = 0;
+	switch (op) {
+		case '+':
+			for (; i + 2 <= count; i += 2) {
+				vst1q_f64(out + i, vaddq_f64(vld1q_f64(lhs + i), vld1q_f64(rhs + i)));
+			}
+			break;
+		case '-':
+			for (; i + 2 <= count; i += 2) {
+				vst1q_f64(out + i, vsubq_f64(vld1q_f64(lhs + i), vld1q_f64(rhs + i)));
+			}
+			break;
+		case '*':
+			for (; i + 2 <= count; i += 2) {
+				vst1q_f64(out + i, vmulq_f64(vld1q_f64(lhs + i), vld1q_f64(rhs + i)));
+			}
+			break;
+		case '/':
+			for (; i + 2 <= count; i += 2) {
+				vst1q_f64(out + i, neon_divide(vld1q_f64(lhs + i), vld1q_f64(rhs + i)));
+			}
+			break;
+		default:
+			memmove(out, rhs, count * sizeof(double));
+			return;
+	}
+	column_scalar(out + i, lhs + i, op, rhs + i, count - i);
+}
+
+#endif
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+static calc_batch_isa g_isa = CALC_BATCH_SCALAR;
+static batch_fn g_apply = NULL;  // NULL until the first call picks the best ISA
+static column_fn g_column = NULL;
+
+static int isa_supported(calc_batch_isa isa) {
+	switch (isa) {
+		case CALC_BATCH_SCALAR: return 1;
+#ifdef CALC_BATCH_X86
+		case CALC_BATCH_SSE2: return __builtin_cpu_supports("sse2");
+		case CALC_BATCH_AVX2: return __builtin_cpu_supports("avx2");
+#endif
+#ifdef CALC_BATCH_ARM
+		case CALC_BATCH_NEON: return 1;
+#endif
+		default: return 0;
+	}
+}
+
+int calc_batch_select(calc_batch_isa isa) {
+	if (!isa_supported(isa)) {
+		return 0;
+	}
+	switch (isa) {
+#ifdef CALC_BATCH_X86
+		case CALC_BATCH_SSE2: g_column = column_sse2; g_apply = apply_sse2; break;
+		case CALC_BATCH_AVX2: g_column = column_avx2; g_apply = apply_avx2; break;
+#endif
+#ifdef CALC_BATCH_ARM
+		case CALC_BATCH_NEON: g_column = column_neon; g_apply = apply_neon; break;
+#endif
+		default: g_column = column_scalar; g_apply = apply_scalar; break;
+	}
+	g_isa = isa;
+	return 1;
+}
+
+// Best first; every thread that races here picks the same answer
+static void select_best(void) {
+	static const calc_batch_isa preference[] = {
+		CALC_BATCH_AVX2, CALC_BATCH_NEON, CALC_BATCH_SSE2, CALC_BATCH_SCALAR
+	};
+	for (size_t i = 0; !calc_batch_select(preference[i]); i++) {}
+}
+
+calc_batch_isa calc_batch_active(void) {
+	if (!g_apply) {
+		select_best();
+	}
+	return g_isa;
+}
+
+const char* calc_batch_isa_name(calc_batch_isa isa) {
+	switch (isa) {
+		case CALC_BATCH_SSE2: return "sse2";
+		case CALC_BATCH_AVX2: return "avx2";
+		case CALC_BATCH_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
+// ============================================================================
+// Batch API
+// ============================================================================
+
+// Operands per block when '^' lanes are patched; out may alias lhs or rhs, so
+// each block's operands are copied before the vector code overwrites them
+#define POW_BLOCK 256
+
+void calc_batch_apply(double* out, const double* lhs, const char* ops, const double* rhs, size_t count) {
+	if (!g_apply) {
+		select_best();
+	}
+	if (!memchr(ops, '^', count)) {
+		g_apply(out, lhs, ops, rhs, count);
+		return;
+	}
+	
+	for (size_t start = 0; start < count; start += POW_BLOCK) {
+		size_t n = count - start < POW_BLOCK ? count - start : POW_BLOCK;
+		double l[POW_BLOCK], r[POW_BLOCK];
+		memcpy(l, lhs + start, n * sizeof(double));
+		memcpy(r, rhs + start, n * sizeof(double));
+		g_apply(out + start, l, ops + start, r, n);
+		
+		// The vector code gave '^' lanes rhs; gather them into one pow batch
+		double x[POW_BLOCK], y[POW_BLOCK];
+		unsigned short at[POW_BLOCK];
+		size_t powers = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (ops[start + i] == '^') {
+				x[powers] = l[i];
+				y[powers] = r[i];
+				at[powers++] = (unsigned short)i;
+			}
+		}
+		calc_math_batch_pow(x, x, y, powers);
+		for (size_t k = 0; k < powers; k++) {
+			out[start + at[k]] = x[k];
+		}
+	}
+}
+
+void calc_batch_apply_column(double* out, const double* lhs, char op, const double* rhs, size_t count) {
+	if (!g_column) {
+		select_best();
+	}
+	if (op == '^') {
+		calc_math_batch_pow(out, lhs, rhs, count);
+		return;
+	}
+	g_column(out, lhs, op, rhs, count);
+}
@@ -0,0 +1,34 @@
+// Batch Evaluation - perform_operation over whole columns of operands
+//
+// Results are bit-for-bit what perform_operation gives element by element,
+// including the divide-by-zero rule (rhs == 0 gives 0), '^' (calc_pow) and
+// unknown operators (result = rhs). Vector code is chosen at runtime from the
+// CPU's features.
+
+#ifndef CALC_BATCH_H
+#define CALC_BATCH_H
+
+#include <stddef.h>
+
+typedef enum calc_batch_isa {
+	CALC_BATCH_SCALAR,  // perform_operation in a loop
+	CALC_BATCH_SSE2,    // x86-64 baseline, 2 doubles per instruction
+	CALC_BATCH_AVX2,    // 4 doubles per instruction, when the CPU has it
+	CALC_BATCH_NEON,    // AArch64, 2 doubles per instruction
+} calc_batch_isa;
+
+// out[i] = perform_operation(lhs[i], ops[i], rhs[i]); out may alias lhs or rhs
+void calc_batch_apply(double* out, const double* lhs, const char* ops, const double* rhs, size_t count);
+
+// out[i] = perform_operation(lhs[i], op, rhs[i]); out may alias lhs or rhs
+void calc_batch_apply_column(double* out, const double* lhs, char op, const double* rhs, size_t count);
+
+// Implementation in use; the best supported one until calc_batch_select
+calc_batch_isa calc_batch_active(void);
+
+// Force an implementation (for benchmarking); returns 0 if the CPU lacks it
+int calc_batch_select(calc_batch_isa isa);
+
+const char* calc_batch_isa_name(calc_batch_isa isa);
+
+#endif
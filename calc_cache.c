@@ -0,0 +1,402 @@
+// Result Cache - bounded memo of expensive results, shared by every thread
+
+#include "calc_cache.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// Layout
+// ============================================================================
+
+// Index slot: tag (hash bits 49-63, never 0) | referenced | ring position.
+// Positions only grow, so 48 bits allow 256 TiB of inserts.
+#define SLOT_POSITION_BITS 48
+#define SLOT_POSITION_MASK ((UINT64_C(1) << SLOT_POSITION_BITS) - 1)
+#define SLOT_REFERENCED (UINT64_C(1) << SLOT_POSITION_BITS)
+#define SLOT_TAG_MASK (~(SLOT_REFERENCED | SLOT_POSITION_MASK))
+#define BUCKET_SLOTS 8
+
+// One index slot per this many bytes of budget, about 6% of it
+#define BYTES_PER_SLOT 128
+#define MIN_BUDGET 4096
+#define COUNTER_STRIPES 16
+
+typedef struct record_header {
+	uint64_t hash;
+	uint32_t key_length;
+	uint32_t value_length;
+} record_header;
+
+typedef struct cache_table {
+	unsigned char* ring;
+	size_t ring_size;               // Multiple of 8
+	size_t max_record;
+	_Atomic uint64_t* slots;        // Buckets of BUCKET_SLOTS, one cache line each
+	size_t bucket_mask;
+	_Atomic uint64_t head;          // Where the next record goes; raised before its bytes are written
+	uint64_t tail;                  // Oldest record; only the writer reads it
+	size_t entries;
+} cache_table;
+
+// Hit and miss counts, spread so threads do not share a line
+typedef struct counter_stripe {
+	_Atomic uint64_t hits;
+	_Atomic uint64_t misses;
+	char padding[48];
+} counter_stripe;
+
+static size_t budget = CALC_CACHE_DEFAULT_BUDGET;
+static _Atomic(cache_table*) table = NULL;
+
+// Held while inserting
+static atomic_flag writing = ATOMIC_FLAG_INIT;
+
+static counter_stripe stripes[COUNTER_STRIPES] __attribute__((aligned(64)));
+static _Atomic unsigned next_stripe = 0;
+static _Thread_local counter_stripe* thread_stripe = NULL;
+static _Atomic uint64_t insertions = 0;
+static _Atomic uint64_t evictions = 0;
+
+static counter_stripe* own_stripe(void) {
+	if (!thread_stripe) {
+		thread_stripe = &stripes[atomic_fetch_add_explicit(&next_stripe, 1, memory_order_relaxed) % COUNTER_STRIPES];
+	}
+	return thread_stripe;
+}
+
+static size_t record_size(size_t key_length, size_t value_length) {
+	return (sizeof(record_header) + key_length + value_length + 7) & ~(size_t)7;
+}
+
+static cache_table* create_table(size_t bytes) {
+	if (bytes < MIN_BUDGET) {
+		return NULL;
+	}
+	size_t buckets = 1;
+	while (buckets * 2 * BUCKET_SLOTS * BYTES_PER_SLOT <= bytes) {
+		buckets *= 2;
+	}
+	size_t index_bytes = buckets * BUCKET_SLOTS * sizeof(uint64_t);
+	cache_table* t = calloc(1, sizeof(*t));
+	if (!t) {
+		return NULL;
+	}
+	t->ring_size = (bytes - index_bytes) & ~(size_t)7;
+	t->max_record = t->ring_size / 16;
+	t->bucket_mask = buckets - 1;
+	t->ring = malloc(t->ring_size);
+	t->slots = aligned_alloc(64, index_bytes);
+	if (!t->ring || !t->slots) {
+		free(t->ring);
+		free(t->slots);
+		free(t);
+		return NULL;
+	}
+	memset(t->slots, 0, index_bytes);
+	return t;
+}
+
+static void free_table(cache_table* t) {
+	if (t) {
+		free(t->ring);
+		free(t->slots);
+		free(t);
+	}
+}
+
+// ============================================================================
+// Hashing & Ring Access
+// ============================================================================
+
+static uint64_t mix(uint64_t a, uint64_t b) {
+	__uint128_t product = (__uint128_t)a * b;
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+// 16 bytes per multiply, with the length folded in at both ends
+static uint64_t hash_key(const unsigned char* key, size_t length) {
+	uint64_t h = length * UINT64_C(0x9e3779b97f4a7c15);
+	for (size_t i = 0; i < length; i += 16) {
+		uint64_t words[2] = {0, 0};
+		memcpy(words, key + i, length - i < 16 ? length - i : 16);
+		h = mix(words[0] ^ h ^ UINT64_C(0xa0761d6478bd642f), words[1] ^ UINT64_C(0xe7037ed1a0b428db));
+	}
+	return mix(h ^ UINT64_C(0x8ebc6af09c88c6e3), length ^ UINT64_C(0x589965cc75374cc3));
+}
+
+static uint64_t tag_of(uint64_t hash) {
+	return (hash | (UINT64_C(1) << 49)) & SLOT_TAG_MASK;
+}
+
+static _Atomic uint64_t* bucket_of(const cache_table* t, uint64_t hash) {
+	return t->slots + (hash & t->bucket_mask) * BUCKET_SLOTS;
+}
+
+// Records may wrap round the end of the ring
+static void ring_read(const cache_table* t, uint64_t position, void* out, size_t length) {
+	size_t offset = position % t->ring_size;
+	size_t first = t->ring_size - offset < length ? t->ring_size - offset : length;
+	memcpy(out, t->ring + offset, first);
+	memcpy((unsigned char*)out + first, t->ring, length - first);
+}
+
+static void ring_write(cache_table* t, uint64_t position, const void* in, size_t length) {
+	size_t offset = position % t->ring_size;
+	size_t first = t->ring_size - offset < length ? t->ring_size - offset : length;
+	memcpy(t->ring + offset, in, first);
+	memcpy(t->ring, (const unsigned char*)in + first, length - first);
+}
+
+static int ring_equal(const cache_table* t, uint64_t position, const void* data, size_t length) {
+	size_t offset = position % t->ring_size;
+	size_t first = t->ring_size - offset < length ? t->ring_size - offset : length;
+	return memcmp(t->ring + offset, data, first) == 0
+		&& memcmp(t->ring, (const unsigned char*)data + first, length - first) == 0;
+}
+
+// Copy a record to dst, at most one ring ahead of src. In the ring that moves
+// it back over free space, so copying the first chunk first is safe.
+static void ring_move(cache_table* t, uint64_t dst, uint64_t src, size_t length) {
+	if ((dst - src) % t->ring_size == 0) {
+		return;
+	}
+	unsigned char chunk[512];
+	for (size_t done = 0; done < length; done += sizeof(chunk)) {
+		size_t n = length - done < sizeof(chunk) ? length - done : sizeof(chunk);
+		ring_read(t, src + done, chunk, n);
+		ring_write(t, dst + done, chunk, n);
+	}
+}
+
+// Claim the ring up to end before writing there, so readers of the bytes
+// being overwritten see the new head when they check
+static void advance_head(cache_table* t, uint64_t end) {
+	atomic_store_explicit(&t->head, end, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+// ============================================================================
+// Lookup
+// ============================================================================
+
+size_t calc_cache_lookup(const void* key, size_t key_length, void* value, size_t capacity) {
+	if (budget == 0) {
+		return 0;
+	}
+	cache_table* t = atomic_load_explicit(&table, memory_order_acquire);
+	if (t) {
+		uint64_t hash = hash_key(key, key_length);
+		uint64_t tag = tag_of(hash);
+		_Atomic uint64_t* bucket = bucket_of(t, hash);
+		for (int i = 0; i < BUCKET_SLOTS; i++) {
+			uint64_t slot = atomic_load_explicit(&bucket[i], memory_order_acquire);
+			if ((slot & SLOT_TAG_MASK) != tag) {
+				continue;
+			}
+			// The record may be overwritten while we read it: check lengths
+			// before trusting them, and the head once done
+			uint64_t position = slot & SLOT_POSITION_MASK;
+			record_header header;
+			ring_read(t, position, &header, sizeof(header));
+			if (header.hash != hash || header.key_length != key_length || header.value_length > t->max_record
+			    || !ring_equal(t, position + sizeof(header), key, key_length)) {
+				continue;
+			}
+			size_t length = header.value_length;
+			if (length <= capacity) {
+				ring_read(t, position + sizeof(header) + key_length, value, length);
+			}
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&t->head, memory_order_relaxed) > position + t->ring_size) {
+				break;
+			}
+			if (length > capacity) {
+				return length;
+			}
+			if (!(slot & SLOT_REFERENCED)) {
+				atomic_compare_exchange_strong_explicit(&bucket[i], &slot, slot | SLOT_REFERENCED,
+					memory_order_relaxed, memory_order_relaxed);
+			}
+			atomic_fetch_add_explicit(&own_stripe()->hits, 1, memory_order_relaxed);
+			return length;
+		}
+	}
+	atomic_fetch_add_explicit(&own_stripe()->misses, 1, memory_order_relaxed);
+	return 0;
+}
+
+// ============================================================================
+// Insertion & Eviction
+// ============================================================================
+
+// Slot of the record at position, if it is still indexed; writer only
+static _Atomic uint64_t* find_record(cache_table* t, uint64_t hash, uint64_t position) {
+	_Atomic uint64_t* bucket = bucket_of(t, hash);
+	for (int i = 0; i < BUCKET_SLOTS; i++) {
+		uint64_t slot = atomic_load_explicit(&bucket[i], memory_order_relaxed);
+		if ((slot & SLOT_TAG_MASK) == tag_of(hash) && (slot & SLOT_POSITION_MASK) == position) {
+			return &bucket[i];
+		}
+	}
+	return NULL;
+}
+
+static int contains(cache_table* t, uint64_t hash, const void* key, size_t key_length) {
+	_Atomic uint64_t* bucket = bucket_of(t, hash);
+	for (int i = 0; i < BUCKET_SLOTS; i++) {
+		uint64_t slot = atomic_load_explicit(&bucket[i], memory_order_relaxed);
+		if ((slot & SLOT_TAG_MASK) != tag_of(hash)) {
+			continue;
+		}
+		record_header header;
+		ring_read(t, slot & SLOT_POSITION_MASK, &header, sizeof(header));
+		if (header.hash == hash && header.key_length == key_length
+		    && ring_equal(t, (slot & SLOT_POSITION_MASK) + sizeof(header), key, key_length)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Retire records from the tail until size bytes fit at the head. A record hit
+// since it was written moves to the head with its bit cleared, at most one
+// ring's worth of them per call.
+static void make_room(cache_table* t, size_t size) {
+	uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+	size_t moved = 0;
+	while (head + size > t->tail + t->ring_size) {
+		record_header header;
+		ring_read(t, t->tail, &header, sizeof(header));
+		size_t length = record_size(header.key_length, header.value_length);
+		_Atomic uint64_t* slot = find_record(t, header.hash, t->tail);
+		if (slot) {
+			uint64_t value = atomic_load_explicit(slot, memory_order_relaxed);
+			if ((value & SLOT_REFERENCED) && moved < t->ring_size) {
+				advance_head(t, head + length);
+				ring_move(t, head, t->tail, length);
+				atomic_store_explicit(slot, (value & SLOT_TAG_MASK) | head, memory_order_release);
+				head += length;
+				moved += length;
+			} else {
+				atomic_store_explicit(slot, 0, memory_order_relaxed);
+				atomic_fetch_add_explicit(&evictions, 1, memory_order_relaxed);
+				t->entries--;
+			}
+		}
+		t->tail += length;
+	}
+}
+
+// Index a record: an empty slot, else the bucket's first one not hit since the
+// last pass (clearing bits on the way), else its first
+static void place(cache_table* t, uint64_t hash, uint64_t position) {
+	_Atomic uint64_t* bucket = bucket_of(t, hash);
+	_Atomic uint64_t* victim = NULL;
+	for (int i = 0; i < BUCKET_SLOTS && !victim; i++) {
+		if (atomic_load_explicit(&bucket[i], memory_order_relaxed) == 0) {
+			victim = &bucket[i];
+		}
+	}
+	for (int i = 0; i < BUCKET_SLOTS && !victim; i++) {
+		uint64_t slot = atomic_fetch_and_explicit(&bucket[i], ~SLOT_REFERENCED, memory_order_relaxed);
+		if (!(slot & SLOT_REFERENCED)) {
+			victim = &bucket[i];
+		}
+	}
+	if (!victim) {
+		victim = &bucket[0];
+	}
+	if (atomic_load_explicit(victim, memory_order_relaxed)) {
+		// Its record stays in the ring, unindexed, until the tail passes it
+		atomic_fetch_add_explicit(&evictions, 1, memory_order_relaxed);
+	} else {
+		t->entries++;
+	}
+	atomic_store_explicit(victim, tag_of(hash) | position, memory_order_release);
+}
+
+void calc_cache_insert(const void* key, size_t key_length, const void* value, size_t value_length) {
+	if (budget == 0 || value_length == 0) {
+		return;
+	}
+	uint64_t hash = hash_key(key, key_length);
+	size_t size = record_size(key_length, value_length);
+	while (atomic_flag_test_and_set_explicit(&writing, memory_order_acquire)) {
+	}
+	
+	cache_table* t = atomic_load_explicit(&table, memory_order_relaxed);
+	if (!t && (t = create_table(budget)) != NULL) {
+		atomic_store_explicit(&table, t, memory_order_release);
+	}
+	if (t && size <= t->max_record && !contains(t, hash, key, key_length)) {
+		make_room(t, size);
+		uint64_t position = atomic_load_explicit(&t->head, memory_order_relaxed);
+		if (position + size <= SLOT_POSITION_MASK) {
+			record_header header = {hash, (uint32_t)key_length, (uint32_t)value_length};
+			advance_head(t, position + size);
+			ring_write(t, position, &header, sizeof(header));
+			ring_write(t, position + sizeof(header), key, key_length);
+			ring_write(t, position + sizeof(header) + key_length, value, value_length);
+			place(t, hash, position);
+			atomic_fetch_add_explicit(&insertions, 1, memory_order_relaxed);
+		}
+	}
+	
+	atomic_flag_clear_explicit(&writing, memory_order_release);
+}
+
+// ============================================================================
+// Budget & Statistics
+// ============================================================================
+
+void calc_cache_clear(void) {
+	free_table(atomic_exchange(&table, NULL));
+	for (int i = 0; i < COUNTER_STRIPES; i++) {
+		atomic_store(&stripes[i].hits, 0);
+		atomic_store(&stripes[i].misses, 0);
+	}
+	atomic_store(&insertions, 0);
+	atomic_store(&evictions, 0);
+}
+
+void calc_cache_set_budget(size_t bytes) {
+	calc_cache_clear();
+	budget = bytes;
+}
+
+size_t calc_cache_budget(void) {
+	return budget;
+}
+
+void calc_cache_get_stats(calc_cache_stats* stats) {
+	memset(stats, 0, sizeof(*stats));
+	for (int i = 0; i < COUNTER_STRIPES; i++) {
+		stats->hits += atomic_load_explicit(&stripes[i].hits, memory_order_relaxed);
+		stats->misses += atomic_load_explicit(&stripes[i].misses, memory_order_relaxed);
+	}
+	stats->insertions = atomic_load_explicit(&insertions, memory_order_relaxed);
+	stats->evictions = atomic_load_explicit(&evictions, memory_order_relaxed);
+	stats->budget = budget;
+	
+	while (atomic_flag_test_and_set_explicit(&writing, memory_order_acquire)) {
+	}
+	cache_table* t = atomic_load_explicit(&table, memory_order_relaxed);
+	if (t) {
+		stats->entries = t->entries;
+		stats->bytes = atomic_load_explicit(&t->head, memory_order_relaxed) - t->tail;
+	}
+	atomic_flag_clear_explicit(&writing, memory_order_release);
+}
+
+void calc_cache_print_stats(FILE* out, const char* name) {
+	calc_cache_stats stats;
+	calc_cache_get_stats(&stats);
+	uint64_t lookups = stats.hits + stats.misses;
+	if (lookups == 0) {
+		return;
+	}
+	fprintf(out, "%s: result cache: %llu hits, %llu misses (%.1f%% hit rate), %llu evictions, %zu of %zu KiB\n",
+		name, (unsigned long long)stats.hits, (unsigned long long)stats.misses, 100.0 * stats.hits / lookups,
+		(unsigned long long)stats.evictions, stats.bytes >> 10, stats.budget >> 10);
+}
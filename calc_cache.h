@@ -0,0 +1,60 @@
+// Result Cache - bounded memo of expensive results, shared by every thread
+//
+// Callers serialise an operation and its operands into a key, so the cache is
+// content-addressed: equal inputs find the result whichever thread, session or
+// batch file computed it first. Records are appended to one ring of bytes and
+// an index of 8-slot buckets maps a key's hash to its record. When the ring is
+// full the oldest record is dropped, unless it was hit since it was written;
+// then it is moved to the head instead (CLOCK's second chance).
+//
+// Lookups take no lock and write nothing shared but a reference bit and a
+// per-thread counter: a reader copies the record, then checks that the ring's
+// head has not come round to it in the meantime, and reports a miss if it has.
+// Inserts are serialised by a spin lock. Memory is allocated on the first
+// insert and stays within the budget.
+
+#ifndef CALC_CACHE_H
+#define CALC_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CALC_CACHE_DEFAULT_BUDGET ((size_t)16 << 20)
+
+typedef struct calc_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t insertions;
+	uint64_t evictions;    // Records dropped to make room, not counting clears
+	size_t entries;        // Records that can still be found
+	size_t bytes;          // Ring bytes in use, including dropped records not yet overwritten
+	size_t budget;
+} calc_cache_stats;
+
+// Bytes for the ring and the index together; 0 turns the cache off. Drops
+// every record and zeroes the counters, so only call it while no other thread
+// is using the cache.
+void calc_cache_set_budget(size_t bytes);
+
+size_t calc_cache_budget(void);
+
+// Drop every record and zero the counters; the same caveat applies
+void calc_cache_clear(void);
+
+// Copy the value stored under key into value and return its length, or 0 if
+// the key is not cached. A length above capacity means nothing was copied:
+// look up again with a larger buffer.
+size_t calc_cache_lookup(const void* key, size_t key_length, void* value, size_t capacity);
+
+// Store a non-empty value under key, unless it is already there or the record
+// would take more than 1/16 of the ring
+void calc_cache_insert(const void* key, size_t key_length, const void* value, size_t value_length);
+
+void calc_cache_get_stats(calc_cache_stats* stats);
+
+// "name: result cache: H hits, M misses (R% hit rate), E evictions, X of Y KiB",
+// or nothing if the cache has not been asked anything
+void calc_cache_print_stats(FILE* out, const char* name);
+
+#endif
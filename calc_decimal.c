@@ -0,0 +1,1030 @@
+// Decimal Arithmetic - arbitrary-precision decimal numbers for exact results
+
+#include "calc_decimal.h"
+#include "calc_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BASE CALC_DECIMAL_BASE
+#define LIMB_DIGITS CALC_DECIMAL_LIMB_DIGITS
+
+size_t calc_decimal_karatsuba_threshold = 40;
+size_t calc_decimal_ntt_threshold = 1500;
+
+static const uint32_t limb_powers[] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// ============================================================================
+// Lifetime & Storage
+// ============================================================================
+
+void calc_decimal_init(calc_decimal* d) {
+	d->limbs = NULL;
+	d->length = 0;
+	d->capacity = 0;
+	d->exponent = 0;
+	d->negative = 0;
+}
+
+void calc_decimal_free(calc_decimal* d) {
+	free(d->limbs);
+	calc_decimal_init(d);
+}
+
+static void reserve(calc_decimal* d, size_t capacity) {
+	if (capacity > d->capacity) {
+		d->limbs = realloc(d->limbs, capacity * sizeof(uint32_t));
+		d->capacity = capacity;
+	}
+}
+
+void calc_decimal_set_zero(calc_decimal* d) {
+	d->length = 0;
+	d->exponent = 0;
+	d->negative = 0;
+}
+
+void calc_decimal_copy(calc_decimal* dst, const calc_decimal* src) {
+	if (dst == src) {
+		return;
+	}
+	reserve(dst, src->length);
+	if (src->length) {
+		memcpy(dst->limbs, src->limbs, src->length * sizeof(uint32_t));
+	}
+	dst->length = src->length;
+	dst->exponent = src->exponent;
+	dst->negative = src->negative;
+}
+
+void calc_decimal_swap(calc_decimal* a, calc_decimal* b) {
+	calc_decimal tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+// Strip zero limbs from both ends so the representation is canonical
+static void normalize(calc_decimal* d) {
+	while (d->length && d->limbs[d->length - 1] == 0) {
+		d->length--;
+	}
+	size_t low = 0;
+	while (low < d->length && d->limbs[low] == 0) {
+		low++;
+	}
+	if (low) {
+		memmove(d->limbs, d->limbs + low, (d->length - low) * sizeof(uint32_t));
+		d->length -= low;
+		d->exponent += (long)low;
+	}
+	if (d->length == 0) {
+		calc_decimal_set_zero(d);
+	}
+}
+
+int calc_decimal_is_zero(const calc_decimal* d) {
+	return d->length == 0;
+}
+
+static int limb_digit_count(uint32_t limb) {
+	int count = 1;
+	while (count < LIMB_DIGITS && limb >= limb_powers[count]) {
+		count++;
+	}
+	return count;
+}
+
+long calc_decimal_digits(const calc_decimal* d) {
+	if (!d->length) {
+		return 0;
+	}
+	// Trailing zeros of the lowest limb are not significant
+	uint32_t low = d->limbs[0];
+	long trailing = 0;
+	while (low % 10 == 0) {
+		low /= 10;
+		trailing++;
+	}
+	return (long)(d->length - 1) * LIMB_DIGITS + limb_digit_count(d->limbs[d->length - 1]) - trailing;
+}
+
+// Decimal exponent of the leading digit
+static long leading_exponent(const calc_decimal* d) {
+	return (d->exponent + (long)d->length - 1) * LIMB_DIGITS + limb_digit_count(d->limbs[d->length - 1]) - 1;
+}
+
+// ============================================================================
+// Conversion
+// ============================================================================
+
+// value = mantissa * 10^decimal_exponent with a mantissa of any size in limbs
+static void set_power_shifted(calc_decimal* d, const uint32_t* digits_base, size_t n, long decimal_exponent) {
+	// Move the partial-limb part of the exponent into the mantissa
+	long limb_exponent = decimal_exponent >= 0 ? decimal_exponent / LIMB_DIGITS
+	                                           : -((-decimal_exponent + LIMB_DIGITS - 1) / LIMB_DIGITS);
+	int shift = (int)(decimal_exponent - limb_exponent * LIMB_DIGITS);
+	reserve(d, n + 1);
+	uint64_t carry = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t t = (uint64_t)digits_base[i] * limb_powers[shift] + carry;
+		d->limbs[i] = (uint32_t)(t % BASE);
+		carry = t / BASE;
+	}
+	d->limbs[n] = (uint32_t)carry;
+	d->length = n + 1;
+	d->exponent = limb_exponent;
+	normalize(d);
+}
+
+void calc_decimal_set_scaled(calc_decimal* d, uint64_t mantissa, long decimal_exponent, int negative) {
+	uint32_t limbs[3];
+	size_t n = 0;
+	while (mantissa) {
+		limbs[n++] = (uint32_t)(mantissa % BASE);
+		mantissa /= BASE;
+	}
+	set_power_shifted(d, limbs, n, decimal_exponent);
+	d->negative = d->length ? negative : 0;
+}
+
+int calc_decimal_set_string(calc_decimal* d, const char* text) {
+	const char* p = text;
+	int negative = 0;
+	if (*p == '-' || *p == '+') {
+		negative = *p == '-';
+		p++;
+	}
+	
+	// Collect digits, remembering where the point was
+	const char* start = p;
+	size_t digit_count = 0;
+	long fraction = 0;
+	int seen_point = 0;
+	for (; (*p >= '0' && *p <= '9') || (*p == '.' && !seen_point); p++) {
+		if (*p == '.') {
+			seen_point = 1;
+		} else {
+			digit_count++;
+			fraction += seen_point;
+		}
+	}
+	if (digit_count == 0) {
+		return 0;
+	}
+	const char* end = p;
+	
+	long exponent = 0;
+	if (*p == 'e' || *p == 'E') {
+		char* exponent_end;
+		exponent = strtol(p + 1, &exponent_end, 10);
+		if (exponent_end == p + 1) {
+			return 0;
+		}
+		p = exponent_end;
+	}
+	if (*p != '\0') {
+		return 0;
+	}
+	
+	// Pack digits into limbs from the least significant end
+	size_t n = (digit_count + LIMB_DIGITS - 1) / LIMB_DIGITS;
+	uint32_t* limbs = calloc(n ? n : 1, sizeof(uint32_t));
+	size_t index = 0;
+	int position = 0;
+	for (const char* q = end; q-- > start;) {
+		if (*q == '.') {
+			continue;
+		}
+		limbs[index] += (uint32_t)(*q - '0') * limb_powers[position];
+		if (++position == LIMB_DIGITS) {
+			position = 0;
+			index++;
+		}
+	}
+	set_power_shifted(d, limbs, n, exponent - fraction);
+	d->negative = d->length ? negative : 0;
+	free(limbs);
+	return 1;
+}
+
+static int write_exponent(char* out, long exponent) {
+	char digits[24];
+	int count = 0;
+	int n = 0;
+	out[n++] = 'e';
+	if (exponent < 0) {
+		out[n++] = '-';
+		exponent = -exponent;
+	}
+	do {
+		digits[count++] = (char)('0' + exponent % 10);
+		exponent /= 10;
+	} while (exponent);
+	while (count) {
+		out[n++] = digits[--count];
+	}
+	return n;
+}
+
+// Significant digits as characters, most significant first; returns the count
+static size_t digit_string(const calc_decimal* d, char* out) {
+	size_t n = 0;
+	for (size_t i = d->length; i-- > 0;) {
+		uint32_t limb = d->limbs[i];
+		int width = i == d->length - 1 ? limb_digit_count(limb) : LIMB_DIGITS;
+		for (int k = width - 1; k >= 0; k--) {
+			out[n++] = (char)('0' + (limb / limb_powers[k]) % 10);
+		}
+	}
+	// Only the lowest limb can end in zeros
+	while (n > 1 && out[n - 1] == '0') {
+		n--;
+	}
+	return n;
+}
+
+size_t calc_decimal_to_string(const calc_decimal* d, char* buffer, size_t size, int max_digits) {
+	if (!d->length) {
+		if (size) {
+			buffer[0] = size > 1 ? '0' : '\0';
+			buffer[size > 1] = '\0';
+		}
+		return 1;
+	}
+	
+	calc_decimal rounded;
+	calc_decimal_init(&rounded);
+	calc_decimal_copy(&rounded, d);
+	if (max_digits > 0) {
+		calc_decimal_round(&rounded, max_digits);
+	}
+	
+	char* digits = malloc(rounded.length * LIMB_DIGITS + 1);
+	long count = (long)digit_string(&rounded, digits);
+	long leading = leading_exponent(&rounded);
+	long limit = max_digits > 0 ? max_digits : count;
+	
+	// Plain notation unless it would need a long run of padding zeros
+	char* text = malloc((size_t)(count + (leading < 0 ? -leading : leading) + 32));
+	size_t n = 0;
+	if (rounded.negative) {
+		text[n++] = '-';
+	}
+	if (leading >= 0 && leading < limit + 6) {
+		for (long i = 0; i <= leading; i++) {
+			text[n++] = i < count ? digits[i] : '0';
+		}
+		if (count > leading + 1) {
+			text[n++] = '.';
+			for (long i = leading + 1; i < count; i++) {
+				text[n++] = digits[i];
+			}
+		}
+	} else if (leading < 0 && -leading <= 6) {
+		text[n++] = '0';
+		text[n++] = '.';
+		for (long i = 0; i < -leading - 1; i++) {
+			text[n++] = '0';
+		}
+		memcpy(text + n, digits, (size_t)count);
+		n += (size_t)count;
+	} else {
+		text[n++] = digits[0];
+		if (count > 1) {
+			text[n++] = '.';
+			memcpy(text + n, digits + 1, (size_t)count - 1);
+			n += (size_t)count - 1;
+		}
+		n += (size_t)write_exponent(text + n, leading);
+	}
+	
+	if (size) {
+		size_t copy = n < size - 1 ? n : size - 1;
+		memcpy(buffer, text, copy);
+		buffer[copy] = '\0';
+	}
+	free(text);
+	free(digits);
+	calc_decimal_free(&rounded);
+	return n;
+}
+
+double calc_decimal_to_double(const calc_decimal* d) {
+	char buffer[40];
+	calc_decimal_to_string(d, buffer, sizeof(buffer), 17);
+	return strtod(buffer, NULL);
+}
+
+int calc_decimal_set_double(calc_decimal* d, double value) {
+	if (value - value != 0) {
+		calc_decimal_set_zero(d);
+		return 0;
+	}
+	// Fewest digits that read back as value
+	char buffer[32];
+	for (int digits = 15; digits <= 17; digits++) {
+		snprintf(buffer, sizeof(buffer), "%.*e", digits - 1, value);
+		if (strtod(buffer, NULL) == value) {
+			break;
+		}
+	}
+	return calc_decimal_set_string(d, buffer);
+}
+
+// ============================================================================
+// Magnitudes
+// ============================================================================
+
+// Unsigned little-endian base-1e9 arrays; results never shrink the caller's buffers
+
+// r[0..nr) += x[0..nx), nr >= nx; returns the carry out of r
+static uint32_t mag_add_to(uint32_t* r, size_t nr, const uint32_t* x, size_t nx) {
+	uint32_t carry = 0;
+	size_t i = 0;
+	for (; i < nx; i++) {
+		uint32_t t = r[i] + x[i] + carry;
+		carry = t >= BASE;
+		r[i] = carry ? t - BASE : t;
+	}
+	for (; carry && i < nr; i++) {
+		uint32_t t = r[i] + 1;
+		carry = t >= BASE;
+		r[i] = carry ? 0 : t;
+	}
+	return carry;
+}
+
+// r[0..nr) -= x[0..nx), requires r >= x
+static void mag_sub_from(uint32_t* r, size_t nr, const uint32_t* x, size_t nx) {
+	uint32_t borrow = 0;
+	size_t i = 0;
+	for (; i < nx; i++) {
+		uint32_t sub = x[i] + borrow;
+		borrow = r[i] < sub;
+		r[i] = borrow ? r[i] + BASE - sub : r[i] - sub;
+	}
+	for (; borrow && i < nr; i++) {
+		borrow = r[i] == 0;
+		r[i] = borrow ? BASE - 1 : r[i] - 1;
+	}
+}
+
+// out[0..max(nx, ny)] = x + y
+static void mag_sum(uint32_t* out, const uint32_t* x, size_t nx, const uint32_t* y, size_t ny) {
+	if (nx < ny) {
+		const uint32_t* t = x;
+		x = y;
+		y = t;
+		size_t tn = nx;
+		nx = ny;
+		ny = tn;
+	}
+	memcpy(out, x, nx * sizeof(uint32_t));
+	out[nx] = mag_add_to(out, nx, y, ny);
+}
+
+// r[0..na+nb) = a * b, r zeroed by the caller
+static void mag_mul_schoolbook(uint32_t* r, const uint32_t* a, size_t na, const uint32_t* b, size_t nb) {
+	for (size_t i = 0; i < na; i++) {
+		uint64_t carry = 0;
+		uint64_t ai = a[i];
+		if (!ai) {
+			continue;
+		}
+		for (size_t j = 0; j < nb; j++) {
+			uint64_t t = ai * b[j] + r[i + j] + carry;
+			r[i + j] = (uint32_t)(t % BASE);
+			carry = t / BASE;
+		}
+		r[i + nb] = (uint32_t)carry;
+	}
+}
+
+static void mag_mul(uint32_t* r, const uint32_t* a, size_t na, const uint32_t* b, size_t nb);
+
+// Balanced Karatsuba: requires na >= nb > na / 2 and nb >= 4, so the
+// (a0 + a1)(b0 + b1) product is always shorter than this one
+static void mag_mul_karatsuba(uint32_t* r, const uint32_t* a, size_t na, const uint32_t* b, size_t nb) {
+	size_t m = na / 2;
+	const uint32_t* a0 = a;
+	const uint32_t* a1 = a + m;
+	const uint32_t* b0 = b;
+	const uint32_t* b1 = b + m;
+	size_t na1 = na - m, nb1 = nb - m;
+	
+	// z0 = a0 * b0 and z2 = a1 * b1 go straight into place
+	mag_mul(r, a0, m, b0, m);
+	mag_mul(r + 2 * m, a1, na1, b1, nb1);
+	
+	// z1 = (a0 + a1)(b0 + b1) - z0 - z2
+	size_t ns = na1 + 1;
+	uint32_t* sa = calloc(ns * 2 + ns * 2, sizeof(uint32_t));
+	uint32_t* sb = sa + ns;
+	uint32_t* z1 = sb + ns;
+	mag_sum(sa, a0, m, a1, na1);
+	mag_sum(sb, b0, m, b1, nb1);
+	mag_mul(z1, sa, ns, sb, ns);
+	mag_sub_from(z1, 2 * ns, r, 2 * m);
+	mag_sub_from(z1, 2 * ns, r + 2 * m, na1 + nb1);
+	
+	size_t nz1 = 2 * ns;
+	while (nz1 && z1[nz1 - 1] == 0) {
+		nz1--;
+	}
+	mag_add_to(r + m, na + nb - m, z1, nz1);
+	free(sa);
+}
+
+// ============================================================================
+// Number-Theoretic Transform
+// ============================================================================
+
+// Two NTT-friendly primes (c * 2^k + 1, primitive root 3); their product bounds
+// every convolution coefficient of base-1000 digits up to 2^23 points
+#define NTT_PRIME_1 998244353u
+#define NTT_PRIME_2 167772161u
+#define NTT_ROOT 3u
+#define NTT_MAX_LOG 23
+#define NTT_DIGIT_BASE 1000u
+
+static uint32_t pow_mod(uint32_t base, uint64_t exponent, uint32_t mod) {
+	uint64_t result = 1, b = base;
+	while (exponent) {
+		if (exponent & 1) {
+			result = result * b % mod;
+		}
+		b = b * b % mod;
+		exponent >>= 1;
+	}
+	return (uint32_t)result;
+}
+
+// Inlined into one copy per prime so every % is by a constant
+static inline __attribute__((always_inline))
+void ntt_transform(uint32_t* a, size_t n, int invert, uint32_t* twiddles, const uint32_t mod) {
+	for (size_t i = 1, j = 0; i < n; i++) {
+		size_t bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			uint32_t t = a[i];
+			a[i] = a[j];
+			a[j] = t;
+		}
+	}
+	
+	for (size_t len = 2; len <= n; len <<= 1) {
+		size_t half = len >> 1;
+		uint32_t w = pow_mod(NTT_ROOT, (mod - 1) / len, mod);
+		if (invert) {
+			w = pow_mod(w, mod - 2, mod);
+		}
+		twiddles[0] = 1;
+		for (size_t k = 1; k < half; k++) {
+			twiddles[k] = (uint32_t)((uint64_t)twiddles[k - 1] * w % mod);
+		}
+		for (size_t i = 0; i < n; i += len) {
+			uint32_t* lo = a + i;
+			uint32_t* hi = a + i + half;
+			for (size_t k = 0; k < half; k++) {
+				uint32_t u = lo[k];
+				uint32_t v = (uint32_t)((uint64_t)hi[k] * twiddles[k] % mod);
+				uint32_t sum = u + v;
+				lo[k] = sum >= mod ? sum - mod : sum;
+				hi[k] = u >= v ? u - v : u + mod - v;
+			}
+		}
+	}
+	
+	if (invert) {
+		uint64_t n_inverse = pow_mod((uint32_t)(n % mod), mod - 2, mod);
+		for (size_t i = 0; i < n; i++) {
+			a[i] = (uint32_t)(a[i] * n_inverse % mod);
+		}
+	}
+}
+
+static void ntt_prime_1(uint32_t* a, size_t n, int invert, uint32_t* twiddles) {
+	ntt_transform(a, n, invert, twiddles, NTT_PRIME_1);
+}
+
+static void ntt_prime_2(uint32_t* a, size_t n, int invert, uint32_t* twiddles) {
+	ntt_transform(a, n, invert, twiddles, NTT_PRIME_2);
+}
+
+// Convolution modulo one prime: fa = fa * fb
+static void ntt_convolve(uint32_t* fa, uint32_t* fb, size_t n, uint32_t* twiddles,
+                         void (*ntt)(uint32_t*, size_t, int, uint32_t*), uint32_t mod) {
+	ntt(fa, n, 0, twiddles);
+	ntt(fb, n, 0, twiddles);
+	for (size_t i = 0; i < n; i++) {
+		fa[i] = (uint32_t)((uint64_t)fa[i] * fb[i] % mod);
+	}
+	ntt(fa, n, 1, twiddles);
+}
+
+static void split_digits(uint32_t* out, const uint32_t* limbs, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		uint32_t limb = limbs[i];
+		out[3 * i] = limb % NTT_DIGIT_BASE;
+		out[3 * i + 1] = limb / NTT_DIGIT_BASE % NTT_DIGIT_BASE;
+		out[3 * i + 2] = limb / (NTT_DIGIT_BASE * NTT_DIGIT_BASE);
+	}
+}
+
+static int ntt_fits(size_t na, size_t nb) {
+	return 3 * (na + nb) <= ((size_t)1 << NTT_MAX_LOG);
+}
+
+static void mag_mul_ntt(uint32_t* r, const uint32_t* a, size_t na, const uint32_t* b, size_t nb) {
+	size_t digits = 3 * (na + nb);
+	size_t n = 1;
+	while (n < digits) {
+		n <<= 1;
+	}
+	
+	uint32_t* buffer = calloc(n * 4 + n / 2, sizeof(uint32_t));
+	uint32_t* fa1 = buffer;
+	uint32_t* fb1 = fa1 + n;
+	uint32_t* fa2 = fb1 + n;
+	uint32_t* fb2 = fa2 + n;
+	uint32_t* twiddles = fb2 + n;
+	
+	split_digits(fa1, a, na);
+	split_digits(fb1, b, nb);
+	memcpy(fa2, fa1, n * sizeof(uint32_t));
+	memcpy(fb2, fb1, n * sizeof(uint32_t));
+	ntt_convolve(fa1, fb1, n, twiddles, ntt_prime_1, NTT_PRIME_1);
+	ntt_convolve(fa2, fb2, n, twiddles, ntt_prime_2, NTT_PRIME_2);
+	
+	// Chinese remainder: x = r1 + p1 * ((r2 - r1) / p1 mod p2), then carry in base 1000
+	const uint64_t p1_inverse = pow_mod(NTT_PRIME_1 % NTT_PRIME_2, NTT_PRIME_2 - 2, NTT_PRIME_2);
+	uint64_t carry = 0;
+	uint32_t limb = 0;
+	size_t limb_index = 0;
+	int part = 0;
+	for (size_t i = 0; i < digits; i++) {
+		uint64_t r1 = fa1[i], r2 = fa2[i];
+		uint64_t diff = (r2 + NTT_PRIME_2 - r1 % NTT_PRIME_2) % NTT_PRIME_2;
+		uint64_t x = r1 + (uint64_t)NTT_PRIME_1 * (diff * p1_inverse % NTT_PRIME_2) + carry;
+		uint32_t digit = (uint32_t)(x % NTT_DIGIT_BASE);
+		carry = x / NTT_DIGIT_BASE;
+		limb += digit * (part == 0 ? 1 : part == 1 ? NTT_DIGIT_BASE : NTT_DIGIT_BASE * NTT_DIGIT_BASE);
+		if (++part == 3) {
+			r[limb_index++] = limb;
+			limb = 0;
+			part = 0;
+		}
+	}
+	free(buffer);
+}
+
+// r[0..na+nb) = a * b, choosing the algorithm by operand size
+static void mag_mul(uint32_t* r, const uint32_t* a, size_t na, const uint32_t* b, size_t nb) {
+	if (na < nb) {
+		const uint32_t* t = a;
+		a = b;
+		b = t;
+		size_t tn = na;
+		na = nb;
+		nb = tn;
+	}
+	memset(r, 0, (na + nb) * sizeof(uint32_t));
+	if (nb == 0) {
+		return;
+	}
+	
+	if (nb < calc_decimal_karatsuba_threshold || nb < 4) {
+		mag_mul_schoolbook(r, a, na, b, nb);
+	} else if (nb >= calc_decimal_ntt_threshold && ntt_fits(na, nb)) {
+		mag_mul_ntt(r, a, na, b, nb);
+	} else if (na > 2 * nb) {
+		// Unbalanced: multiply nb-sized slices of a and accumulate
+		uint32_t* partial = malloc(2 * nb * sizeof(uint32_t));
+		for (size_t offset = 0; offset < na; offset += nb) {
+			size_t chunk = na - offset < nb ? na - offset : nb;
+			mag_mul(partial, a + offset, chunk, b, nb);
+			mag_add_to(r + offset, na + nb - offset, partial, chunk + nb);
+		}
+		free(partial);
+	} else {
+		mag_mul_karatsuba(r, a, na, b, nb);
+	}
+}
+
+// ============================================================================
+// Arithmetic
+// ============================================================================
+
+static int compare_magnitude(const calc_decimal* a, const calc_decimal* b) {
+	if (!a->length || !b->length) {
+		return (a->length != 0) - (b->length != 0);
+	}
+	long top_a = a->exponent + (long)a->length;
+	long top_b = b->exponent + (long)b->length;
+	if (top_a != top_b) {
+		return top_a < top_b ? -1 : 1;
+	}
+	// Same top limb position: compare limb by limb from the top
+	size_t ia = a->length, ib = b->length;
+	while (ia && ib) {
+		ia--;
+		ib--;
+		if (a->limbs[ia] != b->limbs[ib]) {
+			return a->limbs[ia] < b->limbs[ib] ? -1 : 1;
+		}
+	}
+	return ia ? 1 : ib ? -1 : 0;
+}
+
+int calc_decimal_compare(const calc_decimal* a, const calc_decimal* b) {
+	int sign_a = a->length ? (a->negative ? -1 : 1) : 0;
+	int sign_b = b->length ? (b->negative ? -1 : 1) : 0;
+	if (sign_a != sign_b) {
+		return sign_a < sign_b ? -1 : 1;
+	}
+	int magnitude = compare_magnitude(a, b);
+	return sign_a < 0 ? -magnitude : magnitude;
+}
+
+// result = a + (negate_b ? -b : b)
+static void add_signed(calc_decimal* result, const calc_decimal* a, const calc_decimal* b, int negate_b) {
+	int b_negative = b->negative ^ negate_b;
+	if (!b->length) {
+		calc_decimal_copy(result, a);
+		return;
+	}
+	if (!a->length) {
+		calc_decimal_copy(result, b);
+		result->negative = b_negative;
+		return;
+	}
+	
+	// Align both on the lower exponent
+	long low = a->exponent < b->exponent ? a->exponent : b->exponent;
+	long high_a = a->exponent + (long)a->length;
+	long high_b = b->exponent + (long)b->length;
+	size_t n = (size_t)((high_a > high_b ? high_a : high_b) - low) + 1;
+	
+	calc_decimal sum;
+	calc_decimal_init(&sum);
+	reserve(&sum, n);
+	memset(sum.limbs, 0, n * sizeof(uint32_t));
+	sum.exponent = low;
+	sum.length = n;
+	
+	int magnitude = compare_magnitude(a, b);
+	const calc_decimal* big = magnitude >= 0 ? a : b;
+	const calc_decimal* small = magnitude >= 0 ? b : a;
+	memcpy(sum.limbs + (big->exponent - low), big->limbs, big->length * sizeof(uint32_t));
+	if (a->negative == b_negative) {
+		mag_add_to(sum.limbs + (small->exponent - low), n - (size_t)(small->exponent - low),
+		           small->limbs, small->length);
+		sum.negative = a->negative;
+	} else {
+		mag_sub_from(sum.limbs + (small->exponent - low), n - (size_t)(small->exponent - low),
+		             small->limbs, small->length);
+		sum.negative = big == a ? a->negative : b_negative;
+	}
+	normalize(&sum);
+	calc_decimal_swap(result, &sum);
+	calc_decimal_free(&sum);
+}
+
+void calc_decimal_add(calc_decimal* result, const calc_decimal* a, const calc_decimal* b) {
+	add_signed(result, a, b, 0);
+}
+
+void calc_decimal_sub(calc_decimal* result, const calc_decimal* a, const calc_decimal* b) {
+	add_signed(result, a, b, 1);
+}
+
+void calc_decimal_mul(calc_decimal* result, const calc_decimal* a, const calc_decimal* b) {
+	if (!a->length || !b->length) {
+		calc_decimal_set_zero(result);
+		return;
+	}
+	calc_decimal product;
+	calc_decimal_init(&product);
+	reserve(&product, a->length + b->length);
+	mag_mul(product.limbs, a->limbs, a->length, b->limbs, b->length);
+	product.length = a->length + b->length;
+	product.exponent = a->exponent + b->exponent;
+	product.negative = a->negative ^ b->negative;
+	normalize(&product);
+	calc_decimal_swap(result, &product);
+	calc_decimal_free(&product);
+}
+
+// ============================================================================
+// Rounding
+// ============================================================================
+
+// Drop digits below precision; round_mode 0 truncates, 1 rounds half-even
+static void round_digits(calc_decimal* d, long precision, int round_mode) {
+	if (!d->length || precision <= 0) {
+		return;
+	}
+	long total = (long)(d->length - 1) * LIMB_DIGITS + limb_digit_count(d->limbs[d->length - 1]);
+	long drop = total - precision;
+	if (drop <= 0) {
+		return;
+	}
+	
+	size_t index = (size_t)(drop / LIMB_DIGITS);
+	int within = (int)(drop % LIMB_DIGITS);
+	
+	// Dropped part relative to half a unit of the last kept digit
+	uint32_t rest, half;
+	int sticky = 0;
+	size_t sticky_end;
+	uint32_t kept_low;
+	if (within) {
+		rest = d->limbs[index] % limb_powers[within];
+		half = limb_powers[within] / 2;
+		kept_low = d->limbs[index] / limb_powers[within];
+		sticky_end = index;
+	} else {
+		rest = d->limbs[index - 1];
+		half = BASE / 2;
+		kept_low = d->limbs[index];
+		sticky_end = index - 1;
+	}
+	for (size_t i = 0; i < sticky_end && !sticky; i++) {
+		sticky = d->limbs[i] != 0;
+	}
+	int round_up = round_mode && (rest > half || (rest == half && (sticky || (kept_low & 1))));
+	
+	d->limbs[index] -= rest * (within ? 1 : 0);
+	if (round_up) {
+		uint32_t unit = limb_powers[within];
+		reserve(d, d->length + 1);
+		d->limbs[d->length] = 0;
+		mag_add_to(d->limbs + index, d->length + 1 - index, &unit, 1);
+		d->length++;
+	}
+	memmove(d->limbs, d->limbs + index, (d->length - index) * sizeof(uint32_t));
+	d->length -= index;
+	d->exponent += (long)index;
+	normalize(d);
+}
+
+void calc_decimal_round(calc_decimal* d, long precision) {
+	round_digits(d, precision, 1);
+}
+
+// ============================================================================
+// Division
+// ============================================================================
+
+// Keep only the top limbs of d (truncating toward zero)
+static void keep_top_limbs(calc_decimal* d, size_t limbs) {
+	if (d->length > limbs) {
+		size_t drop = d->length - limbs;
+		memmove(d->limbs, d->limbs + drop, limbs * sizeof(uint32_t));
+		d->length = limbs;
+		d->exponent += (long)drop;
+		normalize(d);
+	}
+}
+
+// Decimal digit of d at 10^position
+static int digit_at(const calc_decimal* d, long position) {
+	long offset = position - d->exponent * LIMB_DIGITS;
+	if (offset < 0 || (size_t)(offset / LIMB_DIGITS) >= d->length) {
+		return 0;
+	}
+	return (int)(d->limbs[offset / LIMB_DIGITS] / limb_powers[offset % LIMB_DIGITS] % 10);
+}
+
+// 10^decimal_exponent
+static void set_power_of_ten(calc_decimal* d, long decimal_exponent) {
+	calc_decimal_set_scaled(d, 1, decimal_exponent, 0);
+}
+
+// x ~= 1 / |d| to about limbs limbs, by Newton iteration x += x (1 - d x)
+static void reciprocal(calc_decimal* x, const calc_decimal* d, size_t limbs) {
+	// Start from the double reciprocal of the top two limbs
+	double top = d->limbs[d->length - 1];
+	if (d->length > 1) {
+		top = top * BASE + d->limbs[d->length - 2];
+	}
+	long scale = d->exponent + (long)d->length - (d->length > 1 ? 2 : 1);
+	double r = 1.0 / top;
+	long r_exponent = 0;
+	while (r < 1e16) {
+		r *= 10;
+		r_exponent--;
+	}
+	calc_decimal_set_scaled(x, (uint64_t)r, r_exponent - scale * LIMB_DIGITS, 0);
+	
+	calc_decimal one, t, e;
+	calc_decimal_init(&one);
+	calc_decimal_init(&t);
+	calc_decimal_init(&e);
+	calc_decimal_set_scaled(&one, 1, 0, 0);
+	
+	// Each step roughly doubles the number of correct limbs
+	size_t correct = 1;
+	while (correct < limbs) {
+		correct = correct * 2 < limbs ? correct * 2 : limbs;
+		size_t work = correct + 2;
+		
+		calc_decimal_copy(&t, d);
+		t.negative = 0;
+		keep_top_limbs(&t, work);
+		calc_decimal_mul(&t, &t, x);
+		calc_decimal_sub(&e, &one, &t);
+		calc_decimal_mul(&t, x, &e);
+		keep_top_limbs(&t, work);
+		calc_decimal_add(x, x, &t);
+		keep_top_limbs(x, work);
+	}
+	
+	calc_decimal_free(&one);
+	calc_decimal_free(&t);
+	calc_decimal_free(&e);
+}
+
+int calc_decimal_div(calc_decimal* result, const calc_decimal* a, const calc_decimal* b, long precision) {
+	if (!b->length) {
+		calc_decimal_set_zero(result);
+		return 0;
+	}
+	if (!a->length) {
+		calc_decimal_set_zero(result);
+		return 1;
+	}
+	
+	calc_decimal abs_a, abs_b, x, q, r, t, ulp;
+	calc_decimal_init(&abs_a);
+	calc_decimal_init(&abs_b);
+	calc_decimal_init(&x);
+	calc_decimal_init(&q);
+	calc_decimal_init(&r);
+	calc_decimal_init(&t);
+	calc_decimal_init(&ulp);
+	calc_decimal_copy(&abs_a, a);
+	calc_decimal_copy(&abs_b, b);
+	abs_a.negative = abs_b.negative = 0;
+	
+	// Estimate, truncated to precision digits
+	reciprocal(&x, &abs_b, (size_t)(precision / LIMB_DIGITS) + 3);
+	calc_decimal_mul(&q, &abs_a, &x);
+	round_digits(&q, precision, 0);
+	set_power_of_ten(&ulp, leading_exponent(&q) - precision + 1);
+	
+	// Fix the estimate so that 0 <= r = a - q b < b ulp
+	for (;;) {
+		calc_decimal_mul(&t, &q, &abs_b);
+		calc_decimal_sub(&r, &abs_a, &t);
+		if (r.negative) {
+			calc_decimal_sub(&q, &q, &ulp);
+			continue;
+		}
+		calc_decimal_mul(&t, &abs_b, &ulp);
+		if (calc_decimal_compare(&r, &t) >= 0) {
+			calc_decimal_add(&q, &q, &ulp);
+			continue;
+		}
+		break;
+	}
+	
+	// Round half-even on the remainder: compare 2r with b ulp
+	if (r.length) {
+		calc_decimal_add(&r, &r, &r);
+		int cmp = calc_decimal_compare(&r, &t);
+		if (cmp > 0 || (cmp == 0 && digit_at(&q, leading_exponent(&ulp)) % 2)) {
+			calc_decimal_add(&q, &q, &ulp);
+		}
+	}
+	calc_decimal_round(&q, precision);
+	q.negative = q.length ? a->negative ^ b->negative : 0;
+	calc_decimal_swap(result, &q);
+	
+	calc_decimal_free(&abs_a);
+	calc_decimal_free(&abs_b);
+	calc_decimal_free(&x);
+	calc_decimal_free(&q);
+	calc_decimal_free(&r);
+	calc_decimal_free(&t);
+	calc_decimal_free(&ulp);
+	return 1;
+}
+
+// ============================================================================
+// Engine Operation
+// ============================================================================
+
+static void operate(calc_decimal* result, const calc_decimal* lhs, char op, const calc_decimal* rhs, long precision) {
+	switch (op) {
+		case '+': calc_decimal_add(result, lhs, rhs); break;
+		case '-': calc_decimal_sub(result, lhs, rhs); break;
+		case '*': calc_decimal_mul(result, lhs, rhs); break;
+		case '/': calc_decimal_div(result, lhs, rhs, precision); return;
+		default: calc_decimal_copy(result, rhs); break;
+	}
+	calc_decimal_round(result, precision);
+}
+
+// Operations worth a trip to the result cache: a quotient is a Newton
+// reciprocal (microseconds even at 20 digits) and a product costs about
+// length^2 limb steps, while a sum costs less than hashing its operands
+#define CACHE_PRODUCT_LIMBS 64
+#define ENCODED_HEADER 17
+
+static size_t encoded_size(const calc_decimal* d) {
+	return ENCODED_HEADER + d->length * sizeof(uint32_t);
+}
+
+// Length, exponent, sign, then the limbs; returns the bytes written
+static size_t encode(unsigned char* out, const calc_decimal* d) {
+	uint64_t length = d->length;
+	int64_t exponent = d->exponent;
+	memcpy(out, &length, sizeof(length));
+	memcpy(out + 8, &exponent, sizeof(exponent));
+	out[16] = (unsigned char)d->negative;
+	if (d->length) {
+		memcpy(out + ENCODED_HEADER, d->limbs, d->length * sizeof(uint32_t));
+	}
+	return encoded_size(d);
+}
+
+static void decode(calc_decimal* d, const unsigned char* in) {
+	uint64_t length;
+	int64_t exponent;
+	memcpy(&length, in, sizeof(length));
+	memcpy(&exponent, in + 8, sizeof(exponent));
+	reserve(d, length);
+	if (length) {
+		memcpy(d->limbs, in + ENCODED_HEADER, length * sizeof(uint32_t));
+	}
+	d->length = length;
+	d->exponent = exponent;
+	d->negative = in[16];
+}
+
+// Result of the operation keyed by key, if cached
+static int cached_result(calc_decimal* result, const unsigned char* key, size_t key_length) {
+	unsigned char buffer[1024];
+	size_t length = calc_cache_lookup(key, key_length, buffer, sizeof(buffer));
+	if (length > sizeof(buffer)) {
+		unsigned char* value = malloc(length);
+		int found = value && calc_cache_lookup(key, key_length, value, length) == length;
+		if (found) {
+			decode(result, value);
+		}
+		free(value);
+		return found;
+	}
+	if (length) {
+		decode(result, buffer);
+	}
+	return length != 0;
+}
+
+static void cache_result(const unsigned char* key, size_t key_length, const calc_decimal* result) {
+	unsigned char buffer[1024];
+	unsigned char* value = encoded_size(result) <= sizeof(buffer) ? buffer : malloc(encoded_size(result));
+	if (value) {
+		calc_cache_insert(key, key_length, value, encode(value, result));
+	}
+	if (value != buffer) {
+		free(value);
+	}
+}
+
+void calc_decimal_operation(calc_decimal* result, const calc_decimal* lhs, char op,
+                            const calc_decimal* rhs, long precision) {
+	int costly = op == '/' || (op == '*' && lhs->length * rhs->length >= CACHE_PRODUCT_LIMBS);
+	if (!costly || !calc_cache_budget()) {
+		operate(result, lhs, op, rhs, precision);
+		return;
+	}
+	
+	// Key: op, precision and both operands, taken before result overwrites them
+	unsigned char buffer[1024];
+	size_t key_length = 1 + sizeof(int64_t) + encoded_size(lhs) + encoded_size(rhs);
+	unsigned char* key = key_length <= sizeof(buffer) ? buffer : malloc(key_length);
+	if (!key) {
+		operate(result, lhs, op, rhs, precision);
+		return;
+	}
+	int64_t digits = precision;
+	key[0] = (unsigned char)op;
+	memcpy(key + 1, &digits, sizeof(digits));
+	size_t lhs_length = encode(key + 1 + sizeof(digits), lhs);
+	encode(key + 1 + sizeof(digits) + lhs_length, rhs);
+	
+	if (!cached_result(result, key, key_length)) {
+		operate(result, lhs, op, rhs, precision);
+		cache_result(key, key_length, result);
+	}
+	if (key != buffer) {
+		free(key);
+	}
+}
@@ -0,0 +1,86 @@
+// Decimal Arithmetic - arbitrary-precision decimal numbers for exact results
+//
+// value = (-1)^negative * limbs * 1000000000^exponent, limbs least significant
+// first. Results are rounded half-even to a caller-chosen number of significant
+// digits, so 0.1 + 0.2 is exactly 0.3 and 1 / 3 has as many 3s as requested.
+
+#ifndef CALC_DECIMAL_H
+#define CALC_DECIMAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CALC_DECIMAL_BASE 1000000000u
+#define CALC_DECIMAL_LIMB_DIGITS 9
+
+typedef struct calc_decimal {
+	uint32_t* limbs;
+	size_t length;    // 0 for zero; otherwise the top and bottom limbs are non-zero
+	size_t capacity;
+	long exponent;    // In limbs
+	int negative;
+} calc_decimal;
+
+// Multiplication switches algorithm by the shorter operand's length in limbs:
+// schoolbook below the Karatsuba threshold, Karatsuba below the NTT threshold,
+// then a two-prime number-theoretic transform. Tunable for benchmarking.
+extern size_t calc_decimal_karatsuba_threshold;
+extern size_t calc_decimal_ntt_threshold;
+
+// ============================================================================
+// Lifetime & Conversion
+// ============================================================================
+
+void calc_decimal_init(calc_decimal* d);
+void calc_decimal_free(calc_decimal* d);
+void calc_decimal_copy(calc_decimal* dst, const calc_decimal* src);
+void calc_decimal_swap(calc_decimal* a, calc_decimal* b);
+void calc_decimal_set_zero(calc_decimal* d);
+
+// value = mantissa * 10^decimal_exponent
+void calc_decimal_set_scaled(calc_decimal* d, uint64_t mantissa, long decimal_exponent, int negative);
+
+// Parse "[-]digits[.digits][e[+-]digits]"; returns 0 on malformed input
+int calc_decimal_set_string(calc_decimal* d, const char* text);
+
+// Nearest double (via strtod of the leading 17 digits)
+double calc_decimal_to_double(const calc_decimal* d);
+
+// Shortest decimal (15 to 17 digits) that reads back as value; infinities and
+// NaN give zero and return 0
+int calc_decimal_set_double(calc_decimal* d, double value);
+
+// Write at most max_digits significant digits (0 = all), in plain notation when
+// the result stays within max_digits + 6 characters, otherwise as d.ddde±x.
+// Always terminates buffer; returns the length the full text needs.
+size_t calc_decimal_to_string(const calc_decimal* d, char* buffer, size_t size, int max_digits);
+
+int calc_decimal_is_zero(const calc_decimal* d);
+
+// Number of significant decimal digits
+long calc_decimal_digits(const calc_decimal* d);
+
+// ============================================================================
+// Arithmetic
+// ============================================================================
+
+int calc_decimal_compare(const calc_decimal* a, const calc_decimal* b);
+
+// Exact results; result may alias either operand
+void calc_decimal_add(calc_decimal* result, const calc_decimal* a, const calc_decimal* b);
+void calc_decimal_sub(calc_decimal* result, const calc_decimal* a, const calc_decimal* b);
+void calc_decimal_mul(calc_decimal* result, const calc_decimal* a, const calc_decimal* b);
+
+// Quotient correctly rounded to precision significant digits (Newton reciprocal)
+// Returns 0 and sets result to zero when b is zero
+int calc_decimal_div(calc_decimal* result, const calc_decimal* a, const calc_decimal* b, long precision);
+
+// Round half-even to precision significant digits
+void calc_decimal_round(calc_decimal* d, long precision);
+
+// perform_operation for decimals, rounded to precision digits (rhs == 0 divides to 0).
+// Quotients and long products are looked up in the result cache (calc_cache.h).
+void calc_decimal_operation(calc_decimal* result, const calc_decimal* lhs, char op,
+                            const calc_decimal* rhs, long precision);
+
+#endif
@@ -0,0 +1,1057 @@
+// Calculator Engine - platform-neutral arithmetic core
+
+#include "calc_engine.h"
+#include "calc_tape.h"
+#include "calc_history.h"
+#include "calc_latency.h"
+#include "calc_stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// Engine State
+// ============================================================================
+
+void calc_engine_init(calc_engine* engine, calc_display_fn display, void* ctx) {
+	calc_input_clear(&engine->input);
+	engine->showing_total = 0;
+	engine->display = display;
+	engine->display_ctx = ctx;
+	engine->format = NULL;
+	engine->precision = 0;
+	calc_decimal_init(&engine->decimal_value);
+	calc_decimal_init(&engine->decimal_accumulator);
+	engine->text = NULL;
+	engine->text_size = 0;
+	engine->expression_mode = 0;
+	engine->expression = NULL;
+	engine->expression_length = 0;
+	engine->expression_capacity = 0;
+	calc_expr_init(&engine->compiled);
+	engine->int_bits = 0;
+	engine->int_signed = 0;
+	engine->radix = 10;
+	engine->int_value = 0;
+	engine->int_accumulator = 0;
+	engine->rational = 0;
+	calc_rational_init(&engine->rational_value);
+	calc_rational_init(&engine->rational_accumulator);
+	calc_matrix_init(&engine->matrix_value);
+	calc_matrix_init(&engine->matrix_accumulator);
+	engine->stats = NULL;
+	engine->tape = NULL;
+	engine->history = NULL;
+}
+
+void calc_engine_free(calc_engine* engine) {
+	calc_decimal_free(&engine->decimal_value);
+	calc_decimal_free(&engine->decimal_accumulator);
+	free(engine->text);
+	engine->text = NULL;
+	engine->text_size = 0;
+	free(engine->expression);
+	engine->expression = NULL;
+	engine->expression_length = 0;
+	engine->expression_capacity = 0;
+	calc_expr_free(&engine->compiled);
+	calc_rational_free(&engine->rational_value);
+	calc_rational_free(&engine->rational_accumulator);
+	calc_matrix_free(&engine->matrix_value);
+	calc_matrix_free(&engine->matrix_accumulator);
+	if (engine->stats) {
+		calc_stats_free(engine->stats);
+		free(engine->stats);
+		engine->stats = NULL;
+	}
+}
+
+// Clear the calculator but keep its display, format, integer settings, data
+// set, recordings and the given settings
+static void reset_engine(calc_engine* engine, long precision, int expression_mode) {
+	calc_display_fn display = engine->display;
+	void* ctx = engine->display_ctx;
+	const calc_format_options* format = engine->format;
+	struct calc_tape_writer* tape = engine->tape;
+	struct calc_history* history = engine->history;
+	unsigned char int_bits = engine->int_bits;
+	unsigned char int_signed = engine->int_signed;
+	unsigned char radix = engine->radix;
+	unsigned char rational = engine->rational;
+	struct calc_stats* stats = engine->stats;
+	
+	engine->stats = NULL;
+	calc_engine_free(engine);
+	calc_engine_init(engine, display, ctx);
+	engine->format = format;
+	engine->tape = tape;
+	engine->history = history;
+	engine->precision = precision;
+	engine->expression_mode = (unsigned char)expression_mode;
+	engine->int_bits = int_bits;
+	engine->int_signed = int_signed;
+	engine->radix = radix;
+	engine->rational = rational;
+	engine->stats = stats;
+	if (display) {
+		display(ctx, "0");
+	}
+}
+
+// Append an event to the session tape, if one is attached
+static void record(calc_engine* engine, calc_tape_event event, char key, long argument) {
+	if (engine->tape) {
+		calc_tape_write(engine->tape, event, key, (int32_t)argument, engine->input.display_value);
+	}
+}
+
+static int is_matrix_operator(char key);
+static int is_matrix_function_key(char key);
+
+// Append an operation to the paper tape; decimal and rational results would
+// not recompute the same in double, so only double arithmetic on numbers is kept
+static void record_operation(calc_engine* engine, char op, double operand, double result, unsigned flags) {
+	if (engine->history && !engine->precision && !engine->rational && !is_matrix_operator(op)
+		&& !engine->matrix_value.rows && !engine->matrix_accumulator.rows) {
+		calc_history_append(engine->history, op, operand, result, flags);
+	}
+}
+
+static void record_key(calc_engine* engine, char key) {
+	if (engine->tape) {
+		calc_tape_event event = key >= '0' && key <= '9' ? CALC_TAPE_DIGIT
+			: key == '.' ? CALC_TAPE_DECIMAL_POINT
+			: key == '=' ? CALC_TAPE_EQUALS
+			: calc_key_function(key) >= 0 || is_matrix_function_key(key) ? CALC_TAPE_FUNCTION
+			: CALC_TAPE_OPERATOR;
+		record(engine, event, key, 0);
+	}
+}
+
+void calc_engine_set_precision(calc_engine* engine, long precision) {
+	reset_engine(engine, precision > 0 ? precision : 0, engine->expression_mode);
+	record(engine, CALC_TAPE_PRECISION, '\0', engine->precision);
+}
+
+void calc_engine_set_expression_mode(calc_engine* engine, int enabled) {
+	reset_engine(engine, engine->precision, enabled != 0);
+	record(engine, CALC_TAPE_INPUT_MODE, '\0', engine->expression_mode);
+}
+
+void calc_engine_set_integer_mode(calc_engine* engine, int bits, int is_signed) {
+	int valid = bits == 8 || bits == 16 || bits == 32 || bits == 64 || bits == 128;
+	engine->int_bits = (unsigned char)(valid ? bits : 0);
+	engine->int_signed = valid && is_signed;
+	reset_engine(engine, engine->precision, engine->expression_mode);
+	record(engine, CALC_TAPE_INTEGER_MODE, '\0', engine->int_signed ? -engine->int_bits : engine->int_bits);
+}
+
+// Update display with current value
+static void update_display(calc_engine* engine, double value) {
+	if (!engine->display) {
+		return;
+	}
+	calc_latency_mark(CALC_LATENCY_RENDER);
+	char buffer[CALC_FORMAT_BUFFER_SIZE];
+	calc_format_double(buffer, value, engine->format);
+	engine->display(engine->display_ctx, buffer);
+}
+
+// Update display with a decimal-mode result. Notation options do not apply;
+// significant_digits, when set, still limits the digits shown.
+static void update_display_decimal(calc_engine* engine, const calc_decimal* value) {
+	if (!engine->display) {
+		return;
+	}
+	calc_latency_mark(CALC_LATENCY_RENDER);
+	int digits = (int)engine->precision;
+	if (engine->format && engine->format->significant_digits > 0 && engine->format->significant_digits < digits) {
+		digits = engine->format->significant_digits;
+	}
+	size_t length = calc_decimal_to_string(value, engine->text, engine->text_size, digits);
+	if (length >= engine->text_size) {
+		engine->text_size = length + 1;
+		engine->text = realloc(engine->text, engine->text_size);
+		calc_decimal_to_string(value, engine->text, engine->text_size, digits);
+	}
+	engine->display(engine->display_ctx, engine->text);
+}
+
+// Update display with a rational-mode result, as a fraction or a decimal
+static void update_display_rational(calc_engine* engine, const calc_rational* value) {
+	if (!engine->display) {
+		return;
+	}
+	calc_latency_mark(CALC_LATENCY_RENDER);
+	int as_decimal = engine->rational == CALC_RATIONAL_DECIMALS;
+	size_t length = calc_rational_to_string(value, engine->text, engine->text_size, as_decimal);
+	if (length >= engine->text_size) {
+		engine->text_size = length + 1;
+		engine->text = realloc(engine->text, engine->text_size);
+		calc_rational_to_string(value, engine->text, engine->text_size, as_decimal);
+	}
+	engine->display(engine->display_ctx, engine->text);
+}
+
+// Update display with a matrix, elided past CALC_MATRIX_DISPLAY_ELEMENTS rows
+// and columns
+static void update_display_matrix(calc_engine* engine, const calc_matrix* value) {
+	if (!engine->display) {
+		return;
+	}
+	calc_latency_mark(CALC_LATENCY_RENDER);
+	size_t length = calc_matrix_format(value, engine->text, engine->text_size, engine->format);
+	if (length >= engine->text_size) {
+		engine->text_size = length + 1;
+		engine->text = realloc(engine->text, engine->text_size);
+		calc_matrix_format(value, engine->text, engine->text_size, engine->format);
+	}
+	engine->display(engine->display_ctx, engine->text);
+}
+
+// Show the number being typed exactly as entered
+static void update_display_entry(calc_engine* engine) {
+	if (!engine->display) {
+		return;
+	}
+	calc_latency_mark(CALC_LATENCY_RENDER);
+	char buffer[CALC_ENTRY_MAX_DIGITS + 3];
+	calc_entry_format(&engine->input.entry, buffer);
+	engine->display(engine->display_ctx, buffer);
+}
+
+void calc_engine_set_rational_mode(calc_engine* engine, int mode) {
+	mode = mode == CALC_RATIONAL_FRACTIONS || mode == CALC_RATIONAL_DECIMALS ? mode : 0;
+	int was_on = engine->rational != 0;
+	engine->rational = (unsigned char)mode;
+	if ((mode != 0) != was_on) {
+		reset_engine(engine, engine->precision, engine->expression_mode);
+	} else if (mode && engine->input.new_number) {
+		int shows_accumulator = calc_input_shows_accumulator(&engine->input);
+		update_display_rational(engine, shows_accumulator ? &engine->rational_accumulator : &engine->rational_value);
+	}
+	record(engine, CALC_TAPE_RATIONAL_MODE, '\0', engine->rational);
+}
+
+int calc_engine_set_matrix(calc_engine* engine, const calc_matrix* m) {
+	if (engine->int_bits || engine->rational || engine->precision || engine->expression_mode || m->rows == 0) {
+		return 0;
+	}
+	if (!calc_matrix_copy(&engine->matrix_value, m)) {
+		return 0;
+	}
+	engine->input.display_value = 0;
+	engine->input.new_number = 1;
+	engine->input.function_result = 1;
+	engine->showing_total = 0;
+	update_display_matrix(engine, &engine->matrix_value);
+	return 1;
+}
+
+// ============================================================================
+// Digit Entry
+// ============================================================================
+
+// Powers of ten that are exact in a double
+static const double exact_powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+void calc_entry_clear(calc_entry* entry) {
+	entry->mantissa = 0;
+	entry->digits = 0;
+	entry->fraction = 0;
+	entry->has_decimal = 0;
+}
+
+int calc_entry_append(calc_entry* entry, char key) {
+	if (key == '.') {
+		// Only add one decimal point per number
+		if (entry->has_decimal) {
+			return 0;
+		}
+		entry->has_decimal = 1;
+		return 1;
+	}
+	
+	if (entry->digits == CALC_ENTRY_MAX_DIGITS) {
+		return 0;  // Buffer full, ignore further digits
+	}
+	
+	unsigned digit = (unsigned)(key - '0');
+	entry->mantissa = entry->mantissa * 10 + digit;
+	if (entry->has_decimal) {
+		entry->fraction++;
+		entry->digits++;
+	} else if (entry->mantissa != 0) {
+		entry->digits++;  // Leading integer zeros are not stored
+	}
+	return 1;
+}
+
+double calc_entry_value(const calc_entry* entry) {
+	// Both operands are exact doubles, so one division rounds correctly
+	if (entry->mantissa <= (1ULL << 53)) {
+		return (double)entry->mantissa / exact_powers_of_ten[entry->fraction];
+	}
+	
+	// Too many digits for the fast path: let strtod round the exact decimal
+	char buffer[CALC_ENTRY_MAX_DIGITS + 3];
+	calc_entry_format(entry, buffer);
+	return strtod(buffer, NULL);
+}
+
+int calc_entry_format(const calc_entry* entry, char* buffer) {
+	char digits[CALC_ENTRY_MAX_DIGITS + 1];
+	int count = 0;
+	unsigned long long mantissa = entry->mantissa;
+	
+	// Least significant digit first, padded so the integer part is at least "0"
+	do {
+		digits[count++] = (char)('0' + mantissa % 10);
+		mantissa /= 10;
+	} while (mantissa != 0 || count <= entry->fraction);
+	
+	int length = 0;
+	for (int i = count - 1; i >= entry->fraction; i--) {
+		buffer[length++] = digits[i];
+	}
+	if (entry->has_decimal) {
+		buffer[length++] = '.';
+		for (int i = entry->fraction - 1; i >= 0; i--) {
+			buffer[length++] = digits[i];
+		}
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+// ============================================================================
+// Immediate Input
+// ============================================================================
+
+void calc_input_clear(calc_input* input) {
+	input->display_value = 0.0;
+	input->accumulator = 0.0;
+	calc_entry_clear(&input->entry);
+	input->last_operator = '\0';
+	input->new_number = 1;
+	input->function_result = 0;
+}
+
+int calc_input_digit(calc_input* input, char key) {
+	if (input->new_number) {
+		// Starting a new number
+		calc_entry_clear(&input->entry);
+		input->new_number = 0;
+		input->function_result = 0;
+	}
+	return calc_entry_append(&input->entry, key);
+}
+
+int calc_input_commit(calc_input* input) {
+	if (input->new_number) {
+		return 0;
+	}
+	input->display_value = calc_entry_value(&input->entry);
+	return 1;
+}
+
+int calc_input_operand_ready(const calc_input* input) {
+	return input->last_operator != '\0' && (!input->new_number || input->function_result);
+}
+
+void calc_input_operator_done(calc_input* input, char op) {
+	input->last_operator = op;
+	input->new_number = 1;
+	input->function_result = 0;
+}
+
+void calc_input_equals_done(calc_input* input) {
+	input->accumulator = 0;
+	input->last_operator = '\0';
+	input->new_number = 1;
+	input->function_result = 0;
+}
+
+int calc_input_shows_accumulator(const calc_input* input) {
+	return input->new_number && !input->function_result && input->last_operator != '\0';
+}
+
+int calc_input_function_operand(calc_input* input) {
+	int from_accumulator = calc_input_shows_accumulator(input);
+	if (from_accumulator) {
+		input->display_value = input->accumulator;
+	}
+	input->function_result = 1;
+	return from_accumulator;
+}
+
+int calc_input_percent_of_accumulator(const calc_input* input, calc_function function) {
+	return function == CALC_PERCENT && (input->last_operator == '+' || input->last_operator == '-');
+}
+
+// Finish the number being typed so operators see its value, in every arithmetic
+static void commit_entry(calc_engine* engine) {
+	if (!calc_input_commit(&engine->input)) {
+		return;
+	}
+	if (engine->rational) {
+		calc_rational_set_scaled(&engine->rational_value, engine->input.entry.mantissa, engine->input.entry.fraction, 0);
+	} else if (engine->precision) {
+		calc_decimal_set_scaled(&engine->decimal_value, engine->input.entry.mantissa, -(long)engine->input.entry.fraction, 0);
+	}
+}
+
+static void apply_matrix_operator(calc_engine* engine, calc_matrix* result, double* result_value);
+
+// Apply the pending operator in whichever arithmetic the engine is using
+static void apply_operator(calc_engine* engine, calc_rational* rational_result, calc_decimal* result,
+                           calc_matrix* matrix_result, double* result_value) {
+	if (engine->rational) {
+		calc_rational_operation(rational_result, &engine->rational_accumulator, engine->input.last_operator,
+			&engine->rational_value);
+		*result_value = calc_rational_to_double(rational_result);
+		update_display_rational(engine, rational_result);
+	} else if (engine->precision) {
+		if (engine->input.last_operator == '^') {
+			// No exact decimal power; non-finite results give 0 like division by zero
+			calc_decimal_set_double(result, calc_pow(calc_decimal_to_double(&engine->decimal_accumulator),
+				calc_decimal_to_double(&engine->decimal_value)));
+			calc_decimal_round(result, engine->precision);
+		} else {
+			calc_decimal_operation(result, &engine->decimal_accumulator, engine->input.last_operator,
+				&engine->decimal_value, engine->precision);
+		}
+		*result_value = calc_decimal_to_double(result);
+		update_display_decimal(engine, result);
+	} else if (engine->matrix_accumulator.rows || engine->matrix_value.rows || is_matrix_operator(engine->input.last_operator)) {
+		apply_matrix_operator(engine, matrix_result, result_value);
+	} else {
+		*result_value = perform_operation(engine->input.accumulator, engine->input.last_operator, engine->input.display_value);
+		update_display(engine, *result_value);
+	}
+}
+
+// ============================================================================
+// Engine Input
+// ============================================================================
+
+// Perform arithmetic operation
+double perform_operation(double lhs, char op, double rhs) {
+	switch (op) {
+		case '+': return lhs + rhs;
+		case '-': return lhs - rhs;
+		case '*': return lhs * rhs;
+		case '/': return rhs != 0 ? lhs / rhs : 0;
+		case '^': return calc_pow(lhs, rhs);
+		case '@': return lhs * rhs;
+		case '\\': return lhs != 0 ? rhs / lhs : 0;
+		default: return rhs;
+	}
+}
+
+// Handle number button press
+void calc_handle_number(calc_engine* engine, const char* digit_str) {
+	if (engine->input.new_number) {
+		calc_matrix_resize(&engine->matrix_value, 0, 0);
+	}
+	if (calc_input_digit(&engine->input, digit_str[0])) {
+		update_display_entry(engine);
+	}
+	record_key(engine, digit_str[0]);
+}
+
+// Handle operator button press
+void calc_handle_operator(calc_engine* engine, char op) {
+	commit_entry(engine);
+	
+	// If we have a pending operator and an operand for it, execute it first
+	if (calc_input_operand_ready(&engine->input)) {
+		apply_operator(engine, &engine->rational_accumulator, &engine->decimal_accumulator, &engine->matrix_accumulator,
+			&engine->input.accumulator);
+		record_operation(engine, engine->input.last_operator, engine->input.display_value, engine->input.accumulator, 0);
+	} else if (!calc_input_shows_accumulator(&engine->input)) {
+		// Otherwise the operator replaces the one just typed and the accumulator stays
+		if (engine->input.last_operator == '\0') {
+			// A chain starts, from the last total if nothing replaced it
+			int linked = engine->showing_total && engine->input.new_number && !engine->input.function_result;
+			record_operation(engine, '\0', engine->input.display_value, engine->input.display_value,
+				linked ? CALC_HISTORY_LINKED : 0);
+		}
+		engine->input.accumulator = engine->input.display_value;
+		if (engine->rational) {
+			calc_rational_copy(&engine->rational_accumulator, &engine->rational_value);
+		} else if (engine->precision) {
+			calc_decimal_copy(&engine->decimal_accumulator, &engine->decimal_value);
+		} else {
+			calc_matrix_copy(&engine->matrix_accumulator, &engine->matrix_value);
+		}
+	}
+	
+	engine->showing_total = 0;
+	calc_input_operator_done(&engine->input, op);
+	record_key(engine, op);
+}
+
+// Handle equals button press
+void calc_handle_equals(calc_engine* engine) {
+	if (engine->input.last_operator != '\0') {
+		commit_entry(engine);
+		double operand = engine->input.display_value;
+		apply_operator(engine, &engine->rational_value, &engine->decimal_value, &engine->matrix_value,
+			&engine->input.display_value);
+		record_operation(engine, engine->input.last_operator, operand, engine->input.display_value, CALC_HISTORY_TOTAL);
+		engine->showing_total = 1;
+		calc_decimal_set_zero(&engine->decimal_accumulator);
+		calc_rational_set_zero(&engine->rational_accumulator);
+		calc_matrix_resize(&engine->matrix_accumulator, 0, 0);
+		calc_input_equals_done(&engine->input);
+	}
+	record_key(engine, '=');
+}
+
+// ============================================================================
+// Expression Input
+// ============================================================================
+
+static void expression_append(calc_engine* engine, const char* text, size_t length) {
+	if (engine->expression_length + length + 1 > engine->expression_capacity) {
+		engine->expression_capacity = (engine->expression_length + length + 1) * 2;
+		engine->expression = realloc(engine->expression, engine->expression_capacity);
+	}
+	memcpy(engine->expression + engine->expression_length, text, length);
+	engine->expression_length += length;
+	engine->expression[engine->expression_length] = '\0';
+}
+
+// Start the next expression from the previous result, written exactly
+static void expression_continue(calc_engine* engine) {
+	if (engine->precision) {
+		size_t length = calc_decimal_to_string(&engine->decimal_value, engine->text, engine->text_size, 0);
+		if (length >= engine->text_size) {
+			engine->text_size = length + 1;
+			engine->text = realloc(engine->text, engine->text_size);
+			calc_decimal_to_string(&engine->decimal_value, engine->text, engine->text_size, 0);
+		}
+		expression_append(engine, engine->text, length);
+	} else if (engine->input.display_value - engine->input.display_value == 0) {
+		// Finite results only; NaN and Infinity cannot be typed back
+		char buffer[CALC_FORMAT_BUFFER_SIZE];
+		int length = calc_format_double(buffer, engine->input.display_value, NULL);
+		expression_append(engine, buffer, (size_t)length);
+	}
+}
+
+// Returns 0 if the expression did not compile
+static int expression_evaluate(calc_engine* engine) {
+	if (engine->expression_length == 0) {
+		return 1;
+	}
+	
+	int compiled = calc_expr_compile(&engine->compiled, engine->expression);
+	if (!compiled) {
+		engine->input.display_value = 0;
+		calc_decimal_set_zero(&engine->decimal_value);
+		if (engine->display) {
+			calc_latency_mark(CALC_LATENCY_RENDER);
+			engine->display(engine->display_ctx, "Error");
+		}
+	} else if (engine->precision) {
+		calc_expr_eval_decimal(&engine->compiled, &engine->decimal_value, engine->precision);
+		engine->input.display_value = calc_decimal_to_double(&engine->decimal_value);
+		update_display_decimal(engine, &engine->decimal_value);
+	} else {
+		engine->input.display_value = calc_expr_eval(&engine->compiled);
+		update_display(engine, engine->input.display_value);
+	}
+	
+	engine->expression_length = 0;
+	engine->input.new_number = 1;
+	return compiled;
+}
+
+static int is_statistic_key(char key);
+
+static int expression_key(calc_engine* engine, char key) {
+	int is_number = (key >= '0' && key <= '9') || key == '.';
+	int is_operator = key == '+' || key == '-' || key == '*' || key == '/' || key == '^';
+	int function = calc_key_function(key);
+	
+	if (function >= 0) {
+		calc_handle_function(engine, (calc_function)function);
+		return 1;
+	}
+	if (is_statistic_key(key)) {
+		calc_handle_statistic(engine, key);
+		return 1;
+	}
+	if (key == '=') {
+		expression_evaluate(engine);
+		record_key(engine, key);
+		return 1;
+	}
+	if (!is_number && !is_operator && key != '(' && key != ')') {
+		return 0;
+	}
+	
+	if (engine->input.new_number) {
+		// An operator right after a result applies to that result
+		engine->expression_length = 0;
+		if (is_operator) {
+			expression_continue(engine);
+		}
+		engine->input.new_number = 0;
+	}
+	
+	if (is_number) {
+		// The entry buffer enforces one '.' and the digit limit per number
+		char last = engine->expression_length ? engine->expression[engine->expression_length - 1] : '\0';
+		if (!((last >= '0' && last <= '9') || last == '.')) {
+			calc_entry_clear(&engine->input.entry);
+		}
+		if (!calc_entry_append(&engine->input.entry, key)) {
+			record_key(engine, key);
+			return 1;
+		}
+	}
+	
+	expression_append(engine, &key, 1);
+	if (engine->display) {
+		calc_latency_mark(CALC_LATENCY_RENDER);
+		engine->display(engine->display_ctx, engine->expression);
+	}
+	record_key(engine, key);
+	return 1;
+}
+
+// ============================================================================
+// Scientific Functions
+// ============================================================================
+
+static const char function_keys[CALC_FUNCTION_COUNT] = {
+	[CALC_SQRT] = 'r', [CALC_EXP] = 'e', [CALC_LN] = 'n', [CALC_LOG10] = 'g',
+	[CALC_SIN] = 's', [CALC_COS] = 'c', [CALC_TAN] = 't',
+	[CALC_ASIN] = 'S', [CALC_ACOS] = 'C', [CALC_ATAN] = 'T',
+	[CALC_SINH] = 'h', [CALC_COSH] = 'j', [CALC_TANH] = 'k',
+	[CALC_FACTORIAL] = '!', [CALC_GAMMA] = 'G', [CALC_PERCENT] = '%',
+};
+
+char calc_function_key(calc_function function) {
+	return function_keys[function];
+}
+
+int calc_key_function(char key) {
+	for (int i = 0; i < CALC_FUNCTION_COUNT; i++) {
+		if (function_keys[i] == key) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// display_value (and decimal_value) = a function key's result, rounded to the
+// precision in decimal mode
+static void show_result(calc_engine* engine, double result) {
+	calc_matrix_resize(&engine->matrix_value, 0, 0);
+	if (engine->rational) {
+		calc_rational_set_double(&engine->rational_value, result);
+		engine->input.display_value = calc_rational_to_double(&engine->rational_value);
+		update_display_rational(engine, &engine->rational_value);
+	} else if (engine->precision) {
+		calc_decimal_set_double(&engine->decimal_value, result);
+		calc_decimal_round(&engine->decimal_value, engine->precision);
+		engine->input.display_value = calc_decimal_to_double(&engine->decimal_value);
+		update_display_decimal(engine, &engine->decimal_value);
+	} else {
+		engine->input.display_value = result;
+		update_display(engine, engine->input.display_value);
+	}
+}
+
+// display_value (and decimal_value) = function of the displayed number, or
+// matrix_value = the function of each element
+static void apply_function(calc_engine* engine, calc_function function) {
+	calc_matrix* m = &engine->matrix_value;
+	if (m->rows) {
+		calc_math_batch(function, m->data, m->data, m->rows * m->cols);
+		update_display_matrix(engine, m);
+		return;
+	}
+	int of_accumulator = calc_input_percent_of_accumulator(&engine->input, function);
+	if (engine->rational && function == CALC_PERCENT) {
+		calc_rational hundred;
+		calc_rational_init(&hundred);
+		calc_rational_set_scaled(&hundred, 100, 0, 0);
+		calc_rational_div(&engine->rational_value, &engine->rational_value, &hundred);
+		if (of_accumulator) {
+			calc_rational_mul(&engine->rational_value, &engine->rational_value, &engine->rational_accumulator);
+		}
+		calc_rational_free(&hundred);
+		engine->input.display_value = calc_rational_to_double(&engine->rational_value);
+		update_display_rational(engine, &engine->rational_value);
+		return;
+	}
+	if (engine->precision && function == CALC_PERCENT) {
+		// Exact: x / 100, times the accumulator when it is a percentage of it
+		calc_decimal hundredth;
+		calc_decimal_init(&hundredth);
+		calc_decimal_set_scaled(&hundredth, 1, -2, 0);
+		calc_decimal_mul(&engine->decimal_value, &engine->decimal_value, &hundredth);
+		if (of_accumulator) {
+			calc_decimal_mul(&engine->decimal_value, &engine->decimal_value, &engine->decimal_accumulator);
+		}
+		calc_decimal_free(&hundredth);
+		calc_decimal_round(&engine->decimal_value, engine->precision);
+		engine->input.display_value = calc_decimal_to_double(&engine->decimal_value);
+		update_display_decimal(engine, &engine->decimal_value);
+		return;
+	}
+	double result = engine->rational ? calc_rational_function(function, &engine->rational_value)
+		: calc_math_apply(function, engine->input.display_value);
+	show_result(engine, of_accumulator ? engine->input.accumulator * result : result);
+}
+
+// Make the displayed number a function key's operand: the value of the
+// expression being typed (or the last result), or the typed number. Returns 0
+// if the expression does not compile.
+static int function_operand(calc_engine* engine) {
+	if (engine->expression_mode) {
+		if (!engine->input.new_number && !expression_evaluate(engine)) {
+			return 0;
+		}
+		engine->expression_length = 0;
+	} else {
+		commit_entry(engine);
+		if (calc_input_function_operand(&engine->input)) {
+			if (engine->rational) {
+				calc_rational_copy(&engine->rational_value, &engine->rational_accumulator);
+			} else if (engine->precision) {
+				calc_decimal_copy(&engine->decimal_value, &engine->decimal_accumulator);
+			} else {
+				calc_matrix_copy(&engine->matrix_value, &engine->matrix_accumulator);
+			}
+		}
+	}
+	return 1;
+}
+
+void calc_handle_function(calc_engine* engine, calc_function function) {
+	if (function_operand(engine)) {
+		apply_function(engine, function);
+		engine->input.new_number = 1;
+	}
+	record(engine, CALC_TAPE_FUNCTION, function_keys[function], 0);
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+static int is_statistic_key(char key) {
+	return key == 'D' || key == 'M' || key == 'V' || key == 'K';
+}
+
+double calc_statistic(calc_stats* stats, char key, const double* values, size_t count) {
+	if (key == 'D' && count == 1) {
+		calc_stats_add(stats, values[0]);
+	} else if (key == 'D') {
+		calc_stats_add_array(stats, values, count);
+	} else if (key == 'K') {
+		calc_stats_clear(stats);
+	}
+	return key == 'M' ? calc_stats_mean(stats)
+		: key == 'V' ? calc_stats_stddev(stats, 1) : (double)stats->count;
+}
+
+void calc_handle_statistic(calc_engine* engine, char key) {
+	if (!function_operand(engine)) {
+		record(engine, CALC_TAPE_FUNCTION, key, 0);
+		return;
+	}
+	if (!engine->stats) {
+		engine->stats = malloc(sizeof(calc_stats));
+		if (engine->stats && !calc_stats_init(engine->stats)) {
+			free(engine->stats);
+			engine->stats = NULL;
+		}
+		if (!engine->stats) {
+			if (engine->display) {
+				calc_latency_mark(CALC_LATENCY_RENDER);
+				engine->display(engine->display_ctx, "Error");
+			}
+			record(engine, CALC_TAPE_FUNCTION, key, 0);
+			return;
+		}
+	}
+	
+	const calc_matrix* m = &engine->matrix_value;
+	show_result(engine, m->rows ? calc_statistic(engine->stats, key, m->data, m->rows * m->cols)
+		: calc_statistic(engine->stats, key, &engine->input.display_value, 1));
+	engine->input.new_number = 1;
+	record(engine, CALC_TAPE_FUNCTION, key, 0);
+}
+
+// ============================================================================
+// Matrices
+// ============================================================================
+
+static int is_matrix_operator(char key) {
+	return key == '@' || key == '\\';
+}
+
+static int is_matrix_function_key(char key) {
+	return key == '\'' || key == 'd' || key == 'i';
+}
+
+// A matrix result, or Error (and 0) when the operation failed
+static void show_matrix_result(calc_engine* engine, calc_matrix* result, double* result_value, int ok) {
+	*result_value = 0;
+	if (ok) {
+		update_display_matrix(engine, result);
+		return;
+	}
+	calc_matrix_resize(result, 0, 0);
+	if (engine->display) {
+		calc_latency_mark(CALC_LATENCY_RENDER);
+		engine->display(engine->display_ctx, "Error");
+	}
+}
+
+// apply_operator when either side is a matrix, or for '@' and '\\' between numbers
+static void apply_matrix_operator(calc_engine* engine, calc_matrix* result, double* result_value) {
+	const calc_matrix* a = &engine->matrix_accumulator;
+	const calc_matrix* b = &engine->matrix_value;
+	char op = engine->input.last_operator;
+	char scalar_op = op == '@' ? '*' : op;
+	int ok;
+	if (a->rows && b->rows) {
+		ok = op == '@' ? calc_matrix_multiply(result, a, b)
+			: op == '\\' ? calc_matrix_solve(result, a, b)
+			: calc_matrix_elementwise(result, a, op, b);
+	} else if (a->rows) {
+		// Nothing solves A X = x; every other operator applies x to each element
+		ok = op != '\\' && calc_matrix_scalar(result, a, scalar_op, engine->input.display_value, 0);
+	} else if (b->rows) {
+		ok = op == '\\' ? calc_matrix_scalar(result, b, '/', engine->input.accumulator, 0)
+			: calc_matrix_scalar(result, b, scalar_op, engine->input.accumulator, 1);
+	} else {
+		// Numbers are 1 x 1 matrices
+		calc_matrix_resize(result, 0, 0);
+		*result_value = perform_operation(engine->input.accumulator, op, engine->input.display_value);
+		update_display(engine, *result_value);
+		return;
+	}
+	show_matrix_result(engine, result, result_value, ok);
+}
+
+double calc_matrix_function_number(char key, double value) {
+	return key == 'i' ? perform_operation(1, '/', value) : value;
+}
+
+// Transpose, determinant or inverse of the displayed matrix
+static void apply_matrix_function(calc_engine* engine, char key) {
+	calc_matrix* m = &engine->matrix_value;
+	if (!m->rows) {
+		show_result(engine, calc_matrix_function_number(key, engine->input.display_value));
+		return;
+	}
+	int ok;
+	if (key == 'd') {
+		double determinant;
+		if (calc_matrix_determinant(m, &determinant)) {
+			show_result(engine, determinant);
+			return;
+		}
+		ok = 0;
+	} else {
+		ok = key == 'i' ? calc_matrix_inverse(m, m) : calc_matrix_transpose(m, m);
+	}
+	show_matrix_result(engine, m, &engine->input.display_value, ok);
+}
+
+// ============================================================================
+// Integer Mode
+// ============================================================================
+
+static void update_display_integer(calc_engine* engine, calc_int value) {
+	if (!engine->display) {
+		return;
+	}
+	calc_latency_mark(CALC_LATENCY_RENDER);
+	char buffer[CALC_INT_BUFFER_SIZE];
+	calc_int_format(buffer, value, engine->int_bits, engine->int_signed, engine->radix);
+	engine->display(engine->display_ctx, buffer);
+}
+
+void calc_engine_set_radix(calc_engine* engine, int radix) {
+	engine->radix = (unsigned char)(radix == 2 || radix == 8 || radix == 16 ? radix : 10);
+	if (engine->int_bits) {
+		int shows_accumulator = calc_input_shows_accumulator(&engine->input);
+		update_display_integer(engine, shows_accumulator ? engine->int_accumulator : engine->int_value);
+	}
+	record(engine, CALC_TAPE_RADIX, '\0', engine->radix);
+}
+
+static int is_integer_operator(char key) {
+	return key != '\0' && strchr("+-*/%&|^<>[]", key) != NULL;
+}
+
+// calc_handle_key in integer mode
+static int integer_key(calc_engine* engine, char key) {
+	int bits = engine->int_bits;
+	int is_signed = engine->int_signed;
+	int digit = calc_int_digit(key, engine->radix);
+	calc_tape_event event;
+	
+	if (digit >= 0) {
+		if (engine->input.new_number) {
+			engine->int_value = 0;
+			engine->input.new_number = 0;
+			engine->input.function_result = 0;
+		}
+		// Digits that no longer fit in the word are ignored
+		if (calc_int_append_digit(&engine->int_value, digit, engine->radix, bits, is_signed)) {
+			update_display_integer(engine, engine->int_value);
+		}
+		event = CALC_TAPE_DIGIT;
+	} else if (is_integer_operator(key)) {
+		if (calc_input_operand_ready(&engine->input)) {
+			engine->int_accumulator = calc_int_operation(engine->int_accumulator, engine->input.last_operator,
+				engine->int_value, bits, is_signed);
+			update_display_integer(engine, engine->int_accumulator);
+		} else if (!calc_input_shows_accumulator(&engine->input)) {
+			engine->int_accumulator = engine->int_value;
+		}
+		calc_input_operator_done(&engine->input, key);
+		event = CALC_TAPE_OPERATOR;
+	} else if (key == '=') {
+		if (engine->input.last_operator != '\0') {
+			engine->int_value = calc_int_operation(engine->int_accumulator, engine->input.last_operator,
+				engine->int_value, bits, is_signed);
+			engine->int_accumulator = 0;
+			calc_input_equals_done(&engine->input);
+			update_display_integer(engine, engine->int_value);
+		}
+		event = CALC_TAPE_EQUALS;
+	} else if (key == '~' || key == 'P' || key == 'L' || key == 'Z') {
+		if (calc_input_function_operand(&engine->input)) {
+			engine->int_value = engine->int_accumulator;
+		}
+		calc_int value = engine->int_value;
+		engine->int_value = key == '~' ? calc_int_not(value, bits, is_signed)
+			: (calc_int)(key == 'P' ? calc_int_popcount(value, bits)
+			: key == 'L' ? calc_int_clz(value, bits) : calc_int_ctz(value, bits));
+		engine->input.new_number = 1;
+		update_display_integer(engine, engine->int_value);
+		event = CALC_TAPE_FUNCTION;
+	} else {
+		return 0;
+	}
+	
+	engine->input.display_value = calc_int_to_double(engine->int_value, is_signed);
+	engine->input.accumulator = calc_int_to_double(engine->int_accumulator, is_signed);
+	record(engine, event, key, 0);
+	return 1;
+}
+
+// ============================================================================
+// Key Dispatch
+// ============================================================================
+
+typedef void (*key_handler)(calc_engine* engine, char key);
+
+static void number_key(calc_engine* engine, char key) {
+	char digit_str[2] = {key, '\0'};
+	calc_handle_number(engine, digit_str);
+}
+
+static void operator_key(calc_engine* engine, char key) {
+	calc_handle_operator(engine, key);
+}
+
+static void equals_key(calc_engine* engine, char key) {
+	(void)key;
+	calc_handle_equals(engine);
+}
+
+static void function_key(calc_engine* engine, char key) {
+	calc_handle_function(engine, (calc_function)calc_key_function(key));
+}
+
+static void statistic_key(calc_engine* engine, char key) {
+	calc_handle_statistic(engine, key);
+}
+
+// Matrix keys do nothing in decimal or rational arithmetic
+static void matrix_operator_key(calc_engine* engine, char key) {
+	if (engine->precision || engine->rational) {
+		record_key(engine, key);
+		return;
+	}
+	calc_handle_operator(engine, key);
+}
+
+static void matrix_function_key(calc_engine* engine, char key) {
+	if (!engine->precision && !engine->rational && function_operand(engine)) {
+		apply_matrix_function(engine, key);
+		engine->input.new_number = 1;
+	}
+	record_key(engine, key);
+}
+
+// Parentheses only mean something in expression mode
+static void parenthesis_key(calc_engine* engine, char key) {
+	record_key(engine, key);
+}
+
+// What every calculator key does; CALC_KEY_NONE (0) = not a calculator key
+static const unsigned char key_kinds[128] = {
+	['0'] = CALC_KEY_DIGIT, ['1'] = CALC_KEY_DIGIT, ['2'] = CALC_KEY_DIGIT, ['3'] = CALC_KEY_DIGIT,
+	['4'] = CALC_KEY_DIGIT, ['5'] = CALC_KEY_DIGIT, ['6'] = CALC_KEY_DIGIT, ['7'] = CALC_KEY_DIGIT,
+	['8'] = CALC_KEY_DIGIT, ['9'] = CALC_KEY_DIGIT, ['.'] = CALC_KEY_DIGIT,
+	['+'] = CALC_KEY_OPERATOR, ['-'] = CALC_KEY_OPERATOR, ['*'] = CALC_KEY_OPERATOR, ['/'] = CALC_KEY_OPERATOR,
+	['^'] = CALC_KEY_OPERATOR,
+	['='] = CALC_KEY_EQUALS,
+	['('] = CALC_KEY_PARENTHESIS, [')'] = CALC_KEY_PARENTHESIS,
+	['r'] = CALC_KEY_FUNCTION, ['e'] = CALC_KEY_FUNCTION, ['n'] = CALC_KEY_FUNCTION, ['g'] = CALC_KEY_FUNCTION,
+	['s'] = CALC_KEY_FUNCTION, ['c'] = CALC_KEY_FUNCTION, ['t'] = CALC_KEY_FUNCTION,
+	['S'] = CALC_KEY_FUNCTION, ['C'] = CALC_KEY_FUNCTION, ['T'] = CALC_KEY_FUNCTION,
+	['h'] = CALC_KEY_FUNCTION, ['j'] = CALC_KEY_FUNCTION, ['k'] = CALC_KEY_FUNCTION,
+	['!'] = CALC_KEY_FUNCTION, ['G'] = CALC_KEY_FUNCTION, ['%'] = CALC_KEY_FUNCTION,
+	['D'] = CALC_KEY_STATISTIC, ['M'] = CALC_KEY_STATISTIC, ['V'] = CALC_KEY_STATISTIC, ['K'] = CALC_KEY_STATISTIC,
+	['@'] = CALC_KEY_MATRIX_OPERATOR, ['\\'] = CALC_KEY_MATRIX_OPERATOR,
+	['\''] = CALC_KEY_MATRIX_FUNCTION, ['d'] = CALC_KEY_MATRIX_FUNCTION, ['i'] = CALC_KEY_MATRIX_FUNCTION,
+};
+
+// Immediate-mode handler for each kind of key
+static const key_handler key_handlers[CALC_KEY_KIND_COUNT] = {
+	[CALC_KEY_DIGIT] = number_key,
+	[CALC_KEY_OPERATOR] = operator_key,
+	[CALC_KEY_MATRIX_OPERATOR] = matrix_operator_key,
+	[CALC_KEY_EQUALS] = equals_key,
+	[CALC_KEY_PARENTHESIS] = parenthesis_key,
+	[CALC_KEY_FUNCTION] = function_key,
+	[CALC_KEY_MATRIX_FUNCTION] = matrix_function_key,
+	[CALC_KEY_STATISTIC] = statistic_key,
+};
+
+calc_key_kind calc_key_kind_of(char key) {
+	return (unsigned char)key < 128 ? (calc_key_kind)key_kinds[(unsigned char)key] : CALC_KEY_NONE;
+}
+
+int calc_handle_key(calc_engine* engine, char key) {
+	calc_latency_mark(CALC_LATENCY_COMPUTE);
+	if (engine->int_bits) {
+		return integer_key(engine, key);
+	}
+	key_handler handler = key_handlers[calc_key_kind_of(key)];
+	if (!handler) {
+		return 0;
+	}
+	if (engine->expression_mode && !engine->rational) {
+		return expression_key(engine, key);
+	}
+	handler(engine, key);
+	return 1;
+}
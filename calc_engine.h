@@ -0,0 +1,268 @@
+// Calculator Engine - platform-neutral arithmetic core
+// Shared by the Cocoa app (calculator.c) and the headless tools (replay.c)
+
+#ifndef CALC_ENGINE_H
+#define CALC_ENGINE_H
+
+#include "calc_decimal.h"
+#include "calc_expr.h"
+#include "calc_format.h"
+#include "calc_int.h"
+#include "calc_math.h"
+#include "calc_matrix.h"
+#include "calc_rational.h"
+
+// ============================================================================
+// Engine State
+// ============================================================================
+
+// Called whenever the engine wants the display to show new text
+typedef void (*calc_display_fn)(void* ctx, const char* text);
+
+// Longest number that can be typed (fits in the 64-bit mantissa)
+#define CALC_ENTRY_MAX_DIGITS 19
+
+// Digit entry buffer: the number being typed, kept exactly as typed.
+// It is only converted to a double when an operator or '=' needs the value.
+typedef struct calc_entry {
+	unsigned long long mantissa;  // Typed digits with the decimal point removed
+	unsigned char digits;         // Digits typed, not counting leading integer zeros
+	unsigned char fraction;       // Digits typed after the decimal point
+	unsigned char has_decimal;    // Track if current number has a decimal point
+} calc_entry;
+
+// Immediate-mode input: the displayed number, the number being typed and the
+// pending operator with its left operand. A calc_engine keeps one for every
+// mode, and a calc_session (calc_session.h) is one with its display, so both
+// step through keys with the calc_input functions below.
+typedef struct calc_input {
+	double display_value;
+	double accumulator;
+	calc_entry entry;
+	char last_operator;
+	unsigned char new_number;
+	unsigned char function_result;      // display_value is a function key's result
+} calc_input;
+
+typedef struct calc_engine {
+	calc_input input;
+	unsigned char showing_total;        // display_value is the last '=' result
+	calc_display_fn display;
+	void* display_ctx;
+	const calc_format_options* format;  // NULL = shortest round-trip
+	
+	// Decimal mode: exact arithmetic rounded to precision significant digits.
+	// display_value and accumulator still track the nearest doubles.
+	long precision;                     // 0 = double arithmetic
+	calc_decimal decimal_value;
+	calc_decimal decimal_accumulator;
+	char* text;                         // Display text for long decimal results
+	size_t text_size;
+	
+	// Expression mode: keys build an infix expression that '=' compiles and
+	// evaluates with operator precedence, instead of applying each operator
+	// immediately. The previous result starts the next expression.
+	unsigned char expression_mode;
+	char* expression;
+	size_t expression_length;
+	size_t expression_capacity;
+	calc_expr compiled;
+	
+	// Integer mode: two's-complement words shown in a chosen radix, with the
+	// bitwise operators. Takes over from the other modes while on, always with
+	// immediate input; display_value and accumulator track the values as doubles.
+	unsigned char int_bits;             // 0 = off; 8, 16, 32, 64 or 128
+	unsigned char int_signed;
+	unsigned char radix;                // 2, 8, 10 or 16
+	calc_int int_value;
+	calc_int int_accumulator;
+	
+	// Rational mode: exact fractions (calc_rational.h), shown as a fraction or
+	// as a decimal with the repeating digits in parentheses. Takes over from
+	// decimal mode while on, always with immediate input; display_value and
+	// accumulator still track the nearest doubles.
+	unsigned char rational;             // 0 = off, CALC_RATIONAL_FRACTIONS or CALC_RATIONAL_DECIMALS
+	calc_rational rational_value;
+	calc_rational rational_accumulator;
+	
+	// Statistics: the data set the statistics keys collect into, allocated by
+	// the first 'D'. Clearing the calculator or changing modes keeps it.
+	struct calc_stats* stats;
+	
+	// Matrices: a matrix loaded with calc_engine_set_matrix, or a matrix
+	// result, is the operand in place of display_value (which is then 0). Only
+	// immediate double arithmetic has them; see calc_handle_key for the keys.
+	calc_matrix matrix_value;           // rows = 0: the operand is a number
+	calc_matrix matrix_accumulator;
+	
+	struct calc_tape_writer* tape;      // Session recording (calc_tape.h); NULL = off
+	struct calc_history* history;       // Paper tape of immediate double arithmetic
+	                                    // (calc_history.h); NULL = off
+} calc_engine;
+
+// Reset an engine to "0" with the given display output (display may be NULL)
+void calc_engine_init(calc_engine* engine, calc_display_fn display, void* ctx);
+
+// Release decimal- and rational-mode storage and the data set; the engine may
+// be initialised again afterwards
+void calc_engine_free(calc_engine* engine);
+
+// Switch between double arithmetic (0) and decimal arithmetic with the given
+// number of significant digits; clears the calculator
+void calc_engine_set_precision(calc_engine* engine, long precision);
+
+// Switch between immediate (0) and expression (1) input; clears the calculator
+void calc_engine_set_expression_mode(calc_engine* engine, int enabled);
+
+// Switch to integer mode with words of bits bits (8, 16, 32, 64 or 128), or
+// back to the other modes with bits = 0; clears the calculator
+void calc_engine_set_integer_mode(calc_engine* engine, int bits, int is_signed);
+
+// Rational mode display styles
+#define CALC_RATIONAL_FRACTIONS 1
+#define CALC_RATIONAL_DECIMALS 2
+
+// Switch to exact rational arithmetic shown as fractions or as decimals, or
+// back to the other modes with 0. Turning it on or off clears the calculator;
+// changing the style only changes the display.
+void calc_engine_set_rational_mode(calc_engine* engine, int mode);
+
+// Make a copy of m the operand, as a function key's result would be. Returns
+// 0 in integer, rational, decimal or expression mode, which have no matrices.
+// Loads are not recorded on the session tape.
+int calc_engine_set_matrix(calc_engine* engine, const calc_matrix* m);
+
+// Radix integer mode shows and types numbers in: 2, 8, 10 or 16. Only the
+// display changes, so it can be switched at any time.
+void calc_engine_set_radix(calc_engine* engine, int radix);
+
+// ============================================================================
+// Digit Entry
+// ============================================================================
+
+void calc_entry_clear(calc_entry* entry);
+
+// Append '0'-'9' or '.'; returns 0 if the key was ignored (buffer full, second '.')
+int calc_entry_append(calc_entry* entry, char key);
+
+// Exact value of the typed number (correctly rounded to the nearest double)
+double calc_entry_value(const calc_entry* entry);
+
+// Write the typed number as shown on the display (e.g. "0.10", "12.")
+// buffer must hold at least CALC_ENTRY_MAX_DIGITS + 3 bytes; returns its length
+int calc_entry_format(const calc_entry* entry, char* buffer);
+
+// ============================================================================
+// Immediate Input
+// ============================================================================
+
+// The arithmetic is left to the caller: these only finish typed numbers and
+// move the flags that say which number the display shows and what the next
+// key applies to.
+
+// Clear to "0" with nothing pending
+void calc_input_clear(calc_input* input);
+
+// A digit or '.'; the first after an operator, '=' or a function key starts a
+// new number. Returns 0 if the entry buffer ignored the key.
+int calc_input_digit(calc_input* input, char key);
+
+// Make the typed number display_value; returns 0 if no number was being typed
+int calc_input_commit(calc_input* input);
+
+// Whether the pending operator has its right operand, so an operator key
+// applies it to accumulator and display_value before replacing it. If not,
+// the operator key starts a chain from display_value, or replaces an operator
+// just typed (calc_input_shows_accumulator) and keeps the accumulator.
+int calc_input_operand_ready(const calc_input* input);
+
+// After an operator key has applied or replaced the pending operator
+void calc_input_operator_done(calc_input* input, char op);
+
+// After '=' has applied the pending operator
+void calc_input_equals_done(calc_input* input);
+
+// Right after an operator the display shows the accumulator, not display_value
+int calc_input_shows_accumulator(const calc_input* input);
+
+// After calc_input_commit, make display_value a function key's operand: the
+// accumulator right after an operator (returns 1 then), else the number shown
+int calc_input_function_operand(calc_input* input);
+
+// Percent with '+' or '-' pending is that percentage of the accumulator
+int calc_input_percent_of_accumulator(const calc_input* input, calc_function function);
+
+// ============================================================================
+// Engine Input
+// ============================================================================
+
+// Perform arithmetic operation ('^' is calc_pow). The matrix operators treat
+// numbers as 1 x 1 matrices: '@' multiplies and '\\' divides rhs by lhs.
+double perform_operation(double lhs, char op, double rhs);
+
+// Immediate-mode input
+void calc_handle_number(calc_engine* engine, const char* digit_str);
+void calc_handle_operator(calc_engine* engine, char op);
+void calc_handle_equals(calc_engine* engine);
+
+// Apply a function to the displayed number, in either mode (an expression
+// being typed is evaluated first). The result is the next operand. Percent
+// with '+' or '-' pending is that percentage of the accumulator, so
+// 200 + 10 % shows 20. Decimal mode computes in double, except percent.
+void calc_handle_function(calc_engine* engine, calc_function function);
+
+// Statistics keys, in either mode: 'D' adds the displayed number to the data
+// set and shows how many values it holds, 'M' and 'V' show the data set's mean
+// and sample standard deviation, and 'K' empties it. The result is the next
+// operand. Computed in double, also in decimal mode.
+void calc_handle_statistic(calc_engine* engine, char key);
+
+struct calc_stats;
+
+// A statistics key's result: 'D' adds count values first, 'K' empties the
+// data set first
+double calc_statistic(struct calc_stats* stats, char key, const double* values, size_t count);
+
+// A matrix function key ('\'', 'd', 'i') applied to a number, a 1 x 1 matrix
+double calc_matrix_function_number(char key, double value);
+
+// Dispatch a single key ('0'-'9', '.', '+', '-', '*', '/', '^', '(', ')', '=',
+// a function key or a statistics key) in either mode; parentheses are ignored in immediate mode.
+// Integer mode has its own keys: digits of the radix ('A'-'F' for hex), '+',
+// '-', '*', '/', '%' (remainder), '&', '|', '^' (xor), '<' '>' (shifts), '['
+// ']' (rotates), '=', and '~' (not), 'P' (popcount), 'L' (leading zeros) and
+// 'Z' (trailing zeros), which apply to the displayed number.
+// Matrix keys, in immediate double arithmetic only: '@' (product) and '\\'
+// (solving A X = B) are operators, and '\'' (transpose), 'd' (determinant)
+// and 'i' (inverse) apply to the displayed matrix. The other operators and the
+// function keys work element by element, a number applying to every element.
+// With two numbers '@' multiplies, '\\' divides the right side by the left,
+// and 'i' is the reciprocal. A shape mismatch or a singular matrix shows Error.
+// Returns 0 if the key is not a calculator key
+int calc_handle_key(calc_engine* engine, char key);
+
+// What a key does outside integer mode, as calc_handle_key dispatches it
+typedef enum calc_key_kind {
+	CALC_KEY_NONE,             // Not a calculator key
+	CALC_KEY_DIGIT,            // '0'-'9' and '.'
+	CALC_KEY_OPERATOR,         // '+', '-', '*', '/', '^'
+	CALC_KEY_MATRIX_OPERATOR,  // '@', '\\'
+	CALC_KEY_EQUALS,
+	CALC_KEY_PARENTHESIS,
+	CALC_KEY_FUNCTION,         // calc_key_function's keys
+	CALC_KEY_MATRIX_FUNCTION,  // '\'', 'd', 'i'
+	CALC_KEY_STATISTIC,        // 'D', 'M', 'V', 'K'
+	CALC_KEY_KIND_COUNT
+} calc_key_kind;
+
+calc_key_kind calc_key_kind_of(char key);
+
+// Function keys: 'r' sqrt, 'e' exp, 'n' ln, 'g' log10, 's' 'c' 't' sin cos
+// tan, 'S' 'C' 'T' asin acos atan, 'h' 'j' 'k' sinh cosh tanh, '!' factorial,
+// 'G' gamma, '%' percent
+char calc_function_key(calc_function function);
+
+// The function a key applies, or -1
+int calc_key_function(char key);
+
+#endif
@@ -0,0 +1,522 @@
+// Expression Compiler - precedence-climbing parser and bytecode interpreter
+
+#include "calc_expr.h"
+#include "calc_math.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+void calc_expr_init(calc_expr* expr) {
+	memset(expr, 0, sizeof(*expr));
+}
+
+void calc_expr_free(calc_expr* expr) {
+	free(expr->code);
+	free(expr->constants);
+	free(expr->literals);
+	free(expr->stack);
+	free(expr->columns);
+	calc_expr_init(expr);
+}
+
+// Grow *data to hold at least needed elements
+static void reserve(void** data, size_t* capacity, size_t needed, size_t element_size) {
+	if (needed <= *capacity) {
+		return;
+	}
+	size_t grown = *capacity ? *capacity * 2 : 16;
+	while (grown < needed) {
+		grown *= 2;
+	}
+	*data = realloc(*data, grown * element_size);
+	*capacity = grown;
+}
+
+// ============================================================================
+// Code Generation
+// ============================================================================
+
+typedef struct {
+	calc_expr* expr;
+	const char* text;
+	const char* p;
+	size_t depth;          // Stack depth after the code emitted so far
+	size_t last_literal;   // Offset of the most recent literal's text
+} parser;
+
+static void emit(parser* ps, unsigned char op) {
+	calc_expr* expr = ps->expr;
+	reserve((void**)&expr->code, &expr->code_capacity, expr->code_length + 1, 1);
+	expr->code[expr->code_length++] = op;
+	
+	if (op == CALC_OP_PUSH || op == CALC_OP_PUSH_X) {
+		ps->depth++;
+		if (ps->depth > expr->max_depth) {
+			expr->max_depth = ps->depth;
+		}
+	} else if ((op >= CALC_OP_ADD && op <= CALC_OP_DIV) || op == CALC_OP_POW) {
+		ps->depth--;
+	}
+}
+
+// An operand byte, which emit would take for an opcode
+static void emit_operand(parser* ps, unsigned char operand) {
+	calc_expr* expr = ps->expr;
+	reserve((void**)&expr->code, &expr->code_capacity, expr->code_length + 1, 1);
+	expr->code[expr->code_length++] = operand;
+}
+
+// Push the literal text[0..length) as the next constant
+static void emit_literal(parser* ps, const char* text, size_t length) {
+	calc_expr* expr = ps->expr;
+	reserve((void**)&expr->literals, &expr->literals_capacity, expr->literals_length + length + 2, 1);
+	char* literal = expr->literals + expr->literals_length;
+	memcpy(literal, text, length);
+	literal[length] = '\0';
+	ps->last_literal = expr->literals_length;
+	expr->literals_length += length + 1;
+	
+	reserve((void**)&expr->constants, &expr->constant_capacity, expr->constant_count + 1, sizeof(double));
+	expr->constants[expr->constant_count++] = strtod(literal, NULL);
+	emit(ps, CALC_OP_PUSH);
+}
+
+// True when the code from start on is a single PUSH
+static int is_single_push(const parser* ps, size_t start) {
+	return ps->expr->code_length == start + 1 && ps->expr->code[start] == CALC_OP_PUSH;
+}
+
+// Negate the most recent constant in place, both its value and its text
+static void negate_last_literal(parser* ps) {
+	calc_expr* expr = ps->expr;
+	char* literal = expr->literals + ps->last_literal;
+	size_t length = expr->literals_length - ps->last_literal;  // Including the NUL
+	
+	expr->constants[expr->constant_count - 1] = -expr->constants[expr->constant_count - 1];
+	if (literal[0] == '-') {
+		memmove(literal, literal + 1, length - 1);
+		expr->literals_length--;
+	} else {
+		memmove(literal + 1, literal, length);
+		literal[0] = '-';
+		expr->literals_length++;
+	}
+}
+
+// ============================================================================
+// Parser
+// ============================================================================
+
+static void skip_space(parser* ps) {
+	while (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n' || *ps->p == '\r') {
+		ps->p++;
+	}
+}
+
+static int fail(parser* ps, const char* message) {
+	if (!ps->expr->error) {
+		ps->expr->error = message;
+		ps->expr->error_position = (size_t)(ps->p - ps->text);
+	}
+	return 0;
+}
+
+static int is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// digits [. digits] [e [+-] digits], with at least one mantissa digit
+static int parse_number(parser* ps) {
+	const char* start = ps->p;
+	const char* p = start;
+	int digits = 0;
+	
+	while (is_digit(*p)) {
+		p++;
+		digits++;
+	}
+	if (*p == '.') {
+		p++;
+		while (is_digit(*p)) {
+			p++;
+			digits++;
+		}
+	}
+	if (!digits) {
+		return fail(ps, "expected a number");
+	}
+	if (*p == 'e' || *p == 'E') {
+		const char* exponent = p + 1;
+		if (*exponent == '+' || *exponent == '-') {
+			exponent++;
+		}
+		if (is_digit(*exponent)) {
+			for (p = exponent; is_digit(*p); p++) {}
+		}
+	}
+	
+	emit_literal(ps, start, (size_t)(p - start));
+	ps->p = p;
+	return 1;
+}
+
+static int is_letter(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static int parse_binary(parser* ps, int min_precedence);
+static int parse_unary(parser* ps);
+
+// '(' expression ')'
+static int parse_parenthesized(parser* ps) {
+	skip_space(ps);
+	if (*ps->p != '(') {
+		return fail(ps, "expected '('");
+	}
+	ps->p++;
+	if (!parse_binary(ps, 1)) {
+		return 0;
+	}
+	skip_space(ps);
+	if (*ps->p != ')') {
+		return fail(ps, "expected ')'");
+	}
+	ps->p++;
+	return 1;
+}
+
+// x | pi | function '(' expression ')'
+static int parse_name(parser* ps) {
+	const char* start = ps->p;
+	const char* p = start;
+	while (is_letter(*p) || is_digit(*p)) {
+		p++;
+	}
+	size_t length = (size_t)(p - start);
+	
+	if (length == 1 && *start == 'x') {
+		emit(ps, CALC_OP_PUSH_X);
+		ps->p = p;
+		return 1;
+	}
+	if (length == 2 && memcmp(start, "pi", 2) == 0) {
+		static const char pi[] = "3.14159265358979323846";
+		emit_literal(ps, pi, sizeof(pi) - 1);
+		ps->p = p;
+		return 1;
+	}
+	for (int function = 0; function < CALC_FUNCTION_COUNT; function++) {
+		const char* name = calc_function_name((calc_function)function);
+		if (strlen(name) == length && memcmp(name, start, length) == 0) {
+			ps->p = p;
+			if (!parse_parenthesized(ps)) {
+				return 0;
+			}
+			emit(ps, CALC_OP_CALL);
+			emit_operand(ps, (unsigned char)function);
+			return 1;
+		}
+	}
+	return fail(ps, "unknown name");
+}
+
+// primary := number | name | '(' expression ')'
+// power   := primary ['^' unary]
+static int parse_power(parser* ps) {
+	skip_space(ps);
+	if (*ps->p == '(') {
+		if (!parse_parenthesized(ps)) {
+			return 0;
+		}
+	} else if (is_letter(*ps->p)) {
+		if (!parse_name(ps)) {
+			return 0;
+		}
+	} else if (!parse_number(ps)) {
+		return 0;
+	}
+	
+	skip_space(ps);
+	if (*ps->p != '^') {
+		return 1;
+	}
+	ps->p++;
+	// The exponent may itself be signed or a power: 2^-1, 2^3^2 = 2^9
+	if (!parse_unary(ps)) {
+		return 0;
+	}
+	emit(ps, CALC_OP_POW);
+	return 1;
+}
+
+// unary := ('-' | '+') unary | power
+static int parse_unary(parser* ps) {
+	skip_space(ps);
+	char c = *ps->p;
+	
+	if (c == '-' || c == '+') {
+		ps->p++;
+		size_t start = ps->expr->code_length;
+		if (!parse_unary(ps)) {
+			return 0;
+		}
+		if (c == '-') {
+			// Fold negated literals into the constant table
+			if (is_single_push(ps, start)) {
+				negate_last_literal(ps);
+			} else {
+				emit(ps, CALC_OP_NEG);
+			}
+		}
+		return 1;
+	}
+	
+	return parse_power(ps);
+}
+
+static int precedence(char op) {
+	switch (op) {
+		case '+': case '-': return 1;
+		case '*': case '/': return 2;
+		default: return 0;
+	}
+}
+
+// Precedence climbing: every operator here is left-associative ('^' is
+// parse_power's)
+static int parse_binary(parser* ps, int min_precedence) {
+	if (!parse_unary(ps)) {
+		return 0;
+	}
+	
+	for (;;) {
+		skip_space(ps);
+		char op = *ps->p;
+		int prec = precedence(op);
+		if (prec == 0 || prec < min_precedence) {
+			return 1;
+		}
+		ps->p++;
+		
+		size_t rhs_start = ps->expr->code_length;
+		if (!parse_binary(ps, prec + 1)) {
+			return 0;
+		}
+		
+		unsigned char opcode = op == '+' ? CALC_OP_ADD : op == '-' ? CALC_OP_SUB : op == '*' ? CALC_OP_MUL : CALC_OP_DIV;
+		if (is_single_push(ps, rhs_start)) {
+			// Constant right operand: fuse the push into the operator
+			ps->expr->code[rhs_start] = (unsigned char)(opcode - CALC_OP_ADD + CALC_OP_ADD_K);
+			ps->depth--;
+		} else {
+			emit(ps, opcode);
+		}
+	}
+}
+
+int calc_expr_compile(calc_expr* expr, const char* text) {
+	expr->code_length = 0;
+	expr->constant_count = 0;
+	expr->literals_length = 0;
+	expr->max_depth = 0;
+	expr->error = NULL;
+	expr->error_position = 0;
+	
+	parser ps = {expr, text, text, 0, 0};
+	if (!parse_binary(&ps, 1)) {
+		return 0;
+	}
+	skip_space(&ps);
+	if (*ps.p != '\0') {
+		return fail(&ps, *ps.p == ')' ? "unbalanced ')'" : "unexpected character");
+	}
+	emit(&ps, CALC_OP_RETURN);
+	
+	reserve((void**)&expr->stack, &expr->stack_capacity, expr->max_depth, sizeof(double));
+	return 1;
+}
+
+// ============================================================================
+// Interpreter
+// ============================================================================
+
+double calc_expr_eval(calc_expr* expr) {
+	return calc_expr_eval_at(expr, 0);
+}
+
+double calc_expr_eval_at(calc_expr* expr, double x) {
+	const unsigned char* pc = expr->code;
+	const double* k = expr->constants;
+	double* sp = expr->stack - 1;
+	double rhs;
+	
+	for (;;) {
+		switch (*pc++) {
+			case CALC_OP_PUSH: *++sp = *k++; break;
+			case CALC_OP_NEG: *sp = -*sp; break;
+			case CALC_OP_ADD: sp[-1] += sp[0]; sp--; break;
+			case CALC_OP_SUB: sp[-1] -= sp[0]; sp--; break;
+			case CALC_OP_MUL: sp[-1] *= sp[0]; sp--; break;
+			case CALC_OP_DIV: sp[-1] = sp[0] != 0 ? sp[-1] / sp[0] : 0; sp--; break;
+			case CALC_OP_ADD_K: *sp += *k++; break;
+			case CALC_OP_SUB_K: *sp -= *k++; break;
+			case CALC_OP_MUL_K: *sp *= *k++; break;
+			case CALC_OP_DIV_K: rhs = *k++; *sp = rhs != 0 ? *sp / rhs : 0; break;
+			case CALC_OP_POW: sp[-1] = calc_pow(sp[-1], sp[0]); sp--; break;
+			case CALC_OP_PUSH_X: *++sp = x; break;
+			case CALC_OP_CALL: *sp = calc_math_apply((calc_function)*pc++, *sp); break;
+			default: return *sp;
+		}
+	}
+}
+
+// One block of n <= CALC_EXPR_BATCH lanes. Stack entry j is the column
+// expr->columns + j * CALC_EXPR_BATCH; each instruction is a loop over it.
+static void eval_block(calc_expr* expr, double* out, const double* xs, size_t n) {
+	const unsigned char* pc = expr->code;
+	const double* k = expr->constants;
+	double* top = expr->columns - CALC_EXPR_BATCH;
+	double* below;
+	double c;
+	
+	for (;;) {
+		switch (*pc++) {
+			case CALC_OP_PUSH:
+				top += CALC_EXPR_BATCH;
+				c = *k++;
+				for (size_t i = 0; i < n; i++) {
+					top[i] = c;
+				}
+				break;
+			case CALC_OP_PUSH_X:
+				top += CALC_EXPR_BATCH;
+				memcpy(top, xs, n * sizeof(double));
+				break;
+			case CALC_OP_NEG:
+				for (size_t i = 0; i < n; i++) {
+					top[i] = -top[i];
+				}
+				break;
+			case CALC_OP_ADD:
+				below = top - CALC_EXPR_BATCH;
+				for (size_t i = 0; i < n; i++) {
+					below[i] += top[i];
+				}
+				top = below;
+				break;
+			case CALC_OP_SUB:
+				below = top - CALC_EXPR_BATCH;
+				for (size_t i = 0; i < n; i++) {
+					below[i] -= top[i];
+				}
+				top = below;
+				break;
+			case CALC_OP_MUL:
+				below = top - CALC_EXPR_BATCH;
+				for (size_t i = 0; i < n; i++) {
+					below[i] *= top[i];
+				}
+				top = below;
+				break;
+			case CALC_OP_DIV:
+				below = top - CALC_EXPR_BATCH;
+				for (size_t i = 0; i < n; i++) {
+					below[i] = top[i] != 0 ? below[i] / top[i] : 0;
+				}
+				top = below;
+				break;
+			case CALC_OP_ADD_K:
+				c = *k++;
+				for (size_t i = 0; i < n; i++) {
+					top[i] += c;
+				}
+				break;
+			case CALC_OP_SUB_K:
+				c = *k++;
+				for (size_t i = 0; i < n; i++) {
+					top[i] -= c;
+				}
+				break;
+			case CALC_OP_MUL_K:
+				c = *k++;
+				for (size_t i = 0; i < n; i++) {
+					top[i] *= c;
+				}
+				break;
+			case CALC_OP_DIV_K:
+				c = *k++;
+				for (size_t i = 0; i < n; i++) {
+					top[i] = c != 0 ? top[i] / c : 0;
+				}
+				break;
+			case CALC_OP_POW:
+				below = top - CALC_EXPR_BATCH;
+				calc_math_batch_pow(below, below, top, n);
+				top = below;
+				break;
+			case CALC_OP_CALL:
+				calc_math_batch((calc_function)*pc++, top, top, n);
+				break;
+			default:
+				memcpy(out, top, n * sizeof(double));
+				return;
+		}
+	}
+}
+
+void calc_expr_eval_batch(calc_expr* expr, double* out, const double* xs, size_t count) {
+	reserve((void**)&expr->columns, &expr->columns_capacity, expr->max_depth * CALC_EXPR_BATCH, sizeof(double));
+	for (size_t base = 0; base < count; base += CALC_EXPR_BATCH) {
+		size_t n = count - base < CALC_EXPR_BATCH ? count - base : CALC_EXPR_BATCH;
+		eval_block(expr, out + base, xs + base, n);
+	}
+}
+
+void calc_expr_eval_decimal(const calc_expr* expr, calc_decimal* result, long precision) {
+	static const char operators[] = {'+', '-', '*', '/'};
+	calc_decimal* stack = malloc((expr->max_depth + 1) * sizeof(calc_decimal));
+	for (size_t i = 0; i <= expr->max_depth; i++) {
+		calc_decimal_init(&stack[i]);
+	}
+	calc_decimal* constant = &stack[expr->max_depth];  // Scratch for the _K forms
+	calc_decimal* sp = stack - 1;
+	const char* literal = expr->literals;
+	
+	for (size_t i = 0; i < expr->code_length; i++) {
+		unsigned char op = expr->code[i];
+		if (op == CALC_OP_PUSH) {
+			calc_decimal_set_string(++sp, literal);
+			literal += strlen(literal) + 1;
+		} else if (op == CALC_OP_NEG) {
+			sp->negative = sp->length && !sp->negative;
+		} else if (op >= CALC_OP_ADD && op <= CALC_OP_DIV) {
+			calc_decimal_operation(sp - 1, sp - 1, operators[op - CALC_OP_ADD], sp, precision);
+			sp--;
+		} else if (op >= CALC_OP_ADD_K && op <= CALC_OP_DIV_K) {
+			calc_decimal_set_string(constant, literal);
+			literal += strlen(literal) + 1;
+			calc_decimal_operation(sp, sp, operators[op - CALC_OP_ADD_K], constant, precision);
+		} else if (op == CALC_OP_POW) {
+			// Computed in double; non-finite powers give 0 like division by zero
+			calc_decimal_set_double(sp - 1, calc_pow(calc_decimal_to_double(sp - 1), calc_decimal_to_double(sp)));
+			calc_decimal_round(sp - 1, precision);
+			sp--;
+		} else if (op == CALC_OP_PUSH_X) {
+			calc_decimal_set_string(++sp, "0");
+		} else if (op == CALC_OP_CALL) {
+			calc_function function = (calc_function)expr->code[++i];
+			calc_decimal_set_double(sp, calc_math_apply(function, calc_decimal_to_double(sp)));
+			calc_decimal_round(sp, precision);
+		}
+	}
+	
+	calc_decimal_swap(result, sp);
+	calc_decimal_round(result, precision);
+	for (size_t i = 0; i <= expr->max_depth; i++) {
+		calc_decimal_free(&stack[i]);
+	}
+	free(stack);
+}
@@ -0,0 +1,91 @@
+// Expression Compiler - infix expressions to stack bytecode
+//
+// Grammar: numbers (digits, optional '.', optional e±exponent), binary + - * /
+// with the usual precedence, right-associative '^' binding tighter than unary
+// minus (-2^2 = -4), parentheses and unary minus/plus. Division keeps the
+// perform_operation rule: dividing by zero gives 0. Expressions may also use
+// the variable x, the constant pi and the calc_math functions by their short
+// names, with parenthesized arguments: sin(x)^2, sqrt(1 - x^2).
+
+#ifndef CALC_EXPR_H
+#define CALC_EXPR_H
+
+#include <stddef.h>
+
+#include "calc_decimal.h"
+
+// ============================================================================
+// Bytecode
+// ============================================================================
+
+// PUSH and the _K forms take the next entry of the constant table, in program
+// order, so they need no operand bytes; CALL's one operand byte is the
+// calc_function
+typedef enum calc_opcode {
+	CALC_OP_RETURN,
+	CALC_OP_PUSH,
+	CALC_OP_NEG,
+	CALC_OP_ADD,
+	CALC_OP_SUB,
+	CALC_OP_MUL,
+	CALC_OP_DIV,
+	CALC_OP_ADD_K,     // top = top + constant
+	CALC_OP_SUB_K,
+	CALC_OP_MUL_K,
+	CALC_OP_DIV_K,
+	CALC_OP_POW,       // Never fused with its operand
+	CALC_OP_PUSH_X,    // Push the variable x
+	CALC_OP_CALL,      // top = function(top), the function in the next byte
+} calc_opcode;
+
+// Lanes per block in calc_expr_eval_batch
+#define CALC_EXPR_BATCH 256
+
+typedef struct calc_expr {
+	unsigned char* code;
+	size_t code_length;
+	size_t code_capacity;
+	double* constants;
+	size_t constant_count;
+	size_t constant_capacity;
+	char* literals;       // Constant text, NUL separated, for decimal evaluation
+	size_t literals_length;
+	size_t literals_capacity;
+	double* stack;        // Evaluation stack, at least max_depth entries
+	size_t stack_capacity;
+	size_t max_depth;
+	double* columns;      // Batch stack: max_depth columns of CALC_EXPR_BATCH
+	size_t columns_capacity;
+	const char* error;    // Set when compilation fails
+	size_t error_position;
+} calc_expr;
+
+// ============================================================================
+// Compile & Evaluate
+// ============================================================================
+
+void calc_expr_init(calc_expr* expr);
+void calc_expr_free(calc_expr* expr);
+
+// Compile text, reusing expr's buffers; returns 0 and sets error/error_position
+// on a syntax error
+int calc_expr_compile(calc_expr* expr, const char* text);
+
+// Evaluate a compiled expression with x = 0. Uses expr's own stack, so one
+// calc_expr must not be evaluated from two threads at once.
+double calc_expr_eval(calc_expr* expr);
+
+// Evaluate at the given x
+double calc_expr_eval_at(calc_expr* expr, double x);
+
+// out[i] = f(xs[i]), bit-for-bit what calc_expr_eval_at gives: each
+// instruction runs over a block of CALC_EXPR_BATCH values at a time, with
+// functions and '^' through calc_math's batch forms. out may alias xs.
+void calc_expr_eval_batch(calc_expr* expr, double* out, const double* xs, size_t count);
+
+// Evaluate with exact decimal arithmetic, each operation rounded to precision
+// significant digits as calc_decimal_operation does; x is 0, and functions,
+// like '^', are computed in double and rounded
+void calc_expr_eval_decimal(const calc_expr* expr, calc_decimal* result, long precision);
+
+#endif
@@ -0,0 +1,562 @@
+// Number Formatting - shortest round-trip double to text for the display
+//
+// Digit generation is Grisu3 (Florian Loitsch, "Printing Floating-Point Numbers
+// Quickly and Accurately with Integers", PLDI 2010), which gives the shortest
+// digits that read back as the same double, nearest to it among those, or
+// reports that it cannot be sure. For those inputs (about 0.5% of random
+// doubles, fewer of a calculator's) an exact bignum algorithm decides.
+
+#include "calc_format.h"
+#include <stdint.h>
+#include <string.h>
+
+const calc_format_options calc_format_default = {0, CALC_NOTATION_AUTO};
+
+// ============================================================================
+// DIY Floating Point
+// ============================================================================
+
+// f * 2^e with a full 64-bit significand
+typedef struct {
+	uint64_t f;
+	int e;
+} diy_fp;
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_EXPONENT_MASK 0x7FF0000000000000ULL
+
+static diy_fp diy_from_double(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int biased_exponent = (int)((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+	uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+	diy_fp result;
+	if (biased_exponent != 0) {
+		result.f = significand + DP_HIDDEN_BIT;
+		result.e = biased_exponent - DP_EXPONENT_BIAS;
+	} else {
+		// Subnormal
+		result.f = significand;
+		result.e = 1 - DP_EXPONENT_BIAS;
+	}
+	return result;
+}
+
+static diy_fp diy_sub(diy_fp a, diy_fp b) {
+	diy_fp result = {a.f - b.f, a.e};
+	return result;
+}
+
+// Product rounded to the upper 64 bits
+static diy_fp diy_mul(diy_fp x, diy_fp y) {
+	const uint64_t mask32 = 0xFFFFFFFFULL;
+	uint64_t a = x.f >> 32, b = x.f & mask32;
+	uint64_t c = y.f >> 32, d = y.f & mask32;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & mask32) + (bc & mask32);
+	tmp += 1ULL << 31;
+	diy_fp result = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+	return result;
+}
+
+static diy_fp diy_normalize(diy_fp v) {
+	int shift = __builtin_clzll(v.f);
+	v.f <<= shift;
+	v.e -= shift;
+	return v;
+}
+
+// Neighbouring halfway points m- and m+, both scaled to m+'s exponent
+static void diy_boundaries(diy_fp v, diy_fp* minus, diy_fp* plus) {
+	diy_fp pl = {(v.f << 1) + 1, v.e - 1};
+	while (!(pl.f & (DP_HIDDEN_BIT << 1))) {
+		pl.f <<= 1;
+		pl.e--;
+	}
+	pl.f <<= 64 - DP_SIGNIFICAND_SIZE - 2;
+	pl.e -= 64 - DP_SIGNIFICAND_SIZE - 2;
+	
+	diy_fp mi;
+	if (v.f == DP_HIDDEN_BIT && v.e != 1 - DP_EXPONENT_BIAS) {
+		// Lower neighbour is closer at a power of two, above the subnormals
+		mi.f = (v.f << 2) - 1;
+		mi.e = v.e - 2;
+	} else {
+		mi.f = (v.f << 1) - 1;
+		mi.e = v.e - 1;
+	}
+	mi.f <<= mi.e - pl.e;
+	mi.e = pl.e;
+	
+	*plus = pl;
+	*minus = mi;
+}
+
+// ============================================================================
+// Cached Powers of Ten
+// ============================================================================
+
+// Normalized 10^k for k = -348, -340, ..., 340
+static const uint64_t cached_powers_f[] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+	0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+	0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+	0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+	0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+	0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+	0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+	0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+	0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+	0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+	0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+	0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+	0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+	0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+	0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+	0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+	0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+	0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+	0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+	0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+	0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+	0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const int16_t cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+// Cached power c = 10^-k such that w * c has its exponent in a useful range
+static diy_fp cached_power(int e, int* k) {
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int ik = (int)dk;
+	if (dk - ik > 0.0) {
+		ik++;
+	}
+	unsigned index = (unsigned)((ik >> 3) + 1);
+	*k = -(-348 + (int)index * 8);
+	diy_fp result = {cached_powers_f[index], cached_powers_e[index]};
+	return result;
+}
+
+// ============================================================================
+// Digit Generation
+// ============================================================================
+
+static const uint64_t powers_of_ten[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static int count_decimal_digits_32(uint32_t n) {
+	int count = 1;
+	while (count < 10 && n >= powers_of_ten[count]) {
+		count++;
+	}
+	return count;
+}
+
+// Grisu3's rounding: step the last digit down while that brings it closer to
+// w, then check the digits are provably the closest within the interval.
+// Every quantity is scaled and known to within unit, so 0 means too close to
+// call and the exact algorithm decides.
+static int round_weed(char* digits, int length, uint64_t distance_too_high_w, uint64_t unsafe_interval,
+                      uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+	uint64_t small_distance = distance_too_high_w - unit;
+	uint64_t big_distance = distance_too_high_w + unit;
+	while (rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+	       (rest + ten_kappa < small_distance || small_distance - rest >= rest + ten_kappa - small_distance)) {
+		digits[length - 1]--;
+		rest += ten_kappa;
+	}
+	if (rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+	    (rest + ten_kappa < big_distance || big_distance - rest > rest + ten_kappa - big_distance)) {
+		return 0;
+	}
+	return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+// Digits of the shortest number in (low, high), the scaled boundaries, or 0 if
+// the rounding errors of the scaling leave the answer in doubt
+static int digit_gen(diy_fp low, diy_fp w, diy_fp high, char* digits, int* length, int* kappa) {
+	uint64_t unit = 1;
+	diy_fp too_low = {low.f - unit, low.e};
+	diy_fp too_high = {high.f + unit, high.e};
+	uint64_t unsafe_interval = diy_sub(too_high, too_low).f;
+	diy_fp one = {1ULL << -w.e, w.e};
+	uint32_t integrals = (uint32_t)(too_high.f >> -one.e);
+	uint64_t fractionals = too_high.f & (one.f - 1);
+	*kappa = count_decimal_digits_32(integrals);
+	*length = 0;
+	
+	// Integral part
+	while (*kappa > 0) {
+		uint32_t divisor = (uint32_t)powers_of_ten[*kappa - 1];
+		digits[(*length)++] = (char)('0' + integrals / divisor);
+		integrals %= divisor;
+		(*kappa)--;
+		uint64_t rest = ((uint64_t)integrals << -one.e) + fractionals;
+		if (rest < unsafe_interval) {
+			return round_weed(digits, *length, diy_sub(too_high, w).f, unsafe_interval, rest,
+				(uint64_t)divisor << -one.e, unit);
+		}
+	}
+	
+	// Fractional part
+	for (;;) {
+		fractionals *= 10;
+		unit *= 10;
+		unsafe_interval *= 10;
+		digits[(*length)++] = (char)('0' + (fractionals >> -one.e));
+		fractionals &= one.f - 1;
+		(*kappa)--;
+		if (fractionals < unsafe_interval) {
+			return round_weed(digits, *length, diy_sub(too_high, w).f * unit, unsafe_interval, fractionals,
+				one.f, unit);
+		}
+	}
+}
+
+// Grisu3; returns 0 for the few values it cannot settle
+static int grisu3(double value, char* digits, int* length, int* exponent) {
+	diy_fp v = diy_from_double(value);
+	diy_fp w_minus, w_plus;
+	diy_boundaries(v, &w_minus, &w_plus);
+	
+	int k;
+	diy_fp c_mk = cached_power(w_plus.e, &k);
+	diy_fp w = diy_mul(diy_normalize(v), c_mk);
+	diy_fp wp = diy_mul(w_plus, c_mk);
+	diy_fp wm = diy_mul(w_minus, c_mk);
+	
+	int kappa;
+	if (!digit_gen(wm, w, wp, digits, length, &kappa)) {
+		return 0;
+	}
+	*exponent = k + kappa;
+	return 1;
+}
+
+// ============================================================================
+// Exact Fallback
+// ============================================================================
+
+// Naturals large enough for any double times a power of ten (about 1130 bits)
+#define BIG_LIMBS 40
+
+typedef struct {
+	uint32_t limbs[BIG_LIMBS];   // Least significant first
+	int length;                  // No zero limbs on top
+} big_natural;
+
+static void big_set(big_natural* b, uint64_t value) {
+	b->length = 0;
+	for (; value; value >>= 32) {
+		b->limbs[b->length++] = (uint32_t)value;
+	}
+}
+
+static void big_mul_small(big_natural* b, uint32_t m) {
+	uint64_t carry = 0;
+	for (int i = 0; i < b->length; i++) {
+		carry += (uint64_t)b->limbs[i] * m;
+		b->limbs[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	if (carry) {
+		b->limbs[b->length++] = (uint32_t)carry;
+	}
+}
+
+static void big_mul_pow2(big_natural* b, int n) {
+	for (; n >= 31; n -= 31) {
+		big_mul_small(b, 1u << 31);
+	}
+	if (n) {
+		big_mul_small(b, 1u << n);
+	}
+}
+
+static void big_mul_pow10(big_natural* b, int n) {
+	for (; n >= 9; n -= 9) {
+		big_mul_small(b, 1000000000u);
+	}
+	if (n) {
+		big_mul_small(b, (uint32_t)powers_of_ten[n]);
+	}
+}
+
+static int big_compare(const big_natural* a, const big_natural* b) {
+	if (a->length != b->length) {
+		return a->length < b->length ? -1 : 1;
+	}
+	for (int i = a->length - 1; i >= 0; i--) {
+		if (a->limbs[i] != b->limbs[i]) {
+			return a->limbs[i] < b->limbs[i] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+static void big_add(big_natural* r, const big_natural* a, const big_natural* b) {
+	int length = a->length > b->length ? a->length : b->length;
+	uint64_t carry = 0;
+	for (int i = 0; i < length; i++) {
+		carry += (uint64_t)(i < a->length ? a->limbs[i] : 0) + (i < b->length ? b->limbs[i] : 0);
+		r->limbs[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	r->length = length;
+	if (carry) {
+		r->limbs[r->length++] = (uint32_t)carry;
+	}
+}
+
+// a -= b, for a >= b
+static void big_sub(big_natural* a, const big_natural* b) {
+	uint64_t borrow = 0;
+	for (int i = 0; i < a->length; i++) {
+		uint64_t x = (uint64_t)a->limbs[i] - (i < b->length ? b->limbs[i] : 0) - borrow;
+		a->limbs[i] = (uint32_t)x;
+		borrow = x >> 63;
+	}
+	while (a->length && a->limbs[a->length - 1] == 0) {
+		a->length--;
+	}
+}
+
+// Burger and Dybvig's free-format algorithm ("Printing Floating-Point Numbers
+// Quickly and Accurately", PLDI 1996) on exact naturals: the value is r / s and
+// its rounding interval reaches m_minus / s below and m_plus / s above, ends
+// included when the significand is even, as round-half-even reading allows
+static int exact_shortest(double value, char* digits, int* exponent) {
+	diy_fp v = diy_from_double(value);
+	int closer = v.f == DP_HIDDEN_BIT && v.e != 1 - DP_EXPONENT_BIAS;
+	int inclusive = (v.f & 1) == 0;
+	big_natural r, s, m_plus, m_minus, high;
+	big_set(&r, v.f << (closer ? 2 : 1));
+	big_set(&s, closer ? 4 : 2);
+	big_set(&m_plus, closer ? 2 : 1);
+	big_set(&m_minus, 1);
+	if (v.e >= 0) {
+		big_mul_pow2(&r, v.e);
+		big_mul_pow2(&m_plus, v.e);
+		big_mul_pow2(&m_minus, v.e);
+	} else {
+		big_mul_pow2(&s, -v.e);
+	}
+	
+	// Scale by 10^-k for a k at most the right one, then find the smallest k
+	// with the upper end below 10^k
+	int top = 63 - __builtin_clzll(v.f) + v.e;
+	double estimate = top * 0.30102999566398114;
+	int k = (int)estimate;
+	if (k > estimate) {
+		k--;
+	}
+	if (k >= 0) {
+		big_mul_pow10(&s, k);
+	} else {
+		big_mul_pow10(&r, -k);
+		big_mul_pow10(&m_plus, -k);
+		big_mul_pow10(&m_minus, -k);
+	}
+	for (;;) {
+		big_add(&high, &r, &m_plus);
+		int c = big_compare(&high, &s);
+		if (c < 0 || (c == 0 && !inclusive)) {
+			break;
+		}
+		big_mul_small(&s, 10);
+		k++;
+	}
+	
+	int length = 0;
+	for (;;) {
+		big_mul_small(&r, 10);
+		big_mul_small(&m_plus, 10);
+		big_mul_small(&m_minus, 10);
+		int d = 0;
+		while (big_compare(&r, &s) >= 0) {
+			big_sub(&r, &s);
+			d++;
+		}
+		big_add(&high, &r, &m_plus);
+		int low_end = big_compare(&r, &m_minus);
+		int high_end = big_compare(&high, &s);
+		int round_down = inclusive ? low_end <= 0 : low_end < 0;
+		int round_up = inclusive ? high_end >= 0 : high_end > 0;
+		if (!round_down && !round_up) {
+			digits[length++] = (char)('0' + d);
+			continue;
+		}
+		if (round_down && round_up) {
+			// Both in range: the nearer, ties to even
+			big_natural twice = r;
+			big_mul_small(&twice, 2);
+			int c = big_compare(&twice, &s);
+			round_up = c > 0 || (c == 0 && (d & 1));
+		}
+		digits[length++] = (char)('0' + d + round_up);
+		break;
+	}
+	*exponent = k - length;
+	return length;
+}
+
+int calc_shortest_digits(double value, char* digits, int* exponent) {
+	int length;
+	if (grisu3(value, digits, &length, exponent)) {
+		return length;
+	}
+	return exact_shortest(value, digits, exponent);
+}
+
+// ============================================================================
+// Text Layout
+// ============================================================================
+
+// Round a digit string to count digits; returns the new length and may bump exponent
+static int round_digits(char* digits, int length, int count, int* exponent) {
+	if (count <= 0 || length <= count) {
+		return length;
+	}
+	int round_up = digits[count] >= '5';
+	*exponent += length - count;
+	length = count;
+	if (round_up) {
+		int i = length - 1;
+		while (i >= 0 && digits[i] == '9') {
+			i--;
+		}
+		if (i < 0) {
+			// 999 -> 1000
+			digits[0] = '1';
+			*exponent += length;
+			return 1;
+		}
+		digits[i]++;
+		// 1299 -> 13, with the dropped zeros moved into the exponent
+		*exponent += count - (i + 1);
+		length = i + 1;
+	}
+	return length;
+}
+
+static int write_exponent(char* out, int exponent) {
+	int length = 0;
+	out[length++] = 'e';
+	if (exponent < 0) {
+		out[length++] = '-';
+		exponent = -exponent;
+	}
+	if (exponent >= 100) {
+		out[length++] = (char)('0' + exponent / 100);
+		exponent %= 100;
+		out[length++] = (char)('0' + exponent / 10);
+	} else if (exponent >= 10) {
+		out[length++] = (char)('0' + exponent / 10);
+	}
+	out[length++] = (char)('0' + exponent % 10);
+	return length;
+}
+
+// digits as d.ddd, with int_digits digits before the point (padding with zeros)
+static int write_mantissa(char* out, const char* digits, int length, int int_digits) {
+	int n = 0;
+	for (int i = 0; i < int_digits; i++) {
+		out[n++] = i < length ? digits[i] : '0';
+	}
+	if (length > int_digits) {
+		out[n++] = '.';
+		for (int i = int_digits; i < length; i++) {
+			out[n++] = digits[i];
+		}
+	}
+	return n;
+}
+
+int calc_format_double(char* buffer, double value, const calc_format_options* options) {
+	if (!options) {
+		options = &calc_format_default;
+	}
+	
+	int n = 0;
+	if (value != value) {
+		memcpy(buffer, "NaN", 4);
+		return 3;
+	}
+	if (__builtin_signbit(value)) {
+		buffer[n++] = '-';
+		value = -value;
+	}
+	if (value == __builtin_inf()) {
+		memcpy(buffer + n, "Infinity", 9);
+		return n + 8;
+	}
+	if (value == 0) {
+		buffer[n++] = '0';
+		buffer[n] = '\0';
+		return n;
+	}
+	
+	char digits[CALC_FORMAT_MAX_DIGITS + 1];
+	int exponent;
+	int length = calc_shortest_digits(value, digits, &exponent);
+	length = round_digits(digits, length, options->significant_digits, &exponent);
+	
+	// Drop trailing zeros
+	while (length > 1 && digits[length - 1] == '0') {
+		length--;
+		exponent++;
+	}
+	
+	// Decimal exponent of the leading digit
+	int leading = exponent + length - 1;
+	
+	if (options->notation == CALC_NOTATION_AUTO && leading >= -5 && leading < 15) {
+		if (leading < 0) {
+			// 0.000ddd
+			buffer[n++] = '0';
+			buffer[n++] = '.';
+			for (int i = 0; i < -leading - 1; i++) {
+				buffer[n++] = '0';
+			}
+			memcpy(buffer + n, digits, length);
+			n += length;
+		} else {
+			n += write_mantissa(buffer + n, digits, length, leading + 1);
+		}
+	} else {
+		int int_digits = 1;
+		if (options->notation == CALC_NOTATION_ENGINEERING) {
+			int remainder = ((leading % 3) + 3) % 3;
+			int_digits += remainder;
+			leading -= remainder;
+		}
+		n += write_mantissa(buffer + n, digits, length, int_digits);
+		n += write_exponent(buffer + n, leading);
+	}
+	buffer[n] = '\0';
+	return n;
+}
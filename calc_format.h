@@ -0,0 +1,36 @@
+// Number Formatting - shortest round-trip double to text for the display
+// Locale-free and allocation-free; used by the engine instead of snprintf
+
+#ifndef CALC_FORMAT_H
+#define CALC_FORMAT_H
+
+// Enough for "-1.2345678901234567e-308" plus terminator
+#define CALC_FORMAT_BUFFER_SIZE 32
+
+// Longest digit string produced by calc_shortest_digits
+#define CALC_FORMAT_MAX_DIGITS 17
+
+typedef enum calc_notation {
+	CALC_NOTATION_AUTO,         // Plain digits, scientific for very large/small values
+	CALC_NOTATION_SCIENTIFIC,   // d.ddde±x
+	CALC_NOTATION_ENGINEERING,  // ddd.ddde±x with the exponent a multiple of 3
+} calc_notation;
+
+typedef struct calc_format_options {
+	int significant_digits;  // 0 = shortest text that reads back as the same double
+	calc_notation notation;
+} calc_format_options;
+
+// Shortest-round-trip defaults
+extern const calc_format_options calc_format_default;
+
+// Decimal digits of a finite, positive double: the fewest that read back as
+// value, the nearest to it among those. value = digits * 10^exponent
+// digits is not terminated; returns the number of digits (at most CALC_FORMAT_MAX_DIGITS)
+int calc_shortest_digits(double value, char* digits, int* exponent);
+
+// Format value into buffer (CALC_FORMAT_BUFFER_SIZE bytes); returns the text length
+// NaN and infinities format as "NaN", "Infinity" and "-Infinity"
+int calc_format_double(char* buffer, double value, const calc_format_options* options);
+
+#endif
@@ -0,0 +1,664 @@
+// Function Graphs - sample cache, bisection refinement, rasterizer and PNG output
+
+#include "calc_graph.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Grid lines roughly this many pixels apart, at 1, 2 or 5 times a power of ten
+#define GRID_PIXELS 64
+
+// Rows beyond this distance from the view are clamped before clipping
+#define ROW_LIMIT 1e6
+
+static const uint8_t background_color[3] = {255, 255, 255};
+static const uint8_t grid_color[3] = {232, 232, 232};
+static const uint8_t axis_color[3] = {150, 150, 150};
+static const uint8_t curve_color[3] = {30, 90, 200};
+
+// ============================================================================
+// Buffers
+// ============================================================================
+
+int calc_graph_init(calc_graph* graph, int width, int height) {
+	memset(graph, 0, sizeof(*graph));
+	calc_expr_init(&graph->expr);
+	calc_jit_init(&graph->jit);
+	if (width <= 0 || height <= 0) {
+		return 0;
+	}
+	graph->width = width;
+	graph->height = height;
+	graph->pixels = malloc((size_t)width * height * 4);
+	graph->ink = calloc((size_t)width * height, 1);
+	graph->ink_top = malloc((size_t)width * sizeof(int));
+	graph->ink_bottom = malloc((size_t)width * sizeof(int));
+	graph->column_lines = calloc((size_t)width * 2, 1);
+	graph->row_lines = calloc((size_t)height, 1);
+	if (!graph->pixels || !graph->ink || !graph->ink_top || !graph->ink_bottom ||
+		!graph->column_lines || !graph->row_lines) {
+		calc_graph_free(graph);
+		return 0;
+	}
+	for (int column = 0; column < width; column++) {
+		graph->ink_top[column] = height;
+		graph->ink_bottom[column] = -1;
+	}
+	return 1;
+}
+
+void calc_graph_free(calc_graph* graph) {
+	free(graph->pixels);
+	free(graph->ink);
+	free(graph->ink_top);
+	free(graph->ink_bottom);
+	free(graph->column_lines);
+	free(graph->row_lines);
+	calc_expr_free(&graph->expr);
+	calc_jit_free(&graph->jit);
+	free(graph->samples);
+	free(graph->spare);
+	free(graph->xs);
+	free(graph->slots);
+	free(graph->intervals);
+	free(graph->next_intervals);
+	memset(graph, 0, sizeof(*graph));
+}
+
+// Room for count entries in each sample array; samples keeps its contents
+static void reserve_samples(calc_graph* graph, size_t count) {
+	if (count <= graph->sample_capacity) {
+		return;
+	}
+	size_t capacity = graph->sample_capacity ? graph->sample_capacity : 256;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	graph->samples = realloc(graph->samples, capacity * sizeof(double));
+	graph->spare = realloc(graph->spare, capacity * sizeof(double));
+	graph->xs = realloc(graph->xs, capacity * sizeof(double));
+	graph->slots = realloc(graph->slots, capacity * sizeof(size_t));
+	graph->sample_capacity = capacity;
+}
+
+// Room for count intervals in each work list; both keep their contents
+static void reserve_intervals(calc_graph* graph, size_t count) {
+	if (count <= graph->interval_capacity) {
+		return;
+	}
+	size_t capacity = graph->interval_capacity ? graph->interval_capacity : 256;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	graph->intervals = realloc(graph->intervals, capacity * sizeof(calc_graph_interval));
+	graph->next_intervals = realloc(graph->next_intervals, capacity * sizeof(calc_graph_interval));
+	graph->interval_capacity = capacity;
+}
+
+int calc_graph_set_function(calc_graph* graph, const char* text) {
+	calc_expr expr;
+	calc_expr_init(&expr);
+	if (!calc_expr_compile(&expr, text)) {
+		graph->error = expr.error;
+		graph->error_position = expr.error_position;
+		calc_expr_free(&expr);
+		return 0;
+	}
+	
+	calc_expr_free(&graph->expr);
+	graph->expr = expr;
+	calc_jit_compile(&graph->jit, &graph->expr);
+	graph->has_function = 1;
+	graph->error = NULL;
+	graph->error_position = 0;
+	graph->cached = 0;
+	return 1;
+}
+
+void calc_graph_clear_cache(calc_graph* graph) {
+	graph->cached = 0;
+	graph->drawn = 0;
+}
+
+// ============================================================================
+// Sampling
+// ============================================================================
+
+// Sample grid for view: spacing 2^scale between half a pixel and a pixel,
+// one sample beyond each edge
+static void sample_range(const calc_graph* graph, const calc_graph_view* view,
+                         int* scale, int64_t* first, size_t* count) {
+	int exponent;
+	frexp((view->x_max - view->x_min) / graph->width, &exponent);
+	*scale = exponent - 1;
+	double lo = floor(ldexp(view->x_min, -*scale)) - 1;
+	double hi = ceil(ldexp(view->x_max, -*scale)) + 1;
+	*first = (int64_t)lo;
+	*count = (size_t)(hi - lo) + 1;
+}
+
+// Bring the cache to samples first .. first + count - 1 at spacing 2^scale.
+// Samples the old grid shares (same spacing, or half or double it) are
+// copied; the rest are evaluated in one batch.
+static void update_samples(calc_graph* graph, int scale, int64_t first, size_t count) {
+	reserve_samples(graph, count);
+	int64_t old_first = graph->first;
+	int64_t old_end = old_first + (int64_t)graph->sample_count;
+	int shift = graph->cached ? scale - graph->scale : 2;
+	size_t missing = 0;
+	
+	for (size_t i = 0; i < count; i++) {
+		int64_t k = first + (int64_t)i;
+		int64_t j = old_end;  // Index on the old grid; out of range if none
+		if (shift == 0) {
+			j = k;
+		} else if (shift == -1 && (k & 1) == 0) {
+			j = k / 2;
+		} else if (shift == 1) {
+			j = 2 * k;
+		}
+		if (j >= old_first && j < old_end) {
+			graph->spare[i] = graph->samples[j - old_first];
+		} else {
+			graph->xs[missing] = ldexp((double)k, scale);
+			graph->slots[missing++] = i;
+		}
+	}
+	
+	calc_jit_eval(&graph->jit, &graph->expr, graph->xs, graph->xs, missing);
+	for (size_t m = 0; m < missing; m++) {
+		graph->spare[graph->slots[m]] = graph->xs[m];
+	}
+	graph->evaluations += missing;
+	
+	double* samples = graph->samples;
+	graph->samples = graph->spare;
+	graph->spare = samples;
+	graph->scale = scale;
+	graph->first = first;
+	graph->sample_count = count;
+	graph->cached = 1;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+void calc_graph_fit_y(calc_graph* graph, calc_graph_view* view) {
+	double lo = -1;
+	double hi = 1;
+	
+	if (graph->has_function) {
+		int scale;
+		int64_t first;
+		size_t count;
+		sample_range(graph, view, &scale, &first, &count);
+		update_samples(graph, scale, first, count);
+		
+		size_t finite = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (isfinite(graph->samples[i])) {
+				graph->spare[finite++] = graph->samples[i];
+			}
+		}
+		if (finite > 0) {
+			qsort(graph->spare, finite, sizeof(double), compare_doubles);
+			size_t trim = finite * 2 / 100;
+			lo = graph->spare[trim];
+			hi = graph->spare[finite - 1 - trim];
+			double margin = (hi - lo) * 0.1;
+			lo -= margin;
+			hi += margin;
+			if (!(hi - lo > 1e-9 * fmax(1, fabs(hi)))) {
+				lo -= 1;
+				hi += 1;
+			}
+		}
+	}
+	
+	view->y_min = lo;
+	view->y_max = hi;
+}
+
+// ============================================================================
+// Rasterizer
+// ============================================================================
+
+// Pixel coordinates: pixel (c, r) is centred on (c, r), row 0 at the top
+typedef struct {
+	double x_min, y_max;
+	double x_scale, y_scale;   // Pixels per unit
+} mapping;
+
+static mapping make_mapping(const calc_graph* graph, const calc_graph_view* view) {
+	mapping m;
+	m.x_min = view->x_min;
+	m.y_max = view->y_max;
+	m.x_scale = graph->width / (view->x_max - view->x_min);
+	m.y_scale = graph->height / (view->y_max - view->y_min);
+	return m;
+}
+
+static double column_of(const mapping* m, double x) {
+	return (x - m->x_min) * m->x_scale - 0.5;
+}
+
+static double row_of(const mapping* m, double y) {
+	double row = (m->y_max - y) * m->y_scale - 0.5;
+	return row < -ROW_LIMIT ? -ROW_LIMIT : row > ROW_LIMIT ? ROW_LIMIT : row;
+}
+
+static void fill_pixel(uint8_t* pixel, const uint8_t color[3]) {
+	pixel[0] = color[0];
+	pixel[1] = color[1];
+	pixel[2] = color[2];
+	pixel[3] = 255;
+}
+
+// Spacing of about GRID_PIXELS over a range drawn on pixels pixels
+static double grid_step(double range, int pixels) {
+	double raw = range * GRID_PIXELS / pixels;
+	double decade = pow(10, floor(log10(raw)));
+	double mantissa = raw / decade;
+	return (mantissa <= 1 ? 1 : mantissa <= 2 ? 2 : mantissa <= 5 ? 5 : 10) * decade;
+}
+
+enum { NO_LINE, GRID_LINE, AXIS_LINE };
+
+static const uint8_t* line_color(int line) {
+	return line == AXIS_LINE ? axis_color : line == GRID_LINE ? grid_color : background_color;
+}
+
+// Background colour of pixel (column, row): the y axis stays on top of
+// horizontal lines, which stay on top of vertical grid lines
+static const uint8_t* background_at(const calc_graph* graph, int column, int row) {
+	int column_line = graph->column_lines[column];
+	int row_line = graph->row_lines[row];
+	if (row_line) {
+		return column_line == AXIS_LINE ? axis_color : line_color(row_line);
+	}
+	return line_color(column_line);
+}
+
+// Lines at multiples of step in [lo, hi]: mark[i] for the position position_of
+// maps each to, the axis at 0 over grid lines
+static void mark_lines(uint8_t* marks, int count, double lo, double hi, int pixels,
+                       const mapping* m, double (*position_of)(const mapping*, double)) {
+	double step = grid_step(hi - lo, pixels);
+	for (double k = ceil(lo / step); k * step <= hi; k++) {
+		long i = lround(position_of(m, k * step));
+		if (i >= 0 && i < count && marks[i] != AXIS_LINE) {
+			marks[i] = k == 0 ? AXIS_LINE : GRID_LINE;
+		}
+	}
+}
+
+// Background, grid lines and the axes where they are in view, and no ink.
+// With the y range of the last render only the columns whose line changed
+// and the pixels under the last curve are repainted; otherwise everything
+// is, the first row copied down to the rows without a horizontal line.
+static void draw_background(calc_graph* graph, const calc_graph_view* view, const mapping* m) {
+	int width = graph->width;
+	int height = graph->height;
+	size_t row_bytes = (size_t)width * 4;
+	uint8_t* lines = graph->column_lines + width;
+	memset(lines, NO_LINE, (size_t)width);
+	mark_lines(lines, width, view->x_min, view->x_max, width, m, column_of);
+	
+	int full = !graph->drawn || view->y_min != graph->drawn_y_min || view->y_max != graph->drawn_y_max;
+	if (full) {
+		memcpy(graph->column_lines, lines, (size_t)width);
+		memset(graph->row_lines, NO_LINE, (size_t)height);
+		mark_lines(graph->row_lines, height, view->y_min, view->y_max, height, m, row_of);
+		uint8_t* first_row = graph->pixels;
+		for (int column = 0; column < width; column++) {
+			fill_pixel(first_row + 4 * column, line_color(lines[column]));
+		}
+		for (int row = 1; row < height; row++) {
+			memcpy(graph->pixels + row * row_bytes, first_row, row_bytes);
+		}
+		for (int row = 0; row < height; row++) {
+			if (graph->row_lines[row]) {
+				for (int column = 0; column < width; column++) {
+					fill_pixel(graph->pixels + row * row_bytes + 4 * column, background_at(graph, column, row));
+				}
+			}
+		}
+	} else {
+		for (int column = 0; column < width; column++) {
+			if (lines[column] != graph->column_lines[column]) {
+				graph->column_lines[column] = lines[column];
+				for (int row = 0; row < height; row++) {
+					fill_pixel(graph->pixels + row * row_bytes + 4 * column, background_at(graph, column, row));
+				}
+			}
+		}
+	}
+	
+	// Take the last curve off
+	for (int column = 0; column < width; column++) {
+		for (int row = graph->ink_top[column]; row <= graph->ink_bottom[column]; row++) {
+			graph->ink[(size_t)row * width + column] = 0;
+			if (!full) {
+				fill_pixel(graph->pixels + row * row_bytes + 4 * column, background_at(graph, column, row));
+			}
+		}
+		graph->ink_top[column] = height;
+		graph->ink_bottom[column] = -1;
+	}
+	graph->drawn = 1;
+	graph->drawn_y_min = view->y_min;
+	graph->drawn_y_max = view->y_max;
+}
+
+// Coverage is kept as a maximum, so segments sharing an end do not darken it
+static void plot_ink(calc_graph* graph, long column, long row, double coverage) {
+	if (column < 0 || row < 0 || column >= graph->width || row >= graph->height) {
+		return;
+	}
+	uint8_t* ink = graph->ink + (size_t)row * graph->width + column;
+	int value = (int)(coverage * 255 + 0.5);
+	if (value > *ink) {
+		*ink = (uint8_t)value;
+		graph->ink_top[column] = row < graph->ink_top[column] ? (int)row : graph->ink_top[column];
+		graph->ink_bottom[column] = row > graph->ink_bottom[column] ? (int)row : graph->ink_bottom[column];
+	}
+}
+
+// Clip a segment to [lo_x, hi_x] x [lo_y, hi_y] (Liang-Barsky); returns 0 if
+// none of it is inside
+static int clip_segment(double* x0, double* y0, double* x1, double* y1,
+                        double lo_x, double hi_x, double lo_y, double hi_y) {
+	double dx = *x1 - *x0;
+	double dy = *y1 - *y0;
+	double p[4] = {-dx, dx, -dy, dy};
+	double q[4] = {*x0 - lo_x, hi_x - *x0, *y0 - lo_y, hi_y - *y0};
+	double t0 = 0;
+	double t1 = 1;
+	
+	for (int i = 0; i < 4; i++) {
+		if (p[i] == 0) {
+			if (q[i] < 0) {
+				return 0;
+			}
+			continue;
+		}
+		double t = q[i] / p[i];
+		if (p[i] < 0) {
+			if (t > t1) {
+				return 0;
+			}
+			if (t > t0) {
+				t0 = t;
+			}
+		} else {
+			if (t < t0) {
+				return 0;
+			}
+			if (t < t1) {
+				t1 = t;
+			}
+		}
+	}
+	
+	double x = *x0;
+	double y = *y0;
+	*x0 = x + t0 * dx;
+	*y0 = y + t0 * dy;
+	*x1 = x + t1 * dx;
+	*y1 = y + t1 * dy;
+	return 1;
+}
+
+// Anti-aliased line (Wu): one step per pixel along the major axis, coverage
+// split between the two pixels straddling the line
+static void draw_line(calc_graph* graph, double x0, double y0, double x1, double y1) {
+	if (!clip_segment(&x0, &y0, &x1, &y1, -2, graph->width + 1, -2, graph->height + 1)) {
+		return;
+	}
+	int steep = fabs(y1 - y0) > fabs(x1 - x0);
+	double t;
+	if (steep) {
+		t = x0; x0 = y0; y0 = t;
+		t = x1; x1 = y1; y1 = t;
+	}
+	if (x0 > x1) {
+		t = x0; x0 = x1; x1 = t;
+		t = y0; y0 = y1; y1 = t;
+	}
+	
+	double dx = x1 - x0;
+	double gradient = dx > 0 ? (y1 - y0) / dx : 0;
+	long last = lround(x1);
+	for (long major = lround(x0); major <= last; major++) {
+		double along = major - x0;
+		along = along < 0 ? 0 : along > dx ? dx : along;
+		double minor = y0 + gradient * along;
+		double base = floor(minor);
+		double fraction = minor - base;
+		if (steep) {
+			plot_ink(graph, (long)base, major, 1 - fraction);
+			plot_ink(graph, (long)base + 1, major, fraction);
+		} else {
+			plot_ink(graph, major, (long)base, 1 - fraction);
+			plot_ink(graph, major, (long)base + 1, fraction);
+		}
+	}
+}
+
+// ============================================================================
+// Plotting
+// ============================================================================
+
+// Draw an interval as one segment, or queue it for bisection while its ends
+// are too far apart (or one of them is outside f's domain). At the last level
+// a jump between finite ends is counted as a discontinuity.
+static void route_interval(calc_graph* graph, const mapping* m, const calc_graph_interval* interval,
+                           calc_graph_interval* queue, size_t* queued, int depth) {
+	int finite0 = isfinite(interval->y0);
+	int finite1 = isfinite(interval->y1);
+	if (!finite0 && !finite1) {
+		return;
+	}
+	
+	if (finite0 && finite1) {
+		double r0 = row_of(m, interval->y0);
+		double r1 = row_of(m, interval->y1);
+		// Entirely above or below the view
+		if ((r0 < -1 && r1 < -1) || (r0 > graph->height && r1 > graph->height)) {
+			return;
+		}
+		if (fabs(r1 - r0) <= CALC_GRAPH_REFINE_PIXELS) {
+			draw_line(graph, column_of(m, interval->x0), r0, column_of(m, interval->x1), r1);
+			return;
+		}
+	}
+	
+	if (depth < CALC_GRAPH_REFINE_DEPTH) {
+		queue[(*queued)++] = *interval;
+	} else if (finite0 && finite1) {
+		graph->breaks++;
+	}
+}
+
+static void plot_function(calc_graph* graph, const calc_graph_view* view, const mapping* m) {
+	int scale;
+	int64_t first;
+	size_t count;
+	sample_range(graph, view, &scale, &first, &count);
+	update_samples(graph, scale, first, count);
+	
+	reserve_intervals(graph, count);
+	size_t pending = 0;
+	double x1 = ldexp((double)first, scale);
+	for (size_t i = 0; i + 1 < count; i++) {
+		double x0 = x1;
+		x1 = ldexp((double)(first + (int64_t)i + 1), scale);
+		calc_graph_interval interval = {x0, graph->samples[i], x1, graph->samples[i + 1]};
+		route_interval(graph, m, &interval, graph->intervals, &pending, 0);
+	}
+	
+	// One batch of midpoints per level
+	for (int depth = 1; pending > 0; depth++) {
+		reserve_samples(graph, pending);
+		reserve_intervals(graph, 2 * pending);
+		for (size_t j = 0; j < pending; j++) {
+			graph->xs[j] = 0.5 * (graph->intervals[j].x0 + graph->intervals[j].x1);
+		}
+		calc_jit_eval(&graph->jit, &graph->expr, graph->spare, graph->xs, pending);
+		graph->evaluations += pending;
+		
+		size_t next = 0;
+		for (size_t j = 0; j < pending; j++) {
+			const calc_graph_interval* interval = &graph->intervals[j];
+			double xm = graph->xs[j];
+			double ym = graph->spare[j];
+			calc_graph_interval left = {interval->x0, interval->y0, xm, ym};
+			calc_graph_interval right = {xm, ym, interval->x1, interval->y1};
+			route_interval(graph, m, &left, graph->next_intervals, &next, depth);
+			route_interval(graph, m, &right, graph->next_intervals, &next, depth);
+		}
+		
+		calc_graph_interval* intervals = graph->intervals;
+		graph->intervals = graph->next_intervals;
+		graph->next_intervals = intervals;
+		pending = next;
+	}
+}
+
+void calc_graph_render(calc_graph* graph, const calc_graph_view* view) {
+	mapping m = make_mapping(graph, view);
+	
+	draw_background(graph, view, &m);
+	graph->breaks = 0;
+	if (graph->has_function) {
+		plot_function(graph, view, &m);
+	}
+	
+	// Blend the curve in, over the rows each column has ink in
+	for (int column = 0; column < graph->width; column++) {
+		for (int row = graph->ink_top[column]; row <= graph->ink_bottom[column]; row++) {
+			size_t i = (size_t)row * graph->width + column;
+			int ink = graph->ink[i];
+			if (ink) {
+				uint8_t* pixel = graph->pixels + 4 * i;
+				for (int c = 0; c < 3; c++) {
+					pixel[c] = (uint8_t)((pixel[c] * (255 - ink) + curve_color[c] * ink + 127) / 255);
+				}
+			}
+		}
+	}
+}
+
+// ============================================================================
+// PNG
+// ============================================================================
+
+// The image data is a zlib stream of stored (uncompressed) deflate blocks:
+// graphs are small and this needs no compressor.
+
+#define STORED_BLOCK 65535
+
+static uint32_t crc_table[256];
+static int crc_ready;
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t length) {
+	if (!crc_ready) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int bit = 0; bit < 8; bit++) {
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			crc_table[n] = c;
+		}
+		crc_ready = 1;
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++) {
+		crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void put_u32(uint8_t* p, uint32_t value) {
+	p[0] = (uint8_t)(value >> 24);
+	p[1] = (uint8_t)(value >> 16);
+	p[2] = (uint8_t)(value >> 8);
+	p[3] = (uint8_t)value;
+}
+
+static int write_chunk(FILE* file, const char* type, const uint8_t* data, size_t length) {
+	uint8_t header[8];
+	uint8_t trailer[4];
+	put_u32(header, (uint32_t)length);
+	memcpy(header + 4, type, 4);
+	uint32_t crc = crc32_update(crc32_update(0, header + 4, 4), data, length);
+	put_u32(trailer, crc);
+	return fwrite(header, 1, 8, file) == 8 && fwrite(data, 1, length, file) == length &&
+	       fwrite(trailer, 1, 4, file) == 4;
+}
+
+int calc_graph_write_png(const calc_graph* graph, const char* path) {
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	size_t row_bytes = 1 + (size_t)graph->width * 4;   // Filter byte, then RGBA
+	size_t raw_length = row_bytes * graph->height;
+	size_t blocks = (raw_length + STORED_BLOCK - 1) / STORED_BLOCK;
+	uint8_t* stream = malloc(2 + blocks * 5 + raw_length + 4);
+	if (!stream) {
+		return 0;
+	}
+	
+	// zlib header, then blocks of rows with filter type 0, then Adler-32
+	uint8_t* out = stream;
+	*out++ = 0x78;
+	*out++ = 0x01;
+	uint32_t a = 1;
+	uint32_t b = 0;
+	size_t done = 0;
+	size_t block_left = 0;
+	for (int row = 0; row < graph->height; row++) {
+		const uint8_t* source = graph->pixels + (size_t)row * graph->width * 4;
+		for (size_t i = 0; i < row_bytes; i++) {
+			if (block_left == 0) {
+				size_t length = raw_length - done < STORED_BLOCK ? raw_length - done : STORED_BLOCK;
+				*out++ = done + length == raw_length;   // BFINAL, BTYPE 00
+				*out++ = (uint8_t)length;
+				*out++ = (uint8_t)(length >> 8);
+				*out++ = (uint8_t)~length;
+				*out++ = (uint8_t)(~length >> 8);
+				block_left = length;
+			}
+			uint8_t byte = i == 0 ? 0 : source[i - 1];
+			*out++ = byte;
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+			block_left--;
+			done++;
+		}
+	}
+	put_u32(out, b << 16 | a);
+	out += 4;
+	
+	uint8_t header[13];
+	put_u32(header, (uint32_t)graph->width);
+	put_u32(header + 4, (uint32_t)graph->height);
+	header[8] = 8;    // Bits per channel
+	header[9] = 6;    // RGBA
+	header[10] = 0;   // Deflate
+	header[11] = 0;   // Adaptive filtering
+	header[12] = 0;   // No interlace
+	
+	FILE* file = fopen(path, "wb");
+	int ok = file && fwrite(signature, 1, 8, file) == 8 &&
+	         write_chunk(file, "IHDR", header, sizeof(header)) &&
+	         write_chunk(file, "IDAT", stream, (size_t)(out - stream)) &&
+	         write_chunk(file, "IEND", NULL, 0);
+	if (file && fclose(file) != 0) {
+		ok = 0;
+	}
+	free(stream);
+	return ok;
+}
@@ -0,0 +1,109 @@
+// Function Graphs - plots of f(x) rasterized into an RGBA buffer
+//
+// A calc_graph samples an expression in x (calc_expr) across a view and draws
+// it with anti-aliased lines over a grid and axes. Samples sit on a grid of
+// power-of-two spacing anchored at x = 0, one or two per pixel column, and are
+// cached between renders: a pan evaluates only the samples that scrolled into
+// view, a zoom by two reuses every other sample (or all of them), and new
+// samples are evaluated in one batch, by native code from calc_jit when the
+// expression allows it and calc_expr_eval_batch otherwise. Rendering is
+// incremental too: while the y range stays the same, a render repaints only
+// the columns whose grid lines moved and the pixels the last curve covered,
+// so a frame costs about the curve rather than the whole image.
+//
+// Between neighbouring samples whose rows differ by more than a few pixels
+// the interval is bisected, level by level with each level one batch, to
+// follow steep parts of the curve. An interval still jumping after
+// CALC_GRAPH_REFINE_DEPTH bisections is taken for a discontinuity (tan at
+// pi/2, 1/x at 0) and left open instead of drawn as a vertical line.
+
+#ifndef CALC_GRAPH_H
+#define CALC_GRAPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "calc_expr.h"
+#include "calc_jit.h"
+
+// Bisect intervals whose ends are more than this many rows apart
+#define CALC_GRAPH_REFINE_PIXELS 4.0
+#define CALC_GRAPH_REFINE_DEPTH 12
+
+typedef struct calc_graph_view {
+	double x_min, x_max;
+	double y_min, y_max;
+} calc_graph_view;
+
+typedef struct calc_graph_interval {
+	double x0, y0;
+	double x1, y1;
+} calc_graph_interval;
+
+typedef struct calc_graph {
+	int width, height;
+	uint8_t* pixels;          // RGBA, width * height * 4 bytes, top row first
+	uint8_t* ink;             // Curve coverage per pixel, 0..255
+	int* ink_top;             // Per column, the rows holding the last render's
+	int* ink_bottom;          // ink (top > bottom when there is none)
+	uint8_t* column_lines;    // Per column and per row of the last render: 0,
+	uint8_t* row_lines;       // or the grid line (1) or axis (2) drawn there.
+	                          // column_lines has width more bytes of scratch.
+	int drawn;                // pixels hold the last render
+	double drawn_y_min;       // y range of the last render, which row_lines
+	double drawn_y_max;       // depends on
+	
+	calc_expr expr;           // f(x), once a function is set
+	calc_jit jit;             // expr as native code, if it could be compiled
+	int has_function;
+	const char* error;        // From the last failed calc_graph_set_function
+	size_t error_position;
+	
+	// Sample cache: samples[i] = f((first + i) * 2^scale)
+	int cached;
+	int scale;
+	int64_t first;
+	size_t sample_count;
+	double* samples;
+	double* spare;            // Next samples while updating; scratch otherwise
+	double* xs;               // Arguments to evaluate
+	size_t* slots;            // Where each evaluated value goes
+	size_t sample_capacity;
+	
+	// Refinement work lists, one per level
+	calc_graph_interval* intervals;
+	calc_graph_interval* next_intervals;
+	size_t interval_capacity;
+	
+	uint64_t evaluations;     // f values computed so far, samples and bisections
+	size_t breaks;            // Discontinuities left open by the last render
+} calc_graph;
+
+// ============================================================================
+// Graphs
+// ============================================================================
+
+// Blank width x height graph with no function; returns 0 if out of memory
+int calc_graph_init(calc_graph* graph, int width, int height);
+void calc_graph_free(calc_graph* graph);
+
+// Compile text as f(x) and drop the cached samples. On a syntax error returns
+// 0, sets error and error_position and keeps the previous function.
+int calc_graph_set_function(calc_graph* graph, const char* text);
+
+// Forget the cached samples and the last render, so the next render
+// evaluates every sample and repaints every pixel
+void calc_graph_clear_cache(calc_graph* graph);
+
+// Set view's y range to fit the function over its x range, ignoring the
+// highest and lowest 2% of the samples so poles do not flatten the plot
+void calc_graph_fit_y(calc_graph* graph, calc_graph_view* view);
+
+// Draw the grid, axes and f over view (x_min < x_max, y_min < y_max). pixels
+// must not be changed between renders, which repaint only what moved.
+void calc_graph_render(calc_graph* graph, const calc_graph_view* view);
+
+// Write the pixels as an 8-bit RGBA PNG; returns 0 on an I/O error
+int calc_graph_write_png(const calc_graph* graph, const char* path);
+
+#endif
@@ -0,0 +1,127 @@
+// Paper Tape - ring of operations and forward recomputation after edits
+
+#include "calc_history.h"
+#include "calc_engine.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+int calc_history_init(calc_history* history, size_t capacity) {
+	size_t rounded = 1;
+	while (rounded < capacity) {
+		rounded *= 2;
+	}
+	memset(history, 0, sizeof(*history));
+	history->entries = malloc(rounded * sizeof(calc_history_entry));
+	if (!history->entries) {
+		return 0;
+	}
+	// Touch every page now, so recording never stops for a page fault
+	memset(history->entries, 0, rounded * sizeof(calc_history_entry));
+	history->capacity = rounded;
+	return 1;
+}
+
+void calc_history_free(calc_history* history) {
+	free(history->entries);
+	memset(history, 0, sizeof(*history));
+}
+
+void calc_history_clear(calc_history* history) {
+	history->head = 0;
+	history->count = 0;
+	history->base = 0;
+}
+
+void calc_history_append(calc_history* history, char op, double operand, double result, unsigned flags) {
+	if (history->count == history->capacity) {
+		// Drop the oldest; the next entry's left operand survives in base
+		history->base = history->entries[history->head].result;
+		history->head = (history->head + 1) & (history->capacity - 1);
+		history->count--;
+	}
+	calc_history_entry* entry = calc_history_at(history, history->count++);
+	entry->operand = operand;
+	entry->result = result;
+	entry->op = op;
+	entry->flags = (unsigned char)flags;
+	history->appended++;
+}
+
+// ============================================================================
+// Editing
+// ============================================================================
+
+static int same_bits(double a, double b) {
+	return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// Recompute from index on while results change and entries depend on the one
+// before; returns how many were recomputed
+static size_t recompute(calc_history* history, size_t index) {
+	double previous = index > 0 ? calc_history_at(history, index - 1)->result : history->base;
+	size_t done = 0;
+	
+	while (index < history->count) {
+		calc_history_entry* entry = calc_history_at(history, index);
+		if (done > 0 && entry->op == '\0' && !(entry->flags & CALC_HISTORY_LINKED)) {
+			break;  // A fresh chain
+		}
+		double result;
+		if (entry->op != '\0') {
+			result = perform_operation(previous, entry->op, entry->operand);
+		} else if (entry->flags & CALC_HISTORY_LINKED) {
+			result = entry->operand = previous;
+		} else {
+			result = entry->operand;
+		}
+		done++;
+		if (same_bits(result, entry->result)) {
+			break;  // Nothing after this changes
+		}
+		entry->result = result;
+		previous = result;
+		index++;
+	}
+	return done;
+}
+
+size_t calc_history_set_operand(calc_history* history, size_t index, double operand) {
+	if (index >= history->count) {
+		return 0;
+	}
+	calc_history_entry* entry = calc_history_at(history, index);
+	entry->operand = operand;
+	entry->flags &= (unsigned char)~CALC_HISTORY_LINKED;
+	return recompute(history, index);
+}
+
+size_t calc_history_set_operator(calc_history* history, size_t index, char op) {
+	if (index >= history->count) {
+		return 0;
+	}
+	calc_history_entry* entry = calc_history_at(history, index);
+	entry->op = op;
+	if (op != '\0') {
+		entry->flags &= (unsigned char)~CALC_HISTORY_LINKED;
+	}
+	return recompute(history, index);
+}
+
+void calc_history_recompute_all(calc_history* history) {
+	double previous = history->base;
+	for (size_t i = 0; i < history->count; i++) {
+		calc_history_entry* entry = calc_history_at(history, i);
+		if (entry->op != '\0') {
+			entry->result = perform_operation(previous, entry->op, entry->operand);
+		} else if (entry->flags & CALC_HISTORY_LINKED) {
+			entry->result = entry->operand = previous;
+		} else {
+			entry->result = entry->operand;
+		}
+		previous = entry->result;
+	}
+}
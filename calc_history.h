@@ -0,0 +1,68 @@
+// Paper Tape - the editable history of immediate-mode arithmetic
+//
+// Every operation the engine applies is one entry: the operator, its right
+// operand and the result. A chain starts with an entry that has no operator,
+// holding the first operand, or the previous total when the user carried on
+// from it. Editing an entry recomputes the entries after it that depend on it:
+// up to the end of the chain, or sooner, once a result comes out unchanged.
+//
+// Entries live in one ring allocated up front, so recording costs no
+// allocation; once it is full the oldest entries are dropped.
+
+#ifndef CALC_HISTORY_H
+#define CALC_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Entry flags
+#define CALC_HISTORY_LINKED 1   // A chain start carrying on from the previous result
+#define CALC_HISTORY_TOTAL 2    // The operation '=' applied
+
+typedef struct calc_history_entry {
+	double operand;           // Right operand, or the chain's first value
+	double result;
+	char op;                  // '+', '-', '*', '/', '^', or '\0' for a chain start
+	unsigned char flags;
+} calc_history_entry;
+
+typedef struct calc_history {
+	calc_history_entry* entries;   // Ring of capacity entries (a power of two)
+	size_t capacity;
+	size_t head;                   // Ring index of the oldest entry
+	size_t count;
+	double base;                   // Result of the last dropped entry
+	uint64_t appended;             // Entries ever appended, dropped ones included
+} calc_history;
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+// Empty tape holding up to capacity entries (rounded up to a power of two);
+// returns 0 if the ring cannot be allocated
+int calc_history_init(calc_history* history, size_t capacity);
+void calc_history_free(calc_history* history);
+void calc_history_clear(calc_history* history);
+
+void calc_history_append(calc_history* history, char op, double operand, double result, unsigned flags);
+
+// Entry index, 0 being the oldest kept
+static inline calc_history_entry* calc_history_at(const calc_history* history, size_t index) {
+	return &history->entries[(history->head + index) & (history->capacity - 1)];
+}
+
+// ============================================================================
+// Editing
+// ============================================================================
+
+// Replace an entry's operand (a linked chain start stops carrying on from the
+// previous result) or operator ('\0' makes it a chain start), then recompute
+// what depends on it. Return the number of entries recomputed.
+size_t calc_history_set_operand(calc_history* history, size_t index, double operand);
+size_t calc_history_set_operator(calc_history* history, size_t index, char op);
+
+// Recompute every entry from scratch (for checking edits)
+void calc_history_recompute_all(calc_history* history);
+
+#endif
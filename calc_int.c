@@ -0,0 +1,337 @@
+// Integer Arithmetic - two's-complement words for the programmer mode
+
+#include "calc_int.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef __int128 calc_sint;
+
+// ============================================================================
+// Words
+// ============================================================================
+
+static calc_int word_mask(int bits) {
+	return bits >= 128 ? ~(calc_int)0 : ((calc_int)1 << bits) - 1;
+}
+
+calc_int calc_int_wrap(calc_int value, int bits, int is_signed) {
+	if (bits >= 128) {
+		return value;
+	}
+	value &= word_mask(bits);
+	if (is_signed && (value >> (bits - 1)) != 0) {
+		value |= ~word_mask(bits);
+	}
+	return value;
+}
+
+calc_int calc_int_bits(calc_int value, int bits) {
+	return value & word_mask(bits);
+}
+
+double calc_int_to_double(calc_int value, int is_signed) {
+	return is_signed ? (double)(calc_sint)value : (double)value;
+}
+
+// ============================================================================
+// Arithmetic
+// ============================================================================
+
+// '/' or '%'; operands that fit in 64 bits avoid the 128-bit library division
+static calc_int divide(calc_int lhs, char op, calc_int rhs, int is_signed) {
+	if (rhs == 0) {
+		return 0;
+	}
+	if (!is_signed) {
+		if ((lhs | rhs) >> 64 == 0) {
+			uint64_t a = (uint64_t)lhs, b = (uint64_t)rhs;
+			return op == '/' ? a / b : a % b;
+		}
+		return op == '/' ? lhs / rhs : lhs % rhs;
+	}
+	
+	calc_sint a = (calc_sint)lhs, b = (calc_sint)rhs;
+	if (b == -1) {
+		// The one quotient that overflows (the most negative word) wraps
+		return op == '/' ? -lhs : 0;
+	}
+	if (a == (int64_t)a && b == (int64_t)b) {
+		int64_t a64 = (int64_t)a, b64 = (int64_t)b;
+		return (calc_int)(calc_sint)(op == '/' ? a64 / b64 : a64 % b64);
+	}
+	return (calc_int)(op == '/' ? a / b : a % b);
+}
+
+// Rotate the word's bits left by count (0 to bits - 1)
+static calc_int rotate_left(calc_int value, int count, int bits) {
+	calc_int word = calc_int_bits(value, bits);
+	if (count == 0) {
+		return word;
+	}
+	return (word << count | word >> (bits - count)) & word_mask(bits);
+}
+
+calc_int calc_int_operation(calc_int lhs, char op, calc_int rhs, int bits, int is_signed) {
+	calc_int result;
+	switch (op) {
+		case '+': result = lhs + rhs; break;
+		case '-': result = lhs - rhs; break;
+		case '*': result = lhs * rhs; break;
+		case '/':
+		case '%': result = divide(lhs, op, rhs, is_signed); break;
+		case '&': result = lhs & rhs; break;
+		case '|': result = lhs | rhs; break;
+		case '^': result = lhs ^ rhs; break;
+		case '<':
+			// Negative counts are huge as unsigned, so they shift everything out too
+			result = rhs >= (calc_int)bits ? 0 : lhs << (int)rhs;
+			break;
+		case '>':
+			if (rhs >= (calc_int)bits) {
+				result = is_signed && (calc_sint)lhs < 0 ? ~(calc_int)0 : 0;
+			} else {
+				result = is_signed ? (calc_int)((calc_sint)lhs >> (int)rhs) : lhs >> (int)rhs;
+			}
+			break;
+		// bits is a power of two, so the count's low bits are the count modulo bits
+		case '[': result = rotate_left(lhs, (int)(rhs & (calc_int)(bits - 1)), bits); break;
+		case ']': result = rotate_left(lhs, (int)(-rhs & (calc_int)(bits - 1)), bits); break;
+		default: return rhs;
+	}
+	return calc_int_wrap(result, bits, is_signed);
+}
+
+calc_int calc_int_not(calc_int value, int bits, int is_signed) {
+	return calc_int_wrap(~value, bits, is_signed);
+}
+
+int calc_int_popcount(calc_int value, int bits) {
+	value = calc_int_bits(value, bits);
+	return __builtin_popcountll((uint64_t)value) + __builtin_popcountll((uint64_t)(value >> 64));
+}
+
+int calc_int_clz(calc_int value, int bits) {
+	value = calc_int_bits(value, bits);
+	uint64_t high = (uint64_t)(value >> 64), low = (uint64_t)value;
+	int zeros = high ? __builtin_clzll(high) : low ? 64 + __builtin_clzll(low) : 128;
+	return zeros - (128 - bits);
+}
+
+int calc_int_ctz(calc_int value, int bits) {
+	value = calc_int_bits(value, bits);
+	uint64_t high = (uint64_t)(value >> 64), low = (uint64_t)value;
+	int zeros = low ? __builtin_ctzll(low) : high ? 64 + __builtin_ctzll(high) : 128;
+	return zeros < bits ? zeros : bits;
+}
+
+// ============================================================================
+// Radix Conversion
+// ============================================================================
+
+// Two digits per entry: "00" to "99", "00" to "FF" by byte, "00" to "77" by
+// six bits; and four binary digits per nibble
+#define PAIR_ROW8(d) d"0" d"1" d"2" d"3" d"4" d"5" d"6" d"7"
+#define PAIR_ROW10(d) PAIR_ROW8(d) d"8" d"9"
+#define PAIR_ROW16(d) PAIR_ROW10(d) d"A" d"B" d"C" d"D" d"E" d"F"
+
+static const char decimal_pairs[] =
+	PAIR_ROW10("0") PAIR_ROW10("1") PAIR_ROW10("2") PAIR_ROW10("3") PAIR_ROW10("4")
+	PAIR_ROW10("5") PAIR_ROW10("6") PAIR_ROW10("7") PAIR_ROW10("8") PAIR_ROW10("9");
+
+static const char hex_pairs[] =
+	PAIR_ROW16("0") PAIR_ROW16("1") PAIR_ROW16("2") PAIR_ROW16("3")
+	PAIR_ROW16("4") PAIR_ROW16("5") PAIR_ROW16("6") PAIR_ROW16("7")
+	PAIR_ROW16("8") PAIR_ROW16("9") PAIR_ROW16("A") PAIR_ROW16("B")
+	PAIR_ROW16("C") PAIR_ROW16("D") PAIR_ROW16("E") PAIR_ROW16("F");
+
+static const char octal_pairs[] =
+	PAIR_ROW8("0") PAIR_ROW8("1") PAIR_ROW8("2") PAIR_ROW8("3")
+	PAIR_ROW8("4") PAIR_ROW8("5") PAIR_ROW8("6") PAIR_ROW8("7");
+
+static const char binary_nibbles[] =
+	"0000" "0001" "0010" "0011" "0100" "0101" "0110" "0111"
+	"1000" "1001" "1010" "1011" "1100" "1101" "1110" "1111";
+
+// Digit character -> value + 1, 0 = not a digit
+static const unsigned char digit_values[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+static const uint64_t powers_of_ten[20] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+int calc_int_digit(char c, int radix) {
+	int value = digit_values[(unsigned char)c] - 1;
+	return value < radix ? value : -1;
+}
+
+int calc_int_append_digit(calc_int* value, int digit, int radix, int bits, int is_signed) {
+	calc_int next;
+	if (__builtin_mul_overflow(calc_int_bits(*value, bits), (calc_int)radix, &next)
+		|| __builtin_add_overflow(next, (calc_int)digit, &next)
+		|| (bits < 128 && next >> bits != 0)) {
+		return 0;
+	}
+	*value = calc_int_wrap(next, bits, is_signed);
+	return 1;
+}
+
+// Decimal digits of value written backwards, ending at end; returns the first
+static char* format_decimal_64(char* end, uint64_t value) {
+	while (value >= 100) {
+		unsigned pair = (unsigned)(value % 100);
+		value /= 100;
+		end -= 2;
+		memcpy(end, decimal_pairs + 2 * pair, 2);
+	}
+	if (value >= 10) {
+		end -= 2;
+		memcpy(end, decimal_pairs + 2 * value, 2);
+	} else {
+		*--end = (char)('0' + value);
+	}
+	return end;
+}
+
+// 19 digits per 128-bit division, so a 128-bit value takes at most two
+static char* format_decimal(char* end, calc_int value) {
+	while (value >> 64 != 0) {
+		uint64_t chunk = (uint64_t)(value % powers_of_ten[19]);
+		value /= powers_of_ten[19];
+		char* start = format_decimal_64(end, chunk);
+		while (start > end - 19) {
+			*--start = '0';
+		}
+		end = start;
+	}
+	return format_decimal_64(end, (uint64_t)value);
+}
+
+// Whole table entries, so there may be leading zeros; nothing for zero
+static char* format_power_of_two(char* end, calc_int value, int radix) {
+	if (radix == 16) {
+		for (; value != 0; value >>= 8) {
+			end -= 2;
+			memcpy(end, hex_pairs + 2 * (unsigned)(value & 0xFF), 2);
+		}
+	} else if (radix == 8) {
+		for (; value != 0; value >>= 6) {
+			end -= 2;
+			memcpy(end, octal_pairs + 2 * (unsigned)(value & 077), 2);
+		}
+	} else {
+		for (; value != 0; value >>= 4) {
+			end -= 4;
+			memcpy(end, binary_nibbles + 4 * (unsigned)(value & 0xF), 4);
+		}
+	}
+	return end;
+}
+
+int calc_int_format(char* buffer, calc_int value, int bits, int is_signed, int radix) {
+	char digits[CALC_INT_BUFFER_SIZE];
+	char* end = digits + sizeof(digits);
+	char* start;
+	int negative = 0;
+	if (radix == 10) {
+		negative = is_signed && (calc_sint)value < 0;
+		start = format_decimal(end, negative ? -value : value);
+	} else {
+		start = format_power_of_two(end, calc_int_bits(value, bits), radix);
+		while (start < end && *start == '0') {
+			start++;
+		}
+		if (start == end) {
+			*--start = '0';
+		}
+	}
+	
+	int length = 0;
+	if (negative) {
+		buffer[length++] = '-';
+	}
+	memcpy(buffer + length, start, (size_t)(end - start));
+	length += (int)(end - start);
+	buffer[length] = '\0';
+	return length;
+}
+
+int calc_int_parse(calc_int* value, const char* text, size_t length, int radix, int bits, int is_signed) {
+	int negative = length > 0 && text[0] == '-';
+	if (negative) {
+		if (!is_signed) {
+			return 0;
+		}
+		text++;
+		length--;
+	}
+	if (length == 0) {
+		return 0;
+	}
+	
+	calc_int result = 0;
+	if (radix == 10) {
+		// 19 digits at a time in 64 bits, then one 128-bit multiply-add
+		for (size_t i = 0; i < length; ) {
+			size_t count = length - i < 19 ? length - i : 19;
+			uint64_t chunk = 0;
+			for (size_t j = 0; j < count; j++) {
+				int digit = digit_values[(unsigned char)text[i + j]] - 1;
+				if (digit < 0 || digit > 9) {
+					return 0;
+				}
+				chunk = chunk * 10 + (uint64_t)digit;
+			}
+			if (__builtin_mul_overflow(result, (calc_int)powers_of_ten[count], &result)
+				|| __builtin_add_overflow(result, (calc_int)chunk, &result)) {
+				return 0;
+			}
+			i += count;
+		}
+	} else {
+		// Past leading zeros only the top digit can run over 128 bits; the
+		// rest go 64 bits at a time
+		int shift = radix == 16 ? 4 : radix == 8 ? 3 : 1;
+		while (length > 1 && text[0] == '0') {
+			text++;
+			length--;
+		}
+		int top = calc_int_digit(text[0], radix);
+		if (top < 0 || (length - 1) * (size_t)shift + (top ? 32 - (size_t)__builtin_clz((unsigned)top) : 0) > 128) {
+			return 0;
+		}
+		size_t chunk_digits = (size_t)(64 / shift);
+		for (size_t i = 0; i < length; ) {
+			size_t count = length - i < chunk_digits ? length - i : chunk_digits;
+			uint64_t chunk = 0;
+			for (size_t j = 0; j < count; j++) {
+				int digit = calc_int_digit(text[i + j], radix);
+				if (digit < 0) {
+					return 0;
+				}
+				chunk = chunk << shift | (uint64_t)digit;
+			}
+			result = result << (count * (size_t)shift) | chunk;
+			i += count;
+		}
+	}
+	
+	if (negative) {
+		// Down to the most negative word, -2^(bits - 1)
+		if (result > (calc_int)1 << (bits - 1)) {
+			return 0;
+		}
+		result = -result;
+	} else if (bits < 128 && result >> bits != 0) {
+		return 0;
+	}
+	*value = calc_int_wrap(result, bits, is_signed);
+	return 1;
+}
@@ -0,0 +1,67 @@
+// Integer Arithmetic - two's-complement words for the programmer mode
+//
+// A calc_int holds a word of 8, 16, 32, 64 or 128 bits in a 128-bit integer:
+// sign-extended when the word is signed, zero-extended when it is not, so
+// comparisons and division work on the 128-bit value directly. Every result
+// wraps to the word like the hardware does. Radix conversion is table-driven
+// (two decimal, hex or octal digits, or four binary digits per step), and the
+// bit counts use the compiler builtins, which become POPCNT/LZCNT/TZCNT (or
+// BSR/BSF) on x86-64 and CNT/CLZ/RBIT on AArch64.
+
+#ifndef CALC_INT_H
+#define CALC_INT_H
+
+#include <stddef.h>
+
+typedef unsigned __int128 calc_int;
+
+// 128 binary digits, a sign and the terminator
+#define CALC_INT_BUFFER_SIZE 131
+
+// Wrap value to a word of bits bits (8 to 128)
+calc_int calc_int_wrap(calc_int value, int bits, int is_signed);
+
+// The word's bits, zero-extended (the pattern hex, octal and binary show)
+calc_int calc_int_bits(calc_int value, int bits);
+
+double calc_int_to_double(calc_int value, int is_signed);
+
+// ============================================================================
+// Arithmetic
+// ============================================================================
+
+// '+', '-', '*', '/' and '%' (truncating; a zero divisor gives 0), '&', '|',
+// '^' (xor), '<' and '>' (shifts; '>' is arithmetic for signed words, and a
+// count of bits or more shifts everything out), '[' and ']' (rotates, count
+// modulo bits). Unknown operators give rhs, like perform_operation.
+calc_int calc_int_operation(calc_int lhs, char op, calc_int rhs, int bits, int is_signed);
+
+calc_int calc_int_not(calc_int value, int bits, int is_signed);
+
+// Set bits, and leading and trailing zeros within the word (bits for zero)
+int calc_int_popcount(calc_int value, int bits);
+int calc_int_clz(calc_int value, int bits);
+int calc_int_ctz(calc_int value, int bits);
+
+// ============================================================================
+// Radix Conversion
+// ============================================================================
+
+// Value of a digit character in radix (2 to 16, either case), or -1
+int calc_int_digit(char c, int radix);
+
+// Append a digit to a number being typed, read as a bit pattern: returns 0 and
+// leaves value alone if the digits no longer fit in bits bits
+int calc_int_append_digit(calc_int* value, int digit, int radix, int bits, int is_signed);
+
+// Write value in radix 2, 8, 10 or 16 into buffer (CALC_INT_BUFFER_SIZE
+// bytes). Decimal shows signed words with a '-'; the other radices show the
+// word's bits. Upper-case digits, no prefix; returns the text length.
+int calc_int_format(char* buffer, calc_int value, int bits, int is_signed, int radix);
+
+// Parse length characters of digits in radix, with a leading '-' allowed for
+// signed words. Returns 0 on a bad digit or a number that does not fit: the
+// digits must fit in bits bits, and a negative number must be representable.
+int calc_int_parse(calc_int* value, const char* text, size_t length, int radix, int bits, int is_signed);
+
+#endif
@@ -0,0 +1,544 @@
+// Expression JIT - x86-64 (SSE2, AVX) and AArch64 (NEON) code generators
+//
+// Both generators are plain byte writers and build everywhere; only the one
+// for the host CPU is ever selected to run.
+
+#include "calc_jit.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__APPLE__) && defined(__aarch64__)
+#include <pthread.h>
+#endif
+
+#if defined(__x86_64__)
+#define CALC_JIT_X86 1
+#elif defined(__aarch64__)
+#define CALC_JIT_ARM 1
+#endif
+
+// Stack entries that fit in registers: x86 keeps xmm15 as scratch, AArch64
+// uses v0-v7 and v16-v28, leaving v8-v15 (callee-saved) alone
+#define X86_MAX_DEPTH 15
+#define ARM_MAX_DEPTH 21
+
+// Pool entry e holds one double repeated across a vector: entry 0 is the sign
+// bit (for x86 negation), entry 1 + k the k-th constant of the expression.
+// AArch64 addresses entries with a scaled 12-bit offset from x3.
+#define X86_ENTRY 32
+#define ARM_ENTRY 16
+#define ARM_MAX_ENTRIES 2047
+
+static calc_batch_isa g_isa;
+static int g_selected;
+
+// ============================================================================
+// Code Buffer
+// ============================================================================
+
+typedef struct {
+	size_t position;      // Offset of a rel32 to the pool
+	size_t entry;
+} pool_fixup;
+
+typedef struct {
+	unsigned char* bytes;
+	size_t length;
+	size_t capacity;
+	pool_fixup* fixups;
+	size_t fixup_count;
+	size_t fixup_capacity;
+	int avx;              // x86: VEX encoding and 256-bit vectors
+} code_buffer;
+
+static void reserve(void** data, size_t* capacity, size_t needed, size_t element_size) {
+	if (needed <= *capacity) {
+		return;
+	}
+	size_t grown = *capacity ? *capacity * 2 : 256;
+	while (grown < needed) {
+		grown *= 2;
+	}
+	*data = realloc(*data, grown * element_size);
+	*capacity = grown;
+}
+
+static void emit_byte(code_buffer* code, unsigned value) {
+	reserve((void**)&code->bytes, &code->capacity, code->length + 1, 1);
+	code->bytes[code->length++] = (unsigned char)value;
+}
+
+static void emit_bytes(code_buffer* code, const unsigned char* bytes, size_t count) {
+	reserve((void**)&code->bytes, &code->capacity, code->length + count, 1);
+	memcpy(code->bytes + code->length, bytes, count);
+	code->length += count;
+}
+
+static void emit32(code_buffer* code, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		emit_byte(code, (value >> (8 * i)) & 0xFF);
+	}
+}
+
+static void patch32(code_buffer* code, size_t position, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		code->bytes[position + i] = (unsigned char)(value >> (8 * i));
+	}
+}
+
+static uint32_t read32(const code_buffer* code, size_t position) {
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++) {
+		value |= (uint32_t)code->bytes[position + i] << (8 * i);
+	}
+	return value;
+}
+
+// ============================================================================
+// x86-64
+// ============================================================================
+
+// Arguments (SysV): rdi = out, rsi = xs, rdx = count. rax is the index, rcx
+// the end of the vector loop. Stack entry j lives in xmm/ymm j.
+#define X86_TEMP 15
+
+enum {
+	X86_REG,              // Register operand
+	X86_XS,               // [rsi + rax*8]
+	X86_OUT,              // [rdi + rax*8]
+	X86_POOL,             // [rip + pool entry]
+};
+
+enum {
+	X86_MOVE_LOAD = 0x10,
+	X86_MOVE_STORE = 0x11,
+	X86_AND = 0x54,
+	X86_XOR = 0x57,
+	X86_ADD = 0x58,
+	X86_MUL = 0x59,
+	X86_SUB = 0x5C,
+	X86_DIV = 0x5E,
+	X86_CMP = 0xC2,
+};
+
+// One SSE2 or AVX instruction: reg = src op operand (SSE2 needs reg == src).
+// scalar picks the sd form; and/xor only have a pd form, which is harmless
+// on the low lane. imm < 0 means none.
+static void x86_op(code_buffer* code, int opcode, int scalar, int reg, int src, int kind, int operand, int imm) {
+	int packed_only = opcode == X86_AND || opcode == X86_XOR;
+	int pp = scalar && !packed_only ? 3 : 1;   // F2 or 66
+	int rm = kind == X86_REG ? operand : 0;
+	if (code->avx) {
+		int wide = !scalar;
+		emit_byte(code, 0xC4);
+		emit_byte(code, (reg & 8 ? 0 : 0x80) | 0x40 | (rm & 8 ? 0 : 0x20) | 0x01);
+		emit_byte(code, ((~src & 15) << 3) | (wide << 2) | pp);
+	} else {
+		emit_byte(code, pp == 3 ? 0xF2 : 0x66);
+		if ((reg | rm) & 8) {
+			emit_byte(code, 0x40 | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0));
+		}
+		emit_byte(code, 0x0F);
+	}
+	emit_byte(code, opcode);
+	if (kind == X86_REG) {
+		emit_byte(code, 0xC0 | (reg & 7) << 3 | (rm & 7));
+	} else if (kind == X86_POOL) {
+		emit_byte(code, (reg & 7) << 3 | 5);
+		reserve((void**)&code->fixups, &code->fixup_capacity, code->fixup_count + 1, sizeof(pool_fixup));
+		code->fixups[code->fixup_count++] = (pool_fixup){code->length, (size_t)operand};
+		emit32(code, 0);
+	} else {
+		emit_byte(code, (reg & 7) << 3 | 4);
+		emit_byte(code, kind == X86_XS ? 0xC6 : 0xC7);
+	}
+	if (imm >= 0) {
+		emit_byte(code, imm);
+	}
+}
+
+// The expression over one vector (or one lane when scalar) of x at index rax,
+// result stored to out
+static void x86_body(code_buffer* code, const calc_expr* expr, int scalar) {
+	static const int arithmetic[] = {X86_ADD, X86_SUB, X86_MUL, X86_DIV};
+	const unsigned char* pc = expr->code;
+	size_t k = 0;
+	int top = -1;
+	int op;
+	
+	while ((op = *pc++) != CALC_OP_RETURN) {
+		switch (op) {
+			case CALC_OP_PUSH:
+				top++;
+				x86_op(code, X86_MOVE_LOAD, scalar, top, 0, X86_POOL, (int)(1 + k++), -1);
+				break;
+			case CALC_OP_PUSH_X:
+				top++;
+				x86_op(code, X86_MOVE_LOAD, scalar, top, 0, X86_XS, 0, -1);
+				break;
+			case CALC_OP_NEG:
+				x86_op(code, X86_XOR, scalar, top, top, X86_POOL, 0, -1);
+				break;
+			case CALC_OP_ADD:
+			case CALC_OP_SUB:
+			case CALC_OP_MUL:
+				x86_op(code, arithmetic[op - CALC_OP_ADD], scalar, top - 1, top - 1, X86_REG, top, -1);
+				top--;
+				break;
+			case CALC_OP_DIV:
+				// mask = rhs != 0 (NaN counts as nonzero), then lhs / rhs & mask
+				x86_op(code, X86_XOR, scalar, X86_TEMP, X86_TEMP, X86_REG, X86_TEMP, -1);
+				x86_op(code, X86_CMP, scalar, X86_TEMP, X86_TEMP, X86_REG, top, 4);
+				x86_op(code, X86_DIV, scalar, top - 1, top - 1, X86_REG, top, -1);
+				x86_op(code, X86_AND, scalar, top - 1, top - 1, X86_REG, X86_TEMP, -1);
+				top--;
+				break;
+			case CALC_OP_ADD_K:
+			case CALC_OP_SUB_K:
+			case CALC_OP_MUL_K:
+				x86_op(code, arithmetic[op - CALC_OP_ADD_K], scalar, top, top, X86_POOL, (int)(1 + k++), -1);
+				break;
+			case CALC_OP_DIV_K:
+				if (expr->constants[k] != 0) {
+					x86_op(code, X86_DIV, scalar, top, top, X86_POOL, (int)(1 + k), -1);
+				} else {
+					x86_op(code, X86_XOR, scalar, top, top, X86_REG, top, -1);
+				}
+				k++;
+				break;
+		}
+	}
+	x86_op(code, X86_MOVE_STORE, scalar, 0, 0, X86_OUT, 0, -1);
+}
+
+// Emit a rel32 jump or branch and return the offset of its displacement
+static size_t x86_jump(code_buffer* code, const unsigned char* opcode, size_t length) {
+	emit_bytes(code, opcode, length);
+	size_t position = code->length;
+	emit32(code, 0);
+	return position;
+}
+
+static void x86_land(code_buffer* code, size_t position, size_t target) {
+	patch32(code, position, (uint32_t)(target - (position + 4)));
+}
+
+static void x86_generate(code_buffer* code, const calc_expr* expr) {
+	static const unsigned char jz[] = {0x0F, 0x84}, jb[] = {0x0F, 0x82}, jae[] = {0x0F, 0x83};
+	static const unsigned char cmp_rax_rcx[] = {0x48, 0x39, 0xC8}, cmp_rax_rdx[] = {0x48, 0x39, 0xD0};
+	unsigned lanes = code->avx ? 4 : 2;
+	
+	// rax = 0; rcx = count rounded down to whole vectors
+	const unsigned char setup[] = {0x31, 0xC0, 0x48, 0x89, 0xD1, 0x48, 0x83, 0xE1, (unsigned char)-lanes};
+	emit_bytes(code, setup, sizeof(setup));
+	size_t skip_vectors = x86_jump(code, jz, 2);
+	
+	size_t vector_loop = code->length;
+	x86_body(code, expr, 0);
+	const unsigned char step[] = {0x48, 0x83, 0xC0, (unsigned char)lanes};
+	emit_bytes(code, step, sizeof(step));
+	emit_bytes(code, cmp_rax_rcx, sizeof(cmp_rax_rcx));
+	x86_land(code, x86_jump(code, jb, 2), vector_loop);
+	
+	x86_land(code, skip_vectors, code->length);
+	emit_bytes(code, cmp_rax_rdx, sizeof(cmp_rax_rdx));
+	size_t skip_tail = x86_jump(code, jae, 2);
+	size_t tail_loop = code->length;
+	x86_body(code, expr, 1);
+	const unsigned char step_one[] = {0x48, 0x83, 0xC0, 0x01};
+	emit_bytes(code, step_one, sizeof(step_one));
+	emit_bytes(code, cmp_rax_rdx, sizeof(cmp_rax_rdx));
+	x86_land(code, x86_jump(code, jb, 2), tail_loop);
+	
+	x86_land(code, skip_tail, code->length);
+	if (code->avx) {
+		const unsigned char vzeroupper[] = {0xC5, 0xF8, 0x77};
+		emit_bytes(code, vzeroupper, sizeof(vzeroupper));
+	}
+	emit_byte(code, 0xC3);
+}
+
+// ============================================================================
+// AArch64
+// ============================================================================
+
+// Arguments: x0 = out, x1 = xs, x2 = count; both pointers are post-incremented.
+// x3 points at the pool and x4 counts vector iterations. v29 holds x, v30 a
+// constant operand and v31 a division mask.
+#define ARM_X 29
+#define ARM_CONSTANT 30
+#define ARM_MASK 31
+
+static int arm_register(int entry) {
+	return entry < 8 ? entry : entry + 8;
+}
+
+static void arm_three(code_buffer* code, uint32_t base, int d, int n, int m) {
+	emit32(code, base | (uint32_t)m << 16 | (uint32_t)n << 5 | (uint32_t)d);
+}
+
+// Load pool entry into register d, as a whole vector or its low double
+static void arm_load_constant(code_buffer* code, int scalar, int d, size_t entry) {
+	uint32_t offset = (uint32_t)(entry * ARM_ENTRY);
+	if (scalar) {
+		emit32(code, 0xFD400000 | (offset / 8) << 10 | 3 << 5 | (uint32_t)d);   // ldr d, [x3, #offset]
+	} else {
+		emit32(code, 0x3DC00000 | (offset / 16) << 10 | 3 << 5 | (uint32_t)d);  // ldr q, [x3, #offset]
+	}
+}
+
+static void arm_body(code_buffer* code, const calc_expr* expr, int scalar) {
+	// fadd, fsub, fmul, fdiv; then fneg, fcmeq #0, bic, orr, as 2D/16B or scalar/8B
+	static const uint32_t vector[] = {0x4E60D400, 0x4EE0D400, 0x6E60DC00, 0x6E60FC00, 0x6EE0F800, 0x4EE0D800, 0x4E601C00, 0x4EA01C00};
+	static const uint32_t lane[] = {0x1E602800, 0x1E603800, 0x1E600800, 0x1E601800, 0x1E614000, 0x5EE0D800, 0x0E601C00, 0x0EA01C00};
+	const uint32_t* form = scalar ? lane : vector;
+	const uint32_t movi_zero = 0x6F00E400;
+	const unsigned char* pc = expr->code;
+	size_t k = 0;
+	int top = -1;
+	int op;
+	
+	while ((op = *pc++) != CALC_OP_RETURN) {
+		int t = top >= 0 ? arm_register(top) : 0;
+		int below = top >= 1 ? arm_register(top - 1) : 0;
+		switch (op) {
+			case CALC_OP_PUSH:
+				top++;
+				arm_load_constant(code, scalar, arm_register(top), 1 + k++);
+				break;
+			case CALC_OP_PUSH_X:
+				top++;
+				arm_three(code, form[7], arm_register(top), ARM_X, ARM_X);
+				break;
+			case CALC_OP_NEG:
+				arm_three(code, form[4], t, t, 0);
+				break;
+			case CALC_OP_ADD:
+			case CALC_OP_SUB:
+			case CALC_OP_MUL:
+				arm_three(code, form[op - CALC_OP_ADD], below, below, t);
+				top--;
+				break;
+			case CALC_OP_DIV:
+				// mask = rhs == 0 (false for NaN); lhs = lhs / rhs & ~mask
+				arm_three(code, form[5], ARM_MASK, t, 0);
+				arm_three(code, form[3], below, below, t);
+				arm_three(code, form[6], below, below, ARM_MASK);
+				top--;
+				break;
+			case CALC_OP_ADD_K:
+			case CALC_OP_SUB_K:
+			case CALC_OP_MUL_K:
+				arm_load_constant(code, scalar, ARM_CONSTANT, 1 + k++);
+				arm_three(code, form[op - CALC_OP_ADD_K], t, t, ARM_CONSTANT);
+				break;
+			case CALC_OP_DIV_K:
+				if (expr->constants[k] != 0) {
+					arm_load_constant(code, scalar, ARM_CONSTANT, 1 + k);
+					arm_three(code, form[3], t, t, ARM_CONSTANT);
+				} else {
+					emit32(code, movi_zero | (uint32_t)t);
+				}
+				k++;
+				break;
+		}
+	}
+}
+
+// Branch at position to target: imm19 (cbz, b.cond) or imm14 (tbz) words
+static void arm_land(code_buffer* code, size_t position, size_t target, int bits) {
+	uint32_t words = (uint32_t)((int64_t)(target - position) / 4) & ((1u << bits) - 1);
+	patch32(code, position, read32(code, position) | words << 5);
+}
+
+static void arm_generate(code_buffer* code, const calc_expr* expr) {
+	size_t adr = code->length;
+	emit32(code, 0x10000003);                     // adr x3, pool (patched)
+	emit32(code, 0xD341FC44);                     // lsr x4, x2, #1
+	size_t skip_vectors = code->length;
+	emit32(code, 0xB4000004);                     // cbz x4, tail
+	
+	size_t vector_loop = code->length;
+	emit32(code, 0x4CDF7C00 | 1 << 5 | ARM_X);    // ld1 {v29.2d}, [x1], #16
+	arm_body(code, expr, 0);
+	emit32(code, 0x4C9F7C00);                     // st1 {v0.2d}, [x0], #16
+	emit32(code, 0xF1000484);                     // subs x4, x4, #1
+	size_t loop_back = code->length;
+	emit32(code, 0x54000001);                     // b.ne vector_loop
+	arm_land(code, loop_back, vector_loop, 19);
+	
+	arm_land(code, skip_vectors, code->length, 19);
+	size_t skip_tail = code->length;
+	emit32(code, 0x36000002);                     // tbz x2, #0, done
+	emit32(code, 0xFD400000 | 1 << 5 | ARM_X);    // ldr d29, [x1]
+	arm_body(code, expr, 1);
+	emit32(code, 0xFD000000);                     // str d0, [x0]
+	arm_land(code, skip_tail, code->length, 14);
+	emit32(code, 0xD65F03C0);                     // ret
+	
+	// The pool follows at the next ARM_ENTRY boundary
+	size_t pool = (code->length + ARM_ENTRY - 1) & ~(size_t)(ARM_ENTRY - 1);
+	size_t distance = pool - adr;
+	patch32(code, adr, read32(code, adr) | (uint32_t)(distance & 3) << 29 | (uint32_t)(distance >> 2) << 5);
+}
+
+// ============================================================================
+// Compile & Evaluate
+// ============================================================================
+
+void calc_jit_init(calc_jit* jit) {
+	memset(jit, 0, sizeof(*jit));
+}
+
+void calc_jit_free(calc_jit* jit) {
+	if (jit->memory) {
+		munmap(jit->memory, jit->memory_size);
+	}
+	calc_jit_init(jit);
+}
+
+// Copy code and pool into a fresh mapping and make it executable
+static int install(calc_jit* jit, code_buffer* code, size_t entry_size, const double* constants, size_t constant_count) {
+	size_t lanes = entry_size / sizeof(double);
+	size_t pool = (code->length + entry_size - 1) & ~(entry_size - 1);
+	size_t used = pool + (1 + constant_count) * entry_size;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t size = (used + page - 1) & ~(page - 1);
+	
+	for (size_t i = 0; i < code->fixup_count; i++) {
+		size_t position = code->fixups[i].position;
+		size_t target = pool + code->fixups[i].entry * entry_size;
+		patch32(code, position, (uint32_t)(target - (position + 4)));
+	}
+
+#if defined(__APPLE__) && defined(__aarch64__)
+	// Hardened processes may only map writable code with MAP_JIT, and switch
+	// it between writable and executable per thread
+	unsigned char* memory = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON | MAP_JIT, -1, 0);
+	if (memory == MAP_FAILED) {
+		return 0;
+	}
+	pthread_jit_write_protect_np(0);
+#else
+	unsigned char* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (memory == MAP_FAILED) {
+		return 0;
+	}
+#endif
+
+	memcpy(memory, code->bytes, code->length);
+	memset(memory + code->length, 0, pool - code->length);
+	double* entries = (double*)(memory + pool);
+	const double sign = -0.0;
+	for (size_t e = 0; e <= constant_count; e++) {
+		for (size_t l = 0; l < lanes; l++) {
+			entries[e * lanes + l] = e == 0 ? sign : constants[e - 1];
+		}
+	}
+
+#if defined(__APPLE__) && defined(__aarch64__)
+	pthread_jit_write_protect_np(1);
+#else
+	if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(memory, size);
+		return 0;
+	}
+#endif
+	__builtin___clear_cache((char*)memory, (char*)memory + used);
+	
+	jit->memory = memory;
+	jit->memory_size = size;
+	jit->code_size = code->length;
+	jit->code = (calc_jit_code)(void*)memory;
+	return 1;
+}
+
+int calc_jit_compile(calc_jit* jit, const calc_expr* expr) {
+	calc_jit_free(jit);
+	calc_batch_isa isa = calc_jit_active();
+	if (isa == CALC_BATCH_SCALAR || !expr->code) {
+		return 0;
+	}
+	
+	// Only the four operators, constants and x
+	for (size_t i = 0; i < expr->code_length; i++) {
+		if (expr->code[i] == CALC_OP_POW || expr->code[i] == CALC_OP_CALL) {
+			return 0;
+		}
+	}
+	int arm = isa == CALC_BATCH_NEON;
+	if (expr->max_depth > (arm ? ARM_MAX_DEPTH : X86_MAX_DEPTH)) {
+		return 0;
+	}
+	if (arm && expr->constant_count + 1 > ARM_MAX_ENTRIES) {
+		return 0;
+	}
+	
+	code_buffer code;
+	memset(&code, 0, sizeof(code));
+	code.avx = isa == CALC_BATCH_AVX2;
+	if (arm) {
+		arm_generate(&code, expr);
+	} else {
+		x86_generate(&code, expr);
+	}
+	int installed = install(jit, &code, arm ? ARM_ENTRY : X86_ENTRY, expr->constants, expr->constant_count);
+	free(code.bytes);
+	free(code.fixups);
+	if (installed) {
+		jit->isa = isa;
+	}
+	return installed;
+}
+
+void calc_jit_eval(const calc_jit* jit, calc_expr* expr, double* out, const double* xs, size_t count) {
+	if (jit->code) {
+		jit->code(out, xs, count);
+	} else {
+		calc_expr_eval_batch(expr, out, xs, count);
+	}
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+static int isa_supported(calc_batch_isa isa) {
+	switch (isa) {
+		case CALC_BATCH_SCALAR: return 1;
+#ifdef CALC_JIT_X86
+		case CALC_BATCH_SSE2: return __builtin_cpu_supports("sse2");
+		case CALC_BATCH_AVX2: return __builtin_cpu_supports("avx2");
+#endif
+#ifdef CALC_JIT_ARM
+		case CALC_BATCH_NEON: return 1;
+#endif
+		default: return 0;
+	}
+}
+
+int calc_jit_select(calc_batch_isa isa) {
+	if (!isa_supported(isa)) {
+		return 0;
+	}
+	g_isa = isa;
+	g_selected = 1;
+	return 1;
+}
+
+static void select_best(void) {
+	static const calc_batch_isa preference[] = {
+		CALC_BATCH_AVX2, CALC_BATCH_NEON, CALC_BATCH_SSE2, CALC_BATCH_SCALAR
+	};
+	for (size_t i = 0; !calc_jit_select(preference[i]); i++) {}
+}
+
+calc_batch_isa calc_jit_active(void) {
+	if (!g_selected) {
+		select_best();
+	}
+	return g_isa;
+}
@@ -0,0 +1,53 @@
+// Expression JIT - compiled expressions to native loops over columns of x
+//
+// calc_jit_compile turns a calc_expr's bytecode into straight-line machine
+// code: the evaluation stack lives in vector registers, constants sit in a pool
+// after the code, and one loop runs the whole expression over 4 (AVX2) or 2
+// (SSE2, NEON) values of x at a time, with a scalar copy of the body for the
+// rest. Results are bit-for-bit what calc_expr_eval_batch gives, including
+// the divide-by-zero rule. The code is written to an mmap'd buffer that is
+// made executable only once it is complete.
+//
+// Expressions with '^' or functions, or too deep for the registers, are not
+// compiled; calc_jit_eval then runs the interpreter instead, as it does on
+// CPUs the JIT has no code generator for.
+
+#ifndef CALC_JIT_H
+#define CALC_JIT_H
+
+#include <stddef.h>
+
+#include "calc_batch.h"
+#include "calc_expr.h"
+
+typedef void (*calc_jit_code)(double* out, const double* xs, size_t count);
+
+typedef struct calc_jit {
+	calc_jit_code code;   // NULL when the interpreter runs instead
+	void* memory;         // Executable mapping holding code and constants
+	size_t memory_size;
+	size_t code_size;     // Bytes of instructions at the start of memory
+	calc_batch_isa isa;   // Code generator used; CALC_BATCH_SCALAR if none
+} calc_jit;
+
+void calc_jit_init(calc_jit* jit);
+void calc_jit_free(calc_jit* jit);
+
+// Generate code for expr with the active code generator, replacing any
+// earlier code; returns 0 if the expression or CPU is not supported, leaving
+// jit to interpret. jit keeps no pointer to expr.
+int calc_jit_compile(calc_jit* jit, const calc_expr* expr);
+
+// out[i] = f(xs[i]) for the expr jit was compiled from; out may alias xs.
+// Native code may run on several threads at once; the interpreter fallback
+// uses expr's buffers, as calc_expr_eval_batch does.
+void calc_jit_eval(const calc_jit* jit, calc_expr* expr, double* out, const double* xs, size_t count);
+
+// Code generator used by calc_jit_compile; the best supported one until
+// calc_jit_select. CALC_BATCH_SCALAR means always interpret.
+calc_batch_isa calc_jit_active(void);
+
+// Force a code generator (for benchmarking); returns 0 if the CPU lacks it
+int calc_jit_select(calc_batch_isa isa);
+
+#endif
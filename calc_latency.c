@@ -0,0 +1,369 @@
+// Latency Instrumentation - opt-in per-event timing with histograms
+
+#include "calc_latency.h"
+#include <inttypes.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int calc_latency_enabled = 0;
+
+// ============================================================================
+// Per-Thread Rings
+// ============================================================================
+
+// Power of two; the owner asks for a collect once a ring is 3/4 full
+#define LATENCY_RING_SIZE 1024
+
+typedef struct latency_event {
+	uint64_t at[CALC_LATENCY_POINTS];  // Monotonic ns, 0 = not marked
+} latency_event;
+
+// Single producer (the owning thread), single consumer (whoever holds
+// collecting). The owner publishes events by advancing head; the collector
+// frees slots by advancing tail.
+typedef struct latency_ring {
+	latency_event current;             // Event in progress, owner only
+	int active;
+	_Atomic uint64_t head;
+	_Atomic uint64_t tail;
+	_Atomic uint64_t dropped;
+	struct latency_ring* next;         // Rings are never freed
+	latency_event events[LATENCY_RING_SIZE];
+} latency_ring;
+
+static _Atomic(latency_ring*) rings = NULL;
+static _Thread_local latency_ring* thread_ring = NULL;
+
+// Held while draining rings or touching the histograms
+static atomic_flag collecting = ATOMIC_FLAG_INIT;
+
+static calc_latency_histogram histograms[CALC_LATENCY_PHASES];
+
+static char* dump_path = NULL;
+static volatile sig_atomic_t dump_requested = 0;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static latency_ring* attach_ring(void) {
+	latency_ring* ring = calloc(1, sizeof(*ring));
+	if (!ring) {
+		return NULL;
+	}
+	ring->next = atomic_load(&rings);
+	while (!atomic_compare_exchange_weak(&rings, &ring->next, ring)) {
+	}
+	thread_ring = ring;
+	return ring;
+}
+
+static void lock_histograms(void) {
+	while (atomic_flag_test_and_set_explicit(&collecting, memory_order_acquire)) {
+	}
+}
+
+static void unlock_histograms(void) {
+	atomic_flag_clear_explicit(&collecting, memory_order_release);
+}
+
+static void drain_rings(void);
+static void dump(void);
+
+static void push_event(latency_ring* ring) {
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	if (head - tail == LATENCY_RING_SIZE) {
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+	} else {
+		ring->events[head % LATENCY_RING_SIZE] = ring->current;
+		atomic_store_explicit(&ring->head, ++head, memory_order_release);
+	}
+	
+	if (dump_requested) {
+		dump_requested = 0;
+		dump();
+	} else if (head - tail >= LATENCY_RING_SIZE / 4 * 3) {
+		// Drain here unless another thread already is; never wait
+		if (!atomic_flag_test_and_set_explicit(&collecting, memory_order_acquire)) {
+			drain_rings();
+			unlock_histograms();
+		}
+	}
+}
+
+void calc_latency_record(calc_latency_point point) {
+	latency_ring* ring = thread_ring ? thread_ring : attach_ring();
+	if (!ring) {
+		return;
+	}
+	uint64_t now = now_ns();
+	
+	switch (point) {
+		case CALC_LATENCY_START:
+			memset(&ring->current, 0, sizeof(ring->current));
+			ring->current.at[CALC_LATENCY_START] = now;
+			ring->active = 1;
+			break;
+		case CALC_LATENCY_END:
+			if (ring->active) {
+				ring->active = 0;
+				ring->current.at[CALC_LATENCY_END] = now;
+				push_event(ring);
+			}
+			break;
+		default:
+			if (ring->active && !ring->current.at[point]) {
+				ring->current.at[point] = now;
+			}
+			break;
+	}
+}
+
+// ============================================================================
+// Histograms
+// ============================================================================
+
+#define SUB_HALF (1u << (CALC_LATENCY_SUB_BITS - 1))
+
+static size_t bucket_index(uint64_t value) {
+	if (value < 2 * SUB_HALF) {
+		return (size_t)value;
+	}
+	int shift = 63 - __builtin_clzll(value) - (CALC_LATENCY_SUB_BITS - 1);
+	return (size_t)(shift + 1) * SUB_HALF + (size_t)(value >> shift) - SUB_HALF;
+}
+
+static uint64_t bucket_lower(size_t index) {
+	if (index < 2 * SUB_HALF) {
+		return index;
+	}
+	int shift = (int)(index / SUB_HALF) - 1;
+	return (uint64_t)(index % SUB_HALF + SUB_HALF) << shift;
+}
+
+// The top bucket's bound wraps to UINT64_MAX, which is what it should be
+static uint64_t bucket_upper(size_t index) {
+	if (index < 2 * SUB_HALF) {
+		return index;
+	}
+	int shift = (int)(index / SUB_HALF) - 1;
+	return ((uint64_t)(index % SUB_HALF + SUB_HALF + 1) << shift) - 1;
+}
+
+void calc_latency_histogram_add(calc_latency_histogram* histogram, uint64_t value) {
+	if (histogram->count == 0 || value < histogram->min_ns) {
+		histogram->min_ns = value;
+	}
+	if (value > histogram->max_ns) {
+		histogram->max_ns = value;
+	}
+	histogram->count++;
+	histogram->total_ns += value;
+	histogram->buckets[bucket_index(value)]++;
+}
+
+// Unmarked COMPUTE counts as no dispatch time, unmarked RENDER as no render time
+static void add_event(const latency_event* event) {
+	uint64_t start = event->at[CALC_LATENCY_START];
+	uint64_t end = event->at[CALC_LATENCY_END];
+	uint64_t compute = event->at[CALC_LATENCY_COMPUTE] ? event->at[CALC_LATENCY_COMPUTE] : start;
+	uint64_t render = event->at[CALC_LATENCY_RENDER] ? event->at[CALC_LATENCY_RENDER] : end;
+	if (render < compute) {
+		render = compute;
+	}
+	calc_latency_histogram_add(&histograms[CALC_LATENCY_DISPATCH], compute - start);
+	calc_latency_histogram_add(&histograms[CALC_LATENCY_COMPUTING], render - compute);
+	calc_latency_histogram_add(&histograms[CALC_LATENCY_RENDERING], end - render);
+	calc_latency_histogram_add(&histograms[CALC_LATENCY_TOTAL], end - start);
+}
+
+// Caller holds collecting
+static void drain_rings(void) {
+	for (latency_ring* ring = atomic_load(&rings); ring; ring = ring->next) {
+		uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		for (; tail != head; tail++) {
+			add_event(&ring->events[tail % LATENCY_RING_SIZE]);
+		}
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	}
+}
+
+void calc_latency_collect(void) {
+	lock_histograms();
+	drain_rings();
+	unlock_histograms();
+}
+
+const calc_latency_histogram* calc_latency_phase_histogram(calc_latency_phase phase) {
+	return &histograms[phase];
+}
+
+uint64_t calc_latency_dropped(void) {
+	uint64_t dropped = 0;
+	for (latency_ring* ring = atomic_load(&rings); ring; ring = ring->next) {
+		dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+	}
+	return dropped;
+}
+
+uint64_t calc_latency_percentile(const calc_latency_histogram* histogram, double percentile) {
+	if (histogram->count == 0) {
+		return 0;
+	}
+	double rank = percentile / 100.0 * (double)histogram->count;
+	uint64_t target = rank < 1.0 ? 1 : (uint64_t)rank;
+	if ((double)target < rank) {
+		target++;
+	}
+	uint64_t seen = 0;
+	for (size_t i = 0; i < CALC_LATENCY_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen >= target) {
+			uint64_t upper = bucket_upper(i);
+			return upper < histogram->max_ns ? upper : histogram->max_ns;
+		}
+	}
+	return histogram->max_ns;
+}
+
+void calc_latency_reset(void) {
+	lock_histograms();
+	for (latency_ring* ring = atomic_load(&rings); ring; ring = ring->next) {
+		atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->head, memory_order_acquire), memory_order_release);
+		atomic_store_explicit(&ring->dropped, 0, memory_order_relaxed);
+	}
+	memset(histograms, 0, sizeof(histograms));
+	unlock_histograms();
+}
+
+// ============================================================================
+// Startup
+// ============================================================================
+
+static uint64_t startup_last = 0;   // Time of the last mark, 0 = not begun
+static uint64_t startup_phases[CALC_STARTUP_PHASES];
+
+void (*calc_startup_observer)(calc_startup_phase phase) = NULL;
+
+void calc_startup_begin(void) {
+	memset(startup_phases, 0, sizeof(startup_phases));
+	startup_last = now_ns();
+}
+
+void calc_startup_mark(calc_startup_phase phase) {
+	if (!startup_last || phase < 0 || phase >= CALC_STARTUP_PHASES) {
+		return;
+	}
+	uint64_t now = now_ns();
+	startup_phases[phase] = now - startup_last;
+	startup_last = now;
+	if (calc_startup_observer) {
+		calc_startup_observer(phase);
+	}
+}
+
+uint64_t calc_startup_ns(calc_startup_phase phase) {
+	return phase >= 0 && phase < CALC_STARTUP_PHASES ? startup_phases[phase] : 0;
+}
+
+uint64_t calc_startup_total_ns(void) {
+	uint64_t total = 0;
+	for (int p = 0; p < CALC_STARTUP_PHASES; p++) {
+		total += startup_phases[p];
+	}
+	return total;
+}
+
+// ============================================================================
+// JSON Output
+// ============================================================================
+
+static const char* const phase_names[CALC_LATENCY_PHASES] = {"dispatch", "compute", "render", "total"};
+static const char* const startup_names[CALC_STARTUP_PHASES] = {
+	"classes", "menus", "window", "buttons", "first_frame"
+};
+
+static void write_histogram(FILE* out, const calc_latency_histogram* histogram) {
+	fprintf(out, "{\"count\": %" PRIu64 ", \"min\": %" PRIu64 ", \"mean\": %" PRIu64 ", \"max\": %" PRIu64,
+		histogram->count, histogram->min_ns,
+		histogram->count ? histogram->total_ns / histogram->count : 0, histogram->max_ns);
+	fprintf(out, ", \"p50\": %" PRIu64 ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"p99.9\": %" PRIu64,
+		calc_latency_percentile(histogram, 50), calc_latency_percentile(histogram, 90),
+		calc_latency_percentile(histogram, 99), calc_latency_percentile(histogram, 99.9));
+	
+	// [lower, upper, count] for every non-empty bucket
+	fprintf(out, ",\n      \"buckets\": [");
+	int first = 1;
+	for (size_t i = 0; i < CALC_LATENCY_BUCKETS; i++) {
+		if (histogram->buckets[i]) {
+			fprintf(out, "%s[%" PRIu64 ", %" PRIu64 ", %" PRIu64 "]", first ? "" : ", ",
+				bucket_lower(i), bucket_upper(i), histogram->buckets[i]);
+			first = 0;
+		}
+	}
+	fprintf(out, "]}");
+}
+
+void calc_latency_write_json(FILE* out) {
+	lock_histograms();
+	drain_rings();
+	fprintf(out, "{\n  \"unit\": \"ns\",\n  \"events\": %" PRIu64 ",\n  \"dropped\": %" PRIu64 ",\n",
+		histograms[CALC_LATENCY_TOTAL].count, calc_latency_dropped());
+	if (startup_last) {
+		fprintf(out, "  \"startup\": {");
+		for (int p = 0; p < CALC_STARTUP_PHASES; p++) {
+			fprintf(out, "\"%s\": %" PRIu64 ", ", startup_names[p], startup_phases[p]);
+		}
+		fprintf(out, "\"total\": %" PRIu64 "},\n", calc_startup_total_ns());
+	}
+	fprintf(out, "  \"phases\": {\n");
+	for (int p = 0; p < CALC_LATENCY_PHASES; p++) {
+		fprintf(out, "    \"%s\": ", phase_names[p]);
+		write_histogram(out, &histograms[p]);
+		fprintf(out, "%s\n", p + 1 < CALC_LATENCY_PHASES ? "," : "");
+	}
+	fprintf(out, "  }\n}\n");
+	unlock_histograms();
+}
+
+// ============================================================================
+// Enabling & Dumps
+// ============================================================================
+
+static void dump(void) {
+	FILE* out = fopen(dump_path, "w");
+	if (!out) {
+		perror(dump_path);
+		return;
+	}
+	calc_latency_write_json(out);
+	fclose(out);
+}
+
+static void request_dump(int signal_number) {
+	(void)signal_number;
+	dump_requested = 1;
+}
+
+int calc_latency_enable(const char* path) {
+	if (path && !dump_path) {
+		FILE* out = fopen(path, "w");
+		if (!out) {
+			perror(path);
+			return 0;
+		}
+		fclose(out);
+		dump_path = strdup(path);
+		atexit(dump);
+		signal(SIGUSR1, request_dump);
+	}
+	calc_latency_enabled = 1;
+	return 1;
+}
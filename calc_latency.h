@@ -0,0 +1,138 @@
+// Latency Instrumentation - opt-in per-event timing with histograms
+//
+// Each input event (a button click or replayed key) is timed at four points:
+// start of dispatch, start of compute (the engine takes the key), start of
+// render (the first display update) and end. Events go into a lock-free ring
+// owned by the recording thread; rings are drained into log-linear histograms
+// of the dispatch, compute, render and total times, which can be written as
+// JSON. While disabled every hook is a single predictable branch.
+//
+// Launch is timed separately, as consecutive startup phases from the top of
+// main to the first frame the user can interact with.
+
+#ifndef CALC_LATENCY_H
+#define CALC_LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+typedef enum calc_latency_point {
+	CALC_LATENCY_START,
+	CALC_LATENCY_COMPUTE,
+	CALC_LATENCY_RENDER,
+	CALC_LATENCY_END,
+	CALC_LATENCY_POINTS,
+} calc_latency_point;
+
+// Set by calc_latency_enable; hooks do nothing while it is 0
+extern int calc_latency_enabled;
+
+// Slow path of the hooks below
+void calc_latency_record(calc_latency_point point);
+
+// Start and finish an event on the calling thread
+static inline void calc_latency_begin(void) {
+	if (__builtin_expect(calc_latency_enabled, 0)) {
+		calc_latency_record(CALC_LATENCY_START);
+	}
+}
+
+static inline void calc_latency_end(void) {
+	if (__builtin_expect(calc_latency_enabled, 0)) {
+		calc_latency_record(CALC_LATENCY_END);
+	}
+}
+
+// Mark COMPUTE or RENDER inside the current event; the first mark of each wins
+// and marks outside an event are ignored
+static inline void calc_latency_mark(calc_latency_point point) {
+	if (__builtin_expect(calc_latency_enabled, 0)) {
+		calc_latency_record(point);
+	}
+}
+
+// Start recording. With a path, the histograms are written there as JSON at
+// exit, and after the next event whenever SIGUSR1 arrives (signal handlers
+// cannot safely write files). Returns 0 if the path cannot be written.
+int calc_latency_enable(const char* path);
+
+// ============================================================================
+// Histograms
+// ============================================================================
+
+typedef enum calc_latency_phase {
+	CALC_LATENCY_DISPATCH,    // START to COMPUTE
+	CALC_LATENCY_COMPUTING,   // COMPUTE to RENDER
+	CALC_LATENCY_RENDERING,   // RENDER to END
+	CALC_LATENCY_TOTAL,       // START to END
+	CALC_LATENCY_PHASES,
+} calc_latency_phase;
+
+// Log-linear buckets: exact below 128 ns, then 64 buckets per power of two,
+// so a bucket is never wider than 1/64 of its values
+#define CALC_LATENCY_SUB_BITS 7
+#define CALC_LATENCY_BUCKETS ((64 - CALC_LATENCY_SUB_BITS + 2) << (CALC_LATENCY_SUB_BITS - 1))
+
+typedef struct calc_latency_histogram {
+	uint64_t count;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t total_ns;
+	uint64_t buckets[CALC_LATENCY_BUCKETS];
+} calc_latency_histogram;
+
+// Drain every thread's ring into the histograms
+void calc_latency_collect(void);
+
+// Histogram of one phase, as of the last collect
+const calc_latency_histogram* calc_latency_phase_histogram(calc_latency_phase phase);
+
+// Events lost because a ring was full
+uint64_t calc_latency_dropped(void);
+
+// Count one value; for callers keeping histograms of their own
+void calc_latency_histogram_add(calc_latency_histogram* histogram, uint64_t value);
+
+// Upper bound of the bucket holding the given percentile (0-100), clamped to max_ns
+uint64_t calc_latency_percentile(const calc_latency_histogram* histogram, double percentile);
+
+// Collect, then write counts, min/mean/max, percentiles and non-empty buckets
+void calc_latency_write_json(FILE* out);
+
+// Empty the rings and histograms
+void calc_latency_reset(void);
+
+// ============================================================================
+// Startup
+// ============================================================================
+
+typedef enum calc_startup_phase {
+	CALC_STARTUP_CLASSES,       // Selector table and class registration
+	CALC_STARTUP_MENUS,         // Menu bar
+	CALC_STARTUP_WINDOW,        // finishLaunching to the window, display and engine
+	CALC_STARTUP_BUTTONS,       // Button grid
+	CALC_STARTUP_FIRST_FRAME,   // Window ordered front to the first run-loop pass
+	CALC_STARTUP_PHASES,
+} calc_startup_phase;
+
+// Start the launch clock; marks before this are ignored
+void calc_startup_begin(void);
+
+// End a phase, which ran from the previous mark (or calc_startup_begin)
+void calc_startup_mark(calc_startup_phase phase);
+
+// Nanoseconds a phase took, 0 until it is marked
+uint64_t calc_startup_ns(calc_startup_phase phase);
+
+// Time to the first interactive frame: the sum of the phases marked so far
+uint64_t calc_startup_total_ns(void);
+
+// Called after each mark when set, e.g. to attribute runtime traffic to phases
+extern void (*calc_startup_observer)(calc_startup_phase phase);
+
+#endif
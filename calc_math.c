@@ -0,0 +1,681 @@
+// Scientific Functions - scalar and vector builds of shared kernels
+//
+// calc_math_kernels.h is included three times: with plain doubles (the scalar
+// functions, and the scalar batch), with 2-lane vectors (SSE2 or NEON) and
+// with 4-lane vectors compiled for AVX2. GCC/Clang vector extensions map the
+// same source onto each. Arguments the kernels cannot take in vector form
+// (huge trigonometric arguments, exact factorials) go through the scalar
+// functions, which handle them first.
+
+#include "calc_math.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#define CALC_MATH_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define CALC_MATH_ARM 1
+#include <arm_neon.h>
+#endif
+
+// The kernels need every operation rounded on its own (Dekker products,
+// Cody-Waite reduction), so no contraction into fused multiply-adds
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+// ============================================================================
+// Constants
+// ============================================================================
+
+// x + ROUND_MAGIC - ROUND_MAGIC rounds |x| < 2^51 to an integer, which is
+// also the low bits of x + ROUND_MAGIC
+#define ROUND_MAGIC 0x1.8p52
+#define ROUND_MAGIC_BITS 0x4338000000000000ULL
+
+// ln 2 with 32 trailing zero bits in the head, so n * LN2_HI is exact
+#define LN2_HI 6.93147180369123816490e-01
+#define LN2_LO 1.90821492927058770002e-10
+#define INV_LN2_32 46.16624130844683
+#define LN2_32_HI (LN2_HI / 32)
+#define LN2_32_LO (LN2_LO / 32)
+#define EXP_OVERFLOW 7.09782712893383973096e+02
+#define EXP_UNDERFLOW -7.45133219101941108420e+02
+
+// 2^(j/32) = exp_table_hi[j] + exp_table_lo[j]
+static const double exp_table_hi[32] = {
+	1.0, 1.0218971486541166, 1.0442737824274138, 1.0671404006768237,
+	1.0905077326652577, 1.1143867425958924, 1.1387886347566916, 1.1637248587775775,
+	1.189207115002721, 1.215247359980469, 1.241857812073484, 1.2690509571917332,
+	1.2968395546510096, 1.3252366431597413, 1.3542555469368927, 1.383909881963832,
+	1.4142135623730951, 1.4451808069770467, 1.4768261459394993, 1.5091644275934228,
+	1.5422108254079407, 1.5759808451078865, 1.6104903319492543, 1.645755478153965,
+	1.681792830507429, 1.718619298122478, 1.7562521603732995, 1.7947090750031072,
+	1.8340080864093424, 1.8741676341103, 1.9152065613971474, 1.9571441241754002,
+};
+
+static const double exp_table_lo[32] = {
+	0.0, 5.109225028973444e-17, 8.551889705537965e-17, -7.899853966841582e-17,
+	-3.046782079812471e-17, 1.0410278456845571e-16, 8.912812676025408e-17, 3.8292048369240935e-17,
+	3.982015231465646e-17, -7.712630692681488e-17, 4.658027591836937e-17, 2.667932131342186e-18,
+	2.5382502794888315e-17, -2.8587312100388614e-17, 7.70094837980299e-17, -6.770511658794786e-17,
+	-9.667293313452913e-17, -3.0237581349939873e-17, -3.483994556892796e-17, -1.016455327754295e-16,
+	7.949834809697621e-17, -1.0136916471278304e-17, 2.4707192569797888e-17, -1.0125679913674773e-16,
+	8.199010020581497e-17, -1.851380418263111e-17, 2.960140695448873e-17, 1.8227458427912087e-17,
+	3.283107224245627e-17, -6.122763413004143e-17, -1.0619946056195963e-16, 8.960767791036668e-17,
+};
+
+// atanh(s)/s = 1 + s^2 (1/3 + s^2 LOG_Q1 + ...), LOG_Qj = 1/(2j + 3); the
+// s^3/3 term is carried in double-double
+#define LOG_THIRD_HI (1.0 / 3)
+#define LOG_THIRD_LO 1.850371707708594e-17
+#define LOG_Q1 (1.0 / 5)
+#define LOG_Q2 (1.0 / 7)
+#define LOG_Q3 (1.0 / 9)
+#define LOG_Q4 (1.0 / 11)
+#define LOG_Q5 (1.0 / 13)
+#define LOG_Q6 (1.0 / 15)
+#define LOG_Q7 (1.0 / 17)
+#define LOG_Q8 (1.0 / 19)
+#define LOG_Q9 (1.0 / 21)
+#define LOG_Q10 (1.0 / 23)
+#define LOG_Q11 (1.0 / 25)
+
+#define INV_LN10_HI 0.4342944819032518
+#define INV_LN10_LO 1.098319650216765e-17
+
+#define SIN_S1 -1.66666666666666324348e-01
+#define SIN_S2 8.33333333332248946124e-03
+#define SIN_S3 -1.98412698298579493134e-04
+#define SIN_S4 2.75573137070700676789e-06
+#define SIN_S5 -2.50507602534068634195e-08
+#define SIN_S6 1.58969099521155010221e-10
+
+#define COS_C1 4.16666666666666019037e-02
+#define COS_C2 -1.38888888888741095749e-03
+#define COS_C3 2.48015872894767294178e-05
+#define COS_C4 -2.75573143513906633035e-07
+#define COS_C5 2.08757232129817482790e-09
+#define COS_C6 -1.13596475577881948265e-11
+
+// pi/2 = PIO2_1 + PIO2_2 + PIO2_3 + PIO2_3T to 152 bits
+#define INV_PIO2 6.36619772367581382433e-01
+#define PIO2_1 1.57079632673412561417e+00
+#define PIO2_2 6.07710050630396597660e-11
+#define PIO2_3 2.02226624871116645580e-21
+#define PIO2_3T 8.47842766036889956997e-32
+#define PIO2_HI 1.57079632679489655800e+00
+#define PIO2_LO 6.12323399573676603587e-17
+#define PIO4_HI 7.85398163397448278999e-01
+#define PIO4_LO 3.06161699786838301793e-17
+#define PI_HI 3.141592653589793
+#define PI_LO 1.2246467991473532e-16
+
+#define TAN_T0 3.33333333333334091986e-01
+#define TAN_T1 1.33333333333201242699e-01
+#define TAN_T2 5.39682539762260521377e-02
+#define TAN_T3 2.18694882948595424599e-02
+#define TAN_T4 8.86323982359930005737e-03
+#define TAN_T5 3.59207910759131235356e-03
+#define TAN_T6 1.45620945432529025516e-03
+#define TAN_T7 5.88041240820264096874e-04
+#define TAN_T8 2.46463134818469906812e-04
+#define TAN_T9 7.81794442939557092300e-05
+#define TAN_T10 7.14072491382608190305e-05
+#define TAN_T11 -1.85586374855275456654e-05
+#define TAN_T12 2.59073051863633712884e-05
+
+// Reduction below this uses Cody-Waite; above, Payne-Hanek
+#define TRIG_MEDIUM 0x1p20
+#define TRIG_LARGE(x) (!(fabs(x) < TRIG_MEDIUM))
+
+// atan(0.5), atan(1), atan(1.5), atan(inf) as head + tail
+#define ATAN_HI_0 4.63647609000806093515e-01
+#define ATAN_HI_1 7.85398163397448278999e-01
+#define ATAN_HI_2 9.82793723247329054082e-01
+#define ATAN_HI_3 1.57079632679489655800e+00
+#define ATAN_LO_0 2.26987774529616870924e-17
+#define ATAN_LO_1 3.06161699786838301793e-17
+#define ATAN_LO_2 1.39033110312309984516e-17
+#define ATAN_LO_3 6.12323399573676603587e-17
+
+#define ATAN_T0 3.33333333333329318027e-01
+#define ATAN_T1 -1.99999999998764832476e-01
+#define ATAN_T2 1.42857142725034663711e-01
+#define ATAN_T3 -1.11111104054623557880e-01
+#define ATAN_T4 9.09088713343650656196e-02
+#define ATAN_T5 -7.69187620504482999495e-02
+#define ATAN_T6 6.66107313738753120669e-02
+#define ATAN_T7 -5.83357013379057348645e-02
+#define ATAN_T8 4.97687799461593236017e-02
+#define ATAN_T9 -3.65315727442169155270e-02
+#define ATAN_T10 1.62858201153657823623e-02
+
+#define ASIN_P0 1.66666666666666657415e-01
+#define ASIN_P1 -3.25565818622400915405e-01
+#define ASIN_P2 2.01212532134862925881e-01
+#define ASIN_P3 -4.00555345006794114027e-02
+#define ASIN_P4 7.91534994289814532176e-04
+#define ASIN_P5 3.47933107596021167570e-05
+#define ASIN_Q1 -2.40339491173441421878e+00
+#define ASIN_Q2 2.02094576023350569471e+00
+#define ASIN_Q3 -6.88283971605453293030e-01
+#define ASIN_Q4 7.70381505559019352791e-02
+
+// Taylor coefficients of tanh x after x
+#define TANH_T1 (-1.0 / 3)
+#define TANH_T2 (2.0 / 15)
+#define TANH_T3 (-17.0 / 315)
+#define TANH_T4 (62.0 / 2835)
+#define TANH_T5 (-1382.0 / 155925)
+#define TANH_T6 (21844.0 / 6081075)
+#define TANH_T7 (-929569.0 / 638512875)
+#define TANH_T8 (6404582.0 / 10854718875.0)
+
+#define ASIN_P0 1.66666666666666657415e-01
+#define ASIN_P1 -3.25565818622400915405e-01
+#define ASIN_P2 2.01212532134862925881e-01
+#define ASIN_P3 -4.00555345006794114027e-02
+#define ASIN_P4 7.91534994289814532176e-04
+#define ASIN_P5 3.47933107596021167570e-05
+#define ASIN_Q1 -2.40339491173441421878e+00
+#define ASIN_Q2 2.02094576023350569471e+00
+#define ASIN_Q3 -6.88283971605453293030e-01
+#define ASIN_Q4 7.70381505559019352791e-02
+
+// Taylor coefficients of tanh x after x
+#define TANH_T1 (-1.0 / 3)
+#define TANH_T2 (2.0 / 15)
+#define TANH_T3 (-17.0 / 315)
+#define TANH_T4 (62.0 / 2835)
+#define TANH_T5 (-1382.0 / 155925)
+#define TANH_T6 (21844.0 / 6081075)
+#define TANH_T7 (-929569.0 / 638512875)
+#define TANH_T8 (6404582.0 / 10854718875.0)
+
+// ln sqrt(2 pi), and B_2k / (2k (2k - 1)) for Stirling's series
+#define LN_SQRT_2PI_HI 0.9189385332046728
+#define LN_SQRT_2PI_LO -3.8782941580672414e-17
+#define STIRLING_1 (1.0 / 12)
+#define STIRLING_2 (-1.0 / 360)
+#define STIRLING_3 (1.0 / 1260)
+#define STIRLING_4 (-1.0 / 1680)
+#define STIRLING_5 (1.0 / 1188)
+#define STIRLING_6 (-691.0 / 360360)
+#define STIRLING_7 (1.0 / 156)
+#define STIRLING_8 (-3617.0 / 122400)
+#define STIRLING_9 (43867.0 / 244188)
+
+// n! correctly rounded, n = 0..170
+static const double factorials[171] = {
+	1.0, 1.0, 2.0, 6.0,
+	24.0, 120.0, 720.0, 5040.0,
+	40320.0, 362880.0, 3628800.0, 39916800.0,
+	479001600.0, 6227020800.0, 87178291200.0, 1307674368000.0,
+	20922789888000.0, 355687428096000.0, 6402373705728000.0, 1.21645100408832e+17,
+	2.43290200817664e+18, 5.109094217170944e+19, 1.1240007277776077e+21, 2.585201673888498e+22,
+	6.204484017332394e+23, 1.5511210043330986e+25, 4.0329146112660565e+26, 1.0888869450418352e+28,
+	3.0488834461171387e+29, 8.841761993739702e+30, 2.6525285981219107e+32, 8.222838654177922e+33,
+	2.631308369336935e+35, 8.683317618811886e+36, 2.9523279903960416e+38, 1.0333147966386145e+40,
+	3.7199332678990125e+41, 1.3763753091226346e+43, 5.230226174666011e+44, 2.0397882081197444e+46,
+	8.159152832478977e+47, 3.345252661316381e+49, 1.40500611775288e+51, 6.041526306337383e+52,
+	2.658271574788449e+54, 1.1962222086548019e+56, 5.502622159812089e+57, 2.5862324151116818e+59,
+	1.2413915592536073e+61, 6.082818640342675e+62, 3.0414093201713376e+64, 1.5511187532873822e+66,
+	8.065817517094388e+67, 4.2748832840600255e+69, 2.308436973392414e+71, 1.2696403353658276e+73,
+	7.109985878048635e+74, 4.0526919504877214e+76, 2.3505613312828785e+78, 1.3868311854568984e+80,
+	8.32098711274139e+81, 5.075802138772248e+83, 3.146997326038794e+85, 1.98260831540444e+87,
+	1.2688693218588417e+89, 8.247650592082472e+90, 5.443449390774431e+92, 3.647111091818868e+94,
+	2.4800355424368305e+96, 1.711224524281413e+98, 1.1978571669969892e+100, 8.504785885678623e+101,
+	6.1234458376886085e+103, 4.4701154615126844e+105, 3.307885441519386e+107, 2.48091408113954e+109,
+	1.8854947016660504e+111, 1.4518309202828587e+113, 1.1324281178206297e+115, 8.946182130782976e+116,
+	7.156945704626381e+118, 5.797126020747368e+120, 4.753643337012842e+122, 3.945523969720659e+124,
+	3.314240134565353e+126, 2.81710411438055e+128, 2.4227095383672734e+130, 2.107757298379528e+132,
+	1.8548264225739844e+134, 1.650795516090846e+136, 1.4857159644817615e+138, 1.352001527678403e+140,
+	1.2438414054641308e+142, 1.1567725070816416e+144, 1.087366156656743e+146, 1.032997848823906e+148,
+	9.916779348709496e+149, 9.619275968248212e+151, 9.426890448883248e+153, 9.332621544394415e+155,
+	9.332621544394415e+157, 9.42594775983836e+159, 9.614466715035127e+161, 9.90290071648618e+163,
+	1.0299016745145628e+166, 1.081396758240291e+168, 1.1462805637347084e+170, 1.226520203196138e+172,
+	1.324641819451829e+174, 1.4438595832024937e+176, 1.588245541522743e+178, 1.7629525510902446e+180,
+	1.974506857221074e+182, 2.2311927486598138e+184, 2.5435597334721877e+186, 2.925093693493016e+188,
+	3.393108684451898e+190, 3.969937160808721e+192, 4.684525849754291e+194, 5.574585761207606e+196,
+	6.689502913449127e+198, 8.094298525273444e+200, 9.875044200833601e+202, 1.214630436702533e+205,
+	1.506141741511141e+207, 1.882677176888926e+209, 2.372173242880047e+211, 3.0126600184576594e+213,
+	3.856204823625804e+215, 4.974504222477287e+217, 6.466855489220474e+219, 8.47158069087882e+221,
+	1.1182486511960043e+224, 1.4872707060906857e+226, 1.9929427461615188e+228, 2.6904727073180504e+230,
+	3.659042881952549e+232, 5.012888748274992e+234, 6.917786472619489e+236, 9.615723196941089e+238,
+	1.3462012475717526e+241, 1.898143759076171e+243, 2.695364137888163e+245, 3.854370717180073e+247,
+	5.5502938327393044e+249, 8.047926057471992e+251, 1.1749972043909107e+254, 1.727245890454639e+256,
+	2.5563239178728654e+258, 3.80892263763057e+260, 5.713383956445855e+262, 8.62720977423324e+264,
+	1.3113358856834524e+267, 2.0063439050956823e+269, 3.0897696138473508e+271, 4.789142901463394e+273,
+	7.471062926282894e+275, 1.1729568794264145e+278, 1.853271869493735e+280, 2.9467022724950384e+282,
+	4.7147236359920616e+284, 7.590705053947219e+286, 1.2296942187394494e+289, 2.0044015765453026e+291,
+	3.287218585534296e+293, 5.423910666131589e+295, 9.003691705778438e+297, 1.503616514864999e+300,
+	2.5260757449731984e+302, 4.269068009004705e+304, 7.257415615307999e+306,
+};
+
+static int factorial_exact(double x) {
+	return x >= 0 && x <= 170 && x == (double)(int)x;
+}
+
+#define FACTORIAL_EXACT(x) factorial_exact(x)
+
+// ============================================================================
+// Scalar Kernels
+// ============================================================================
+
+static inline uint64_t bits_of(double x) {
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return bits;
+}
+
+static inline double double_of(uint64_t bits) {
+	double x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+#define VD double
+#define VU uint64_t
+#define VI int64_t
+#define WIDTH 1
+#define K(name) name##_scalar
+#define KERNEL static inline __attribute__((always_inline))
+#define BATCH static
+#define SPLAT(c) ((double)(c))
+#define AS_BITS(x) bits_of(x)
+#define AS_DOUBLE(u) double_of(u)
+#define LT(a, b) (-(VI)((a) < (b)))
+#define LE(a, b) (-(VI)((a) <= (b)))
+#define GT(a, b) (-(VI)((a) > (b)))
+#define GE(a, b) (-(VI)((a) >= (b)))
+#define EQ(a, b) (-(VI)((a) == (b)))
+#define NE(a, b) (-(VI)((a) != (b)))
+#define SELECT(m, a, b) ((m) ? (a) : (b))
+#define SQRT(x) __builtin_sqrt(x)
+#define GATHER(table, index) ((table)[index])
+#include "calc_math_kernels.h"
+#undef VD
+#undef VU
+#undef VI
+#undef WIDTH
+#undef K
+#undef KERNEL
+#undef BATCH
+#undef SPLAT
+#undef AS_BITS
+#undef AS_DOUBLE
+#undef LT
+#undef LE
+#undef GT
+#undef GE
+#undef EQ
+#undef NE
+#undef SELECT
+#undef SQRT
+#undef GATHER
+
+// ============================================================================
+// Vector Kernels
+// ============================================================================
+
+#define AS_BITS(x) ((VU)(x))
+#define AS_DOUBLE(u) ((VD)(u))
+#define SPLAT(c) ((VD){0} + (c))
+#define LT(a, b) ((VI)((a) < (b)))
+#define LE(a, b) ((VI)((a) <= (b)))
+#define GT(a, b) ((VI)((a) > (b)))
+#define GE(a, b) ((VI)((a) >= (b)))
+#define EQ(a, b) ((VI)((a) == (b)))
+#define NE(a, b) ((VI)((a) != (b)))
+#define SELECT(m, a, b) AS_DOUBLE((AS_BITS(a) & (VU)(m)) | (AS_BITS(b) & ~(VU)(m)))
+#define GATHER(table, index) ({ \
+	VD gathered_; \
+	for (int lane_ = 0; lane_ < WIDTH; lane_++) { \
+		gathered_[lane_] = (table)[(index)[lane_]]; \
+	} \
+	gathered_; \
+})
+#define GATHER(table, index) ({ \
+	VD gathered_; \
+	for (int lane_ = 0; lane_ < WIDTH; lane_++) { \
+		gathered_[lane_] = (table)[(index)[lane_]]; \
+	} \
+	gathered_; \
+})
+
+#if defined(CALC_MATH_X86) || defined(CALC_MATH_ARM)
+
+typedef double v2df __attribute__((vector_size(16)));
+typedef uint64_t v2du __attribute__((vector_size(16)));
+typedef int64_t v2di __attribute__((vector_size(16)));
+
+#define VD v2df
+#define VU v2du
+#define VI v2di
+#define WIDTH 2
+#define K(name) name##_v2
+#define KERNEL static inline __attribute__((always_inline))
+#define BATCH static
+#ifdef CALC_MATH_X86
+#define SQRT(x) ((VD)_mm_sqrt_pd((__m128d)(x)))
+#else
+#define SQRT(x) ((VD)vsqrtq_f64((float64x2_t)(x)))
+#endif
+#include "calc_math_kernels.h"
+#undef VD
+#undef VU
+#undef VI
+#undef WIDTH
+#undef K
+#undef KERNEL
+#undef BATCH
+#undef SQRT
+
+#endif
+
+#ifdef CALC_MATH_X86
+
+typedef double v4df __attribute__((vector_size(32)));
+typedef uint64_t v4du __attribute__((vector_size(32)));
+typedef int64_t v4di __attribute__((vector_size(32)));
+
+#define VD v4df
+#define VU v4du
+#define VI v4di
+#define WIDTH 4
+#define K(name) name##_v4
+#define KERNEL static inline __attribute__((always_inline, target("avx2")))
+#define BATCH static __attribute__((target("avx2")))
+#define SQRT(x) ((VD)_mm256_sqrt_pd((__m256d)(x)))
+#undef GATHER
+#define GATHER(table, index) ((VD)_mm256_i64gather_pd((table), (__m256i)(index), 8))
+#include "calc_math_kernels.h"
+#undef VD
+#undef VU
+#undef VI
+#undef WIDTH
+#undef K
+#undef KERNEL
+#undef BATCH
+#undef SQRT
+
+#endif
+
+// ============================================================================
+// Large Trigonometric Arguments
+// ============================================================================
+
+// 2/pi in binary, most significant bit first (1280 bits)
+static const uint64_t two_over_pi[20] = {
+	0xa2f9836e4e441529, 0xfc2757d1f534ddc0, 0xdb6295993c439041, 0xfe5163abdebbc561,
+	0xb7246e3a424dd2e0, 0x06492eea09d1921c, 0xfe1deb1cb129a73e, 0xe88235f52ebb4484,
+	0xe99c7026b45f7e41, 0x3991d639835339f4, 0x9c845f8bbdf9283b, 0x1ff897ffde05980f,
+	0xef2f118b5a0a6d1f, 0x6d367ecf27cb09b7, 0x4f463f669e5fea2d, 0x7527bac7ebe5f17b,
+	0x3d0739f78a5292ea, 0x6bfb5fb11f8d5d08, 0x56033046fc7b6bab, 0xf0cfbc209af4361d,
+};
+
+// x = n pi/2 + (*y0 + *y1) for finite |x| >= TRIG_MEDIUM (Payne-Hanek): only a
+// 192-bit window of 2/pi matters, since earlier bits contribute multiples of 4
+// to x * 2/pi and later ones less than 2^-128
+static int64_t reduce_large(double x, double* y0, double* y1) {
+	uint64_t bits = bits_of(x);
+	int exponent = (int)((bits >> 52) & 0x7ff) - 1075;  // |x| = mantissa * 2^exponent
+	uint64_t mantissa = (bits & 0x000fffffffffffffULL) | 0x0010000000000000ULL;
+	
+	// Bit i of 2/pi is worth 2^-i; the window starts at bit first
+	int first = exponent > 2 ? exponent - 1 : 1;
+	int word = (first - 1) / 64;
+	int shift = (first - 1) % 64;
+	uint64_t window[3];
+	for (int k = 0; k < 3; k++) {
+		window[k] = two_over_pi[word + k];
+		if (shift) {
+			window[k] = (window[k] << shift) | (two_over_pi[word + k + 1] >> (64 - shift));
+		}
+	}
+	
+	// mantissa * window, 256 bits, with fraction_bits below the binary point
+	unsigned __int128 t = (unsigned __int128)mantissa * window[2];
+	uint64_t p0 = (uint64_t)t;
+	t = (unsigned __int128)mantissa * window[1] + (t >> 64);
+	unsigned __int128 low = ((unsigned __int128)(uint64_t)t << 64) | p0;
+	t = (unsigned __int128)mantissa * window[0] + (t >> 64);
+	unsigned __int128 high = t;
+	int fraction_bits = first + 191 - exponent;  // 190 to 224
+	int s = fraction_bits - 128;
+	
+	int64_t n = (int64_t)(high >> s) & 3;
+	unsigned __int128 fraction = (low >> s) | (high << (128 - s));
+	
+	// Round to the nearest quadrant: fractions of 1/2 or more count from n + 1
+	int negative = (int)(fraction >> 127);
+	n += negative;
+	unsigned __int128 magnitude = negative ? -fraction : fraction;
+	double f_hi = 0.0, f_lo = 0.0;
+	if (magnitude) {
+		uint64_t top = (uint64_t)(magnitude >> 64);
+		int zeros = top ? __builtin_clzll(top) : 64 + __builtin_clzll((uint64_t)magnitude);
+		magnitude <<= zeros;
+		f_hi = ldexp((double)(uint64_t)(magnitude >> 75), -53 - zeros);
+		f_lo = ldexp((double)((uint64_t)(magnitude >> 22) & 0x001fffffffffffffULL), -106 - zeros);
+		if (negative) {
+			f_hi = -f_hi;
+			f_lo = -f_lo;
+		}
+	}
+	
+	// Times pi/2
+	double p_err;
+	double p = two_prod_scalar(f_hi, PIO2_HI, &p_err);
+	*y0 = fast_two_sum_scalar(p, p_err + (f_hi * PIO2_LO + f_lo * PIO2_HI), y1);
+	if (x < 0) {
+		*y0 = -*y0;
+		*y1 = -*y1;
+		n = -n;
+	}
+	return n;
+}
+
+// ============================================================================
+// Scalar API
+// ============================================================================
+
+double calc_sqrt(double x) {
+	return sqrt_scalar(x);
+}
+
+double calc_exp(double x) {
+	return exp_scalar(x);
+}
+
+double calc_ln(double x) {
+	return ln_scalar(x);
+}
+
+double calc_log10(double x) {
+	return log10_scalar(x);
+}
+
+double calc_sin(double x) {
+	if (TRIG_LARGE(x) && isfinite(x)) {
+		double y0, y1;
+		int64_t n = reduce_large(x, &y0, &y1);
+		return quadrant_scalar(n, y0, y1, 0);
+	}
+	return sin_scalar(x);
+}
+
+double calc_cos(double x) {
+	if (TRIG_LARGE(x) && isfinite(x)) {
+		double y0, y1;
+		int64_t n = reduce_large(x, &y0, &y1);
+		return quadrant_scalar(n, y0, y1, 1);
+	}
+	return cos_scalar(x);
+}
+
+double calc_tan(double x) {
+	if (TRIG_LARGE(x) && isfinite(x)) {
+		double y0, y1;
+		int64_t n = reduce_large(x, &y0, &y1);
+		return tan_kernel_scalar(y0, y1, -(n & 1));
+	}
+	return tan_scalar(x);
+}
+
+double calc_asin(double x) {
+	return asin_scalar(x);
+}
+
+double calc_acos(double x) {
+	return acos_scalar(x);
+}
+
+double calc_atan(double x) {
+	return atan_scalar(x);
+}
+
+double calc_sinh(double x) {
+	return sinh_scalar(x);
+}
+
+double calc_cosh(double x) {
+	return cosh_scalar(x);
+}
+
+double calc_tanh(double x) {
+	return tanh_scalar(x);
+}
+
+double calc_factorial(double x) {
+	if (factorial_exact(x)) {
+		return factorials[(int)x];
+	}
+	return factorial_scalar(x);
+}
+
+double calc_gamma(double x) {
+	return gamma_scalar(x);
+}
+
+double calc_percent(double x) {
+	return percent_scalar(x);
+}
+
+double calc_pow(double x, double y) {
+	return pow_scalar(x, y);
+}
+
+double calc_math_apply(calc_function function, double x) {
+	switch (function) {
+		case CALC_SQRT: return calc_sqrt(x);
+		case CALC_EXP: return calc_exp(x);
+		case CALC_LN: return calc_ln(x);
+		case CALC_LOG10: return calc_log10(x);
+		case CALC_SIN: return calc_sin(x);
+		case CALC_COS: return calc_cos(x);
+		case CALC_TAN: return calc_tan(x);
+		case CALC_ASIN: return calc_asin(x);
+		case CALC_ACOS: return calc_acos(x);
+		case CALC_ATAN: return calc_atan(x);
+		case CALC_SINH: return calc_sinh(x);
+		case CALC_COSH: return calc_cosh(x);
+		case CALC_TANH: return calc_tanh(x);
+		case CALC_FACTORIAL: return calc_factorial(x);
+		case CALC_GAMMA: return calc_gamma(x);
+		case CALC_PERCENT: return calc_percent(x);
+		default: return x;
+	}
+}
+
+const char* calc_function_name(calc_function function) {
+	static const char* const names[CALC_FUNCTION_COUNT] = {
+		"sqrt", "exp", "ln", "log10", "sin", "cos", "tan", "asin", "acos", "atan",
+		"sinh", "cosh", "tanh", "factorial", "gamma", "percent"
+	};
+	return (unsigned)function < CALC_FUNCTION_COUNT ? names[function] : "?";
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+typedef size_t (*math_batch_fn)(calc_function function, double* out, const double* in, size_t count);
+typedef size_t (*pow_batch_fn)(double* out, const double* x, const double* y, size_t count);
+
+static calc_batch_isa g_isa = CALC_BATCH_SCALAR;
+static math_batch_fn g_batch = NULL;  // NULL until the first call picks the best ISA
+static pow_batch_fn g_batch_pow = NULL;
+
+static int isa_supported(calc_batch_isa isa) {
+	switch (isa) {
+		case CALC_BATCH_SCALAR: return 1;
+#ifdef CALC_MATH_X86
+		case CALC_BATCH_SSE2: return __builtin_cpu_supports("sse2");
+		case CALC_BATCH_AVX2: return __builtin_cpu_supports("avx2");
+#endif
+#ifdef CALC_MATH_ARM
+		case CALC_BATCH_NEON: return 1;
+#endif
+		default: return 0;
+	}
+}
+
+int calc_math_select(calc_batch_isa isa) {
+	if (!isa_supported(isa)) {
+		return 0;
+	}
+	switch (isa) {
+#ifdef CALC_MATH_X86
+		case CALC_BATCH_SSE2: g_batch_pow = batch_pow_v2; g_batch = batch_v2; break;
+		case CALC_BATCH_AVX2: g_batch_pow = batch_pow_v4; g_batch = batch_v4; break;
+#endif
+#ifdef CALC_MATH_ARM
+		case CALC_BATCH_NEON: g_batch_pow = batch_pow_v2; g_batch = batch_v2; break;
+#endif
+		default: g_batch_pow = batch_pow_scalar; g_batch = batch_scalar; break;
+	}
+	g_isa = isa;
+	return 1;
+}
+
+static void select_best(void) {
+	static const calc_batch_isa preference[] = {
+		CALC_BATCH_AVX2, CALC_BATCH_NEON, CALC_BATCH_SSE2, CALC_BATCH_SCALAR
+	};
+	for (size_t i = 0; !calc_math_select(preference[i]); i++) {}
+}
+
+calc_batch_isa calc_math_active(void) {
+	if (!g_batch) {
+		select_best();
+	}
+	return g_isa;
+}
+
+// ============================================================================
+// Batch API
+// ============================================================================
+
+void calc_math_batch(calc_function function, double* out, const double* in, size_t count) {
+	if (!g_batch) {
+		select_best();
+	}
+	for (size_t i = g_batch(function, out, in, count); i < count; i++) {
+		out[i] = calc_math_apply(function, in[i]);
+	}
+}
+
+void calc_math_batch_pow(double* out, const double* x, const double* y, size_t count) {
+	if (!g_batch_pow) {
+		select_best();
+	}
+	for (size_t i = g_batch_pow(out, x, y, count); i < count; i++) {
+		out[i] = calc_pow(x[i], y[i]);
+	}
+}
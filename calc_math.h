@@ -0,0 +1,97 @@
+// Scientific Functions - the calculator's one-argument functions and pow
+//
+// Every function has a scalar form and a batch form over whole columns. The
+// batch code runs the same kernels on vectors (calc_batch's ISAs), so batch
+// results are bit-for-bit the scalar ones. Accuracy does not depend on libm.
+//
+// Maximum error in ULPs against a long-double reference, as measured by
+// bench/bench_math over its test domains:
+//
+//   sqrt, percent                     0.5 (correctly rounded)
+//   ln, log10                         0.51
+//   exp                               0.53
+//   pow                               0.6
+//   sin, cos                          0.85   any finite argument
+//   tan                               0.8
+//   asin, acos, atan                  0.9
+//   sinh, cosh, tanh                  0.6
+//   gamma, factorial                  1.0    factorial of 0..170 is exact
+//
+// Out-of-domain arguments give NaN and overflow gives infinity, as in C99
+// Annex F (tgamma for gamma; factorial(x) is gamma(x + 1)).
+
+#ifndef CALC_MATH_H
+#define CALC_MATH_H
+
+#include <stddef.h>
+
+#include "calc_batch.h"
+
+typedef enum calc_function {
+	CALC_SQRT,
+	CALC_EXP,
+	CALC_LN,
+	CALC_LOG10,
+	CALC_SIN,                // Radians
+	CALC_COS,
+	CALC_TAN,
+	CALC_ASIN,
+	CALC_ACOS,
+	CALC_ATAN,
+	CALC_SINH,
+	CALC_COSH,
+	CALC_TANH,
+	CALC_FACTORIAL,          // x!, defined for non-integers as gamma(x + 1)
+	CALC_GAMMA,
+	CALC_PERCENT,            // x / 100
+	CALC_FUNCTION_COUNT
+} calc_function;
+
+// ============================================================================
+// Scalar
+// ============================================================================
+
+double calc_sqrt(double x);
+double calc_exp(double x);
+double calc_ln(double x);
+double calc_log10(double x);
+double calc_sin(double x);
+double calc_cos(double x);
+double calc_tan(double x);
+double calc_asin(double x);
+double calc_acos(double x);
+double calc_atan(double x);
+double calc_sinh(double x);
+double calc_cosh(double x);
+double calc_tanh(double x);
+double calc_factorial(double x);
+double calc_gamma(double x);
+double calc_percent(double x);
+
+// x raised to y, with C99's special cases (pow(x, 0) = 1, pow(-8, 1/3) = NaN)
+double calc_pow(double x, double y);
+
+// The function by enumerator
+double calc_math_apply(calc_function function, double x);
+
+// Short name, e.g. "sqrt", "ln", "asin"
+const char* calc_function_name(calc_function function);
+
+// ============================================================================
+// Batch
+// ============================================================================
+
+// out[i] = function(in[i]); out may alias in
+void calc_math_batch(calc_function function, double* out, const double* in, size_t count);
+
+// out[i] = calc_pow(x[i], y[i]); out may alias x or y
+void calc_math_batch_pow(double* out, const double* x, const double* y, size_t count);
+
+// Implementation in use; the best supported one until calc_math_select.
+// Chosen independently of calc_batch_select.
+calc_batch_isa calc_math_active(void);
+
+// Force an implementation (for benchmarking); returns 0 if the CPU lacks it
+int calc_math_select(calc_batch_isa isa);
+
+#endif
@@ -0,0 +1,690 @@
+// Scientific Function Kernels - internal to calc_math.c
+//
+// Included once per vector width. The includer defines:
+//   VD, VU, VI       lanes of double, uint64_t and int64_t (plain scalars for
+//                    the scalar build)
+//   WIDTH            lanes per VD
+//   K(name)          the instantiation's name for a kernel
+//   KERNEL, BATCH    qualifiers for kernels and for the batch loops
+//   SPLAT(c)         c in every lane
+//   AS_BITS, AS_DOUBLE   reinterpret between VD and VU
+//   LT LE GT GE EQ NE    comparisons giving VI masks (all ones or zero)
+//   SELECT(m, a, b)  a where m is set, else b
+//   SQRT(x)          correctly rounded square root
+//
+// Kernels use only operations that round the same way in every lane width and
+// never branch on data, so each lane gets exactly the scalar result. The one
+// exception is trigonometric reduction of |x| >= TRIG_MEDIUM, which the batch
+// loops redo with the scalar functions.
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+KERNEL VD K(abs)(VD x) {
+	return AS_DOUBLE(AS_BITS(x) & 0x7fffffffffffffffULL);
+}
+
+KERNEL VD K(copysign)(VD magnitude, VD sign) {
+	return AS_DOUBLE((AS_BITS(magnitude) & 0x7fffffffffffffffULL) | (AS_BITS(sign) & 0x8000000000000000ULL));
+}
+
+KERNEL VI K(sign_mask)(VD x) {
+	return -(VI)(AS_BITS(x) >> 63);
+}
+
+// Nearest integer (ties to even) for any x
+KERNEL VD K(rint)(VD x) {
+	VD ax = K(abs)(x);
+	VD rounded = K(copysign)((ax + 0x1p52) - 0x1p52, x);
+	return SELECT(LT(ax, 0x1p52), rounded, x);
+}
+
+// Low bit of an integer-valued x with |x| < 2^53, as a mask
+KERNEL VI K(odd_mask)(VD x) {
+	VD ax = K(abs)(x);
+	VU bits = AS_BITS(SELECT(LT(ax, 0x1p52), ax + 0x1p52, ax));
+	return -(VI)(bits & 1) & LT(ax, 0x1p53);
+}
+
+// 2^k for -1022 <= k <= 1023
+KERNEL VD K(pow2)(VI k) {
+	return AS_DOUBLE(((VU)k + 1023) << 52);
+}
+
+// a + b = sum + *err exactly
+KERNEL VD K(two_sum)(VD a, VD b, VD* err) {
+	VD sum = a + b;
+	VD b_part = sum - a;
+	*err = (a - (sum - b_part)) + (b - b_part);
+	return sum;
+}
+
+// As two_sum, for |a| >= |b|
+KERNEL VD K(fast_two_sum)(VD a, VD b, VD* err) {
+	VD sum = a + b;
+	*err = b - (sum - a);
+	return sum;
+}
+
+// a * b = product + *err exactly (Dekker), for |a|, |b| < 2^996
+KERNEL VD K(two_prod)(VD a, VD b, VD* err) {
+	VD product = a * b;
+	VD a_split = 134217729.0 * a;
+	VD a_hi = a_split - (a_split - a);
+	VD a_lo = a - a_hi;
+	VD b_split = 134217729.0 * b;
+	VD b_hi = b_split - (b_split - b);
+	VD b_lo = b - b_hi;
+	*err = ((a_hi * b_hi - product) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo;
+	return product;
+}
+
+// ============================================================================
+// Exponential & Logarithm
+// ============================================================================
+
+// e^(x + tail) = (result + *lo) 2^*m for |tail| much smaller than 1 ULP of
+// x: x = (32m + j) ln2/32 + r with |r| <= ln2/64, and e^x = 2^m 2^(j/32) e^r
+// with 2^(j/32) from a double-double table. Good to about 2^-59 relative.
+KERNEL VD K(exp_parts)(VD x, VD tail, VD* lo, VI* m) {
+	VD shifted = x * INV_LN2_32 + ROUND_MAGIC;
+	VD n = shifted - ROUND_MAGIC;
+	VI k = (VI)(AS_BITS(shifted) - ROUND_MAGIC_BITS);
+	VD r = (x - n * LN2_32_HI) + (tail - n * LN2_32_LO);
+	VD p = r + r * r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040))))));
+	VI j = k & 31;
+	*m = k >> 5;
+	VD t_hi = GATHER(exp_table_hi, j);
+	VD t_lo = GATHER(exp_table_lo, j);
+	return K(fast_two_sum)(t_hi, t_lo + t_hi * p, lo);
+}
+
+// y 2^m in two steps, so that m may reach past either end of the exponent
+// range
+KERNEL VD K(scale)(VD y, VI m) {
+	VI half = m >> 1;
+	return y * K(pow2)(half) * K(pow2)(m - half);
+}
+
+KERNEL VD K(exp_dd)(VD x, VD tail) {
+	VD lo;
+	VI m;
+	VD hi = K(exp_parts)(x, tail, &lo, &m);
+	// Near and below the subnormal range, v = hi 2^(m + 1022) < 2. If v < 1,
+	// 1 + v has the subnormal spacing, so rounding it rounds the result once.
+	VI low = LT(m, -1021);
+	VD down = K(pow2)((m + 1022) & low);
+	VD v = hi * down;
+	VD big = 1.0 + v;
+	VD fix = ((1.0 - big) + v) + lo * down;
+	v = SELECT(LT(v, 1.0), (big + fix) - 1.0, v);
+	VD result = SELECT(low, v * K(pow2)(low & -1022), K(scale)(hi, m & ~low));
+	result = SELECT(GT(x, EXP_OVERFLOW), SPLAT(INFINITY), result);
+	result = SELECT(LT(x, EXP_UNDERFLOW), SPLAT(0.0), result);
+	return SELECT(NE(x, x), x, result);
+}
+
+KERNEL VD K(exp)(VD x) {
+	return K(exp_dd)(x, SPLAT(0.0));
+}
+
+// ln(x) = result + *lo for finite x > 0, to about 2^-66 relative.
+// x = 2^e * m with m in [sqrt(2)/2, sqrt(2)); ln(m) = 2 atanh(s) with
+// s = (m - 1)/(m + 1), carried as a double-double through the series.
+KERNEL VD K(log_dd)(VD x, VD* lo) {
+	VI subnormal = LT(x, 0x1p-1022);
+	x = SELECT(subnormal, x * 0x1p54, x);
+	VU bits = AS_BITS(x);
+	VU mantissa = bits & 0x000fffffffffffffULL;
+	VU upper = (mantissa + 0x00095f6400000000ULL) & 0x0010000000000000ULL;
+	VD m = AS_DOUBLE(mantissa | (upper ^ 0x3ff0000000000000ULL));
+	VI e = (VI)(bits >> 52) - 1023 + (VI)(upper >> 52) - (subnormal & 54);
+	VD exponent = AS_DOUBLE((VU)e + ROUND_MAGIC_BITS) - ROUND_MAGIC;
+	
+	VD f = m - 1.0;
+	VD den_err;
+	VD den = K(two_sum)(m, SPLAT(1.0), &den_err);
+	VD s = f / den;
+	VD p_err;
+	VD p = K(two_prod)(s, den, &p_err);
+	VD s_lo = (((f - p) - p_err) - s * den_err) / den;
+	
+	VD z_lo;
+	VD z = K(two_prod)(s, s, &z_lo);
+	VD head = 2.0 * s;
+	VD cube_lo;
+	VD cube = K(two_prod)(head, z, &cube_lo);
+	cube_lo = cube_lo + head * z_lo;
+	VD third_lo;
+	VD third = K(two_prod)(cube, SPLAT(LOG_THIRD_HI), &third_lo);
+	third_lo = third_lo + (cube * LOG_THIRD_LO + cube_lo * LOG_THIRD_HI);
+	VD series = LOG_Q1 + z * (LOG_Q2 + z * (LOG_Q3 + z * (LOG_Q4 + z * (LOG_Q5
+		+ z * (LOG_Q6 + z * (LOG_Q7 + z * (LOG_Q8 + z * (LOG_Q9 + z * (LOG_Q10 + z * LOG_Q11)))))))));
+	// 2 atanh(s + s_lo) = 2 atanh(s) + 2 s_lo / (1 - s^2) to first order
+	VD tail = third_lo + (2.0 * s_lo + 2.0 * s_lo * z) + cube * z * series;
+	
+	VD sum_err;
+	VD sum = K(two_sum)(exponent * LN2_HI, head, &sum_err);
+	VD third_err;
+	sum = K(two_sum)(sum, third, &third_err);
+	sum_err = sum_err + third_err;
+	return K(fast_two_sum)(sum, sum_err + tail + exponent * LN2_LO, lo);
+}
+
+// Special arguments of ln and log10
+KERNEL VD K(log_special)(VD x, VD result) {
+	result = SELECT(EQ(x, 0.0), SPLAT(-INFINITY), result);
+	result = SELECT(LT(x, 0.0), SPLAT(NAN), result);
+	result = SELECT(EQ(x, INFINITY), x, result);
+	return SELECT(NE(x, x), x, result);
+}
+
+KERNEL VD K(ln)(VD x) {
+	VD lo;
+	return K(log_special)(x, K(log_dd)(x, &lo));
+}
+
+KERNEL VD K(log10)(VD x) {
+	VD lo;
+	VD hi = K(log_dd)(x, &lo);
+	VD p_err;
+	VD p = K(two_prod)(hi, SPLAT(INV_LN10_HI), &p_err);
+	return K(log_special)(x, p + (p_err + (hi * INV_LN10_LO + lo * INV_LN10_HI)));
+}
+
+// x^y = e^(y ln|x|) with ln|x| and the product carried in double-double
+KERNEL VD K(pow)(VD x, VD y) {
+	VD ax = K(abs)(x);
+	VD log_lo;
+	VD log_hi = K(log_dd)(ax, &log_lo);
+	log_hi = SELECT(EQ(ax, 0.0), SPLAT(-INFINITY), log_hi);
+	log_hi = SELECT(EQ(ax, INFINITY), SPLAT(INFINITY), log_hi);
+	
+	VD p_err;
+	VD p = K(two_prod)(y, log_hi, &p_err);
+	// Far outside exp's range the tail may be NaN, and is not needed
+	VD tail = SELECT(LT(K(abs)(p), 1000.0), p_err + y * log_lo, SPLAT(0.0));
+	VD head_err;
+	VD head = K(fast_two_sum)(p, tail, &head_err);
+	head_err = SELECT(LT(K(abs)(p), 1000.0), head_err, SPLAT(0.0));
+	VD result = K(exp_dd)(head, head_err);
+	
+	// Sign and domain for negative x
+	VD ay = K(abs)(y);
+	VI integer = GE(ay, 0x1p52) | EQ(K(rint)(y), y);
+	result = SELECT(K(sign_mask)(x) & K(odd_mask)(y) & integer, -result, result);
+	result = SELECT(LT(x, 0.0) & ~integer, SPLAT(NAN), result);
+	result = SELECT(EQ(ax, 1.0) & EQ(ay, INFINITY), SPLAT(1.0), result);
+	return SELECT(EQ(y, 0.0) | EQ(x, 1.0), SPLAT(1.0), result);
+}
+
+// ============================================================================
+// Trigonometric
+// ============================================================================
+
+// sin(x + y) and cos(x + y) for |x| <= pi/4, |y| tiny (fdlibm's k_sin.c and
+// k_cos.c); *lo is the rounding error of the result
+KERNEL VD K(sin_kernel)(VD x, VD y, VD* lo) {
+	VD z = x * x;
+	VD v = z * x;
+	VD r = SIN_S2 + z * (SIN_S3 + z * (SIN_S4 + z * (SIN_S5 + z * SIN_S6)));
+	return K(fast_two_sum)(x, -((z * (0.5 * y - v * r) - y) - v * SIN_S1), lo);
+}
+
+KERNEL VD K(cos_kernel)(VD x, VD y, VD* lo) {
+	VD z = x * x;
+	VD r = z * (COS_C1 + z * (COS_C2 + z * (COS_C3 + z * (COS_C4 + z * (COS_C5 + z * COS_C6)))));
+	VD ax = K(abs)(x);
+	VD qx = AS_DOUBLE((AS_BITS(ax) - 0x0020000000000000ULL) & 0xffffffff00000000ULL);
+	qx = SELECT(GE(ax, 0x1.90001p-1), SPLAT(0.28125), qx);
+	qx = SELECT(LT(ax, 0x1.33333p-2), SPLAT(0.0), qx);
+	VD hz = 0.5 * z - qx;
+	VD a = 1.0 - qx;
+	return K(fast_two_sum)(a, -(hz - (z * r - x * y)), lo);
+}
+
+// x = n pi/2 + (*y0 + *y1) for |x| < TRIG_MEDIUM (Cody-Waite with pi/2 in
+// three 33-bit pieces and a 53-bit tail, so every n * piece is exact)
+KERNEL VI K(reduce)(VD x, VD* y0, VD* y1) {
+	VD shifted = x * INV_PIO2 + ROUND_MAGIC;
+	VD n = shifted - ROUND_MAGIC;
+	VD r = x - n * PIO2_1;
+	VD err_2;
+	VD r_2 = K(two_sum)(r, -(n * PIO2_2), &err_2);
+	VD err_3;
+	VD r_3 = K(two_sum)(r_2, -(n * PIO2_3), &err_3);
+	*y0 = K(fast_two_sum)(r_3, (err_2 + err_3) - n * PIO2_3T, y1);
+	return (VI)(AS_BITS(shifted) - ROUND_MAGIC_BITS);
+}
+
+// sin (cos if cosine) of n pi/2 + y0 + y1
+KERNEL VD K(quadrant)(VI n, VD y0, VD y1, int cosine) {
+	VD lo;
+	VD s = K(sin_kernel)(y0, y1, &lo);
+	VD c = K(cos_kernel)(y0, y1, &lo);
+	VU q = (VU)n + (uint64_t)cosine;
+	VD result = SELECT(-(VI)(q & 1), c, s);
+	return SELECT(-(VI)((q >> 1) & 1), -result, result);
+}
+
+// tan(x + y) for |x| <= pi/4, or -1/tan(x + y) where odd is set (fdlibm's
+// k_tan.c; above 0.6744 it works with pi/4 - |x| instead)
+KERNEL VD K(tan_kernel)(VD x, VD y, VI odd) {
+	VD sign = K(copysign)(SPLAT(1.0), x);
+	VI folded = GE(K(abs)(x), 0x1.59428p-1);
+	x = SELECT(folded, (PIO4_HI - K(abs)(x)) + (PIO4_LO - y * sign), x);
+	y = SELECT(folded, SPLAT(0.0), y);
+	
+	VD z = x * x;
+	VD w = z * z;
+	VD r = TAN_T1 + w * (TAN_T3 + w * (TAN_T5 + w * (TAN_T7 + w * (TAN_T9 + w * TAN_T11))));
+	VD v = z * (TAN_T2 + w * (TAN_T4 + w * (TAN_T6 + w * (TAN_T8 + w * (TAN_T10 + w * TAN_T12)))));
+	VD s = z * x;
+	r = y + z * (s * (r + v) + y);
+	r = r + TAN_T0 * s;
+	w = x + r;
+	
+	VD iy = SELECT(odd, SPLAT(-1.0), SPLAT(1.0));
+	VD near_pio4 = sign * (iy - 2.0 * (x - (w * w / (w + iy) - r)));
+	// -1/(x + r), correcting the division with the head of w
+	VD w_hi = AS_DOUBLE(AS_BITS(w) & 0xffffffff00000000ULL);
+	VD v_lo = r - (w_hi - x);
+	VD a = -1.0 / w;
+	VD t = AS_DOUBLE(AS_BITS(a) & 0xffffffff00000000ULL);
+	VD inverse = t + a * ((1.0 + t * w_hi) + t * v_lo);
+	return SELECT(folded, near_pio4, SELECT(odd, inverse, w));
+}
+
+// Lanes with |x| >= TRIG_MEDIUM are wrong here; the batch loops patch them.
+// Below 2^-27, sin x and tan x round to x (which keeps the sign of zero).
+KERNEL VD K(sin)(VD x) {
+	VD y0, y1;
+	VI n = K(reduce)(x, &y0, &y1);
+	VD result = SELECT(LT(K(abs)(x), 0x1p-27), x, K(quadrant)(n, y0, y1, 0));
+	return SELECT(LT(K(abs)(x), INFINITY), result, x - x);
+}
+
+KERNEL VD K(cos)(VD x) {
+	VD y0, y1;
+	VI n = K(reduce)(x, &y0, &y1);
+	return SELECT(LT(K(abs)(x), INFINITY), K(quadrant)(n, y0, y1, 1), x - x);
+}
+
+KERNEL VD K(tan)(VD x) {
+	VD y0, y1;
+	VI n = K(reduce)(x, &y0, &y1);
+	VD result = SELECT(LT(K(abs)(x), 0x1p-27), x, K(tan_kernel)(y0, y1, -(VI)((VU)n & 1)));
+	return SELECT(LT(K(abs)(x), INFINITY), result, x - x);
+}
+
+// fdlibm's s_atan.c: atan(|x|) = atan(c) + atan((|x| - c)/(1 + c|x|)) with c
+// one of 0, 1/2, 1, 3/2, infinity, chosen by |x|
+KERNEL VD K(atan)(VD x) {
+	VD ax = K(abs)(x);
+	VI band_0 = GE(ax, 0.4375);
+	VI band_1 = GE(ax, 0.6875);
+	VI band_2 = GE(ax, 1.1875);
+	VI band_3 = GE(ax, 2.4375) | NE(ax, ax);
+	
+	VD num = ax;
+	VD den = SPLAT(1.0);
+	VD hi = SPLAT(0.0);
+	VD lo = SPLAT(0.0);
+	num = SELECT(band_0, 2.0 * ax - 1.0, num);
+	den = SELECT(band_0, 2.0 + ax, den);
+	hi = SELECT(band_0, SPLAT(ATAN_HI_0), hi);
+	lo = SELECT(band_0, SPLAT(ATAN_LO_0), lo);
+	num = SELECT(band_1, ax - 1.0, num);
+	den = SELECT(band_1, ax + 1.0, den);
+	hi = SELECT(band_1, SPLAT(ATAN_HI_1), hi);
+	lo = SELECT(band_1, SPLAT(ATAN_LO_1), lo);
+	num = SELECT(band_2, ax - 1.5, num);
+	den = SELECT(band_2, 1.0 + 1.5 * ax, den);
+	hi = SELECT(band_2, SPLAT(ATAN_HI_2), hi);
+	lo = SELECT(band_2, SPLAT(ATAN_LO_2), lo);
+	num = SELECT(band_3, SPLAT(-1.0), num);
+	den = SELECT(band_3, ax, den);
+	hi = SELECT(band_3, SPLAT(ATAN_HI_3), hi);
+	lo = SELECT(band_3, SPLAT(ATAN_LO_3), lo);
+	
+	VD t = num / den;
+	VD z = t * t;
+	VD w = z * z;
+	VD s1 = z * (ATAN_T0 + w * (ATAN_T2 + w * (ATAN_T4 + w * (ATAN_T6 + w * (ATAN_T8 + w * ATAN_T10)))));
+	VD s2 = w * (ATAN_T1 + w * (ATAN_T3 + w * (ATAN_T5 + w * (ATAN_T7 + w * ATAN_T9))));
+	VD result = hi - ((t * (s1 + s2) - lo) - t);
+	return SELECT(NE(x, x), x, K(copysign)(result, x));
+}
+
+// asin(x) = x + x R(x^2) for |x| < 0.5, with R from fdlibm's e_asin.c
+KERNEL VD K(asin_ratio)(VD t) {
+	VD p = t * (ASIN_P0 + t * (ASIN_P1 + t * (ASIN_P2 + t * (ASIN_P3 + t * (ASIN_P4 + t * ASIN_P5)))));
+	VD q = 1.0 + t * (ASIN_Q1 + t * (ASIN_Q2 + t * (ASIN_Q3 + t * ASIN_Q4)));
+	return p / q;
+}
+
+// fdlibm's e_asin.c: above 0.5, asin(|x|) = pi/2 - 2 asin(sqrt((1 - |x|)/2)),
+// with the square root split in two between 0.5 and 0.975
+KERNEL VD K(asin)(VD x) {
+	VD ax = K(abs)(x);
+	VI small = LT(ax, 0.5);
+	VD t = SELECT(small, x * x, (1.0 - ax) * 0.5);
+	VD r = K(asin_ratio)(t);
+	VD s = SQRT(t);
+	VD near_one = PIO2_HI - (2.0 * (s + s * r) - PIO2_LO);
+	VD s_hi = AS_DOUBLE(AS_BITS(s) & 0xffffffff00000000ULL);
+	VD c = (t - s_hi * s_hi) / (s + s_hi);
+	VD middle = PIO4_HI - ((2.0 * s * r - (PIO2_LO - 2.0 * c)) - (PIO4_HI - 2.0 * s_hi));
+	VD result = SELECT(GE(ax, 0.975), near_one, middle);
+	result = SELECT(small, ax + ax * r, result);
+	return SELECT(NE(x, x), x, K(copysign)(result, x));
+}
+
+// fdlibm's e_acos.c, from the same R
+KERNEL VD K(acos)(VD x) {
+	VD ax = K(abs)(x);
+	VI small = LT(ax, 0.5);
+	VD t = SELECT(small, x * x, (1.0 - ax) * 0.5);
+	VD r = K(asin_ratio)(t);
+	VD s = SQRT(t);
+	VD middle = PIO2_HI - (x - (PIO2_LO - x * r));
+	VD negative = PI_HI - 2.0 * (s + (r * s - PIO2_LO));
+	VD s_hi = AS_DOUBLE(AS_BITS(s) & 0xffffffff00000000ULL);
+	VD c = (t - s_hi * s_hi) / (s + s_hi);
+	VD positive = 2.0 * (s_hi + (r * s + c));
+	VD result = SELECT(LT(x, 0.0), negative, positive);
+	result = SELECT(small, middle, result);
+	result = SELECT(EQ(x, 1.0), SPLAT(0.0), result);
+	return SELECT(NE(x, x), x, result);
+}
+
+// ============================================================================
+// Hyperbolic
+// ============================================================================
+
+// Taylor series near zero, where e^x - e^-x would cancel
+KERNEL VD K(sinh_series)(VD x) {
+	VD z = x * x;
+	return x + x * z * (1.0 / 6 + z * (1.0 / 120 + z * (1.0 / 5040 + z * (1.0 / 362880
+		+ z * (1.0 / 39916800 + z * (1.0 / 6227020800.0 + z * (1.0 / 1307674368000.0)))))));
+}
+
+KERNEL VD K(tanh_series)(VD x) {
+	VD z = x * x;
+	return x + x * z * (TANH_T1 + z * (TANH_T2 + z * (TANH_T3 + z * (TANH_T4 + z * (TANH_T5
+		+ z * (TANH_T6 + z * (TANH_T7 + z * TANH_T8)))))));
+}
+
+// e^x as a double-double, for |x| < 700
+KERNEL VD K(exp_pair)(VD x, VD* lo) {
+	VI m;
+	VD hi = K(exp_parts)(x, SPLAT(0.0), lo, &m);
+	VD scale = K(pow2)(m);
+	*lo = *lo * scale;
+	return hi * scale;
+}
+
+// 1/(hi + lo) as a double-double
+KERNEL VD K(reciprocal)(VD hi, VD lo, VD* result_lo) {
+	VD r = 1.0 / hi;
+	VD p_err;
+	VD p = K(two_prod)(r, hi, &p_err);
+	*result_lo = (((1.0 - p) - p_err) - r * lo) / hi;
+	return r;
+}
+
+// e^|x| / 2 for |x| >= 22, where e^-|x| no longer shows
+KERNEL VD K(half_exp)(VD ax) {
+	VD lo;
+	VI m;
+	VD hi = K(exp_parts)(ax, SPLAT(0.0), &lo, &m);
+	return SELECT(GT(ax, 711.0), SPLAT(INFINITY), K(scale)(hi, m - 1));
+}
+
+// (e^|x| -+ e^-|x|) / 2 in double-double below 22
+KERNEL VD K(sinh)(VD x) {
+	VD ax = K(abs)(x);
+	VD e_lo;
+	VD e = K(exp_pair)(ax, &e_lo);
+	VD inv_lo;
+	VD inv = K(reciprocal)(e, e_lo, &inv_lo);
+	VD d_err;
+	VD d = K(two_sum)(e, -inv, &d_err);
+	VD result = 0.5 * (d + (d_err + (e_lo - inv_lo)));
+	result = SELECT(LT(ax, 22.0), result, K(half_exp)(ax));
+	result = SELECT(LT(ax, 0.25), K(sinh_series)(ax), result);
+	return SELECT(NE(x, x), x, K(copysign)(result, x));
+}
+
+KERNEL VD K(cosh)(VD x) {
+	VD ax = K(abs)(x);
+	VD e_lo;
+	VD e = K(exp_pair)(ax, &e_lo);
+	VD inv_lo;
+	VD inv = K(reciprocal)(e, e_lo, &inv_lo);
+	VD d_err;
+	VD d = K(two_sum)(e, inv, &d_err);
+	VD result = 0.5 * (d + (d_err + (e_lo + inv_lo)));
+	result = SELECT(LT(ax, 22.0), result, K(half_exp)(ax));
+	return SELECT(NE(x, x), x, result);
+}
+
+// (e^2|x| - 1)/(e^2|x| + 1) in double-double between 0.125 and 22
+KERNEL VD K(tanh)(VD x) {
+	VD ax = K(abs)(x);
+	VD e_lo;
+	VD e = K(exp_pair)(2.0 * ax, &e_lo);
+	VD n_err;
+	VD n = K(two_sum)(e, SPLAT(-1.0), &n_err);
+	VD d_err;
+	VD d = K(two_sum)(e, SPLAT(1.0), &d_err);
+	VD q = n / d;
+	VD p_err;
+	VD p = K(two_prod)(q, d, &p_err);
+	VD result = q + ((((n - p) - p_err) + (n_err + e_lo)) - q * (d_err + e_lo)) / d;
+	result = SELECT(LT(ax, 0.125), K(tanh_series)(ax), result);
+	result = SELECT(GE(ax, 22.0), SPLAT(1.0), result);
+	return SELECT(NE(x, x), x, K(copysign)(result, x));
+}
+
+// ============================================================================
+// Gamma
+// ============================================================================
+
+// sin(pi (a + a_lo)) = result + *lo for |a| < 2^52
+KERNEL VD K(sinpi)(VD a, VD a_lo, VD* lo) {
+	VD n = K(rint)(a);
+	VD r = (a - n) + a_lo;
+	VD ar = K(abs)(r);
+	VI use_cos = GT(ar, 0.25);
+	VD arg = SELECT(use_cos, 0.5 - ar, r);
+	VD p_err;
+	VD p = K(two_prod)(arg, SPLAT(PI_HI), &p_err);
+	VD y1;
+	VD y0 = K(fast_two_sum)(p, p_err + arg * PI_LO, &y1);
+	VD s_lo;
+	VD s = K(sin_kernel)(y0, y1, &s_lo);
+	VD c_lo;
+	VD c = K(cos_kernel)(y0, y1, &c_lo);
+	s = SELECT(use_cos, c, s);
+	s_lo = SELECT(use_cos, c_lo, s_lo);
+	VI negate = K(odd_mask)(n) ^ (use_cos & K(sign_mask)(r));
+	*lo = SELECT(negate, -s_lo, s_lo);
+	return SELECT(negate, -s, s);
+}
+
+// ln gamma(z + z_lo) = result + *lo for z >= 10, by Stirling's series
+KERNEL VD K(lgamma_stirling)(VD z, VD z_lo, VD* lo) {
+	VD log_lo;
+	VD log_hi = K(log_dd)(z, &log_lo);
+	VD a = z - 0.5;
+	VD p_err;
+	VD p = K(two_prod)(a, log_hi, &p_err);
+	p_err = p_err + a * log_lo;
+	VD s_err;
+	VD s = K(two_sum)(p, -z, &s_err);
+	
+	VD y = 1.0 / z;
+	VD y2 = y * y;
+	VD series = y * (STIRLING_1 + y2 * (STIRLING_2 + y2 * (STIRLING_3 + y2 * (STIRLING_4
+		+ y2 * (STIRLING_5 + y2 * (STIRLING_6 + y2 * (STIRLING_7 + y2 * (STIRLING_8 + y2 * STIRLING_9))))))));
+	// z_lo moves the result by about z_lo * digamma(z)
+	VD shift = z_lo * (log_hi - 0.5 * y);
+	
+	VD h_err;
+	VD h = K(two_sum)(s, SPLAT(LN_SQRT_2PI_HI), &h_err);
+	VD tail = ((s_err + p_err) + h_err) + ((LN_SQRT_2PI_LO + series) + shift);
+	return K(fast_two_sum)(h, tail, lo);
+}
+
+// gamma(a + a_lo). Arguments below 10 are raised to 10 or more with
+// gamma(w) = gamma(w + n) / (w (w + 1) ... (w + n - 1)), the product kept in
+// double-double; negative ones are reflected with
+// gamma(a) = pi / (sin(pi a) gamma(1 - a)).
+KERNEL VD K(gamma_dd)(VD a, VD a_lo) {
+	VI reflect = LT(a, 0.0);
+	VD w_lo;
+	VD w = K(two_sum)(SPLAT(1.0), -a, &w_lo);
+	w = SELECT(reflect, w, a);
+	w_lo = SELECT(reflect, w_lo - a_lo, a_lo);
+	
+	VD product = SPLAT(1.0);
+	VD product_lo = SPLAT(0.0);
+	VD z = w;
+	VD z_lo = w_lo;
+	for (int i = 0; i < 10; i++) {
+		VI below = LT(z, 10.0);
+		VD p_err;
+		VD p = K(two_prod)(product, z, &p_err);
+		VD next_lo;
+		VD next = K(fast_two_sum)(p, p_err + (product * z_lo + product_lo * z), &next_lo);
+		product = SELECT(below, next, product);
+		product_lo = SELECT(below, next_lo, product_lo);
+		
+		VD z_err;
+		VD z_next = K(two_sum)(z, SPLAT(1.0), &z_err);
+		z_next = K(fast_two_sum)(z_next, z_err + z_lo, &z_err);
+		z = SELECT(below, z_next, z);
+		z_lo = SELECT(below, z_err, z_lo);
+	}
+	
+	// Reflected arguments need 1/gamma(w) = product e^-lgamma(z)
+	VD e_lo;
+	VD e = K(lgamma_stirling)(z, z_lo, &e_lo);
+	VD g_lo;
+	VI m;
+	VD g = K(exp_parts)(SELECT(reflect, -e, e), SELECT(reflect, -e_lo, e_lo), &g_lo, &m);
+	
+	VD q = g / product;
+	VD q_err;
+	VD q_check = K(two_prod)(q, product, &q_err);
+	VD direct = q + ((((g - q_check) - q_err) + g_lo) - q * product_lo) / product;
+	// pi g product / sin(pi a), in double-double up to the final division
+	VD s_lo;
+	VD s = K(sinpi)(a, a_lo, &s_lo);
+	VD gp_err;
+	VD gp = K(two_prod)(g, product, &gp_err);
+	gp_err = gp_err + (g * product_lo + g_lo * product);
+	VD num_err;
+	VD num = K(two_prod)(gp, SPLAT(PI_HI), &num_err);
+	num_err = num_err + (gp * PI_LO + gp_err * PI_HI);
+	VD r = num / s;
+	VD r_err;
+	VD r_check = K(two_prod)(r, s, &r_err);
+	VD reflected = r + ((((num - r_check) - r_err) + num_err) - r * s_lo) / s;
+	
+	VD result = K(scale)(SELECT(reflect, reflected, direct), m);
+	// gamma(a) is about 1/a near zero, where the product loses its split
+	result = SELECT(LT(K(abs)(a), 0x1p-54), 1.0 / a, result);
+	result = SELECT(LT(a, -200.0), K(copysign)(SPLAT(0.0), s), result);
+	VI pole = reflect & EQ(a_lo, 0.0) & (GE(K(abs)(a), 0x1p52) | EQ(K(rint)(a), a));
+	result = SELECT(pole, SPLAT(NAN), result);
+	result = SELECT(GT(a, 200.0), SPLAT(INFINITY), result);
+	return SELECT(NE(a, a), a, result);
+}
+
+KERNEL VD K(gamma)(VD x) {
+	return K(gamma_dd)(x, SPLAT(0.0));
+}
+
+// Integer arguments are patched from a table by calc_factorial and the batch
+// loops
+KERNEL VD K(factorial)(VD x) {
+	VD a_lo;
+	VD a = K(two_sum)(x, SPLAT(1.0), &a_lo);
+	a_lo = SELECT(LT(K(abs)(x), INFINITY), a_lo, SPLAT(0.0));
+	return K(gamma_dd)(a, a_lo);
+}
+
+// ============================================================================
+// Elementary
+// ============================================================================
+
+KERNEL VD K(sqrt)(VD x) {
+	return SQRT(x);
+}
+
+KERNEL VD K(percent)(VD x) {
+	return x / 100.0;
+}
+
+// ============================================================================
+// Batch Loops
+// ============================================================================
+
+// Whole vectors of in through kernel; lanes of x matching patch are redone
+// with the scalar function
+#define KERNEL_LOOP(kernel, patch, scalar) \
+	for (; i + WIDTH <= count; i += WIDTH) { \
+		VD x; \
+		memcpy(&x, in + i, sizeof(x)); \
+		VD r = kernel(x); \
+		double lanes[WIDTH]; \
+		memcpy(lanes, &x, sizeof(x)); \
+		memcpy(out + i, &r, sizeof(r)); \
+		for (int j = 0; j < WIDTH; j++) { \
+			if (patch(lanes[j])) { \
+				out[i + j] = scalar(lanes[j]); \
+			} \
+		} \
+	}
+
+#define NEVER_PATCH(x) 0
+
+// Returns how many leading elements were done; the caller finishes the rest
+BATCH size_t K(batch)(calc_function function, double* out, const double* in, size_t count) {
+	size_t i = 0;
+	switch (function) {
+		case CALC_SQRT: KERNEL_LOOP(K(sqrt), NEVER_PATCH, calc_sqrt) break;
+		case CALC_EXP: KERNEL_LOOP(K(exp), NEVER_PATCH, calc_exp) break;
+		case CALC_LN: KERNEL_LOOP(K(ln), NEVER_PATCH, calc_ln) break;
+		case CALC_LOG10: KERNEL_LOOP(K(log10), NEVER_PATCH, calc_log10) break;
+		case CALC_SIN: KERNEL_LOOP(K(sin), TRIG_LARGE, calc_sin) break;
+		case CALC_COS: KERNEL_LOOP(K(cos), TRIG_LARGE, calc_cos) break;
+		case CALC_TAN: KERNEL_LOOP(K(tan), TRIG_LARGE, calc_tan) break;
+		case CALC_ASIN: KERNEL_LOOP(K(asin), NEVER_PATCH, calc_asin) break;
+		case CALC_ACOS: KERNEL_LOOP(K(acos), NEVER_PATCH, calc_acos) break;
+		case CALC_ATAN: KERNEL_LOOP(K(atan), NEVER_PATCH, calc_atan) break;
+		case CALC_SINH: KERNEL_LOOP(K(sinh), NEVER_PATCH, calc_sinh) break;
+		case CALC_COSH: KERNEL_LOOP(K(cosh), NEVER_PATCH, calc_cosh) break;
+		case CALC_TANH: KERNEL_LOOP(K(tanh), NEVER_PATCH, calc_tanh) break;
+		case CALC_FACTORIAL: KERNEL_LOOP(K(factorial), FACTORIAL_EXACT, calc_factorial) break;
+		case CALC_GAMMA: KERNEL_LOOP(K(gamma), NEVER_PATCH, calc_gamma) break;
+		case CALC_PERCENT: KERNEL_LOOP(K(percent), NEVER_PATCH, calc_percent) break;
+		default: break;
+	}
+	return i;
+}
+
+BATCH size_t K(batch_pow)(double* out, const double* x, const double* y, size_t count) {
+	size_t i = 0;
+	for (; i + WIDTH <= count; i += WIDTH) {
+		VD a, b;
+		memcpy(&a, x + i, sizeof(a));
+		memcpy(&b, y + i, sizeof(b));
+		VD r = K(pow)(a, b);
+		memcpy(out + i, &r, sizeof(r));
+	}
+	return i;
+}
@@ -0,0 +1,785 @@
+// Matrices - dense double matrices for the Matrix view and calc-matrix
+
+#include "calc_matrix.h"
+#include "calc_engine.h"
+#include "calc_stats.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#define CALC_MATRIX_X86 1
+#elif defined(__aarch64__)
+#define CALC_MATRIX_ARM 1
+#endif
+
+// Product blocking: a KC x NC block of B is packed once and reused for every
+// MC x KC block of A, which stays in L2 while the kernel streams B through it
+#define GEMM_KC 256
+#define GEMM_MC 96     // A multiple of every kernel's MR
+#define GEMM_NC 1024   // A multiple of every kernel's NR
+
+// Smaller products skip packing and run a plain loop
+#define GEMM_DIRECT_WORK (16 * 16 * 16)
+
+// LU panel width; the trailing update of each panel is one product
+#define LU_BLOCK 64
+
+// Transpose tile edge
+#define TRANSPOSE_TILE 32
+
+// ============================================================================
+// Lifetime & Text
+// ============================================================================
+
+void calc_matrix_init(calc_matrix* m) {
+	m->rows = 0;
+	m->cols = 0;
+	m->data = NULL;
+	m->capacity = 0;
+}
+
+void calc_matrix_free(calc_matrix* m) {
+	free(m->data);
+	calc_matrix_init(m);
+}
+
+int calc_matrix_resize(calc_matrix* m, size_t rows, size_t cols) {
+	size_t count = rows * cols;
+	if (cols != 0 && count / cols != rows) {
+		calc_matrix_free(m);
+		return 0;
+	}
+	if (count > m->capacity) {
+		double* data = realloc(m->data, count * sizeof(double));
+		if (!data) {
+			calc_matrix_free(m);
+			return 0;
+		}
+		m->data = data;
+		m->capacity = count;
+	}
+	m->rows = count ? rows : 0;
+	m->cols = count ? cols : 0;
+	return 1;
+}
+
+int calc_matrix_copy(calc_matrix* dst, const calc_matrix* src) {
+	if (dst == src) {
+		return 1;
+	}
+	if (!calc_matrix_resize(dst, src->rows, src->cols)) {
+		return 0;
+	}
+	if (src->rows) {
+		memcpy(dst->data, src->data, src->rows * src->cols * sizeof(double));
+	}
+	return 1;
+}
+
+int calc_matrix_identity(calc_matrix* m, size_t n) {
+	if (!calc_matrix_resize(m, n, n)) {
+		return 0;
+	}
+	memset(m->data, 0, n * n * sizeof(double));
+	for (size_t i = 0; i < n; i++) {
+		m->data[i * n + i] = 1;
+	}
+	return 1;
+}
+
+static int is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == ',' || c == '[' || c == ']';
+}
+
+// A row ends: the first sets the width, later ones must match it
+static int end_row(calc_matrix* m, size_t* in_row) {
+	if (*in_row == 0) {
+		return 1;   // Blank line
+	}
+	if (m->cols == 0) {
+		m->cols = *in_row;
+	} else if (*in_row != m->cols) {
+		return 0;
+	}
+	m->rows++;
+	*in_row = 0;
+	return 1;
+}
+
+int calc_matrix_parse(calc_matrix* m, const char* text, size_t length) {
+	const char* end = text + length;
+	size_t count = 0;
+	size_t in_row = 0;
+	m->rows = 0;
+	m->cols = 0;
+	
+	while (text < end) {
+		char c = *text;
+		if (c == '\n' || c == ';') {
+			if (!end_row(m, &in_row)) {
+				return 0;
+			}
+			text++;
+			continue;
+		}
+		if (is_blank(c)) {
+			text++;
+			continue;
+		}
+		const char* token = text;
+		while (text < end && !is_blank(*text) && *text != '\n' && *text != ';') {
+			text++;
+		}
+		if (count == m->capacity) {
+			size_t capacity = m->capacity ? m->capacity * 2 : 16;
+			double* data = realloc(m->data, capacity * sizeof(double));
+			if (!data) {
+				return 0;
+			}
+			m->data = data;
+			m->capacity = capacity;
+		}
+		if (!calc_stats_parse_number(token, (size_t)(text - token), &m->data[count])) {
+			m->rows = m->cols = 0;
+			return 0;
+		}
+		count++;
+		in_row++;
+	}
+	if (!end_row(m, &in_row)) {
+		m->rows = m->cols = 0;
+		return 0;
+	}
+	return 1;
+}
+
+typedef struct text_writer {
+	char* buffer;
+	size_t size;
+	size_t length;   // Full length, even past size
+} text_writer;
+
+static void put_text(text_writer* w, const char* text, size_t length) {
+	if (w->length < w->size) {
+		size_t room = w->size - 1 - w->length;
+		memcpy(w->buffer + w->length, text, length < room ? length : room);
+	}
+	w->length += length;
+}
+
+size_t calc_matrix_format(const calc_matrix* m, char* buffer, size_t size, const calc_format_options* options) {
+	text_writer w = {buffer, size, 0};
+	size_t rows = m->rows < CALC_MATRIX_DISPLAY_ELEMENTS ? m->rows : CALC_MATRIX_DISPLAY_ELEMENTS;
+	size_t cols = m->cols < CALC_MATRIX_DISPLAY_ELEMENTS ? m->cols : CALC_MATRIX_DISPLAY_ELEMENTS;
+	char text[CALC_FORMAT_BUFFER_SIZE];
+	
+	if (rows < m->rows || cols < m->cols) {
+		int length = snprintf(text, sizeof(text), "%zux%zu ", m->rows, m->cols);
+		put_text(&w, text, (size_t)length);
+	}
+	put_text(&w, "[", 1);
+	for (size_t i = 0; i < rows; i++) {
+		if (i > 0) {
+			put_text(&w, "; ", 2);
+		}
+		for (size_t j = 0; j < cols; j++) {
+			if (j > 0) {
+				put_text(&w, ", ", 2);
+			}
+			int length = calc_format_double(text, calc_matrix_row(m, i)[j], options);
+			put_text(&w, text, (size_t)length);
+		}
+		if (cols < m->cols) {
+			put_text(&w, ", ...", 5);
+		}
+	}
+	if (rows < m->rows) {
+		put_text(&w, "; ...", 5);
+	}
+	put_text(&w, "]", 1);
+	if (size > 0) {
+		buffer[w.length < size ? w.length : size - 1] = '\0';
+	}
+	return w.length;
+}
+
+int calc_matrix_write_csv(const calc_matrix* m, FILE* out) {
+	char text[CALC_FORMAT_BUFFER_SIZE];
+	for (size_t i = 0; i < m->rows; i++) {
+		const double* row = calc_matrix_row(m, i);
+		for (size_t j = 0; j < m->cols; j++) {
+			calc_format_double(text, row[j], NULL);
+			fputs(text, out);
+			fputc(j + 1 < m->cols ? ',' : '\n', out);
+		}
+	}
+	return !ferror(out);
+}
+
+// ============================================================================
+// Element-wise
+// ============================================================================
+
+int calc_matrix_elementwise(calc_matrix* result, const calc_matrix* a, char op, const calc_matrix* b) {
+	if (a->rows != b->rows || a->cols != b->cols) {
+		return 0;
+	}
+	// Same shape, so result keeps any operand's storage it aliases
+	if (!calc_matrix_resize(result, a->rows, a->cols)) {
+		return 0;
+	}
+	calc_batch_apply_column(result->data, a->data, op, b->data, a->rows * a->cols);
+	return 1;
+}
+
+int calc_matrix_scalar(calc_matrix* result, const calc_matrix* a, char op, double scalar, int scalar_first) {
+	if (!calc_matrix_resize(result, a->rows, a->cols)) {
+		return 0;
+	}
+	// The scalar side is a short column repeated along the matrix
+	double column[256];
+	for (size_t i = 0; i < 256; i++) {
+		column[i] = scalar;
+	}
+	size_t count = a->rows * a->cols;
+	for (size_t i = 0; i < count; i += 256) {
+		size_t n = count - i < 256 ? count - i : 256;
+		if (scalar_first) {
+			calc_batch_apply_column(result->data + i, column, op, a->data + i, n);
+		} else {
+			calc_batch_apply_column(result->data + i, a->data + i, op, column, n);
+		}
+	}
+	return 1;
+}
+
+// ============================================================================
+// Product Kernels
+// ============================================================================
+
+typedef void (*kernel_fn)(size_t kc, const double* a, const double* b, double* c, size_t ldc,
+                          size_t mr, size_t nr, double alpha);
+
+typedef struct product_kernel {
+	kernel_fn run;
+	size_t mr;
+	size_t nr;
+} product_kernel;
+
+#define VD double
+#define WIDTH 1
+#define MR 4
+#define NR 4
+#define K(name) name##_scalar
+#define KERNEL static
+#define SPLAT(x) ((double)(x))
+#include "calc_matrix_kernel.h"
+#undef VD
+#undef WIDTH
+#undef MR
+#undef NR
+#undef K
+#undef KERNEL
+#undef SPLAT
+
+#if defined(CALC_MATRIX_X86) || defined(CALC_MATRIX_ARM)
+
+typedef double v2df __attribute__((vector_size(16)));
+
+#define VD v2df
+#define WIDTH 2
+#define MR 4
+#define NR 4
+#define K(name) name##_v2
+#define KERNEL static
+#define SPLAT(x) ((v2df){(x), (x)})
+#include "calc_matrix_kernel.h"
+#undef VD
+#undef WIDTH
+#undef MR
+#undef NR
+#undef K
+#undef KERNEL
+#undef SPLAT
+
+#endif
+
+#ifdef CALC_MATRIX_X86
+
+typedef double v4df __attribute__((vector_size(32)));
+
+// 6 x 8 keeps twelve accumulators, two rows of B and a broadcast in the
+// sixteen AVX registers
+#define VD v4df
+#define WIDTH 4
+#define MR 6
+#define NR 8
+#define K(name) name##_avx2
+#define KERNEL static __attribute__((target("avx2,fma")))
+#define SPLAT(x) ((v4df){(x), (x), (x), (x)})
+#include "calc_matrix_kernel.h"
+#undef VD
+#undef WIDTH
+#undef MR
+#undef NR
+#undef K
+#undef KERNEL
+#undef SPLAT
+
+#endif
+
+static const product_kernel kernel_scalar = {gemm_kernel_scalar, 4, 4};
+#if defined(CALC_MATRIX_X86) || defined(CALC_MATRIX_ARM)
+static const product_kernel kernel_v2 = {gemm_kernel_v2, 4, 4};
+#endif
+#ifdef CALC_MATRIX_X86
+static const product_kernel kernel_avx2 = {gemm_kernel_avx2, 6, 8};
+#endif
+
+static const product_kernel* g_kernel = NULL;
+static calc_batch_isa g_isa = CALC_BATCH_SCALAR;
+static int g_threads = 0;
+
+static int isa_supported(calc_batch_isa isa) {
+	switch (isa) {
+		case CALC_BATCH_SCALAR: return 1;
+#ifdef CALC_MATRIX_X86
+		case CALC_BATCH_SSE2: return __builtin_cpu_supports("sse2");
+		case CALC_BATCH_AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+#ifdef CALC_MATRIX_ARM
+		case CALC_BATCH_NEON: return 1;
+#endif
+		default: return 0;
+	}
+}
+
+int calc_matrix_select(calc_batch_isa isa) {
+	if (!isa_supported(isa)) {
+		return 0;
+	}
+	switch (isa) {
+#ifdef CALC_MATRIX_X86
+		case CALC_BATCH_SSE2: g_kernel = &kernel_v2; break;
+		case CALC_BATCH_AVX2: g_kernel = &kernel_avx2; break;
+#endif
+#ifdef CALC_MATRIX_ARM
+		case CALC_BATCH_NEON: g_kernel = &kernel_v2; break;
+#endif
+		default: g_kernel = &kernel_scalar; break;
+	}
+	g_isa = isa;
+	return 1;
+}
+
+// Best first; every thread that races here picks the same answer
+static void select_best(void) {
+	static const calc_batch_isa preference[] = {
+		CALC_BATCH_AVX2, CALC_BATCH_NEON, CALC_BATCH_SSE2, CALC_BATCH_SCALAR
+	};
+	for (size_t i = 0; !calc_matrix_select(preference[i]); i++) {}
+}
+
+calc_batch_isa calc_matrix_active(void) {
+	if (!g_kernel) {
+		select_best();
+	}
+	return g_isa;
+}
+
+void calc_matrix_set_threads(int threads) {
+	g_threads = threads > 0 ? threads : 1;
+}
+
+int calc_matrix_threads(void) {
+	if (g_threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		g_threads = cpus > 0 ? (int)cpus : 1;
+	}
+	return g_threads;
+}
+
+// ============================================================================
+// Products
+// ============================================================================
+
+// MR-row panels of an mc x kc block of A, MR values per step, zero-padded
+static void pack_a(size_t mr, size_t mc, size_t kc, const double* a, size_t lda, double* packed) {
+	for (size_t ir = 0; ir < mc; ir += mr) {
+		size_t rows = mc - ir < mr ? mc - ir : mr;
+		for (size_t p = 0; p < kc; p++) {
+			for (size_t i = 0; i < rows; i++) {
+				packed[i] = a[(ir + i) * lda + p];
+			}
+			for (size_t i = rows; i < mr; i++) {
+				packed[i] = 0;
+			}
+			packed += mr;
+		}
+	}
+}
+
+// NR-column panels of a kc x nc block of B, NR values per step, zero-padded
+static void pack_b(size_t nr, size_t kc, size_t nc, const double* b, size_t ldb, double* packed) {
+	for (size_t jr = 0; jr < nc; jr += nr) {
+		size_t cols = nc - jr < nr ? nc - jr : nr;
+		for (size_t p = 0; p < kc; p++) {
+			memcpy(packed, b + p * ldb + jr, cols * sizeof(double));
+			for (size_t j = cols; j < nr; j++) {
+				packed[j] = 0;
+			}
+			packed += nr;
+		}
+	}
+}
+
+static void gemm_direct(size_t m, size_t n, size_t k, double alpha, const double* a, size_t lda,
+                        const double* b, size_t ldb, double* c, size_t ldc) {
+	for (size_t i = 0; i < m; i++) {
+		double* c_row = c + i * ldc;
+		for (size_t p = 0; p < k; p++) {
+			double scaled = alpha * a[i * lda + p];
+			const double* b_row = b + p * ldb;
+			for (size_t j = 0; j < n; j++) {
+				c_row[j] += scaled * b_row[j];
+			}
+		}
+	}
+}
+
+static void gemm_blocked(const product_kernel* kernel, size_t m, size_t n, size_t k, double alpha,
+                         const double* a, size_t lda, const double* b, size_t ldb, double* c, size_t ldc,
+                         double* packed_a, double* packed_b) {
+	size_t mr = kernel->mr;
+	size_t nr = kernel->nr;
+	for (size_t jc = 0; jc < n; jc += GEMM_NC) {
+		size_t nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+		for (size_t pc = 0; pc < k; pc += GEMM_KC) {
+			size_t kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+			pack_b(nr, kc, nc, b + pc * ldb + jc, ldb, packed_b);
+			for (size_t ic = 0; ic < m; ic += GEMM_MC) {
+				size_t mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+				pack_a(mr, mc, kc, a + ic * lda + pc, lda, packed_a);
+				for (size_t jr = 0; jr < nc; jr += nr) {
+					for (size_t ir = 0; ir < mc; ir += mr) {
+						kernel->run(kc, packed_a + ir * kc, packed_b + jr * kc, c + (ic + ir) * ldc + jc + jr, ldc,
+							mc - ir < mr ? mc - ir : mr, nc - jr < nr ? nc - jr : nr, alpha);
+					}
+				}
+			}
+		}
+	}
+}
+
+// One thread's share of a product: a band of rows or columns of C
+typedef struct gemm_task {
+	const product_kernel* kernel;
+	size_t m, n, k;
+	double alpha;
+	const double* a;
+	size_t lda;
+	const double* b;
+	size_t ldb;
+	double* c;
+	size_t ldc;
+	pthread_t thread;
+} gemm_task;
+
+// Each task packs into buffers of its own; without them it falls back to the plain loop
+static void* run_gemm_task(void* arg) {
+	gemm_task* task = arg;
+	void* packed_a = NULL;
+	void* packed_b = NULL;
+	if (posix_memalign(&packed_a, 64, GEMM_MC * GEMM_KC * sizeof(double)) == 0
+		&& posix_memalign(&packed_b, 64, GEMM_KC * GEMM_NC * sizeof(double)) == 0) {
+		gemm_blocked(task->kernel, task->m, task->n, task->k, task->alpha, task->a, task->lda, task->b,
+			task->ldb, task->c, task->ldc, packed_a, packed_b);
+	} else {
+		gemm_direct(task->m, task->n, task->k, task->alpha, task->a, task->lda, task->b, task->ldb,
+			task->c, task->ldc);
+	}
+	free(packed_a);
+	free(packed_b);
+	return NULL;
+}
+
+#define MAX_GEMM_THREADS 64
+
+void calc_matrix_gemm(size_t m, size_t n, size_t k, double alpha, const double* a, size_t lda,
+                      const double* b, size_t ldb, double* c, size_t ldc) {
+	if (m == 0 || n == 0 || k == 0) {
+		return;
+	}
+	double work = (double)m * n * k;
+	if (work < GEMM_DIRECT_WORK) {
+		gemm_direct(m, n, k, alpha, a, lda, b, ldb, c, ldc);
+		return;
+	}
+	calc_matrix_active();
+	const product_kernel* kernel = g_kernel;
+	
+	// Split the longer side of C into bands of whole kernel tiles
+	int split_rows = m >= n;
+	size_t length = split_rows ? m : n;
+	size_t unit = split_rows ? GEMM_MC : kernel->nr * 16;
+	size_t threads = work < CALC_MATRIX_THREAD_WORK ? 1 : (size_t)calc_matrix_threads();
+	size_t most = (length + unit - 1) / unit;
+	threads = threads < most ? threads : most;
+	threads = threads < MAX_GEMM_THREADS ? threads : MAX_GEMM_THREADS;
+	
+	gemm_task tasks[MAX_GEMM_THREADS];
+	size_t band = (length / unit + threads - 1) / threads * unit;
+	size_t started = 0;
+	for (size_t t = 0; t < threads; t++) {
+		size_t start = t * band;
+		if (start >= length) {
+			break;
+		}
+		size_t size = length - start < band || t + 1 == threads ? length - start : band;
+		gemm_task* task = &tasks[started++];
+		*task = (gemm_task){kernel, m, n, k, alpha, a, lda, b, ldb, c, ldc, 0};
+		if (split_rows) {
+			task->m = size;
+			task->a = a + start * lda;
+			task->c = c + start * ldc;
+		} else {
+			task->n = size;
+			task->b = b + start;
+			task->c = c + start;
+		}
+	}
+	
+	// The calling thread takes the first band; if a thread cannot start, it runs here
+	for (size_t t = 1; t < started; t++) {
+		if (pthread_create(&tasks[t].thread, NULL, run_gemm_task, &tasks[t]) != 0) {
+			tasks[t].thread = 0;
+			run_gemm_task(&tasks[t]);
+		}
+	}
+	run_gemm_task(&tasks[0]);
+	for (size_t t = 1; t < started; t++) {
+		if (tasks[t].thread) {
+			pthread_join(tasks[t].thread, NULL);
+		}
+	}
+}
+
+int calc_matrix_multiply(calc_matrix* result, const calc_matrix* a, const calc_matrix* b) {
+	if (a->cols != b->rows) {
+		return 0;
+	}
+	calc_matrix product;
+	calc_matrix_init(&product);
+	if (!calc_matrix_resize(&product, a->rows, b->cols)) {
+		return 0;
+	}
+	memset(product.data, 0, a->rows * b->cols * sizeof(double));
+	calc_matrix_gemm(a->rows, b->cols, a->cols, 1.0, a->data, a->cols, b->data, b->cols, product.data, b->cols);
+	calc_matrix_free(result);
+	*result = product;
+	return 1;
+}
+
+int calc_matrix_transpose(calc_matrix* result, const calc_matrix* a) {
+	calc_matrix transposed;
+	calc_matrix_init(&transposed);
+	if (!calc_matrix_resize(&transposed, a->cols, a->rows)) {
+		return 0;
+	}
+	// Tiles keep both the rows read and the rows written in cache
+	for (size_t i0 = 0; i0 < a->rows; i0 += TRANSPOSE_TILE) {
+		size_t i1 = a->rows - i0 < TRANSPOSE_TILE ? a->rows : i0 + TRANSPOSE_TILE;
+		for (size_t j0 = 0; j0 < a->cols; j0 += TRANSPOSE_TILE) {
+			size_t j1 = a->cols - j0 < TRANSPOSE_TILE ? a->cols : j0 + TRANSPOSE_TILE;
+			for (size_t i = i0; i < i1; i++) {
+				for (size_t j = j0; j < j1; j++) {
+					transposed.data[j * a->rows + i] = a->data[i * a->cols + j];
+				}
+			}
+		}
+	}
+	calc_matrix_free(result);
+	*result = transposed;
+	return 1;
+}
+
+// ============================================================================
+// LU Factorization
+// ============================================================================
+
+// Factor the n x n matrix a in place into a unit lower L (below the diagonal)
+// and U, with row i swapped with row pivots[i] at step i. Panels of LU_BLOCK
+// columns are factored one column at a time; the rest of the matrix is then
+// updated with one product per panel. Returns the number of row swaps, or -1
+// if a pivot is zero (a is singular; the factorization is then incomplete).
+static long lu_factor(double* a, size_t n, size_t* pivots) {
+	long swaps = 0;
+	for (size_t j0 = 0; j0 < n; j0 += LU_BLOCK) {
+		size_t j1 = n - j0 < LU_BLOCK ? n : j0 + LU_BLOCK;
+		
+		// Panel: columns j0..j1, all rows from j0 down
+		for (size_t j = j0; j < j1; j++) {
+			size_t pivot = j;
+			for (size_t i = j + 1; i < n; i++) {
+				if (fabs(a[i * n + j]) > fabs(a[pivot * n + j])) {
+					pivot = i;
+				}
+			}
+			pivots[j] = pivot;
+			if (a[pivot * n + j] == 0) {
+				return -1;
+			}
+			if (pivot != j) {
+				// Whole rows, so L's finished columns are permuted too
+				double* x = a + j * n;
+				double* y = a + pivot * n;
+				for (size_t c = 0; c < n; c++) {
+					double t = x[c];
+					x[c] = y[c];
+					y[c] = t;
+				}
+				swaps++;
+			}
+			const double* u_row = a + j * n;
+			for (size_t i = j + 1; i < n; i++) {
+				double* row = a + i * n;
+				double l = row[j] / u_row[j];
+				row[j] = l;
+				for (size_t c = j + 1; c < j1; c++) {
+					row[c] -= l * u_row[c];
+				}
+			}
+		}
+		if (j1 == n) {
+			break;
+		}
+		
+		// U12 = L11^-1 A12: the panel's rows right of it
+		for (size_t i = j0 + 1; i < j1; i++) {
+			double* row = a + i * n;
+			for (size_t r = j0; r < i; r++) {
+				double l = row[r];
+				const double* u_row = a + r * n;
+				for (size_t c = j1; c < n; c++) {
+					row[c] -= l * u_row[c];
+				}
+			}
+		}
+		
+		// A22 -= L21 U12
+		calc_matrix_gemm(n - j1, n - j1, j1 - j0, -1.0, a + j1 * n + j0, n, a + j0 * n + j1, n,
+			a + j1 * n + j1, n);
+	}
+	return swaps;
+}
+
+int calc_matrix_determinant(const calc_matrix* a, double* determinant) {
+	if (a->rows != a->cols) {
+		return 0;
+	}
+	calc_matrix lu;
+	calc_matrix_init(&lu);
+	size_t* pivots = malloc((a->rows + 1) * sizeof(size_t));
+	if (!pivots || !calc_matrix_copy(&lu, a)) {
+		free(pivots);
+		return 0;
+	}
+	size_t n = a->rows;
+	long swaps = lu_factor(lu.data, n, pivots);
+	double product = swaps < 0 ? 0 : swaps % 2 ? -1 : 1;
+	for (size_t i = 0; i < n && swaps >= 0; i++) {
+		product *= lu.data[i * n + i];
+	}
+	*determinant = product;
+	calc_matrix_free(&lu);
+	free(pivots);
+	return 1;
+}
+
+int calc_matrix_solve(calc_matrix* result, const calc_matrix* a, const calc_matrix* b) {
+	if (a->rows != a->cols || b->rows != a->rows) {
+		return 0;
+	}
+	size_t n = a->rows;
+	size_t width = b->cols;
+	calc_matrix lu;
+	calc_matrix x;
+	calc_matrix_init(&lu);
+	calc_matrix_init(&x);
+	size_t* pivots = malloc((n + 1) * sizeof(size_t));
+	if (!pivots || !calc_matrix_copy(&lu, a) || !calc_matrix_copy(&x, b) || lu_factor(lu.data, n, pivots) < 0) {
+		free(pivots);
+		calc_matrix_free(&lu);
+		calc_matrix_free(&x);
+		return 0;
+	}
+	
+	// P B, then L Y = P B, then U X = Y, LU_BLOCK rows of X at a time
+	for (size_t i = 0; i < n; i++) {
+		if (pivots[i] != i) {
+			double* p = calc_matrix_row(&x, i);
+			double* q = calc_matrix_row(&x, pivots[i]);
+			for (size_t c = 0; c < width; c++) {
+				double t = p[c];
+				p[c] = q[c];
+				q[c] = t;
+			}
+		}
+	}
+	// Block rows of X: the rows solved so far come off as one product, then the
+	// block is finished row by row
+	for (size_t j0 = 0; j0 < n; j0 += LU_BLOCK) {
+		size_t j1 = n - j0 < LU_BLOCK ? n : j0 + LU_BLOCK;
+		calc_matrix_gemm(j1 - j0, width, j0, -1.0, lu.data + j0 * n, n, x.data, width, x.data + j0 * width, width);
+		for (size_t i = j0 + 1; i < j1; i++) {
+			double* row = calc_matrix_row(&x, i);
+			for (size_t r = j0; r < i; r++) {
+				double l = lu.data[i * n + r];
+				const double* y = calc_matrix_row(&x, r);
+				for (size_t c = 0; c < width; c++) {
+					row[c] -= l * y[c];
+				}
+			}
+		}
+	}
+	for (size_t j1 = n; j1 > 0;) {
+		size_t j0 = j1 > LU_BLOCK ? j1 - LU_BLOCK : 0;
+		calc_matrix_gemm(j1 - j0, width, n - j1, -1.0, lu.data + j0 * n + j1, n, x.data + j1 * width, width,
+			x.data + j0 * width, width);
+		for (size_t i = j1; i-- > j0;) {
+			double* row = calc_matrix_row(&x, i);
+			for (size_t r = i + 1; r < j1; r++) {
+				double u = lu.data[i * n + r];
+				const double* y = calc_matrix_row(&x, r);
+				for (size_t c = 0; c < width; c++) {
+					row[c] -= u * y[c];
+				}
+			}
+			double diagonal = lu.data[i * n + i];
+			for (size_t c = 0; c < width; c++) {
+				row[c] /= diagonal;
+			}
+		}
+		j1 = j0;
+	}
+	
+	free(pivots);
+	calc_matrix_free(&lu);
+	calc_matrix_free(result);
+	*result = x;
+	return 1;
+}
+
+int calc_matrix_inverse(calc_matrix* result, const calc_matrix* a) {
+	calc_matrix identity;
+	calc_matrix_init(&identity);
+	if (a->rows != a->cols || !calc_matrix_identity(&identity, a->rows)) {
+		return 0;
+	}
+	int solved = calc_matrix_solve(result, a, &identity);
+	calc_matrix_free(&identity);
+	return solved;
+}
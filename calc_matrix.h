@@ -0,0 +1,111 @@
+// Matrices - dense double matrices for the Matrix view and calc-matrix
+//
+// Matrices are row-major. Element-wise operators follow perform_operation
+// exactly (they run through calc_batch), including its divide-by-zero rule.
+// Multiplication packs blocks of both operands into cache-sized panels and
+// runs a register-blocked kernel on them, picked at runtime like calc_batch's
+// (AVX2 with FMA, else SSE2 or NEON), and splits large products across
+// threads. Determinant, inverse and solve use a blocked LU factorization with
+// partial pivoting whose trailing updates are products.
+
+#ifndef CALC_MATRIX_H
+#define CALC_MATRIX_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "calc_batch.h"
+#include "calc_format.h"
+
+// Products with at least this many multiply-adds are split across threads
+#define CALC_MATRIX_THREAD_WORK (1 << 21)
+
+// Elements per row and rows shown by calc_matrix_format before eliding
+#define CALC_MATRIX_DISPLAY_ELEMENTS 4
+
+typedef struct calc_matrix {
+	size_t rows;         // 0 = empty
+	size_t cols;
+	double* data;        // rows * cols, row-major
+	size_t capacity;     // Elements allocated
+} calc_matrix;
+
+// ============================================================================
+// Lifetime & Text
+// ============================================================================
+
+// Empty, with nothing allocated
+void calc_matrix_init(calc_matrix* m);
+void calc_matrix_free(calc_matrix* m);
+
+// Make m rows x cols, keeping its allocation when big enough; the contents
+// are undefined. Returns 0 if memory runs out (m is then empty).
+int calc_matrix_resize(calc_matrix* m, size_t rows, size_t cols);
+int calc_matrix_copy(calc_matrix* dst, const calc_matrix* src);
+int calc_matrix_identity(calc_matrix* m, size_t n);
+
+static inline double* calc_matrix_row(const calc_matrix* m, size_t row) {
+	return m->data + row * m->cols;
+}
+
+// Rows separated by newlines or ';', elements by ',' or blanks, with optional
+// enclosing brackets: "[1 2; 3 4]" and a CSV file both parse. Returns 0 if a
+// token is not a number or the rows differ in length; empty text gives an
+// empty matrix.
+int calc_matrix_parse(calc_matrix* m, const char* text, size_t length);
+
+// "[1, 2; 3, 4]", eliding with "..." beyond CALC_MATRIX_DISPLAY_ELEMENTS rows
+// or columns (and then prefixed "RxC "), each element formatted with options
+// (NULL = shortest round-trip). Always terminates buffer; returns the length
+// the full text needs.
+size_t calc_matrix_format(const calc_matrix* m, char* buffer, size_t size, const calc_format_options* options);
+
+// One row per line, elements separated by commas, shortest round-trip digits
+int calc_matrix_write_csv(const calc_matrix* m, FILE* out);
+
+// ============================================================================
+// Arithmetic
+// ============================================================================
+
+// Element by element: result = perform_operation(a, op, b). Returns 0 if the
+// shapes differ. result may alias either operand.
+int calc_matrix_elementwise(calc_matrix* result, const calc_matrix* a, char op, const calc_matrix* b);
+
+// The same with a number on one side: a op scalar, or scalar op a when
+// scalar_first. result may alias a.
+int calc_matrix_scalar(calc_matrix* result, const calc_matrix* a, char op, double scalar, int scalar_first);
+
+// result = a b. Returns 0 if a->cols != b->rows. result may alias either operand.
+int calc_matrix_multiply(calc_matrix* result, const calc_matrix* a, const calc_matrix* b);
+
+// C += alpha A B on strided storage: A is m x k, B is k x n, C is m x n, each
+// row-major with the given row strides. C must not overlap A or B.
+void calc_matrix_gemm(size_t m, size_t n, size_t k, double alpha, const double* a, size_t lda,
+                      const double* b, size_t ldb, double* c, size_t ldc);
+
+// result may alias a
+int calc_matrix_transpose(calc_matrix* result, const calc_matrix* a);
+
+// Returns 0 if a is not square
+int calc_matrix_determinant(const calc_matrix* a, double* determinant);
+
+// Return 0 if a is not square, the shapes do not fit, or a is singular.
+// result may alias either operand.
+int calc_matrix_inverse(calc_matrix* result, const calc_matrix* a);
+int calc_matrix_solve(calc_matrix* result, const calc_matrix* a, const calc_matrix* b);
+
+// ============================================================================
+// Kernels & Threads
+// ============================================================================
+
+// Threads for large products; defaults to the online CPUs
+void calc_matrix_set_threads(int threads);
+int calc_matrix_threads(void);
+
+// Product kernel in use; the best supported one until calc_matrix_select
+calc_batch_isa calc_matrix_active(void);
+
+// Force a kernel (for benchmarking); returns 0 if the CPU lacks it
+int calc_matrix_select(calc_batch_isa isa);
+
+#endif
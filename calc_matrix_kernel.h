@@ -0,0 +1,72 @@
+// Matrix Product Kernel - internal to calc_matrix.c
+//
+// Included once per vector width. The includer defines:
+//   VD          WIDTH doubles (a plain double for the scalar build)
+//   WIDTH       lanes per VD
+//   MR, NR      rows and columns of C the kernel keeps in registers; NR is a
+//               multiple of WIDTH
+//   K(name)     the instantiation's name for a kernel
+//   KERNEL      qualifiers, including any target attribute
+//   SPLAT(x)    x in every lane
+//
+// The packed panels are 64-byte aligned: a holds MR values per step of the
+// inner dimension and b holds NR, so every load of b is an aligned vector.
+
+// C[0..mr)[0..nr) += alpha * (a panel) (b panel), over kc steps
+KERNEL void K(gemm_kernel)(size_t kc, const double* a, const double* b, double* c, size_t ldc,
+                          size_t mr, size_t nr, double alpha) {
+	VD acc[MR][NR / WIDTH];
+#pragma GCC unroll 8
+	for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 8
+		for (int j = 0; j < NR / WIDTH; j++) {
+			acc[i][j] = SPLAT(0.0);
+		}
+	}
+
+	for (size_t p = 0; p < kc; p++) {
+		VD bv[NR / WIDTH];
+#pragma GCC unroll 8
+		for (int j = 0; j < NR / WIDTH; j++) {
+			bv[j] = *(const VD*)(b + j * WIDTH);
+		}
+#pragma GCC unroll 8
+		for (int i = 0; i < MR; i++) {
+			VD ai = SPLAT(a[i]);
+#pragma GCC unroll 8
+			for (int j = 0; j < NR / WIDTH; j++) {
+				acc[i][j] += ai * bv[j];
+			}
+		}
+		a += MR;
+		b += NR;
+	}
+
+	// Full tiles add straight into C; edge tiles go through a buffer
+	VD scale = SPLAT(alpha);
+	if (mr == MR && nr == NR) {
+#pragma GCC unroll 8
+		for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 8
+			for (int j = 0; j < NR / WIDTH; j++) {
+				VD cv;
+				memcpy(&cv, c + i * ldc + j * WIDTH, sizeof(VD));
+				cv += scale * acc[i][j];
+				memcpy(c + i * ldc + j * WIDTH, &cv, sizeof(VD));
+			}
+		}
+		return;
+	}
+	double tile[MR][NR];
+	for (int i = 0; i < MR; i++) {
+		for (int j = 0; j < NR / WIDTH; j++) {
+			VD scaled = scale * acc[i][j];
+			memcpy(&tile[i][j * WIDTH], &scaled, sizeof(VD));
+		}
+	}
+	for (size_t i = 0; i < mr; i++) {
+		for (size_t j = 0; j < nr; j++) {
+			c[i * ldc + j] += tile[i][j];
+		}
+	}
+}
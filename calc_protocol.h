@@ -0,0 +1,88 @@
+// Calculation Server Protocol - framing between calc-server and its clients
+//
+// Every message is a 4-byte header followed by its payload: the payload
+// length as two bytes, low byte first, then the op or status byte and a zero
+// byte. Headers go through the encode and decode functions below, never
+// memcpy of the structs, so both ends agree whatever their byte order. A
+// request carries calculator keys for the connection's
+// session; the response carries the display text after the last key.
+// Clients may pipeline: any number of requests can be written without
+// waiting, and responses come back in request order. The server reads
+// whatever has arrived, answers every complete request in it and writes the
+// answers back with one write.
+
+#ifndef CALC_PROTOCOL_H
+#define CALC_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CALC_SOCKET_PATH "/tmp/calc-server.sock"
+
+// Largest payload in either direction
+#define CALC_PROTOCOL_MAX_PAYLOAD 0xFFFF
+
+// Bytes of either header on the wire
+#define CALC_PROTOCOL_HEADER_SIZE ((size_t)4)
+
+typedef enum calc_request_op {
+	CALC_REQUEST_KEYS = 1,    // Payload: keys for calc_session_key
+	CALC_REQUEST_RESET,       // No payload: clear the session to "0"
+} calc_request_op;
+
+typedef struct calc_request_header {
+	uint16_t length;          // Payload bytes after the header
+	uint8_t op;               // calc_request_op
+	uint8_t reserved;
+} calc_request_header;
+
+typedef enum calc_response_status {
+	CALC_RESPONSE_OK = 0,
+	CALC_RESPONSE_BAD_KEY,    // Keys before the first unknown key were applied
+	CALC_RESPONSE_BAD_OP,     // Nothing was applied
+} calc_response_status;
+
+typedef struct calc_response_header {
+	uint16_t length;          // Display text bytes after the header, no NUL
+	uint8_t status;           // calc_response_status
+	uint8_t reserved;
+} calc_response_header;
+
+// ============================================================================
+// Wire Format
+// ============================================================================
+
+static inline void calc_protocol_put_header(char* out, uint16_t length, uint8_t code) {
+	unsigned char* bytes = (unsigned char*)out;
+	bytes[0] = (unsigned char)(length & 0xFF);
+	bytes[1] = (unsigned char)(length >> 8);
+	bytes[2] = code;
+	bytes[3] = 0;
+}
+
+static inline uint16_t calc_protocol_header_length(const char* in) {
+	const unsigned char* bytes = (const unsigned char*)in;
+	return (uint16_t)(bytes[0] | bytes[1] << 8);
+}
+
+static inline void calc_request_header_encode(char* out, const calc_request_header* header) {
+	calc_protocol_put_header(out, header->length, header->op);
+}
+
+static inline void calc_request_header_decode(calc_request_header* header, const char* in) {
+	header->length = calc_protocol_header_length(in);
+	header->op = (uint8_t)in[2];
+	header->reserved = (uint8_t)in[3];
+}
+
+static inline void calc_response_header_encode(char* out, const calc_response_header* header) {
+	calc_protocol_put_header(out, header->length, header->status);
+}
+
+static inline void calc_response_header_decode(calc_response_header* header, const char* in) {
+	header->length = calc_protocol_header_length(in);
+	header->status = (uint8_t)in[2];
+	header->reserved = (uint8_t)in[3];
+}
+
+#endif
@@ -0,0 +1,1165 @@
+// Rational Arithmetic - exact fractions with 64-bit fast paths
+
+#include "calc_rational.h"
+#include "calc_cache.h"
+#include "calc_math.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned __int128 u128;
+
+static const uint64_t powers_of_ten[20] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+// ============================================================================
+// Naturals
+// ============================================================================
+
+static void nat_init(calc_natural* n) {
+	n->limbs = NULL;
+	n->length = 0;
+	n->capacity = 0;
+}
+
+static void nat_free(calc_natural* n) {
+	free(n->limbs);
+	nat_init(n);
+}
+
+static void nat_reserve(calc_natural* n, size_t capacity) {
+	if (capacity > n->capacity) {
+		n->limbs = realloc(n->limbs, capacity * sizeof(uint32_t));
+		n->capacity = capacity;
+	}
+}
+
+static void nat_trim(calc_natural* n) {
+	while (n->length && n->limbs[n->length - 1] == 0) {
+		n->length--;
+	}
+}
+
+static void nat_swap(calc_natural* a, calc_natural* b) {
+	calc_natural tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void nat_copy(calc_natural* dst, const calc_natural* src) {
+	if (dst == src) {
+		return;
+	}
+	nat_reserve(dst, src->length);
+	if (src->length) {
+		memcpy(dst->limbs, src->limbs, src->length * sizeof(uint32_t));
+	}
+	dst->length = src->length;
+}
+
+static void nat_set_u128(calc_natural* n, u128 value) {
+	nat_reserve(n, 4);
+	n->length = 0;
+	while (value) {
+		n->limbs[n->length++] = (uint32_t)value;
+		value >>= 32;
+	}
+}
+
+// Value of a natural of at most two limbs
+static uint64_t nat_to_u64(const calc_natural* n) {
+	uint64_t value = 0;
+	for (size_t i = n->length; i-- > 0;) {
+		value = value << 32 | n->limbs[i];
+	}
+	return value;
+}
+
+static size_t nat_bits(const calc_natural* n) {
+	return n->length ? n->length * 32 - (size_t)__builtin_clz(n->limbs[n->length - 1]) : 0;
+}
+
+// Trailing zero bits of a non-zero natural
+static size_t nat_ctz(const calc_natural* n) {
+	size_t i = 0;
+	while (n->limbs[i] == 0) {
+		i++;
+	}
+	return i * 32 + (size_t)__builtin_ctz(n->limbs[i]);
+}
+
+static int nat_compare(const calc_natural* a, const calc_natural* b) {
+	if (a->length != b->length) {
+		return a->length < b->length ? -1 : 1;
+	}
+	for (size_t i = a->length; i-- > 0;) {
+		if (a->limbs[i] != b->limbs[i]) {
+			return a->limbs[i] < b->limbs[i] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+// r = a + b; r may alias either
+static void nat_add(calc_natural* r, const calc_natural* a, const calc_natural* b) {
+	if (a->length < b->length) {
+		const calc_natural* tmp = a;
+		a = b;
+		b = tmp;
+	}
+	size_t length = a->length;
+	nat_reserve(r, length + 1);
+	uint64_t carry = 0;
+	for (size_t i = 0; i < length; i++) {
+		carry += (uint64_t)a->limbs[i] + (i < b->length ? b->limbs[i] : 0);
+		r->limbs[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	r->limbs[length] = (uint32_t)carry;
+	r->length = length + 1;
+	nat_trim(r);
+}
+
+// r = a - b for a >= b; r may alias either
+static void nat_sub(calc_natural* r, const calc_natural* a, const calc_natural* b) {
+	size_t length = a->length;
+	nat_reserve(r, length);
+	uint64_t borrow = 0;
+	for (size_t i = 0; i < length; i++) {
+		uint64_t x = (uint64_t)a->limbs[i] - (i < b->length ? b->limbs[i] : 0) - borrow;
+		r->limbs[i] = (uint32_t)x;
+		borrow = x >> 63;
+	}
+	r->length = length;
+	nat_trim(r);
+}
+
+// r = a * b (schoolbook); r may alias either
+static void nat_mul(calc_natural* r, const calc_natural* a, const calc_natural* b) {
+	if (!a->length || !b->length) {
+		r->length = 0;
+		return;
+	}
+	size_t length = a->length + b->length;
+	uint32_t* out = calloc(length, sizeof(uint32_t));
+	for (size_t i = 0; i < a->length; i++) {
+		uint64_t carry = 0;
+		for (size_t j = 0; j < b->length; j++) {
+			carry += (uint64_t)a->limbs[i] * b->limbs[j] + out[i + j];
+			out[i + j] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		out[i + b->length] = (uint32_t)carry;
+	}
+	free(r->limbs);
+	r->limbs = out;
+	r->capacity = length;
+	r->length = length;
+	nat_trim(r);
+}
+
+// r = a * m + add; r may alias a
+static void nat_mul_small_add(calc_natural* r, const calc_natural* a, uint32_t m, uint32_t add) {
+	size_t length = a->length;
+	nat_reserve(r, length + 1);
+	uint64_t carry = add;
+	for (size_t i = 0; i < length; i++) {
+		carry += (uint64_t)a->limbs[i] * m;
+		r->limbs[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+	r->limbs[length] = (uint32_t)carry;
+	r->length = length + 1;
+	nat_trim(r);
+}
+
+// q = a / d (q may be NULL or alias a); returns a % d
+static uint32_t nat_div_small(calc_natural* q, const calc_natural* a, uint32_t d) {
+	size_t length = a->length;
+	if (q) {
+		nat_reserve(q, length);
+	}
+	uint64_t rem = 0;
+	for (size_t i = length; i-- > 0;) {
+		uint64_t x = rem << 32 | a->limbs[i];
+		if (q) {
+			q->limbs[i] = (uint32_t)(x / d);
+		}
+		rem = x % d;
+	}
+	if (q) {
+		q->length = length;
+		nat_trim(q);
+	}
+	return (uint32_t)rem;
+}
+
+// r = a << bits; r may alias a
+static void nat_shift_left(calc_natural* r, const calc_natural* a, size_t bits) {
+	if (!a->length) {
+		r->length = 0;
+		return;
+	}
+	size_t words = bits / 32;
+	unsigned shift = bits % 32;
+	size_t from = a->length;
+	nat_reserve(r, from + words + 1);
+	const uint32_t* in = a->limbs;
+	uint32_t* out = r->limbs;
+	
+	// Top down, so shifting in place never overwrites a limb still to be read
+	out[from + words] = (uint32_t)((uint64_t)in[from - 1] >> (32 - shift));
+	for (size_t i = from; i-- > 0;) {
+		uint64_t pair = (uint64_t)in[i] << 32 | (i ? in[i - 1] : 0);
+		out[i + words] = (uint32_t)(pair >> (32 - shift));
+	}
+	memset(out, 0, words * sizeof(uint32_t));
+	r->length = from + words + 1;
+	nat_trim(r);
+}
+
+static void nat_shift_right(calc_natural* n, size_t bits) {
+	size_t words = bits / 32;
+	unsigned shift = bits % 32;
+	if (words >= n->length) {
+		n->length = 0;
+		return;
+	}
+	size_t length = n->length - words;
+	for (size_t i = 0; i < length; i++) {
+		uint64_t pair = n->limbs[i + words];
+		if (i + words + 1 < n->length) {
+			pair |= (uint64_t)n->limbs[i + words + 1] << 32;
+		}
+		n->limbs[i] = (uint32_t)(pair >> shift);
+	}
+	n->length = length;
+	nat_trim(n);
+}
+
+// q = a / b and r = a % b for non-zero b (Knuth's algorithm D). Either
+// result may be NULL or alias an operand.
+static void nat_divmod(calc_natural* q, calc_natural* r, const calc_natural* a, const calc_natural* b) {
+	if (nat_compare(a, b) < 0) {
+		if (r) {
+			nat_copy(r, a);
+		}
+		if (q) {
+			q->length = 0;
+		}
+		return;
+	}
+	if (b->length == 1) {
+		uint32_t rem = nat_div_small(q, a, b->limbs[0]);
+		if (r) {
+			nat_set_u128(r, rem);
+		}
+		return;
+	}
+	
+	// Normalize so the divisor's top bit is set
+	size_t n = b->length;
+	size_t m = a->length - n;
+	unsigned shift = (unsigned)__builtin_clz(b->limbs[n - 1]);
+	uint32_t* v = malloc(n * sizeof(uint32_t));
+	uint32_t* u = malloc((a->length + 1) * sizeof(uint32_t));
+	uint32_t* quotient = malloc((m + 1) * sizeof(uint32_t));
+	for (size_t i = n; i-- > 0;) {
+		uint64_t pair = (uint64_t)b->limbs[i] << 32 | (i ? b->limbs[i - 1] : 0);
+		v[i] = (uint32_t)(pair >> (32 - shift));
+	}
+	u[a->length] = (uint32_t)((uint64_t)a->limbs[a->length - 1] >> (32 - shift));
+	for (size_t i = a->length; i-- > 0;) {
+		uint64_t pair = (uint64_t)a->limbs[i] << 32 | (i ? a->limbs[i - 1] : 0);
+		u[i] = (uint32_t)(pair >> (32 - shift));
+	}
+	
+	for (size_t j = m + 1; j-- > 0;) {
+		// Estimate the quotient limb from the top two limbs; it is at most 2 too big
+		uint64_t top = (uint64_t)u[j + n] << 32 | u[j + n - 1];
+		uint64_t qhat = top / v[n - 1];
+		uint64_t rhat = top % v[n - 1];
+		while (qhat >> 32 || qhat * v[n - 2] > (rhat << 32 | u[j + n - 2])) {
+			qhat--;
+			rhat += v[n - 1];
+			if (rhat >> 32) {
+				break;
+			}
+		}
+		
+		// u -= qhat * v, adding v back if that went negative
+		int64_t k = 0;
+		int64_t t;
+		for (size_t i = 0; i < n; i++) {
+			uint64_t p = qhat * v[i];
+			t = (int64_t)u[i + j] - k - (int64_t)(p & 0xFFFFFFFF);
+			u[i + j] = (uint32_t)t;
+			k = (int64_t)(p >> 32) - (t >> 32);
+		}
+		t = (int64_t)u[j + n] - k;
+		u[j + n] = (uint32_t)t;
+		quotient[j] = (uint32_t)qhat;
+		if (t < 0) {
+			quotient[j]--;
+			uint64_t carry = 0;
+			for (size_t i = 0; i < n; i++) {
+				carry += (uint64_t)u[i + j] + v[i];
+				u[i + j] = (uint32_t)carry;
+				carry >>= 32;
+			}
+			u[j + n] += (uint32_t)carry;
+		}
+	}
+	
+	if (r) {
+		nat_reserve(r, n);
+		for (size_t i = 0; i < n; i++) {
+			r->limbs[i] = (uint32_t)(((uint64_t)u[i + 1] << 32 | u[i]) >> shift);
+		}
+		r->length = n;
+		nat_trim(r);
+	}
+	if (q) {
+		free(q->limbs);
+		q->limbs = quotient;
+		q->capacity = m + 1;
+		q->length = m + 1;
+		nat_trim(q);
+	} else {
+		free(quotient);
+	}
+	free(u);
+	free(v);
+}
+
+// g = gcd(a, b): binary GCD on odd naturals, with a division step when one is
+// much longer than the other, and the word GCD once both fit in 64 bits
+static void nat_gcd(calc_natural* g, const calc_natural* a, const calc_natural* b) {
+	if (!a->length || !b->length) {
+		nat_copy(g, a->length ? a : b);
+		return;
+	}
+	calc_natural u, v;
+	nat_init(&u);
+	nat_init(&v);
+	nat_copy(&u, a);
+	nat_copy(&v, b);
+	size_t u_zeros = nat_ctz(&u);
+	size_t v_zeros = nat_ctz(&v);
+	size_t shift = u_zeros < v_zeros ? u_zeros : v_zeros;
+	nat_shift_right(&u, u_zeros);
+	nat_shift_right(&v, v_zeros);
+	
+	for (;;) {
+		// u and v are odd
+		if (u.length <= 2 && v.length <= 2) {
+			nat_set_u128(&u, calc_rational_gcd(nat_to_u64(&u), nat_to_u64(&v)));
+			break;
+		}
+		if (nat_compare(&u, &v) < 0) {
+			nat_swap(&u, &v);
+		}
+		if (u.length > v.length + 1) {
+			nat_divmod(NULL, &u, &u, &v);
+		} else {
+			nat_sub(&u, &u, &v);
+		}
+		if (!u.length) {
+			nat_swap(&u, &v);
+			break;
+		}
+		nat_shift_right(&u, nat_ctz(&u));
+	}
+	nat_shift_left(g, &u, shift);
+	nat_free(&u);
+	nat_free(&v);
+}
+
+// ============================================================================
+// Lifetime & Conversion
+// ============================================================================
+
+void calc_rational_init(calc_rational* r) {
+	r->num = 0;
+	r->den = 1;
+	r->negative = 0;
+	r->big = 0;
+	nat_init(&r->big_num);
+	nat_init(&r->big_den);
+}
+
+void calc_rational_free(calc_rational* r) {
+	nat_free(&r->big_num);
+	nat_free(&r->big_den);
+	calc_rational_init(r);
+}
+
+void calc_rational_set_zero(calc_rational* r) {
+	r->num = 0;
+	r->den = 1;
+	r->negative = 0;
+	r->big = 0;
+}
+
+void calc_rational_copy(calc_rational* dst, const calc_rational* src) {
+	if (dst == src) {
+		return;
+	}
+	dst->num = src->num;
+	dst->den = src->den;
+	dst->negative = src->negative;
+	dst->big = src->big;
+	if (src->big) {
+		nat_copy(&dst->big_num, &src->big_num);
+		nat_copy(&dst->big_den, &src->big_den);
+	}
+}
+
+// Store a fraction already in lowest terms
+static void set_u128(calc_rational* r, int negative, u128 num, u128 den) {
+	if (num == 0) {
+		calc_rational_set_zero(r);
+		return;
+	}
+	r->negative = negative;
+	if ((num >> 64) == 0 && (den >> 64) == 0) {
+		r->big = 0;
+		r->num = (uint64_t)num;
+		r->den = (uint64_t)den;
+	} else {
+		r->big = 1;
+		nat_set_u128(&r->big_num, num);
+		nat_set_u128(&r->big_den, den);
+	}
+}
+
+// Take num / den (in lowest terms) into r, back in the small form if it fits;
+// num and den are left holding r's old storage
+static void set_naturals(calc_rational* r, int negative, calc_natural* num, calc_natural* den) {
+	if (!num->length) {
+		calc_rational_set_zero(r);
+		return;
+	}
+	r->negative = negative;
+	if (num->length <= 2 && den->length <= 2) {
+		r->big = 0;
+		r->num = nat_to_u64(num);
+		r->den = nat_to_u64(den);
+	} else {
+		r->big = 1;
+		nat_swap(&r->big_num, num);
+		nat_swap(&r->big_den, den);
+	}
+}
+
+static void to_naturals(const calc_rational* r, calc_natural* num, calc_natural* den) {
+	if (r->big) {
+		nat_copy(num, &r->big_num);
+		nat_copy(den, &r->big_den);
+	} else {
+		nat_set_u128(num, r->num);
+		nat_set_u128(den, r->den);
+	}
+}
+
+void calc_rational_set_scaled(calc_rational* r, uint64_t mantissa, int fraction_digits, int negative) {
+	uint64_t den = powers_of_ten[fraction_digits];
+	uint64_t g = calc_rational_gcd(mantissa, den);
+	set_u128(r, negative, mantissa / g, den / g);
+}
+
+int calc_rational_set_double(calc_rational* r, double value) {
+	if (!isfinite(value)) {
+		// 1/0 or 0/0
+		r->num = !isnan(value);
+		r->den = 0;
+		r->negative = !isnan(value) && value < 0;
+		r->big = 0;
+		return 0;
+	}
+	if (value == 0) {
+		calc_rational_set_zero(r);
+		return 1;
+	}
+	// |value| = mantissa * 2^exponent with an odd mantissa
+	int exponent;
+	uint64_t mantissa = (uint64_t)ldexp(frexp(fabs(value), &exponent), 53);
+	exponent -= 53;
+	int zeros = __builtin_ctzll(mantissa);
+	mantissa >>= zeros;
+	exponent += zeros;
+	
+	if (exponent >= 0 && exponent <= 11) {
+		set_u128(r, value < 0, (u128)mantissa << exponent, 1);
+	} else if (exponent < 0 && exponent > -64) {
+		set_u128(r, value < 0, mantissa, (u128)1 << -exponent);
+	} else {
+		calc_natural num, den;
+		nat_init(&num);
+		nat_init(&den);
+		nat_set_u128(&num, mantissa);
+		nat_set_u128(&den, 1);
+		if (exponent > 0) {
+			nat_shift_left(&num, &num, (size_t)exponent);
+		} else {
+			nat_shift_left(&den, &den, (size_t)-exponent);
+		}
+		set_naturals(r, value < 0, &num, &den);
+		nat_free(&num);
+		nat_free(&den);
+	}
+	return 1;
+}
+
+// Leading bits of a natural as a double, scaled by 2^-exponent
+static double nat_leading(const calc_natural* n, long* exponent) {
+	if (n->length <= 2) {
+		*exponent = 0;
+		return (double)nat_to_u64(n);
+	}
+	size_t top = n->length - 1;
+	*exponent = (long)(top - 2) * 32;
+	return ((double)n->limbs[top] * 4294967296.0 + n->limbs[top - 1]) * 4294967296.0 + n->limbs[top - 2];
+}
+
+// The value as m * 2^exponent with 0.5 <= |m| < 1, so bignums beyond the
+// double range keep their leading bits (exponent 0 for zero, infinity, NaN)
+static double split_double(const calc_rational* r, long* exponent) {
+	long num_exponent = 0;
+	long den_exponent = 0;
+	double value;
+	if (r->big) {
+		double num = nat_leading(&r->big_num, &num_exponent);
+		double den = nat_leading(&r->big_den, &den_exponent);
+		value = num / den;
+	} else {
+		value = (double)r->num / (double)r->den;
+	}
+	int shift = 0;
+	if (isfinite(value)) {
+		value = frexp(value, &shift);
+	}
+	*exponent = num_exponent - den_exponent + shift;
+	return r->negative ? -value : value;
+}
+
+double calc_rational_to_double(const calc_rational* r) {
+	long exponent;
+	double m = split_double(r, &exponent);
+	return ldexp(m, (int)exponent);
+}
+
+// A bignum whose double is out of range or subnormal
+static int beyond_double(const calc_rational* r, double value) {
+	return r->big && !(fabs(value) >= DBL_MIN && fabs(value) <= DBL_MAX);
+}
+
+double calc_rational_function(calc_function function, const calc_rational* r) {
+	double value = calc_rational_to_double(r);
+	if (!beyond_double(r, value)) {
+		return calc_math_apply(function, value);
+	}
+	long exponent;
+	double m = split_double(r, &exponent);
+	switch (function) {
+		case CALC_SQRT:
+			if (exponent & 1) {
+				m *= 2;
+				exponent--;
+			}
+			return ldexp(calc_sqrt(m), (int)(exponent / 2));
+		case CALC_LN:
+			return calc_ln(m) + (double)exponent * 0.69314718055994530942;
+		case CALC_LOG10:
+			return calc_log10(m) + (double)exponent * 0.30102999566398119521;
+		default:
+			return calc_math_apply(function, value);
+	}
+}
+
+int calc_rational_is_zero(const calc_rational* r) {
+	return !r->big && r->num == 0 && r->den != 0;
+}
+
+int calc_rational_is_finite(const calc_rational* r) {
+	return r->big || r->den != 0;
+}
+
+int calc_rational_is_integer(const calc_rational* r) {
+	return r->big ? r->big_den.length == 1 && r->big_den.limbs[0] == 1 : r->den == 1;
+}
+
+// ============================================================================
+// Text
+// ============================================================================
+
+// Appends into a fixed buffer, counting what does not fit
+typedef struct text_writer {
+	char* buffer;
+	size_t size;
+	size_t length;
+} text_writer;
+
+static void put_text(text_writer* w, const char* text, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		if (w->length + 1 < w->size) {
+			w->buffer[w->length] = text[i];
+		}
+		w->length++;
+	}
+}
+
+static void put_u64(text_writer* w, uint64_t value) {
+	char digits[20];
+	int count = 0;
+	do {
+		digits[19 - count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+	put_text(w, digits + 20 - count, (size_t)count);
+}
+
+static void put_natural(text_writer* w, const calc_natural* n) {
+	if (n->length <= 2) {
+		put_u64(w, nat_to_u64(n));
+		return;
+	}
+	// Nine digits at a time, least significant first
+	calc_natural q;
+	nat_init(&q);
+	nat_copy(&q, n);
+	uint32_t* chunks = malloc((n->length * 32 / 29 + 2) * sizeof(uint32_t));
+	size_t count = 0;
+	do {
+		chunks[count++] = nat_div_small(&q, &q, 1000000000u);
+	} while (q.length);
+	put_u64(w, chunks[count - 1]);
+	for (size_t i = count - 1; i-- > 0;) {
+		char digits[9];
+		uint32_t chunk = chunks[i];
+		for (int k = 8; k >= 0; k--) {
+			digits[k] = (char)('0' + chunk % 10);
+			chunk /= 10;
+		}
+		put_text(w, digits, 9);
+	}
+	free(chunks);
+	nat_free(&q);
+}
+
+// Digits after the point: digits[pre..count) in parentheses when they repeat,
+// "..." after them when the expansion was cut off
+static void put_fraction_digits(text_writer* w, const char* digits, int count, int pre, int repeats, int cut) {
+	put_text(w, ".", 1);
+	if (repeats) {
+		put_text(w, digits, (size_t)pre);
+		put_text(w, "(", 1);
+		put_text(w, digits + pre, (size_t)(count - pre));
+		put_text(w, ")", 1);
+	} else {
+		put_text(w, digits, (size_t)count);
+		if (cut) {
+			put_text(w, "...", 3);
+		}
+	}
+}
+
+// Digits before the repeating part of 1/den: the larger power of 2 or 5 in den
+static int small_preperiod(uint64_t den) {
+	int twos = __builtin_ctzll(den);
+	int fives = 0;
+	for (den >>= twos; den % 5 == 0 && fives <= CALC_RATIONAL_DECIMAL_PLACES; den /= 5) {
+		fives++;
+	}
+	return twos > fives ? twos : fives;
+}
+
+static void put_decimal_small(text_writer* w, uint64_t num, uint64_t den) {
+	put_u64(w, num / den);
+	uint64_t rem = num % den;
+	if (!rem) {
+		return;
+	}
+	// Long division; the digits repeat once the remainder after the
+	// non-repeating digits comes round again
+	int pre = small_preperiod(den);
+	char digits[CALC_RATIONAL_DECIMAL_PLACES];
+	int count = 0;
+	int repeats = 0;
+	uint64_t start = 0;
+	while (count < CALC_RATIONAL_DECIMAL_PLACES) {
+		if (count == pre) {
+			start = rem;
+		}
+		u128 x = (u128)rem * 10;
+		digits[count++] = (char)('0' + (int)(x / den));
+		rem = (uint64_t)(x % den);
+		if (!rem || (count > pre && rem == start)) {
+			repeats = rem != 0;
+			break;
+		}
+	}
+	put_fraction_digits(w, digits, count, pre, repeats, rem != 0 && !repeats);
+}
+
+static void put_decimal_big(text_writer* w, const calc_natural* num, const calc_natural* den) {
+	calc_natural q, rem, start, d;
+	nat_init(&q);
+	nat_init(&rem);
+	nat_init(&start);
+	nat_init(&d);
+	nat_divmod(&q, &rem, num, den);
+	put_natural(w, &q);
+	if (rem.length) {
+		// Non-repeating digits: the larger power of 2 or 5 in den
+		size_t twos = nat_ctz(den);
+		size_t fives = 0;
+		nat_copy(&d, den);
+		nat_shift_right(&d, twos);
+		while (fives <= CALC_RATIONAL_DECIMAL_PLACES && nat_div_small(&q, &d, 5) == 0) {
+			nat_swap(&q, &d);
+			fives++;
+		}
+		size_t larger = twos > fives ? twos : fives;
+		int pre = larger > CALC_RATIONAL_DECIMAL_PLACES ? CALC_RATIONAL_DECIMAL_PLACES + 1 : (int)larger;
+		
+		char digits[CALC_RATIONAL_DECIMAL_PLACES];
+		int count = 0;
+		int repeats = 0;
+		while (count < CALC_RATIONAL_DECIMAL_PLACES) {
+			if (count == pre) {
+				nat_copy(&start, &rem);
+			}
+			nat_mul_small_add(&rem, &rem, 10, 0);
+			nat_divmod(&q, &rem, &rem, den);
+			digits[count++] = (char)('0' + (q.length ? q.limbs[0] : 0));
+			if (!rem.length || (count > pre && nat_compare(&rem, &start) == 0)) {
+				repeats = rem.length != 0;
+				break;
+			}
+		}
+		put_fraction_digits(w, digits, count, pre, repeats, rem.length && !repeats);
+	}
+	nat_free(&q);
+	nat_free(&rem);
+	nat_free(&start);
+	nat_free(&d);
+}
+
+size_t calc_rational_to_string(const calc_rational* r, char* buffer, size_t size, int as_decimal) {
+	text_writer w = {buffer, size, 0};
+	if (r->negative) {
+		put_text(&w, "-", 1);
+	}
+	if (!calc_rational_is_finite(r)) {
+		put_text(&w, r->num ? "Infinity" : "NaN", r->num ? 8 : 3);
+	} else if (as_decimal) {
+		if (r->big) {
+			put_decimal_big(&w, &r->big_num, &r->big_den);
+		} else {
+			put_decimal_small(&w, r->num, r->den);
+		}
+	} else if (r->big) {
+		put_natural(&w, &r->big_num);
+		if (!calc_rational_is_integer(r)) {
+			put_text(&w, "/", 1);
+			put_natural(&w, &r->big_den);
+		}
+	} else {
+		put_u64(&w, r->num);
+		if (r->den != 1) {
+			put_text(&w, "/", 1);
+			put_u64(&w, r->den);
+		}
+	}
+	if (size) {
+		buffer[w.length < size ? w.length : size - 1] = '\0';
+	}
+	return w.length;
+}
+
+// ============================================================================
+// Arithmetic
+// ============================================================================
+
+uint64_t calc_rational_gcd(uint64_t a, uint64_t b) {
+	if (!a || !b) {
+		return a | b;
+	}
+	// Common factors of two come back at the end; the rest is odd minus odd,
+	// kept branch-free: the difference's trailing zeros are the same either
+	// way round (the top bit stands in for ctz(0) on the last step)
+	int a_zeros = __builtin_ctzll(a);
+	int b_zeros = __builtin_ctzll(b);
+	int shift = a_zeros < b_zeros ? a_zeros : b_zeros;
+	b >>= b_zeros;
+	while (a != 0) {
+		a >>= a_zeros;
+		uint64_t difference = a > b ? a - b : b - a;
+		a_zeros = __builtin_ctzll((a - b) | (1ULL << 63));
+		b = a < b ? a : b;
+		a = difference;
+	}
+	return b << shift;
+}
+
+// a + b, with b's sign taken as b_negative. With d1 = gcd(b, d),
+// a/b + c/d = (a*(d/d1) + c*(b/d1)) / ((b/d1)*d), and only d1 can share a
+// factor with that numerator. Returns 0 if the numerator overflows 128 bits.
+static int add_small(calc_rational* result, const calc_rational* a, const calc_rational* b, int b_negative) {
+	uint64_t d1 = calc_rational_gcd(a->den, b->den);
+	uint64_t a_den = a->den / d1;
+	uint64_t b_den = b->den / d1;
+	u128 x = (u128)a->num * b_den;
+	u128 y = (u128)b->num * a_den;
+	u128 t;
+	int negative;
+	if (a->negative == b_negative) {
+		if (__builtin_add_overflow(x, y, &t)) {
+			return 0;
+		}
+		negative = b_negative;
+	} else if (x >= y) {
+		t = x - y;
+		negative = a->negative;
+	} else {
+		t = y - x;
+		negative = b_negative;
+	}
+	uint64_t d2 = d1 == 1 ? 1 : calc_rational_gcd((uint64_t)(t % d1), d1);
+	if (d2 != 1) {
+		t /= d2;
+	}
+	set_u128(result, negative, t, (u128)a_den * (b->den / d2));
+	return 1;
+}
+
+static void add_big(calc_rational* result, const calc_rational* a, const calc_rational* b, int b_negative) {
+	calc_natural an, ad, bn, bd, d1, x;
+	nat_init(&an);
+	nat_init(&ad);
+	nat_init(&bn);
+	nat_init(&bd);
+	nat_init(&d1);
+	nat_init(&x);
+	to_naturals(a, &an, &ad);
+	to_naturals(b, &bn, &bd);
+	
+	nat_gcd(&d1, &ad, &bd);
+	nat_divmod(&ad, NULL, &ad, &d1);
+	nat_divmod(&x, NULL, &bd, &d1);
+	nat_mul(&an, &an, &x);
+	nat_mul(&bn, &bn, &ad);
+	int negative;
+	if (a->negative == b_negative) {
+		nat_add(&an, &an, &bn);
+		negative = b_negative;
+	} else if (nat_compare(&an, &bn) >= 0) {
+		nat_sub(&an, &an, &bn);
+		negative = a->negative;
+	} else {
+		nat_sub(&an, &bn, &an);
+		negative = b_negative;
+	}
+	
+	// Reduce by d2 = gcd(numerator, d1)
+	nat_gcd(&x, &an, &d1);
+	if (x.length && !(x.length == 1 && x.limbs[0] == 1)) {
+		nat_divmod(&an, NULL, &an, &x);
+		nat_divmod(&bd, NULL, &bd, &x);
+	}
+	nat_mul(&ad, &ad, &bd);
+	set_naturals(result, negative, &an, &ad);
+	
+	nat_free(&an);
+	nat_free(&ad);
+	nat_free(&bn);
+	nat_free(&bd);
+	nat_free(&d1);
+	nat_free(&x);
+}
+
+// a op b in double when either is infinite or NaN; returns 0 if both are
+// finite
+static int non_finite(calc_rational* result, const calc_rational* a, char op, const calc_rational* b) {
+	if (calc_rational_is_finite(a) && calc_rational_is_finite(b)) {
+		return 0;
+	}
+	double x = calc_rational_to_double(a);
+	double y = calc_rational_to_double(b);
+	double value;
+	switch (op) {
+		case '+': value = x + y; break;
+		case '-': value = x - y; break;
+		case '*': value = x * y; break;
+		case '/': value = x / y; break;
+		default: value = calc_pow(x, y); break;
+	}
+	calc_rational_set_double(result, value);
+	return 1;
+}
+
+static void add_signed(calc_rational* result, const calc_rational* a, const calc_rational* b, int b_negative) {
+	if ((a->big || b->big) || !add_small(result, a, b, b_negative)) {
+		add_big(result, a, b, b_negative);
+	}
+}
+
+void calc_rational_add(calc_rational* result, const calc_rational* a, const calc_rational* b) {
+	if (non_finite(result, a, '+', b)) {
+		return;
+	}
+	add_signed(result, a, b, b->negative);
+}
+
+void calc_rational_sub(calc_rational* result, const calc_rational* a, const calc_rational* b) {
+	if (non_finite(result, a, '-', b)) {
+		return;
+	}
+	add_signed(result, a, b, !b->negative);
+}
+
+// (a/b) * (c/d) = ((a/g1) * (c/g2)) / ((b/g2) * (d/g1)) with g1 = gcd(a, d) and
+// g2 = gcd(c, b), which is already in lowest terms
+void calc_rational_mul(calc_rational* result, const calc_rational* a, const calc_rational* b) {
+	if (non_finite(result, a, '*', b)) {
+		return;
+	}
+	int negative = a->negative != b->negative;
+	if (!a->big && !b->big) {
+		uint64_t g1 = calc_rational_gcd(a->num, b->den);
+		uint64_t g2 = calc_rational_gcd(b->num, a->den);
+		set_u128(result, negative, (u128)(a->num / g1) * (b->num / g2), (u128)(a->den / g2) * (b->den / g1));
+		return;
+	}
+	
+	calc_natural an, ad, bn, bd, g;
+	nat_init(&an);
+	nat_init(&ad);
+	nat_init(&bn);
+	nat_init(&bd);
+	nat_init(&g);
+	to_naturals(a, &an, &ad);
+	to_naturals(b, &bn, &bd);
+	nat_gcd(&g, &an, &bd);
+	if (g.length) {
+		nat_divmod(&an, NULL, &an, &g);
+		nat_divmod(&bd, NULL, &bd, &g);
+	}
+	nat_gcd(&g, &bn, &ad);
+	if (g.length) {
+		nat_divmod(&bn, NULL, &bn, &g);
+		nat_divmod(&ad, NULL, &ad, &g);
+	}
+	nat_mul(&an, &an, &bn);
+	nat_mul(&ad, &ad, &bd);
+	set_naturals(result, negative, &an, &ad);
+	nat_free(&an);
+	nat_free(&ad);
+	nat_free(&bn);
+	nat_free(&bd);
+	nat_free(&g);
+}
+
+int calc_rational_div(calc_rational* result, const calc_rational* a, const calc_rational* b) {
+	if (calc_rational_is_zero(b)) {
+		calc_rational_set_zero(result);
+		return 0;
+	}
+	if (non_finite(result, a, '/', b)) {
+		return 1;
+	}
+	// Multiply by b turned over; the copy shares b's limbs and is not freed
+	calc_rational inverse = *b;
+	inverse.num = b->den;
+	inverse.den = b->num;
+	inverse.big_num = b->big_den;
+	inverse.big_den = b->big_num;
+	calc_rational_mul(result, a, &inverse);
+	return 1;
+}
+
+static int magnitude_bits(const calc_rational* r) {
+	if (r->big) {
+		size_t bits = nat_bits(&r->big_num) > nat_bits(&r->big_den) ? nat_bits(&r->big_num) : nat_bits(&r->big_den);
+		return bits > CALC_RATIONAL_POW_BITS ? CALC_RATIONAL_POW_BITS + 1 : (int)bits;
+	}
+	uint64_t larger = r->num > r->den ? r->num : r->den;
+	return 64 - __builtin_clzll(larger);
+}
+
+// base^y in double, for a bignum base whose double is out of range: with
+// base = m * 2^k, m^y * 2^(y*k) keeps the result when it fits
+static double scaled_pow(const calc_rational* base, double y) {
+	long k;
+	double m = split_double(base, &k);
+	double t = y * (double)k;
+	double whole = floor(t);
+	if (!(fabs(whole) < 1e6)) {
+		// 2^(y*k) is beyond any double, and |k| > 1000 while |y*log2(m)| is
+		// at most |y|: only the signs matter
+		return calc_pow(m < 0 ? -1 : 1, y) * (t > 0 ? HUGE_VAL : 0);
+	}
+	return ldexp(calc_pow(m, y) * calc_pow(2, t - whole), (int)whole);
+}
+
+static void power(calc_rational* result, const calc_rational* base, const calc_rational* exponent) {
+	if (non_finite(result, base, '^', exponent)) {
+		return;
+	}
+	if (!exponent->big && exponent->den == 1) {
+		uint64_t e = exponent->num;
+		if (calc_rational_is_zero(base)) {
+			// 0^0 = 1; 0^-n is a division by zero
+			set_u128(result, 0, e == 0, 1);
+			return;
+		}
+		if (e <= (uint64_t)(CALC_RATIONAL_POW_BITS / magnitude_bits(base))) {
+			// Square and multiply
+			calc_rational square, product;
+			calc_rational_init(&square);
+			calc_rational_init(&product);
+			calc_rational_copy(&square, base);
+			set_u128(&product, 0, 1, 1);
+			for (; e; e >>= 1) {
+				if (e & 1) {
+					calc_rational_mul(&product, &product, &square);
+				}
+				if (e > 1) {
+					calc_rational_mul(&square, &square, &square);
+				}
+			}
+			if (exponent->negative) {
+				set_u128(&square, 0, 1, 1);
+				calc_rational_div(&product, &square, &product);
+			}
+			calc_rational_copy(result, &product);
+			calc_rational_free(&square);
+			calc_rational_free(&product);
+			return;
+		}
+	}
+	double x = calc_rational_to_double(base);
+	double y = calc_rational_to_double(exponent);
+	calc_rational_set_double(result, beyond_double(base, x) ? scaled_pow(base, y) : calc_pow(x, y));
+}
+
+static void operate(calc_rational* result, const calc_rational* lhs, char op, const calc_rational* rhs) {
+	switch (op) {
+		case '+': calc_rational_add(result, lhs, rhs); break;
+		case '-': calc_rational_sub(result, lhs, rhs); break;
+		case '*': calc_rational_mul(result, lhs, rhs); break;
+		case '/': calc_rational_div(result, lhs, rhs); break;
+		case '^': power(result, lhs, rhs); break;
+		default: calc_rational_copy(result, rhs); break;
+	}
+}
+
+// Operations worth a trip to the result cache: anything on bignums, whose
+// GCDs cost more than hashing them, and powers with a large exponent.
+// Machine-word fractions are cheaper than the lookup.
+#define CACHE_POWER_EXPONENT 32
+#define ENCODED_HEADER 18
+
+static size_t encoded_size(const calc_rational* r) {
+	return ENCODED_HEADER + (r->big ? (r->big_num.length + r->big_den.length) * sizeof(uint32_t) : 0);
+}
+
+// Sign, form, then numerator and denominator as two words or as two lengths
+// followed by their limbs; returns the bytes written
+static size_t encode(unsigned char* out, const calc_rational* r) {
+	out[0] = (unsigned char)r->negative;
+	out[1] = (unsigned char)r->big;
+	uint64_t words[2] = {r->num, r->den};
+	if (r->big) {
+		words[0] = r->big_num.length;
+		words[1] = r->big_den.length;
+		memcpy(out + ENCODED_HEADER, r->big_num.limbs, r->big_num.length * sizeof(uint32_t));
+		memcpy(out + ENCODED_HEADER + r->big_num.length * sizeof(uint32_t), r->big_den.limbs,
+			r->big_den.length * sizeof(uint32_t));
+	}
+	memcpy(out + 2, words, sizeof(words));
+	return encoded_size(r);
+}
+
+static void decode(calc_rational* r, const unsigned char* in) {
+	uint64_t words[2];
+	memcpy(words, in + 2, sizeof(words));
+	r->negative = in[0];
+	r->big = in[1];
+	if (!r->big) {
+		r->num = words[0];
+		r->den = words[1];
+		return;
+	}
+	nat_reserve(&r->big_num, words[0]);
+	nat_reserve(&r->big_den, words[1]);
+	memcpy(r->big_num.limbs, in + ENCODED_HEADER, words[0] * sizeof(uint32_t));
+	memcpy(r->big_den.limbs, in + ENCODED_HEADER + words[0] * sizeof(uint32_t), words[1] * sizeof(uint32_t));
+	r->big_num.length = words[0];
+	r->big_den.length = words[1];
+}
+
+// Result of the operation keyed by key, if cached
+static int cached_result(calc_rational* result, const unsigned char* key, size_t key_length) {
+	unsigned char buffer[1024];
+	size_t length = calc_cache_lookup(key, key_length, buffer, sizeof(buffer));
+	if (length > sizeof(buffer)) {
+		unsigned char* value = malloc(length);
+		int found = value && calc_cache_lookup(key, key_length, value, length) == length;
+		if (found) {
+			decode(result, value);
+		}
+		free(value);
+		return found;
+	}
+	if (length) {
+		decode(result, buffer);
+	}
+	return length != 0;
+}
+
+static void cache_result(const unsigned char* key, size_t key_length, const calc_rational* result) {
+	unsigned char buffer[1024];
+	unsigned char* value = encoded_size(result) <= sizeof(buffer) ? buffer : malloc(encoded_size(result));
+	if (value) {
+		calc_cache_insert(key, key_length, value, encode(value, result));
+	}
+	if (value != buffer) {
+		free(value);
+	}
+}
+
+void calc_rational_operation(calc_rational* result, const calc_rational* lhs, char op, const calc_rational* rhs) {
+	int costly = op && strchr("+-*/^", op) != NULL
+		&& (lhs->big || rhs->big || (op == '^' && rhs->num >= CACHE_POWER_EXPONENT));
+	if (!costly || !calc_cache_budget()) {
+		operate(result, lhs, op, rhs);
+		return;
+	}
+	
+	// Key: op and both operands, taken before result overwrites them
+	unsigned char buffer[1024];
+	size_t key_length = 1 + encoded_size(lhs) + encoded_size(rhs);
+	unsigned char* key = key_length <= sizeof(buffer) ? buffer : malloc(key_length);
+	if (!key) {
+		operate(result, lhs, op, rhs);
+		return;
+	}
+	key[0] = (unsigned char)op;
+	size_t lhs_length = encode(key + 1, lhs);
+	encode(key + 1 + lhs_length, rhs);
+	
+	if (!cached_result(result, key, key_length)) {
+		operate(result, lhs, op, rhs);
+		cache_result(key, key_length, result);
+	}
+	if (key != buffer) {
+		free(key);
+	}
+}
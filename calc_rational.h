@@ -0,0 +1,108 @@
+// Rational Arithmetic - exact fractions for the Rational menu
+//
+// A calc_rational is a fraction in lowest terms with a positive denominator,
+// so 1/3 * 3 is exactly 1 and 0.1 + 0.2 is exactly 3/10. While numerator and
+// denominator fit in 64 bits they are kept inline, and operations run on
+// 128-bit intermediates with only one 64-bit GCD each (Knuth's reductions:
+// cross-cancel before multiplying, and reduce a sum only by the gcd of the
+// denominators). A result that does not fit is promoted to arbitrary-precision
+// naturals and demoted again once it fits.
+//
+// GCDs are binary (Stein's algorithm: count trailing zeros, shift, subtract),
+// with one division step first when the operands differ much in length.
+//
+// Results that come from doubles (functions, powers that are not exact) can
+// be infinite or NaN. Those are kept as 1/0 (signed) and 0/0, shown as
+// "Infinity" and "NaN" like the double display, and arithmetic on them
+// follows the doubles.
+
+#ifndef CALC_RATIONAL_H
+#define CALC_RATIONAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "calc_math.h"
+
+// Decimal display: digits shown after the point before giving up on finding
+// the repeating part
+#define CALC_RATIONAL_DECIMAL_PLACES 30
+
+// Integer powers are exact while the result stays under this many bits;
+// other powers are computed in double
+#define CALC_RATIONAL_POW_BITS 65536
+
+typedef struct calc_natural {
+	uint32_t* limbs;   // Least significant first
+	size_t length;     // 0 for zero; otherwise the top limb is non-zero
+	size_t capacity;
+} calc_natural;
+
+typedef struct calc_rational {
+	uint64_t num;           // |value| = num / den while big is 0; den is 0
+	uint64_t den;           // only for infinity (num 1) and NaN (num 0)
+	int negative;
+	int big;                // |value| = big_num / big_den instead
+	calc_natural big_num;
+	calc_natural big_den;
+} calc_rational;
+
+// ============================================================================
+// Lifetime & Conversion
+// ============================================================================
+
+// Zero, with nothing allocated until a value needs more than 64 bits
+void calc_rational_init(calc_rational* r);
+void calc_rational_free(calc_rational* r);
+void calc_rational_copy(calc_rational* dst, const calc_rational* src);
+void calc_rational_set_zero(calc_rational* r);
+
+// value = mantissa / 10^fraction_digits (fraction_digits at most 19)
+void calc_rational_set_scaled(calc_rational* r, uint64_t mantissa, int fraction_digits, int negative);
+
+// The double's exact value; returns 0 for infinities and NaN, which are kept
+// as such
+int calc_rational_set_double(calc_rational* r, double value);
+
+// A double within an ulp of the value (exact when both terms fit in 53 bits)
+double calc_rational_to_double(const calc_rational* r);
+
+// function(r) in double. Square root and logarithms of bignums beyond the
+// double range take the power of two out first, so sqrt(10^600) is 1e300
+// rather than sqrt(infinity).
+double calc_rational_function(calc_function function, const calc_rational* r);
+
+int calc_rational_is_zero(const calc_rational* r);
+int calc_rational_is_finite(const calc_rational* r);
+int calc_rational_is_integer(const calc_rational* r);
+
+// Write "[-]num/den" ("[-]num" for integers), or with as_decimal the decimal
+// expansion with the repeating digits in parentheses, e.g. "0.1(6)", cut off
+// with "..." after CALC_RATIONAL_DECIMAL_PLACES digits. Always terminates
+// buffer; returns the length the full text needs.
+size_t calc_rational_to_string(const calc_rational* r, char* buffer, size_t size, int as_decimal);
+
+// ============================================================================
+// Arithmetic
+// ============================================================================
+
+// Binary GCD of two words (gcd(0, b) = b)
+uint64_t calc_rational_gcd(uint64_t a, uint64_t b);
+
+// Exact results for finite operands; result may alias either operand
+void calc_rational_add(calc_rational* result, const calc_rational* a, const calc_rational* b);
+void calc_rational_sub(calc_rational* result, const calc_rational* a, const calc_rational* b);
+void calc_rational_mul(calc_rational* result, const calc_rational* a, const calc_rational* b);
+
+// Returns 0 and sets result to zero when b is zero
+int calc_rational_div(calc_rational* result, const calc_rational* a, const calc_rational* b);
+
+// perform_operation for rationals (rhs == 0 divides to 0). '^' is exact for
+// integer exponents within CALC_RATIONAL_POW_BITS, otherwise the exact value
+// of calc_pow's double result (infinity when it overflows), with bignum bases
+// scaled first so a base beyond the double range still gives the power that
+// fits. Operations on bignums and large powers are looked up in the result
+// cache (calc_cache.h).
+void calc_rational_operation(calc_rational* result, const calc_rational* lhs, char op, const calc_rational* rhs);
+
+#endif
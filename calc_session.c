@@ -0,0 +1,179 @@
+// Calculator Sessions - compact, pooled immediate-mode calculators
+
+#include "calc_session.h"
+#include "calc_stats.h"
+#include <stdlib.h>
+
+// ============================================================================
+// Sessions
+// ============================================================================
+
+void calc_session_init(calc_session* session) {
+	calc_input_clear(&session->input);
+	session->shows_entry = 0;
+	session->stats = NULL;
+}
+
+void calc_session_free(calc_session* session) {
+	if (session->stats) {
+		calc_stats_free(session->stats);
+		free(session->stats);
+		session->stats = NULL;
+	}
+}
+
+void calc_session_reset(calc_session* session) {
+	calc_session_free(session);
+	calc_session_init(session);
+}
+
+// The statistics keys' data set, allocated on first use; NULL if memory runs out
+static calc_stats* session_stats(calc_session* session) {
+	if (!session->stats) {
+		session->stats = malloc(sizeof(calc_stats));
+		if (session->stats && !calc_stats_init(session->stats)) {
+			free(session->stats);
+			session->stats = NULL;
+		}
+	}
+	return session->stats;
+}
+
+// calc_handle_key's steps for immediate double arithmetic on numbers
+int calc_session_key(calc_session* session, char key) {
+	calc_input* input = &session->input;
+	switch (calc_key_kind_of(key)) {
+		case CALC_KEY_DIGIT:
+			if (calc_input_digit(input, key)) {
+				session->shows_entry = 1;
+			}
+			return 1;
+		
+		case CALC_KEY_OPERATOR:
+		case CALC_KEY_MATRIX_OPERATOR:
+			calc_input_commit(input);
+			if (calc_input_operand_ready(input)) {
+				input->accumulator = perform_operation(input->accumulator, input->last_operator, input->display_value);
+				session->shows_entry = 0;
+			} else if (!calc_input_shows_accumulator(input)) {
+				input->accumulator = input->display_value;
+			}
+			calc_input_operator_done(input, key);
+			return 1;
+		
+		case CALC_KEY_EQUALS:
+			if (input->last_operator != '\0') {
+				calc_input_commit(input);
+				input->display_value = perform_operation(input->accumulator, input->last_operator, input->display_value);
+				session->shows_entry = 0;
+				calc_input_equals_done(input);
+			}
+			return 1;
+		
+		case CALC_KEY_PARENTHESIS:
+			return 1;  // Parentheses only mean something in expression mode
+		
+		case CALC_KEY_FUNCTION:
+		case CALC_KEY_MATRIX_FUNCTION:
+		case CALC_KEY_STATISTIC: {
+			calc_input_commit(input);
+			calc_input_function_operand(input);
+			double x = input->display_value;
+			int function = calc_key_function(key);
+			if (function >= 0) {
+				double result = calc_math_apply((calc_function)function, x);
+				if (calc_input_percent_of_accumulator(input, (calc_function)function)) {
+					result = input->accumulator * result;
+				}
+				input->display_value = result;
+			} else if (calc_key_kind_of(key) == CALC_KEY_MATRIX_FUNCTION) {
+				input->display_value = calc_matrix_function_number(key, x);
+			} else {
+				// Without memory for a data set the operand stays on the display
+				calc_stats* stats = session_stats(session);
+				if (stats) {
+					input->display_value = calc_statistic(stats, key, &x, 1);
+				}
+			}
+			session->shows_entry = 0;
+			input->new_number = 1;
+			return 1;
+		}
+		
+		default:
+			return 0;
+	}
+}
+
+int calc_session_format(const calc_session* session, char* buffer, const calc_format_options* format) {
+	if (session->shows_entry) {
+		return calc_entry_format(&session->input.entry, buffer);
+	}
+	const calc_input* input = &session->input;
+	return calc_format_double(buffer, calc_input_shows_accumulator(input) ? input->accumulator : input->display_value, format);
+}
+
+// ============================================================================
+// Session Pool
+// ============================================================================
+
+void calc_session_pool_init(calc_session_pool* pool, size_t slab_sessions) {
+	pool->slabs = NULL;
+	pool->free_list = NULL;
+	pool->slab_sessions = slab_sessions ? slab_sessions : 4096;
+	pool->carved = pool->slab_sessions;  // No slab yet: the first create allocates one
+	pool->live = 0;
+	pool->slab_count = 0;
+}
+
+void calc_session_pool_free(calc_session_pool* pool) {
+	size_t carved = pool->carved;
+	while (pool->slabs) {
+		// A free slot's link overlays only the start of the session, so its
+		// stats pointer is still the NULL calc_session_destroy left there
+		for (size_t i = 0; i < carved; i++) {
+			calc_session_free(&pool->slabs->slots[i].session);
+		}
+		carved = pool->slab_sessions;
+		calc_session_slab* next = pool->slabs->next;
+		free(pool->slabs);
+		pool->slabs = next;
+	}
+	calc_session_pool_init(pool, pool->slab_sessions);
+}
+
+calc_session* calc_session_create(calc_session_pool* pool) {
+	calc_session_slot* slot = pool->free_list;
+	if (slot) {
+		pool->free_list = slot->next_free;
+	} else {
+		// Carve from the newest slab, starting a new one when it is used up
+		if (pool->carved == pool->slab_sessions) {
+			calc_session_slab* slab = malloc(sizeof(calc_session_slab) + pool->slab_sessions * sizeof(calc_session_slot));
+			if (!slab) {
+				return NULL;
+			}
+			slab->next = pool->slabs;
+			pool->slabs = slab;
+			pool->slab_count++;
+			pool->carved = 0;
+		}
+		slot = &pool->slabs->slots[pool->carved++];
+	}
+	
+	pool->live++;
+	calc_session_init(&slot->session);
+	return &slot->session;
+}
+
+void calc_session_destroy(calc_session_pool* pool, calc_session* session) {
+	calc_session_free(session);
+	calc_session_slot* slot = (calc_session_slot*)session;
+	slot->next_free = pool->free_list;
+	pool->free_list = slot;
+	pool->live--;
+}
+
+size_t calc_session_pool_bytes(const calc_session_pool* pool) {
+	return pool->slab_count * (sizeof(calc_session_slab) + pool->slab_sessions * sizeof(calc_session_slot));
+}
@@ -0,0 +1,87 @@
+// Calculator Sessions - compact, pooled immediate-mode calculators
+//
+// A calc_session holds only the state immediate-mode double arithmetic needs
+// (56 bytes): the engine's calc_input, stepped with the same calc_input
+// functions calc_handle_key uses, and a data set allocated by the first
+// statistics key. There is no display callback: the display text is produced
+// on demand. Sessions come from a calc_session_pool, which carves them out of
+// large slabs and recycles them through a free list, so a service can keep
+// millions alive and create or destroy one without touching malloc.
+// Decimal, rational, expression and integer modes and matrix operands need
+// the full calc_engine.
+
+#ifndef CALC_SESSION_H
+#define CALC_SESSION_H
+
+#include <stddef.h>
+
+#include "calc_engine.h"
+
+// ============================================================================
+// Sessions
+// ============================================================================
+
+typedef struct calc_session {
+	calc_input input;
+	unsigned char shows_entry;       // Display shows the entry as typed
+	struct calc_stats* stats;        // NULL until a statistics key
+} calc_session;
+
+// Set up a session outside a pool, cleared to "0"
+void calc_session_init(calc_session* session);
+
+// Release the session's data set; it may be initialised again afterwards
+void calc_session_free(calc_session* session);
+
+// Clear to "0" and empty the data set
+void calc_session_reset(calc_session* session);
+
+// Feed one key, with calc_handle_key's meaning in immediate double arithmetic
+// (matrix keys treat numbers as 1 x 1 matrices); returns 0 if the key is not
+// a calculator key
+int calc_session_key(calc_session* session, char key);
+
+// Write the display text into buffer (CALC_FORMAT_BUFFER_SIZE bytes); format
+// may be NULL for shortest round-trip. Returns the text length.
+int calc_session_format(const calc_session* session, char* buffer, const calc_format_options* format);
+
+// ============================================================================
+// Session Pool
+// ============================================================================
+
+// Free slots hold the free-list link in place of the session
+typedef union calc_session_slot {
+	calc_session session;
+	union calc_session_slot* next_free;
+} calc_session_slot;
+
+typedef struct calc_session_slab {
+	struct calc_session_slab* next;
+	calc_session_slot slots[];
+} calc_session_slab;
+
+typedef struct calc_session_pool {
+	calc_session_slab* slabs;
+	calc_session_slot* free_list;
+	size_t slab_sessions;            // Sessions per slab
+	size_t carved;                   // Slots handed out from the newest slab
+	size_t live;
+	size_t slab_count;
+} calc_session_pool;
+
+// slab_sessions = 0 picks a default of 4096 (224 KiB slabs)
+void calc_session_pool_init(calc_session_pool* pool, size_t slab_sessions);
+
+// Release every slab and live session's data set; sessions from the pool
+// become invalid
+void calc_session_pool_free(calc_session_pool* pool);
+
+// A reset session, or NULL if memory runs out
+calc_session* calc_session_create(calc_session_pool* pool);
+
+void calc_session_destroy(calc_session_pool* pool, calc_session* session);
+
+// Bytes held by the pool's slabs
+size_t calc_session_pool_bytes(const calc_session_pool* pool);
+
+#endif
@@ -0,0 +1,492 @@
+// Statistics - streaming, mergeable summaries of data sets
+
+#include "calc_stats.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUB_COUNT (1 << CALC_STATS_SUB_BITS)
+
+// Negative buckets run from the largest magnitude down to index ZERO_BUCKET,
+// then the positive ones upwards, so index order is value order
+#define ZERO_BUCKET (CALC_STATS_OCTAVES * SUB_COUNT)
+
+// Biased exponent of 2^-128, the smallest magnitude with its own buckets
+#define LOWEST_EXPONENT (1023 - CALC_STATS_OCTAVES / 2)
+
+// Values per block in calc_stats_add_array; a block stays in L1 for the second pass
+#define STATS_BLOCK 512
+
+// ============================================================================
+// Histogram
+// ============================================================================
+
+static uint64_t double_bits(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double bits_double(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// The exponent and the top CALC_STATS_SUB_BITS mantissa bits pick the bucket
+static size_t bucket_index(double value) {
+	uint64_t bits = double_bits(value);
+	int64_t key = (int64_t)((bits & 0x7FFFFFFFFFFFFFFFull) >> (52 - CALC_STATS_SUB_BITS))
+		- ((int64_t)LOWEST_EXPONENT << CALC_STATS_SUB_BITS);
+	if (key < 0) {
+		return ZERO_BUCKET;
+	}
+	if (key >= ZERO_BUCKET) {
+		key = ZERO_BUCKET - 1;
+	}
+	return bits >> 63 ? ZERO_BUCKET - 1 - (size_t)key : ZERO_BUCKET + 1 + (size_t)key;
+}
+
+// The value fraction of the way through a bucket's range, in value order
+static double bucket_value(size_t index, double fraction) {
+	if (index == ZERO_BUCKET) {
+		return 0;
+	}
+	int negative = index < ZERO_BUCKET;
+	uint64_t key = negative ? ZERO_BUCKET - 1 - index : index - ZERO_BUCKET - 1;
+	uint64_t lower_bits = (key + ((uint64_t)LOWEST_EXPONENT << CALC_STATS_SUB_BITS)) << (52 - CALC_STATS_SUB_BITS);
+	double lower = bits_double(lower_bits);
+	double width = bits_double(lower_bits + (1ull << (52 - CALC_STATS_SUB_BITS))) - lower;
+	return negative ? -(lower + (1 - fraction) * width) : lower + fraction * width;
+}
+
+// ============================================================================
+// Summaries
+// ============================================================================
+
+int calc_stats_init(calc_stats* stats) {
+	stats->buckets = calloc(CALC_STATS_BUCKETS, sizeof(uint64_t));
+	if (!stats->buckets) {
+		return 0;
+	}
+	calc_stats_clear(stats);
+	return 1;
+}
+
+void calc_stats_free(calc_stats* stats) {
+	free(stats->buckets);
+	stats->buckets = NULL;
+}
+
+void calc_stats_clear(calc_stats* stats) {
+	stats->count = 0;
+	stats->ignored = 0;
+	stats->sum = 0;
+	stats->sum_error = 0;
+	stats->shift = 0;
+	stats->mean = 0;
+	stats->m2 = 0;
+	stats->min = INFINITY;
+	stats->max = -INFINITY;
+	memset(stats->buckets, 0, CALC_STATS_BUCKETS * sizeof(uint64_t));
+}
+
+// Neumaier's variant of Kahan summation: keeps what each addition rounded
+// away, whichever operand is larger
+static inline void compensated_add(double* sum, double* error, double value) {
+	double total = *sum + value;
+	*error += fabs(*sum) >= fabs(value) ? (*sum - total) + value : (value - total) + *sum;
+	*sum = total;
+}
+
+// Chan et al.: combine the moments of count values with mean (relative to
+// stats->shift, which must be set) and m2
+static void merge_moments(calc_stats* stats, uint64_t count, double mean, double m2) {
+	if (count == 0) {
+		return;
+	}
+	if (stats->count == 0) {
+		stats->count = count;
+		stats->mean = mean;
+		stats->m2 = m2;
+		return;
+	}
+	double n = (double)stats->count;
+	double total = n + (double)count;
+	double delta = mean - stats->mean;
+	stats->mean += delta * ((double)count / total);
+	stats->m2 += m2 + delta * delta * (n * (double)count / total);
+	stats->count += count;
+}
+
+void calc_stats_add(calc_stats* stats, double value) {
+	if (!isfinite(value)) {
+		stats->ignored++;
+		return;
+	}
+	
+	// Welford
+	if (stats->count == 0) {
+		stats->shift = value;
+	}
+	stats->count++;
+	double shifted = value - stats->shift;
+	double delta = shifted - stats->mean;
+	stats->mean += delta / (double)stats->count;
+	stats->m2 += delta * (shifted - stats->mean);
+	
+	compensated_add(&stats->sum, &stats->sum_error, value);
+	stats->min = value < stats->min ? value : stats->min;
+	stats->max = value > stats->max ? value : stats->max;
+	stats->buckets[bucket_index(value)]++;
+}
+
+// A block's sum, shifted sum, min and max in four independent lanes, then its
+// squared deviations from the block mean in a second pass over the cached
+// values. No division per value, unlike Welford's update.
+static void add_block(calc_stats* stats, const double* values, size_t count) {
+	// Non-finite values are rare: check the whole block with one branch
+	int finite = 1;
+	for (size_t i = 0; i < count; i++) {
+		finite &= values[i] - values[i] == 0;
+	}
+	if (!finite) {
+		for (size_t i = 0; i < count; i++) {
+			calc_stats_add(stats, values[i]);
+		}
+		return;
+	}
+	
+	if (stats->count == 0) {
+		stats->shift = values[0];
+	}
+	double shift = stats->shift;
+	double sum[4] = {0, 0, 0, 0};
+	double error[4] = {0, 0, 0, 0};
+	double shifted[4] = {0, 0, 0, 0};
+	double low[4] = {values[0], values[0], values[0], values[0]};
+	double high[4] = {values[0], values[0], values[0], values[0]};
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		for (int lane = 0; lane < 4; lane++) {
+			double v = values[i + lane];
+			compensated_add(&sum[lane], &error[lane], v);
+			shifted[lane] += v - shift;
+			low[lane] = v < low[lane] ? v : low[lane];
+			high[lane] = v > high[lane] ? v : high[lane];
+		}
+	}
+	for (; i < count; i++) {
+		compensated_add(&sum[0], &error[0], values[i]);
+		shifted[0] += values[i] - shift;
+		low[0] = values[i] < low[0] ? values[i] : low[0];
+		high[0] = values[i] > high[0] ? values[i] : high[0];
+	}
+	
+	double block_sum = 0;
+	double block_error = error[0] + error[1] + error[2] + error[3];
+	for (int lane = 0; lane < 4; lane++) {
+		compensated_add(&block_sum, &block_error, sum[lane]);
+		stats->min = low[lane] < stats->min ? low[lane] : stats->min;
+		stats->max = high[lane] > stats->max ? high[lane] : stats->max;
+	}
+	double mean = ((shifted[0] + shifted[1]) + (shifted[2] + shifted[3])) / (double)count;
+	
+	// Corrected two-pass: subtracting the squared sum of deviations cancels
+	// most of the error in the mean
+	double squares[4] = {0, 0, 0, 0};
+	double deviations[4] = {0, 0, 0, 0};
+	for (i = 0; i + 4 <= count; i += 4) {
+		for (int lane = 0; lane < 4; lane++) {
+			double d = (values[i + lane] - shift) - mean;
+			squares[lane] += d * d;
+			deviations[lane] += d;
+		}
+	}
+	for (; i < count; i++) {
+		double d = (values[i] - shift) - mean;
+		squares[0] += d * d;
+		deviations[0] += d;
+	}
+	double deviation = (deviations[0] + deviations[1]) + (deviations[2] + deviations[3]);
+	double m2 = (squares[0] + squares[1]) + (squares[2] + squares[3]) - deviation * deviation / (double)count;
+	
+	stats->sum_error += block_error;
+	compensated_add(&stats->sum, &stats->sum_error, block_sum);
+	merge_moments(stats, count, mean, m2 > 0 ? m2 : 0);
+	
+	uint64_t* buckets = stats->buckets;
+	for (i = 0; i < count; i++) {
+		buckets[bucket_index(values[i])]++;
+	}
+}
+
+void calc_stats_add_array(calc_stats* stats, const double* values, size_t count) {
+	while (count > 0) {
+		size_t n = count < STATS_BLOCK ? count : STATS_BLOCK;
+		add_block(stats, values, n);
+		values += n;
+		count -= n;
+	}
+}
+
+void calc_stats_merge(calc_stats* stats, const calc_stats* from) {
+	if (stats->count == 0) {
+		stats->shift = from->shift;
+	}
+	merge_moments(stats, from->count, from->mean + (from->shift - stats->shift), from->m2);
+	stats->ignored += from->ignored;
+	stats->sum_error += from->sum_error;
+	compensated_add(&stats->sum, &stats->sum_error, from->sum);
+	stats->min = from->min < stats->min ? from->min : stats->min;
+	stats->max = from->max > stats->max ? from->max : stats->max;
+	for (size_t i = 0; i < CALC_STATS_BUCKETS; i++) {
+		stats->buckets[i] += from->buckets[i];
+	}
+}
+
+double calc_stats_sum(const calc_stats* stats) {
+	return stats->sum + stats->sum_error;
+}
+
+double calc_stats_mean(const calc_stats* stats) {
+	return stats->count ? calc_stats_sum(stats) / (double)stats->count : 0;
+}
+
+double calc_stats_variance(const calc_stats* stats, int sample) {
+	uint64_t divisor = sample ? stats->count - 1 : stats->count;
+	if (stats->count == 0 || divisor == 0) {
+		return 0;
+	}
+	return stats->m2 / (double)divisor;
+}
+
+double calc_stats_stddev(const calc_stats* stats, int sample) {
+	return sqrt(calc_stats_variance(stats, sample));
+}
+
+double calc_stats_quantile(const calc_stats* stats, double q) {
+	if (stats->count == 0) {
+		return 0;
+	}
+	if (q <= 0) {
+		return stats->min;
+	}
+	if (q >= 1) {
+		return stats->max;
+	}
+	
+	// Nearest rank among 0 .. count - 1, spread evenly over its bucket
+	uint64_t rank = (uint64_t)(q * (double)(stats->count - 1) + 0.5);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < CALC_STATS_BUCKETS; i++) {
+		uint64_t count = stats->buckets[i];
+		if (seen + count > rank) {
+			double value = bucket_value(i, ((double)(rank - seen) + 0.5) / (double)count);
+			return value < stats->min ? stats->min : value > stats->max ? stats->max : value;
+		}
+		seen += count;
+	}
+	return stats->max;
+}
+
+// ============================================================================
+// Number Parsing
+// ============================================================================
+
+static const unsigned char separators[256] = {
+	[' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\r'] = 1, ['\v'] = 1, ['\f'] = 1, [','] = 1, [';'] = 1,
+};
+
+// Every power of ten up to 10^22 is an exact double
+static const double powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Largest mantissa that can take n more digits without overflow
+#define MANTISSA_LIMIT(power) ((UINT64_MAX - ((power) - 1)) / (power))
+static const uint64_t digit_powers[9] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+};
+static const uint64_t mantissa_limits[9] = {
+	UINT64_MAX, MANTISSA_LIMIT(10ull), MANTISSA_LIMIT(100ull), MANTISSA_LIMIT(1000ull),
+	MANTISSA_LIMIT(10000ull), MANTISSA_LIMIT(100000ull), MANTISSA_LIMIT(1000000ull),
+	MANTISSA_LIMIT(10000000ull), MANTISSA_LIMIT(100000000ull),
+};
+
+// Eight characters as a little-endian word, first character in the low byte
+static inline uint64_t load_eight(const char* p) {
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+	return word;
+}
+
+// SWAR: the high bit of each byte that is not '0'-'9'. Adding 0x50 and 0x46
+// to the low seven bits sets the high bit from 0x30 and from 0x3A up, with no
+// carry into the next byte.
+static inline uint64_t non_digit_bytes(uint64_t word) {
+	uint64_t low = word & 0x7F7F7F7F7F7F7F7Full;
+	uint64_t from_zero = low + 0x5050505050505050ull;
+	uint64_t past_nine = low + 0x4646464646464646ull;
+	return (word | ~from_zero | past_nine) & 0x8080808080808080ull;
+}
+
+// Up to eight digit characters in the low bytes, the rest zero bytes, to
+// their value in three multiplies: pairs of digits, pairs of pairs, halves
+static inline uint32_t eight_digits_value(uint64_t word) {
+	word = ((word & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+	word = ((word & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+	return (uint32_t)(((word & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32);
+}
+
+static inline int is_digit(char c) {
+	return (unsigned char)(c - '0') < 10;
+}
+
+// Accumulate digits into *mantissa, a word at a time while eight bytes are
+// left; digits that no longer fit set *overflow. Adds the digits read to
+// *digits.
+static inline const char* read_digits(const char* p, const char* end, uint64_t* mantissa,
+                                      size_t* digits, int* overflow) {
+	const char* start = p;
+	uint64_t m = *mantissa;
+	while (end - p >= 8) {
+		uint64_t word = load_eight(p);
+		uint64_t stops = non_digit_bytes(word);
+		int n = stops ? __builtin_ctzll(stops) / 8 : 8;
+		if (n > 0) {
+			// Move the run to the top so the zero bytes below read as leading zeros
+			uint64_t run = n < 8 ? word << (8 * (8 - n)) : word;
+			if (m > mantissa_limits[n]) {
+				*overflow = 1;
+			} else {
+				m = m * digit_powers[n] + eight_digits_value(run);
+			}
+			p += n;
+		}
+		if (n < 8) {
+			*mantissa = m;
+			*digits += (size_t)(p - start);
+			return p;
+		}
+	}
+	while (p < end && is_digit(*p)) {
+		if (m > mantissa_limits[1]) {
+			*overflow = 1;
+		} else {
+			m = m * 10 + (uint64_t)(*p - '0');
+		}
+		p++;
+	}
+	*mantissa = m;
+	*digits += (size_t)(p - start);
+	return p;
+}
+
+// Correctly rounded conversion of the text the fast path cannot do exactly
+static double slow_convert(const char* text, size_t length) {
+	char buffer[128];
+	char* copy = length < sizeof(buffer) ? buffer : malloc(length + 1);
+	if (!copy) {
+		return NAN;
+	}
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+	double value = strtod(copy, NULL);
+	if (copy != buffer) {
+		free(copy);
+	}
+	return value;
+}
+
+// Parse a number at p; returns the position after it, or NULL if the text
+// there does not start with one. What follows is the caller's business.
+static inline const char* parse_number(const char* p, const char* end, double* value) {
+	const char* start = p;
+	int negative = 0;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	
+	uint64_t mantissa = 0;
+	size_t digits = 0;
+	int overflow = 0;
+	p = read_digits(p, end, &mantissa, &digits, &overflow);
+	long exponent = 0;
+	if (p < end && *p == '.') {
+		size_t fraction = 0;
+		p = read_digits(p + 1, end, &mantissa, &fraction, &overflow);
+		digits += fraction;
+		exponent = -(long)fraction;
+	}
+	if (digits == 0) {
+		return NULL;
+	}
+	
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		int exponent_negative = 0;
+		if (p < end && (*p == '-' || *p == '+')) {
+			exponent_negative = *p == '-';
+			p++;
+		}
+		if (p == end || !is_digit(*p)) {
+			return NULL;
+		}
+		long written = 0;
+		for (; p < end && is_digit(*p); p++) {
+			if (written < 100000) {
+				written = written * 10 + (*p - '0');
+			}
+		}
+		exponent += exponent_negative ? -written : written;
+	}
+	
+	if (mantissa == 0 && !overflow) {
+		*value = negative ? -0.0 : 0.0;
+	} else if (!overflow && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+		// Clinger's fast path: mantissa and power are exact, so the one
+		// multiply or divide rounds correctly
+		double m = (double)mantissa;
+		double result = exponent >= 0 ? m * powers_of_ten[exponent] : m / powers_of_ten[-exponent];
+		*value = negative ? -result : result;
+	} else {
+		*value = slow_convert(start, (size_t)(p - start));
+	}
+	return p;
+}
+
+int calc_stats_parse_number(const char* text, size_t length, double* value) {
+	return parse_number(text, text + length, value) == text + length;
+}
+
+const char* calc_stats_parse(const char* text, const char* end, double* values, size_t capacity,
+                             size_t* count, uint64_t* ignored) {
+	const char* p = text;
+	size_t n = 0;
+	while (n < capacity) {
+		while (p < end && separators[(unsigned char)*p]) {
+			p++;
+		}
+		if (p == end) {
+			break;
+		}
+		const char* after = parse_number(p, end, &values[n]);
+		if (after && (after == end || separators[(unsigned char)*after])) {
+			n++;
+			p = after;
+		} else {
+			(*ignored)++;
+			while (p < end && !separators[(unsigned char)*p]) {
+				p++;
+			}
+		}
+	}
+	*count = n;
+	return p;
+}
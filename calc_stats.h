@@ -0,0 +1,84 @@
+// Statistics - streaming, mergeable summaries of data sets
+//
+// A calc_stats takes values one at a time or in arrays and keeps the count, a
+// compensated (Neumaier) sum, the running mean and sum of squared deviations
+// (Welford, on the values minus the first one), min, max and a log-linear histogram for quantiles. Summaries of
+// separate parts of a data set merge into the summary of the whole (Chan et
+// al.), so threads can each reduce a share of the data and combine at the end.
+
+#ifndef CALC_STATS_H
+#define CALC_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Quantile histogram: 128 buckets per power of two for magnitudes from 2^-128
+// to 2^128, for each sign, plus one bucket for zero and smaller magnitudes
+#define CALC_STATS_SUB_BITS 7
+#define CALC_STATS_OCTAVES 256
+#define CALC_STATS_BUCKETS (2 * (CALC_STATS_OCTAVES << CALC_STATS_SUB_BITS) + 1)
+
+typedef struct calc_stats {
+	uint64_t count;
+	uint64_t ignored;       // NaNs and infinities, which are left out
+	double sum;
+	double sum_error;       // Neumaier compensation: the sum is sum + sum_error
+	double shift;           // The first value; mean is kept relative to it, so a
+	double mean;            // large common offset costs no precision
+	double m2;              // Sum of squared deviations from the mean
+	double min;             // +/-infinity while empty
+	double max;
+	uint64_t* buckets;      // CALC_STATS_BUCKETS counts
+} calc_stats;
+
+// ============================================================================
+// Summaries
+// ============================================================================
+
+// Empty summary; returns 0 if the histogram cannot be allocated
+int calc_stats_init(calc_stats* stats);
+void calc_stats_free(calc_stats* stats);
+void calc_stats_clear(calc_stats* stats);
+
+void calc_stats_add(calc_stats* stats, double value);
+
+// Same result as adding each value, up to rounding: the values go through in
+// blocks whose moments are computed in two passes and merged
+void calc_stats_add_array(calc_stats* stats, const double* values, size_t count);
+
+// Fold from into stats
+void calc_stats_merge(calc_stats* stats, const calc_stats* from);
+
+double calc_stats_sum(const calc_stats* stats);
+
+// The compensated sum over the count; 0 for an empty data set
+double calc_stats_mean(const calc_stats* stats);
+
+// Divides by count - 1 when sample is set, otherwise by count; 0 if there are
+// too few values
+double calc_stats_variance(const calc_stats* stats, int sample);
+double calc_stats_stddev(const calc_stats* stats, int sample);
+
+// Approximate q-quantile (0 <= q <= 1) by nearest rank, interpolated within
+// the histogram bucket holding that rank: within 1/128 of the true value for
+// magnitudes from 2^-128 to 2^128, and always between min and max. q = 0 and
+// 1 give min and max exactly; an empty data set gives 0.
+double calc_stats_quantile(const calc_stats* stats, double q);
+
+// ============================================================================
+// Number Parsing
+// ============================================================================
+
+// One decimal number ([-+]digits[.digits][(e|E)[-+]digits], with digits on at
+// least one side of the point), correctly rounded like strtod; returns 0 if
+// the text is anything else
+int calc_stats_parse_number(const char* text, size_t length, double* value);
+
+// Parse tokens separated by whitespace, ',' or ';' from [text, end) into
+// values, counting tokens that are not numbers in *ignored. Stops at end or
+// once capacity values are written, and returns where it stopped (always a
+// token boundary); *count is the number of values written.
+const char* calc_stats_parse(const char* text, const char* end, double* values, size_t capacity,
+                             size_t* count, uint64_t* ignored);
+
+#endif
@@ -0,0 +1,167 @@
+// Session Tape - append-only binary recording of engine events
+
+#include "calc_tape.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The format is defined by these layouts; fail the build if padding changes them
+typedef char calc_tape_header_is_16_bytes[sizeof(calc_tape_header) == 16 ? 1 : -1];
+typedef char calc_tape_record_is_16_bytes[sizeof(calc_tape_record) == 16 ? 1 : -1];
+
+static int header_valid(const calc_tape_header* header) {
+	return memcmp(header->magic, CALC_TAPE_MAGIC, 4) == 0
+		&& header->version == CALC_TAPE_VERSION
+		&& header->record_size == sizeof(calc_tape_record);
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+int calc_tape_open(calc_tape_writer* writer, const char* path) {
+	writer->file = fopen(path, "ab+");
+	if (!writer->file) {
+		perror(path);
+		return 0;
+	}
+	
+	fseek(writer->file, 0, SEEK_END);
+	long size = ftell(writer->file);
+	if (size < (long)sizeof(calc_tape_header)) {
+		// New (or unusably short) file: start it over with a header
+		calc_tape_header header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CALC_TAPE_MAGIC, 4);
+		header.version = CALC_TAPE_VERSION;
+		header.record_size = sizeof(calc_tape_record);
+		if (ftruncate(fileno(writer->file), 0) != 0 || fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+			perror(path);
+			calc_tape_close(writer);
+			return 0;
+		}
+	} else {
+		calc_tape_header header;
+		fseek(writer->file, 0, SEEK_SET);
+		if (fread(&header, sizeof(header), 1, writer->file) != 1 || !header_valid(&header)) {
+			fprintf(stderr, "%s: not a version %d calculator tape\n", path, CALC_TAPE_VERSION);
+			calc_tape_close(writer);
+			return 0;
+		}
+		// Drop a record torn by a crash so appended records stay aligned
+		long whole = size - (long)((size - (long)sizeof(header)) % (long)sizeof(calc_tape_record));
+		if (whole != size && ftruncate(fileno(writer->file), whole) != 0) {
+			perror(path);
+			calc_tape_close(writer);
+			return 0;
+		}
+	}
+	
+	calc_tape_write(writer, CALC_TAPE_SESSION, '\0', 0, 0.0);
+	return 1;
+}
+
+void calc_tape_close(calc_tape_writer* writer) {
+	if (writer->file) {
+		fclose(writer->file);
+		writer->file = NULL;
+	}
+}
+
+void calc_tape_write(calc_tape_writer* writer, calc_tape_event event, char key, int32_t argument, double display_value) {
+	calc_tape_record record = {0};
+	record.event = (uint8_t)event;
+	record.key = key;
+	record.argument = argument;
+	record.display_value = display_value;
+	fwrite(&record, sizeof(record), 1, writer->file);
+}
+
+// ============================================================================
+// Replay
+// ============================================================================
+
+int calc_tape_map(calc_tape_reader* reader, const char* path) {
+	memset(reader, 0, sizeof(*reader));
+	
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(path);
+		if (fd >= 0) close(fd);
+		return 0;
+	}
+	size_t size = (size_t)st.st_size;
+	if (size < sizeof(calc_tape_header)) {
+		fprintf(stderr, "%s: not a calculator tape\n", path);
+		close(fd);
+		return 0;
+	}
+	
+	void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		perror(path);
+		return 0;
+	}
+	if (!header_valid(mapping)) {
+		fprintf(stderr, "%s: not a version %d calculator tape\n", path, CALC_TAPE_VERSION);
+		munmap(mapping, size);
+		return 0;
+	}
+	
+	reader->mapping = mapping;
+	reader->mapping_size = size;
+	reader->records = (const calc_tape_record*)((const char*)mapping + sizeof(calc_tape_header));
+	reader->count = (size - sizeof(calc_tape_header)) / sizeof(calc_tape_record);
+	return 1;
+}
+
+void calc_tape_unmap(calc_tape_reader* reader) {
+	if (reader->mapping) {
+		munmap(reader->mapping, reader->mapping_size);
+	}
+	memset(reader, 0, sizeof(*reader));
+}
+
+size_t calc_tape_replay(const calc_tape_reader* reader, calc_engine* engine) {
+	size_t mismatches = 0;
+	for (size_t i = 0; i < reader->count; i++) {
+		const calc_tape_record* record = &reader->records[i];
+		switch (record->event) {
+			case CALC_TAPE_SESSION:
+				calc_engine_set_expression_mode(engine, 0);
+				calc_engine_set_precision(engine, 0);
+				calc_engine_set_integer_mode(engine, 0, 0);
+				calc_engine_set_radix(engine, 10);
+				calc_engine_set_rational_mode(engine, 0);
+				break;
+			case CALC_TAPE_PRECISION:
+				calc_engine_set_precision(engine, record->argument);
+				break;
+			case CALC_TAPE_INPUT_MODE:
+				calc_engine_set_expression_mode(engine, record->argument);
+				break;
+			case CALC_TAPE_INTEGER_MODE:
+				calc_engine_set_integer_mode(engine, abs(record->argument), record->argument < 0);
+				break;
+			case CALC_TAPE_RADIX:
+				calc_engine_set_radix(engine, record->argument);
+				break;
+			case CALC_TAPE_RATIONAL_MODE:
+				calc_engine_set_rational_mode(engine, record->argument);
+				break;
+			default:
+				calc_handle_key(engine, record->key);
+				break;
+		}
+		// Bitwise, so NaN results compare equal to themselves
+		if (memcmp(&engine->input.display_value, &record->display_value, sizeof(double)) != 0) {
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
@@ -0,0 +1,84 @@
+// Session Tape - append-only binary recording of engine events
+//
+// A tape is a 16-byte header followed by fixed-size 16-byte records, all
+// little-endian. Replay maps the file and walks the records in place, so
+// there is no parsing or copying. Each session starts with a SESSION record,
+// and every key and setting change is followed by the engine's display_value
+// so a replay can verify it reproduces the recorded session exactly.
+
+#ifndef CALC_TAPE_H
+#define CALC_TAPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "calc_engine.h"
+
+#define CALC_TAPE_MAGIC "CTAP"
+#define CALC_TAPE_VERSION 1
+
+typedef struct calc_tape_header {
+	char magic[4];          // CALC_TAPE_MAGIC
+	uint16_t version;       // CALC_TAPE_VERSION
+	uint16_t record_size;   // sizeof(calc_tape_record)
+	uint32_t reserved[2];
+} calc_tape_header;
+
+typedef enum calc_tape_event {
+	CALC_TAPE_SESSION = 1,     // Fresh engine
+	CALC_TAPE_DIGIT,           // key '0'-'9', or a digit of the radix in integer mode
+	CALC_TAPE_DECIMAL_POINT,   // key '.'
+	CALC_TAPE_OPERATOR,        // key '+', '-', '*', '/', '^', '(' or ')', or an integer-mode operator
+	CALC_TAPE_EQUALS,          // key '='
+	CALC_TAPE_PRECISION,       // calc_engine_set_precision; argument = digits
+	CALC_TAPE_INPUT_MODE,      // calc_engine_set_expression_mode; argument = 0 or 1
+	CALC_TAPE_FUNCTION,        // function key (calc_key_function), e.g. 'r' for sqrt, '~' 'P' 'L' 'Z', or 'D' 'M' 'V' 'K'
+	CALC_TAPE_INTEGER_MODE,    // calc_engine_set_integer_mode; argument = bits, negative when signed
+	CALC_TAPE_RADIX,           // calc_engine_set_radix; argument = radix
+	CALC_TAPE_RATIONAL_MODE,   // calc_engine_set_rational_mode; argument = 0, 1 (fractions) or 2 (decimals)
+} calc_tape_event;
+
+typedef struct calc_tape_record {
+	uint8_t event;          // calc_tape_event
+	char key;
+	uint8_t reserved[2];
+	int32_t argument;
+	double display_value;   // Engine display_value after the event
+} calc_tape_record;
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+typedef struct calc_tape_writer {
+	FILE* file;
+} calc_tape_writer;
+
+// Open path for appending (writing the header if the file is new or empty)
+// and start a new session; returns 0 if the file cannot be used
+int calc_tape_open(calc_tape_writer* writer, const char* path);
+void calc_tape_close(calc_tape_writer* writer);
+
+void calc_tape_write(calc_tape_writer* writer, calc_tape_event event, char key, int32_t argument, double display_value);
+
+// ============================================================================
+// Replay
+// ============================================================================
+
+typedef struct calc_tape_reader {
+	void* mapping;
+	size_t mapping_size;
+	const calc_tape_record* records;  // Points into the mapping
+	size_t count;                     // Whole records only; a torn tail is ignored
+} calc_tape_reader;
+
+// Map a tape read-only; returns 0 (with a message on stderr) if it is not one
+int calc_tape_map(calc_tape_reader* reader, const char* path);
+void calc_tape_unmap(calc_tape_reader* reader);
+
+// Feed every record through engine (reset at each SESSION record) and return
+// how many events left a display_value different from the recorded one
+size_t calc_tape_replay(const calc_tape_reader* reader, calc_engine* engine);
+
+#endif
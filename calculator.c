@@ -1,398 +1,856 @@
 // macOS Calculator in Pure C
-// Compile with: gcc -o calculator calculator.c -framework Foundation -framework AppKit -lm
+// Compile with: gcc -o calculator calculator.c objc_shim.c $ENGINE_SOURCES -framework Foundation
+//               -framework AppKit -lm, with ENGINE_SOURCES from build.sh
 
-#include <objc/runtime.h>
-#include <objc/message.h>
-#include <CoreGraphics/CoreGraphics.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
+#include "objc_shim.h"
+#include "calc_engine.h"
+#include "calc_tape.h"
+#include "calc_latency.h"
+#include "calc_graph.h"
+#include "calc_history.h"
+
 // ============================================================================
-// Type Definitions & Macros
+// Calculator State
 // ============================================================================
 
-#ifdef __arm64__
-#define abi_objc_msgSend_stret objc_msgSend
-#define abi_objc_msgSend_fpret objc_msgSend
-#else
-#define abi_objc_msgSend_stret objc_msgSend_stret
-#define abi_objc_msgSend_fpret objc_msgSend_fpret
-#endif
-
-typedef CGRect NSRect;
-typedef CGPoint NSPoint;
-typedef CGSize NSSize;
-
-typedef void NSApplication;
-typedef void NSWindow;
-typedef void NSView;
-typedef void NSButton;
-typedef void NSTextField;
-typedef void NSEvent;
-typedef void NSString;
-
-#ifndef NSUInteger
-typedef unsigned long NSUInteger;
-typedef long NSInteger;
-#endif
-
-#define NS_ENUM(type, name) type name; enum
-
-typedef NS_ENUM(NSUInteger, NSWindowStyleMask) {
-	NSWindowStyleMaskBorderless = 0,
-	NSWindowStyleMaskTitled = 1 << 0,
-	NSWindowStyleMaskClosable = 1 << 1,
-	NSWindowStyleMaskMiniaturizable = 1 << 2,
-	NSWindowStyleMaskResizable = 1 << 3,
-};
+// Engine state lives in calc_engine.c; the app only owns the display field
+calc_engine g_engine;
+NSTextField* g_display = NULL;
 
-typedef NS_ENUM(NSUInteger, NSBackingStoreType) {
-	NSBackingStoreBuffered = 2
-};
+// Target of every calculator button, and of the deferred display flush
+id g_button_delegate = NULL;
 
-typedef NS_ENUM(NSUInteger, NSTextAlignment) {
-	NSTextAlignmentRight = 2,
-};
+// Session tape, recording when CALC_TAPE names a file
+calc_tape_writer g_tape = {NULL};
+
+void close_tape(void) {
+	calc_tape_close(&g_tape);
+}
 
-// objc_msgSend macros
-#define objc_msgSend_id				((id (*)(id, SEL))objc_msgSend)
-#define objc_msgSend_id_id			((id (*)(id, SEL, id))objc_msgSend)
-#define objc_msgSend_id_rect		((id (*)(id, SEL, NSRect))objc_msgSend)
-#define objc_msgSend_uint			((NSUInteger (*)(id, SEL))objc_msgSend)
-#define objc_msgSend_int			((NSInteger (*)(id, SEL))objc_msgSend)
-#define objc_msgSend_SEL			((SEL (*)(id, SEL))objc_msgSend)
-#define objc_msgSend_float			((CGFloat (*)(id, SEL))abi_objc_msgSend_fpret)
-#define objc_msgSend_bool			((BOOL (*)(id, SEL))objc_msgSend)
-#define objc_msgSend_void			((void (*)(id, SEL))objc_msgSend)
-#define objc_msgSend_void_id		((void (*)(id, SEL, id))objc_msgSend)
-#define objc_msgSend_void_uint		((void (*)(id, SEL, NSUInteger))objc_msgSend)
-#define objc_msgSend_void_int		((void (*)(id, SEL, NSInteger))objc_msgSend)
-#define objc_msgSend_void_bool		((void (*)(id, SEL, BOOL))objc_msgSend)
-#define objc_msgSend_void_float		((void (*)(id, SEL, CGFloat))objc_msgSend)
-#define objc_msgSend_void_double	((void (*)(id, SEL, double))objc_msgSend)
-#define objc_msgSend_id_char_const	((id (*)(id, SEL, const char *))objc_msgSend)
-#define objc_msgSend_void_id_id		((void (*)(id, SEL, id, id))objc_msgSend)
-
-#define NSAlloc(nsclass) objc_msgSend_id((id)nsclass, sel_registerName("alloc"))
-#define NSRelease(obj) objc_msgSend_id((id)obj, sel_registerName("release"))
+// Paper tape table (Tape View), brought up to date after every key
+void show_tape(void);
 
 // ============================================================================
-// String Utilities
+// Display Rendering
 // ============================================================================
 
-id cstring_to_nsstring(const char* cstr) {
-	return ((id(*)(id, SEL, const char*))objc_msgSend)
-		((id)objc_getClass("NSString"), 
-		 sel_registerName("stringWithUTF8String:"), 
-		 cstr);
+// The engine's updates only land in the pending buffer. One flush per
+// run-loop cycle pushes the latest text to the field, and only when it differs
+// from what the field already shows, so a burst of keys costs one NSString.
+char* g_pending_text = NULL;
+size_t g_pending_size = 0;
+char* g_shown_text = NULL;
+size_t g_shown_size = 0;
+int g_flush_scheduled = 0;
+
+// Copy text into a reusable buffer, growing it when needed
+void copy_text(char** buffer, size_t* size, const char* text) {
+	size_t length = strlen(text);
+	if (length >= *size) {
+		*size = length + 1;
+		*buffer = realloc(*buffer, *size);
+	}
+	memcpy(*buffer, text, length + 1);
+}
+
+// Display output callback for the engine
+void update_display(void* ctx, const char* text) {
+	(void)ctx;
+	copy_text(&g_pending_text, &g_pending_size, text);
+	if (!g_flush_scheduled && strcmp(g_pending_text, g_shown_text) != 0) {
+		// A zero delay runs flush_display on the next pass of the run loop
+		g_flush_scheduled = 1;
+		objc_msgSend_void_SEL_id_double(g_button_delegate, objc_sel.performSelectorAfterDelay,
+			objc_sel.flushDisplay, NULL, 0.0);
+	}
 }
 
-// Convert NSString to C string
-const char* nsstring_to_cstring(id nsstr) {
-	return ((const char*(*)(id, SEL))objc_msgSend)
-		(nsstr, sel_registerName("UTF8String"));
+void flush_display(void* self, SEL sel, id arg) {
+	g_flush_scheduled = 0;
+	if (strcmp(g_pending_text, g_shown_text) == 0) {
+		return;
+	}
+	void* pool = objc_autoreleasePoolPush();
+	objc_msgSend_void_id(g_display, objc_sel.setStringValue, cstring_to_nsstring(g_pending_text));
+	objc_autoreleasePoolPop(pool);
+	copy_text(&g_shown_text, &g_shown_size, g_pending_text);
 }
 
-// Get the app's process name (executable name)
-const char* get_process_name(void) {
-	id process_info = objc_msgSend_id((id)objc_getClass("NSProcessInfo"), sel_registerName("processInfo"));
-	id app_name = objc_msgSend_id(process_info, sel_registerName("processName"));
-	return nsstring_to_cstring(app_name);
+// Queued when the window is ordered front; the first pass of the run loop
+// after that has drawn the window and is ready for input
+void first_frame_shown(void* self, SEL sel, id arg) {
+	calc_startup_mark(CALC_STARTUP_FIRST_FRAME);
 }
 
 // ============================================================================
-// Calculator State
+// Button Callbacks
 // ============================================================================
 
-struct {
-	double display_value;
-	double accumulator;
-	char last_operator;
-	BOOL new_number;
-	BOOL has_decimal;  // Track if current number has a decimal point
-	NSTextField* display;
-} calc_state = {0.0, 0.0, '\0', 1, 0, NULL};
-
-// Update display with current value
-void update_display(double value) {
-	char buffer[32];
-	// Remove trailing zeros and decimal point if needed
-	snprintf(buffer, sizeof(buffer), "%.10g", value);
-	id ns_str = cstring_to_nsstring(buffer);
-	objc_msgSend_void_id(calc_state.display, sel_registerName("setStringValue:"), ns_str);
-}
-
-// Perform arithmetic operation
-double perform_operation(double lhs, char op, double rhs) {
-	switch (op) {
-		case '+': return lhs + rhs;
-		case '-': return lhs - rhs;
-		case '*': return lhs * rhs;
-		case '/': return rhs != 0 ? lhs / rhs : 0;
-		default: return rhs;
-	}
-}
-
-// Handle number button press
-void handle_number(const char* digit_str) {
-	// Handle decimal point
-	if (digit_str[0] == '.') {
-		// Only add one decimal point per number
-		if (calc_state.has_decimal) {
-			return;  // Already has a decimal, ignore
-		}
-		calc_state.has_decimal = 1;
-		calc_state.new_number = 0;  // Don't start a new number
-		update_display(calc_state.display_value);
-		return;
-	}
-	
-	// Handle digit button
-	double digit = atof(digit_str);
+// Button grid, four per row, then the scientific panel, three per row, the
+// programmer panel, four per row, and the matrix panel, three per row; each
+// button's tag is its index here, so a click needs no title lookup
+typedef struct {
+	const char* label;   // NULL = empty cell
+	char key;
+} calc_button;
+
+#define GRID_BUTTON_COUNT 24
+#define SCIENTIFIC_BUTTON_COUNT 15
+#define PROGRAMMER_BUTTON_COUNT 16
+#define MATRIX_BUTTON_COUNT 5
+#define BUTTON_COUNT (GRID_BUTTON_COUNT + SCIENTIFIC_BUTTON_COUNT + PROGRAMMER_BUTTON_COUNT + MATRIX_BUTTON_COUNT)
+
+const calc_button calc_buttons[BUTTON_COUNT] = {
+	{"7", '7'}, {"8", '8'}, {"9", '9'}, {"/", '/'},
+	{"4", '4'}, {"5", '5'}, {"6", '6'}, {"*", '*'},
+	{"1", '1'}, {"2", '2'}, {"3", '3'}, {"-", '-'},
+	{"0", '0'}, {".", '.'}, {"=", '='}, {"+", '+'},
+	{"\u03A3+", 'D'}, {"x\u0304", 'M'}, {"\u03C3", 'V'}, {"C\u03A3", 'K'},   // Statistics
+	{"(", '('}, {")", ')'}, {"%", '%'}, {"^", '^'},
+	
+	// Scientific panel (keys from calc_function_key)
+	{"\u221A", 'r'}, {"e\u02E3", 'e'}, {"\u0393", 'G'},
+	{"ln", 'n'}, {"log", 'g'}, {"x!", '!'},
+	{"sin", 's'}, {"cos", 'c'}, {"tan", 't'},
+	{"asin", 'S'}, {"acos", 'C'}, {"atan", 'T'},
+	{"sinh", 'h'}, {"cosh", 'j'}, {"tanh", 'k'},
+	
+	// Programmer panel (integer-mode keys; '^' on the grid is xor, '%' remainder)
+	{"A", 'A'}, {"B", 'B'}, {"C", 'C'}, {"D", 'D'},
+	{"E", 'E'}, {"F", 'F'}, {"AND", '&'}, {"OR", '|'},
+	{"NOT", '~'}, {"<<", '<'}, {">>", '>'}, {"RoL", '['},
+	{"RoR", ']'}, {"pop", 'P'}, {"clz", 'L'}, {"ctz", 'Z'},
+	
+	// Matrix panel (product, solve, transpose, determinant, inverse)
+	{"A\u00B7B", '@'}, {"A\\B", '\\'}, {"A\u1D40", '\''},
+	{"det", 'd'}, {"inv", 'i'}
+};
+
+// Each event drains its own autorelease pool
+void button_clicked(void* self, SEL sel, id sender) {
+	calc_latency_begin();
+	void* pool = objc_autoreleasePoolPush();
 	
-	if (calc_state.new_number) {
-		// Starting a new number
-		calc_state.display_value = digit;
-		calc_state.new_number = 0;
-		calc_state.has_decimal = 0;
+	NSInteger tag = objc_msgSend_int(sender, objc_sel.tag);
+	if (tag >= 0 && tag < BUTTON_COUNT && calc_buttons[tag].label) {
+		calc_handle_key(&g_engine, calc_buttons[tag].key);
+		show_tape();
 	} else {
-		// Appending to current number
-		if (calc_state.has_decimal) {
-			// We have a decimal - need to append fractional digits
-			// Count decimal places from the string representation
-			char buffer[32];
-			snprintf(buffer, sizeof(buffer), "%.10g", calc_state.display_value);
-			const char* decimal_pos = strchr(buffer, '.');
-			int decimal_places = decimal_pos ? strlen(decimal_pos + 1) : 0;
-			
-			// Calculate the multiplier (10^(decimal_places + 1))
-			double multiplier = 1.0;
-			for (int i = 0; i < decimal_places + 1; i++) {
-				multiplier *= 10.0;
+		printf("Unknown button tag: %ld\n", (long)tag);
+	}
+	
+	objc_autoreleasePoolPop(pool);
+	calc_latency_end();
+}
+
+// ============================================================================
+// Keyboard Input
+// ============================================================================
+
+// Virtual key codes (ANSI layout) for the calculator keys. Main keyboard keys
+// depend on shift; keypad keys do not.
+typedef struct {
+	unsigned short key_code;
+	unsigned char shift;   // 0 = unshifted, 1 = shifted, 2 = either
+	char key;
+} key_binding;
+
+static const key_binding key_bindings[] = {
+	{0x1D, 0, '0'}, {0x12, 0, '1'}, {0x13, 0, '2'}, {0x14, 0, '3'}, {0x15, 0, '4'},
+	{0x17, 0, '5'}, {0x16, 0, '6'}, {0x1A, 0, '7'}, {0x1C, 0, '8'}, {0x19, 0, '9'},
+	{0x2F, 0, '.'}, {0x1B, 0, '-'}, {0x2C, 0, '/'}, {0x18, 0, '='}, {0x18, 1, '+'},
+	{0x1C, 1, '*'}, {0x19, 1, '('}, {0x1D, 1, ')'}, {0x17, 1, '%'}, {0x16, 1, '^'},
+	{0x12, 1, '!'},
+	{0x0F, 0, 'r'}, {0x0E, 0, 'e'}, {0x2D, 0, 'n'}, {0x05, 0, 'g'}, {0x05, 1, 'G'},
+	{0x01, 0, 's'}, {0x08, 0, 'c'}, {0x11, 0, 't'},
+	{0x01, 1, 'S'}, {0x08, 1, 'C'}, {0x11, 1, 'T'},
+	{0x04, 0, 'h'}, {0x26, 0, 'j'}, {0x28, 0, 'k'},
+	{0x00, 1, 'A'}, {0x0B, 1, 'B'}, {0x02, 1, 'D'}, {0x0E, 1, 'E'}, {0x03, 1, 'F'},
+	{0x1A, 1, '&'}, {0x2A, 1, '|'}, {0x32, 1, '~'}, {0x2B, 1, '<'}, {0x2F, 1, '>'},
+	{0x21, 0, '['}, {0x1E, 0, ']'}, {0x23, 1, 'P'}, {0x25, 1, 'L'}, {0x06, 1, 'Z'},
+	{0x2E, 1, 'M'}, {0x09, 1, 'V'}, {0x28, 1, 'K'},   // Statistics; shift-D is both
+	{0x13, 1, '@'}, {0x2A, 0, '\\'}, {0x27, 0, '\''}, {0x02, 0, 'd'}, {0x22, 0, 'i'},
+	{0x24, 2, '='},   // Return
+	{0x52, 2, '0'}, {0x53, 2, '1'}, {0x54, 2, '2'}, {0x55, 2, '3'}, {0x56, 2, '4'},
+	{0x57, 2, '5'}, {0x58, 2, '6'}, {0x59, 2, '7'}, {0x5B, 2, '8'}, {0x5C, 2, '9'},
+	{0x41, 2, '.'}, {0x45, 2, '+'}, {0x4E, 2, '-'}, {0x43, 2, '*'}, {0x4B, 2, '/'},
+	{0x51, 2, '='}, {0x4C, 2, '='},   // Keypad = and Enter
+};
+
+// [shift][key code] -> button tag, -1 = not a calculator key
+signed char g_key_tags[2][128];
+
+// Point every bound key code at the tag of the button with the same key
+void build_key_tags(void) {
+	memset(g_key_tags, -1, sizeof(g_key_tags));
+	for (size_t b = 0; b < sizeof(key_bindings) / sizeof(key_bindings[0]); b++) {
+		for (int tag = 0; tag < BUTTON_COUNT; tag++) {
+			if (calc_buttons[tag].label && calc_buttons[tag].key == key_bindings[b].key) {
+				if (key_bindings[b].shift != 1) {
+					g_key_tags[0][key_bindings[b].key_code] = (signed char)tag;
+				}
+				if (key_bindings[b].shift != 0) {
+					g_key_tags[1][key_bindings[b].key_code] = (signed char)tag;
+				}
 			}
-			
-			// Add the new digit in the appropriate decimal position
-			calc_state.display_value += digit / multiplier;
-		} else {
-			// No decimal yet - append digit normally
-			calc_state.display_value = calc_state.display_value * 10 + digit;
+		}
+	}
+}
+
+// keyDown: reaches the window when no control takes the key. Keys that are
+// not calculator keys are dropped rather than passed on to NSWindow.
+void window_key_down(void* self, SEL sel, id event) {
+	calc_latency_begin();
+	void* pool = objc_autoreleasePoolPush();
+	
+	NSUInteger flags = objc_msgSend_uint(event, objc_sel.modifierFlags);
+	unsigned short key_code = objc_msgSend_ushort(event, objc_sel.keyCode);
+	NSUInteger chords = NSEventModifierFlagCommand | NSEventModifierFlagControl | NSEventModifierFlagOption;
+	if (!(flags & chords) && key_code < 128) {
+		int tag = g_key_tags[(flags & NSEventModifierFlagShift) != 0][key_code];
+		if (tag >= 0) {
+			calc_handle_key(&g_engine, calc_buttons[tag].key);
+			show_tape();
 		}
 	}
 	
-	update_display(calc_state.display_value);
+	objc_autoreleasePoolPop(pool);
+	calc_latency_end();
+}
+
+// Precision menu items carry their digit count in the tag (0 = double)
+void precision_selected(void* self, SEL sel, id sender) {
+	calc_engine_set_precision(&g_engine, objc_msgSend_int(sender, objc_sel.tag));
+}
+
+// Input menu items: tag 0 = immediate, 1 = expression with precedence
+void input_mode_selected(void* self, SEL sel, id sender) {
+	calc_engine_set_expression_mode(&g_engine, (int)objc_msgSend_int(sender, objc_sel.tag));
 }
 
-// Handle operator button press
-void handle_operator(char op) {
-	// If we have a pending operator, execute it first
-	if (calc_state.last_operator != '\0' && !calc_state.new_number) {
-		calc_state.accumulator = perform_operation(
-			calc_state.accumulator, 
-			calc_state.last_operator, 
-			calc_state.display_value
-		);
-		update_display(calc_state.accumulator);
+// Word menu items carry the word size in bits, negative for signed words
+void word_size_selected(void* self, SEL sel, id sender) {
+	NSInteger tag = objc_msgSend_int(sender, objc_sel.tag);
+	calc_engine_set_integer_mode(&g_engine, (int)(tag < 0 ? -tag : tag), tag < 0);
+}
+
+// Radix menu items carry the radix
+void radix_selected(void* self, SEL sel, id sender) {
+	calc_engine_set_radix(&g_engine, (int)objc_msgSend_int(sender, objc_sel.tag));
+}
+
+// Rational menu items: tag 0 = off, 1 = fractions, 2 = decimals
+void rational_mode_selected(void* self, SEL sel, id sender) {
+	calc_engine_set_rational_mode(&g_engine, (int)objc_msgSend_int(sender, objc_sel.tag));
+}
+
+// ============================================================================
+// Delegate Class Setup
+// ============================================================================
+
+// Global window for access by delegates
+NSWindow* g_window = NULL;
+
+// Classes registered in main()
+Class g_button_delegate_class = NULL;
+Class g_window_delegate_class = NULL;
+Class g_window_class = NULL;
+
+// Window sizes for the View menu; the panels sit right of the grid
+#define BASIC_WIDTH 320
+#define SCIENTIFIC_WIDTH 545
+#define PROGRAMMER_WIDTH 620
+#define GRAPH_WIDTH 745
+#define TAPE_WIDTH 640
+#define MATRIX_WIDTH 545
+#define WINDOW_HEIGHT 570
+
+// ============================================================================
+// Graph View
+// ============================================================================
+
+// The plot is GRAPH_PIXELS square. Pans move a quarter of the view and zooms
+// halve or double it, so most samples come from the graph's cache.
+#define GRAPH_PIXELS 420
+
+calc_graph g_graph;
+calc_graph_view g_graph_view = {-10, 10, -1, 1};
+id g_graph_image = NULL;   // NSImageView
+
+// Render and hand the pixels to the image view as a new NSImage
+void show_graph(void) {
+	void* pool = objc_autoreleasePoolPush();
+	calc_graph_render(&g_graph, &g_graph_view);
+	
+	id rep = ((id (*)(id, SEL, unsigned char**, NSInteger, NSInteger, NSInteger, NSInteger, BOOL, BOOL, id, NSInteger, NSInteger))objc_msgSend)
+		(NSAlloc(objc_cls.NSBitmapImageRep), objc_sel.initWithBitmapDataPlanes, NULL, g_graph.width, g_graph.height,
+		 8, 4, 1, 0, cstring_to_nsstring("NSDeviceRGBColorSpace"), (NSInteger)g_graph.width * 4, 32);
+	unsigned char* data = objc_msgSend_ptr(rep, objc_sel.bitmapData);
+	if (data) {
+		memcpy(data, g_graph.pixels, (size_t)g_graph.width * g_graph.height * 4);
+	}
+	NSSize size = {g_graph.width, g_graph.height};
+	id image = objc_msgSend_id_size(NSAlloc(objc_cls.NSImage), objc_sel.initWithSize, size);
+	objc_msgSend_void_id(image, objc_sel.addRepresentation, rep);
+	objc_msgSend_void_id(g_graph_image, objc_sel.setImage, image);
+	NSRelease(rep);
+	NSRelease(image);
+	objc_autoreleasePoolPop(pool);
+}
+
+// Graph buttons: tag 0/1 pan left/right, 2/3 zoom in/out about the centre,
+// 4 fits the y range to the curve
+void graph_button_clicked(void* self, SEL sel, id sender) {
+	NSInteger tag = objc_msgSend_int(sender, objc_sel.tag);
+	double width = g_graph_view.x_max - g_graph_view.x_min;
+	double height = g_graph_view.y_max - g_graph_view.y_min;
+	double factor = tag == 2 ? -0.25 : 0.5;
+	
+	if (tag == 0 || tag == 1) {
+		double shift = tag == 0 ? -width / 4 : width / 4;
+		g_graph_view.x_min += shift;
+		g_graph_view.x_max += shift;
+	} else if (tag == 2 || tag == 3) {
+		g_graph_view.x_min -= width * factor;
+		g_graph_view.x_max += width * factor;
+		g_graph_view.y_min -= height * factor;
+		g_graph_view.y_max += height * factor;
 	} else {
-		calc_state.accumulator = calc_state.display_value;
+		calc_graph_fit_y(&g_graph, &g_graph_view);
 	}
-	
-	calc_state.last_operator = op;
-	calc_state.new_number = 1;
-	calc_state.has_decimal = 0;  // Reset decimal flag for next number
+	show_graph();
+}
+
+// Return in the f(x) field plots the new function, fitted vertically. A
+// syntax error is shown in the window title and the old plot stays.
+void graph_function_entered(void* self, SEL sel, id sender) {
+	const char* text = nsstring_to_cstring(objc_msgSend_id(sender, objc_sel.stringValue));
+	if (!text || !calc_graph_set_function(&g_graph, text)) {
+		char title[128];
+		snprintf(title, sizeof(title), "Calculator \u2014 %s at %zu",
+			text ? g_graph.error : "no function", g_graph.error_position + 1);
+		objc_msgSend_void_id(g_window, objc_sel.setTitle, cstring_to_nsstring(title));
+		return;
+	}
+	objc_msgSend_void_id(g_window, objc_sel.setTitle, cstring_to_nsstring("Calculator"));
+	calc_graph_fit_y(&g_graph, &g_graph_view);
+	show_graph();
 }
 
-// Handle equals button press
-void handle_equals(void) {
-	if (calc_state.last_operator != '\0') {
-		calc_state.display_value = perform_operation(
-			calc_state.accumulator,
-			calc_state.last_operator,
-			calc_state.display_value
-		);
-		update_display(calc_state.display_value);
-		calc_state.accumulator = 0;
-		calc_state.last_operator = '\0';
-		calc_state.new_number = 1;
-		calc_state.has_decimal = 0;  // Reset decimal flag after equals
+// Plot, f(x) field and pan/zoom buttons, top to bottom
+void add_graph_controls(NSView* panel, id target) {
+	calc_graph_init(&g_graph, GRAPH_PIXELS, GRAPH_PIXELS);
+	calc_graph_set_function(&g_graph, "sin(x)");
+	calc_graph_fit_y(&g_graph, &g_graph_view);
+	
+	NSRect image_frame = {{0, 110}, {GRAPH_PIXELS, GRAPH_PIXELS}};
+	g_graph_image = objc_msgSend_id_rect(NSAlloc(objc_cls.NSImageView), objc_sel.initWithFrame, image_frame);
+	objc_msgSend_void_id(panel, objc_sel.addSubview, g_graph_image);
+	
+	NSRect field_frame = {{0, 75}, {GRAPH_PIXELS, 26}};
+	NSTextField* field = objc_msgSend_id_rect(NSAlloc(objc_cls.NSTextField), objc_sel.initWithFrame, field_frame);
+	objc_msgSend_void_id(field, objc_sel.setStringValue, cstring_to_nsstring("sin(x)"));
+	objc_msgSend_void_bool(field, objc_sel.setEditable, 1);
+	objc_msgSend_void_id(field, objc_sel.setTarget, target);
+	objc_msgSend_void_SEL(field, objc_sel.setAction, objc_sel.graphFunctionEntered);
+	objc_msgSend_void_id(panel, objc_sel.addSubview, field);
+	
+	static const char* labels[] = {"\u2190", "\u2192", "+", "\u2212", "Fit"};
+	for (int i = 0; i < 5; i++) {
+		NSRect frame = {{i * 85, 0}, {80, 45}};
+		NSButton* button = objc_msgSend_id_rect(NSAlloc(objc_cls.NSButton), objc_sel.initWithFrame, frame);
+		objc_msgSend_void_id(button, objc_sel.setTitle, cstring_to_nsstring(labels[i]));
+		objc_msgSend_void_int(button, objc_sel.setTag, i);
+		objc_msgSend_void_id(button, objc_sel.setTarget, target);
+		objc_msgSend_void_SEL(button, objc_sel.setAction, objc_sel.graphButtonClicked);
+		objc_msgSend_void_id(panel, objc_sel.addSubview, button);
 	}
 }
 
 // ============================================================================
-// Button Callbacks
+// Tape View
 // ============================================================================
 
-#include <stdlib.h>
+// The paper tape keeps the last TAPE_ENTRIES operations, one table row each.
+// Editing an Op or Operand cell recomputes the rows that depend on it; the
+// calculator itself carries on from the number it shows.
+#define TAPE_ENTRIES 65536
 
-void button_clicked(void* self, SEL sel, id sender) {
-	// Get button title
-	id title_obj = ((id(*)(id, SEL))objc_msgSend)(sender, sel_registerName("title"));
-	const char* title = ((const char*(*)(id, SEL))objc_msgSend)(title_obj, sel_registerName("UTF8String"));
-	
-	// Dispatch based on button type
-	if ((title[0] >= '0' && title[0] <= '9') || title[0] == '.') {
-		// Number button or decimal point
-		handle_number(title);
-	} else if (title[0] == '=') {
-		// Equals
-		handle_equals();
-	} else if (title[0] == '+' || title[0] == '-' || title[0] == '*' || title[0] == '/') {
-		// Operator
-		handle_operator(title[0]);
+calc_history g_history;
+id g_tape_table = NULL;        // NSTableView
+id g_tape_columns[3];          // NSTableColumns: op, operand, result
+int g_tape_visible = 0;
+uint64_t g_tape_shown = 0;     // g_history.appended when the table last reloaded
+
+// Reload the table after keys added entries, scrolled to the newest
+void show_tape(void) {
+	if (!g_tape_visible || g_tape_shown == g_history.appended) {
+		return;
+	}
+	g_tape_shown = g_history.appended;
+	objc_msgSend_void(g_tape_table, objc_sel.reloadData);
+	if (g_history.count > 0) {
+		objc_msgSend_void_int(g_tape_table, objc_sel.scrollRowToVisible, (NSInteger)g_history.count - 1);
+	}
+}
+
+// NSTableViewDataSource
+NSInteger tape_row_count(void* self, SEL sel, id table) {
+	return (NSInteger)g_history.count;
+}
+
+// Chain starts show no operator and totals end in '='
+id tape_cell_value(void* self, SEL sel, id table, id column, NSInteger row) {
+	if (row < 0 || (size_t)row >= g_history.count) {
+		return NULL;
+	}
+	const calc_history_entry* entry = calc_history_at(&g_history, (size_t)row);
+	char text[CALC_FORMAT_BUFFER_SIZE + 2];
+	if (column == g_tape_columns[0]) {
+		snprintf(text, sizeof(text), "%c%s", entry->op != '\0' ? entry->op : ' ',
+			entry->flags & CALC_HISTORY_TOTAL ? " =" : "");
 	} else {
-		printf("Unknown button: %s\n", title);
+		calc_format_double(text, column == g_tape_columns[1] ? entry->operand : entry->result, g_engine.format);
 	}
+	return cstring_to_nsstring(text);
+}
+
+// An Op cell takes '+', '-', '*', '/' or '^', or nothing to start a new chain
+// there; an Operand cell takes a number. Anything else leaves the row as it was.
+void tape_cell_edited(void* self, SEL sel, id table, id value, id column, NSInteger row) {
+	const char* text = nsstring_to_cstring(value);
+	if (!text || row < 0) {
+		return;
+	}
+	while (*text == ' ') {
+		text++;
+	}
+	if (column == g_tape_columns[0]) {
+		if (*text == '\0' || strchr("+-*/^", *text)) {
+			calc_history_set_operator(&g_history, (size_t)row, *text);
+		}
+	} else if (column == g_tape_columns[1]) {
+		char* end;
+		double operand = strtod(text, &end);
+		if (end != text) {
+			calc_history_set_operand(&g_history, (size_t)row, operand);
+		}
+	}
+	objc_msgSend_void(table, objc_sel.reloadData);
+}
+
+// Scrolling table of the tape filling the panel
+void add_tape_controls(NSView* panel, id data_source) {
+	NSRect frame = {{0, 0}, {TAPE_WIDTH - BASIC_WIDTH, WINDOW_HEIGHT - 40}};
+	id scroll = objc_msgSend_id_rect(NSAlloc(objc_cls.NSScrollView), objc_sel.initWithFrame, frame);
+	g_tape_table = objc_msgSend_id_rect(NSAlloc(objc_cls.NSTableView), objc_sel.initWithFrame, frame);
+	
+	static const char* titles[] = {"Op", "Operand", "Result"};
+	static const CGFloat widths[] = {40, 125, 125};
+	for (int i = 0; i < 3; i++) {
+		id column = objc_msgSend_id_id(NSAlloc(objc_cls.NSTableColumn), objc_sel.initWithIdentifier,
+			cstring_to_nsstring(titles[i]));
+		objc_msgSend_void_id(column, objc_sel.setTitle, cstring_to_nsstring(titles[i]));
+		objc_msgSend_void_float(column, objc_sel.setWidth, widths[i]);
+		objc_msgSend_void_bool(column, objc_sel.setEditable, i < 2);
+		objc_msgSend_void_id(g_tape_table, objc_sel.addTableColumn, column);
+		g_tape_columns[i] = column;
+	}
+	objc_msgSend_void_id(g_tape_table, objc_sel.setDataSource, data_source);
+	
+	objc_msgSend_void_id(scroll, objc_sel.setDocumentView, g_tape_table);
+	objc_msgSend_void_bool(scroll, objc_sel.setHasVerticalScroller, 1);
+	objc_msgSend_void_id(panel, objc_sel.addSubview, scroll);
 }
 
 // ============================================================================
-// Delegate Class Setup
+// Matrix View
 // ============================================================================
 
-// Global window for access by delegates
-NSWindow* g_window = NULL;
+#define MATRIX_FIELD_Y 160
+
+// Return in the matrix field makes the typed matrix, e.g. "[1 2; 3 4]", the
+// operand. Text that is not a matrix, or a mode without matrices, is reported
+// in the window title and the operand stays.
+void matrix_entered(void* self, SEL sel, id sender) {
+	const char* text = nsstring_to_cstring(objc_msgSend_id(sender, objc_sel.stringValue));
+	calc_matrix m;
+	calc_matrix_init(&m);
+	const char* error = NULL;
+	if (!text || !calc_matrix_parse(&m, text, strlen(text)) || m.rows == 0) {
+		error = "Calculator \u2014 not a matrix";
+	} else if (!calc_engine_set_matrix(&g_engine, &m)) {
+		error = "Calculator \u2014 matrices need immediate double arithmetic";
+	}
+	calc_matrix_free(&m);
+	objc_msgSend_void_id(g_window, objc_sel.setTitle, cstring_to_nsstring(error ? error : "Calculator"));
+	show_tape();
+}
+
+// Matrix field above the panel's buttons
+void add_matrix_controls(NSView* panel, id target) {
+	NSRect field_frame = {{0, MATRIX_FIELD_Y}, {MATRIX_WIDTH - BASIC_WIDTH - 5, 26}};
+	NSTextField* field = objc_msgSend_id_rect(NSAlloc(objc_cls.NSTextField), objc_sel.initWithFrame, field_frame);
+	objc_msgSend_void_id(field, objc_sel.setStringValue, cstring_to_nsstring("[1 2; 3 4]"));
+	objc_msgSend_void_bool(field, objc_sel.setEditable, 1);
+	objc_msgSend_void_id(field, objc_sel.setTarget, target);
+	objc_msgSend_void_SEL(field, objc_sel.setAction, objc_sel.matrixEntered);
+	objc_msgSend_void_id(panel, objc_sel.addSubview, field);
+}
+
+// ============================================================================
+// Window Setup
+// ============================================================================
+
+// Each View menu item widens the window to show one panel right of the grid.
+// A panel holds a run of calc_buttons and any other controls, and is built
+// the first time its view is chosen, so launch builds only the display and
+// the grid.
+typedef struct {
+	CGFloat width;          // Window content width
+	CGFloat panel_width;    // 0 = no panel
+	CGFloat panel_height;
+	int first_button;       // calc_buttons on the panel
+	int button_count;
+	int columns;
+	void (*add_controls)(NSView* panel, id target);
+} view_layout;
+
+#define VIEW_COUNT 6
+
+static const view_layout view_layouts[VIEW_COUNT] = {
+	{BASIC_WIDTH, 0, 0, 0, 0, 0, NULL},
+	{SCIENTIFIC_WIDTH, SCIENTIFIC_WIDTH - BASIC_WIDTH, 370,
+		GRID_BUTTON_COUNT, SCIENTIFIC_BUTTON_COUNT, 3, NULL},
+	{PROGRAMMER_WIDTH, PROGRAMMER_WIDTH - BASIC_WIDTH, 295,
+		GRID_BUTTON_COUNT + SCIENTIFIC_BUTTON_COUNT, PROGRAMMER_BUTTON_COUNT, 4, NULL},
+	{GRAPH_WIDTH, GRAPH_PIXELS, WINDOW_HEIGHT - 40, 0, 0, 0, add_graph_controls},
+	{TAPE_WIDTH, TAPE_WIDTH - BASIC_WIDTH, WINDOW_HEIGHT - 40, 0, 0, 0, add_tape_controls},
+	{MATRIX_WIDTH, MATRIX_WIDTH - BASIC_WIDTH, MATRIX_FIELD_Y + 26,
+		GRID_BUTTON_COUNT + SCIENTIFIC_BUTTON_COUNT + PROGRAMMER_BUTTON_COUNT, MATRIX_BUTTON_COUNT, 3,
+		add_matrix_controls},
+};
+
+NSView* g_panels[VIEW_COUNT];   // NULL until the view is first chosen
+
+#define BUTTON_SIZE 70
+#define BUTTON_MARGIN 5
+
+// calc_buttons[first] to [first + count - 1], columns per row from (x, y);
+// each button's tag is its index
+void add_buttons(NSView* parent, int first, int count, int columns, CGFloat x, CGFloat y) {
+	for (int i = first; i < first + count; i++) {
+		if (!calc_buttons[i].label) {
+			continue;
+		}
+		int index = i - first;
+		NSRect frame = {{x + index % columns * (BUTTON_SIZE + BUTTON_MARGIN),
+			y + index / columns * (BUTTON_SIZE + BUTTON_MARGIN)}, {BUTTON_SIZE, BUTTON_SIZE}};
+		NSButton* button = objc_msgSend_id_rect(NSAlloc(objc_cls.NSButton), objc_sel.initWithFrame, frame);
+		objc_msgSend_void_id(button, objc_sel.setTitle, cstring_to_nsstring(calc_buttons[i].label));
+		objc_msgSend_void_int(button, objc_sel.setTag, i);
+		objc_msgSend_void_id(button, objc_sel.setTarget, g_button_delegate);
+		objc_msgSend_void_SEL(button, objc_sel.setAction, objc_sel.buttonClicked);
+		objc_msgSend_void_id(parent, objc_sel.addSubview, button);
+	}
+}
+
+// The panel of a view, built on first use; NULL for the basic view
+NSView* view_panel(int view) {
+	const view_layout* layout = &view_layouts[view];
+	if (g_panels[view] || layout->panel_width == 0) {
+		return g_panels[view];
+	}
+	NSRect frame = {{BASIC_WIDTH - 5, 20}, {layout->panel_width, layout->panel_height}};
+	NSView* panel = objc_msgSend_id_rect(NSAlloc(objc_cls.NSView), objc_sel.initWithFrame, frame);
+	add_buttons(panel, layout->first_button, layout->button_count, layout->columns, 0, 0);
+	if (layout->add_controls) {
+		layout->add_controls(panel, g_button_delegate);
+	}
+	objc_msgSend_void_id(objc_msgSend_id(g_window, objc_sel.contentView), objc_sel.addSubview, panel);
+	g_panels[view] = panel;
+	return panel;
+}
+
+// View menu items: tag 0 = basic, 1 = scientific, 2 = programmer, 3 = graph,
+// 4 = tape, 5 = matrix.
+// Programmer turns integer mode on (64-bit signed until the Word menu says
+// otherwise) and the other views turn it off. Keys work from the keyboard in
+// any view.
+void view_mode_selected(void* self, SEL sel, id sender) {
+	NSInteger view = objc_msgSend_int(sender, objc_sel.tag);
+	if (view < 0 || view >= VIEW_COUNT) {
+		view = 0;
+	}
+	for (int v = 0; v < VIEW_COUNT; v++) {
+		if (g_panels[v] && v != view) {
+			objc_msgSend_void_bool(g_panels[v], objc_sel.setHidden, 1);
+		}
+	}
+	NSView* panel = view_panel((int)view);
+	if (panel) {
+		objc_msgSend_void_bool(panel, objc_sel.setHidden, 0);
+	}
+	NSSize size = {view_layouts[view].width, WINDOW_HEIGHT};
+	objc_msgSend_void_size(g_window, objc_sel.setContentSize, size);
+	if ((view == 2) != (g_engine.int_bits != 0)) {
+		calc_engine_set_integer_mode(&g_engine, view == 2 ? 64 : 0, 1);
+	}
+	if (view == 3) {
+		show_graph();
+	}
+	g_tape_visible = view == 4;
+	show_tape();
+}
 
 void app_did_finish_launching(void* self, SEL sel, id notification) {
 	// Create window during finishLaunching callback for proper menu bar rendering
-	NSRect frame = {{100, 100}, {320, 420}};
+	NSRect frame = {{100, 100}, {BASIC_WIDTH, WINDOW_HEIGHT}};
 	NSWindowStyleMask style = NSWindowStyleMaskTitled | NSWindowStyleMaskClosable | NSWindowStyleMaskMiniaturizable;
 	NSBackingStoreType backing = NSBackingStoreBuffered;
 	
-	SEL init_sel = sel_registerName("initWithContentRect:styleMask:backing:defer:");
 	g_window = ((id (*)(id, SEL, NSRect, NSWindowStyleMask, NSBackingStoreType, BOOL))objc_msgSend)
-		(NSAlloc(objc_getClass("NSWindow")), init_sel, frame, style, backing, 0);
+		(NSAlloc(g_window_class), objc_sel.initWithContentRect, frame, style, backing, 0);
 	
-	objc_msgSend_void_id(g_window, sel_registerName("setTitle:"), cstring_to_nsstring("Calculator"));
-	objc_msgSend_void_bool(g_window, sel_registerName("setReleasedWhenClosed:"), 1);
+	objc_msgSend_void_id(g_window, objc_sel.setTitle, cstring_to_nsstring("Calculator"));
+	objc_msgSend_void_bool(g_window, objc_sel.setReleasedWhenClosed, 1);
 	
-	// Get window delegate and set it
-	Class window_delegate_class = objc_getClass("WindowDelegate");
-	id window_delegate = objc_msgSend_id(NSAlloc(window_delegate_class), sel_registerName("init"));
-	objc_msgSend_void_id(g_window, sel_registerName("setDelegate:"), window_delegate);
+	// Create window delegate and set it
+	id window_delegate = objc_msgSend_id(NSAlloc(g_window_delegate_class), objc_sel.init);
+	objc_msgSend_void_id(g_window, objc_sel.setDelegate, window_delegate);
 	
 	// Get content view
-	NSView* content_view = objc_msgSend_id(g_window, sel_registerName("contentView"));
+	NSView* content_view = objc_msgSend_id(g_window, objc_sel.contentView);
 	
 	// Create display (NSTextField)
-	NSRect display_frame = {{10, 360}, {300, 40}};
-	NSTextField* display = ((id (*)(id, SEL, NSRect))objc_msgSend)
-		(NSAlloc(objc_getClass("NSTextField")), 
-		 sel_registerName("initWithFrame:"), 
-		 display_frame);
-	
-	objc_msgSend_void_id(display, sel_registerName("setStringValue:"), cstring_to_nsstring("0"));
-	objc_msgSend_void_int(display, sel_registerName("setAlignment:"), NSTextAlignmentRight);
-	objc_msgSend_void_bool(display, sel_registerName("setEditable:"), 0);
-	objc_msgSend_void_id(content_view, sel_registerName("addSubview:"), display);
-	
-	calc_state.display = display;
-	
-	// Get button delegate for reuse
-	Class button_delegate_class = objc_getClass("ButtonDelegate");
-	id button_delegate = objc_msgSend_id(NSAlloc(button_delegate_class), sel_registerName("init"));
-	
-	// Create button grid (4x4: 0-9, operators, decimal, equals)
-	const char* button_labels[] = {
-	        "7", "8", "9", "/",
-	        "4", "5", "6", "*",
-	        "1", "2", "3", "-",
-	        "0", ".", "=", "+"
-	};
-	
-	CGFloat btn_width = 70;
-	CGFloat btn_height = 70;
-	CGFloat margin = 5;
-	CGFloat start_x = 10;
-	CGFloat start_y = 20;
-	
-	for (int i = 0; i < 16; i++) {
-		int row = i / 4;
-		int col = i % 4;
-		
-		CGFloat x = start_x + col * (btn_width + margin);
-		CGFloat y = start_y + row * (btn_height + margin);
-		NSRect btn_frame = {{x, y}, {btn_width, btn_height}};
-		
-		NSButton* button = ((id (*)(id, SEL, NSRect))objc_msgSend)
-			(NSAlloc(objc_getClass("NSButton")), 
-			 sel_registerName("initWithFrame:"), 
-			 btn_frame);
-		
-		objc_msgSend_void_id(button, sel_registerName("setTitle:"), cstring_to_nsstring(button_labels[i]));
-		objc_msgSend_void_id(button, sel_registerName("setTarget:"), button_delegate);
-		((void(*)(id, SEL, SEL))objc_msgSend)(button, sel_registerName("setAction:"), sel_registerName("buttonClicked:"));
-		
-		objc_msgSend_void_id(content_view, sel_registerName("addSubview:"), button);
+	NSRect display_frame = {{10, 510}, {300, 40}};
+	NSTextField* display = objc_msgSend_id_rect(NSAlloc(objc_cls.NSTextField), objc_sel.initWithFrame, display_frame);
+	
+	objc_msgSend_void_id(display, objc_sel.setStringValue, cstring_to_nsstring("0"));
+	objc_msgSend_void_int(display, objc_sel.setAlignment, NSTextAlignmentRight);
+	objc_msgSend_void_bool(display, objc_sel.setEditable, 0);
+	objc_msgSend_void_bool(display, objc_sel.setSelectable, 0);  // Keep typing going to the window
+	objc_msgSend_void_id(content_view, objc_sel.addSubview, display);
+	
+	g_display = display;
+	copy_text(&g_pending_text, &g_pending_size, "0");
+	copy_text(&g_shown_text, &g_shown_size, "0");
+	calc_engine_init(&g_engine, update_display, display);
+	if (g_tape.file) {
+		g_engine.tape = &g_tape;
 	}
 	
+	// The paper tape records from launch, whether or not its view is open
+	if (calc_history_init(&g_history, TAPE_ENTRIES)) {
+		g_engine.history = &g_history;
+	}
+	
+	// Create button delegate for reuse
+	g_button_delegate = objc_msgSend_id(NSAlloc(g_button_delegate_class), objc_sel.init);
+	calc_startup_mark(CALC_STARTUP_WINDOW);
+	
+	// Button grid (4x6: 0-9, operators, decimal, equals, statistics,
+	// parentheses, percent, power); the View menu's panels wait until chosen
+	add_buttons(content_view, 0, GRID_BUTTON_COUNT, 4, 10, 20);
+	build_key_tags();
+	calc_startup_mark(CALC_STARTUP_BUTTONS);
+	
 	// Show window
-	((id(*)(id, SEL, id))objc_msgSend)(g_window, sel_registerName("makeKeyAndOrderFront:"), NULL);
+	objc_msgSend_id_id(g_window, objc_sel.makeKeyAndOrderFront, NULL);
 	
 	// Bring app to foreground after window is created
-	id app = ((id(*)(id, SEL))objc_msgSend)
-		((id)objc_getClass("NSApplication"), sel_registerName("sharedApplication"));
-	objc_msgSend_void_bool(app, sel_registerName("activateIgnoringOtherApps:"), 1);
+	id app = shared_application();
+	objc_msgSend_void_bool(app, objc_sel.activateIgnoringOtherApps, 1);
+	objc_msgSend_void_SEL_id_double(g_button_delegate, objc_sel.performSelectorAfterDelay,
+		objc_sel.firstFrameShown, NULL, 0.0);
 }
 
 unsigned int window_should_close(void* self, SEL sel, id sender) {
 	// When window close button is pressed, terminate the application
 	// NSApplication_run() will handle the shutdown
-	id app = ((id(*)(id, SEL))objc_msgSend)
-		((id)objc_getClass("NSApplication"), sel_registerName("sharedApplication"));
+	id app = shared_application();
 	// terminate: takes a sender argument
-	objc_msgSend_void_id(app, sel_registerName("terminate:"), NULL);
+	objc_msgSend_void_id(app, objc_sel.terminate, NULL);
 	return 1;
 }
 
 Class create_button_delegate_class(void) {
-	Class delegate_class = objc_allocateClassPair(objc_getClass("NSObject"), "ButtonDelegate", 0);
-	
-	// Add method for button clicks
-	class_addMethod(delegate_class, sel_registerName("buttonClicked:"), (IMP)button_clicked, "v@:@");
+	Class delegate_class = objc_allocateClassPair(objc_cls.NSObject, "ButtonDelegate", 0);
+	
+	// Add method for button clicks, and the display flush it schedules
+	class_addMethod(delegate_class, objc_sel.buttonClicked, (IMP)button_clicked, "v@:@");
+	class_addMethod(delegate_class, objc_sel.flushDisplay, (IMP)flush_display, "v@:@");
+	class_addMethod(delegate_class, objc_sel.firstFrameShown, (IMP)first_frame_shown, "v@:@");
+	class_addMethod(delegate_class, objc_sel.graphButtonClicked, (IMP)graph_button_clicked, "v@:@");
+	class_addMethod(delegate_class, objc_sel.graphFunctionEntered, (IMP)graph_function_entered, "v@:@");
+	class_addMethod(delegate_class, objc_sel.matrixEntered, (IMP)matrix_entered, "v@:@");
+	class_addMethod(delegate_class, objc_sel.numberOfRowsInTableView, (IMP)tape_row_count, "q@:@");
+	class_addMethod(delegate_class, objc_sel.objectValueForTableColumn, (IMP)tape_cell_value, "@@:@@q");
+	class_addMethod(delegate_class, objc_sel.setObjectValueForTableColumn, (IMP)tape_cell_edited, "v@:@@@q");
 	
 	objc_registerClassPair(delegate_class);
 	return delegate_class;
 }
 
+// NSWindow subclass that turns key presses into calculator keys
+Class create_window_class(void) {
+	Class window_class = objc_allocateClassPair(objc_cls.NSWindow, "CalculatorWindow", 0);
+	
+	class_addMethod(window_class, objc_sel.keyDown, (IMP)window_key_down, "v@:@");
+	
+	objc_registerClassPair(window_class);
+	return window_class;
+}
+
 Class create_app_delegate_class(void) {
-	Class delegate_class = objc_allocateClassPair(objc_getClass("NSObject"), "AppDelegate", 0);
+	Class delegate_class = objc_allocateClassPair(objc_cls.NSObject, "AppDelegate", 0);
 	
 	// Add method for finish launching
-	class_addMethod(delegate_class, sel_registerName("applicationDidFinishLaunching:"), (IMP)app_did_finish_launching, "v@:@");
+	class_addMethod(delegate_class, objc_sel.applicationDidFinishLaunching, (IMP)app_did_finish_launching, "v@:@");
+	
+	// Menu items with no target reach the app delegate through the responder chain
+	class_addMethod(delegate_class, objc_sel.precisionSelected, (IMP)precision_selected, "v@:@");
+	class_addMethod(delegate_class, objc_sel.inputModeSelected, (IMP)input_mode_selected, "v@:@");
+	class_addMethod(delegate_class, objc_sel.viewModeSelected, (IMP)view_mode_selected, "v@:@");
+	class_addMethod(delegate_class, objc_sel.wordSizeSelected, (IMP)word_size_selected, "v@:@");
+	class_addMethod(delegate_class, objc_sel.radixSelected, (IMP)radix_selected, "v@:@");
+	class_addMethod(delegate_class, objc_sel.rationalModeSelected, (IMP)rational_mode_selected, "v@:@");
 	
 	objc_registerClassPair(delegate_class);
 	return delegate_class;
 }
 
 Class create_window_delegate_class(void) {
-	Class delegate_class = objc_allocateClassPair(objc_getClass("NSObject"), "WindowDelegate", 0);
+	Class delegate_class = objc_allocateClassPair(objc_cls.NSObject, "WindowDelegate", 0);
 	
 	// Add method for window close
-	class_addMethod(delegate_class, sel_registerName("windowShouldClose:"), (IMP)window_should_close, "I@:@");
+	class_addMethod(delegate_class, objc_sel.windowShouldClose, (IMP)window_should_close, "I@:@");
 	
 	objc_registerClassPair(delegate_class);
 	return delegate_class;
 }
 
+// ============================================================================
+// Menus
+// ============================================================================
+
+typedef struct {
+	const char* title;
+	long tag;
+} menu_choice;
+
+// Precision menu: double arithmetic or exact decimal to a fixed digit count
+static const menu_choice precisions[] = {
+	{"Double", 0}, {"34 Digits", 34}, {"100 Digits", 100}, {"1000 Digits", 1000}
+};
+
+// Input menu: apply each operator at once, or type a whole expression
+static const menu_choice input_modes[] = {
+	{"Immediate", 0}, {"Expression", 1}
+};
+
+// View menu: the basic grid alone, or with the scientific or programmer
+// keys, a plot of f(x), the paper tape or the matrix keys
+static const menu_choice view_modes[] = {
+	{"Basic", 0}, {"Scientific", 1}, {"Programmer", 2}, {"Graph", 3}, {"Tape", 4}, {"Matrix", 5}
+};
+
+// Word and Radix menus: integer mode's word size and display radix
+static const menu_choice word_sizes[] = {
+	{"Int8", -8}, {"Int16", -16}, {"Int32", -32}, {"Int64", -64}, {"Int128", -128},
+	{"UInt8", 8}, {"UInt16", 16}, {"UInt32", 32}, {"UInt64", 64}, {"UInt128", 128}
+};
+static const menu_choice radices[] = {
+	{"Binary", 2}, {"Octal", 8}, {"Decimal", 10}, {"Hexadecimal", 16}
+};
+
+// Rational menu: exact fractions, shown as num/den or as a decimal with
+// the repeating digits in parentheses
+static const menu_choice rational_modes[] = {
+	{"Off", 0}, {"Fractions", CALC_RATIONAL_FRACTIONS}, {"Decimals", CALC_RATIONAL_DECIMALS}
+};
+
+// The menu bar after the app menu, left to right. Actions point into objc_sel,
+// which objc_shim_init fills in before the menus are built.
+typedef struct {
+	const char* title;
+	const menu_choice* choices;
+	size_t count;
+	const SEL* action;
+} menu_layout;
+
+#define MENU(title, choices, action) {title, choices, sizeof(choices) / sizeof(choices[0]), &objc_sel.action}
+
+static const menu_layout menu_layouts[] = {
+	MENU("Precision", precisions, precisionSelected),
+	MENU("Input", input_modes, inputModeSelected),
+	MENU("View", view_modes, viewModeSelected),
+	MENU("Word", word_sizes, wordSizeSelected),
+	MENU("Radix", radices, radixSelected),
+	MENU("Rational", rational_modes, rationalModeSelected),
+};
+
+// Add a menu whose items send action (to the app delegate) tagged with their value
+void add_choice_menu(id main_menu, const char* title, const menu_choice* choices, size_t count, SEL action) {
+	id menu = objc_msgSend_id(NSAlloc(objc_cls.NSMenu), objc_sel.init);
+	objc_msgSend_void_id(menu, objc_sel.setTitle, cstring_to_nsstring(title));
+	for (size_t i = 0; i < count; i++) {
+		id item = objc_msgSend_id_id_SEL_id(NSAlloc(objc_cls.NSMenuItem), objc_sel.initWithTitle,
+			cstring_to_nsstring(choices[i].title), action, cstring_to_nsstring(""));
+		objc_msgSend_void_int(item, objc_sel.setTag, choices[i].tag);
+		objc_msgSend_void_id(menu, objc_sel.addItem, item);
+	}
+	id menu_item = objc_msgSend_id_id_SEL_id(NSAlloc(objc_cls.NSMenuItem), objc_sel.initWithTitle,
+		cstring_to_nsstring(title), NULL, cstring_to_nsstring(""));
+	objc_msgSend_void_id(menu_item, objc_sel.setSubmenu, menu);
+	objc_msgSend_void_id(main_menu, objc_sel.addItem, menu_item);
+}
+
 // ============================================================================
 // Main
 // ============================================================================
 
 int main(int argc, char* argv[]) {
-	// Create and register delegate classes
-	Class button_delegate_class = create_button_delegate_class();
-	Class window_delegate_class = create_window_delegate_class();
+	// Launch is timed phase by phase up to the first frame (see calc_latency.h)
+	calc_startup_begin();
+	
+	// Resolve selectors and classes once, before anything sends a message
+	objc_shim_init();
+	
+	// terminate: exits the process, so the tape is flushed by atexit
+	const char* tape_path = getenv("CALC_TAPE");
+	if (tape_path && calc_tape_open(&g_tape, tape_path)) {
+		atexit(close_tape);
+	}
+	
+	// Per-click latency histograms, written as JSON at exit and on SIGUSR1
+	const char* latency_path = getenv("CALC_LATENCY");
+	if (latency_path) {
+		calc_latency_enable(latency_path);
+	}
+	
+	// Create and register the delegate and window classes
+	g_button_delegate_class = create_button_delegate_class();
+	g_window_delegate_class = create_window_delegate_class();
+	g_window_class = create_window_class();
 	Class app_delegate_class = create_app_delegate_class();
 	
 	// Initialize app
-	NSApplication* app = objc_msgSend_id((id)objc_getClass("NSApplication"), sel_registerName("sharedApplication"));
-	objc_msgSend_void_int(app, sel_registerName("setActivationPolicy:"), 0); // NSApplicationActivationPolicyRegular
+	NSApplication* app = shared_application();
+	objc_msgSend_void_int(app, objc_sel.setActivationPolicy, 0); // NSApplicationActivationPolicyRegular
 	
 	// Set app delegate BEFORE finishLaunching so it gets the callback
-	id app_delegate = objc_msgSend_id(NSAlloc(app_delegate_class), sel_registerName("init"));
-	objc_msgSend_void_id(app, sel_registerName("setDelegate:"), app_delegate);
+	id app_delegate = objc_msgSend_id(NSAlloc(app_delegate_class), objc_sel.init);
+	objc_msgSend_void_id(app, objc_sel.setDelegate, app_delegate);
+	calc_startup_mark(CALC_STARTUP_CLASSES);
 	
 	// Create main menu bar
-	id main_menu = objc_msgSend_id(NSAlloc(objc_getClass("NSMenu")), sel_registerName("init"));
+	id main_menu = objc_msgSend_id(NSAlloc(objc_cls.NSMenu), objc_sel.init);
 	
 	// Get app's process name for dynamic menu title
 	const char* app_name = get_process_name();
@@ -400,38 +858,36 @@ int main(int argc, char* argv[]) {
 	snprintf(quit_title, sizeof(quit_title), "Quit %s", app_name);
 	
 	// Create app menu (with app name)
-	id app_menu = objc_msgSend_id(NSAlloc(objc_getClass("NSMenu")), sel_registerName("init"));
+	id app_menu = objc_msgSend_id(NSAlloc(objc_cls.NSMenu), objc_sel.init);
 	
 	// Add Quit item to app menu
-	id quit_item = ((id(*)(id, SEL, id, SEL, id))objc_msgSend)
-		(NSAlloc(objc_getClass("NSMenuItem")),
-		 sel_registerName("initWithTitle:action:keyEquivalent:"),
-		 cstring_to_nsstring(quit_title),
-		 sel_registerName("terminate:"),
-		 cstring_to_nsstring("q"));
-	objc_msgSend_void_id(app_menu, sel_registerName("addItem:"), quit_item);
+	id quit_item = objc_msgSend_id_id_SEL_id(NSAlloc(objc_cls.NSMenuItem), objc_sel.initWithTitle,
+		cstring_to_nsstring(quit_title), objc_sel.terminate, cstring_to_nsstring("q"));
+	objc_msgSend_void_id(app_menu, objc_sel.addItem, quit_item);
 	
 	// Create app menu item (this should show app name in menu bar)
 	// Use the process name dynamically from NSProcessInfo
-	id app_menu_item = ((id(*)(id, SEL, id, SEL, id))objc_msgSend)
-		(NSAlloc(objc_getClass("NSMenuItem")),
-		 sel_registerName("initWithTitle:action:keyEquivalent:"),
-		 cstring_to_nsstring(app_name),
-		 NULL,
-		 cstring_to_nsstring(""));
-	objc_msgSend_void_id(app_menu_item, sel_registerName("setSubmenu:"), app_menu);
-	objc_msgSend_void_id(main_menu, sel_registerName("addItem:"), app_menu_item);
+	id app_menu_item = objc_msgSend_id_id_SEL_id(NSAlloc(objc_cls.NSMenuItem), objc_sel.initWithTitle,
+		cstring_to_nsstring(app_name), NULL, cstring_to_nsstring(""));
+	objc_msgSend_void_id(app_menu_item, objc_sel.setSubmenu, app_menu);
+	objc_msgSend_void_id(main_menu, objc_sel.addItem, app_menu_item);
+	
+	for (size_t m = 0; m < sizeof(menu_layouts) / sizeof(menu_layouts[0]); m++) {
+		add_choice_menu(main_menu, menu_layouts[m].title, menu_layouts[m].choices, menu_layouts[m].count,
+			*menu_layouts[m].action);
+	}
 	
 	// Set main menu BEFORE finishLaunching (important for proper initialization)
-	objc_msgSend_void_id(app, sel_registerName("setMainMenu:"), main_menu);
+	objc_msgSend_void_id(app, objc_sel.setMainMenu, main_menu);
+	calc_startup_mark(CALC_STARTUP_MENUS);
 	
 	// Finish launching - this triggers applicationDidFinishLaunching callback
 	// which creates the window and UI, then activates the app
-	objc_msgSend_void(app, sel_registerName("finishLaunching"));
+	objc_msgSend_void(app, objc_sel.finishLaunching);
 	
 	// Run event loop using NSApplication's run method
 	// This is the standard Apple-approved way and handles menu bar rendering properly
-	objc_msgSend_void(app, sel_registerName("run"));
+	objc_msgSend_void(app, objc_sel.run);
 	
 	return 0;
 }
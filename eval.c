@@ -0,0 +1,441 @@
+// Parallel Expression Evaluator - one expression per line, results in input order
+// Compile with: gcc -O2 -pthread -o calc-eval eval.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// The input is memory-mapped and cut into chunks on line boundaries. Each worker
+// owns a contiguous run of chunks and takes them from the front; a worker that
+// runs out steals the back half of another worker's run. Workers format results
+// into per-chunk buffers, which the main thread writes out in chunk order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "calc_cache.h"
+#include "calc_expr.h"
+#include "calc_format.h"
+
+// ============================================================================
+// Input
+// ============================================================================
+
+typedef struct {
+	const char* data;
+	size_t size;
+	int mapped;
+} input_file;
+
+// Map a file, or read stdin ("-") into memory
+static int open_input(const char* path, input_file* in) {
+	in->data = NULL;
+	in->size = 0;
+	in->mapped = 0;
+	
+	if (strcmp(path, "-") == 0) {
+		size_t capacity = 1 << 16;
+		char* data = malloc(capacity);
+		size_t n;
+		while ((n = fread(data + in->size, 1, capacity - in->size, stdin)) > 0) {
+			in->size += n;
+			if (in->size == capacity) {
+				capacity *= 2;
+				data = realloc(data, capacity);
+			}
+		}
+		in->data = data;
+		return 1;
+	}
+	
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(path);
+		if (fd >= 0) close(fd);
+		return 0;
+	}
+	in->size = (size_t)st.st_size;
+	if (in->size > 0) {
+		void* data = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			perror(path);
+			close(fd);
+			return 0;
+		}
+		madvise(data, in->size, MADV_SEQUENTIAL);
+		in->data = data;
+		in->mapped = 1;
+	}
+	close(fd);
+	return 1;
+}
+
+static void close_input(input_file* in) {
+	if (in->mapped) {
+		munmap((void*)in->data, in->size);
+	} else {
+		free((void*)in->data);
+	}
+}
+
+// ============================================================================
+// Chunks & Work Stealing
+// ============================================================================
+
+typedef struct {
+	const char* begin;
+	const char* end;     // Just past the chunk's last '\n' (or the end of input)
+	char* out;
+	size_t out_length;
+	size_t out_capacity;
+	size_t lines;
+	int done;            // Guarded by evaluator.progress_lock
+} chunk;
+
+// A worker's remaining chunks [next, end); owner takes from next, thieves from end
+typedef struct {
+	pthread_mutex_t lock;
+	size_t next;
+	size_t end;
+} chunk_range;
+
+typedef struct {
+	chunk* chunks;
+	size_t chunk_count;
+	chunk_range* ranges;
+	int threads;
+	long precision;                       // 0 = double arithmetic
+	const calc_format_options* format;
+	pthread_mutex_t progress_lock;
+	pthread_cond_t progress;
+} evaluator;
+
+typedef struct {
+	evaluator* ev;
+	int id;
+	pthread_t thread;
+} worker;
+
+static size_t take_own(chunk_range* range) {
+	size_t index = (size_t)-1;
+	pthread_mutex_lock(&range->lock);
+	if (range->next < range->end) {
+		index = range->next++;
+	}
+	pthread_mutex_unlock(&range->lock);
+	return index;
+}
+
+// Move the back half of the first non-empty victim's range into ours and take
+// its first chunk; returns (size_t)-1 once every range is empty
+static size_t steal(evaluator* ev, int thief) {
+	for (int offset = 1; offset < ev->threads; offset++) {
+		chunk_range* victim = &ev->ranges[(thief + offset) % ev->threads];
+		pthread_mutex_lock(&victim->lock);
+		size_t remaining = victim->end - victim->next;
+		if (remaining == 0) {
+			pthread_mutex_unlock(&victim->lock);
+			continue;
+		}
+		size_t begin = victim->end - (remaining + 1) / 2;
+		size_t end = victim->end;
+		victim->end = begin;
+		pthread_mutex_unlock(&victim->lock);
+		
+		chunk_range* own = &ev->ranges[thief];
+		pthread_mutex_lock(&own->lock);
+		own->next = begin + 1;
+		own->end = end;
+		pthread_mutex_unlock(&own->lock);
+		return begin;
+	}
+	return (size_t)-1;
+}
+
+// ============================================================================
+// Evaluation
+// ============================================================================
+
+static void chunk_append(chunk* c, const char* text, size_t length) {
+	if (c->out_length + length > c->out_capacity) {
+		c->out_capacity = (c->out_length + length) * 2;
+		c->out = realloc(c->out, c->out_capacity);
+	}
+	memcpy(c->out + c->out_length, text, length);
+	c->out_length += length;
+}
+
+// Per-worker state: nothing here is shared with other workers
+typedef struct {
+	calc_expr expr;
+	calc_decimal value;
+	char* line;
+	size_t line_capacity;
+	char* text;
+	size_t text_capacity;
+} worker_state;
+
+static void evaluate_chunk(evaluator* ev, worker_state* state, chunk* c) {
+	c->out_capacity = (size_t)(c->end - c->begin) + 64;
+	c->out = malloc(c->out_capacity);
+	
+	const char* p = c->begin;
+	while (p < c->end) {
+		const char* newline = memchr(p, '\n', (size_t)(c->end - p));
+		const char* line_end = newline ? newline : c->end;
+		size_t length = (size_t)(line_end - p);
+		
+		// The parser needs a terminated string
+		if (length + 1 > state->line_capacity) {
+			state->line_capacity = (length + 1) * 2;
+			state->line = realloc(state->line, state->line_capacity);
+		}
+		memcpy(state->line, p, length);
+		state->line[length] = '\0';
+		
+		if (length == 0 || (length == 1 && p[0] == '\r')) {
+			// Blank lines stay blank so output lines match input lines
+		} else if (!calc_expr_compile(&state->expr, state->line)) {
+			chunk_append(c, "Error", 5);
+		} else if (ev->precision) {
+			calc_expr_eval_decimal(&state->expr, &state->value, ev->precision);
+			size_t needed = calc_decimal_to_string(&state->value, state->text, state->text_capacity, 0);
+			if (needed >= state->text_capacity) {
+				state->text_capacity = needed + 1;
+				state->text = realloc(state->text, state->text_capacity);
+				calc_decimal_to_string(&state->value, state->text, state->text_capacity, 0);
+			}
+			chunk_append(c, state->text, needed);
+		} else {
+			char buffer[CALC_FORMAT_BUFFER_SIZE];
+			int n = calc_format_double(buffer, calc_expr_eval(&state->expr), ev->format);
+			chunk_append(c, buffer, (size_t)n);
+		}
+		chunk_append(c, "\n", 1);
+		c->lines++;
+		p = line_end + 1;
+	}
+}
+
+static void* worker_main(void* arg) {
+	worker* w = arg;
+	evaluator* ev = w->ev;
+	worker_state state;
+	memset(&state, 0, sizeof(state));
+	calc_expr_init(&state.expr);
+	calc_decimal_init(&state.value);
+	
+	for (;;) {
+		size_t index = take_own(&ev->ranges[w->id]);
+		if (index == (size_t)-1) {
+			index = steal(ev, w->id);
+			if (index == (size_t)-1) {
+				break;
+			}
+		}
+		evaluate_chunk(ev, &state, &ev->chunks[index]);
+		
+		pthread_mutex_lock(&ev->progress_lock);
+		ev->chunks[index].done = 1;
+		pthread_cond_broadcast(&ev->progress);
+		pthread_mutex_unlock(&ev->progress_lock);
+	}
+	
+	calc_expr_free(&state.expr);
+	calc_decimal_free(&state.value);
+	free(state.line);
+	free(state.text);
+	return NULL;
+}
+
+// Cut the input into chunks of about chunk_size bytes, ending on newlines
+static size_t split_chunks(const input_file* in, size_t chunk_size, chunk** out) {
+	size_t capacity = in->size / chunk_size + 2;
+	chunk* chunks = calloc(capacity, sizeof(chunk));
+	size_t count = 0;
+	const char* p = in->data;
+	const char* end = in->data + in->size;
+	
+	while (p < end) {
+		const char* stop = (size_t)(end - p) > chunk_size ? p + chunk_size : end;
+		if (stop < end) {
+			const char* newline = memchr(stop, '\n', (size_t)(end - stop));
+			stop = newline ? newline + 1 : end;
+		}
+		if (count == capacity) {
+			capacity *= 2;
+			chunks = realloc(chunks, capacity * sizeof(chunk));
+		}
+		memset(&chunks[count], 0, sizeof(chunk));
+		chunks[count].begin = p;
+		chunks[count].end = stop;
+		count++;
+		p = stop;
+	}
+	*out = chunks;
+	return count;
+}
+
+// Evaluate every chunk on threads workers; writes results to output in input
+// order (output may be NULL to discard them). Returns the number of lines.
+static size_t run(const input_file* in, size_t chunk_size, int threads, long precision,
+                  const calc_format_options* format, FILE* output) {
+	evaluator ev;
+	ev.chunk_count = split_chunks(in, chunk_size, &ev.chunks);
+	ev.threads = threads;
+	ev.precision = precision;
+	ev.format = format;
+	pthread_mutex_init(&ev.progress_lock, NULL);
+	pthread_cond_init(&ev.progress, NULL);
+	
+	// Each worker starts with an equal contiguous run of chunks
+	ev.ranges = calloc((size_t)threads, sizeof(chunk_range));
+	for (int t = 0; t < threads; t++) {
+		pthread_mutex_init(&ev.ranges[t].lock, NULL);
+		ev.ranges[t].next = ev.chunk_count * (size_t)t / (size_t)threads;
+		ev.ranges[t].end = ev.chunk_count * (size_t)(t + 1) / (size_t)threads;
+	}
+	
+	worker* workers = calloc((size_t)threads, sizeof(worker));
+	for (int t = 0; t < threads; t++) {
+		workers[t].ev = &ev;
+		workers[t].id = t;
+		pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+	}
+	
+	// Write chunks as soon as they and everything before them are done
+	size_t lines = 0;
+	for (size_t i = 0; i < ev.chunk_count; i++) {
+		pthread_mutex_lock(&ev.progress_lock);
+		while (!ev.chunks[i].done) {
+			pthread_cond_wait(&ev.progress, &ev.progress_lock);
+		}
+		pthread_mutex_unlock(&ev.progress_lock);
+		
+		if (output) {
+			fwrite(ev.chunks[i].out, 1, ev.chunks[i].out_length, output);
+		}
+		lines += ev.chunks[i].lines;
+		free(ev.chunks[i].out);
+	}
+	
+	for (int t = 0; t < threads; t++) {
+		pthread_join(workers[t].thread, NULL);
+	}
+	for (int t = 0; t < threads; t++) {
+		pthread_mutex_destroy(&ev.ranges[t].lock);
+	}
+	pthread_mutex_destroy(&ev.progress_lock);
+	pthread_cond_destroy(&ev.progress);
+	free(workers);
+	free(ev.ranges);
+	free(ev.chunks);
+	return lines;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [-t threads] [-c chunk-kb] [-g digits] [-P digits] [-m MiB] [-o output] [-s] file\n", argv0);
+	fprintf(stderr, "  -t N   worker threads (default: one per online CPU)\n");
+	fprintf(stderr, "  -c N   chunk size in KiB (default 256)\n");
+	fprintf(stderr, "  -g N   show N significant digits (default: shortest round-trip)\n");
+	fprintf(stderr, "  -P N   exact decimal arithmetic rounded to N significant digits\n");
+	fprintf(stderr, "  -m N   result cache for -P quotients and long products, in MiB (default 16, 0 = off)\n");
+	fprintf(stderr, "  -o F   write results to F instead of stdout\n");
+	fprintf(stderr, "  -s     scaling run: time 1..N threads, discard results\n");
+	fprintf(stderr, "  Use '-' to read expressions from stdin.\n");
+}
+
+int main(int argc, char* argv[]) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = cpus > 0 ? (int)cpus : 1;
+	size_t chunk_size = 256 * 1024;
+	long precision = 0;
+	int scaling = 0;
+	const char* output_path = NULL;
+	calc_format_options format = calc_format_default;
+	
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+		if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+			threads = atoi(argv[++arg]);
+		} else if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc) {
+			chunk_size = (size_t)atol(argv[++arg]) * 1024;
+		} else if (strcmp(argv[arg], "-g") == 0 && arg + 1 < argc) {
+			format.significant_digits = atoi(argv[++arg]);
+		} else if (strcmp(argv[arg], "-P") == 0 && arg + 1 < argc) {
+			precision = atol(argv[++arg]);
+		} else if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+			calc_cache_set_budget((size_t)atol(argv[++arg]) << 20);
+		} else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+			output_path = argv[++arg];
+		} else if (strcmp(argv[arg], "-s") == 0) {
+			scaling = 1;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (arg + 1 != argc || threads < 1 || chunk_size == 0 || precision < 0) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	input_file in;
+	if (!open_input(argv[arg], &in)) {
+		return 1;
+	}
+	
+	if (scaling) {
+		fprintf(stderr, "%8s %12s %14s %8s\n", "threads", "seconds", "lines/sec", "speedup");
+		double single = 0;
+		for (int t = 1; t <= threads; t++) {
+			// Every run starts cold, or later ones would only time hits
+			calc_cache_clear();
+			double start = now_seconds();
+			size_t lines = run(&in, chunk_size, t, precision, &format, NULL);
+			double elapsed = now_seconds() - start;
+			if (t == 1) {
+				single = elapsed;
+			}
+			fprintf(stderr, "%8d %12.4f %14.0f %8.2f\n", t, elapsed,
+				elapsed > 0 ? lines / elapsed : 0.0, elapsed > 0 ? single / elapsed : 0.0);
+		}
+		close_input(&in);
+		return 0;
+	}
+	
+	FILE* output = stdout;
+	if (output_path && !(output = fopen(output_path, "wb"))) {
+		perror(output_path);
+		close_input(&in);
+		return 1;
+	}
+	
+	double start = now_seconds();
+	size_t lines = run(&in, chunk_size, threads, precision, &format, output);
+	double elapsed = now_seconds() - start;
+	fprintf(stderr, "%s: %zu lines on %d threads in %.3f s, %.0f lines/sec\n",
+		argv[arg], lines, threads, elapsed, elapsed > 0 ? lines / elapsed : 0.0);
+	calc_cache_print_stats(stderr, argv[arg]);
+	
+	if (output != stdout) {
+		fclose(output);
+	}
+	close_input(&in);
+	return 0;
+}
@@ -0,0 +1,109 @@
+// Function Plotter - draws f(x) into a PNG without a window
+// Compile with: gcc -O2 -o calc-graph graph.c $GRAPH_SOURCES -lm
+//               with GRAPH_SOURCES from build.sh
+//
+// The expression uses the calculator's syntax plus x, pi and the scientific
+// functions, e.g. 'sin(x)/x' or 'sqrt(4 - x^2)'. Without -y the y range is
+// fitted to the function over the x range.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calc_graph.h"
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// "lo,hi" with lo < hi
+static int parse_range(const char* text, double* lo, double* hi) {
+	char* end;
+	*lo = strtod(text, &end);
+	if (end == text || *end != ',') {
+		return 0;
+	}
+	text = end + 1;
+	*hi = strtod(text, &end);
+	return end != text && *end == '\0' && *lo < *hi;
+}
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [-s WxH] [-x min,max] [-y min,max] [-o file.png] 'f(x)'\n", argv0);
+	fprintf(stderr, "  -s WxH       image size in pixels (default 640x480)\n");
+	fprintf(stderr, "  -x min,max   x range (default -10,10)\n");
+	fprintf(stderr, "  -y min,max   y range (default: fitted to f)\n");
+	fprintf(stderr, "  -o FILE      output PNG (default graph.png)\n");
+}
+
+int main(int argc, char* argv[]) {
+	int width = 640;
+	int height = 480;
+	calc_graph_view view = {-10, 10, 0, 0};
+	int fit_y = 1;
+	const char* output = "graph.png";
+	
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+		if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+			if (sscanf(argv[++arg], "%dx%d", &width, &height) != 2) {
+				width = 0;
+			}
+		} else if (strcmp(argv[arg], "-x") == 0 && arg + 1 < argc) {
+			if (!parse_range(argv[++arg], &view.x_min, &view.x_max)) {
+				width = 0;
+			}
+		} else if (strcmp(argv[arg], "-y") == 0 && arg + 1 < argc) {
+			fit_y = 0;
+			if (!parse_range(argv[++arg], &view.y_min, &view.y_max)) {
+				width = 0;
+			}
+		} else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+			output = argv[++arg];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (arg + 1 != argc || width <= 0 || height <= 0 || width > 16384 || height > 16384) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	calc_graph graph;
+	if (!calc_graph_init(&graph, width, height)) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+	if (!calc_graph_set_function(&graph, argv[arg])) {
+		fprintf(stderr, "%s\n%*s^ %s\n", argv[arg], (int)graph.error_position, "", graph.error);
+		calc_graph_free(&graph);
+		return 1;
+	}
+	
+	double start = now_seconds();
+	if (fit_y) {
+		calc_graph_fit_y(&graph, &view);
+	}
+	calc_graph_render(&graph, &view);
+	double elapsed = now_seconds() - start;
+	
+	if (!calc_graph_write_png(&graph, output)) {
+		perror(output);
+		calc_graph_free(&graph);
+		return 1;
+	}
+	fprintf(stderr, "%s: %dx%d, y %g..%g, %llu evaluations, %zu discontinuities, %.2f ms\n",
+		output, width, height, view.y_min, view.y_max, (unsigned long long)graph.evaluations,
+		graph.breaks, elapsed * 1e3);
+	
+	calc_graph_free(&graph);
+	return 0;
+}
@@ -0,0 +1,330 @@
+// Calculation Server Load Generator - throughput and latency of calc-server
+// Compile with: gcc -O2 -pthread -o calc-load load.c calc_session.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// For each concurrency level and pipeline depth, opens that many connections
+// and keeps depth requests in flight on each until the level's requests are
+// answered, all from one thread polling the sockets. Every response is
+// checked against a local calc_session fed the same keys, and its latency
+// (request queued to response read) goes into a calc_latency histogram.
+// Exits 1 on a wrong answer or a dropped connection.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "calc_protocol.h"
+#include "calc_session.h"
+#include "calc_latency.h"
+
+#define MAX_LEVELS 16
+
+static const char pattern[] = "12.5+3.25*4-1/2=0.1+0.2=987654321*123456789=7*6=";
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// ============================================================================
+// Connections
+// ============================================================================
+
+typedef struct {
+	int fd;
+	calc_session mirror;       // Fed each request's keys as its response arrives
+	size_t quota;              // Requests this connection sends
+	size_t sent;
+	size_t received;
+	uint64_t* sent_at;         // Request n was queued at sent_at[n % depth]
+	char* out;                 // Requests queued but not yet written
+	size_t out_start;
+	size_t out_length;
+	char* in;
+	size_t in_length;
+	size_t in_capacity;
+} client;
+
+typedef struct {
+	const char* path;
+	size_t depth;
+	size_t keys_per_request;
+	calc_latency_histogram* latency;
+} load_run;
+
+static int connect_to(const char* path) {
+	struct sockaddr_un address = {0};
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", path);
+		return -1;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		fprintf(stderr, "%s: %s (is calc-server running?)\n", path, strerror(errno));
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+// Keys of request n: the pattern, cycled, keys_per_request at a time
+static void request_keys(const load_run* run, size_t n, char* keys) {
+	size_t at = n * run->keys_per_request % (sizeof(pattern) - 1);
+	for (size_t i = 0; i < run->keys_per_request; i++) {
+		keys[i] = pattern[at];
+		at = at + 1 == sizeof(pattern) - 1 ? 0 : at + 1;
+	}
+}
+
+// Queue requests until depth are in flight
+static void fill(const load_run* run, client* c, uint64_t now) {
+	// Unwritten requests move to the front; with them the buffer holds depth requests
+	memmove(c->out, c->out + c->out_start, c->out_length - c->out_start);
+	c->out_length -= c->out_start;
+	c->out_start = 0;
+	while (c->sent < c->quota && c->sent - c->received < run->depth) {
+		calc_request_header header = {(uint16_t)run->keys_per_request, CALC_REQUEST_KEYS, 0};
+		calc_request_header_encode(c->out + c->out_length, &header);
+		request_keys(run, c->sent, c->out + c->out_length + CALC_PROTOCOL_HEADER_SIZE);
+		c->out_length += CALC_PROTOCOL_HEADER_SIZE + run->keys_per_request;
+		c->sent_at[c->sent % run->depth] = now;
+		c->sent++;
+	}
+}
+
+static int flush(client* c) {
+	while (c->out_start < c->out_length) {
+		ssize_t n = send(c->fd, c->out + c->out_start, c->out_length - c->out_start, 0);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 1;
+			}
+			perror("send");
+			return 0;
+		}
+		c->out_start += (size_t)n;
+	}
+	return 1;
+}
+
+// Read and check responses; returns 0 on a dropped connection or wrong answer
+static int receive(const load_run* run, client* c) {
+	ssize_t n = recv(c->fd, c->in + c->in_length, c->in_capacity - c->in_length, 0);
+	if (n <= 0) {
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			return 1;
+		}
+		fprintf(stderr, "server closed a connection with %zu responses outstanding\n", c->sent - c->received);
+		return 0;
+	}
+	uint64_t now = now_ns();
+	c->in_length += (size_t)n;
+	
+	size_t offset = 0;
+	char keys[CALC_PROTOCOL_MAX_PAYLOAD];
+	char expected[CALC_FORMAT_BUFFER_SIZE];
+	while (c->in_length - offset >= CALC_PROTOCOL_HEADER_SIZE) {
+		calc_response_header header;
+		calc_response_header_decode(&header, c->in + offset);
+		if (c->in_length - offset < CALC_PROTOCOL_HEADER_SIZE + header.length) {
+			break;
+		}
+		const char* text = c->in + offset + CALC_PROTOCOL_HEADER_SIZE;
+		
+		request_keys(run, c->received, keys);
+		for (size_t i = 0; i < run->keys_per_request; i++) {
+			calc_session_key(&c->mirror, keys[i]);
+		}
+		int length = calc_session_format(&c->mirror, expected, NULL);
+		if (header.status != CALC_RESPONSE_OK || header.length != length || memcmp(text, expected, (size_t)length) != 0) {
+			fprintf(stderr, "FAIL: response %zu is \"%.*s\" (status %d), expected \"%s\"\n",
+				c->received, (int)header.length, text, header.status, expected);
+			return 0;
+		}
+		calc_latency_histogram_add(run->latency, now - c->sent_at[c->received % run->depth]);
+		c->received++;
+		offset += CALC_PROTOCOL_HEADER_SIZE + header.length;
+	}
+	memmove(c->in, c->in + offset, c->in_length - offset);
+	c->in_length -= offset;
+	return 1;
+}
+
+// ============================================================================
+// Load Levels
+// ============================================================================
+
+// Send requests spread over connections; returns elapsed seconds, or -1 on failure
+static double run_level(const load_run* run, size_t connections, size_t requests) {
+	client* clients = calloc(connections, sizeof(client));
+	struct pollfd* fds = calloc(connections, sizeof(struct pollfd));
+	size_t request_bytes = CALC_PROTOCOL_HEADER_SIZE + run->keys_per_request;
+	size_t opened = 0;
+	int ok = 1;
+	
+	for (; opened < connections; opened++) {
+		client* c = &clients[opened];
+		c->fd = connect_to(run->path);
+		if (c->fd < 0) {
+			ok = 0;
+			break;
+		}
+		calc_session_init(&c->mirror);
+		c->quota = requests / connections + (opened < requests % connections);
+		c->sent_at = malloc(run->depth * sizeof(uint64_t));
+		c->out = malloc(run->depth * request_bytes);
+		c->in_capacity = run->depth * (CALC_PROTOCOL_HEADER_SIZE + CALC_FORMAT_BUFFER_SIZE);
+		c->in = malloc(c->in_capacity);
+	}
+	
+	uint64_t start = now_ns();
+	size_t finished = 0;
+	while (ok && finished < connections) {
+		uint64_t now = now_ns();
+		for (size_t i = 0; i < connections; i++) {
+			client* c = &clients[i];
+			fill(run, c, now);
+			if (!flush(c)) {
+				ok = 0;
+			}
+			fds[i].fd = c->received < c->quota ? c->fd : -1;
+			fds[i].events = POLLIN | (c->out_start < c->out_length ? POLLOUT : 0);
+			fds[i].revents = 0;
+		}
+		if (!ok) {
+			break;
+		}
+		if (poll(fds, connections, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			ok = 0;
+			break;
+		}
+		for (size_t i = 0; i < connections && ok; i++) {
+			client* c = &clients[i];
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				ok = receive(run, c);
+				if (ok && c->received == c->quota) {
+					finished++;
+				}
+			}
+		}
+	}
+	double elapsed = (double)(now_ns() - start) * 1e-9;
+	
+	for (size_t i = 0; i < opened; i++) {
+		close(clients[i].fd);
+		calc_session_free(&clients[i].mirror);
+		free(clients[i].sent_at);
+		free(clients[i].out);
+		free(clients[i].in);
+	}
+	free(clients);
+	free(fds);
+	return ok ? elapsed : -1;
+}
+
+// Comma-separated positive numbers; returns how many were read, 0 if malformed
+static int parse_list(const char* text, size_t* values) {
+	int count = 0;
+	while (*text && count < MAX_LEVELS) {
+		char* end;
+		long value = strtol(text, &end, 10);
+		if (end == text || value < 1 || (*end != ',' && *end != '\0')) {
+			return 0;
+		}
+		values[count++] = (size_t)value;
+		text = *end ? end + 1 : end;
+	}
+	return *text ? 0 : count;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [-s socket] [-c connections,...] [-d depth,...] [-n requests] [-k keys]\n", argv0);
+	fprintf(stderr, "  -s F   server socket (default %s)\n", CALC_SOCKET_PATH);
+	fprintf(stderr, "  -c L   concurrency levels: connections open at once (default 1,4,16,64)\n");
+	fprintf(stderr, "  -d L   pipeline depths: requests in flight per connection (default 1,16)\n");
+	fprintf(stderr, "  -n N   requests per level (default 200000)\n");
+	fprintf(stderr, "  -k N   keys per request (default 8)\n");
+}
+
+int main(int argc, char* argv[]) {
+	load_run run = {CALC_SOCKET_PATH, 0, 8, NULL};
+	size_t levels[MAX_LEVELS] = {1, 4, 16, 64};
+	size_t depths[MAX_LEVELS] = {1, 16};
+	int level_count = 4;
+	int depth_count = 2;
+	long requests = 200000;
+	
+	for (int arg = 1; arg < argc; arg++) {
+		if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+			run.path = argv[++arg];
+		} else if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc) {
+			level_count = parse_list(argv[++arg], levels);
+		} else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+			depth_count = parse_list(argv[++arg], depths);
+		} else if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+			requests = atol(argv[++arg]);
+		} else if (strcmp(argv[arg], "-k") == 0 && arg + 1 < argc) {
+			run.keys_per_request = (size_t)atol(argv[++arg]);
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (level_count == 0 || depth_count == 0 || requests < 1 ||
+		run.keys_per_request < 1 || run.keys_per_request > CALC_PROTOCOL_MAX_PAYLOAD) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	signal(SIGPIPE, SIG_IGN);
+	run.latency = malloc(sizeof(calc_latency_histogram));
+	
+	printf("%11s %6s %14s %12s %10s %10s %10s\n",
+		"connections", "depth", "requests/sec", "keys/sec", "p50 us", "p99 us", "max us");
+	for (int l = 0; l < level_count; l++) {
+		for (int d = 0; d < depth_count; d++) {
+			size_t connections = levels[l] < (size_t)requests ? levels[l] : (size_t)requests;
+			run.depth = depths[d];
+			memset(run.latency, 0, sizeof(calc_latency_histogram));
+			double elapsed = run_level(&run, connections, (size_t)requests);
+			if (elapsed < 0) {
+				free(run.latency);
+				return 1;
+			}
+			double rate = elapsed > 0 ? requests / elapsed : 0.0;
+			printf("%11zu %6zu %14.0f %12.0f %10.1f %10.1f %10.1f\n", connections, run.depth,
+				rate, rate * run.keys_per_request,
+				calc_latency_percentile(run.latency, 50) / 1000.0,
+				calc_latency_percentile(run.latency, 99) / 1000.0,
+				run.latency->max_ns / 1000.0);
+			fflush(stdout);
+		}
+	}
+	
+	free(run.latency);
+	return 0;
+}
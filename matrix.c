@@ -0,0 +1,198 @@
+// Matrix Tool - matrix arithmetic on CSV files
+// Compile with: gcc -O2 -pthread -o calc-matrix matrix.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// Each input file is memory-mapped and parsed straight into a calc_matrix:
+// one row per line, elements separated by commas or blanks. The result is
+// written as CSV in the same layout (a determinant as a single number), and
+// the time of the operation itself goes to stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "calc_matrix.h"
+#include "calc_stats.h"
+
+// ============================================================================
+// Input
+// ============================================================================
+
+// Parse a matrix from a file, or from stdin ("-")
+static int load_matrix(const char* path, calc_matrix* m) {
+	if (strcmp(path, "-") == 0) {
+		size_t size = 0;
+		size_t capacity = 1 << 16;
+		char* data = malloc(capacity);
+		size_t n;
+		while (data && (n = fread(data + size, 1, capacity - size, stdin)) > 0) {
+			size += n;
+			if (size == capacity) {
+				capacity *= 2;
+				data = realloc(data, capacity);
+			}
+		}
+		int parsed = data && calc_matrix_parse(m, data, size);
+		free(data);
+		if (!parsed) {
+			fprintf(stderr, "%s: not a matrix\n", path);
+		}
+		return parsed;
+	}
+	
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(path);
+		if (fd >= 0) close(fd);
+		return 0;
+	}
+	size_t size = (size_t)st.st_size;
+	void* data = NULL;
+	if (size > 0) {
+		data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			perror(path);
+			close(fd);
+			return 0;
+		}
+		madvise(data, size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	int parsed = calc_matrix_parse(m, data, size);
+	if (data) {
+		munmap(data, size);
+	}
+	if (!parsed) {
+		fprintf(stderr, "%s: not a matrix\n", path);
+	}
+	return parsed;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [-t threads] [-o out.csv] A.csv [op B.csv|number]\n", argv0);
+	fprintf(stderr, "  -t N   threads for large products (default: one per online CPU)\n");
+	fprintf(stderr, "  -o F   write the result to F instead of stdout\n");
+	fprintf(stderr, "  op     + - * / ^ element by element (a number applies to every element),\n");
+	fprintf(stderr, "         @ product, \\ solve A X = B; or alone: T transpose, det, inv\n");
+	fprintf(stderr, "  Use '-' to read A from stdin.\n");
+}
+
+// Apply op to the loaded operands and write the result; returns the exit status
+static int run(const char* argv0, const char* name, const char* op, const char* out_path,
+               const calc_matrix* a, const calc_matrix* b, const double* scalar, calc_matrix* result) {
+	double start = now_seconds();
+	double determinant = 0;
+	int ok;
+	if (op == NULL) {
+		ok = calc_matrix_copy(result, a);
+	} else if (strcmp(op, "T") == 0) {
+		ok = calc_matrix_transpose(result, a);
+	} else if (strcmp(op, "det") == 0) {
+		ok = calc_matrix_determinant(a, &determinant);
+	} else if (strcmp(op, "inv") == 0) {
+		ok = calc_matrix_inverse(result, a);
+	} else if (scalar) {
+		// A product with a number scales; A X = x has no solution to report
+		ok = op[0] != '\\' && calc_matrix_scalar(result, a, op[0] == '@' ? '*' : op[0], *scalar, 0);
+	} else if (op[0] == '@') {
+		ok = calc_matrix_multiply(result, a, b);
+	} else if (op[0] == '\\') {
+		ok = calc_matrix_solve(result, a, b);
+	} else {
+		ok = calc_matrix_elementwise(result, a, op[0], b);
+	}
+	double elapsed = now_seconds() - start;
+	if (!ok) {
+		fprintf(stderr, "%s: %s %s: shapes do not fit, the matrix is singular, or out of memory\n",
+			argv0, name, op ? op : "");
+		return 1;
+	}
+	
+	FILE* out = out_path ? fopen(out_path, "w") : stdout;
+	if (!out) {
+		perror(out_path);
+		return 1;
+	}
+	int written;
+	if (op && strcmp(op, "det") == 0) {
+		char buffer[CALC_FORMAT_BUFFER_SIZE];
+		calc_format_double(buffer, determinant, NULL);
+		written = fprintf(out, "%s\n", buffer) > 0;
+	} else {
+		written = calc_matrix_write_csv(result, out);
+	}
+	if (out != stdout && fclose(out) != 0) {
+		written = 0;
+	}
+	if (!written) {
+		fprintf(stderr, "%s: cannot write the result\n", argv0);
+		return 1;
+	}
+	
+	fprintf(stderr, "%s: %zux%zu %s in %.3f s", name, a->rows, a->cols, op ? op : "copy", elapsed);
+	if (op && op[0] == '@' && !scalar && elapsed > 0) {
+		fprintf(stderr, ", %.2f GFLOP/s on %d threads", 2.0 * a->rows * a->cols * b->cols / elapsed / 1e9,
+			calc_matrix_threads());
+	}
+	fprintf(stderr, "\n");
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	const char* out_path = NULL;
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+		if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+			int threads = atoi(argv[++arg]);
+			if (threads < 1) {
+				usage(argv[0]);
+				return 2;
+			}
+			calc_matrix_set_threads(threads);
+		} else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+			out_path = argv[++arg];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	int operands = argc - arg;
+	const char* op = operands >= 2 ? argv[arg + 1] : NULL;
+	int unary = op && (strcmp(op, "T") == 0 || strcmp(op, "det") == 0 || strcmp(op, "inv") == 0);
+	int binary = op && strlen(op) == 1 && strchr("+-*/^@\\", op[0]) != NULL;
+	if (!(operands == 1 || (operands == 2 && unary) || (operands == 3 && binary))) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	calc_matrix a, b, result;
+	calc_matrix_init(&a);
+	calc_matrix_init(&b);
+	calc_matrix_init(&result);
+	double scalar = 0;
+	int is_scalar = binary && calc_stats_parse_number(argv[arg + 2], strlen(argv[arg + 2]), &scalar);
+	int status = 1;
+	if (load_matrix(argv[arg], &a) && (!binary || is_scalar || load_matrix(argv[arg + 2], &b))) {
+		status = run(argv[0], argv[arg], op, out_path, &a, &b, is_scalar ? &scalar : NULL, &result);
+	}
+	calc_matrix_free(&a);
+	calc_matrix_free(&b);
+	calc_matrix_free(&result);
+	return status;
+}
@@ -0,0 +1,42 @@
+// Objective-C Runtime Shim - shared by calculator.c and menu-without-bundle.c
+
+#include "objc_shim.h"
+
+objc_selector_table objc_sel;
+objc_class_table objc_cls;
+
+// ============================================================================
+// Selector & Class Tables
+// ============================================================================
+
+void objc_shim_init(void) {
+#define OBJC_SHIM_SEL_INIT(field, name) objc_sel.field = sel_registerName(name);
+#define OBJC_SHIM_CLASS_INIT(name) objc_cls.name = objc_getClass(#name);
+	OBJC_SHIM_SELECTORS(OBJC_SHIM_SEL_INIT)
+	OBJC_SHIM_CLASSES(OBJC_SHIM_CLASS_INIT)
+#undef OBJC_SHIM_SEL_INIT
+#undef OBJC_SHIM_CLASS_INIT
+}
+
+// ============================================================================
+// Typed Wrappers
+// ============================================================================
+
+id cstring_to_nsstring(const char* cstr) {
+	return objc_msgSend_id_char_const((id)objc_cls.NSString, objc_sel.stringWithUTF8String, cstr);
+}
+
+// Convert NSString to C string
+const char* nsstring_to_cstring(id nsstr) {
+	return objc_msgSend_char_const(nsstr, objc_sel.UTF8String);
+}
+
+const char* get_process_name(void) {
+	id process_info = objc_msgSend_id((id)objc_cls.NSProcessInfo, objc_sel.processInfo);
+	id app_name = objc_msgSend_id(process_info, objc_sel.processName);
+	return nsstring_to_cstring(app_name);
+}
+
+id shared_application(void) {
+	return objc_msgSend_id((id)objc_cls.NSApplication, objc_sel.sharedApplication);
+}
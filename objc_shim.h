@@ -0,0 +1,235 @@
+// Objective-C Runtime Shim - shared by calculator.c and menu-without-bundle.c
+//
+// Every selector and class the apps use is resolved once by objc_shim_init()
+// into the objc_sel / objc_cls tables, so event handlers never call
+// sel_registerName or objc_getClass. Build with -DOBJC_STUB to run against the
+// counting stub runtime (objc_stub.c) instead of the Apple frameworks.
+
+#ifndef OBJC_SHIM_H
+#define OBJC_SHIM_H
+
+#ifdef OBJC_STUB
+#include "objc_stub.h"
+#else
+#include <objc/runtime.h>
+#include <objc/message.h>
+#include <CoreGraphics/CoreGraphics.h>
+
+// Exported by libobjc (they are what @autoreleasepool compiles to) but not
+// declared in the SDK headers
+void* objc_autoreleasePoolPush(void);
+void objc_autoreleasePoolPop(void* pool);
+#endif
+
+// ============================================================================
+// Type Definitions & Macros
+// ============================================================================
+
+#ifdef __arm64__
+#define abi_objc_msgSend_stret objc_msgSend
+#define abi_objc_msgSend_fpret objc_msgSend
+#else
+#define abi_objc_msgSend_stret objc_msgSend_stret
+#define abi_objc_msgSend_fpret objc_msgSend_fpret
+#endif
+
+typedef CGRect NSRect;
+typedef CGPoint NSPoint;
+typedef CGSize NSSize;
+
+typedef void NSApplication;
+typedef void NSWindow;
+typedef void NSView;
+typedef void NSButton;
+typedef void NSTextField;
+typedef void NSEvent;
+typedef void NSString;
+
+#ifndef NSUInteger
+typedef unsigned long NSUInteger;
+typedef long NSInteger;
+#endif
+
+#define NS_ENUM(type, name) type name; enum
+
+typedef NS_ENUM(NSUInteger, NSWindowStyleMask) {
+	NSWindowStyleMaskBorderless = 0,
+	NSWindowStyleMaskTitled = 1 << 0,
+	NSWindowStyleMaskClosable = 1 << 1,
+	NSWindowStyleMaskMiniaturizable = 1 << 2,
+	NSWindowStyleMaskResizable = 1 << 3,
+};
+
+typedef NS_ENUM(NSUInteger, NSBackingStoreType) {
+	NSBackingStoreBuffered = 2
+};
+
+typedef NS_ENUM(NSUInteger, NSTextAlignment) {
+	NSTextAlignmentRight = 2,
+};
+
+typedef NS_ENUM(NSUInteger, NSEventModifierFlags) {
+	NSEventModifierFlagShift = 1 << 17,
+	NSEventModifierFlagControl = 1 << 18,
+	NSEventModifierFlagOption = 1 << 19,
+	NSEventModifierFlagCommand = 1 << 20,
+};
+
+// objc_msgSend macros
+#define objc_msgSend_id				((id (*)(id, SEL))objc_msgSend)
+#define objc_msgSend_id_id			((id (*)(id, SEL, id))objc_msgSend)
+#define objc_msgSend_id_rect		((id (*)(id, SEL, NSRect))objc_msgSend)
+#define objc_msgSend_uint			((NSUInteger (*)(id, SEL))objc_msgSend)
+#define objc_msgSend_int			((NSInteger (*)(id, SEL))objc_msgSend)
+#define objc_msgSend_ushort			((unsigned short (*)(id, SEL))objc_msgSend)
+#define objc_msgSend_SEL			((SEL (*)(id, SEL))objc_msgSend)
+#define objc_msgSend_float			((CGFloat (*)(id, SEL))abi_objc_msgSend_fpret)
+#define objc_msgSend_bool			((BOOL (*)(id, SEL))objc_msgSend)
+#define objc_msgSend_void			((void (*)(id, SEL))objc_msgSend)
+#define objc_msgSend_void_id		((void (*)(id, SEL, id))objc_msgSend)
+#define objc_msgSend_void_uint		((void (*)(id, SEL, NSUInteger))objc_msgSend)
+#define objc_msgSend_void_int		((void (*)(id, SEL, NSInteger))objc_msgSend)
+#define objc_msgSend_void_bool		((void (*)(id, SEL, BOOL))objc_msgSend)
+#define objc_msgSend_void_float		((void (*)(id, SEL, CGFloat))objc_msgSend)
+#define objc_msgSend_void_double	((void (*)(id, SEL, double))objc_msgSend)
+#define objc_msgSend_void_size		((void (*)(id, SEL, NSSize))objc_msgSend)
+#define objc_msgSend_void_SEL		((void (*)(id, SEL, SEL))objc_msgSend)
+#define objc_msgSend_id_char_const	((id (*)(id, SEL, const char *))objc_msgSend)
+#define objc_msgSend_char_const		((const char* (*)(id, SEL))objc_msgSend)
+#define objc_msgSend_void_id_id		((void (*)(id, SEL, id, id))objc_msgSend)
+#define objc_msgSend_id_id_SEL_id	((id (*)(id, SEL, id, SEL, id))objc_msgSend)
+#define objc_msgSend_void_SEL_id_double	((void (*)(id, SEL, SEL, id, double))objc_msgSend)
+#define objc_msgSend_id_size		((id (*)(id, SEL, NSSize))objc_msgSend)
+#define objc_msgSend_ptr			((void* (*)(id, SEL))objc_msgSend)
+
+#define NSAlloc(nsclass) objc_msgSend_id((id)nsclass, objc_sel.alloc)
+#define NSRelease(obj) objc_msgSend_id((id)obj, objc_sel.release)
+
+// ============================================================================
+// Selector & Class Tables
+// ============================================================================
+
+// X(field, selector name)
+#define OBJC_SHIM_SELECTORS(X) \
+	X(alloc, "alloc") \
+	X(init, "init") \
+	X(release, "release") \
+	X(stringWithUTF8String, "stringWithUTF8String:") \
+	X(UTF8String, "UTF8String") \
+	X(processInfo, "processInfo") \
+	X(processName, "processName") \
+	X(sharedApplication, "sharedApplication") \
+	X(setActivationPolicy, "setActivationPolicy:") \
+	X(activateIgnoringOtherApps, "activateIgnoringOtherApps:") \
+	X(setDelegate, "setDelegate:") \
+	X(setMainMenu, "setMainMenu:") \
+	X(finishLaunching, "finishLaunching") \
+	X(run, "run") \
+	X(terminate, "terminate:") \
+	X(initWithTitle, "initWithTitle:action:keyEquivalent:") \
+	X(addItem, "addItem:") \
+	X(setSubmenu, "setSubmenu:") \
+	X(initWithContentRect, "initWithContentRect:styleMask:backing:defer:") \
+	X(initWithFrame, "initWithFrame:") \
+	X(setTitle, "setTitle:") \
+	X(title, "title") \
+	X(setReleasedWhenClosed, "setReleasedWhenClosed:") \
+	X(contentView, "contentView") \
+	X(addSubview, "addSubview:") \
+	X(makeKeyAndOrderFront, "makeKeyAndOrderFront:") \
+	X(setStringValue, "setStringValue:") \
+	X(stringValue, "stringValue") \
+	X(setAlignment, "setAlignment:") \
+	X(setEditable, "setEditable:") \
+	X(setSelectable, "setSelectable:") \
+	X(setTarget, "setTarget:") \
+	X(setAction, "setAction:") \
+	X(setTag, "setTag:") \
+	X(setHidden, "setHidden:") \
+	X(setContentSize, "setContentSize:") \
+	X(tag, "tag") \
+	X(keyDown, "keyDown:") \
+	X(keyCode, "keyCode") \
+	X(modifierFlags, "modifierFlags") \
+	X(applicationDidFinishLaunching, "applicationDidFinishLaunching:") \
+	X(windowShouldClose, "windowShouldClose:") \
+	X(buttonClicked, "buttonClicked:") \
+	X(flushDisplay, "flushDisplay:") \
+	X(firstFrameShown, "firstFrameShown:") \
+	X(performSelectorAfterDelay, "performSelector:withObject:afterDelay:") \
+	X(precisionSelected, "precisionSelected:") \
+	X(inputModeSelected, "inputModeSelected:") \
+	X(viewModeSelected, "viewModeSelected:") \
+	X(wordSizeSelected, "wordSizeSelected:") \
+	X(radixSelected, "radixSelected:") \
+	X(rationalModeSelected, "rationalModeSelected:") \
+	X(graphButtonClicked, "graphButtonClicked:") \
+	X(graphFunctionEntered, "graphFunctionEntered:") \
+	X(matrixEntered, "matrixEntered:") \
+	X(initWithBitmapDataPlanes, "initWithBitmapDataPlanes:pixelsWide:pixelsHigh:bitsPerSample:" \
+		"samplesPerPixel:hasAlpha:isPlanar:colorSpaceName:bytesPerRow:bitsPerPixel:") \
+	X(bitmapData, "bitmapData") \
+	X(initWithSize, "initWithSize:") \
+	X(addRepresentation, "addRepresentation:") \
+	X(setImage, "setImage:") \
+	X(initWithIdentifier, "initWithIdentifier:") \
+	X(setWidth, "setWidth:") \
+	X(addTableColumn, "addTableColumn:") \
+	X(setDataSource, "setDataSource:") \
+	X(setDocumentView, "setDocumentView:") \
+	X(setHasVerticalScroller, "setHasVerticalScroller:") \
+	X(reloadData, "reloadData") \
+	X(scrollRowToVisible, "scrollRowToVisible:") \
+	X(numberOfRowsInTableView, "numberOfRowsInTableView:") \
+	X(objectValueForTableColumn, "tableView:objectValueForTableColumn:row:") \
+	X(setObjectValueForTableColumn, "tableView:setObjectValue:forTableColumn:row:")
+
+// X(class name)
+#define OBJC_SHIM_CLASSES(X) \
+	X(NSObject) \
+	X(NSString) \
+	X(NSProcessInfo) \
+	X(NSApplication) \
+	X(NSMenu) \
+	X(NSMenuItem) \
+	X(NSWindow) \
+	X(NSView) \
+	X(NSTextField) \
+	X(NSButton) \
+	X(NSImageView) \
+	X(NSImage) \
+	X(NSBitmapImageRep) \
+	X(NSScrollView) \
+	X(NSTableView) \
+	X(NSTableColumn)
+
+#define OBJC_SHIM_SEL_FIELD(field, name) SEL field;
+#define OBJC_SHIM_CLASS_FIELD(name) Class name;
+
+typedef struct objc_selector_table {
+	OBJC_SHIM_SELECTORS(OBJC_SHIM_SEL_FIELD)
+} objc_selector_table;
+
+typedef struct objc_class_table {
+	OBJC_SHIM_CLASSES(OBJC_SHIM_CLASS_FIELD)
+} objc_class_table;
+
+extern objc_selector_table objc_sel;
+extern objc_class_table objc_cls;
+
+// Resolve every selector and class; call once at the top of main()
+void objc_shim_init(void);
+
+// ============================================================================
+// Typed Wrappers
+// ============================================================================
+
+id cstring_to_nsstring(const char* cstr);
+const char* nsstring_to_cstring(id nsstr);
+
+// Get the app's process name (executable name)
+const char* get_process_name(void);
+
+id shared_application(void);
+
+#endif
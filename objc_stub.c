@@ -0,0 +1,462 @@
+// Stub Objective-C Runtime - a Linux-buildable stand-in for libobjc + AppKit
+
+#include "objc_stub.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+objc_stub_counters objc_stub_stats;
+
+// ============================================================================
+// Selectors
+// ============================================================================
+
+// Messages the stub gives behaviour to: X(kind, selector name). Any other
+// selector starting with "init" returns self; the rest are counted and ignored.
+#define STUB_MESSAGES(X) \
+	X(ALLOC, "alloc") \
+	X(INIT_WITH_TITLE, "initWithTitle:action:keyEquivalent:") \
+	X(INIT_WITH_UTF8_STRING, "initWithUTF8String:") \
+	X(STRING_WITH_UTF8_STRING, "stringWithUTF8String:") \
+	X(UTF8_STRING, "UTF8String") \
+	X(SHARED_APPLICATION, "sharedApplication") \
+	X(PROCESS_INFO, "processInfo") \
+	X(PROCESS_NAME, "processName") \
+	X(TITLE, "title") \
+	X(SET_TITLE, "setTitle:") \
+	X(STRING_VALUE, "stringValue") \
+	X(SET_STRING_VALUE, "setStringValue:") \
+	X(TAG, "tag") \
+	X(SET_TAG, "setTag:") \
+	X(KEY_CODE, "keyCode") \
+	X(MODIFIER_FLAGS, "modifierFlags") \
+	X(DELEGATE, "delegate") \
+	X(SET_DELEGATE, "setDelegate:") \
+	X(TARGET, "target") \
+	X(SET_TARGET, "setTarget:") \
+	X(ACTION, "action") \
+	X(SET_ACTION, "setAction:") \
+	X(SET_SUBMENU, "setSubmenu:") \
+	X(CONTENT_VIEW, "contentView") \
+	X(ADD_SUBVIEW, "addSubview:") \
+	X(ADD_ITEM, "addItem:") \
+	X(FINISH_LAUNCHING, "finishLaunching") \
+	X(PERFORM_SELECTOR_AFTER_DELAY, "performSelector:withObject:afterDelay:")
+
+#define STUB_MESSAGE_KIND(kind, name) STUB_##kind,
+#define STUB_MESSAGE_NAME(kind, name) name,
+
+typedef enum stub_message {
+	STUB_OTHER,
+	STUB_INIT,
+	STUB_MESSAGES(STUB_MESSAGE_KIND)
+	STUB_MESSAGE_COUNT
+} stub_message;
+
+static const char* const stub_message_names[] = {
+	NULL, NULL, STUB_MESSAGES(STUB_MESSAGE_NAME)
+};
+
+// A SEL points at its interned entry, which also counts how often it is sent
+// and records which stub behaviour it has, so sending never compares names
+struct objc_selector {
+	const char* name;
+	unsigned long sent;
+	stub_message kind;
+	struct objc_selector* next;
+};
+
+static struct objc_selector* selectors = NULL;
+
+static stub_message classify_selector(const char* name) {
+	for (int kind = STUB_INIT + 1; kind < STUB_MESSAGE_COUNT; kind++) {
+		if (strcmp(stub_message_names[kind], name) == 0) {
+			return (stub_message)kind;
+		}
+	}
+	return strncmp(name, "init", 4) == 0 ? STUB_INIT : STUB_OTHER;
+}
+
+static struct objc_selector* intern_selector(const char* name) {
+	for (struct objc_selector* s = selectors; s; s = s->next) {
+		if (strcmp(s->name, name) == 0) {
+			return s;
+		}
+	}
+	struct objc_selector* s = calloc(1, sizeof(*s));
+	s->name = strdup(name);
+	s->kind = classify_selector(name);
+	s->next = selectors;
+	selectors = s;
+	return s;
+}
+
+SEL sel_registerName(const char* name) {
+	objc_stub_stats.selector_lookups++;
+	return intern_selector(name);
+}
+
+const char* sel_getName(SEL sel) {
+	return sel->name;
+}
+
+unsigned long objc_stub_sent(const char* selector_name) {
+	return intern_selector(selector_name)->sent;
+}
+
+// ============================================================================
+// Classes and Objects
+// ============================================================================
+
+typedef struct stub_method {
+	SEL name;
+	IMP imp;
+	struct stub_method* next;
+} stub_method;
+
+// Classes are objects too: their isa is the shared stub metaclass
+struct objc_class {
+	Class isa;
+	const char* name;
+	Class superclass;
+	stub_method* methods;
+	struct objc_class* next;
+};
+
+#define STUB_MAX_SUBVIEWS 64
+
+// Every stub object carries the state any of the stubbed AppKit classes needs
+struct objc_object {
+	Class isa;
+	char* text;       // NSString contents
+	id title;         // Buttons, windows, menu items
+	id string_value;  // Text fields
+	id delegate;
+	id target;
+	SEL action;
+	long tag;
+	id content_view;
+	id submenu;
+	id subviews[STUB_MAX_SUBVIEWS];
+	size_t subview_count;
+	unsigned short key_code;        // Key events
+	unsigned long modifier_flags;
+};
+
+static Class classes = NULL;
+static struct objc_class metaclass = {NULL, "metaclass", NULL, NULL, NULL};
+
+static Class find_class(const char* name) {
+	for (Class c = classes; c; c = c->next) {
+		if (strcmp(c->name, name) == 0) {
+			return c;
+		}
+	}
+	return NULL;
+}
+
+static Class new_class(Class superclass, const char* name) {
+	Class c = calloc(1, sizeof(*c));
+	c->isa = &metaclass;
+	c->name = strdup(name);
+	c->superclass = superclass;
+	c->next = classes;
+	classes = c;
+	return c;
+}
+
+// Framework classes spring into existence on first lookup
+static Class stub_class(const char* name) {
+	Class c = find_class(name);
+	return c ? c : new_class(NULL, name);
+}
+
+Class objc_getClass(const char* name) {
+	objc_stub_stats.class_lookups++;
+	return stub_class(name);
+}
+
+Class objc_allocateClassPair(Class superclass, const char* name, size_t extra_bytes) {
+	(void)extra_bytes;
+	return find_class(name) ? NULL : new_class(superclass, name);
+}
+
+void objc_registerClassPair(Class cls) {
+	(void)cls;
+}
+
+BOOL class_addMethod(Class cls, SEL name, IMP imp, const char* types) {
+	(void)types;
+	stub_method* m = calloc(1, sizeof(*m));
+	m->name = name;
+	m->imp = imp;
+	m->next = cls->methods;
+	cls->methods = m;
+	return YES;
+}
+
+static IMP find_method(Class cls, SEL name) {
+	for (; cls; cls = cls->superclass) {
+		for (stub_method* m = cls->methods; m; m = m->next) {
+			if (m->name == name) {
+				return m->imp;
+			}
+		}
+	}
+	return NULL;
+}
+
+static id new_object(Class cls) {
+	objc_stub_stats.allocations++;
+	id object = calloc(1, sizeof(*object));
+	object->isa = cls;
+	return object;
+}
+
+static id new_string(const char* text) {
+	id string = new_object(stub_class("NSString"));
+	string->text = strdup(text ? text : "");
+	return string;
+}
+
+// Objects are never freed: the stub only lives for one benchmark run
+static id singleton(id* slot, const char* class_name) {
+	if (!*slot) {
+		*slot = new_object(stub_class(class_name));
+	}
+	return *slot;
+}
+
+const char* objc_stub_text(id object) {
+	if (!object) {
+		return NULL;
+	}
+	if (object->text) {
+		return object->text;
+	}
+	return object->string_value ? object->string_value->text : NULL;
+}
+
+id objc_stub_key_event(unsigned short key_code, unsigned long modifier_flags) {
+	id event = new_object(stub_class("NSEvent"));
+	event->key_code = key_code;
+	event->modifier_flags = modifier_flags;
+	return event;
+}
+
+size_t objc_stub_subviews(id view, id* subviews, size_t max_subviews) {
+	size_t count = view->subview_count < max_subviews ? view->subview_count : max_subviews;
+	memcpy(subviews, view->subviews, count * sizeof(id));
+	return count;
+}
+
+void objc_stub_reset_counters(void) {
+	memset(&objc_stub_stats, 0, sizeof(objc_stub_stats));
+	for (struct objc_selector* s = selectors; s; s = s->next) {
+		s->sent = 0;
+	}
+}
+
+// ============================================================================
+// Run Loop & Autorelease Pools
+// ============================================================================
+
+#define STUB_MAX_PENDING 64
+
+typedef struct {
+	id target;
+	SEL selector;
+	id object;
+} stub_perform;
+
+static stub_perform pending[STUB_MAX_PENDING];
+static size_t pending_count = 0;
+
+// Objects are never freed, so a pool only needs to be counted
+void* objc_autoreleasePoolPush(void) {
+	objc_stub_stats.autorelease_pools++;
+	return &pending_count;
+}
+
+void objc_autoreleasePoolPop(void* pool) {
+	(void)pool;
+}
+
+// ============================================================================
+// Messaging
+// ============================================================================
+
+static int count_arguments(SEL op) {
+	int count = 0;
+	for (const char* p = op->name; *p; p++) {
+		count += *p == ':';
+	}
+	return count;
+}
+
+// Only object-, selector- and integer-sized arguments are ever read back, and
+// only for the selectors that take nothing else
+static id stub_msgSend(id self, SEL op, ...) {
+	objc_stub_stats.messages++;
+	((struct objc_selector*)op)->sent++;
+	if (!self) {
+		return nil;
+	}
+	
+	va_list args;
+	va_start(args, op);
+	id result = nil;
+	
+	// Methods added with class_addMethod take object arguments
+	IMP imp = find_method(self->isa, op);
+	if (imp) {
+		int argc = count_arguments(op);
+		id a = argc > 0 ? va_arg(args, id) : nil;
+		id b = argc > 1 ? va_arg(args, id) : nil;
+		result = ((id (*)(id, SEL, id, id))imp)(self, op, a, b);
+		va_end(args);
+		return result;
+	}
+	
+	static id shared_application = NULL;
+	static id process_info = NULL;
+	
+	switch (op->kind) {
+		case STUB_ALLOC:
+			result = new_object((Class)self);
+			break;
+		case STUB_INIT:
+			result = self;
+			break;
+		case STUB_INIT_WITH_TITLE:
+			self->title = va_arg(args, id);
+			self->action = va_arg(args, SEL);
+			result = self;
+			break;
+		case STUB_INIT_WITH_UTF8_STRING:
+			self->text = strdup(va_arg(args, const char*));
+			result = self;
+			break;
+		case STUB_STRING_WITH_UTF8_STRING:
+			result = new_string(va_arg(args, const char*));
+			break;
+		case STUB_UTF8_STRING:
+			result = (id)self->text;
+			break;
+		case STUB_SHARED_APPLICATION:
+			result = singleton(&shared_application, "NSApplication");
+			break;
+		case STUB_PROCESS_INFO:
+			result = singleton(&process_info, "NSProcessInfo");
+			break;
+		case STUB_PROCESS_NAME:
+			result = new_string("calculator");
+			break;
+		case STUB_TITLE:
+			result = self->title;
+			break;
+		case STUB_SET_TITLE:
+			self->title = va_arg(args, id);
+			break;
+		case STUB_STRING_VALUE:
+			result = self->string_value;
+			break;
+		case STUB_SET_STRING_VALUE:
+			self->string_value = va_arg(args, id);
+			break;
+		case STUB_TAG:
+			result = (id)self->tag;
+			break;
+		case STUB_SET_TAG:
+			self->tag = va_arg(args, long);
+			break;
+		case STUB_KEY_CODE:
+			result = (id)(size_t)self->key_code;
+			break;
+		case STUB_MODIFIER_FLAGS:
+			result = (id)self->modifier_flags;
+			break;
+		case STUB_DELEGATE:
+			result = self->delegate;
+			break;
+		case STUB_SET_DELEGATE:
+			self->delegate = va_arg(args, id);
+			break;
+		case STUB_TARGET:
+			result = self->target;
+			break;
+		case STUB_SET_TARGET:
+			self->target = va_arg(args, id);
+			break;
+		case STUB_ACTION:
+			result = (id)self->action;
+			break;
+		case STUB_SET_ACTION:
+			self->action = va_arg(args, SEL);
+			break;
+		case STUB_SET_SUBMENU:
+			self->submenu = va_arg(args, id);
+			break;
+		case STUB_CONTENT_VIEW:
+			if (!self->content_view) {
+				self->content_view = new_object(stub_class("NSView"));
+			}
+			result = self->content_view;
+			break;
+		case STUB_ADD_SUBVIEW:
+		case STUB_ADD_ITEM: {
+			id subview = va_arg(args, id);
+			if (self->subview_count < STUB_MAX_SUBVIEWS) {
+				self->subviews[self->subview_count++] = subview;
+			}
+			break;
+		}
+		case STUB_FINISH_LAUNCHING: {
+			// Deliver applicationDidFinishLaunching: like NSApplication does
+			SEL did_finish = intern_selector("applicationDidFinishLaunching:");
+			if (self->delegate && find_method(self->delegate->isa, did_finish)) {
+				stub_msgSend(self->delegate, did_finish, nil);
+			}
+			break;
+		}
+		case STUB_PERFORM_SELECTOR_AFTER_DELAY: {
+			// The delay is not read: every perform waits for the next objc_stub_run_loop
+			SEL selector = va_arg(args, SEL);
+			id object = va_arg(args, id);
+			if (pending_count < STUB_MAX_PENDING) {
+				pending[pending_count++] = (stub_perform){self, selector, object};
+			}
+			break;
+		}
+		default:
+			break;
+	}
+	
+	va_end(args);
+	return result;
+}
+
+size_t objc_stub_run_loop(void) {
+	stub_perform due[STUB_MAX_PENDING];
+	size_t count = pending_count;
+	memcpy(due, pending, count * sizeof(stub_perform));
+	pending_count = 0;
+	for (size_t i = 0; i < count; i++) {
+		stub_msgSend(due[i].target, due[i].selector, due[i].object);
+	}
+	return count;
+}
+
+static double stub_msgSend_fpret(id self, SEL op, ...) {
+	stub_msgSend(self, op);
+	return 0.0;
+}
+
+static void stub_msgSend_stret(void* result, id self, SEL op, ...) {
+	(void)result;
+	stub_msgSend(self, op);
+}
+
+void (*const objc_msgSend)(void) = (void (*)(void))stub_msgSend;
+void (*const objc_msgSend_fpret)(void) = (void (*)(void))stub_msgSend_fpret;
+void (*const objc_msgSend_stret)(void) = (void (*)(void))stub_msgSend_stret;
@@ -0,0 +1,83 @@
+// Stub Objective-C Runtime - a Linux-buildable stand-in for libobjc + AppKit
+// Build with -DOBJC_STUB and link objc_stub.c instead of the Apple frameworks.
+//
+// Objects are plain C structs and only the handful of messages the calculator
+// depends on have behaviour; everything is counted so headless benchmarks can
+// check how much runtime traffic each keystroke causes.
+
+#ifndef OBJC_STUB_H
+#define OBJC_STUB_H
+
+#include <stddef.h>
+
+// ============================================================================
+// Runtime Types
+// ============================================================================
+
+typedef struct objc_class* Class;
+typedef struct objc_object* id;
+typedef const struct objc_selector* SEL;
+typedef signed char BOOL;
+typedef void (*IMP)(void);
+
+#define YES ((BOOL)1)
+#define NO ((BOOL)0)
+#define nil ((id)0)
+
+typedef double CGFloat;
+typedef struct { CGFloat x, y; } CGPoint;
+typedef struct { CGFloat width, height; } CGSize;
+typedef struct { CGPoint origin; CGSize size; } CGRect;
+
+// ============================================================================
+// Runtime API
+// ============================================================================
+
+Class objc_getClass(const char* name);
+SEL sel_registerName(const char* name);
+const char* sel_getName(SEL sel);
+Class objc_allocateClassPair(Class superclass, const char* name, size_t extra_bytes);
+void objc_registerClassPair(Class cls);
+BOOL class_addMethod(Class cls, SEL name, IMP imp, const char* types);
+
+void* objc_autoreleasePoolPush(void);
+void objc_autoreleasePoolPop(void* pool);
+
+// Like the Apple SDK these are untyped and must be cast to the method's type
+extern void (*const objc_msgSend)(void);
+extern void (*const objc_msgSend_fpret)(void);
+extern void (*const objc_msgSend_stret)(void);
+
+// ============================================================================
+// Stub Inspection
+// ============================================================================
+
+typedef struct objc_stub_counters {
+	unsigned long messages;          // objc_msgSend calls
+	unsigned long selector_lookups;  // sel_registerName calls
+	unsigned long class_lookups;     // objc_getClass calls
+	unsigned long allocations;       // Objects created (alloc and string factories)
+	unsigned long autorelease_pools; // objc_autoreleasePoolPush calls
+} objc_stub_counters;
+
+extern objc_stub_counters objc_stub_stats;
+
+void objc_stub_reset_counters(void);
+
+// Number of times a selector has been sent since the last reset
+unsigned long objc_stub_sent(const char* selector_name);
+
+// Text held by a stub NSString, or the string value of a control
+const char* objc_stub_text(id object);
+
+// Run one run-loop cycle: deliver every performSelector:withObject:afterDelay:
+// queued before the call, and return how many were delivered
+size_t objc_stub_run_loop(void);
+
+// A key-down NSEvent, as AppKit would pass to keyDown:
+id objc_stub_key_event(unsigned short key_code, unsigned long modifier_flags);
+
+// Subviews added to a view with addSubview:, in order
+size_t objc_stub_subviews(id view, id* subviews, size_t max_subviews);
+
+#endif
@@ -0,0 +1,333 @@
+// Keystroke Replay Driver - runs calculator keystroke files through the engine
+// Compile with: gcc -O2 -pthread -o calc-replay replay.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// A keystroke file holds calculator keys ('0'-'9', '.', '+', '-', '*', '/', '^', '(', ')', '=')
+// function keys (calc_function_key, e.g. 'r' for sqrt, 's' for sin, '%') and the
+// statistics keys 'D' 'M' 'V' 'K', the matrix keys (which see only numbers here,
+// as a file cannot load a matrix), or with -i or -u the integer-mode keys
+// (calc_handle_key).
+// Whitespace is ignored and '#' starts a comment that runs to the end of the line.
+// With -t the files are session tapes (calc_tape.h) instead, replayed in place.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calc_cache.h"
+#include "calc_engine.h"
+#include "calc_tape.h"
+#include "calc_latency.h"
+
+// ============================================================================
+// Keystroke Loading
+// ============================================================================
+
+typedef struct {
+	char* keys;
+	size_t count;
+} keystrokes;
+
+// Read a keystroke file, keeping only calculator keys
+static int load_keystrokes(const char* path, keystrokes* out) {
+	FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return 0;
+	}
+	
+	size_t capacity = 4096;
+	out->keys = malloc(capacity);
+	out->count = 0;
+	
+	int c;
+	while ((c = fgetc(file)) != EOF) {
+		if (c == '#') {
+			// Skip comment to end of line
+			while ((c = fgetc(file)) != EOF && c != '\n') {}
+			continue;
+		}
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			continue;
+		}
+		if (!strchr("0123456789ABCDEFabcdef.+-*/%^&|<>[]~PLZMVK()=@\\'i", c) && calc_key_function((char)c) < 0) {
+			fprintf(stderr, "%s: unknown key '%c'\n", path, c);
+			if (file != stdin) fclose(file);
+			free(out->keys);
+			return 0;
+		}
+		if (out->count == capacity) {
+			capacity *= 2;
+			out->keys = realloc(out->keys, capacity);
+		}
+		out->keys[out->count++] = (char)c;
+	}
+	
+	if (file != stdin) fclose(file);
+	return 1;
+}
+
+// ============================================================================
+// Display Sinks
+// ============================================================================
+
+// Keeps the last display text so it can be reported after a replay
+typedef struct {
+	char* text;
+	size_t size;
+	int echo;
+} replay_display;
+
+static void replay_update_display(void* ctx, const char* text) {
+	replay_display* display = ctx;
+	size_t length = strlen(text);
+	if (length >= display->size) {
+		// Decimal mode can show hundreds of digits
+		display->size = length + 1;
+		display->text = realloc(display->text, display->size);
+	}
+	memcpy(display->text, text, length + 1);
+	if (display->echo) {
+		printf("%s\n", text);
+	}
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ============================================================================
+// Tapes
+// ============================================================================
+
+// Replay a session tape; fails if the engine no longer reproduces it
+static int replay_tape(const char* path, const calc_format_options* format, long iterations, int echo) {
+	calc_tape_reader tape;
+	if (!calc_tape_map(&tape, path)) {
+		return 0;
+	}
+	
+	replay_display display = {strdup("0"), 2, echo};
+	calc_engine engine;
+	calc_engine_init(&engine, replay_update_display, &display);
+	engine.format = format;
+	size_t mismatches = calc_tape_replay(&tape, &engine);
+	calc_engine_free(&engine);
+	display.echo = 0;
+	char* final_text = strdup(display.text);
+	
+	double start = now_seconds();
+	for (long iter = 0; iter < iterations; iter++) {
+		calc_engine_init(&engine, replay_update_display, &display);
+		engine.format = format;
+		calc_tape_replay(&tape, &engine);
+		calc_engine_free(&engine);
+	}
+	double elapsed = now_seconds() - start;
+	
+	double total = (double)tape.count * iterations;
+	printf("%s: %s\n", path, final_text);
+	if (mismatches) {
+		printf("%s: %zu of %zu events did not reproduce the recorded value\n", path, mismatches, tape.count);
+	}
+	fprintf(stderr, "%s: %.0f events in %.6f s, %.0f events/sec, %.1f ns/event\n",
+		path, total, elapsed,
+		elapsed > 0 ? total / elapsed : 0.0,
+		total > 0 ? elapsed * 1e9 / total : 0.0);
+	
+	free(final_text);
+	free(display.text);
+	calc_tape_unmap(&tape);
+	return mismatches == 0;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [-n iterations] [-v] [-g digits] [-f sci|eng] [-P digits] [-e] [-i|-u bits] [-r radix] [-x fraction|decimal] [-m MiB] [-w tape | -t] [-L json] file...\n", argv0);
+	fprintf(stderr, "  -n N   replay each file N times for timing (default 1), each from an empty result cache\n");
+	fprintf(stderr, "  -v     print every display update of the first pass\n");
+	fprintf(stderr, "  -g N   show N significant digits (default: shortest round-trip)\n");
+	fprintf(stderr, "  -f     scientific or engineering notation\n");
+	fprintf(stderr, "  -P N   exact decimal arithmetic rounded to N significant digits\n");
+	fprintf(stderr, "  -e     expression mode: operator precedence and parentheses\n");
+	fprintf(stderr, "  -i N   integer mode with signed N-bit words (8, 16, 32, 64 or 128); -u unsigned\n");
+	fprintf(stderr, "  -r N   integer-mode radix: 2, 8, 10 (default) or 16\n");
+	fprintf(stderr, "  -x S   exact rational arithmetic, shown as a fraction or a decimal\n");
+	fprintf(stderr, "  -m N   result cache for costly decimal and rational operations, in MiB (default 16, 0 = off);\n");
+	fprintf(stderr, "         the statistics printed at the end cover the last timed pass\n");
+	fprintf(stderr, "  -w F   append the first pass of every file to session tape F\n");
+	fprintf(stderr, "  -t     the files are session tapes: replay them and check each value\n");
+	fprintf(stderr, "  -L F   time every keystroke and write latency histograms to F as JSON\n");
+	fprintf(stderr, "  Use '-' to read keystrokes from stdin.\n");
+}
+
+int main(int argc, char* argv[]) {
+	long iterations = 1;
+	int echo = 0;
+	int first_file = 1;
+	long precision = 0;
+	int expression_mode = 0;
+	int int_bits = 0;
+	int int_signed = 0;
+	int radix = 10;
+	int rational = 0;
+	int tapes = 0;
+	const char* tape_path = NULL;
+	const char* latency_path = NULL;
+	calc_format_options format = calc_format_default;
+	
+	for (; first_file < argc && argv[first_file][0] == '-' && argv[first_file][1] != '\0'; first_file++) {
+		if (strcmp(argv[first_file], "-n") == 0 && first_file + 1 < argc) {
+			iterations = atol(argv[++first_file]);
+		} else if (strcmp(argv[first_file], "-v") == 0) {
+			echo = 1;
+		} else if (strcmp(argv[first_file], "-g") == 0 && first_file + 1 < argc) {
+			format.significant_digits = atoi(argv[++first_file]);
+		} else if (strcmp(argv[first_file], "-f") == 0 && first_file + 1 < argc) {
+			const char* notation = argv[++first_file];
+			format.notation = strcmp(notation, "eng") == 0 ? CALC_NOTATION_ENGINEERING : CALC_NOTATION_SCIENTIFIC;
+		} else if (strcmp(argv[first_file], "-t") == 0) {
+			tapes = 1;
+		} else if (strcmp(argv[first_file], "-w") == 0 && first_file + 1 < argc) {
+			tape_path = argv[++first_file];
+		} else if (strcmp(argv[first_file], "-L") == 0 && first_file + 1 < argc) {
+			latency_path = argv[++first_file];
+		} else if (strcmp(argv[first_file], "-m") == 0 && first_file + 1 < argc) {
+			calc_cache_set_budget((size_t)atol(argv[++first_file]) << 20);
+		} else if (strcmp(argv[first_file], "-e") == 0) {
+			expression_mode = 1;
+		} else if (strcmp(argv[first_file], "-P") == 0 && first_file + 1 < argc) {
+			precision = atol(argv[++first_file]);
+		} else if ((strcmp(argv[first_file], "-i") == 0 || strcmp(argv[first_file], "-u") == 0) && first_file + 1 < argc) {
+			int_signed = argv[first_file][1] == 'i';
+			int_bits = atoi(argv[++first_file]);
+		} else if (strcmp(argv[first_file], "-r") == 0 && first_file + 1 < argc) {
+			radix = atoi(argv[++first_file]);
+		} else if (strcmp(argv[first_file], "-x") == 0 && first_file + 1 < argc) {
+			const char* style = argv[++first_file];
+			rational = strcmp(style, "fraction") == 0 ? CALC_RATIONAL_FRACTIONS
+				: strcmp(style, "decimal") == 0 ? CALC_RATIONAL_DECIMALS : -1;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	int valid_bits = int_bits == 0 || int_bits == 8 || int_bits == 16 || int_bits == 32 || int_bits == 64 || int_bits == 128;
+	int valid_radix = radix == 2 || radix == 8 || radix == 10 || radix == 16;
+	if (first_file >= argc || iterations < 1 || precision < 0 || !valid_bits || !valid_radix || rational < 0
+		|| (tapes && tape_path)) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	calc_tape_writer tape = {NULL};
+	if (tape_path && !calc_tape_open(&tape, tape_path)) {
+		return 1;
+	}
+	if (latency_path && !calc_latency_enable(latency_path)) {
+		return 1;
+	}
+	
+	int status = 0;
+	for (int f = first_file; f < argc; f++) {
+		if (tapes) {
+			if (!replay_tape(argv[f], &format, iterations, echo)) {
+				status = 1;
+			}
+			continue;
+		}
+		
+		keystrokes input;
+		if (!load_keystrokes(argv[f], &input)) {
+			status = 1;
+			continue;
+		}
+		
+		replay_display display = {strdup("0"), 2, echo};
+		calc_engine engine;
+		
+		// First pass produces the reported display and optional echo
+		calc_engine_init(&engine, replay_update_display, &display);
+		engine.format = &format;
+		engine.precision = precision;
+		engine.expression_mode = (unsigned char)expression_mode;
+		engine.int_bits = (unsigned char)int_bits;
+		engine.int_signed = (unsigned char)int_signed;
+		engine.radix = (unsigned char)radix;
+		engine.rational = (unsigned char)rational;
+		if (tape.file) {
+			// Each file is its own session, settings first
+			if (f > first_file) {
+				calc_tape_write(&tape, CALC_TAPE_SESSION, '\0', 0, 0.0);
+			}
+			if (precision) {
+				calc_tape_write(&tape, CALC_TAPE_PRECISION, '\0', (int32_t)precision, 0.0);
+			}
+			if (expression_mode) {
+				calc_tape_write(&tape, CALC_TAPE_INPUT_MODE, '\0', 1, 0.0);
+			}
+			if (int_bits) {
+				calc_tape_write(&tape, CALC_TAPE_INTEGER_MODE, '\0', int_signed ? -int_bits : int_bits, 0.0);
+			}
+			if (radix != 10) {
+				calc_tape_write(&tape, CALC_TAPE_RADIX, '\0', radix, 0.0);
+			}
+			if (rational) {
+				calc_tape_write(&tape, CALC_TAPE_RATIONAL_MODE, '\0', rational, 0.0);
+			}
+			engine.tape = &tape;
+		}
+		for (size_t i = 0; i < input.count; i++) {
+			calc_latency_begin();
+			calc_handle_key(&engine, input.keys[i]);
+			calc_latency_end();
+		}
+		calc_engine_free(&engine);
+		display.echo = 0;
+		char* final_text = strdup(display.text);
+		
+		// Timed passes start from a fresh engine and an empty result cache
+		// each iteration, or later ones would only time hits
+		double elapsed = 0;
+		for (long iter = 0; iter < iterations; iter++) {
+			calc_cache_clear();
+			double start = now_seconds();
+			calc_engine_init(&engine, replay_update_display, &display);
+			engine.format = &format;
+			engine.precision = precision;
+			engine.expression_mode = (unsigned char)expression_mode;
+			engine.int_bits = (unsigned char)int_bits;
+			engine.int_signed = (unsigned char)int_signed;
+			engine.radix = (unsigned char)radix;
+			engine.rational = (unsigned char)rational;
+			for (size_t i = 0; i < input.count; i++) {
+				calc_latency_begin();
+				calc_handle_key(&engine, input.keys[i]);
+				calc_latency_end();
+			}
+			calc_engine_free(&engine);
+			elapsed += now_seconds() - start;
+		}
+		
+		double total = (double)input.count * iterations;
+		printf("%s: %s\n", argv[f], final_text);
+		fprintf(stderr, "%s: %.0f keystrokes in %.6f s, %.0f keystrokes/sec, %.1f ns/keystroke\n",
+			argv[f], total, elapsed,
+			elapsed > 0 ? total / elapsed : 0.0,
+			total > 0 ? elapsed * 1e9 / total : 0.0);
+		
+		free(final_text);
+		free(display.text);
+		free(input.keys);
+	}
+	
+	calc_cache_print_stats(stderr, argv[0]);
+	calc_tape_close(&tape);
+	return status;
+}
@@ -0,0 +1,440 @@
+// Calculation Server - calculator sessions over a Unix domain socket
+// Compile with: gcc -O2 -pthread -o calc-server server.c calc_session.c $ENGINE_SOURCES -lm
+//               with ENGINE_SOURCES from build.sh
+//
+// One thread runs an event loop (epoll on Linux, kqueue elsewhere) over
+// non-blocking sockets. Each connection owns a calc_session from a shared
+// pool, and requests are framed as in calc_protocol.h. A read answers every
+// complete request it brought in and the answers go out in one write; a
+// client that stops reading has its input paused once its unsent answers pass
+// OUTPUT_HIGH_WATER, instead of the server buffering without bound.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
+
+#include "calc_protocol.h"
+#include "calc_session.h"
+
+#define INPUT_INITIAL 16384
+#define OUTPUT_HIGH_WATER (256 * 1024)
+#define MAX_EVENTS 256
+
+// ============================================================================
+// Event Loop
+// ============================================================================
+
+typedef struct {
+	void* ptr;
+	unsigned char readable;   // Also set for hangups and errors, which the next read reports
+	unsigned char writable;
+} poller_event;
+
+static int poller_create(void) {
+#ifdef __linux__
+	return epoll_create1(0);
+#else
+	return kqueue();
+#endif
+}
+
+// Start (add) or change watching fd; ptr comes back in its events
+static int poller_watch(int poller, int fd, void* ptr, int read, int write, int add) {
+#ifdef __linux__
+	struct epoll_event event = {0};
+	event.events = (read ? EPOLLIN : 0) | (write ? EPOLLOUT : 0);
+	event.data.ptr = ptr;
+	return epoll_ctl(poller, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event);
+#else
+	(void)add;
+	struct kevent changes[2];
+	EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD | (read ? EV_ENABLE : EV_DISABLE), 0, 0, ptr);
+	EV_SET(&changes[1], fd, EVFILT_WRITE, EV_ADD | (write ? EV_ENABLE : EV_DISABLE), 0, 0, ptr);
+	return kevent(poller, changes, 2, NULL, 0, NULL);
+#endif
+}
+
+// Block until something is ready; returns the event count, or -1 (EINTR on a signal)
+static int poller_wait(int poller, poller_event* events, int max) {
+#ifdef __linux__
+	struct epoll_event ready[MAX_EVENTS];
+	int count = epoll_wait(poller, ready, max < MAX_EVENTS ? max : MAX_EVENTS, -1);
+	for (int i = 0; i < count; i++) {
+		events[i].ptr = ready[i].data.ptr;
+		events[i].readable = (ready[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0;
+		events[i].writable = (ready[i].events & EPOLLOUT) != 0;
+	}
+	return count;
+#else
+	struct kevent ready[MAX_EVENTS];
+	int count = kevent(poller, NULL, 0, ready, max < MAX_EVENTS ? max : MAX_EVENTS, NULL);
+	for (int i = 0; i < count; i++) {
+		events[i].ptr = ready[i].udata;
+		events[i].readable = ready[i].filter == EVFILT_READ;
+		events[i].writable = ready[i].filter == EVFILT_WRITE;
+	}
+	return count;
+#endif
+}
+
+// ============================================================================
+// Connections
+// ============================================================================
+
+typedef struct connection {
+	int fd;                      // -1 once closed; freed after the current batch of events
+	calc_session* session;
+	char* in;
+	size_t in_length;
+	size_t in_capacity;
+	char* out;
+	size_t out_start;            // Bytes before this have been written
+	size_t out_length;
+	size_t out_capacity;
+	unsigned char reading;       // What the poller is watching for
+	unsigned char writing;
+	struct connection* next_closed;
+} connection;
+
+typedef struct {
+	int poller;
+	int listener;
+	calc_session_pool sessions;
+	calc_format_options format;
+	connection* closed;
+	size_t connections;
+	size_t total_connections;
+	unsigned long long requests;
+	unsigned long long keys;
+} server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal_number) {
+	(void)signal_number;
+	stop_requested = 1;
+}
+
+static void close_connection(server* s, connection* c) {
+	close(c->fd);  // Also drops it from the poller
+	c->fd = -1;
+	calc_session_destroy(&s->sessions, c->session);
+	c->next_closed = s->closed;
+	s->closed = c;
+	s->connections--;
+}
+
+static void free_closed(server* s) {
+	while (s->closed) {
+		connection* c = s->closed;
+		s->closed = c->next_closed;
+		free(c->in);
+		free(c->out);
+		free(c);
+	}
+}
+
+static void accept_connections(server* s) {
+	for (;;) {
+		int fd = accept(s->listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+				perror("accept");
+			}
+			return;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		
+		connection* c = calloc(1, sizeof(connection));
+		calc_session* session = c ? calc_session_create(&s->sessions) : NULL;
+		char* in = session ? malloc(INPUT_INITIAL) : NULL;
+		if (!in) {
+			if (session) calc_session_destroy(&s->sessions, session);
+			free(c);
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->session = session;
+		c->in = in;
+		c->in_capacity = INPUT_INITIAL;
+		c->reading = 1;
+		if (poller_watch(s->poller, fd, c, 1, 0, 1) != 0) {
+			perror("watch");
+			calc_session_destroy(&s->sessions, session);
+			free(in);
+			free(c);
+			close(fd);
+			continue;
+		}
+		s->connections++;
+		s->total_connections++;
+	}
+}
+
+// ============================================================================
+// Requests
+// ============================================================================
+
+static int reserve_output(connection* c, size_t bytes) {
+	if (c->out_length + bytes <= c->out_capacity) {
+		return 1;
+	}
+	// Drop what has been written before growing
+	if (c->out_start > 0) {
+		memmove(c->out, c->out + c->out_start, c->out_length - c->out_start);
+		c->out_length -= c->out_start;
+		c->out_start = 0;
+		if (c->out_length + bytes <= c->out_capacity) {
+			return 1;
+		}
+	}
+	size_t capacity = c->out_capacity ? c->out_capacity * 2 : 4096;
+	while (capacity < c->out_length + bytes) {
+		capacity *= 2;
+	}
+	char* out = realloc(c->out, capacity);
+	if (!out) {
+		return 0;
+	}
+	c->out = out;
+	c->out_capacity = capacity;
+	return 1;
+}
+
+// Apply one request and queue its response; returns 0 if out of memory
+static int handle_request(server* s, connection* c, const calc_request_header* header, const char* payload) {
+	calc_response_header response = {0, CALC_RESPONSE_OK, 0};
+	switch (header->op) {
+		case CALC_REQUEST_KEYS:
+			for (uint16_t i = 0; i < header->length; i++) {
+				if (!calc_session_key(c->session, payload[i])) {
+					response.status = CALC_RESPONSE_BAD_KEY;
+					break;
+				}
+				s->keys++;
+			}
+			break;
+		case CALC_REQUEST_RESET:
+			calc_session_reset(c->session);
+			break;
+		default:
+			response.status = CALC_RESPONSE_BAD_OP;
+			break;
+	}
+	s->requests++;
+	
+	// Format straight into the output buffer, behind the header
+	if (!reserve_output(c, CALC_PROTOCOL_HEADER_SIZE + CALC_FORMAT_BUFFER_SIZE)) {
+		return 0;
+	}
+	char* at = c->out + c->out_length;
+	response.length = (uint16_t)calc_session_format(c->session, at + CALC_PROTOCOL_HEADER_SIZE, &s->format);
+	calc_response_header_encode(at, &response);
+	c->out_length += CALC_PROTOCOL_HEADER_SIZE + response.length;
+	return 1;
+}
+
+// Answer every complete request in the input buffer
+static int handle_input(server* s, connection* c) {
+	size_t offset = 0;
+	while (c->in_length - offset >= CALC_PROTOCOL_HEADER_SIZE) {
+		calc_request_header header;
+		calc_request_header_decode(&header, c->in + offset);
+		size_t frame = CALC_PROTOCOL_HEADER_SIZE + header.length;
+		if (c->in_length - offset < frame) {
+			break;
+		}
+		if (!handle_request(s, c, &header, c->in + offset + CALC_PROTOCOL_HEADER_SIZE)) {
+			return 0;
+		}
+		offset += frame;
+	}
+	
+	// Keep the partial request at the front, with room for all of it
+	memmove(c->in, c->in + offset, c->in_length - offset);
+	c->in_length -= offset;
+	if (c->in_length >= CALC_PROTOCOL_HEADER_SIZE) {
+		size_t frame = CALC_PROTOCOL_HEADER_SIZE + calc_protocol_header_length(c->in);
+		if (frame > c->in_capacity) {
+			char* in = realloc(c->in, frame);
+			if (!in) {
+				return 0;
+			}
+			c->in = in;
+			c->in_capacity = frame;
+		}
+	}
+	return 1;
+}
+
+// Write what is queued; returns 0 if the connection failed
+static int flush_output(connection* c) {
+	while (c->out_start < c->out_length) {
+		ssize_t n = send(c->fd, c->out + c->out_start, c->out_length - c->out_start, 0);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		c->out_start += (size_t)n;
+	}
+	c->out_start = 0;
+	c->out_length = 0;
+	return 1;
+}
+
+// Watch for writes while output is queued, and for reads while it is short enough
+static int update_interest(server* s, connection* c) {
+	size_t queued = c->out_length - c->out_start;
+	unsigned char reading = queued < OUTPUT_HIGH_WATER;
+	unsigned char writing = queued > 0;
+	if (reading == c->reading && writing == c->writing) {
+		return 1;
+	}
+	c->reading = reading;
+	c->writing = writing;
+	return poller_watch(s->poller, c->fd, c, reading, writing, 0) == 0;
+}
+
+static void connection_ready(server* s, connection* c, const poller_event* event) {
+	if (event->readable && c->reading) {
+		ssize_t n = recv(c->fd, c->in + c->in_length, c->in_capacity - c->in_length, 0);
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+			close_connection(s, c);
+			return;
+		}
+		if (n > 0) {
+			c->in_length += (size_t)n;
+			if (!handle_input(s, c)) {
+				close_connection(s, c);
+				return;
+			}
+		}
+	}
+	if (c->out_length > c->out_start && !flush_output(c)) {
+		close_connection(s, c);
+		return;
+	}
+	if (!update_interest(s, c)) {
+		close_connection(s, c);
+	}
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static int listen_on(const char* path) {
+	struct sockaddr_un address = {0};
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", path);
+		return -1;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	unlink(path);  // A stale socket from a previous run
+	if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [-s socket] [-g digits] [-f sci|eng]\n", argv0);
+	fprintf(stderr, "  -s F   listen on Unix socket F (default %s)\n", CALC_SOCKET_PATH);
+	fprintf(stderr, "  -g N   show N significant digits (default: shortest round-trip)\n");
+	fprintf(stderr, "  -f     scientific or engineering notation\n");
+	fprintf(stderr, "  Runs until SIGINT or SIGTERM.\n");
+}
+
+int main(int argc, char* argv[]) {
+	const char* path = CALC_SOCKET_PATH;
+	server s = {0};
+	s.format = calc_format_default;
+	
+	for (int arg = 1; arg < argc; arg++) {
+		if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+			path = argv[++arg];
+		} else if (strcmp(argv[arg], "-g") == 0 && arg + 1 < argc) {
+			s.format.significant_digits = atoi(argv[++arg]);
+		} else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc) {
+			const char* notation = argv[++arg];
+			s.format.notation = strcmp(notation, "eng") == 0 ? CALC_NOTATION_ENGINEERING : CALC_NOTATION_SCIENTIFIC;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, request_stop);
+	signal(SIGTERM, request_stop);
+	
+	s.listener = listen_on(path);
+	if (s.listener < 0) {
+		return 1;
+	}
+	s.poller = poller_create();
+	if (s.poller < 0 || poller_watch(s.poller, s.listener, &s.listener, 1, 0, 1) != 0) {
+		perror("poller");
+		close(s.listener);
+		unlink(path);
+		return 1;
+	}
+	calc_session_pool_init(&s.sessions, 0);
+	fprintf(stderr, "calc-server: listening on %s\n", path);
+	
+	poller_event events[MAX_EVENTS];
+	while (!stop_requested) {
+		int count = poller_wait(s.poller, events, MAX_EVENTS);
+		if (count < 0) {
+			if (errno != EINTR) {
+				perror("wait");
+				break;
+			}
+			continue;
+		}
+		for (int i = 0; i < count; i++) {
+			if (events[i].ptr == &s.listener) {
+				accept_connections(&s);
+				continue;
+			}
+			connection* c = events[i].ptr;
+			if (c->fd >= 0) {
+				connection_ready(&s, c, &events[i]);
+			}
+		}
+		free_closed(&s);
+	}
+	
+	fprintf(stderr, "calc-server: %zu connections served, %llu requests, %llu keys\n",
+		s.total_connections, s.requests, s.keys);
+	close(s.listener);
+	close(s.poller);
+	unlink(path);
+	calc_session_pool_free(&s.sessions);
+	return 0;
+}
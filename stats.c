@@ -0,0 +1,327 @@
+// Statistics Tool - count, sum, mean, variance and quantiles of a file of numbers
+// Compile with: gcc -O2 -pthread -o calc-stats stats.c calc_stats.c calc_format.c -lm
+//
+// The input is memory-mapped and cut into chunks on separators. Workers take
+// chunks from a shared counter, parse them into blocks of doubles and fold
+// the blocks into their own calc_stats; the main thread merges the summaries
+// at the end, so the data is read exactly once.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "calc_stats.h"
+#include "calc_format.h"
+
+// Values parsed per calc_stats_add_array call
+#define VALUE_BATCH 4096
+
+#define MAX_QUANTILES 32
+
+// ============================================================================
+// Input
+// ============================================================================
+
+typedef struct {
+	const char* data;
+	size_t size;
+	int mapped;
+} input_file;
+
+// Map a file, or read stdin ("-") into memory
+static int open_input(const char* path, input_file* in) {
+	in->data = NULL;
+	in->size = 0;
+	in->mapped = 0;
+	
+	if (strcmp(path, "-") == 0) {
+		size_t capacity = 1 << 16;
+		char* data = malloc(capacity);
+		size_t n;
+		while ((n = fread(data + in->size, 1, capacity - in->size, stdin)) > 0) {
+			in->size += n;
+			if (in->size == capacity) {
+				capacity *= 2;
+				data = realloc(data, capacity);
+			}
+		}
+		in->data = data;
+		return 1;
+	}
+	
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(path);
+		if (fd >= 0) close(fd);
+		return 0;
+	}
+	in->size = (size_t)st.st_size;
+	if (in->size > 0) {
+		void* data = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			perror(path);
+			close(fd);
+			return 0;
+		}
+		madvise(data, in->size, MADV_SEQUENTIAL);
+		in->data = data;
+		in->mapped = 1;
+	}
+	close(fd);
+	return 1;
+}
+
+static void close_input(input_file* in) {
+	if (in->mapped) {
+		munmap((void*)in->data, in->size);
+	} else {
+		free((void*)in->data);
+	}
+}
+
+// ============================================================================
+// Reduction
+// ============================================================================
+
+typedef struct {
+	const char* begin;
+	const char* end;     // Just past a separator (or the end of input)
+} chunk;
+
+typedef struct {
+	chunk* chunks;
+	size_t chunk_count;
+	_Atomic size_t next;    // First chunk nobody has taken
+} reduction;
+
+typedef struct {
+	reduction* red;
+	calc_stats stats;
+	pthread_t thread;
+} worker;
+
+static void* worker_main(void* arg) {
+	worker* w = arg;
+	reduction* red = w->red;
+	double* values = malloc(VALUE_BATCH * sizeof(double));
+	
+	for (;;) {
+		size_t index = atomic_fetch_add_explicit(&red->next, 1, memory_order_relaxed);
+		if (index >= red->chunk_count) {
+			break;
+		}
+		const char* p = red->chunks[index].begin;
+		const char* end = red->chunks[index].end;
+		while (p < end) {
+			size_t count;
+			p = calc_stats_parse(p, end, values, VALUE_BATCH, &count, &w->stats.ignored);
+			calc_stats_add_array(&w->stats, values, count);
+		}
+	}
+	
+	free(values);
+	return NULL;
+}
+
+static int is_separator(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f' || c == ',' || c == ';';
+}
+
+// Cut the input into chunks of about chunk_size bytes, ending after a
+// separator so no number is split
+static size_t split_chunks(const input_file* in, size_t chunk_size, chunk** out) {
+	size_t capacity = in->size / chunk_size + 2;
+	chunk* chunks = calloc(capacity, sizeof(chunk));
+	size_t count = 0;
+	const char* p = in->data;
+	const char* end = in->data + in->size;
+	
+	while (p < end) {
+		const char* stop = (size_t)(end - p) > chunk_size ? p + chunk_size : end;
+		while (stop < end && !is_separator(stop[-1])) {
+			stop++;
+		}
+		if (count == capacity) {
+			capacity *= 2;
+			chunks = realloc(chunks, capacity * sizeof(chunk));
+		}
+		chunks[count].begin = p;
+		chunks[count].end = stop;
+		count++;
+		p = stop;
+	}
+	*out = chunks;
+	return count;
+}
+
+// Summarize the input on up to threads workers into stats (initialized by the
+// caller); returns 0 if not even one worker's summary can be allocated
+static int run(const input_file* in, size_t chunk_size, int threads, calc_stats* stats) {
+	reduction red;
+	red.chunk_count = split_chunks(in, chunk_size, &red.chunks);
+	atomic_init(&red.next, 0);
+	
+	worker* workers = calloc((size_t)threads, sizeof(worker));
+	int started = 0;
+	for (; started < threads; started++) {
+		workers[started].red = &red;
+		if (!calc_stats_init(&workers[started].stats)) {
+			break;
+		}
+		pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]);
+	}
+	
+	for (int t = 0; t < started; t++) {
+		pthread_join(workers[t].thread, NULL);
+		calc_stats_merge(stats, &workers[t].stats);
+		calc_stats_free(&workers[t].stats);
+	}
+	free(workers);
+	free(red.chunks);
+	return started > 0;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Comma-separated quantiles between 0 and 1; returns how many, or -1
+static int parse_quantiles(const char* text, double* quantiles) {
+	int count = 0;
+	while (*text) {
+		char* end;
+		double q = strtod(text, &end);
+		if (end == text || q < 0 || q > 1 || count == MAX_QUANTILES || (*end != ',' && *end != '\0')) {
+			return -1;
+		}
+		quantiles[count++] = q;
+		text = *end ? end + 1 : end;
+	}
+	return count;
+}
+
+static void print_value(const char* name, double value) {
+	char buffer[CALC_FORMAT_BUFFER_SIZE];
+	calc_format_double(buffer, value, &calc_format_default);
+	printf("%-10s %s\n", name, buffer);
+}
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [-t threads] [-c chunk-kb] [-q quantiles] [-s] file\n", argv0);
+	fprintf(stderr, "  -t N   worker threads (default: one per online CPU)\n");
+	fprintf(stderr, "  -c N   chunk size in KiB (default 1024)\n");
+	fprintf(stderr, "  -q L   comma-separated quantiles (default 0.5,0.9,0.99)\n");
+	fprintf(stderr, "  -s     scaling run: time 1..N threads, print no statistics\n");
+	fprintf(stderr, "  Numbers are separated by whitespace, ',' or ';'; other tokens are counted\n");
+	fprintf(stderr, "  as ignored. Use '-' to read stdin.\n");
+}
+
+int main(int argc, char* argv[]) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = cpus > 0 ? (int)cpus : 1;
+	size_t chunk_size = 1024 * 1024;
+	double quantiles[MAX_QUANTILES] = {0.5, 0.9, 0.99};
+	int quantile_count = 3;
+	int scaling = 0;
+	
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+		if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+			threads = atoi(argv[++arg]);
+		} else if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc) {
+			chunk_size = (size_t)atol(argv[++arg]) * 1024;
+		} else if (strcmp(argv[arg], "-q") == 0 && arg + 1 < argc) {
+			quantile_count = parse_quantiles(argv[++arg], quantiles);
+		} else if (strcmp(argv[arg], "-s") == 0) {
+			scaling = 1;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (arg + 1 != argc || threads < 1 || chunk_size == 0 || quantile_count < 0) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	input_file in;
+	if (!open_input(argv[arg], &in)) {
+		return 1;
+	}
+	calc_stats stats;
+	if (!calc_stats_init(&stats)) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		close_input(&in);
+		return 1;
+	}
+	
+	if (scaling) {
+		fprintf(stderr, "%8s %12s %12s %8s\n", "threads", "seconds", "MB/sec", "speedup");
+		double single = 0;
+		for (int t = 1; t <= threads; t++) {
+			calc_stats_clear(&stats);
+			double start = now_seconds();
+			int ok = run(&in, chunk_size, t, &stats);
+			double elapsed = now_seconds() - start;
+			if (!ok) {
+				fprintf(stderr, "%s: out of memory\n", argv[0]);
+				break;
+			}
+			if (t == 1) {
+				single = elapsed;
+			}
+			fprintf(stderr, "%8d %12.4f %12.0f %8.2f\n", t, elapsed,
+				elapsed > 0 ? in.size / elapsed / 1e6 : 0.0, elapsed > 0 ? single / elapsed : 0.0);
+		}
+		calc_stats_free(&stats);
+		close_input(&in);
+		return 0;
+	}
+	
+	double start = now_seconds();
+	int ok = run(&in, chunk_size, threads, &stats);
+	double elapsed = now_seconds() - start;
+	if (!ok) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		calc_stats_free(&stats);
+		close_input(&in);
+		return 1;
+	}
+	
+	printf("%-10s %llu\n", "count", (unsigned long long)stats.count);
+	printf("%-10s %llu\n", "ignored", (unsigned long long)stats.ignored);
+	if (stats.count > 0) {
+		print_value("sum", calc_stats_sum(&stats));
+		print_value("mean", calc_stats_mean(&stats));
+		print_value("variance", calc_stats_variance(&stats, 1));
+		print_value("stddev", calc_stats_stddev(&stats, 1));
+		print_value("min", stats.min);
+		print_value("max", stats.max);
+		for (int i = 0; i < quantile_count; i++) {
+			char name[32];
+			snprintf(name, sizeof(name), "q%g", quantiles[i]);
+			print_value(name, calc_stats_quantile(&stats, quantiles[i]));
+		}
+	}
+	fprintf(stderr, "%s: %zu bytes on %d threads in %.3f s, %.0f MB/sec, %.0f values/sec\n",
+		argv[arg], in.size, threads, elapsed, elapsed > 0 ? in.size / elapsed / 1e6 : 0.0,
+		elapsed > 0 ? stats.count / elapsed : 0.0);
+	
+	calc_stats_free(&stats);
+	close_input(&in);
+	return 0;
+}